@@ -16,64 +16,66 @@
 
 #include "base/PropertyName.h"
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
 namespace BaseProperties
 {
 
-extern const PropertyName PITCH;
-extern const PropertyName VELOCITY;
-extern const PropertyName ACCIDENTAL;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName PITCH;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName VELOCITY;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName ACCIDENTAL;
 
-extern const PropertyName NOTE_TYPE;
-extern const PropertyName NOTE_DOTS;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName NOTE_TYPE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName NOTE_DOTS;
 
-extern const PropertyName MARK_COUNT;
-extern PropertyName getMarkPropertyName(int markNo);
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName MARK_COUNT;
+extern ROSEGARDENPRIVATE_EXPORT PropertyName getMarkPropertyName(int markNo);
 
-extern const PropertyName TIED_BACKWARD;
-extern const PropertyName TIED_FORWARD;
-extern const PropertyName TIE_IS_ABOVE; // optional; default position if absent
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TIED_BACKWARD;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TIED_FORWARD;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TIE_IS_ABOVE; // optional; default position if absent
 
-extern const PropertyName BEAMED_GROUP_ID;
-extern const PropertyName BEAMED_GROUP_TYPE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName BEAMED_GROUP_ID;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName BEAMED_GROUP_TYPE;
 
-extern const PropertyName BEAMED_GROUP_TUPLET_BASE;
-extern const PropertyName BEAMED_GROUP_TUPLED_COUNT;
-extern const PropertyName BEAMED_GROUP_UNTUPLED_COUNT;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName BEAMED_GROUP_TUPLET_BASE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName BEAMED_GROUP_TUPLED_COUNT;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName BEAMED_GROUP_UNTUPLED_COUNT;
 
-extern const PropertyName IS_GRACE_NOTE;
-extern const PropertyName HAS_GRACE_NOTES; // obsolete
-extern const PropertyName MAY_HAVE_GRACE_NOTES; // hint for use by performance helper
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName IS_GRACE_NOTE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName HAS_GRACE_NOTES; // obsolete
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName MAY_HAVE_GRACE_NOTES; // hint for use by performance helper
 
-extern const std::string GROUP_TYPE_BEAMED;
-extern const std::string GROUP_TYPE_TUPLED;
-extern const std::string GROUP_TYPE_GRACE; // obsolete
+extern ROSEGARDENPRIVATE_EXPORT const std::string GROUP_TYPE_BEAMED;
+extern ROSEGARDENPRIVATE_EXPORT const std::string GROUP_TYPE_TUPLED;
+extern ROSEGARDENPRIVATE_EXPORT const std::string GROUP_TYPE_GRACE; // obsolete
 
-extern const PropertyName TRIGGER_EXPAND;
-extern const PropertyName TRIGGER_EXPANSION_DEPTH;
-extern const PropertyName TRIGGER_SEGMENT_ID;
-extern const PropertyName TRIGGER_SEGMENT_RETUNE;
-extern const PropertyName TRIGGER_SEGMENT_ADJUST_TIMES;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TRIGGER_EXPAND;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TRIGGER_EXPANSION_DEPTH;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TRIGGER_SEGMENT_ID;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TRIGGER_SEGMENT_RETUNE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TRIGGER_SEGMENT_ADJUST_TIMES;
 
-extern const std::string TRIGGER_SEGMENT_ADJUST_NONE;
-extern const std::string TRIGGER_SEGMENT_ADJUST_SQUISH;
-extern const std::string TRIGGER_SEGMENT_ADJUST_SYNC_START;
-extern const std::string TRIGGER_SEGMENT_ADJUST_SYNC_END;
+extern ROSEGARDENPRIVATE_EXPORT const std::string TRIGGER_SEGMENT_ADJUST_NONE;
+extern ROSEGARDENPRIVATE_EXPORT const std::string TRIGGER_SEGMENT_ADJUST_SQUISH;
+extern ROSEGARDENPRIVATE_EXPORT const std::string TRIGGER_SEGMENT_ADJUST_SYNC_START;
+extern ROSEGARDENPRIVATE_EXPORT const std::string TRIGGER_SEGMENT_ADJUST_SYNC_END;
 
-extern const PropertyName RECORDED_CHANNEL;
-extern const PropertyName RECORDED_PORT;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName RECORDED_CHANNEL;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName RECORDED_PORT;
 
-extern const PropertyName DISPLACED_X;
-extern const PropertyName DISPLACED_Y;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName DISPLACED_X;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName DISPLACED_Y;
 
-extern const PropertyName INVISIBLE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName INVISIBLE;
 
-extern const PropertyName TMP;         /// TODO : TMP->REPEATING
-extern const PropertyName LINKED_SEGMENT_IGNORE_UPDATE;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName TMP;         /// TODO : TMP->REPEATING
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName LINKED_SEGMENT_IGNORE_UPDATE;
 
-extern const PropertyName MEMBER_OF_PARALLEL;
+extern ROSEGARDENPRIVATE_EXPORT const PropertyName MEMBER_OF_PARALLEL;
 }
 
 }
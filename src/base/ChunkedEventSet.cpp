@@ -0,0 +1,392 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[ChunkedEventSet]"
+
+#include "ChunkedEventSet.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Rosegarden
+{
+
+
+ChunkedEventSet::ChunkedEventSet() :
+    m_size(0),
+    m_version(0)
+{
+}
+
+ChunkedEventSet::ChunkedEventSet(const ChunkedEventSet &other) :
+    m_lastKeys(other.m_lastKeys),
+    m_size(other.m_size),
+    m_version(0)
+{
+    m_chunks.reserve(other.m_chunks.size());
+    for (size_t c = 0; c < other.m_chunks.size(); ++c)
+        m_chunks.push_back(new Chunk(*other.m_chunks[c]));
+}
+
+ChunkedEventSet &
+ChunkedEventSet::operator=(const ChunkedEventSet &other)
+{
+    if (&other == this)
+        return *this;
+
+    ChunkedEventSet copy(other);
+    swap(copy);
+
+    return *this;
+}
+
+ChunkedEventSet::~ChunkedEventSet()
+{
+    for (size_t c = 0; c < m_chunks.size(); ++c)
+        delete m_chunks[c];
+}
+
+void
+ChunkedEventSet::clear()
+{
+    for (size_t c = 0; c < m_chunks.size(); ++c)
+        delete m_chunks[c];
+    m_chunks.clear();
+    m_lastKeys.clear();
+    m_size = 0;
+    ++m_version;
+}
+
+void
+ChunkedEventSet::swap(ChunkedEventSet &other)
+{
+    m_chunks.swap(other.m_chunks);
+    m_lastKeys.swap(other.m_lastKeys);
+    std::swap(m_size, other.m_size);
+    // Iterators belong to the container, not the contents, so
+    // neither set's iterators can be trusted now.
+    m_version = std::max(m_version, other.m_version) + 1;
+    other.m_version = m_version;
+}
+
+void
+ChunkedEventSet::lowerBound(const SortKey &key, size_t &chunk, int &pos) const
+{
+    // First chunk whose last key is not less than key.
+    chunk = std::lower_bound(m_lastKeys.begin(), m_lastKeys.end(), key) -
+            m_lastKeys.begin();
+    if (chunk == m_chunks.size()) {
+        pos = 0;
+        return;
+    }
+
+    const Chunk *c = m_chunks[chunk];
+    pos = static_cast<int>(
+            std::lower_bound(c->keys, c->keys + c->count, key) - c->keys);
+}
+
+void
+ChunkedEventSet::upperBound(const SortKey &key, size_t &chunk, int &pos) const
+{
+    // First chunk whose last key is greater than key.
+    chunk = std::upper_bound(m_lastKeys.begin(), m_lastKeys.end(), key) -
+            m_lastKeys.begin();
+    if (chunk == m_chunks.size()) {
+        pos = 0;
+        return;
+    }
+
+    const Chunk *c = m_chunks[chunk];
+    pos = static_cast<int>(
+            std::upper_bound(c->keys, c->keys + c->count, key) - c->keys);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::lower_bound(Event *e) const
+{
+    size_t chunk;
+    int pos;
+    lowerBound(SortKey(e), chunk, pos);
+    return iterator(this, chunk, pos);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::upper_bound(Event *e) const
+{
+    size_t chunk;
+    int pos;
+    upperBound(SortKey(e), chunk, pos);
+    return iterator(this, chunk, pos);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::find(Event *e) const
+{
+    iterator i = lower_bound(e);
+    if (i == end()  ||  SortKey(e) < m_chunks[i.m_chunk]->keys[i.m_pos])
+        return end();
+    return i;
+}
+
+ChunkedEventSet::size_type
+ChunkedEventSet::count(Event *e) const
+{
+    const SortKey key(e);
+    size_type n = 0;
+
+    size_t chunk;
+    int pos;
+    lowerBound(key, chunk, pos);
+
+    for (; chunk < m_chunks.size(); ++chunk, pos = 0) {
+        const Chunk *c = m_chunks[chunk];
+        for (; pos < c->count; ++pos) {
+            if (key < c->keys[pos])
+                return n;
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::insert(Event *e)
+{
+    size_t chunk;
+    int pos;
+    upperBound(SortKey(e), chunk, pos);
+    return insertAt(chunk, pos, e);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::insert(iterator hint, Event *e)
+{
+    // As std::multiset: use the hint if e belongs right before it,
+    // otherwise search.
+
+    const SortKey key(e);
+    hint.sync();
+
+    if (hint.m_event == nullptr) {
+        // At the end, if e isn't less than the last Event.
+        if (m_size > 0  &&  key < m_lastKeys.back())
+            return insert(e);
+        return insertAt(m_chunks.size(), 0, e);
+    }
+
+    const SortKey hintKey = m_chunks[hint.m_chunk]->keys[hint.m_pos];
+
+    if (!(hintKey < key)) {
+        // e <= *hint.  Insert before hint if *(hint - 1) <= e.
+        if (hint.m_chunk == 0  &&  hint.m_pos == 0)
+            return insertAt(0, 0, e);
+
+        iterator before = hint;
+        --before;
+        if (!(key < m_chunks[before.m_chunk]->keys[before.m_pos]))
+            return insertAt(hint.m_chunk, hint.m_pos, e);
+
+        return insert(e);
+    }
+
+    // *hint < e.  Insert after hint if e <= *(hint + 1).
+    iterator after = hint;
+    ++after;
+    if (after.m_event == nullptr)
+        return insertAt(m_chunks.size(), 0, e);
+    if (!(m_chunks[after.m_chunk]->keys[after.m_pos] < key))
+        return insertAt(after.m_chunk, after.m_pos, e);
+
+    size_t chunk;
+    int pos;
+    lowerBound(key, chunk, pos);
+    return insertAt(chunk, pos, e);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::insertAt(size_t chunk, int pos, Event *e)
+{
+    ++m_version;
+    ++m_size;
+
+    if (m_chunks.empty()) {
+        m_chunks.push_back(new Chunk);
+        m_lastKeys.push_back(SortKey());
+        chunk = 0;
+        pos = 0;
+    } else if (chunk == m_chunks.size()) {
+        // Append to the last chunk.
+        --chunk;
+        pos = m_chunks[chunk]->count;
+    }
+
+    Chunk *c = m_chunks[chunk];
+
+    if (c->count == ChunkCapacity) {
+        // Split the chunk in half.
+        Chunk *next = new Chunk;
+        const int half = ChunkCapacity / 2;
+        next->count = ChunkCapacity - half;
+        memcpy(next->keys, c->keys + half, next->count * sizeof(SortKey));
+        memcpy(next->events, c->events + half, next->count * sizeof(Event *));
+        c->count = half;
+
+        m_chunks.insert(m_chunks.begin() + chunk + 1, next);
+        m_lastKeys.insert(m_lastKeys.begin() + chunk + 1, m_lastKeys[chunk]);
+        m_lastKeys[chunk] = c->keys[half - 1];
+
+        if (pos > half) {
+            ++chunk;
+            pos -= half;
+            c = next;
+        }
+    }
+
+    const int tail = c->count - pos;
+    memmove(c->keys + pos + 1, c->keys + pos, tail * sizeof(SortKey));
+    memmove(c->events + pos + 1, c->events + pos, tail * sizeof(Event *));
+    c->keys[pos] = SortKey(e);
+    c->events[pos] = e;
+    ++c->count;
+
+    if (pos == c->count - 1)
+        m_lastKeys[chunk] = c->keys[pos];
+
+    return iterator(this, chunk, pos);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::erase(iterator i)
+{
+    i.sync();
+
+    ++m_version;
+    --m_size;
+
+    size_t chunk = i.m_chunk;
+    int pos = i.m_pos;
+    Chunk *c = m_chunks[chunk];
+
+    --c->count;
+    const int tail = c->count - pos;
+    memmove(c->keys + pos, c->keys + pos + 1, tail * sizeof(SortKey));
+    memmove(c->events + pos, c->events + pos + 1, tail * sizeof(Event *));
+
+    if (c->count == 0) {
+        delete c;
+        m_chunks.erase(m_chunks.begin() + chunk);
+        m_lastKeys.erase(m_lastKeys.begin() + chunk);
+        return iterator(this, chunk, 0);
+    }
+
+    m_lastKeys[chunk] = c->keys[c->count - 1];
+
+    // Merge with the next chunk if both are running low, so that
+    // erasing doesn't leave lots of nearly empty chunks behind.
+    if (chunk + 1 < m_chunks.size()) {
+        Chunk *next = m_chunks[chunk + 1];
+        if (c->count + next->count <= ChunkCapacity / 2) {
+            memcpy(c->keys + c->count, next->keys, next->count * sizeof(SortKey));
+            memcpy(c->events + c->count, next->events,
+                   next->count * sizeof(Event *));
+            c->count += next->count;
+            delete next;
+            m_chunks.erase(m_chunks.begin() + chunk + 1);
+            m_lastKeys.erase(m_lastKeys.begin() + chunk + 1);
+            m_lastKeys[chunk] = c->keys[c->count - 1];
+        }
+    }
+
+    if (pos == c->count) {
+        ++chunk;
+        pos = 0;
+    }
+
+    return iterator(this, chunk, pos);
+}
+
+ChunkedEventSet::iterator
+ChunkedEventSet::erase(iterator first, iterator last)
+{
+    while (first != last)
+        first = erase(first);
+    return first;
+}
+
+ChunkedEventSet::size_type
+ChunkedEventSet::erase(Event *e)
+{
+    const SortKey key(e);
+    size_type n = 0;
+
+    iterator i = lower_bound(e);
+    while (i != end()  &&  !(key < m_chunks[i.m_chunk]->keys[i.m_pos])) {
+        i = erase(i);
+        ++n;
+    }
+
+    return n;
+}
+
+void
+ChunkedEventSet::relocate(const iterator &i) const
+{
+    i.m_version = m_version;
+
+    if (i.m_event == nullptr) {
+        i.m_chunk = m_chunks.size();
+        i.m_pos = 0;
+        return;
+    }
+
+    // Still where we left it?
+    if (i.m_chunk < m_chunks.size()  &&
+        i.m_pos < m_chunks[i.m_chunk]->count  &&
+        m_chunks[i.m_chunk]->events[i.m_pos] == i.m_event)
+        return;
+
+    // Search the Events that are equivalent to ours.  Go by the key we
+    // kept rather than asking the Event, which may have been deleted.
+    const SortKey &key = i.m_key;
+    size_t chunk;
+    int pos;
+    lowerBound(key, chunk, pos);
+
+    for (; chunk < m_chunks.size(); ++chunk, pos = 0) {
+        const Chunk *c = m_chunks[chunk];
+        for (; pos < c->count; ++pos) {
+            if (c->events[pos] == i.m_event) {
+                i.m_chunk = chunk;
+                i.m_pos = pos;
+                return;
+            }
+            if (key < c->keys[pos])
+                break;
+        }
+        if (pos < c->count)
+            break;
+    }
+
+    // The Event has been erased.  Using an iterator to an erased
+    // element is undefined for std::multiset too, but at least don't
+    // go wandering off into memory that isn't ours.
+    i.m_chunk = m_chunks.size();
+    i.m_pos = 0;
+    i.m_event = nullptr;
+}
+
+
+}
@@ -0,0 +1,334 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_CHUNKED_EVENT_SET_H
+#define RG_CHUNKED_EVENT_SET_H
+
+#include "Event.h"
+#include "TimeT.h"
+
+#include <rosegardenprivate_export.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace Rosegarden
+{
+
+
+/// Sorted Event container with the interface of std::multiset<Event*>.
+/**
+ * The Events are kept in order in a list of fixed size chunks, each
+ * holding up to ChunkCapacity Event pointers alongside their sort keys
+ * (absolute time and sub-ordering).  Searching compares the cached keys
+ * in contiguous arrays rather than following tree nodes scattered about
+ * the heap and dereferencing an Event at each step, and iterating walks
+ * the arrays in order.  Both are a good deal kinder to the cache than
+ * std::multiset, at the cost of insert() and erase() shifting up to
+ * ChunkCapacity pointers.
+ *
+ * Caching the keys is safe as an Event's time and sub-ordering can't
+ * change once it has been constructed.
+ *
+ * Ordering is the same as std::multiset<Event*, Event::EventCmp>:
+ * insert() places an Event after any others that compare equal to it.
+ *
+ * Iterators stay valid across insert() and erase() of other Events,
+ * as with std::multiset.  An iterator remembers the Event it points at
+ * and its sort key along with its position, and if the container has
+ * been modified since, finds that Event again by key.  This makes the
+ * first use of an iterator after a modification O(log n) rather than
+ * O(1).  If the same Event pointer is in the container more than once,
+ * such an iterator will find the first of them.
+ *
+ * iterator and const_iterator are the same type, as they are for
+ * std::multiset, whose elements are always const.
+ *
+ * EventContainer derives from this instead of std::multiset when
+ * RG_CHUNKED_EVENT_CONTAINER is defined (cmake option
+ * USE_CHUNKED_EVENT_CONTAINER).
+ */
+class ROSEGARDENPRIVATE_EXPORT ChunkedEventSet
+{
+private:
+    /// Sort key cached for each Event.  See operator<(Event, Event).
+    struct SortKey
+    {
+        SortKey() : time(0), subOrdering(0) { }
+        explicit SortKey(const Event *e) :
+            time(e->getAbsoluteTime()),
+            subOrdering(e->getSubOrdering()) { }
+
+        bool operator<(const SortKey &other) const
+        {
+            if (time != other.time) return time < other.time;
+            return subOrdering < other.subOrdering;
+        }
+
+        timeT time;
+        short subOrdering;
+    };
+
+public:
+    typedef Event *key_type;
+    typedef Event *value_type;
+    typedef Event::EventCmp key_compare;
+    typedef Event::EventCmp value_compare;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef Event * const &reference;
+    typedef Event * const &const_reference;
+    typedef Event * const *pointer;
+    typedef Event * const *const_pointer;
+
+    /// Number of Events per chunk.
+    static const int ChunkCapacity = 64;
+
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef Event *value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Event * const *pointer;
+        typedef Event * const &reference;
+
+        iterator() :
+            m_set(nullptr), m_chunk(0), m_pos(0),
+            m_event(nullptr), m_version(0) { }
+
+        reference operator*() const;
+        pointer operator->() const  { return &operator*(); }
+
+        iterator &operator++();
+        iterator operator++(int)
+            { iterator tmp(*this); ++*this; return tmp; }
+        iterator &operator--();
+        iterator operator--(int)
+            { iterator tmp(*this); --*this; return tmp; }
+
+        /// Same container and same position.
+        bool operator==(const iterator &other) const;
+        bool operator!=(const iterator &other) const
+            { return !operator==(other); }
+
+    private:
+        friend class ChunkedEventSet;
+
+        iterator(const ChunkedEventSet *set, size_t chunk, int pos);
+
+        /// Catch up with any changes made to the container.
+        void sync() const;
+        /// Pick up the Event and key at (m_chunk, m_pos).
+        void load();
+
+        const ChunkedEventSet *m_set;
+        mutable size_t m_chunk;
+        mutable int m_pos;
+        /// The Event pointed at, or nullptr for end().
+        mutable Event *m_event;
+        /// m_event's sort key, for finding it again without touching
+        /// it, as it may have been erased and deleted since.
+        mutable SortKey m_key;
+        mutable unsigned m_version;
+    };
+
+    typedef iterator const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<iterator> const_reverse_iterator;
+
+    ChunkedEventSet();
+    template <class InputIterator>
+    ChunkedEventSet(InputIterator first, InputIterator last) :
+        m_size(0),
+        m_version(0)
+    {
+        insert(first, last);
+    }
+    ChunkedEventSet(const ChunkedEventSet &other);
+    ChunkedEventSet &operator=(const ChunkedEventSet &other);
+    ~ChunkedEventSet();
+
+    iterator begin() const  { return iterator(this, 0, 0); }
+    iterator end() const  { return iterator(this, m_chunks.size(), 0); }
+    iterator cbegin() const  { return begin(); }
+    iterator cend() const  { return end(); }
+    reverse_iterator rbegin() const  { return reverse_iterator(end()); }
+    reverse_iterator rend() const  { return reverse_iterator(begin()); }
+    reverse_iterator crbegin() const  { return rbegin(); }
+    reverse_iterator crend() const  { return rend(); }
+
+    bool empty() const  { return m_size == 0; }
+    size_type size() const  { return m_size; }
+    size_type max_size() const  { return size_type(-1) / sizeof(Event *); }
+
+    /// Insert after any equivalent Events.
+    iterator insert(Event *e);
+    /// Insert as close as possible to just before hint.
+    iterator insert(iterator hint, Event *e);
+    template <class InputIterator>
+    void insert(InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++first)
+            insert(end(), *first);
+    }
+
+    /// Returns the iterator following the one erased.
+    iterator erase(iterator i);
+    iterator erase(iterator first, iterator last);
+    /// Erase all Events equivalent to e.  Returns the number erased.
+    size_type erase(Event *e);
+
+    void clear();
+    void swap(ChunkedEventSet &other);
+
+    /// The first Event equivalent to e, or end().
+    iterator find(Event *e) const;
+    size_type count(Event *e) const;
+    iterator lower_bound(Event *e) const;
+    iterator upper_bound(Event *e) const;
+    std::pair<iterator, iterator> equal_range(Event *e) const
+        { return std::make_pair(lower_bound(e), upper_bound(e)); }
+
+    key_compare key_comp() const  { return key_compare(); }
+    value_compare value_comp() const  { return value_compare(); }
+
+private:
+    struct Chunk
+    {
+        Chunk() : count(0) { }
+
+        int count;
+        SortKey keys[ChunkCapacity];
+        Event *events[ChunkCapacity];
+    };
+
+    /// Position of the first Event with a key not less than key.
+    void lowerBound(const SortKey &key, size_t &chunk, int &pos) const;
+    /// Position of the first Event with a key greater than key.
+    void upperBound(const SortKey &key, size_t &chunk, int &pos) const;
+
+    /// Insert e before the Event at (chunk, pos).
+    iterator insertAt(size_t chunk, int pos, Event *e);
+
+    /// Update the position of an iterator after the container has changed.
+    void relocate(const iterator &i) const;
+
+    std::vector<Chunk *> m_chunks;
+    /// SortKey of the last Event in each chunk, for searching.
+    std::vector<SortKey> m_lastKeys;
+    size_t m_size;
+    /// Bumped by every change, so that iterators know to relocate.
+    unsigned m_version;
+};
+
+/// Same Event pointers in the same order, as for std::multiset.
+inline bool
+operator==(const ChunkedEventSet &a, const ChunkedEventSet &b)
+{
+    return a.size() == b.size()  &&  std::equal(a.begin(), a.end(), b.begin());
+}
+
+inline bool
+operator!=(const ChunkedEventSet &a, const ChunkedEventSet &b)
+{
+    return !(a == b);
+}
+
+inline
+ChunkedEventSet::iterator::iterator(const ChunkedEventSet *set,
+                                    size_t chunk, int pos) :
+    m_set(set),
+    m_chunk(chunk),
+    m_pos(pos),
+    m_event(nullptr),
+    m_version(set->m_version)
+{
+    load();
+}
+
+inline void
+ChunkedEventSet::iterator::load()
+{
+    if (m_chunk < m_set->m_chunks.size()) {
+        const Chunk *c = m_set->m_chunks[m_chunk];
+        m_event = c->events[m_pos];
+        m_key = c->keys[m_pos];
+    } else {
+        m_event = nullptr;
+    }
+}
+
+inline bool
+ChunkedEventSet::iterator::operator==(const iterator &other) const
+{
+    if (m_set != other.m_set)
+        return false;
+    // Default constructed.
+    if (!m_set)
+        return true;
+
+    sync();
+    other.sync();
+    return m_chunk == other.m_chunk  &&  m_pos == other.m_pos;
+}
+
+inline void
+ChunkedEventSet::iterator::sync() const
+{
+    if (m_version != m_set->m_version)
+        m_set->relocate(*this);
+}
+
+inline ChunkedEventSet::iterator::reference
+ChunkedEventSet::iterator::operator*() const
+{
+    sync();
+    return m_set->m_chunks[m_chunk]->events[m_pos];
+}
+
+inline ChunkedEventSet::iterator &
+ChunkedEventSet::iterator::operator++()
+{
+    sync();
+    if (++m_pos >= m_set->m_chunks[m_chunk]->count) {
+        ++m_chunk;
+        m_pos = 0;
+    }
+    load();
+    return *this;
+}
+
+inline ChunkedEventSet::iterator &
+ChunkedEventSet::iterator::operator--()
+{
+    sync();
+    if (m_pos > 0) {
+        --m_pos;
+    } else {
+        --m_chunk;
+        m_pos = m_set->m_chunks[m_chunk]->count - 1;
+    }
+    load();
+    return *this;
+}
+
+
+}
+
+#endif
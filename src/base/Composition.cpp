@@ -226,8 +226,8 @@ Composition::Composition() :
     m_selectedTrackId(0),
     m_timeSigSegment(TimeSignature::EventType),
     m_tempoSegment(TempoEventType),
-    m_barPositionsNeedCalculating(true),
-    m_tempoTimestampsNeedCalculating(true),
+    m_firstStaleBarPosition(0),
+    m_firstStaleTempoTimestamp(0),
     m_basicQuantizer(new BasicQuantizer()),
     m_notationQuantizer(new NotationQuantizer()),
     m_position(0),
@@ -661,6 +661,9 @@ Composition::getDuration() const
 void
 Composition::setStartMarker(const timeT &sM)
 {
+    // Bar numbering starts from a negative start marker.
+    if ((sM < 0 || m_startMarker < 0) && sM != m_startMarker)
+        invalidateBarPositions(0);
     m_startMarker = sM;
     updateRefreshStatuses();
 }
@@ -703,20 +706,27 @@ Composition::clear()
 void
 Composition::calculateBarPositions() const
 {
-    if (!m_barPositionsNeedCalculating) return;
+    ReferenceSegment &t = m_timeSigSegment;
+
+    if (m_firstStaleBarPosition >= t.size()) return;
 
 #ifdef DEBUG_BAR_STUFF
-    RG_DEBUG << "calculateBarPositions()";
+    RG_DEBUG << "calculateBarPositions() from " << m_firstStaleBarPosition;
 #endif
 
-    ReferenceSegment &t = m_timeSigSegment;
-    ReferenceSegment::iterator i;
+    ReferenceSegment::iterator i = t.begin() + m_firstStaleBarPosition;
 
     timeT lastBarNo = 0;
     timeT lastSigTime = 0;
     timeT barDuration = TimeSignature().getBarDuration();
 
-    if (getStartMarker() < 0) {
+    if (i != t.begin()) {
+        // Carry on from the last time signature that is up to date.
+        const Event *last = *(i - 1);
+        lastBarNo = last->get<Int>(BarNumberProperty);
+        lastSigTime = last->getAbsoluteTime();
+        barDuration = TimeSignature(*last).getBarDuration();
+    } else if (getStartMarker() < 0) {
         if (!t.empty() && (*t.begin())->getAbsoluteTime() <= 0) {
             barDuration = TimeSignature(**t.begin()).getBarDuration();
         }
@@ -727,7 +737,7 @@ Composition::calculateBarPositions() const
 #endif
     }
 
-    for (i = t.begin(); i != t.end(); ++i) {
+    for ( ; i != t.end(); ++i) {
 
         timeT myTime = (*i)->getAbsoluteTime();
         int n = (myTime - lastSigTime) / barDuration;
@@ -753,7 +763,7 @@ Composition::calculateBarPositions() const
         barDuration = TimeSignature(**i).getBarDuration();
     }
 
-    m_barPositionsNeedCalculating = false;
+    m_firstStaleBarPosition = t.size();
 }
 
 int
@@ -887,7 +897,7 @@ Composition::addTimeSignature(timeT t, TimeSignature timeSig)
 
     ReferenceSegment::iterator i =
         m_timeSigSegment.insertEvent(timeSig.getAsEvent(t));
-    m_barPositionsNeedCalculating = true;
+    invalidateBarPositions(std::distance(m_timeSigSegment.begin(), i));
 
     updateRefreshStatuses();
     notifyTimeSignatureChanged();
@@ -979,7 +989,7 @@ void
 Composition::removeTimeSignature(int n)
 {
     m_timeSigSegment.eraseEvent(m_timeSigSegment[n]);
-    m_barPositionsNeedCalculating = true;
+    invalidateBarPositions(n);
     updateRefreshStatuses();
     notifyTimeSignatureChanged();
 }
@@ -1081,6 +1091,7 @@ Composition::addTempoAtTime(timeT time, tempoT tempo, tempoT targetTempo)
     }
 
     ReferenceSegment::iterator i = m_tempoSegment.insertEvent(tempoEvent);
+    invalidateTempoTimestamps(std::distance(m_tempoSegment.begin(), i));
 
     if (fullTempoUpdate) {
 
@@ -1095,7 +1106,6 @@ Composition::addTempoAtTime(timeT time, tempoT tempo, tempoT targetTempo)
         if (targetTempo > 0 && targetTempo > m_maxTempo) m_maxTempo = targetTempo;
     }
 
-    m_tempoTimestampsNeedCalculating = true;
     updateRefreshStatuses();
 
 #ifdef DEBUG_TEMPO_STUFF
@@ -1160,7 +1170,7 @@ Composition::removeTempoChange(int n)
     }
 
     m_tempoSegment.eraseEvent(m_tempoSegment[n]);
-    m_tempoTimestampsNeedCalculating = true;
+    invalidateTempoTimestamps(n);
 
     if (oldTempo == m_minTempo ||
         oldTempo == m_maxTempo ||
@@ -1196,20 +1206,30 @@ Composition::updateExtremeTempos()
     }
 }
 
-RealTime
-Composition::getElapsedRealTime(timeT t) const
+Composition::ReferenceSegment::iterator
+Composition::getTempoForRealTimeAux(ReferenceSegment::iterator i,
+                                    timeT t) const
 {
-    calculateTempoTimestamps();
-
-    ReferenceSegment::iterator i = m_tempoSegment.findNearestTime(t);
     if (i == m_tempoSegment.end()) {
+        // In negative time use the first tempo change, so long as it's
+        // no later than time zero.  See getTempoAtTime().
         i = m_tempoSegment.begin();
         if (t >= 0 ||
             (i == m_tempoSegment.end() || (*i)->getAbsoluteTime() > 0)) {
-            return time2RealTime(t, m_defaultTempo);
+            return m_tempoSegment.end();
         }
     }
 
+    return i;
+}
+
+RealTime
+Composition::getElapsedRealTimeAux(ReferenceSegment::iterator i,
+                                   timeT t) const
+{
+    if (i == m_tempoSegment.end())
+        return time2RealTime(t, m_defaultTempo);
+
     RealTime elapsed;
 
     tempoT target = -1;
@@ -1236,6 +1256,52 @@ Composition::getElapsedRealTime(timeT t) const
     return elapsed;
 }
 
+RealTime
+Composition::getElapsedRealTime(timeT t) const
+{
+    calculateTempoTimestamps();
+
+    ReferenceSegment::iterator i = getTempoForRealTimeAux(
+            m_tempoSegment.findNearestTime(t), t);
+
+    return getElapsedRealTimeAux(i, t);
+}
+
+void
+Composition::getElapsedRealTimes(const std::vector<timeT> &times,
+                                 std::vector<RealTime> &realTimes) const
+{
+    calculateTempoTimestamps();
+
+    realTimes.resize(times.size());
+
+    const ReferenceSegment::iterator begin = m_tempoSegment.begin();
+    const ReferenceSegment::iterator end = m_tempoSegment.end();
+
+    // The last tempo change at or before the current time, or end() if
+    // there isn't one.  Equivalent to findNearestTime().
+    ReferenceSegment::iterator nearest = end;
+    timeT previous = 0;
+
+    for (size_t n = 0; n < times.size(); ++n) {
+        const timeT t = times[n];
+
+        // Out of order.  Start again from the beginning.
+        if (n > 0  &&  t < previous)
+            nearest = end;
+        previous = t;
+
+        ReferenceSegment::iterator next = (nearest == end ? begin : nearest + 1);
+        while (next != end  &&  (*next)->getAbsoluteTime() <= t) {
+            nearest = next;
+            ++next;
+        }
+
+        realTimes[n] = getElapsedRealTimeAux(
+                getTempoForRealTimeAux(nearest, t), t);
+    }
+}
+
 timeT
 Composition::getElapsedTimeForRealTime(RealTime t) const
 {
@@ -1288,7 +1354,7 @@ Composition::getElapsedTimeForRealTime(RealTime t) const
 void
 Composition::calculateTempoTimestamps() const
 {
-    if (!m_tempoTimestampsNeedCalculating) return;
+    if (m_firstStaleTempoTimestamp >= m_tempoSegment.size()) return;
 
     timeT lastTimeT = 0;
     RealTime lastRealTime;
@@ -1296,12 +1362,24 @@ Composition::calculateTempoTimestamps() const
     tempoT tempo = m_defaultTempo;
     tempoT target = -1;
 
+    ReferenceSegment::iterator i =
+            m_tempoSegment.begin() + m_firstStaleTempoTimestamp;
+
+    if (i != m_tempoSegment.begin()) {
+        // Carry on from the last tempo change that is up to date.
+        ReferenceSegment::iterator last = i - 1;
+        lastTimeT = (*last)->getAbsoluteTime();
+        lastRealTime = getTempoTimestamp(*last);
+        tempo = tempoT((*last)->get<Int>(TempoProperty));
+        timeT nextTempoTime = 0;
+        if (!getTempoTarget(last, target, nextTempoTime)) target = -1;
+    }
+
 #ifdef DEBUG_TEMPO_STUFF
-    RG_DEBUG << "calculateTempoTimestamps(): Tempo events are:";
+    RG_DEBUG << "calculateTempoTimestamps(): Tempo events from " << m_firstStaleTempoTimestamp << " are:";
 #endif
 
-    for (ReferenceSegment::iterator i = m_tempoSegment.begin();
-         i != m_tempoSegment.end(); ++i) {
+    for ( ; i != m_tempoSegment.end(); ++i) {
 
         RealTime myTime;
 
@@ -1329,7 +1407,7 @@ Composition::calculateTempoTimestamps() const
         if (!getTempoTarget(i, target, nextTempoTime)) target = -1;
     }
 
-    m_tempoTimestampsNeedCalculating = false;
+    m_firstStaleTempoTimestamp = m_tempoSegment.size();
 }
 
 #ifdef DEBUG_TEMPO_STUFF
@@ -33,6 +33,7 @@
 // System
 #include <set>
 #include <map>
+#include <vector>
 
 namespace Rosegarden 
 {
@@ -578,7 +579,11 @@ public:
      * Set a default tempo for the composition.  This will be
      * overridden by any tempo events encountered during playback.
      */
-    void setCompositionDefaultTempo(tempoT tempo) { m_defaultTempo = tempo; }
+    void setCompositionDefaultTempo(tempoT tempo) {
+        m_defaultTempo = tempo;
+        // The default tempo applies up to the first tempo change.
+        m_firstStaleTempoTimestamp = 0;
+    }
     tempoT getCompositionDefaultTempo() const { return m_defaultTempo; }
 
     /**
@@ -660,6 +665,17 @@ public:
      */
     RealTime getElapsedRealTime(timeT t) const;
 
+    /**
+     * Convert each of the given timeT times to RealTime, as
+     * getElapsedRealTime() would.  The times should be in ascending
+     * order, in which case this takes a single pass over the tempo
+     * changes rather than searching them once per time.  Use this
+     * rather than calling getElapsedRealTime() in a loop when there
+     * are many times to convert.
+     */
+    void getElapsedRealTimes(const std::vector<timeT> &times,
+                             std::vector<RealTime> &realTimes) const;
+
     /**
      * Return the nearest time in timeT units to the point at the
      * given number of microseconds after the beginning of the
@@ -1002,11 +1018,11 @@ protected:
         iterator findRealTime(RealTime time);
         iterator findNearestRealTime(RealTime time);
 
-        std::string getEventType() const { return m_eventType; }
+        std::string getEventType() const { return m_eventType.getName(); }
 
     private:
         iterator find(Event *e);
-        std::string m_eventType;
+        EventTypeName m_eventType;
         // not a set: want random access for bars
         std::vector<Event*> m_events;
     };
@@ -1018,13 +1034,44 @@ protected:
     mutable ReferenceSegment m_tempoSegment;
 
     /// affects m_timeSigSegment
+    /**
+     * Each time signature's bar number depends only on the time
+     * signatures before it, so this recalculates from
+     * m_firstStaleBarPosition onwards.
+     */
     void calculateBarPositions() const;
-    mutable bool m_barPositionsNeedCalculating;
+    /// Time signatures before this index have up to date bar numbers.
+    mutable ReferenceSegment::size_type m_firstStaleBarPosition;
+    /// Mark the bar numbers from time signature n onwards out of date.
+    void invalidateBarPositions(ReferenceSegment::size_type n) const {
+        if (n < m_firstStaleBarPosition) m_firstStaleBarPosition = n;
+    }
     ReferenceSegment::iterator getTimeSignatureAtAux(timeT t) const;
 
     /// affects m_tempoSegment
+    /**
+     * Each tempo change's timestamp depends only on the tempo change
+     * before it, so this recalculates from m_firstStaleTempoTimestamp
+     * onwards.
+     */
     void calculateTempoTimestamps() const;
-    mutable bool m_tempoTimestampsNeedCalculating;
+    /// Tempo changes before this index have up to date timestamps.
+    mutable ReferenceSegment::size_type m_firstStaleTempoTimestamp;
+    /// Mark the timestamps from tempo change n onwards out of date.
+    void invalidateTempoTimestamps(ReferenceSegment::size_type n) const {
+        if (n < m_firstStaleTempoTimestamp) m_firstStaleTempoTimestamp = n;
+    }
+    /// The tempo change in effect at t for getElapsedRealTime().
+    /**
+     * i is the result of m_tempoSegment.findNearestTime(t).  Returns
+     * end() if t precedes all tempo changes and the default tempo
+     * applies.
+     */
+    ReferenceSegment::iterator getTempoForRealTimeAux(
+            ReferenceSegment::iterator i, timeT t) const;
+    /// getElapsedRealTime() given the tempo change in effect at t.
+    RealTime getElapsedRealTimeAux(ReferenceSegment::iterator i,
+                                   timeT t) const;
     RealTime time2RealTime(timeT time, tempoT tempo) const;
     RealTime time2RealTime(timeT time, tempoT tempo,
                            timeT targetTempoTime, tempoT targetTempo) const;
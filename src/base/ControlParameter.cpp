@@ -100,7 +100,7 @@ bool ControlParameter::operator==(const ControlParameter &control) const
 bool operator<(const ControlParameter &a, const ControlParameter &b)
 {
     if (a.m_type != b.m_type)
-        return a.m_type < b.m_type;
+        return a.m_type.getName() < b.m_type.getName();
     else if (a.m_controllerNumber != b.m_controllerNumber)
         return a.m_controllerNumber < b.m_controllerNumber;
     else
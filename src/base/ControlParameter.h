@@ -71,7 +71,7 @@ public:
     };
 
     std::string getName() const { return m_name; }
-    std::string getType() const { return m_type; }
+    std::string getType() const { return m_type.getName(); }
     std::string getDescription() const { return m_description; }
 
     int getMin() const { return m_min; }
@@ -128,7 +128,7 @@ protected:
 
     // The type of event this controller controls (eg "controller" or
     // "pitchbend"); 
-    std::string    m_type;
+    EventTypeName  m_type;
 
     // Descriptive name for this control parameter, or "<none>".
     std::string    m_description;
@@ -76,7 +76,7 @@ class ControllerSearch
                       timeT noLaterThan) const;
     bool matches(Event *e) const;
 
-    const std::string  m_eventType;
+    const EventTypeName m_eventType;
     const int          m_controllerId;
     const Instrument  *m_instrument;
 };
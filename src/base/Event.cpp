@@ -33,35 +33,37 @@ PropertyName Event::EventData::NotationTime = "!notationtime";
 PropertyName Event::EventData::NotationDuration = "!notationduration";
 
 
-Event::EventData::EventData(const std::string &type, timeT absoluteTime,
+Event::EventData::EventData(const EventTypeName &type, timeT absoluteTime,
                             timeT duration, short subOrdering) :
     m_refCount(1),
     m_type(type),
     m_absoluteTime(absoluteTime),
     m_duration(duration),
     m_subOrdering(subOrdering),
-    m_properties(nullptr)
+    m_properties()
 {
-    // empty
+#ifndef NDEBUG
+    m_liveCount.ref();
+#endif
 }
 
-Event::EventData::EventData(const std::string &type, timeT absoluteTime,
+Event::EventData::EventData(const EventTypeName &type, timeT absoluteTime,
                             timeT duration, short subOrdering,
-                            const PropertyMap *properties) :
+                            const PropertyTable &properties) :
     m_refCount(1),
     m_type(type),
     m_absoluteTime(absoluteTime),
     m_duration(duration),
     m_subOrdering(subOrdering),
-    m_properties(properties ? new PropertyMap(*properties) : nullptr)
+    m_properties(properties)
 {
-    // empty
+#ifndef NDEBUG
+    m_liveCount.ref();
+#endif
 }
 
-Event::EventData *Event::EventData::unshare()
+Event::EventData *Event::EventData::unshare() const
 {
-    --m_refCount;
-
     EventData *newData = new EventData
         (m_type, m_absoluteTime, m_duration, m_subOrdering, m_properties);
 
@@ -70,28 +72,25 @@ Event::EventData *Event::EventData::unshare()
 
 Event::EventData::~EventData()
 {
-    if (m_properties) {
-        delete m_properties;
-        m_properties = nullptr;
-    }
+#ifndef NDEBUG
+    m_liveCount.deref();
+#endif
 }
 
 timeT
 Event::EventData::getNotationTime() const
 {
-    if (!m_properties) return m_absoluteTime;
-    PropertyMap::const_iterator i = m_properties->find(NotationTime);
-    if (i == m_properties->end()) return m_absoluteTime;
-    else return static_cast<PropertyStore<Int> *>(i->second)->getData();
+    const PropertyTable::Slot *slot = m_properties.find(NotationTime);
+    if (!slot) return m_absoluteTime;
+    else return PropertyTable::getValue<Int>(*slot);
 }
 
 timeT
 Event::EventData::getNotationDuration() const
 {
-    if (!m_properties) return m_duration;
-    PropertyMap::const_iterator i = m_properties->find(NotationDuration);
-    if (i == m_properties->end()) return m_duration;
-    else return static_cast<PropertyStore<Int> *>(i->second)->getData();
+    const PropertyTable::Slot *slot = m_properties.find(NotationDuration);
+    if (!slot) return m_duration;
+    else return PropertyTable::getValue<Int>(*slot);
 }
 
 timeT
@@ -106,48 +105,38 @@ Event::getGreaterDuration()
 void
 Event::EventData::setTime(const PropertyName &name, timeT t, timeT deft)
 {
-    if (!m_properties) m_properties = new PropertyMap();
-    PropertyMap::iterator i = m_properties->find(name);
+    PropertyTable::Slot *slot = m_properties.find(name);
 
     if (t != deft) {
-        if (i == m_properties->end()) {
-            m_properties->insert(PropertyPair(name, new PropertyStore<Int>(t)));
-        } else {
-            static_cast<PropertyStore<Int> *>(i->second)->setData(t);
-        }
-    } else if (i != m_properties->end()) {
-        delete i->second;
-        m_properties->erase(i);
+        if (!slot) slot = m_properties.insert(name, Int);
+        PropertyTable::setValue<Int>(*slot, t);
+    } else if (slot) {
+        m_properties.erase(slot);
     }
 }
 
-PropertyMap *
-Event::find(const PropertyName &name, PropertyMap::iterator &i)
+PropertyTable *
+Event::find(const PropertyName &name, PropertyTable::Slot *&slot)
 {
-    PropertyMap *map = m_data->m_properties;
+    slot = m_data->m_properties.find(name);
+    if (slot) return &m_data->m_properties;
 
-    if (!map || ((i = map->find(name)) == map->end())) {
+    slot = m_nonPersistentProperties.find(name);
+    if (slot) return &m_nonPersistentProperties;
 
-        map = m_nonPersistentProperties;
-        if (!map) return nullptr;
-
-        i = map->find(name);
-        if (i == map->end()) return nullptr;
-    }
-
-    return map;
+    return nullptr;
 }
 
 bool
 Event::has(const PropertyName &name) const
 {
 #ifndef NDEBUG
-    ++m_hasCount;
+    m_hasCount.ref();
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
-    if (map) return true;
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
+    if (table) return true;
     else return false;
 }
 
@@ -155,16 +144,13 @@ void
 Event::unset(const PropertyName &name)
 {
 #ifndef NDEBUG
-    ++m_unsetCount;
+    m_unsetCount.ref();
 #endif
 
     unshare();
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
-    if (map) {
-        delete i->second;
-        map->erase(i);
-    }
+    PropertyTable::Slot *slot;
+    PropertyTable *table = find(name, slot);
+    if (table) table->erase(slot);
 }
     
 
@@ -172,10 +158,10 @@ PropertyType
 Event::getPropertyType(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
-    if (map) {
-        return i->second->getType();
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
+    if (table) {
+        return slot->type;
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -186,10 +172,10 @@ string
 Event::getPropertyTypeAsString(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
-    if (map) {
-        return i->second->getTypeName();
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
+    if (table) {
+        return PropertyTable::getTypeName(*slot);
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -200,10 +186,10 @@ string
 Event::getAsString(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
-    if (map) {
-        return i->second->unparse();
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
+    if (table) {
+        return PropertyTable::unparse(*slot);
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -297,12 +283,13 @@ Event::toXmlString(timeT expectedTime) const
 
 #ifndef NDEBUG
 
-int Event::m_getCount = 0;
-int Event::m_setCount = 0;
-int Event::m_setMaybeCount = 0;
-int Event::m_hasCount = 0;
-int Event::m_unsetCount = 0;
+QAtomicInt Event::m_getCount = 0;
+QAtomicInt Event::m_setCount = 0;
+QAtomicInt Event::m_setMaybeCount = 0;
+QAtomicInt Event::m_hasCount = 0;
+QAtomicInt Event::m_unsetCount = 0;
 clock_t Event::m_lastStats = clock();
+QAtomicInt Event::EventData::m_liveCount = 0;
 
 void
 Event::dumpStats(ostream &out)
@@ -312,13 +299,31 @@ Event::dumpStats(ostream &out)
     out << "\nEvent stats, since start of run or last report ("
         << ms << "ms ago):" << std::endl;
 
-    out << "Calls to get<>: " << m_getCount << std::endl;
-    out << "Calls to set<>: " << m_setCount << std::endl;
-    out << "Calls to setMaybe<>: " << m_setMaybeCount << std::endl;
-    out << "Calls to has: " << m_hasCount << std::endl;
-    out << "Calls to unset: " << m_unsetCount << std::endl;
+    out << "Calls to get<>: " << m_getCount.load() << std::endl;
+    out << "Calls to set<>: " << m_setCount.load() << std::endl;
+    out << "Calls to setMaybe<>: " << m_setMaybeCount.load() << std::endl;
+    out << "Calls to has: " << m_hasCount.load() << std::endl;
+    out << "Calls to unset: " << m_unsetCount.load() << std::endl;
+
+    // Memory held by live events.  The property tables are shared by
+    // the persistent properties of all EventData objects and the
+    // non-persistent properties of all Events.
+    const int liveCount = EventData::m_liveCount.load();
+    const size_t propertyBytes = PropertyTable::getTotalAllocated();
+    out << "Live event data: " << liveCount << std::endl;
+    out << "Property table bytes: " << propertyBytes << std::endl;
+    if (liveCount > 0) {
+        out << "Approximate bytes per event: "
+            << (liveCount * (sizeof(Event) + sizeof(EventData)) +
+                propertyBytes) / liveCount
+            << std::endl;
+    }
 
-    m_getCount = m_setCount = m_setMaybeCount = m_hasCount = m_unsetCount = 0;
+    m_getCount.store(0);
+    m_setCount.store(0);
+    m_setMaybeCount.store(0);
+    m_hasCount.store(0);
+    m_unsetCount.store(0);
     m_lastStats = clock();
 }
 
@@ -345,11 +350,10 @@ Event::PropertyNames
 Event::getPersistentPropertyNames() const
 {
     PropertyNames v;
-    if (m_data->m_properties) {
-        for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-             i != m_data->m_properties->end(); ++i) {
-            v.push_back(i->first);
-        }
+    v.reserve(m_data->m_properties.size());
+    for (const PropertyTable::Slot *slot = m_data->m_properties.begin();
+         slot != m_data->m_properties.end(); ++slot) {
+        v.push_back(slot->name);
     }
     return v;
 }
@@ -358,11 +362,10 @@ Event::PropertyNames
 Event::getNonPersistentPropertyNames() const
 {
     PropertyNames v;
-    if (m_nonPersistentProperties) {
-        for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-             i != m_nonPersistentProperties->end(); ++i) {
-            v.push_back(i->first);
-        }
+    v.reserve(m_nonPersistentProperties.size());
+    for (const PropertyTable::Slot *slot = m_nonPersistentProperties.begin();
+         slot != m_nonPersistentProperties.end(); ++slot) {
+        v.push_back(slot->name);
     }
     return v;
 }
@@ -370,7 +373,7 @@ Event::getNonPersistentPropertyNames() const
 void
 Event::clearNonPersistentProperties()
 {
-    if (m_nonPersistentProperties) m_nonPersistentProperties->clear();
+    m_nonPersistentProperties.clear();
 }
 
 void
@@ -387,22 +390,9 @@ Event::unsafeChangeTime(timeT offset)
 size_t
 Event::getStorageSize() const
 {
-    size_t s = sizeof(Event) + sizeof(EventData) + m_data->m_type.size();
-    if (m_data->m_properties) {
-        for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-             i != m_data->m_properties->end(); ++i) {
-            s += sizeof(i->first);
-            s += i->second->getStorageSize();
-        }
-    }
-    if (m_nonPersistentProperties) {
-        for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-             i != m_nonPersistentProperties->end(); ++i) {
-            s += sizeof(i->first);
-            s += i->second->getStorageSize();
-        }
-    }
-    return s;
+    return sizeof(Event) + sizeof(EventData) +
+           m_data->m_properties.getStorageSize() +
+           m_nonPersistentProperties.getStorageSize();
 }
 
 bool
@@ -424,28 +414,28 @@ operator<(const Event &a, const Event &b)
 
 QDebug &operator<<(QDebug &dbg, const Event &event)
 {
-    dbg << "Event type :" << event.m_data->m_type << "\n";
+    dbg << "Event type :" << event.m_data->m_type.getName() << "\n";
     dbg << "  Absolute Time :" << event.m_data->m_absoluteTime << "\n";
     dbg << "  Duration :" << event.m_data->m_duration << "\n";
     dbg << "  Sub-ordering :" << event.m_data->m_subOrdering << "\n";
     dbg << "  Persistent properties :\n";
 
-    if (event.m_data->m_properties) {
-        for (const PropertyMap::value_type &property :
-                 *(event.m_data->m_properties)) {
-            dbg << "    " << property.first.getName() << "[" <<
-                   property.first.getValue() << "] :" << *(property.second) <<
-                   "\n";
-        }
+    for (const PropertyTable::Slot &property :
+             event.m_data->m_properties) {
+        dbg << "    " << property.name.getName() << "[" <<
+               property.name.getValue() << "] :" <<
+               PropertyTable::getTypeName(property) << "-" <<
+               PropertyTable::unparse(property) << "\n";
     }
 
-    if (event.m_nonPersistentProperties) {
+    if (!event.m_nonPersistentProperties.empty()) {
         dbg << "  Non-persistent properties :\n";
-        for (const PropertyMap::value_type &property :
-                 *(event.m_nonPersistentProperties)) {
-            dbg << "    " << property.first.getName() << "[" <<
-                   property.first.getValue() << "] :" << *(property.second) <<
-                   "\n";
+        for (const PropertyTable::Slot &property :
+                 event.m_nonPersistentProperties) {
+            dbg << "    " << property.name.getName() << "[" <<
+                   property.name.getValue() << "] :" <<
+                   PropertyTable::getTypeName(property) << "-" <<
+                   PropertyTable::unparse(property) << "\n";
         }
     }
 
@@ -17,13 +17,16 @@
 #ifndef RG_EVENT_H
 #define RG_EVENT_H
 
-#include "PropertyMap.h"
+#include "EventTypeName.h"
+#include "PropertyTable.h"
 #include "Exception.h"
 #include "TimeT.h"
 #include "misc/Debug.h"
 
 #include <rosegardenprivate_export.h>
 
+#include <QAtomicInt>
+
 #include <string>
 #include <vector>
 #include <iostream>
@@ -59,7 +62,7 @@ namespace Rosegarden
  * would lead to an easier to understand and faster implementation of
  * Event.  The concrete types like Note would inherit directly from Event
  * and would provide member objects without using properties and a
- * PropertyMap.  One key downside is that older versions of rg would then
+ * PropertyTable.  One key downside is that older versions of rg would then
  * be unable to preserve properties that they do not understand.
  * Not sure that's a very big deal given that the properties have been
  * pretty stable for quite a while.
@@ -102,17 +105,17 @@ public:
 
     // *** Constructors
 
-    Event(const std::string &type,
+    Event(const EventTypeName &type,
           timeT absoluteTime, timeT duration = 0, short subOrdering = 0) :
         m_data(new EventData(type, absoluteTime, duration, subOrdering)),
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     { }
 
-    Event(const std::string &type,
+    Event(const EventTypeName &type,
           timeT absoluteTime, timeT duration, short subOrdering,
           timeT notationAbsoluteTime, timeT notationDuration) :
         m_data(new EventData(type, absoluteTime, duration, subOrdering)),
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         setNotationAbsoluteTime(notationAbsoluteTime);
         setNotationDuration(notationDuration);
@@ -121,7 +124,7 @@ public:
     // these ctors can't use default args: default has to be obtained from e
 
     Event(const Event &e, timeT absoluteTime) :
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         share(e);
         unshare();
@@ -131,7 +134,7 @@ public:
     }
 
     Event(const Event &e, timeT absoluteTime, timeT duration) :
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         share(e);
         unshare();
@@ -143,7 +146,7 @@ public:
 
     Event(const Event &e, timeT absoluteTime,
           timeT duration, short subOrdering):
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         share(e);
         unshare();
@@ -156,7 +159,7 @@ public:
 
     Event(const Event &e, timeT absoluteTime, timeT duration, short subOrdering,
           timeT notationAbsoluteTime) :
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         share(e);
         unshare();
@@ -169,7 +172,7 @@ public:
 
     Event(const Event &e, timeT absoluteTime, timeT duration, short subOrdering,
           timeT notationAbsoluteTime, timeT notationDuration) :
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         share(e);
         unshare();
@@ -183,7 +186,7 @@ public:
     ~Event()  { lose(); }
 
     Event(const Event &e) :
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     {
         share(e);
     }
@@ -209,6 +212,17 @@ public:
                          getNotationDuration());
     }
 
+    /// Copy, including the non-persistent properties.
+    /**
+     * The copy constructor leaves the non-persistent properties behind,
+     * but they are saved along with the persistent ones, so this is the
+     * copy to take of an Event that is to be saved later.
+     */
+    Event *copyWithNonPersistentProperties() const
+    {
+        return new Event(*this, m_nonPersistentProperties);
+    }
+
     // check if the events are copies
     bool isCopyOf(const Event &e);
 
@@ -224,10 +238,17 @@ public:
             RG_DEBUG << "Event::getType(): FATAL: m_data == nullptr.  Crash likely.";
             return "";
         }
-        return m_data->m_type;
+        return m_data->m_type.getName();
     }
+    /// Interned type of the Event.  Cheaper to compare than getType().
+    const EventTypeName &getTypeName() const  { return m_data->m_type; }
     /// Check Event type.
-    bool isa(const std::string &type) const  { return (m_data->m_type == type); }
+    /**
+     * This is an integer comparison.  Pass one of the EventType constants
+     * (e.g. Note::EventType) rather than a string, as converting a string
+     * to an EventTypeName requires a lookup.
+     */
+    bool isa(const EventTypeName &type) const  { return (m_data->m_type == type); }
 
     timeT getAbsoluteTime() const  { return m_data->m_absoluteTime; }
     timeT getNotationAbsoluteTime() const  { return m_data->getNotationTime(); }
@@ -384,10 +405,10 @@ protected:
 
     Event() :
         m_data(new EventData("", 0, 0, 0)),
-        m_nonPersistentProperties(nullptr)
+        m_nonPersistentProperties()
     { }
 
-    void setType(const std::string &t) { unshare(); m_data->m_type = t; }
+    void setType(const EventTypeName &t) { unshare(); m_data->m_type = t; }
     void setAbsoluteTime(timeT t)      { unshare(); m_data->m_absoluteTime = t; }
     void setDuration(timeT d)          { unshare(); m_data->m_duration = d; }
     void setSubOrdering(short o)       { unshare(); m_data->m_subOrdering = o; }
@@ -400,22 +421,24 @@ private:
     /// Data that are shared between shallow-copied instances
     struct EventData
     {
-        EventData(const std::string &type,
+        EventData(const EventTypeName &type,
                   timeT absoluteTime, timeT duration, short subOrdering);
-        EventData(const std::string &type,
+        EventData(const EventTypeName &type,
                   timeT absoluteTime, timeT duration, short subOrdering,
-                  const PropertyMap *properties);
+                  const PropertyTable &properties);
         /// Make a unique copy.  Used for Copy On Write.
-        EventData *unshare();
+        EventData *unshare() const;
         ~EventData();
-        unsigned int m_refCount;
+        /// Atomic, as copies of the same event may be taken, unshared
+        /// and dropped on different threads at once.
+        QAtomicInt m_refCount;
 
-        std::string m_type;
+        EventTypeName m_type;
         timeT m_absoluteTime;
         timeT m_duration;
         short m_subOrdering;
 
-        PropertyMap *m_properties;
+        PropertyTable m_properties;
 
         // These are properties because we don't care so much about
         // raw speed in get/set, but we do care about storage size for
@@ -427,6 +450,10 @@ private:
             { setTime(NotationDuration, d, m_duration); }
         timeT getNotationDuration() const;
 
+#ifndef NDEBUG
+        static QAtomicInt m_liveCount;
+#endif
+
     private:
         EventData(const EventData &);
         EventData &operator=(const EventData &);
@@ -444,14 +471,19 @@ private:
     //     and see if it makes any sort of performance or memory difference.
     //     Might also be a good idea to see if C++11 move semantics would help.
     EventData *m_data;
-    // ??? This doesn't seem to participate in Copy On Write, so a
-    //     QSharedPointer should simplify managing this.
-    PropertyMap *m_nonPersistentProperties; // Unique to an instance
+    /// Does not participate in Copy On Write.  Unique to an instance.
+    PropertyTable m_nonPersistentProperties;
+
+    Event(const Event &e, const PropertyTable &nonPersistentProperties) :
+        m_nonPersistentProperties(nonPersistentProperties)
+    {
+        share(e);
+    }
 
     void share(const Event &e)
     {
         m_data = e.m_data;
-        m_data->m_refCount++;
+        m_data->m_refCount.ref();
     }
 
     /// Makes a copy.  Used for Copy On Write.
@@ -460,8 +492,11 @@ private:
      */
     bool unshare()
     {
-        if (m_data->m_refCount > 1) {
-            m_data = m_data->unshare();
+        if (m_data->m_refCount.loadAcquire() > 1) {
+            EventData *shared = m_data;
+            m_data = shared->unshare();
+            // The others sharing it may have let go while we copied.
+            if (!shared->m_refCount.deref()) delete shared;
             return true;
         } else {
             return false;
@@ -471,59 +506,51 @@ private:
     /// Dereference and delete.
     void lose()
     {
-        if (--m_data->m_refCount == 0) {
+        if (!m_data->m_refCount.deref()) {
             delete m_data;
             m_data = nullptr;
         }
-        delete m_nonPersistentProperties;
-        m_nonPersistentProperties = nullptr;
+        m_nonPersistentProperties.clear();
     }
 
     /// Find a property in both the persistent and non-persistent properties.
     /**
      * @param[in]  name The property to find.
-     * @param[out] i    An iterator pointing to the property that was found.
+     * @param[out] slot The slot holding the property that was found.
      *                  Invalid if the function return value is nullptr.
-     * \return The map in which the property was found.  Returns nullptr
+     * \return The table in which the property was found.  Returns nullptr
      *         otherwise.
      */
-    PropertyMap *find(const PropertyName &name, PropertyMap::iterator &i);
+    PropertyTable *find(const PropertyName &name, PropertyTable::Slot *&slot);
 
     /// Find a property in both the persistent and non-persistent properties.
     /**
      * @param[in]  name The property to find.
-     * @param[out] i    An iterator pointing to the property that was found.
+     * @param[out] slot The slot holding the property that was found.
      *                  Invalid if the function return value is nullptr.
-     * \return The map in which the property was found.  Returns nullptr
+     * \return The table in which the property was found.  Returns nullptr
      *         otherwise.
      */
-    const PropertyMap *find(const PropertyName &name,
-                            PropertyMap::const_iterator &i) const
+    const PropertyTable *find(const PropertyName &name,
+                              const PropertyTable::Slot *&slot) const
     {
-        PropertyMap::iterator j;
-        PropertyMap *map = const_cast<Event *>(this)->find(name, j);
-        i = j;
-        return map;
+        PropertyTable::Slot *s = nullptr;
+        PropertyTable *table = const_cast<Event *>(this)->find(name, s);
+        slot = s;
+        return table;
     }
 
-    PropertyMap::iterator insert(const PropertyPair &pair, bool persistent)
+    PropertyTable &table(bool persistent)
     {
-        PropertyMap **map =
-            (persistent ? &m_data->m_properties : &m_nonPersistentProperties);
-
-        // If the map hasn't been created yet, create it.
-        if (!*map)
-            *map = new PropertyMap();
-
-        return (*map)->insert(pair).first;
+        return (persistent ? m_data->m_properties : m_nonPersistentProperties);
     }
 
 #ifndef NDEBUG
-    static int m_getCount;
-    static int m_setCount;
-    static int m_setMaybeCount;
-    static int m_hasCount;
-    static int m_unsetCount;
+    static QAtomicInt m_getCount;
+    static QAtomicInt m_setCount;
+    static QAtomicInt m_setMaybeCount;
+    static QAtomicInt m_hasCount;
+    static QAtomicInt m_unsetCount;
     static clock_t m_lastStats;
 #endif
 };
@@ -536,23 +563,22 @@ Event::get(const PropertyName &name,
            typename PropertyDefn<P>::basic_type &val) const
 {
 #ifndef NDEBUG
-    ++m_getCount;
+    m_getCount.ref();
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
 
     // Not found?  Bail.
-    if (!map)
+    if (!table)
         return false;
 
-    PropertyStoreBase *sb = i->second;
-    if (sb->getType() == P) {
-        val = (static_cast<PropertyStore<P> *>(sb))->getData();
+    if (slot->type == P) {
+        val = PropertyTable::getValue<P>(*slot);
         return true;
     } else {
 #ifndef NDEBUG
-        RG_DEBUG << "get() Error: Attempt to get property \"" << name.getName() << "\" as" << PropertyDefn<P>::typeName() <<", actual type is" << sb->getTypeName();
+        RG_DEBUG << "get() Error: Attempt to get property \"" << name.getName() << "\" as" << PropertyDefn<P>::typeName() <<", actual type is" << PropertyTable::getTypeName(*slot);
 #endif
         return false;
     }
@@ -564,20 +590,20 @@ Event::get(const PropertyName &name) const
     // throw (NoData, BadType)
 {
 #ifndef NDEBUG
-    ++m_getCount;
+    m_getCount.ref();
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
 
-    if (map) {
+    if (table) {
 
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P)
-            return (static_cast<PropertyStore<P> *>(sb))->getData();
+        if (slot->type == P)
+            return PropertyTable::getValue<P>(*slot);
         else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(),
+                          PropertyTable::getTypeName(*slot),
                           __FILE__, __LINE__);
         }
 
@@ -597,13 +623,13 @@ bool
 Event::isPersistent(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    const PropertyTable::Slot *slot;
+    const PropertyTable *table = find(name, slot);
 
-    if (!map)
+    if (!table)
         throw NoData(name.getName(), __FILE__, __LINE__);
 
-    return (map == m_data->m_properties);
+    return (table == &m_data->m_properties);
 }
 
 
@@ -614,37 +640,33 @@ Event::set(const PropertyName &name, typename PropertyDefn<P>::basic_type value,
     // throw (BadType)
 {
 #ifndef NDEBUG
-    ++m_setCount;
+    m_setCount.ref();
 #endif
 
-    // this is a little slow, could bear improvement
-
     // Copy on Write
     unshare();
 
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    PropertyTable::Slot *slot;
+    PropertyTable *found = find(name, slot);
 
     // If found, update.
-    if (map) {
-        bool persistentBefore = (map == m_data->m_properties);
-        if (persistentBefore != persistent) {
-            i = insert(*i, persistent);
-            map->erase(name);
-        }
-
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P) {
-            (static_cast<PropertyStore<P> *>(sb))->setData(value);
-        } else {
+    if (found) {
+        if (slot->type != P) {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(),
+                          PropertyTable::getTypeName(*slot),
                           __FILE__, __LINE__);
         }
 
+        bool persistentBefore = (found == &m_data->m_properties);
+        if (persistentBefore != persistent)
+            slot = table(persistent).moveFrom(*found, slot);
+
+        PropertyTable::setValue<P>(*slot, value);
+
     } else {  // Create
-        PropertyStoreBase *p = new PropertyStore<P>(value);
-        insert(PropertyPair(name, p), persistent);
+        slot = table(persistent).insert(name, P);
+        PropertyTable::setValue<P>(*slot, value);
     }
 }
 
@@ -659,34 +681,32 @@ Event::setMaybe(const PropertyName &name, typename PropertyDefn<P>::basic_type v
     // rather than through calls to has, isPersistent and set<>
 
 #ifndef NDEBUG
-    ++m_setMaybeCount;
+    m_setMaybeCount.ref();
 #endif
 
     // Copy On Write
     unshare();
 
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    PropertyTable::Slot *slot;
+    PropertyTable *found = find(name, slot);
 
     // If found, update only if not persistent
-    if (map) {
+    if (found) {
         // If persistent, bail.
-        if (map == m_data->m_properties)
+        if (found == &m_data->m_properties)
             return;
 
-        PropertyStoreBase *sb = i->second;
-
-        if (sb->getType() == P) {
-            (static_cast<PropertyStore<P> *>(sb))->setData(value);
+        if (slot->type == P) {
+            PropertyTable::setValue<P>(*slot, value);
         } else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(),
+                          PropertyTable::getTypeName(*slot),
                           __FILE__, __LINE__);
         }
     } else {  // Create
-        PropertyStoreBase *p = new PropertyStore<P>(value);
-        insert(PropertyPair(name, p),
-               false);  // persistent
+        slot = m_nonPersistentProperties.insert(name, P);
+        PropertyTable::setValue<P>(*slot, value);
     }
 }
 
@@ -0,0 +1,42 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/EventTypeName.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace Rosegarden
+{
+
+
+// A pointer rather than an object so that the type constants in other
+// translation units can be interned during static initialisation,
+// regardless of initialisation order.  See PropertyName.
+EventTypeName::intern_set *EventTypeName::m_interns = nullptr;
+
+const std::string *EventTypeName::intern(const std::string &s)
+{
+    // Function-local for the same reason as m_interns.
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+
+    if (!m_interns)
+        m_interns = new intern_set;
+
+    return &*m_interns->insert(s).first;
+}
+
+}
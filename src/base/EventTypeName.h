@@ -0,0 +1,111 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_EVENT_TYPE_NAME_H
+#define RG_EVENT_TYPE_NAME_H
+
+#include <rosegardenprivate_export.h>
+
+#include <ostream>
+#include <set>
+#include <string>
+
+namespace Rosegarden
+{
+
+
+/// An interned Event type such as "note" or "clefchange".
+/**
+ * EventTypeName does for Event types what PropertyName does for
+ * property names: the string is interned once and from then on an
+ * EventTypeName is a pointer to the one interned copy of the string,
+ * so equality is a pointer comparison.  Event::isa() is called in
+ * nearly every loop over a Segment, so this matters.
+ *
+ * The type constants (Note::EventType, Clef::EventType, etc...) are
+ * EventTypeNames.  An EventTypeName converts implicitly to and from
+ * std::string so that code which treats types as strings (XML I/O,
+ * dialogs, debugging output) keeps working.  Constructing one from a
+ * string costs a map lookup, so avoid doing that in a loop.
+ *
+ * Ordering compares the strings themselves, so that maps keyed on
+ * EventTypeName (and anything written out from them) come out in the
+ * same order on every run.
+ *
+ * getName() needs no lookup, so it is safe to call from any thread.
+ * Interning is serialised.
+ */
+class ROSEGARDENPRIVATE_EXPORT EventTypeName
+{
+public:
+    EventTypeName() : m_name(intern(std::string())) { }
+    EventTypeName(const char *cs) : m_name(intern(std::string(cs))) { }
+    EventTypeName(const std::string &s) : m_name(intern(s)) { }
+
+    bool operator==(const EventTypeName &t) const {
+        return m_name == t.m_name;
+    }
+    bool operator!=(const EventTypeName &t) const {
+        return m_name != t.m_name;
+    }
+    bool operator<(const EventTypeName &t) const {
+        if (m_name == t.m_name)
+            return false;
+        return *m_name < *t.m_name;
+    }
+
+    /// The original string.  O(1).
+    const std::string &getName() const  { return *m_name; }
+
+    operator const std::string &() const  { return getName(); }
+
+private:
+    /// A set, so that the interned strings never move.
+    typedef std::set<std::string> intern_set;
+
+    static intern_set *m_interns;
+
+    /// The interned copy of the string.
+    const std::string *m_name;
+
+    static const std::string *intern(const std::string &s);
+};
+
+inline bool operator==(const std::string &s, const EventTypeName &t) {
+    return s == t.getName();
+}
+inline bool operator!=(const std::string &s, const EventTypeName &t) {
+    return s != t.getName();
+}
+inline bool operator==(const EventTypeName &t, const std::string &s) {
+    return s == t.getName();
+}
+inline bool operator!=(const EventTypeName &t, const std::string &s) {
+    return s != t.getName();
+}
+
+inline std::ostream &operator<<(std::ostream &out, const EventTypeName &t) {
+    out << t.getName();
+    return out;
+}
+
+inline std::string operator+(const std::string &s, const EventTypeName &t) {
+    return s + t.getName();
+}
+
+
+}
+
+#endif
@@ -18,9 +18,12 @@
 
 #include "Exception.h"
 #include "MidiProgram.h"  // For MidiByte
+#include "EventTypeName.h"
 #include "PropertyName.h"
 #include "TimeT.h"
 
+#include <rosegardenprivate_export.h>
+
 #include <string>
 
 // Internal representation of some very MIDI-specific event types
@@ -39,11 +42,11 @@ class Event;
 
 namespace PitchBend
 {
-    extern const std::string EventType;
+    extern ROSEGARDENPRIVATE_EXPORT const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
-    extern const PropertyName MSB;
-    extern const PropertyName LSB;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName MSB;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName LSB;
 
     /// Returned Event is on heap; caller takes responsibility for ownership.
     Event *makeEvent(timeT absoluteTime, MidiByte msb, MidiByte lsb);
@@ -53,11 +56,11 @@ namespace PitchBend
 
 namespace Controller
 {
-    extern const std::string EventType;
+    extern ROSEGARDENPRIVATE_EXPORT const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
-    extern const PropertyName NUMBER;
-    extern const PropertyName VALUE;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName NUMBER;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName VALUE;
 
     /// Returned Event is on heap; caller takes responsibility for ownership.
     Event *makeEvent(timeT absoluteTime, MidiByte number, MidiByte value);
@@ -67,11 +70,11 @@ namespace Controller
 
 namespace KeyPressure
 {
-    extern const std::string EventType;
+    extern ROSEGARDENPRIVATE_EXPORT const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
-    extern const PropertyName PITCH;
-    extern const PropertyName PRESSURE;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName PITCH;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName PRESSURE;
 
     /// Returned Event is on heap; caller takes responsibility for ownership.
     Event *makeEvent(timeT absoluteTime, MidiByte pitch, MidiByte pressure);
@@ -81,10 +84,10 @@ namespace KeyPressure
 
 namespace ChannelPressure
 {
-    extern const std::string EventType;
+    extern ROSEGARDENPRIVATE_EXPORT const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
-    extern const PropertyName PRESSURE;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName PRESSURE;
 
     /// Returned Event is on heap; caller takes responsibility for ownership.
     Event *makeEvent(timeT absoluteTime, MidiByte pressure);
@@ -94,10 +97,10 @@ namespace ChannelPressure
 
 namespace ProgramChange
 {
-    extern const std::string EventType;
+    extern ROSEGARDENPRIVATE_EXPORT const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
-    extern const PropertyName PROGRAM;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName PROGRAM;
 
     /// Returned Event is on heap; caller takes responsibility for ownership.
     Event *makeEvent(timeT absoluteTime, MidiByte program);
@@ -107,14 +110,14 @@ namespace ProgramChange
 
 namespace SystemExclusive
 {
-    extern const std::string EventType;
+    extern ROSEGARDENPRIVATE_EXPORT const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     struct BadEncoding : public Exception {
         BadEncoding() : Exception("Bad SysEx encoding") { }
     };
 
-    extern const PropertyName DATABLOCK;
+    extern ROSEGARDENPRIVATE_EXPORT const PropertyName DATABLOCK;
 
     /// Returned Event is on heap; caller takes responsibility for ownership.
     Event *makeEvent(timeT absoluteTime, const std::string &rawData);
@@ -542,8 +542,10 @@ NotationQuantizer::Impl::quantizeDurationProvisional(Segment *, Segment::iterato
 void
 NotationQuantizer::Impl::quantizeDuration(Segment *s, Chord &c) const
 {
+#ifdef DEBUG_NOTATION_QUANTIZER
     static int totalFracCount = 0;
     static float totalFrac = 0;
+#endif
 
     Profiler profiler("NotationQuantizer::Impl::quantizeDuration");
 
@@ -629,11 +631,13 @@ NotationQuantizer::Impl::quantizeDuration(Segment *s, Chord &c) const
 
 	timeT spaceAvailable = nextNoteTime - qt;
 	
+#ifdef DEBUG_NOTATION_QUANTIZER
 	if (spaceAvailable > 0) {
 	    float frac = float(ud) / float(spaceAvailable);
 	    totalFrac += frac;
 	    totalFracCount += 1;
 	}
+#endif
 
 	if (!m_contrapuntal && qd > spaceAvailable) {
 
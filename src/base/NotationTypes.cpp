@@ -280,7 +280,7 @@ using namespace Marks;
 // Clef
 //////////////////////////////////////////////////////////////////////
 
-const string Clef::EventType = "clefchange";
+const EventTypeName Clef::EventType = "clefchange";
 const int Clef::EventSubOrdering = -250;
 const PropertyName Clef::ClefPropertyName = "clef";
 const PropertyName Clef::OctaveOffsetPropertyName = "octaveoffset";
@@ -437,7 +437,7 @@ Event *Clef::getAsEvent(timeT absoluteTime) const
 
 Key::KeyDetailMap Key::m_keyDetailMap = Key::KeyDetailMap();
 
-const string Key::EventType = "keychange";
+const EventTypeName Key::EventType = "keychange";
 const int Key::EventSubOrdering = -200;
 const PropertyName Key::KeyPropertyName = "key";
 const Key Key::DefaultKey = Key("C major");
@@ -741,7 +741,7 @@ Key::KeyDetails& Key::KeyDetails::operator=(const Key::KeyDetails &d)
 // Indication
 //////////////////////////////////////////////////////////////////////
 
-const std::string Indication::EventType = "indication";
+const EventTypeName Indication::EventType = "indication";
 const int Indication::EventSubOrdering = -50;
 const PropertyName Indication::IndicationTypePropertyName = "indicationtype";
 //const PropertyName Indication::IndicationDurationPropertyName = "indicationduration";
@@ -830,7 +830,7 @@ Indication::isValid(const std::string &s) const
 // Text
 //////////////////////////////////////////////////////////////////////
 
-const std::string Text::EventType = "text";
+const EventTypeName Text::EventType = "text";
 const int Text::EventSubOrdering = -70;
 const PropertyName Text::TextPropertyName = "text";
 const PropertyName Text::TextTypePropertyName = "type";
@@ -1878,8 +1878,8 @@ Pitch Pitch::transpose(const Key &key, int pitchDelta, int heightDelta)
 // Note
 //////////////////////////////////////////////////////////////////////
 
-const string Note::EventType = "note";
-const string Note::EventRestType = "rest";
+const EventTypeName Note::EventType = "note";
+const EventTypeName Note::EventRestType = "rest";
 const int Note::EventRestSubOrdering = 10;
 
 const timeT Note::m_shortestTime = basePPQ / 16;
@@ -1951,7 +1951,7 @@ Event *Note::getAsRestEvent(timeT absoluteTime) const
 // TimeSignature
 //////////////////////////////////////////////////////////////////////
 
-const string TimeSignature::EventType = "timesignature";
+const EventTypeName TimeSignature::EventType = "timesignature";
 const int TimeSignature::EventSubOrdering = -150;
 const PropertyName TimeSignature::NumeratorPropertyName = "numerator";
 const PropertyName TimeSignature::DenominatorPropertyName = "denominator";
@@ -2490,7 +2490,7 @@ AccidentalTable::newClef(const Clef &clef)
 // Symbol
 //////////////////////////////////////////////////////////////////////
 
-const std::string Symbol::EventType = "symbol";
+const EventTypeName Symbol::EventType = "symbol";
 const int Symbol::EventSubOrdering = -70;
 const PropertyName Symbol::SymbolTypePropertyName = "type";
 
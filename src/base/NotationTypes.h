@@ -264,7 +264,7 @@ namespace Marks //!!! This would be better as a class, these days
 class ROSEGARDENPRIVATE_EXPORT Clef
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName ClefPropertyName;
     static const PropertyName OctaveOffsetPropertyName;
@@ -387,7 +387,7 @@ private:
 class ROSEGARDENPRIVATE_EXPORT Key
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName KeyPropertyName;
     static const Key DefaultKey;
@@ -619,7 +619,7 @@ private:
 class Indication
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName IndicationTypePropertyName;
     typedef Exception BadIndicationName;
@@ -687,7 +687,7 @@ private:
 class Text
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName TextPropertyName;
     static const PropertyName TextTypePropertyName;
@@ -1047,8 +1047,8 @@ class TimeSignature;
 class ROSEGARDENPRIVATE_EXPORT Note
 {
 public:
-    static const std::string EventType;
-    static const std::string EventRestType;
+    static const EventTypeName EventType;
+    static const EventTypeName EventRestType;
     static const int EventRestSubOrdering;
 
     typedef int Type; // not an enum, too much arithmetic at stake
@@ -1280,7 +1280,7 @@ private:
     TimeSignature(const Event &e)
         /* throw (Event::NoData, Event::BadType, BadTimeSignature) */;
 
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName NumeratorPropertyName;
     static const PropertyName DenominatorPropertyName;
@@ -1393,7 +1393,7 @@ private:
 class ROSEGARDENPRIVATE_EXPORT Symbol
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName SymbolTypePropertyName;
 
@@ -24,6 +24,14 @@
 #include <map>
 
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutexLocker>
 
 using std::cerr;
 using std::endl;
@@ -34,6 +42,9 @@ Profiles* Profiles::m_instance = nullptr;
 
 Profiles* Profiles::getInstance()
 {
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+
     if (!m_instance) m_instance = new Profiles();
     
     return m_instance;
@@ -57,6 +68,8 @@ void Profiles::accumulate(
 )
 {
 #ifndef NO_TIMING    
+    QMutexLocker locker(&m_mutex);
+
     ProfilePair &pair(m_profiles[id]);
     ++pair.first;
     pair.second.first += time;
@@ -80,6 +93,8 @@ void Profiles::dump() const
 {
 #ifndef NO_TIMING
 
+    QMutexLocker locker(&m_mutex);
+
     fprintf(stderr, "Profiling points:\n");
 
     fprintf(stderr, "\nBy name:\n");
@@ -173,10 +188,226 @@ void Profiles::dump() const
 #endif
 }
 
+QAtomicInt ProfileTrace::m_recording(0);
+QAtomicPointer<ProfileTrace::ThreadBuffer> ProfileTrace::m_buffers(nullptr);
+qint64 ProfileTrace::m_startTime = 0;
+
+qint64
+ProfileTrace::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void
+ProfileTrace::start()
+{
+    if (!m_buffers.loadAcquire())
+        m_buffers.storeRelease(new ThreadBuffer[MaxThreads]);
+
+    m_startTime = now();
+    m_recording.storeRelease(1);
+}
+
+void
+ProfileTrace::stop()
+{
+    m_recording.storeRelease(0);
+}
+
+namespace
+{
+    /// The calling thread's claim on a ProfileTrace buffer.
+    /**
+     * Hands the buffer back to the pool when the thread exits.  A
+     * template only because ProfileTrace::ThreadBuffer is private.
+     */
+    template <class Buffer>
+    struct ThreadBufferClaim
+    {
+        ThreadBufferClaim() : buffer(nullptr)  { }
+        ~ThreadBufferClaim()
+        {
+            if (buffer)
+                buffer->state.storeRelease(Buffer::Released);
+        }
+
+        Buffer *buffer;
+    };
+}
+
+ProfileTrace::ThreadBuffer *
+ProfileTrace::claimBuffer(ThreadBuffer *buffers, ThreadBuffer::State state)
+{
+    for (int i = 0; i < MaxThreads; ++i) {
+        if (buffers[i].state.loadAcquire() == state  &&
+            buffers[i].state.testAndSetOrdered(state, ThreadBuffer::InUse))
+            return &buffers[i];
+    }
+
+    return nullptr;
+}
+
+ProfileTrace::ThreadBuffer *
+ProfileTrace::getThreadBuffer()
+{
+    static thread_local ThreadBufferClaim<ThreadBuffer> claim;
+
+    if (claim.buffer)
+        return claim.buffer;
+
+    ThreadBuffer *buffers = m_buffers.loadAcquire();
+    if (!buffers)
+        return nullptr;
+
+    // Prefer a buffer no thread has used, so that the records of threads
+    // that have exited are kept as long as possible.  If there are none
+    // free, try again next time, as a thread may have exited by then.
+    ThreadBuffer *buffer = claimBuffer(buffers, ThreadBuffer::Unused);
+    if (!buffer)
+        buffer = claimBuffer(buffers, ThreadBuffer::Released);
+    if (!buffer)
+        return nullptr;
+
+    // Only this thread writes to its buffer.  These are published to
+    // exportChromeTrace() by the first store to written.
+    buffer->written.storeRelease(0);
+    buffer->tid = int(syscall(SYS_gettid));
+    if (pthread_getname_np(pthread_self(), buffer->threadName,
+                           sizeof(buffer->threadName)) != 0)
+        buffer->threadName[0] = '\0';
+
+    claim.buffer = buffer;
+
+    return buffer;
+}
+
+void
+ProfileTrace::record(const char *name, qint64 start, qint64 end)
+{
+    ThreadBuffer *buffer = getThreadBuffer();
+    if (!buffer)
+        return;
+
+    const int written = buffer->written.load();
+
+    Record &r = buffer->records[written % RingSize];
+    r.name = name;
+    r.start = start;
+    r.duration = end - start;
+
+    // Wrap well before overflowing, keeping the same position in the
+    // ring.
+    int next = written + 1;
+    if (next >= (1 << 30))
+        next -= RingSize * (1 << 16);
+    buffer->written.storeRelease(next);
+}
+
+namespace
+{
+    /// Append s to json as a quoted string.
+    void appendJsonString(QByteArray &json, const char *s)
+    {
+        json += '"';
+        for (; *s; ++s) {
+            const unsigned char c = *s;
+            if (c == '"'  ||  c == '\\') {
+                json += '\\';
+                json += char(c);
+            } else if (c < 0x20) {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                json += escape;
+            } else {
+                json += char(c);
+            }
+        }
+        json += '"';
+    }
+}
+
+bool
+ProfileTrace::exportChromeTrace(const QString &fileName)
+{
+    const ThreadBuffer *buffers = m_buffers.loadAcquire();
+    const int pid = int(getpid());
+
+    QByteArray json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    char line[256];
+
+    for (int t = 0; buffers  &&  t < MaxThreads; ++t) {
+        const ThreadBuffer &buffer = buffers[t];
+
+        const int written = buffer.written.loadAcquire();
+        if (written == 0)
+            continue;
+
+        if (!first)
+            json += ",\n";
+        first = false;
+
+        snprintf(line, sizeof(line),
+                 "{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                 "\"name\":\"thread_name\",\"args\":{\"name\":",
+                 pid, buffer.tid);
+        json += line;
+        appendJsonString(json, buffer.threadName[0] ? buffer.threadName : "?");
+        json += "}}";
+
+        const int count = qMin(written, int(RecordsPerThread));
+        std::vector<Record> records;
+        records.reserve(count);
+        for (int i = written - count; i < written; ++i)
+            records.push_back(buffer.records[i % RingSize]);
+
+        // A thread that was part way through recording when stop() was
+        // called may have been overwriting the oldest of these while we
+        // copied them.  Record i is overwritten by the write of record
+        // i + RingSize, so drop any that might have been.
+        const int writtenAfter = buffer.written.loadAcquire();
+        size_t overwritten = 0;
+        if (writtenAfter < written) {
+            // Wrapped.  Can't tell, so drop the lot.
+            overwritten = records.size();
+        } else {
+            const int firstSafe = writtenAfter - RingSize + 1;
+            if (firstSafe > written - count)
+                overwritten = qMin(size_t(firstSafe - (written - count)),
+                                   records.size());
+        }
+
+        for (size_t i = overwritten; i < records.size(); ++i) {
+            const Record &r = records[i];
+            if (r.start < m_startTime)
+                continue;
+
+            json += ",\n{\"ph\":\"X\",\"name\":";
+            appendJsonString(json, r.name);
+            snprintf(line, sizeof(line),
+                     ",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     pid, buffer.tid,
+                     double(r.start - m_startTime) / 1000.0,
+                     double(r.duration) / 1000.0);
+            json += line;
+        }
+    }
+
+    json += "\n]}\n";
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return file.write(json) == json.size();
+}
+
 #ifndef NO_TIMING    
 
 Profiler::Profiler(const char* c, bool showOnDestruct) :
     m_c(c),
+    m_traceStart(ProfileTrace::isRecording() ? ProfileTrace::now() : 0),
     m_showOnDestruct(showOnDestruct),
     m_ended(false)
 {
@@ -217,6 +448,9 @@ Profiler::end()
 
     Profiles::getInstance()->accumulate(m_c, elapsedCPU, elapsedTime);
 
+    if (m_traceStart  &&  ProfileTrace::isRecording())
+        ProfileTrace::record(m_c, m_traceStart, ProfileTrace::now());
+
     if (m_showOnDestruct)
         cerr << "Profiler : id = " << m_c
              << " - elapsed = " << ((elapsedCPU * 1000) / CLOCKS_PER_SEC)
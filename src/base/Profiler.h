@@ -24,6 +24,14 @@
 
 #include "RealTime.h"
 
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+#include <rosegardenprivate_export.h>
+
 //#define NO_TIMING 1
 
 //#define WANT_TIMING 1
@@ -66,9 +74,134 @@ protected:
     LastCallMap m_lastCalls;
     WorstCallMap m_worstCalls;
 
+    /// Profilers may be used on threads other than the GUI thread.
+    mutable QMutex m_mutex;
+
     static Profiles* m_instance;
 };
 
+/// Per-thread trace of timed scopes, for viewing in chrome://tracing.
+/**
+ * Unlike Profiles, which accumulates totals and is compiled out of
+ * release builds, ProfileTrace is always available and is switched on
+ * and off at runtime.  While it is recording, every Profiler and
+ * ProfileTrace::Scope logs its name, start time and duration.
+ * exportChromeTrace() then writes what was logged as Chrome trace-event
+ * JSON, which chrome://tracing, Perfetto and friends can display as a
+ * timeline per thread.
+ *
+ * Recording is safe on the JACK process callback and the sequencer
+ * thread: it takes no locks and allocates no memory, other than the
+ * C++ runtime noting, once per thread, that the thread's buffer is to
+ * be released when it exits.  Each thread claims a ring buffer from a
+ * pool of MaxThreads the first time it records, and keeps its most
+ * recent RecordsPerThread records there.  When the thread exits, its
+ * buffer goes back to the pool.  Its records are still exported until
+ * another thread claims the buffer.  When recording is off, the cost
+ * of a scope is a single atomic load.
+ *
+ * Names must be string literals (or otherwise live for the life of the
+ * program) as only the pointer is stored.
+ *
+ * Running "kill -USR2" on the Rosegarden process starts recording, and
+ * doing it again stops recording and exports the trace to a temporary
+ * file.  See RosegardenMainWindow::signalAction().
+ */
+class ROSEGARDENPRIVATE_EXPORT ProfileTrace
+{
+public:
+    /// Threads beyond this many recording at once will be ignored.
+    static const int MaxThreads = 32;
+    /// Most recent records kept for each thread.
+    static const int RecordsPerThread = 8192;
+
+    /// Whether Profilers should record anything.  Cheap.
+    static bool isRecording()  { return m_recording.load() != 0; }
+
+    /// Start recording.  Records from any previous recording are dropped.
+    static void start();
+    /// Stop recording.  What was recorded can then be exported.
+    static void stop();
+
+    /**
+     * Write the records from the last recording to fileName in Chrome
+     * trace-event JSON format.  Call stop() first.
+     *
+     * Returns false if the file couldn't be written.
+     */
+    static bool exportChromeTrace(const QString &fileName);
+
+    /// Monotonic time in nanoseconds, as used for the records.
+    static qint64 now();
+
+    /// Record a scope that ran from start to end (see now()).
+    static void record(const char *name, qint64 start, qint64 end);
+
+    /// Records the time from construction to destruction.
+    /**
+     * Use this rather than Profiler in code that must stay realtime safe
+     * in debug builds, as Profiler also accumulates into Profiles, which
+     * locks a mutex.
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name) :
+            m_name(name),
+            m_start(isRecording() ? now() : 0)
+        { }
+        ~Scope()
+        {
+            if (m_start  &&  isRecording())
+                record(m_name, m_start, now());
+        }
+
+    private:
+        const char *m_name;
+        qint64 m_start;
+    };
+
+private:
+    /// One spare slot, so that a record being written as the trace is
+    /// exported doesn't overwrite one of the RecordsPerThread exported.
+    static const int RingSize = RecordsPerThread + 1;
+
+    struct Record
+    {
+        const char *name;
+        qint64 start;
+        qint64 duration;
+    };
+
+    struct ThreadBuffer
+    {
+        enum State { Unused, InUse, Released };
+        /// Claimed with a compare and swap.
+        QAtomicInt state;
+
+        /// Linux thread ID, for the "tid" in the trace.
+        int tid;
+        char threadName[16];
+        /// Total records written.  The newest is at (written - 1) %
+        /// RingSize.
+        QAtomicInt written;
+        Record records[RingSize];
+    };
+
+    /// The calling thread's buffer, claiming one if need be.
+    static ThreadBuffer *getThreadBuffer();
+    /// Claim a buffer in the given state, if there is one.
+    static ThreadBuffer *claimBuffer(ThreadBuffer *buffers,
+                                     ThreadBuffer::State state);
+
+    static QAtomicInt m_recording;
+    /// Allocated by the first start(), and never freed as realtime
+    /// threads might be using it at any time.
+    static QAtomicPointer<ThreadBuffer> m_buffers;
+    /// now() at the last start().  Older records are not exported.
+    static qint64 m_startTime;
+};
+
 #ifndef NO_TIMING
 
 /**
@@ -99,20 +232,38 @@ protected:
     const char* m_c;
     clock_t m_startCPU;
     RealTime m_startTime;
+    /// ProfileTrace::now() at construction, or 0 if not recording.
+    qint64 m_traceStart;
     bool m_showOnDestruct;
     bool m_ended;
 };
 
 #else
 
+/**
+ * Without timing, a Profiler only records to ProfileTrace, so that
+ * release builds can still be profiled.
+ */
 class Profiler
 {
 public:
-    Profiler(const char *, bool = false) { }
-    ~Profiler() { }
+    Profiler(const char *name, bool = false) :
+        m_name(name),
+        m_traceStart(ProfileTrace::isRecording() ? ProfileTrace::now() : 0)
+    { }
+    ~Profiler()  { end(); }
 
     void update() const { }
-    void end() { }
+    void end()
+    {
+        if (m_traceStart  &&  ProfileTrace::isRecording())
+            ProfileTrace::record(m_name, m_traceStart, ProfileTrace::now());
+        m_traceStart = 0;
+    }
+
+private:
+    const char *m_name;
+    qint64 m_traceStart;
 };
 
 #endif
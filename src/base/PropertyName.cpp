@@ -20,6 +20,9 @@
 #include "base/PropertyName.h"
 #include "base/Exception.h"
 
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QtGlobal>
 
 namespace Rosegarden 
@@ -27,46 +30,94 @@ namespace Rosegarden
 using std::string;
 
 PropertyName::intern_map *PropertyName::m_interns = nullptr;
-PropertyName::intern_reverse_map *PropertyName::m_internsReversed = nullptr;
 int PropertyName::m_nextValue = 0;
 
+namespace
+{
+    // Function-local so that it is there for the property name
+    // constants during static initialisation.
+    QMutex &internMutex()
+    {
+        static QMutex mutex;
+        return mutex;
+    }
+
+    // The names by value, for getName().  Blocks of slots are
+    // allocated as values are handed out and are never freed or
+    // changed afterwards, so readers need no lock.  Plain arrays of
+    // QBasicAtomicPointer need no dynamic initialisation, so this is
+    // all null before any static constructor runs.
+    typedef QBasicAtomicPointer<const string> NameSlot;
+    const int SlotsPerBlock = 256;
+    const int MaxBlocks = 4096;
+    QBasicAtomicPointer<NameSlot> nameBlocks[MaxBlocks];
+
+    void publishName(int value, const string *name)
+    {
+        NameSlot *block = nameBlocks[value / SlotsPerBlock].load();
+        if (!block) {
+            block = new NameSlot[SlotsPerBlock]();
+            nameBlocks[value / SlotsPerBlock].storeRelease(block);
+        }
+        block[value % SlotsPerBlock].storeRelease(name);
+    }
+
+    const string *lookUpName(int value)
+    {
+        if (value < 0  ||  value >= MaxBlocks * SlotsPerBlock)
+            return nullptr;
+
+        const NameSlot *block =
+                nameBlocks[value / SlotsPerBlock].loadAcquire();
+        if (!block)
+            return nullptr;
+
+        return block[value % SlotsPerBlock].loadAcquire();
+    }
+}
+
 int PropertyName::intern(const string &s)
 {
-    if (!m_interns) {
+    QMutexLocker locker(&internMutex());
+
+    if (!m_interns)
         m_interns = new intern_map;
-        m_internsReversed = new intern_reverse_map;
-    }
 
     intern_map::iterator i(m_interns->find(s));
     
     if (i != m_interns->end()) {
         return i->second;
     } else {
+        if (m_nextValue + 1 >= MaxBlocks * SlotsPerBlock) {
+            throw Exception("PropertyName::intern(): too many property names");
+        }
         int nv = ++m_nextValue;
-        m_interns->insert(intern_pair(s, nv));
-        m_internsReversed->insert(intern_reverse_pair(nv, s));
+        // Map keys never move, so getName() can refer to this one.
+        i = m_interns->insert(intern_pair(s, nv)).first;
+        publishName(nv, &i->first);
         return nv;
     }
 }
 
 string PropertyName::getName() const
 {
-    intern_reverse_map::iterator i(m_internsReversed->find(m_value));
-    if (i != m_internsReversed->end()) return i->second;
+    const string *name = lookUpName(m_value);
+    if (name) return *name;
+
+    QMutexLocker locker(&internMutex());
 
     // dump some informative data, even if we aren't in debug mode,
     // because this really shouldn't be happening
     std::cerr << "ERROR: PropertyName::getName: value corrupted!\n";
     std::cerr << "PropertyName's internal value is " << m_value << std::endl;
-    std::cerr << "Reverse interns are ";
-    i = m_internsReversed->begin();
-    if (i == m_internsReversed->end()) std::cerr << "(none)";
-    else while (i != m_internsReversed->end()) {
-	if (i != m_internsReversed->begin()) {
+    std::cerr << "Interns are ";
+    if (!m_interns  ||  m_interns->empty()) std::cerr << "(none)";
+    else for (intern_map::const_iterator i = m_interns->begin();
+              i != m_interns->end(); ++i) {
+	if (i != m_interns->begin()) {
 	    std::cerr << ", ";
 	}
-	std::cerr << i->first << "=" << i->second;
-	++i;
+	std::cerr << i->second << "=" << i->first;
     }
     std::cerr << std::endl;
 
@@ -67,6 +67,10 @@ namespace Rosegarden
   store the string representation of a PropertyName in a property;
   but that's slow.)
 
+  Interning is serialised, so PropertyNames may be made on any thread.
+  getName() takes no lock: each name is published in a table indexed
+  by value as it is interned, and never changes after that.
+
 */
 
 class ROSEGARDENPRIVATE_EXPORT PropertyName
@@ -109,11 +113,7 @@ private:
     typedef std::map<std::string, int> intern_map;
     typedef intern_map::value_type intern_pair;
 
-    typedef std::map<int, std::string> intern_reverse_map;
-    typedef intern_reverse_map::value_type intern_reverse_pair;
-
     static intern_map *m_interns;
-    static intern_reverse_map *m_internsReversed;
     static int m_nextValue;
 
     int m_value;
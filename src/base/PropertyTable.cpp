@@ -0,0 +1,233 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "PropertyTable.h"
+
+#include <algorithm>
+
+namespace Rosegarden
+{
+
+
+#ifndef NDEBUG
+QAtomicInt PropertyTable::m_totalAllocated = 0;
+#endif
+
+namespace
+{
+    struct SlotNameCmp
+    {
+        bool operator()(const PropertyTable::Slot &slot,
+                        const PropertyName &name) const
+        {
+            return slot.name < name;
+        }
+    };
+}
+
+PropertyTable::PropertyTable(const PropertyTable &other) :
+    m_slots(nullptr),
+    m_size(0),
+    m_capacity(0)
+{
+    if (other.m_size == 0)
+        return;
+
+    // Exact fit.  Most tables are copied by Event::unshare() and are
+    // then either left alone or grown by a single property.
+    reserve(other.m_size);
+
+    for (unsigned int i = 0; i < other.m_size; ++i) {
+        m_slots[i] = other.m_slots[i];
+        if (m_slots[i].type == String)
+            m_slots[i].stringValue = new std::string(*other.m_slots[i].stringValue);
+    }
+    m_size = other.m_size;
+}
+
+PropertyTable::~PropertyTable()
+{
+    clear();
+}
+
+PropertyTable::Slot *
+PropertyTable::find(const PropertyName &name)
+{
+    Slot *slot = std::lower_bound(begin(), end(), name, SlotNameCmp());
+    if (slot == end()  ||  !(slot->name == name))
+        return nullptr;
+    return slot;
+}
+
+PropertyTable::Slot *
+PropertyTable::insert(const PropertyName &name, PropertyType type)
+{
+    const unsigned int index =
+        std::lower_bound(begin(), end(), name, SlotNameCmp()) - begin();
+
+    Slot *slot = makeSlot(index, name, type);
+
+    switch (type) {
+    case Int:
+        slot->intValue = 0;
+        break;
+    case Bool:
+        slot->boolValue = false;
+        break;
+    case RealTimeT:
+        slot->realTimeValue.sec = 0;
+        slot->realTimeValue.nsec = 0;
+        break;
+    case String:
+        slot->stringValue = new std::string;
+        break;
+    }
+
+    return slot;
+}
+
+PropertyTable::Slot *
+PropertyTable::moveFrom(PropertyTable &other, Slot *otherSlot)
+{
+    const unsigned int index =
+        std::lower_bound(begin(), end(), otherSlot->name, SlotNameCmp()) -
+        begin();
+
+    Slot *slot = makeSlot(index, otherSlot->name, otherSlot->type);
+    *slot = *otherSlot;
+
+    // Ownership of any string has been transferred, so remove the
+    // old slot without going through erase().
+    const unsigned int otherIndex = otherSlot - other.m_slots;
+    std::copy(other.m_slots + otherIndex + 1, other.m_slots + other.m_size,
+              other.m_slots + otherIndex);
+    --other.m_size;
+
+    return slot;
+}
+
+void
+PropertyTable::erase(Slot *slot)
+{
+    if (slot->type == String)
+        delete slot->stringValue;
+
+    std::copy(slot + 1, end(), slot);
+    --m_size;
+}
+
+void
+PropertyTable::clear()
+{
+    for (Slot *slot = begin(); slot != end(); ++slot) {
+        if (slot->type == String)
+            delete slot->stringValue;
+    }
+
+#ifndef NDEBUG
+    m_totalAllocated.fetchAndAddRelaxed(-int(m_capacity * sizeof(Slot)));
+#endif
+
+    delete[] m_slots;
+    m_slots = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+}
+
+PropertyTable::Slot *
+PropertyTable::makeSlot(unsigned int index, const PropertyName &name,
+                        PropertyType type)
+{
+    if (m_size == m_capacity) {
+        // Grow slowly.  Tables are small and memory is what we are
+        // trying to save here.
+        reserve(m_capacity < 4 ? 4 : m_capacity + m_capacity / 2);
+    }
+
+    std::copy_backward(m_slots + index, m_slots + m_size,
+                       m_slots + m_size + 1);
+    ++m_size;
+
+    Slot *slot = m_slots + index;
+    slot->name = name;
+    slot->type = type;
+    return slot;
+}
+
+void
+PropertyTable::reserve(unsigned int capacity)
+{
+    if (capacity <= m_capacity)
+        return;
+
+    Slot *slots = new Slot[capacity];
+    std::copy(m_slots, m_slots + m_size, slots);
+    delete[] m_slots;
+
+#ifndef NDEBUG
+    m_totalAllocated.fetchAndAddRelaxed(int((capacity - m_capacity) * sizeof(Slot)));
+#endif
+
+    m_slots = slots;
+    m_capacity = capacity;
+}
+
+std::string
+PropertyTable::getTypeName(const Slot &slot)
+{
+    switch (slot.type) {
+    case Int:
+        return PropertyDefn<Int>::typeName();
+    case String:
+        return PropertyDefn<String>::typeName();
+    case Bool:
+        return PropertyDefn<Bool>::typeName();
+    case RealTimeT:
+        return PropertyDefn<RealTimeT>::typeName();
+    }
+
+    return "";
+}
+
+std::string
+PropertyTable::unparse(const Slot &slot)
+{
+    switch (slot.type) {
+    case Int:
+        return PropertyDefn<Int>::unparse(getValue<Int>(slot));
+    case String:
+        return PropertyDefn<String>::unparse(getValue<String>(slot));
+    case Bool:
+        return PropertyDefn<Bool>::unparse(getValue<Bool>(slot));
+    case RealTimeT:
+        return PropertyDefn<RealTimeT>::unparse(getValue<RealTimeT>(slot));
+    }
+
+    return "";
+}
+
+size_t
+PropertyTable::getStorageSize() const
+{
+    size_t s = m_capacity * sizeof(Slot);
+    for (const Slot *slot = begin(); slot != end(); ++slot) {
+        if (slot->type == String)
+            s += sizeof(std::string) + slot->stringValue->size();
+    }
+    return s;
+}
+
+
+}
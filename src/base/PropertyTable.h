@@ -0,0 +1,207 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_PROPERTY_TABLE_H
+#define RG_PROPERTY_TABLE_H
+
+#include "Property.h"
+#include "PropertyName.h"
+
+#include <rosegardenprivate_export.h>
+
+#include <QAtomicInt>
+
+#include <string>
+
+namespace Rosegarden
+{
+
+
+/// Compact property storage for Event.
+/**
+ * A PropertyTable is a flat array of slots sorted by the interned value
+ * of their PropertyName.  Int, Bool and RealTimeT values are stored
+ * inline in the slot, only String values need a separate allocation.
+ * All of an Event's properties therefore live in a single heap block,
+ * rather than one std::map node plus one PropertyStore per property as
+ * with PropertyMap.  Copying a table (which is what Copy On Write in
+ * Event does) is a single allocation and a loop.
+ *
+ * Lookup is a binary search over the slots.  Events rarely carry more
+ * than a dozen properties, so insertion by shifting the tail of the
+ * array is cheaper in practice than maintaining a tree.
+ *
+ * Slot pointers are invalidated by insert() and erase() on the same
+ * table.
+ *
+ * PropertyMap is still used by Configuration, which needs the
+ * std::map interface.
+ */
+class ROSEGARDENPRIVATE_EXPORT PropertyTable
+{
+public:
+    struct Slot
+    {
+        PropertyName name;
+        PropertyType type;
+
+        struct RealTimeValue
+        {
+            int sec;
+            int nsec;
+        };
+
+        union {
+            long intValue;
+            bool boolValue;
+            RealTimeValue realTimeValue;
+            std::string *stringValue;
+        };
+    };
+
+    PropertyTable() :
+        m_slots(nullptr),
+        m_size(0),
+        m_capacity(0)
+    { }
+    PropertyTable(const PropertyTable &other);
+    ~PropertyTable();
+
+    bool empty() const  { return m_size == 0; }
+    unsigned int size() const  { return m_size; }
+
+    Slot *begin()  { return m_slots; }
+    Slot *end()  { return m_slots + m_size; }
+    const Slot *begin() const  { return m_slots; }
+    const Slot *end() const  { return m_slots + m_size; }
+
+    /// Returns nullptr if the property is not in the table.
+    Slot *find(const PropertyName &name);
+    const Slot *find(const PropertyName &name) const
+        { return const_cast<PropertyTable *>(this)->find(name); }
+
+    /// Add a slot for a property that is not yet in the table.
+    /**
+     * The value of the new slot is zero (or an empty string).
+     */
+    Slot *insert(const PropertyName &name, PropertyType type);
+
+    /// Move a slot (and its value) from another table into this one.
+    /**
+     * The property must not already be present in this table.  Returns
+     * the new slot.
+     */
+    Slot *moveFrom(PropertyTable &other, Slot *slot);
+
+    void erase(Slot *slot);
+    void clear();
+
+    template <PropertyType P>
+    static typename PropertyDefn<P>::basic_type getValue(const Slot &slot);
+
+    template <PropertyType P>
+    static void setValue(Slot &slot, typename PropertyDefn<P>::basic_type value);
+
+    static std::string getTypeName(const Slot &slot);
+    static std::string unparse(const Slot &slot);
+
+    /// Heap storage used by this table.  For debugging and inspection.
+    size_t getStorageSize() const;
+
+#ifndef NDEBUG
+    /// Heap storage used by the slot arrays of all tables.
+    static size_t getTotalAllocated()  { return size_t(m_totalAllocated.load()); }
+#endif
+
+private:
+    PropertyTable &operator=(const PropertyTable &); // not provided
+
+    /// Make room for a slot at index, growing the array if needed.
+    Slot *makeSlot(unsigned int index, const PropertyName &name,
+                   PropertyType type);
+    void reserve(unsigned int capacity);
+
+    Slot *m_slots;
+    unsigned int m_size;
+    unsigned int m_capacity;
+
+#ifndef NDEBUG
+    static QAtomicInt m_totalAllocated;
+#endif
+};
+
+template <>
+inline PropertyDefn<Int>::basic_type
+PropertyTable::getValue<Int>(const Slot &slot)
+{
+    return slot.intValue;
+}
+
+template <>
+inline PropertyDefn<String>::basic_type
+PropertyTable::getValue<String>(const Slot &slot)
+{
+    return *slot.stringValue;
+}
+
+template <>
+inline PropertyDefn<Bool>::basic_type
+PropertyTable::getValue<Bool>(const Slot &slot)
+{
+    return slot.boolValue;
+}
+
+template <>
+inline PropertyDefn<RealTimeT>::basic_type
+PropertyTable::getValue<RealTimeT>(const Slot &slot)
+{
+    return RealTime(slot.realTimeValue.sec, slot.realTimeValue.nsec);
+}
+
+template <>
+inline void
+PropertyTable::setValue<Int>(Slot &slot, PropertyDefn<Int>::basic_type value)
+{
+    slot.intValue = value;
+}
+
+template <>
+inline void
+PropertyTable::setValue<String>(Slot &slot,
+                                PropertyDefn<String>::basic_type value)
+{
+    *slot.stringValue = value;
+}
+
+template <>
+inline void
+PropertyTable::setValue<Bool>(Slot &slot, PropertyDefn<Bool>::basic_type value)
+{
+    slot.boolValue = value;
+}
+
+template <>
+inline void
+PropertyTable::setValue<RealTimeT>(Slot &slot,
+                                   PropertyDefn<RealTimeT>::basic_type value)
+{
+    slot.realTimeValue.sec = value.sec;
+    slot.realTimeValue.nsec = value.nsec;
+}
+
+
+}
+
+#endif
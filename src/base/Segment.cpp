@@ -27,6 +27,7 @@
 #include "gui/general/GUIPalette.h"
 #include "misc/Debug.h"
 
+#include <QAtomicInt>
 #include <QtGlobal>
 
 #include <iostream>
@@ -45,7 +46,9 @@ using std::string;
 
 //#define DEBUG_NORMALIZE_RESTS 1
 
-static int g_runtimeSegmentId = 0;
+// Segments are made on more than one thread when converting files in
+// a batch (see BatchConverter).
+static QAtomicInt g_runtimeSegmentId;
 
 Segment::Segment(SegmentType segmentType, timeT startTime) :
     EventContainer(),
@@ -75,7 +78,7 @@ Segment::Segment(SegmentType segmentType, timeT startTime) :
     m_notifyResizeLocked(false),
     m_memoStart(0),
     m_memoEndMarkerTime(nullptr),
-    m_runtimeSegmentId(g_runtimeSegmentId++),
+    m_runtimeSegmentId(g_runtimeSegmentId.fetchAndAddRelaxed(1)),
     m_snapGridSize(-1),
     m_viewFeatures(0),
     m_autoFade(false),
@@ -123,7 +126,7 @@ Segment::Segment(const Segment &segment):
     m_notifyResizeLocked(false),  // To copy a segment while notifications
     m_memoStart(0),               // are locked doesn't sound as a good
     m_memoEndMarkerTime(nullptr),       // idea.
-    m_runtimeSegmentId(g_runtimeSegmentId++),
+    m_runtimeSegmentId(g_runtimeSegmentId.fetchAndAddRelaxed(1)),
     m_snapGridSize(-1),
     m_viewFeatures(0),
     m_autoFade(segment.isAutoFading()),
@@ -1841,7 +1844,7 @@ allEventsChanged(const Segment *s)
 // Find the next Event of "type".
 EventContainer::iterator
 EventContainer::findEventOfType(EventContainer::iterator i,
-                                const std::string &type)
+                                const EventTypeName &type)
 {
     for (; i != end(); ++i) {
         Event *e = *i;
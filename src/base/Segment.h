@@ -23,6 +23,9 @@
 
 #include "Track.h"
 #include "Event.h"
+#ifdef RG_CHUNKED_EVENT_CONTAINER
+#include "ChunkedEventSet.h"
+#endif
 #include "base/NotationTypes.h"
 #include "RefreshStatus.h"
 #include "RealTime.h"
@@ -57,20 +60,30 @@ class Composition;
 class SegmentLinker;
 class BasicCommand;
 
+#ifdef RG_CHUNKED_EVENT_CONTAINER
+typedef ChunkedEventSet EventContainerBase;
+#else
+typedef std::multiset<Event*, Event::EventCmp> EventContainerBase;
+#endif
+
 /// Container of Event objects.
 /**
  * EventContainer is a precursor to Segment, used in code that needs
  * to store events but doesn't need all the ancillary data and
  * behaviors that Segment provides.
  *
+ * The underlying container is a std::multiset, or a ChunkedEventSet
+ * if RG_CHUNKED_EVENT_CONTAINER is defined.  Both have the same
+ * interface.
+ *
  * ??? The STL container classes are not intended to be derived from.
  *     They provide no virtual dtor.  EventContainer should instead
  *     have a std::multiset member object.
  */
-class ROSEGARDENPRIVATE_EXPORT EventContainer : public std::multiset<Event*, Event::EventCmp>
+class ROSEGARDENPRIVATE_EXPORT EventContainer : public EventContainerBase
 {
  public:
-    iterator findEventOfType(iterator i, const std::string &type);
+    iterator findEventOfType(iterator i, const EventTypeName &type);
 };
 
 /// Container of Event objects.
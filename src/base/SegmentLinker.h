@@ -20,13 +20,15 @@
 #include "Segment.h"
 #include <QObject>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden 
 {
 
 class Command;
 class Event;
 
-class SegmentLinker : public QObject
+class ROSEGARDENPRIVATE_EXPORT SegmentLinker : public QObject
 {
     Q_OBJECT
     
@@ -235,7 +235,7 @@ SegmentNotationHelper::getPreviousAdjacentNote(iterator i,
 Segment::iterator
 SegmentNotationHelper::findContiguousNext(iterator el) 
 {
-    std::string elType = (*el)->getType(),
+    EventTypeName elType = (*el)->getTypeName(),
         reject, accept;
      
     if (elType == Note::EventType) {
@@ -254,7 +254,7 @@ SegmentNotationHelper::findContiguousNext(iterator el)
     iterator i = ++el;
     
     for(; isBeforeEndMarker(i); ++i) {
-        std::string iType = (*i)->getType();
+        const EventTypeName &iType = (*i)->getTypeName();
 
         if (iType == reject) {
             success = false;
@@ -276,7 +276,7 @@ SegmentNotationHelper::findContiguousPrevious(iterator el)
 {
     if (el == begin()) return end();
 
-    std::string elType = (*el)->getType(),
+    EventTypeName elType = (*el)->getTypeName(),
         reject, accept;
      
     if (elType == Note::EventType) {
@@ -295,7 +295,7 @@ SegmentNotationHelper::findContiguousPrevious(iterator el)
     iterator i = --el;
 
     while (true) {
-        std::string iType = (*i)->getType();
+        const EventTypeName &iType = (*i)->getTypeName();
 
         if (iType == reject) {
             success = false;
@@ -1110,7 +1110,7 @@ SegmentNotationHelper::insertSingleSomething(iterator i, int duration,
         // erase i and all subsequent events with the same type and
         // absolute time
         timeT time((*i)->getAbsoluteTime());
-        std::string type((*i)->getType());
+        EventTypeName type((*i)->getTypeName());
         iterator j(i);
         while (j != end() && (*j)->getAbsoluteTime() == time) {
             ++j;
@@ -340,7 +340,7 @@ EventSelection::contains(Event *e) const
 }
 
 bool
-EventSelection::contains(const std::string &type) const
+EventSelection::contains(const EventTypeName &type) const
 {
     for (EventContainer::const_iterator i = m_segmentEvents.begin();
 	 i != m_segmentEvents.end(); ++i) {
@@ -105,7 +105,7 @@ public:
      * Return true if there are any events of the given type in
      * this selection.  Slow.
      */
-    bool contains(const std::string &eventType) const;
+    bool contains(const EventTypeName &eventType) const;
 
     /**
      * Return the time at which the first Event in the selection
@@ -465,7 +465,7 @@ GenericChord<Element, Container, singleStaff>::test(const Iterator &i)
     // notes] and perhaps a bit safer to do it by testing for
     // inclusion rather than exclusion.)
 
-    std::string type(e->getType());
+    const EventTypeName &type(e->getTypeName());
     return (type == Note::EventType ||
             type == Note::EventRestType ||
             type == Text::EventType ||
@@ -114,6 +114,7 @@ Studio::addDevice(const std::string &name,
     }
 
     m_devices.push_back(d);
+    indexDevice(d);
 }
 
 void
@@ -124,11 +125,40 @@ Studio::removeDevice(DeviceId id)
         if ((*it)->getId() == id) {
             delete *it;
             m_devices.erase(it);
+            // Rare enough that starting again is simplest, and that
+            // finds any other device with the same ID.
+            reindexDevices();
             return;
         }
     }
 }
 
+void
+Studio::indexDevice(Device *device)
+{
+    // insert() leaves an existing entry alone, so the first device
+    // with an ID wins, as it did when we searched the list.
+    m_deviceIndex.insert(DeviceIndex::value_type(device->getId(), device));
+
+    InstrumentList list = device->getAllInstruments();
+    for (InstrumentList::iterator it = list.begin(); it != list.end(); ++it) {
+        m_instrumentIndex.insert
+            (InstrumentIndex::value_type((*it)->getId(), *it));
+    }
+}
+
+void
+Studio::reindexDevices()
+{
+    m_deviceIndex.clear();
+    m_instrumentIndex.clear();
+
+    for (DeviceListIterator it = m_devices.begin();
+         it != m_devices.end(); ++it) {
+        indexDevice(*it);
+    }
+}
+
 void
 Studio::resyncDeviceConnections()
 {
@@ -245,21 +275,11 @@ Studio::getPresentationInstruments() const
 Instrument*
 Studio::getInstrumentById(InstrumentId id)
 {
-    std::vector<Device*>::iterator it;
-    InstrumentList list;
-    InstrumentList::iterator iit;
-
-    for (it = m_devices.begin(); it != m_devices.end(); ++it)
-    {
-        list = (*it)->getAllInstruments();
-
-        for (iit = list.begin(); iit != list.end(); ++iit)
-            if ((*iit)->getId() == id)
-                return (*iit);
-    }
-
-    return nullptr;
+    InstrumentIndex::const_iterator it = m_instrumentIndex.find(id);
+    if (it == m_instrumentIndex.end())
+        return nullptr;
 
+    return it->second;
 }
 
 // From a user selection (from a "Presentation" list) return
@@ -327,6 +347,11 @@ Studio::getBusses()
 Buss *
 Studio::getBussById(BussId id)
 {
+    // addBuss() and setBussCount() keep each buss at the index of its
+    // ID, so we only need to look further if something went wrong.
+    if (id < m_busses.size()  &&  m_busses[id]->getId() == id)
+        return m_busses[id];
+
     for (BussList::iterator i = m_busses.begin(); i != m_busses.end(); ++i) {
         if ((*i)->getId() == id) return *i;
     }
@@ -470,6 +495,9 @@ Studio::clear()
         delete *it;
 
     m_devices.erase(m_devices.begin(), m_devices.end());
+
+    m_deviceIndex.clear();
+    m_instrumentIndex.clear();
 }
 
 std::string
@@ -533,34 +561,26 @@ Studio::toXmlString(const std::vector<DeviceId> &devices) const
 const MidiMetronome *
 Studio::getMetronomeFromDevice(DeviceId id)
 {
-    // For each Device
-    for (std::vector<Device *>::const_iterator deviceIter = m_devices.begin();
-         deviceIter != m_devices.end();
-         ++deviceIter) {
-
-        //RG_DEBUG << "getMetronomeFromDevice(): Having a look at device " << (*it)->getId();
-
-        // No ID match?  Try the next.
-        if ((*deviceIter)->getId() != id)
-            continue;
+    Device *device = getDevice(id);
+    if (!device)
+        return nullptr;
 
-        MidiDevice *midiDevice = dynamic_cast<MidiDevice *>(*deviceIter);
+    MidiDevice *midiDevice = dynamic_cast<MidiDevice *>(device);
 
-        // If it's a MidiDevice and it has a metronome, return it.
-        if (midiDevice  &&
-            midiDevice->getMetronome()) {
-            //RG_DEBUG << "getMetronomeFromDevice(" << id << "): device is a MIDI device";
-            return midiDevice->getMetronome();
-        }
+    // If it's a MidiDevice and it has a metronome, return it.
+    if (midiDevice  &&
+        midiDevice->getMetronome()) {
+        //RG_DEBUG << "getMetronomeFromDevice(" << id << "): device is a MIDI device";
+        return midiDevice->getMetronome();
+    }
 
-        SoftSynthDevice *ssDevice = dynamic_cast<SoftSynthDevice *>(*deviceIter);
+    SoftSynthDevice *ssDevice = dynamic_cast<SoftSynthDevice *>(device);
 
-        // If it's a SoftSynthDevice and it has a metronome, return it.
-        if (ssDevice  &&
-            ssDevice->getMetronome()) {
-            //RG_DEBUG << "getMetronomeFromDevice(" << id << "): device is a soft synth device";
-            return ssDevice->getMetronome();
-        }
+    // If it's a SoftSynthDevice and it has a metronome, return it.
+    if (ssDevice  &&
+        ssDevice->getMetronome()) {
+        //RG_DEBUG << "getMetronomeFromDevice(" << id << "): device is a soft synth device";
+        return ssDevice->getMetronome();
     }
 
     return nullptr;
@@ -769,28 +789,14 @@ Device *
 Studio::getDevice(DeviceId id) const
 {
     //RG_DEBUG << "Studio[" << this << "]::getDevice(" << id << ")... ";
-    
-    std::vector<Device*>::const_iterator it;
-    
-    for (it = m_devices.begin(); it != m_devices.end(); ++it) {
-        
-        // possibly fix a following seg.fault :
-        if( ! (*it) ){ 
-            RG_WARNING << "getDevice(): WARNING: (*it) is nullptr";
-            continue;
-        }
-        
-        //RG_DEBUG << (*it)->getId();
 
-        if ((*it)->getId() == id) {
-            //RG_DEBUG << "Found";
-            return (*it);
-        }
+    DeviceIndex::const_iterator it = m_deviceIndex.find(id);
+    if (it == m_deviceIndex.end()) {
+        //RG_DEBUG << "NOT found";
+        return nullptr;
     }
-    
-    //RG_DEBUG << "NOT found";
-    
-    return nullptr;
+
+    return it->second;
 }
 
 Device *
@@ -820,37 +826,18 @@ Studio::getSoftSynthDevice()
 std::string
 Studio::getSegmentName(InstrumentId id)
 {
-    MidiDevice *midiDevice;
-    std::vector<Device*>::iterator it;
-    Rosegarden::InstrumentList::iterator iit;
-    Rosegarden::InstrumentList instList;
+    Instrument *instrument = getInstrumentById(id);
+    if (!instrument)
+        return std::string("");
 
-    for (it = m_devices.begin(); it != m_devices.end(); ++it)
-    {
-        midiDevice = dynamic_cast<MidiDevice*>(*it);
+    MidiDevice *midiDevice = dynamic_cast<MidiDevice*>(instrument->getDevice());
+    if (!midiDevice)
+        return std::string("");
 
-        if (midiDevice)
-        {
-            instList = (*it)->getAllInstruments();
-
-            for (iit = instList.begin(); iit != instList.end(); ++iit)
-            {
-                if ((*iit)->getId() == id)
-                {
-                    if ((*iit)->sendsProgramChange())
-                    {
-                        return (*iit)->getProgramName();
-                    }
-                    else
-                    {
-                        return midiDevice->getName() + " " + (*iit)->getName();
-                    }
-                }
-            }
-        }
-    }
-
-    return std::string("");
+    if (instrument->sendsProgramChange())
+        return instrument->getProgramName();
+    else
+        return midiDevice->getName() + " " + instrument->getName();
 }
 
 InstrumentId
@@ -23,9 +23,12 @@
 #include "MidiMetronome.h"
 #include "ControlParameter.h"
 
+#include <rosegardenprivate_export.h>
+
 #include <QCoreApplication>
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace Rosegarden
@@ -54,8 +57,13 @@ typedef std::vector<Device*>::const_iterator DeviceListConstIterator;
  *
  * RosegardenDocument has an instance of Studio.  A reference can be obtained
  * using RosegardenDocument::getStudio().
+ *
+ * Devices and their Instruments are indexed by ID, so getDevice() and
+ * getInstrumentById() take the same time however big the studio is.
+ * The index is kept up to date by addDevice(), removeDevice() and
+ * clear(), so those are the only ways to add and remove devices.
  */
-class Studio : public XmlExportable
+class ROSEGARDENPRIVATE_EXPORT Studio : public XmlExportable
 {
     Q_DECLARE_TR_FUNCTIONS(Rosegarden::Studio)
 
@@ -150,7 +158,8 @@ public:
     //
     const MidiMetronome* getMetronomeFromDevice(DeviceId id);
 
-    // Return the device list
+    // Return the device list.  Don't add or remove devices through
+    // this, or getDevice() and getInstrumentById() won't know.
     //
     DeviceList* getDevices() { return &m_devices; }
 
@@ -205,8 +214,20 @@ public:
 
 private:
 
+    /// Add the device and its instruments to the indices.
+    void indexDevice(Device *device);
+    /// Index all the devices again, after some have gone.
+    void reindexDevices();
+
     DeviceList        m_devices;
 
+    // Where there is more than one device or instrument with the same
+    // ID, as there shouldn't be, these have the first.
+    typedef std::unordered_map<DeviceId, Device *> DeviceIndex;
+    DeviceIndex       m_deviceIndex;
+    typedef std::unordered_map<InstrumentId, Instrument *> InstrumentIndex;
+    InstrumentIndex   m_instrumentIndex;
+
     BussList          m_busses;
     RecordInList      m_recordIns;
 
@@ -16,6 +16,8 @@
 #ifndef RG_VIEW_SEGMENT_H
 #define RG_VIEW_SEGMENT_H
 
+#include <rosegardenprivate_export.h>
+
 #include "ViewElement.h"
 #include "base/Segment.h"
 
@@ -36,7 +38,7 @@ class ViewSegmentObserver;
  * avoid confusion with classes that draw staff lines and other
  * surrounding context.  All this does is manage the view elements.
  */
-class ViewSegment : public SegmentObserver
+class ROSEGARDENPRIVATE_EXPORT ViewSegment : public SegmentObserver
 {
 public: 
     ~ViewSegment() override;
@@ -62,7 +62,7 @@ public:
     int maxValue() const;
 
 private:
-    const std::string m_eventType;
+    const EventTypeName m_eventType;
     PropertyName m_property;
 
     EventSelection *m_selection;
@@ -19,10 +19,14 @@
 #ifndef RG_EVENTINSERTIONCOMMAND_H
 #define RG_EVENTINSERTIONCOMMAND_H
 
+#include <rosegardenprivate_export.h>
+
 #include "document/BasicCommand.h"
 
 #include <QCoreApplication>
 
+#include <rosegardenprivate_export.h>
+
 
 
 
@@ -33,7 +37,7 @@ class Segment;
 class Event;
 
 
-class EventInsertionCommand : public BasicCommand
+class ROSEGARDENPRIVATE_EXPORT EventInsertionCommand : public BasicCommand
 {
     Q_DECLARE_TR_FUNCTIONS(Rosegarden::EventInsertionCommand)
 
@@ -39,20 +39,16 @@ BasicCommand::BasicCommand(const QString &name, Segment &segment,
     m_startTime(calculateStartTime(start, segment)),
     m_endTime(calculateEndTime(end, segment)),
     m_segment(&segment),
-    m_savedEvents(new Segment(segment.getType(), m_startTime)),
+    m_bruteForceRedoRequired(bruteForceRedo),
     m_doBruteForceRedo(false),
-    m_redoEvents(nullptr),
     m_segmentMarking(""),
     m_comp(nullptr),
     m_modifiedEventsStart(-1),
     m_modifiedEventsEnd(-1),
-    m_originalStartTime(segment.getStartTime())
+    m_originalStartTime(segment.getStartTime()),
+    m_storageSize(0)
 {
     if (m_endTime == m_startTime) ++m_endTime;
-
-    if (bruteForceRedo) {
-        m_redoEvents = new Segment(segment.getType(), m_startTime);
-    }
 }
 
 // Variant ctor to be used when events to insert are known when
@@ -64,16 +60,30 @@ BasicCommand::BasicCommand(const QString &name,
     m_startTime(calculateStartTime(redoEvents->getStartTime(), *redoEvents)),
     m_endTime(calculateEndTime(redoEvents->getEndTime(), *redoEvents)),
     m_segment(&segment),
-    m_savedEvents(new Segment(segment.getType(), m_startTime)),
+    m_bruteForceRedoRequired(true),
     m_doBruteForceRedo(true),
-    m_redoEvents(redoEvents),
     m_segmentMarking(""),
     m_comp(nullptr),
     m_modifiedEventsStart(-1),
     m_modifiedEventsEnd(-1),
-    m_originalStartTime(segment.getStartTime())
+    m_originalStartTime(segment.getStartTime()),
+    m_storageSize(0)
 {
     if (m_endTime == m_startTime) { ++m_endTime; }
+
+    // The events replace whatever is in their range.
+    m_modifiedEventsStart = m_startTime;
+    m_modifiedEventsEnd = m_endTime;
+
+    m_redoEvents.reserve(redoEvents->size());
+    for (Segment::iterator i = redoEvents->begin();
+         i != redoEvents->end(); ++i) {
+        m_redoEvents.push_back(**i);
+    }
+    redoEvents->clear();
+    delete redoEvents;
+
+    updateStorageSize();
 }
 
 // Variant ctor to be used when segment does not exist at creation time
@@ -85,26 +95,19 @@ BasicCommand::BasicCommand(const QString &name,
     NamedCommand(name),
     m_startTime(start),
     m_segment(nullptr),
-    m_savedEvents(nullptr),
+    m_bruteForceRedoRequired(false),
     m_doBruteForceRedo(false),
-    m_redoEvents(nullptr),
     m_segmentMarking(segmentMarking),
     m_comp(comp),
     m_modifiedEventsStart(-1),
     m_modifiedEventsEnd(-1),
-    m_originalStartTime(-1)
+    m_originalStartTime(-1),
+    m_storageSize(0)
 {
 }    
 
 BasicCommand::~BasicCommand()
 {
-    requireSegment();
-    m_savedEvents->clear();
-    if (m_redoEvents) {
-        m_redoEvents->clear();
-        delete m_redoEvents;
-    }
-    delete m_savedEvents;
 }
 
 timeT
@@ -165,7 +168,15 @@ void
 BasicCommand::beginExecute()
 {
     requireSegment();
-    copyTo(m_savedEvents, true);
+
+    // Copies share the events' data, so this costs a reference count
+    // each rather than a copy of each event.
+    m_snapshot.clear();
+    m_snapshot.reserve(m_segment->size());
+    for (Segment::iterator i = m_segment->begin();
+         i != m_segment->end(); ++i) {
+        m_snapshot.push_back(**i);
+    }
 }
 
 void
@@ -177,16 +188,19 @@ BasicCommand::execute()
         m_segment->getStartTime() << m_segment->getEndTime();
     RG_DEBUG << *m_segment;
     RG_DEBUG << getName() << "segment end";
-    beginExecute();
 
     if (!m_doBruteForceRedo) {
+        beginExecute();
         modifySegment();
+
+        // calculate the start and end of the modified region
+        calculateModifiedStartEnd();
     } else {
-        copyFrom(m_redoEvents);
+        copyModified(m_savedEvents);
+        replaceModified(m_redoEvents);
     }
-    
-    // calculate the start and end of the modified region
-    calculateModifiedStartEnd();
+
+    updateStorageSize();
 
     m_segment->updateRefreshStatuses(getStartTime(), getRelayoutEndTime());
 
@@ -212,15 +226,18 @@ BasicCommand::unexecute()
     RG_DEBUG << getName() << "segment end";
     RG_DEBUG << "unexecute() begin...";
 
-    if (m_redoEvents) {
-        copyTo(m_redoEvents, true);
-        m_doBruteForceRedo = true;
-    }
-
     // This can take a very long time.  This is because we are adding
     // events to a Segment that has someone to notify of changes.
     // Every single call to Segment::insert() fires off notifications.
-    copyFrom(m_savedEvents);
+    replaceModified(m_savedEvents);
+
+    if (m_bruteForceRedoRequired) {
+        m_doBruteForceRedo = true;
+    } else {
+        // Redo calls modifySegment() again, which saves them again.
+        EventVector().swap(m_savedEvents);
+    }
+    updateStorageSize();
 
     if (m_segment->getStartTime() > m_originalStartTime) {
         // this can happen if a segment is shortened from the start
@@ -240,56 +257,40 @@ BasicCommand::unexecute()
 }
     
 void
-BasicCommand::copyTo(Rosegarden::Segment *events, bool wholeSegment)
+BasicCommand::copyModified(EventVector &events)
 {
     requireSegment();
-    RG_DEBUG << "copyTo() for" << getName() << ":" << m_segment <<
-        "to" << events << ", range (" << m_startTime << "," << m_endTime <<
-        ")";
-
-    Segment::iterator from = m_segment->findTime(m_startTime);
-    Segment::iterator to   = m_segment->findTime(m_endTime);
-
-    if (wholeSegment) {
-        from = m_segment->findTime(m_segment->getStartTime());
-        to = m_segment->findTime(m_segment->getEndTime());
-        events->clear();
-    }
+    RG_DEBUG << "copyModified() for" << getName() << ": range (" <<
+        m_modifiedEventsStart << "," << m_modifiedEventsEnd << ")";
 
-    for (Segment::iterator i = from; i != m_segment->end() && i != to; ++i) {
+    events.clear();
 
-        RG_DEBUG << "copyTo(): Found event of type" << (*i)->getType() << "and duration" << (*i)->getDuration() << "at time" << (*i)->getAbsoluteTime();
+    Segment::iterator from = m_segment->findTime(m_modifiedEventsStart);
+    Segment::iterator to   = m_segment->findTime(m_modifiedEventsEnd);
 
-        events->insert(new Event(**i));
+    for (Segment::iterator i = from; i != to; ++i) {
+        events.push_back(**i);
     }
 }
    
 void
-BasicCommand::copyFrom(Rosegarden::Segment *events, bool wholeSegment)
+BasicCommand::replaceModified(const EventVector &events)
 {
     requireSegment();
-    RG_DEBUG << "copyFrom() for" << getName() << ":" << events <<
-        "to" << m_segment << ", range (" << m_startTime << "," <<
-        m_endTime << ")";
-
-    Segment::iterator from = events->findTime(m_modifiedEventsStart);
-    Segment::iterator to   = events->findTime(m_modifiedEventsEnd);
-
-    if (wholeSegment) {
-        from = events->findTime(events->getStartTime());
-        to = events->findTime(events->getEndTime());
-    }
+    RG_DEBUG << "replaceModified() for" << getName() << ":" <<
+        events.size() << "events, range (" << m_modifiedEventsStart <<
+        "," << m_modifiedEventsEnd << ")";
 
     m_segment->erase(m_segment->findTime(m_modifiedEventsStart),
                      m_segment->findTime(m_modifiedEventsEnd));
-    for (Segment::iterator i = from; i != to; ++i) {
 
-        RG_DEBUG << "copyFrom(): Found event of type" << (*i)->getType() << "and duration" << (*i)->getDuration() << "at time" << (*i)->getAbsoluteTime();
+    for (EventVector::const_iterator i = events.begin();
+         i != events.end(); ++i) {
 
-        m_segment->insert(new Event(**i));
-    }
+        RG_DEBUG << "replaceModified(): Found event of type" << i->getType() << "and duration" << i->getDuration() << "at time" << i->getAbsoluteTime();
 
-    events->clear();
+        m_segment->insert(new Event(*i));
+    }
 }
 
 void
@@ -313,68 +314,101 @@ BasicCommand::requireSegment()
     m_startTime = calculateStartTime(m_startTime, *m_segment);
     m_endTime = calculateEndTime(m_segment->getEndTime(), *m_segment);
     if (m_endTime == m_startTime) ++m_endTime;
-    m_savedEvents = new Segment(m_segment->getType(), m_startTime);
     m_originalStartTime = m_segment->getStartTime();
 }
   
 void
 BasicCommand::calculateModifiedStartEnd()
 {
-    if (m_modifiedEventsStart != -1 ||
-        m_modifiedEventsEnd != -1) {
-        //already done
-        return;
+    // m_segment has modified events, m_snapshot has the original
+    // unchanged segment events.  Skip those that are the same at the
+    // start...
+    const size_t count = m_snapshot.size();
+    size_t head = 0;
+    Segment::iterator i = m_segment->begin();
+    while (head < count && i != m_segment->end() &&
+           (*i)->isCopyOf(m_snapshot[head])) {
+        ++head;
+        ++i;
     }
-    m_modifiedEventsStart = m_segment->getStartTime();
-    m_modifiedEventsEnd = m_segment->getEndTime();
-    // m_segment has modified events savedEvents has the original
-    // unchanged segment events
-    Segment::iterator j = m_savedEvents->begin();
-    if (j == m_savedEvents->end()) {
-        // all done
-        return;
+
+    // ...and at the end.
+    size_t tail = 0;
+    Segment::iterator j = m_segment->end();
+    while (head + tail < count && j != i) {
+        Segment::iterator k = j;
+        --k;
+        if (!(*k)->isCopyOf(m_snapshot[count - tail - 1])) break;
+        j = k;
+        ++tail;
     }
-    for (Segment::iterator i = m_segment->begin();
-         i != m_segment->end(); ++i) {
-        Event* segEvent = (*i);
-        Event* savedEvent = (*j);
-        m_modifiedEventsStart = segEvent->getAbsoluteTime() - 1;
-        // are they the same ?
-        if (!segEvent->isCopyOf(*savedEvent)) {
-            // found a changed note
-            break;
-        }
-        ++j;
-        if (j == m_savedEvents->end()) {
-            // all done
-            break;
-        }
+
+    // What's left, m_snapshot[head, count - tail) before and [i, j)
+    // after, is what changed.  Widen that to the times of the events
+    // at either end, so that the range can be found with findTime().
+    bool changed = false;
+    timeT start = 0;
+    timeT end = 0;
+    if (head + tail < count) {
+        start = m_snapshot[head].getAbsoluteTime();
+        end = m_snapshot[count - tail - 1].getAbsoluteTime() + 1;
+        changed = true;
     }
+    if (i != j) {
+        Segment::iterator last = j;
+        --last;
+        timeT first = (*i)->getAbsoluteTime();
+        timeT after = (*last)->getAbsoluteTime() + 1;
+        if (!changed || first < start) start = first;
+        if (!changed || after > end) end = after;
+        changed = true;
+    }
+
+    m_savedEvents.clear();
+    m_redoEvents.clear();
 
-    Segment::reverse_iterator rj = m_savedEvents->rbegin();
-    for (Segment::reverse_iterator i = m_segment->rbegin();
-         i != m_segment->rend(); ++i) {
-        Event* segEvent = (*i);
-        Event* savedEvent = (*rj);
-        // are they the same ?
-        if (!segEvent->isCopyOf(*savedEvent)) {
-            // found a changed note
-            break;
-        }
-        m_modifiedEventsEnd = segEvent->getAbsoluteTime() - 1;
-        ++rj;
-        if (rj == m_savedEvents->rend()) {
-            // all done
-            break;
-        }
+    if (!changed) {
+        // Nothing to save.  An empty range at the start.
+        m_modifiedEventsStart = m_modifiedEventsEnd = m_segment->getStartTime();
+        EventVector().swap(m_snapshot);
+        return;
     }
 
-    if (m_modifiedEventsEnd < m_modifiedEventsStart) 
-        m_modifiedEventsEnd = m_modifiedEventsStart + 1;
-        
+    m_modifiedEventsStart = start;
+    m_modifiedEventsEnd = end;
+
+    // Unchanged events can share the times at either end.
+    size_t from = head;
+    while (from > 0 && m_snapshot[from - 1].getAbsoluteTime() >= start) {
+        --from;
+    }
+    size_t to = count - tail;
+    while (to < count && m_snapshot[to].getAbsoluteTime() < end) {
+        ++to;
+    }
+    m_savedEvents.assign(m_snapshot.begin() + from, m_snapshot.begin() + to);
+    // Free the snapshot, or every command in the history keeps one.
+    EventVector().swap(m_snapshot);
+
+    if (m_bruteForceRedoRequired) copyModified(m_redoEvents);
+
     RG_DEBUG << "calculateModifiedStartEnd: " << m_modifiedEventsStart <<
-        m_modifiedEventsEnd;
-    
+        m_modifiedEventsEnd << ":" << m_savedEvents.size() << "saved";
+}
+
+void
+BasicCommand::updateStorageSize()
+{
+    m_storageSize = sizeof(*this);
+
+    for (EventVector::const_iterator i = m_savedEvents.begin();
+         i != m_savedEvents.end(); ++i) {
+        m_storageSize += i->getStorageSize();
+    }
+    for (EventVector::const_iterator i = m_redoEvents.begin();
+         i != m_redoEvents.end(); ++i) {
+        m_storageSize += i->getStorageSize();
+    }
 }
 
 }
@@ -19,11 +19,15 @@
 #ifndef RG_BASICCOMMAND_H
 #define RG_BASICCOMMAND_H
 
+#include <rosegardenprivate_export.h>
+
 #include "base/Segment.h"
 #include "document/Command.h"
 #include "base/Event.h"
 #include "misc/Debug.h"
 
+#include <vector>
+
 class QString;
 
 namespace Rosegarden
@@ -38,9 +42,14 @@ class CommandArgumentQuerier; // forward declaration useful for some subclasses
  * single Rosegarden Segment, by brute force.  When a subclass
  * of BasicCommand executes, it stores a copy of the events that are
  * modified by the command, ready to be restored verbatim on undo.
+ *
+ * Only the events that differ before and after modifySegment() are
+ * kept, and each copy shares its EventData with the event it was
+ * copied from, so an undo step costs about as much as the events it
+ * changed rather than the whole segment.
  */
 
-class BasicCommand : public NamedCommand
+class ROSEGARDENPRIVATE_EXPORT BasicCommand : public NamedCommand
 {
 public:
     ~BasicCommand() override;
@@ -57,6 +66,9 @@ public:
     /// events selected after command; 0 if no change / no meaningful selection
     virtual EventSelection *getSubsequentSelection() { return nullptr; }
 
+    /// Approximate bytes held by the saved events for undo and redo.
+    size_t getStorageSize() const override  { return m_storageSize; }
+
 protected:
     /**
      * You should pass "bruteForceRedoRequired = true" if your
@@ -91,13 +103,18 @@ protected:
 
     virtual void modifySegment() = 0;
 
+    /// Take the snapshot of m_segment that execute() compares with
+    /// after modifySegment() to find what it changed.
     virtual void beginExecute();
 
 private:
-    /// Copy from m_segment to segment.
-    void copyTo(Segment *segment, bool wholeSegment = false);
-    /// Copy from segment to m_segment replacing events in the time range.
-    void copyFrom(Segment *segment, bool wholeSegment = false);
+    typedef std::vector<Event> EventVector;
+
+    /// Copy m_segment's events in the modified range into events.
+    void copyModified(EventVector &events);
+    /// Replace m_segment's events in the modified range with copies of
+    /// events.
+    void replaceModified(const EventVector &events);
 
     timeT calculateStartTime(timeT given, Segment &segment);
     timeT calculateEndTime(timeT given, Segment &segment);
@@ -105,9 +122,12 @@ private:
     /// if the segment is not set yet - get it from the segment marking
     void requireSegment();
 
-    /// find out the range of Events modified by modifySegment
+    /// Compare m_segment with m_snapshot to find the range of Events
+    /// modified by modifySegment, and save the events either side of it.
     void calculateModifiedStartEnd();
 
+    void updateStorageSize();
+
     timeT m_startTime;
     timeT m_endTime;
 
@@ -116,13 +136,19 @@ private:
     /// create a command before the segment exists and set the segment
     /// later
     Segment *m_segment;
-    /// Events from m_segment prior to executing the command.
-    Segment *m_savedEvents;
-
+    /// Every event in m_segment, from beginExecute() until
+    /// calculateModifiedStartEnd() is done with them.
+    EventVector m_snapshot;
+    /// Events in the modified range prior to executing the command.
+    EventVector m_savedEvents;
+
+    /// Keep m_redoEvents on execute so that redo can use them.
+    bool m_bruteForceRedoRequired;
     /// Redo or execute() will be using a list of events (m_redoEvents).
     bool m_doBruteForceRedo;
-    /// Events for redo, or for the "redoEvents" ctor.
-    Segment *m_redoEvents;
+    /// Events in the modified range after executing the command, or
+    /// those given to the "redoEvents" ctor.
+    EventVector m_redoEvents;
 
     /// The segment marking for delayed acces to segment
     QString m_segmentMarking;
@@ -136,6 +162,8 @@ private:
 
     timeT m_originalStartTime;
 
+    size_t m_storageSize;
+
 };
 
 
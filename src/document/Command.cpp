@@ -86,6 +86,16 @@ MacroCommand::setName(QString name)
     m_name = name;
 }
 
+size_t
+MacroCommand::getStorageSize() const
+{
+    size_t size = 0;
+    for (size_t i = 0; i < m_commands.size(); ++i) {
+        size += m_commands[i]->getStorageSize();
+    }
+    return size;
+}
+
 BundleCommand::BundleCommand(QString name) :
     MacroCommand(name)
 {
@@ -37,6 +37,13 @@ public:
     virtual void execute() = 0;
     virtual void unexecute() = 0;
     virtual QString getName() const = 0;
+
+    /// Approximate bytes the command holds in order to undo and redo.
+    /**
+     * CommandHistory adds these up to keep the history within its
+     * memory limit.  Commands that hold little need not say.
+     */
+    virtual size_t getStorageSize() const  { return 0; }
     
     bool getUpdateLinks() const { return m_updateLinks; }
     void setUpdateLinks(bool update) { m_updateLinks = update; }
@@ -73,6 +80,8 @@ public:
 
     QString getName() const override;
     virtual void setName(QString name);
+
+    size_t getStorageSize() const override;
     
     virtual const std::vector<Command *>& getCommands() { return m_commands; }
 
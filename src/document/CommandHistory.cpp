@@ -19,8 +19,10 @@
 #include "CommandHistory.h"
 
 #include "Command.h"
+#include "misc/ConfigGroups.h"
 
 #include <QRegExp>
+#include <QSettings>
 #include <QMenu>
 #include <QToolBar>
 #include <QString>
@@ -41,6 +43,7 @@ CommandHistory::CommandHistory() :
     m_redoLimit(50),
     m_menuLimit(15),
     m_savedAt(0),
+    m_memoryLimit(0),
     m_currentCompound(nullptr),
     m_executeCompound(false),
     m_currentBundle(nullptr),
@@ -81,6 +84,17 @@ CommandHistory::CommandHistory() :
     m_redoMenuAction->setMenu(m_redoMenu);
     connect(m_redoMenu, &QMenu::triggered,
             this, &CommandHistory::redoActivated);
+
+    QSettings settings;
+    settings.beginGroup(GeneralOptionsConfigGroup);
+    int undoMemoryMB = settings.value("undomemorymb", 256).toInt();
+    if (undoMemoryMB < 0)
+        undoMemoryMB = 0;
+    // Write it to the file to make it easier to find.
+    settings.setValue("undomemorymb", undoMemoryMB);
+    settings.endGroup();
+
+    setMemoryLimit(size_t(undoMemoryMB) * 1024 * 1024);
 }
 
 CommandHistory::~CommandHistory()
@@ -175,13 +189,15 @@ CommandHistory::addCommand(Command *command, bool execute, bool bundle)
     // can we reach savedAt?
     if ((int)m_undoStack.size() < m_savedAt) m_savedAt = -1; // nope
 
-    m_undoStack.push(command);
-    clipCommands();
+    m_undoStack.push_back(command);
     
     if (execute) {
         command->execute();
     }
 
+    // After executing, as that is when a command saves its events.
+    clipCommands();
+
     // Emit even if we aren't executing the command, because
     // someone must have executed it for this to make any sense
     emit updateLinkedSegments(command);
@@ -231,6 +247,7 @@ CommandHistory::addToBundle(Command *command, bool execute)
 
     if (execute) command->execute();
     m_currentBundle->addCommand(command);
+    clipMemory();
 
     // Emit even if we aren't executing the command, because
     // someone must have executed it for this to make any sense
@@ -340,14 +357,14 @@ CommandHistory::undo()
 
     closeBundle();
 
-    Command *command = m_undoStack.top();
+    Command *command = m_undoStack.back();
     command->unexecute();
     emit updateLinkedSegments(command);
     emit commandExecuted();
     emit commandUnexecuted(command);
 
-    m_redoStack.push(command);
-    m_undoStack.pop();
+    m_redoStack.push_back(command);
+    m_undoStack.pop_back();
 
     clipCommands();
     updateActions();
@@ -366,15 +383,17 @@ CommandHistory::redo()
 
     closeBundle();
 
-    Command *command = m_redoStack.top();
+    Command *command = m_redoStack.back();
     command->execute();
     emit updateLinkedSegments(command);
     emit commandExecuted();
     emit commandExecuted(command);
 
-    m_undoStack.push(command);
-    m_redoStack.pop();
-    // no need to clip
+    m_undoStack.push_back(command);
+    m_redoStack.pop_back();
+    // no need to clip for the number of steps, but a command may hold
+    // more once it has executed again
+    clipMemory();
 
     updateActions();
 
@@ -399,6 +418,43 @@ CommandHistory::setRedoLimit(int limit)
     }
 }
 
+void
+CommandHistory::setMemoryLimit(size_t bytes)
+{
+    if (bytes != m_memoryLimit) {
+        m_memoryLimit = bytes;
+        clipCommands();
+    }
+}
+
+std::vector<size_t>
+CommandHistory::getUndoStorageSizes() const
+{
+    std::vector<size_t> sizes;
+    for (CommandStack::const_reverse_iterator i = m_undoStack.rbegin();
+         i != m_undoStack.rend(); ++i) {
+        sizes.push_back((*i)->getStorageSize());
+    }
+    return sizes;
+}
+
+size_t
+CommandHistory::getStorageSize() const
+{
+    return storageSize(m_undoStack) + storageSize(m_redoStack);
+}
+
+size_t
+CommandHistory::storageSize(const CommandStack &stack)
+{
+    size_t size = 0;
+    for (CommandStack::const_iterator i = stack.begin();
+         i != stack.end(); ++i) {
+        size += (*i)->getStorageSize();
+    }
+    return size;
+}
+
 void
 CommandHistory::setMenuLimit(int limit)
 {
@@ -428,32 +484,53 @@ CommandHistory::clipCommands()
 
     clipStack(m_undoStack, m_undoLimit);
     clipStack(m_redoStack, m_redoLimit);
+
+    clipMemory();
 }
 
 void
-CommandHistory::clipStack(CommandStack &stack, int limit)
+CommandHistory::clipMemory()
 {
-    int i;
-
-    if ((int)stack.size() > limit) {
+    if (m_memoryLimit == 0) return;
 
-        CommandStack tempStack;
+    size_t size = getStorageSize();
+    if (size <= m_memoryLimit) return;
 
-        for (i = 0; i < limit; ++i) {
+    // The oldest undo steps first, but never the latest...
+    while (size > m_memoryLimit && m_undoStack.size() > 1) {
+        Command *command = m_undoStack.front();
+        size -= command->getStorageSize();
 #ifdef DEBUG_COMMAND_HISTORY
-            Command *command = stack.top();
-            std::cerr << "CommandHistory::clipStack: Saving recent command: " << command->getName().toLocal8Bit().data() << " at " << command << std::endl;
+        std::cerr << "CommandHistory::clipMemory: Dropping oldest undo step at " << command << std::endl;
 #endif
-            tempStack.push(stack.top());
-            stack.pop();
-        }
+        delete command;
+        m_undoStack.pop_front();
+        --m_savedAt;
+    }
 
-        clearStack(stack);
+    // ...then the redo steps furthest away, but never the next.
+    while (size > m_memoryLimit && m_redoStack.size() > 1) {
+        Command *command = m_redoStack.front();
+        size -= command->getStorageSize();
+#ifdef DEBUG_COMMAND_HISTORY
+        std::cerr << "CommandHistory::clipMemory: Dropping furthest redo step at " << command << std::endl;
+#endif
+        delete command;
+        m_redoStack.pop_front();
+    }
+}
 
-        for (i = 0; i < m_undoLimit; ++i) {
-            stack.push(tempStack.top());
-            tempStack.pop();
-        }
+void
+CommandHistory::clipStack(CommandStack &stack, int limit)
+{
+    while ((int)stack.size() > limit) {
+        // Oldest first.
+        Command *command = stack.front();
+#ifdef DEBUG_COMMAND_HISTORY
+        std::cerr << "CommandHistory::clipStack: Dropping command at " << command << std::endl;
+#endif
+        delete command;
+        stack.pop_front();
     }
 }
 
@@ -461,13 +538,13 @@ void
 CommandHistory::clearStack(CommandStack &stack)
 {
     while (!stack.empty()) {
-        Command *command = stack.top();
+        Command *command = stack.back();
         // Not safe to call getName() on a command about to be deleted
 #ifdef DEBUG_COMMAND_HISTORY
         std::cerr << "CommandHistory::clearStack: About to delete command " << command << std::endl;
 #endif
         delete command;
-        stack.pop();
+        stack.pop_back();
     }
 }
 
@@ -511,6 +588,15 @@ CommandHistory::updateActions()
 {
     m_actionCounts.clear();
 
+#ifdef DEBUG_COMMAND_HISTORY
+    const std::vector<size_t> sizes = getUndoStorageSizes();
+    std::cerr << "CommandHistory::updateActions: " << getStorageSize()
+              << " bytes held of " << m_memoryLimit << "; undo steps:";
+    for (size_t i = 0; i < sizes.size(); ++i)
+        std::cerr << " " << sizes[i];
+    std::cerr << std::endl;
+#endif
+
     // for undo then redo
     for (int undo = 0; undo <= 1; ++undo) {
 
@@ -532,7 +618,7 @@ CommandHistory::updateActions()
 
         } else {
 
-            QString commandName = stack.top()->getName();
+            QString commandName = stack.back()->getName();
             commandName.replace(QRegExp("&"), "");
 
             QString text = (undo ? tr("&Undo %1") : tr("Re&do %1"))
@@ -548,14 +634,12 @@ CommandHistory::updateActions()
 
         menu->clear();
 
-        CommandStack tempStack;
         int j = 0;
 
-        while (j < m_menuLimit && !stack.empty()) {
+        for (CommandStack::const_reverse_iterator i = stack.rbegin();
+             j < m_menuLimit && i != stack.rend(); ++i) {
 
-            Command *command = stack.top();
-            tempStack.push(command);
-            stack.pop();
+            Command *command = *i;
 
             QString commandName = command->getName();
             commandName.replace(QRegExp("&"), "");
@@ -564,14 +648,16 @@ CommandHistory::updateActions()
             if (undo) text = tr("&Undo %1").arg(commandName);
             else      text = tr("Re&do %1").arg(commandName);
 
+            // Point out the steps that are holding on to a lot.
+            const size_t storageSize = command->getStorageSize();
+            if (storageSize >= 1024 * 1024) {
+                text = tr("%1 (%2 MB)").arg(text)
+                        .arg(double(storageSize) / (1024 * 1024), 0, 'f', 1);
+            }
+
             QAction *action = menu->addAction(text);
             m_actionCounts[action] = j++;
         }
-
-        while (!tempStack.empty()) {
-            stack.push(tempStack.top());
-            tempStack.pop();
-        }
     }
 }
 
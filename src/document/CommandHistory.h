@@ -18,12 +18,15 @@
 #ifndef RG_COMMANDHISTORY_H
 #define RG_COMMANDHISTORY_H
 
+#include <rosegardenprivate_export.h>
+
 #include <QObject>
 #include <QString>
 
-#include <stack>
+#include <deque>
 #include <set>
 #include <map>
+#include <vector>
 
 class QAction;
 class QMenu;
@@ -46,8 +49,12 @@ class ActionFileClient;
  * and Redo menu or toolbar with the same command history, and it
  * keeps them all up-to-date at once.  This makes it effective in
  * systems where multiple views may be editing the same data.
+ *
+ * The history is limited both in steps and in the memory the commands
+ * hold for undo and redo.  See setMemoryLimit().  The memory limit is
+ * "undomemorymb" in the General_Options settings.
  */
-class CommandHistory : public QObject
+class ROSEGARDENPRIVATE_EXPORT CommandHistory : public QObject
 {
     Q_OBJECT
 
@@ -105,11 +112,33 @@ public:
 
     /// Set the maximum number of items in the redo history.
     void setRedoLimit(int limit);
+
+    /// Return the most memory, in bytes, the undo and redo history may hold.
+    size_t getMemoryLimit() const { return m_memoryLimit; }
+
+    /// Set the most memory, in bytes, the undo and redo history may hold.
+    /**
+     * When the commands' Command::getStorageSize() add up to more, the
+     * oldest undo steps and then the furthest redo steps are dropped.
+     * The next step to undo and the next to redo are always kept.  0
+     * for no limit.
+     */
+    void setMemoryLimit(size_t bytes);
+
+    /// Approximate memory held by each undo step, the latest first.
+    std::vector<size_t> getUndoStorageSizes() const;
+
+    /// Approximate memory held by the whole undo and redo history.
+    size_t getStorageSize() const;
     
     /// Return the maximum number of items visible in undo and redo menus.
     int getMenuLimit() const { return m_menuLimit; }
 
     /// Set the maximum number of items in the menus.
+    /**
+     * Steps that hold a lot of memory show how much in the menus, so
+     * that the user can see what is worth clearing.
+     */
     void setMenuLimit(int limit);
 
     /// Return the time after which a bundle will be closed if nothing is added.
@@ -212,18 +241,21 @@ protected:
 
     void updateActions();
 
-    // Command Stacks
-    typedef std::stack<Command *> CommandStack;
+    // Command Stacks.  The top of each is at the back.
+    typedef std::deque<Command *> CommandStack;
     CommandStack m_undoStack;
     CommandStack m_redoStack;
     void clipStack(CommandStack &stack, int limit);
     void clearStack(CommandStack &stack);
     void clipCommands();
+    void clipMemory();
+    static size_t storageSize(const CommandStack &stack);
 
     int m_undoLimit;
     int m_redoLimit;
     int m_menuLimit;
     int m_savedAt;
+    size_t m_memoryLimit;
 
     // Compound
     MacroCommand *m_currentCompound;
@@ -0,0 +1,436 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[DocumentSnapshot]"
+
+#include "DocumentSnapshot.h"
+
+#include "RosegardenDocument.h"
+
+#include "base/Composition.h"
+#include "base/Event.h"
+#include "base/MidiTypes.h"
+#include "base/Profiler.h"
+#include "base/Segment.h"
+#include "base/SegmentLinker.h"
+#include "base/Studio.h"
+#include "base/TriggerSegment.h"
+#include "base/XmlExportable.h"
+#include "misc/Debug.h"
+#include "misc/Strings.h"
+#include "sound/AudioFileManager.h"
+
+#include "rosegarden-version.h"
+
+#include <QTextStream>
+
+namespace Rosegarden
+{
+
+
+DocumentSnapshot::DocumentSnapshot(RosegardenDocument *doc,
+                                   bool copyEvents) :
+    m_copyEvents(copyEvents),
+    m_firstTriggerSegment(0),
+    m_eventCount(0)
+{
+    Profiler profiler("DocumentSnapshot::DocumentSnapshot");
+
+    Composition &composition = doc->getComposition();
+
+    QTextStream header(&m_header, QIODevice::WriteOnly);
+
+    // output XML header
+    //
+    header << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    << "<!DOCTYPE rosegarden-data>\n"
+    << "<rosegarden-data version=\"" << VERSION
+    << "\" format-version-major=\"" << RosegardenDocument::FILE_FORMAT_VERSION_MAJOR
+    << "\" format-version-minor=\"" << RosegardenDocument::FILE_FORMAT_VERSION_MINOR
+    << "\" format-version-point=\"" << RosegardenDocument::FILE_FORMAT_VERSION_POINT
+    << "\">\n";
+
+    // Send out Composition (this includes Tracks, Instruments, Tempo
+    // and Time Signature changes and any other sub-objects)
+    //
+    header << strtoqstr(composition.toXmlString())
+           << endl << endl;
+
+    header << strtoqstr(doc->getAudioFileManager().toXmlString())
+           << endl << endl;
+
+    header << strtoqstr(doc->getConfiguration().toXmlString())
+           << endl << endl;
+
+    // Put a break in the file
+    //
+    header << endl << endl;
+
+    for (Composition::iterator segitr = composition.begin();
+         segitr != composition.end(); ++segitr) {
+
+        Segment *segment = *segitr;
+
+        // Fix #1446 : Replace isLinked() with isTrulyLinked().
+        // Maybe this fix will need to be removed some day if the
+        // LinkTransposeParams come to be used.
+        if (segment->isTrulyLinked()) {
+            QString attsString = QString("linkerid=\"%1\" ");
+            attsString += QString("linkertransposechangekey=\"%2\" ");
+            attsString += QString("linkertransposesteps=\"%3\" ");
+            attsString += QString("linkertransposesemitones=\"%4\" ");
+            attsString += QString("linkertransposesegmentback=\"%5\" ");
+            QString linkedSegAtts = QString(attsString)
+              .arg(segment->getLinker()->getSegmentLinkerId())
+              .arg(segment->getLinkTransposeParams().m_changeKey ? "true" :
+                                                                   "false")
+              .arg(segment->getLinkTransposeParams().m_steps)
+              .arg(segment->getLinkTransposeParams().m_semitones)
+              .arg(segment->getLinkTransposeParams().m_transposeSegmentBack
+                                                         ? "true" : "false");
+
+            addSegment(segment, linkedSegAtts);
+        } else {
+            addSegment(segment);
+        }
+
+    }
+
+    m_firstTriggerSegment = m_segments.size();
+
+    for (Composition::triggersegmentcontaineriterator ci =
+                composition.getTriggerSegments().begin();
+            ci != composition.getTriggerSegments().end(); ++ci) {
+
+        QString triggerAtts = QString
+                              ("triggerid=\"%1\" triggerbasepitch=\"%2\" triggerbasevelocity=\"%3\" triggerretune=\"%4\" triggeradjusttimes=\"%5\" ")
+                              .arg((*ci)->getId())
+                              .arg((*ci)->getBasePitch())
+                              .arg((*ci)->getBaseVelocity())
+                              .arg((*ci)->getDefaultRetune())
+                              .arg(strtoqstr((*ci)->getDefaultTimeAdjust()));
+
+        addSegment((*ci)->getSegment(), triggerAtts);
+    }
+
+    QTextStream footer(&m_footer, QIODevice::WriteOnly);
+
+    // Put a break in the file
+    //
+    footer << endl << endl;
+
+    // Send out the studio - a self contained command
+    //
+    footer << strtoqstr(doc->getStudio().toXmlString()) << endl << endl;
+
+    // Send out the appearance data
+    footer << "<appearance>" << endl;
+    footer << strtoqstr(composition.getSegmentColourMap().toXmlString("segmentmap"));
+    footer << strtoqstr(composition.getGeneralColourMap().toXmlString("generalmap"));
+    footer << "</appearance>" << endl << endl << endl;
+
+    // close the top-level XML tag
+    //
+    footer << "</rosegarden-data>\n";
+}
+
+DocumentSnapshot::~DocumentSnapshot()
+{
+    for (size_t i = 0; i < m_segments.size(); ++i) {
+        const std::vector<Event *> &events = m_segments[i].events;
+        for (size_t j = 0; j < events.size(); ++j)
+            delete events[j];
+    }
+}
+
+void
+DocumentSnapshot::addSegment(Segment *segment, QString extraAttributes)
+{
+    m_segments.push_back(SegmentSnapshot());
+    SegmentSnapshot &snapshot = m_segments.back();
+
+    snapshot.startTime = segment->getStartTime();
+    snapshot.segment = nullptr;
+
+    QTextStream outStream(&snapshot.startTag, QIODevice::WriteOnly);
+
+    QString time;
+
+    outStream << QString("<%1 track=\"%2\" start=\"%3\" ")
+    .arg(segment->getXmlElementName())
+    .arg(segment->getTrack())
+    .arg(segment->getStartTime());
+
+    if (!extraAttributes.isEmpty())
+        outStream << extraAttributes << " ";
+
+    outStream << "label=\"" <<
+    strtoqstr(XmlExportable::encode(segment->getLabel()));
+
+    if (segment->isRepeating()) {
+        outStream << "\" repeat=\"true";
+    }
+
+    if (segment->getTranspose() != 0) {
+        outStream << "\" transpose=\"" << segment->getTranspose();
+    }
+
+    if (segment->getDelay() != 0) {
+        outStream << "\" delay=\"" << segment->getDelay();
+    }
+
+    if (segment->getRealTimeDelay() != RealTime::zeroTime) {
+        outStream << "\" rtdelaysec=\"" << segment->getRealTimeDelay().sec
+        << "\" rtdelaynsec=\"" << segment->getRealTimeDelay().nsec;
+    }
+
+    if (segment->getColourIndex() != 0) {
+        outStream << "\" colourindex=\"" << segment->getColourIndex();
+    }
+
+    if (segment->getSnapGridSize() != -1) {
+        outStream << "\" snapgridsize=\"" << segment->getSnapGridSize();
+    }
+
+    if (segment->getViewFeatures() != 0) {
+        outStream << "\" viewfeatures=\"" << segment->getViewFeatures();
+    }
+
+    if (segment->getForNotation() != true) {
+        outStream << "\" fornotation=\"" << "false";
+    }
+
+    const timeT *endMarker = segment->getRawEndMarkerTime();
+    if (endMarker) {
+        outStream << "\" endmarker=\"" << *endMarker;
+    }
+
+    if (segment->getType() == Segment::Audio) {
+
+        outStream << "\" type=\"audio\" "
+                  << "file=\""
+                  << segment->getAudioFileId();
+
+        if (segment->getStretchRatio() != 1.f &&
+            segment->getStretchRatio() != 0.f) {
+
+            outStream << "\" unstretched=\""
+                      << segment->getUnstretchedFileId()
+                      << "\" stretch=\""
+                      << segment->getStretchRatio();
+        }
+
+        outStream << "\">\n";
+
+        // convert out - should do this as XmlExportable really
+        // once all this code is centralised
+        //
+        time.sprintf("%d.%06d", segment->getAudioStartTime().sec,
+                     segment->getAudioStartTime().usec());
+
+        outStream << "    <begin index=\""
+        << time
+        << "\"/>\n";
+
+        time.sprintf("%d.%06d", segment->getAudioEndTime().sec,
+                     segment->getAudioEndTime().usec());
+
+        outStream << "    <end index=\""
+        << time
+        << "\"/>\n";
+
+        if (segment->isAutoFading()) {
+            time.sprintf("%d.%06d", segment->getFadeInTime().sec,
+                         segment->getFadeInTime().usec());
+
+            outStream << "    <fadein time=\""
+            << time
+            << "\"/>\n";
+
+            time.sprintf("%d.%06d", segment->getFadeOutTime().sec,
+                         segment->getFadeOutTime().usec());
+
+            outStream << "    <fadeout time=\""
+            << time
+            << "\"/>\n";
+        }
+
+    } else // Internal type
+    {
+        outStream << "\">\n";
+
+        if (m_copyEvents) {
+            snapshot.events.reserve(segment->size());
+            for (Segment::iterator i = segment->begin();
+                 i != segment->end(); ++i) {
+                snapshot.events.push_back(
+                        (*i)->copyWithNonPersistentProperties());
+            }
+            m_eventCount += static_cast<long>(snapshot.events.size());
+        } else {
+            snapshot.segment = segment;
+        }
+
+        QTextStream endStream(&snapshot.endTag, QIODevice::WriteOnly);
+
+        // Add EventRulers to segment - we call them controllers because of
+        // a historical mistake in naming them.  My bad.  RWB.
+        //
+        Segment::EventRulerList list = segment->getEventRulerList();
+
+        if (list.size()) {
+            endStream << "<gui>\n"; // gui elements
+            Segment::EventRulerListConstIterator it;
+            for (it = list.begin(); it != list.end(); ++it) {
+                endStream << "  <controller type=\"" << strtoqstr((*it)->m_type);
+
+                if ((*it)->m_type == Controller::EventType) {
+                    endStream << "\" value =\"" << (*it)->m_controllerValue;
+                }
+
+                endStream << "\"/>\n";
+            }
+            endStream << "</gui>\n";
+        }
+
+    }
+
+    snapshot.endTag += QString("</%1>\n").arg(segment->getXmlElementName());
+}
+
+namespace
+{
+    // Writes the Events from begin to end.  Works on both the Event
+    // copies in a snapshot and a live Segment.
+    template <class Iterator>
+    void writeEventRange(QTextStream &outStream, timeT startTime,
+                         Iterator begin, Iterator end)
+    {
+        bool inChord = false;
+        timeT chordStart = 0, chordDuration = 0;
+        timeT expectedTime = startTime;
+
+        for (Iterator i = begin; i != end; ++i) {
+
+            timeT absTime = (*i)->getAbsoluteTime();
+
+            Iterator nextEl = i;
+            ++nextEl;
+
+            if (nextEl != end &&
+                    (*nextEl)->getAbsoluteTime() == absTime &&
+                    (*i)->getDuration() != 0 &&
+                    !inChord) {
+                outStream << "<chord>" << endl;
+                inChord = true;
+                chordStart = absTime;
+                chordDuration = 0;
+            }
+
+            if (inChord && (*i)->getDuration() > 0)
+                if (chordDuration == 0 || (*i)->getDuration() < chordDuration)
+                    chordDuration = (*i)->getDuration();
+
+            outStream << '\t'
+            << strtoqstr((*i)->toXmlString(expectedTime)) << endl;
+
+            if (nextEl != end &&
+                    (*nextEl)->getAbsoluteTime() != absTime &&
+                    inChord) {
+                outStream << "</chord>\n";
+                inChord = false;
+                expectedTime = chordStart + chordDuration;
+            } else if (inChord) {
+                expectedTime = absTime;
+            } else {
+                expectedTime = absTime + (*i)->getDuration();
+            }
+        }
+
+        if (inChord) {
+            outStream << "</chord>\n";
+        }
+    }
+}
+
+void
+DocumentSnapshot::writeEvents(QTextStream &outStream,
+                              const SegmentSnapshot &segment)
+{
+    if (segment.segment) {
+        writeEventRange(outStream, segment.startTime,
+                        segment.segment->begin(), segment.segment->end());
+    } else {
+        writeEventRange(outStream, segment.startTime,
+                        segment.events.begin(), segment.events.end());
+    }
+}
+
+void
+DocumentSnapshot::write(QTextStream &outStream) const
+{
+    Profiler profiler("DocumentSnapshot::write");
+
+    outStream << m_header;
+
+    for (size_t i = 0; i < m_segments.size(); ++i) {
+
+        // Put a break in the file between the Segments and the trigger
+        // Segments.
+        if (i == m_firstTriggerSegment)
+            outStream << endl << endl;
+
+        const SegmentSnapshot &segment = m_segments[i];
+        outStream << segment.startTag;
+        writeEvents(outStream, segment);
+        outStream << segment.endTag;
+    }
+
+    if (m_firstTriggerSegment == m_segments.size())
+        outStream << endl << endl;
+
+    outStream << m_footer;
+}
+
+
+DocumentSaveThread::DocumentSaveThread(DocumentSnapshot *snapshot,
+                                       const QString &fileName) :
+    m_snapshot(snapshot),
+    m_fileName(fileName),
+    m_ok(false)
+{
+}
+
+DocumentSaveThread::~DocumentSaveThread()
+{
+    wait();
+    delete m_snapshot;
+}
+
+void
+DocumentSaveThread::run()
+{
+    Profiler profiler("DocumentSaveThread::run");
+
+    m_ok = RosegardenDocument::saveSnapshot(*m_snapshot, m_fileName, m_errMsg);
+
+    if (!m_ok)
+        RG_WARNING << "run(): Could not save" << m_fileName << ":" << m_errMsg;
+}
+
+
+}
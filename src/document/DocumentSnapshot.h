@@ -0,0 +1,150 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_DOCUMENT_SNAPSHOT_H
+#define RG_DOCUMENT_SNAPSHOT_H
+
+#include "base/TimeT.h"
+
+#include <QString>
+#include <QThread>
+
+#include <vector>
+
+#include <rosegardenprivate_export.h>
+
+class QTextStream;
+
+namespace Rosegarden
+{
+
+
+class Event;
+class RosegardenDocument;
+class Segment;
+
+/// A copy of a RosegardenDocument as it stands, for saving.
+/**
+ * Taking a snapshot is cheap.  The Events are copied, but a copy of an
+ * Event shares its data with the original until one of them changes
+ * (see Event::EventData).  Everything else (tracks, instruments, the
+ * studio, etc...) is small, and is turned into XML straight away.
+ *
+ * Turning the Events into XML and compressing the result, which is
+ * what makes saving a large composition slow, can then be done on
+ * another thread (see DocumentSaveThread) while the user carries on
+ * editing the document.
+ *
+ * A snapshot must be taken and deleted on the GUI thread, as its
+ * Events share reference counts with the document's.
+ *
+ * A snapshot taken without copying the Events refers to the document's
+ * own Segments instead.  That is for saving there and then (see
+ * RosegardenDocument::saveDocument()), and it must be written on the
+ * GUI thread before the document next changes.
+ *
+ * @see RosegardenDocument::takeSnapshot()
+ * @see RosegardenDocument::saveSnapshot()
+ */
+class ROSEGARDENPRIVATE_EXPORT DocumentSnapshot
+{
+public:
+    explicit DocumentSnapshot(RosegardenDocument *doc,
+                              bool copyEvents = true);
+    ~DocumentSnapshot();
+
+    /// Write the whole document as XML.
+    /**
+     * Touches nothing but the snapshot, so this can be called on any
+     * thread.
+     */
+    void write(QTextStream &outStream) const;
+
+    /// Number of Events in the snapshot.  0 if the Events weren't copied.
+    long getEventCount() const  { return m_eventCount; }
+
+private:
+    // Copying would share the Events.
+    DocumentSnapshot(const DocumentSnapshot &);
+    DocumentSnapshot &operator=(const DocumentSnapshot &);
+
+    struct SegmentSnapshot
+    {
+        /// The Segment's start tag and, for audio Segments, its contents.
+        QString startTag;
+        /// Copies of the Segment's Events.
+        std::vector<Event *> events;
+        /// The Segment itself, if the Events weren't copied.
+        const Segment *segment;
+        timeT startTime;
+        /// The Segment's EventRulers and end tag.
+        QString endTag;
+    };
+
+    void addSegment(Segment *segment,
+                    QString extraAttributes = QString());
+    static void writeEvents(QTextStream &outStream,
+                            const SegmentSnapshot &segment);
+
+    bool m_copyEvents;
+
+    /// Everything before the Segments.
+    QString m_header;
+    std::vector<SegmentSnapshot> m_segments;
+    /// Index in m_segments of the first trigger Segment.
+    size_t m_firstTriggerSegment;
+    /// Everything after the Segments.
+    QString m_footer;
+
+    long m_eventCount;
+};
+
+/// Saves a DocumentSnapshot on a thread of its own.
+/**
+ * Used for autosave, so that autosaving a large composition doesn't
+ * stall the GUI.
+ */
+class ROSEGARDENPRIVATE_EXPORT DocumentSaveThread : public QThread
+{
+public:
+    /// Takes ownership of snapshot.
+    DocumentSaveThread(DocumentSnapshot *snapshot, const QString &fileName);
+    /// Deletes the snapshot, so must be called on the GUI thread.
+    ~DocumentSaveThread() override;
+
+    QString getFileName() const  { return m_fileName; }
+
+    /// Whether the save worked.  Only meaningful once finished.
+    bool isOK() const  { return m_ok; }
+    /// User-readable reason for a failed save.
+    QString getErrorMessage() const  { return m_errMsg; }
+
+protected:
+    void run() override;
+
+private:
+    DocumentSnapshot *m_snapshot;
+    QString m_fileName;
+
+    bool m_ok;
+    QString m_errMsg;
+};
+
+
+}
+
+#endif
@@ -17,10 +17,12 @@
 
 #include <QString>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
-class GzipFile
+class ROSEGARDENPRIVATE_EXPORT GzipFile
 {
 public:
     static bool writeToFile(QString file, QString text);
@@ -0,0 +1,152 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[GzipStreamReader]"
+
+#include "GzipStreamReader.h"
+
+#include "misc/Debug.h"
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QScopedPointer>
+#include <QTextCodec>
+#include <QTextDecoder>
+
+namespace Rosegarden
+{
+
+
+GzipStreamReader::GzipStreamReader(const QString &fileName,
+                                   int chunkSize,
+                                   int maxChunks) :
+    m_fileName(fileName),
+    m_chunkSize(chunkSize),
+    m_maxChunks(maxChunks),
+    m_file(nullptr),
+    m_fileSize(0),
+    m_finished(false),
+    m_cancelled(false),
+    m_ok(false),
+    m_progress(0)
+{
+}
+
+GzipStreamReader::~GzipStreamReader()
+{
+    cancel();
+    wait();
+
+    if (m_file)
+        gzclose(m_file);
+}
+
+bool
+GzipStreamReader::open()
+{
+    m_file = gzopen(m_fileName.toLocal8Bit().data(), "rb");
+    if (!m_file) {
+        RG_WARNING << "open(): Could not open" << m_fileName;
+        return false;
+    }
+
+    m_fileSize = QFileInfo(m_fileName).size();
+
+    start();
+
+    return true;
+}
+
+bool
+GzipStreamReader::readChunk(QString &text)
+{
+    text.clear();
+
+    QMutexLocker locker(&m_mutex);
+
+    while (m_queue.isEmpty()  &&  !m_finished  &&  !m_cancelled)
+        m_condition.wait(&m_mutex);
+
+    if (m_queue.isEmpty()  ||  m_cancelled)
+        return false;
+
+    text = m_queue.dequeue();
+    // Make room for the worker thread.
+    m_condition.wakeAll();
+
+    return true;
+}
+
+void
+GzipStreamReader::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cancelled = true;
+    m_queue.clear();
+    m_condition.wakeAll();
+}
+
+void
+GzipStreamReader::run()
+{
+    // A stateful decoder, so that UTF-8 sequences which straddle two
+    // chunks come out right.
+    QScopedPointer<QTextDecoder> decoder(
+            QTextCodec::codecForName("UTF-8")->makeDecoder());
+
+    QByteArray buffer(m_chunkSize, '\0');
+    int got = 0;
+
+    while ((got = gzread(m_file, buffer.data(), m_chunkSize)) > 0) {
+
+        QString text = decoder->toUnicode(buffer.constData(), got);
+
+        // How far through the compressed file we are.
+        if (m_fileSize > 0) {
+            const qint64 offset = gzoffset(m_file);
+            m_progress.storeRelease(
+                    static_cast<int>(qMin(offset * 100 / m_fileSize,
+                                          qint64(100))));
+        }
+
+        QMutexLocker locker(&m_mutex);
+
+        while (m_queue.size() >= m_maxChunks  &&  !m_cancelled)
+            m_condition.wait(&m_mutex);
+
+        if (m_cancelled)
+            return;
+
+        m_queue.enqueue(text);
+        m_condition.wakeAll();
+    }
+
+    const bool ok = gzeof(m_file);
+    if (!ok)
+        RG_WARNING << "run(): Error reading" << m_fileName;
+
+    m_progress.storeRelease(100);
+
+    QMutexLocker locker(&m_mutex);
+    m_ok = ok;
+    m_finished = true;
+    m_condition.wakeAll();
+}
+
+
+}
@@ -0,0 +1,127 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_GZIP_STREAM_READER_H
+#define RG_GZIP_STREAM_READER_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <zlib.h>
+
+#include <rosegardenprivate_export.h>
+
+namespace Rosegarden
+{
+
+
+/// Decompresses a gzip'd UTF-8 text file on a worker thread.
+/**
+ * The worker thread inflates and decodes the file a chunk at a time and
+ * hands the text over through a small bounded queue, so that the
+ * consumer (e.g. an incremental XML parse on the GUI thread) can get
+ * on with the first part of the file while the rest is still being
+ * read, and so that the whole file is never in memory at once.
+ *
+ * Like gzread(), this reads uncompressed files as well.
+ *
+ *   GzipStreamReader reader(fileName);
+ *   if (!reader.open())
+ *       ...
+ *   QString chunk;
+ *   while (reader.readChunk(chunk))
+ *       ...
+ *   if (!reader.isOK())
+ *       ...
+ *
+ * @see GzipFile::readFromFile() which reads the whole file in one go.
+ */
+class ROSEGARDENPRIVATE_EXPORT GzipStreamReader : public QThread
+{
+public:
+    /**
+     * chunkSize is the number of (uncompressed) bytes read at a time.
+     * At most maxChunks chunks are queued before the worker waits for
+     * the consumer to catch up.
+     */
+    explicit GzipStreamReader(const QString &fileName,
+                              int chunkSize = 256 * 1024,
+                              int maxChunks = 8);
+    /// Stops the worker thread if it is still running.
+    ~GzipStreamReader() override;
+
+    /// Open the file and start the worker thread.
+    /**
+     * Returns false if the file could not be opened.
+     */
+    bool open();
+
+    /// Get the next chunk of text.
+    /**
+     * Waits for the worker thread if it has nothing ready yet.  Returns
+     * false, leaving text empty, once there is nothing left to read.
+     * Must only be called from one thread.
+     */
+    bool readChunk(QString &text);
+
+    /// Whether the whole file was read without error.
+    /**
+     * Only meaningful once readChunk() has returned false.
+     */
+    bool isOK() const  { return m_ok; }
+
+    /// How far through the (compressed) file the worker thread is, 0-100.
+    int getProgress() const  { return m_progress.loadAcquire(); }
+
+    /// Stop reading.  readChunk() will return false from now on.
+    void cancel();
+
+protected:
+    /// The worker thread.
+    void run() override;
+
+private:
+    QString m_fileName;
+    int m_chunkSize;
+    int m_maxChunks;
+
+    gzFile m_file;
+    /// Size of the file on disk, for getProgress().
+    qint64 m_fileSize;
+
+    /// Protects m_queue, m_finished and m_cancelled.
+    QMutex m_mutex;
+    /// Signalled whenever any of the above changes.
+    QWaitCondition m_condition;
+    QQueue<QString> m_queue;
+    /// The worker thread has read all it is going to read.
+    bool m_finished;
+    bool m_cancelled;
+
+    /// Written by the worker thread before it sets m_finished.
+    bool m_ok;
+    QAtomicInt m_progress;
+};
+
+
+}
+
+#endif
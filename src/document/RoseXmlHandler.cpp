@@ -2298,17 +2298,19 @@ RoseXmlHandler::endElement(const QString& namespaceURI,
 
     // Set percentage done
     //
-    if ((m_totalElements > m_elementsSoFar) &&
-        (++m_elementsSoFar % 300 == 0)) {
+    if (++m_elementsSoFar % 300 == 0) {
 
         if (m_progressDialog) {
             // If the user cancelled, bail.
             if (m_progressDialog->wasCanceled())
                 return false;
 
-            m_progressDialog->setValue(static_cast<int>(
-                    static_cast<double>(m_elementsSoFar) /
-                    static_cast<double>(m_totalElements) * 100.0));
+            // If we weren't told how many elements to expect, whoever
+            // is feeding us the file reports progress instead.
+            if (m_totalElements > m_elementsSoFar)
+                m_progressDialog->setValue(static_cast<int>(
+                        static_cast<double>(m_elementsSoFar) /
+                        static_cast<double>(m_totalElements) * 100.0));
         }
 
         // Kick the event loop so that we don't appear to be in
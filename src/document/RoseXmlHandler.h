@@ -81,6 +81,9 @@ public:
     /**
      * Construct a new RoseXmlHandler which will put the data extracted
      * from the XML file into the specified composition
+     *
+     * elementCount is used to show progress, and may be 0 if it isn't
+     * known.
      */
     RoseXmlHandler(RosegardenDocument *doc,
                    unsigned int elementCount,
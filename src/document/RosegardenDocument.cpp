@@ -23,7 +23,9 @@
 
 #include "CommandHistory.h"
 #include "RoseXmlHandler.h"
+#include "DocumentSnapshot.h"
 #include "GzipFile.h"
+#include "XmlStreamParser.h"
 
 #include "base/AudioDevice.h"
 #include "base/AudioPluginInstance.h"
@@ -95,6 +97,7 @@
 #include <QSettings>
 #include <QMessageBox>
 #include <QProcess>
+#include <QScopedPointer>
 #include <QTemporaryFile>
 #include <QByteArray>
 #include <QDataStream>
@@ -126,6 +129,7 @@ RosegardenDocument::RosegardenDocument(
     m_autoSaved(false),
     m_lockFile(nullptr),
     m_audioPeaksThread(&m_audioFileManager),
+    m_autoSaveThread(nullptr),
     m_seqManager(nullptr),
     m_pluginManager(pluginManager),
     m_audioRecordLatency(0, 0),
@@ -157,6 +161,8 @@ RosegardenDocument::~RosegardenDocument()
     m_audioPeaksThread.finish();
     m_audioPeaksThread.wait();
 
+    finishAutoSave();
+
     deleteEditViews();
 
     //     ControlRulerCanvasRepository::clear();
@@ -225,6 +231,9 @@ const QString &RosegardenDocument::getAbsFilePath() const
 
 void RosegardenDocument::deleteAutoSaveFile()
 {
+    // Don't let an autosave in progress put it back.
+    finishAutoSave();
+
     QFile::remove(getAutoSaveFileName());
 }
 
@@ -334,10 +343,47 @@ void RosegardenDocument::slotAutoSave()
     << getAbsFilePath() << "' as"
     << autoSaveFileName;
 
-    QString errMsg;
+    // Still writing the last one.  Try again next time.
+    if (m_autoSaveThread)
+        return;
+
+    // Take a snapshot here and write it out on another thread, as
+    // writing a large composition takes a while.
+    m_autoSaveThread = new DocumentSaveThread(takeSnapshot(), autoSaveFileName);
+    connect(m_autoSaveThread, &QThread::finished,
+            this, &RosegardenDocument::slotAutoSaveFinished);
+
+    // Anything modified from here on isn't in this autosave, and will
+    // clear this again.
+    setAutoSaved(true);
+
+    m_autoSaveThread->start(QThread::LowPriority);
+}
+
+void RosegardenDocument::slotAutoSaveFinished()
+{
+    // This may be for an autosave that finishAutoSave() has already
+    // tidied up after.
+    if (m_autoSaveThread  &&  m_autoSaveThread->isFinished())
+        finishAutoSave();
+}
+
+void RosegardenDocument::finishAutoSave()
+{
+    if (!m_autoSaveThread)
+        return;
+
+    m_autoSaveThread->wait();
 
-    saveDocument(autoSaveFileName, errMsg, true);
+    if (!m_autoSaveThread->isOK()) {
+        RG_WARNING << "finishAutoSave(): Autosave to" << m_autoSaveThread->getFileName() << "failed:" << m_autoSaveThread->getErrorMessage();
+        // Try again next time.
+        setAutoSaved(false);
+    }
 
+    // Deletes the snapshot, which must be done on this thread.
+    delete m_autoSaveThread;
+    m_autoSaveThread = nullptr;
 }
 
 bool RosegardenDocument::isRegularDotRGFile() const
@@ -590,23 +636,14 @@ bool RosegardenDocument::openDocument(const QString &filename,
 
     // Load.
 
-    QString fileContents;
-
-    // Unzip
-    bool okay = GzipFile::readFromFile(filename, fileContents);
-    
     QString errMsg;
     bool cancelled = false;
 
-    if (!okay) {
-        errMsg = tr("Could not open Rosegarden file");
-    } else {
-        // Parse the XML
-        okay = xmlParse(fileContents,
-                        errMsg,
-                        permanent,
-                        cancelled);
-    }
+    // Unzip and parse the XML
+    bool okay = xmlParse(filename,
+                         errMsg,
+                         permanent,
+                         cancelled);
 
     if (!okay) {
         StartupLogo::hideIfStillThere();
@@ -1207,11 +1244,53 @@ int RosegardenDocument::FILE_FORMAT_VERSION_POINT = 5;
 bool RosegardenDocument::saveDocument(const QString& filename,
                                     QString& errMsg,
                                     bool autosave)
+{
+    Profiler profiler("RosegardenDocument::saveDocument");
+
+    RG_DEBUG << "RosegardenDocument::saveDocument(" << filename << ")";
+
+    // Let any autosave finish first, so that it can't overwrite this
+    // save with an older one if they are to the same file.
+    finishAutoSave();
+
+    // We write it out before returning, so there is no need to copy
+    // the Events.
+    QScopedPointer<DocumentSnapshot> snapshot(
+            takeSnapshot(false /*copyEvents*/));
+
+    if (!saveSnapshot(*snapshot, filename, errMsg))
+        return false;
+
+    RG_DEBUG << "RosegardenDocument::saveDocument() finished";
+
+    if (!autosave) {
+        emit documentModified(false);
+        m_modified = false;
+        CommandHistory::getInstance()->documentSaved();
+    }
+
+    setAutoSaved(true);
+
+    return true;
+}
+
+DocumentSnapshot *RosegardenDocument::takeSnapshot(bool copyEvents)
+{
+    // First make sure all MIDI devices know their current connections
+    //
+    m_studio.resyncDeviceConnections();
+
+    return new DocumentSnapshot(this, copyEvents);
+}
+
+bool RosegardenDocument::saveSnapshot(const DocumentSnapshot &snapshot,
+                                      const QString &filename,
+                                      QString &errMsg)
 {
     QFileInfo fileInfo(filename);
 
     if (!fileInfo.exists()) { // safe to write directly
-        return saveDocumentActual(filename, errMsg, autosave);
+        return saveSnapshotActual(snapshot, filename, errMsg);
     }
 
     if (fileInfo.exists()  &&  !fileInfo.isWritable()) {
@@ -1243,7 +1322,7 @@ bool RosegardenDocument::saveDocument(const QString& filename,
         return false;
     }
 
-    bool success = saveDocumentActual(tempFileName, errMsg, autosave);
+    bool success = saveSnapshotActual(snapshot, tempFileName, errMsg);
 
     if (!success) {
         // errMsg should be already set
@@ -1263,135 +1342,21 @@ bool RosegardenDocument::saveDocument(const QString& filename,
     return true;
 }
 
-
-bool RosegardenDocument::saveDocumentActual(const QString& filename,
-                                          QString& errMsg,
-                                          bool autosave)
+bool RosegardenDocument::saveSnapshotActual(const DocumentSnapshot &snapshot,
+                                            const QString& filename,
+                                            QString& errMsg)
 {
-    //Profiler profiler("RosegardenDocument::saveDocumentActual");
+    Profiler profiler("RosegardenDocument::saveSnapshotActual");
 
-    RG_DEBUG << "RosegardenDocument::saveDocumentActual(" << filename << ")";
+    RG_DEBUG << "RosegardenDocument::saveSnapshotActual(" << filename << ")";
 
     QString outText;
     QTextStream outStream(&outText, QIODevice::WriteOnly);
 //    outStream.setEncoding(QTextStream::UnicodeUTF8); qt3
     outStream.setCodec("UTF-8");
 
-    // output XML header
-    //
-    outStream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-    << "<!DOCTYPE rosegarden-data>\n"
-    << "<rosegarden-data version=\"" << VERSION
-    << "\" format-version-major=\"" << FILE_FORMAT_VERSION_MAJOR
-    << "\" format-version-minor=\"" << FILE_FORMAT_VERSION_MINOR
-    << "\" format-version-point=\"" << FILE_FORMAT_VERSION_POINT
-    << "\">\n";
-
-    // First make sure all MIDI devices know their current connections
-    //
-    m_studio.resyncDeviceConnections();
-
-    // Send out Composition (this includes Tracks, Instruments, Tempo
-    // and Time Signature changes and any other sub-objects)
-    //
-    outStream << strtoqstr(getComposition().toXmlString())
-              << endl << endl;
-
-    outStream << strtoqstr(getAudioFileManager().toXmlString())
-              << endl << endl;
-
-    outStream << strtoqstr(getConfiguration().toXmlString())
-              << endl << endl;
-
-    long totalEvents = 0;
-    for (Composition::iterator segitr = m_composition.begin();
-         segitr != m_composition.end(); ++segitr) {
-        totalEvents += (long)(*segitr)->size();
-    }
-
-    for (Composition::triggersegmentcontaineriterator ci =
-             m_composition.getTriggerSegments().begin();
-         ci != m_composition.getTriggerSegments().end(); ++ci) {
-        totalEvents += (long)(*ci)->getSegment()->size();
-    }
-
-    // output all elements
-    //
-    // Iterate on segments
-    long eventCount = 0;
-
-    // Put a break in the file
-    //
-    outStream << endl << endl;
-
-    for (Composition::iterator segitr = m_composition.begin();
-         segitr != m_composition.end(); ++segitr) {
-
-        Segment *segment = *segitr;
-
-        // Fix #1446 : Replace isLinked() with isTrulyLinked().
-        // Maybe this fix will need to be removed some day if the
-        // LinkTransposeParams come to be used.
-        if (segment->isTrulyLinked()) {
-            QString attsString = QString("linkerid=\"%1\" ");
-            attsString += QString("linkertransposechangekey=\"%2\" ");
-            attsString += QString("linkertransposesteps=\"%3\" ");
-            attsString += QString("linkertransposesemitones=\"%4\" ");
-            attsString += QString("linkertransposesegmentback=\"%5\" ");
-            QString linkedSegAtts = QString(attsString)
-              .arg(segment->getLinker()->getSegmentLinkerId())
-              .arg(segment->getLinkTransposeParams().m_changeKey ? "true" : 
-                                                                   "false")
-              .arg(segment->getLinkTransposeParams().m_steps)
-              .arg(segment->getLinkTransposeParams().m_semitones)
-              .arg(segment->getLinkTransposeParams().m_transposeSegmentBack
-                                                         ? "true" : "false");
-
-            saveSegment(outStream, segment, totalEvents,
-                                            eventCount, linkedSegAtts);
-        } else {
-            saveSegment(outStream, segment, totalEvents, eventCount);
-        }
-
-    }
-
-    // Put a break in the file
-    //
-    outStream << endl << endl;
-
-    for (Composition::triggersegmentcontaineriterator ci =
-                m_composition.getTriggerSegments().begin();
-            ci != m_composition.getTriggerSegments().end(); ++ci) {
-
-        QString triggerAtts = QString
-                              ("triggerid=\"%1\" triggerbasepitch=\"%2\" triggerbasevelocity=\"%3\" triggerretune=\"%4\" triggeradjusttimes=\"%5\" ")
-                              .arg((*ci)->getId())
-                              .arg((*ci)->getBasePitch())
-                              .arg((*ci)->getBaseVelocity())
-                              .arg((*ci)->getDefaultRetune())
-                              .arg(strtoqstr((*ci)->getDefaultTimeAdjust()));
-
-        Segment *segment = (*ci)->getSegment();
-        saveSegment(outStream, segment, totalEvents, eventCount, triggerAtts);
-    }
-
-    // Put a break in the file
-    //
-    outStream << endl << endl;
-
-    // Send out the studio - a self contained command
-    //
-    outStream << strtoqstr(m_studio.toXmlString()) << endl << endl;
-
-    // Send out the appearance data
-    outStream << "<appearance>" << endl;
-    outStream << strtoqstr(getComposition().getSegmentColourMap().toXmlString("segmentmap"));
-    outStream << strtoqstr(getComposition().getGeneralColourMap().toXmlString("generalmap"));
-    outStream << "</appearance>" << endl << endl << endl;
-
-    // close the top-level XML tag
-    //
-    outStream << "</rosegarden-data>\n";
+    snapshot.write(outStream);
+    outStream.flush();
 
     bool okay = GzipFile::writeToFile(filename, outText);
     if (!okay) {
@@ -1399,16 +1364,6 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
         return false;
     }
 
-    RG_DEBUG << "RosegardenDocument::saveDocument() finished";
-
-    if (!autosave) {
-        emit documentModified(false);
-        m_modified = false;
-        CommandHistory::getInstance()->documentSaved();
-    }
-
-    setAutoSaved(true);
-
     return true;
 }
 
@@ -1448,192 +1403,6 @@ bool RosegardenDocument::exportStudio(const QString& filename,
     return true;
 }
 
-void RosegardenDocument::saveSegment(QTextStream& outStream, Segment *segment,
-                                   long /*totalEvents*/, long &/*count*/,
-                                   QString extraAttributes)
-{
-    QString time;
-
-    outStream << QString("<%1 track=\"%2\" start=\"%3\" ")
-    .arg(segment->getXmlElementName())
-    .arg(segment->getTrack())
-    .arg(segment->getStartTime());
-
-    if (!extraAttributes.isEmpty())
-        outStream << extraAttributes << " ";
-
-    outStream << "label=\"" <<
-    strtoqstr(XmlExportable::encode(segment->getLabel()));
-
-    if (segment->isRepeating()) {
-        outStream << "\" repeat=\"true";
-    }
-
-    if (segment->getTranspose() != 0) {
-        outStream << "\" transpose=\"" << segment->getTranspose();
-    }
-
-    if (segment->getDelay() != 0) {
-        outStream << "\" delay=\"" << segment->getDelay();
-    }
-
-    if (segment->getRealTimeDelay() != RealTime::zeroTime) {
-        outStream << "\" rtdelaysec=\"" << segment->getRealTimeDelay().sec
-        << "\" rtdelaynsec=\"" << segment->getRealTimeDelay().nsec;
-    }
-
-    if (segment->getColourIndex() != 0) {
-        outStream << "\" colourindex=\"" << segment->getColourIndex();
-    }
-
-    if (segment->getSnapGridSize() != -1) {
-        outStream << "\" snapgridsize=\"" << segment->getSnapGridSize();
-    }
-
-    if (segment->getViewFeatures() != 0) {
-        outStream << "\" viewfeatures=\"" << segment->getViewFeatures();
-    }
-
-    if (segment->getForNotation() != true) {
-        outStream << "\" fornotation=\"" << "false";
-    }
-
-    const timeT *endMarker = segment->getRawEndMarkerTime();
-    if (endMarker) {
-        outStream << "\" endmarker=\"" << *endMarker;
-    }
-
-    if (segment->getType() == Segment::Audio) {
-
-        outStream << "\" type=\"audio\" "
-                  << "file=\""
-                  << segment->getAudioFileId();
-
-        if (segment->getStretchRatio() != 1.f &&
-            segment->getStretchRatio() != 0.f) {
-
-            outStream << "\" unstretched=\""
-                      << segment->getUnstretchedFileId()
-                      << "\" stretch=\""
-                      << segment->getStretchRatio();
-        }
-        
-        outStream << "\">\n";
-
-        // convert out - should do this as XmlExportable really
-        // once all this code is centralised
-        //
-        time.sprintf("%d.%06d", segment->getAudioStartTime().sec,
-                     segment->getAudioStartTime().usec());
-
-        outStream << "    <begin index=\""
-        << time
-        << "\"/>\n";
-
-        time.sprintf("%d.%06d", segment->getAudioEndTime().sec,
-                     segment->getAudioEndTime().usec());
-
-        outStream << "    <end index=\""
-        << time
-        << "\"/>\n";
-
-        if (segment->isAutoFading()) {
-            time.sprintf("%d.%06d", segment->getFadeInTime().sec,
-                         segment->getFadeInTime().usec());
-
-            outStream << "    <fadein time=\""
-            << time
-            << "\"/>\n";
-
-            time.sprintf("%d.%06d", segment->getFadeOutTime().sec,
-                         segment->getFadeOutTime().usec());
-
-            outStream << "    <fadeout time=\""
-            << time
-            << "\"/>\n";
-        }
-
-    } else // Internal type
-    {
-        outStream << "\">\n";
-
-        bool inChord = false;
-        timeT chordStart = 0, chordDuration = 0;
-        timeT expectedTime = segment->getStartTime();
-
-        for (Segment::iterator i = segment->begin();
-                i != segment->end(); ++i) {
-
-            timeT absTime = (*i)->getAbsoluteTime();
-
-            Segment::iterator nextEl = i;
-            ++nextEl;
-
-            if (nextEl != segment->end() &&
-                    (*nextEl)->getAbsoluteTime() == absTime &&
-                    (*i)->getDuration() != 0 &&
-                    !inChord) {
-                outStream << "<chord>" << endl;
-                inChord = true;
-                chordStart = absTime;
-                chordDuration = 0;
-            }
-
-            if (inChord && (*i)->getDuration() > 0)
-                if (chordDuration == 0 || (*i)->getDuration() < chordDuration)
-                    chordDuration = (*i)->getDuration();
-
-            outStream << '\t'
-            << strtoqstr((*i)->toXmlString(expectedTime)) << endl;
-
-            if (nextEl != segment->end() &&
-                    (*nextEl)->getAbsoluteTime() != absTime &&
-                    inChord) {
-                outStream << "</chord>\n";
-                inChord = false;
-                expectedTime = chordStart + chordDuration;
-            } else if (inChord) {
-                expectedTime = absTime;
-            } else {
-                expectedTime = absTime + (*i)->getDuration();
-            }
-
-//            if ((++count % 500 == 0) && progress) {
-//                progress->setValue(count * 100 / totalEvents);
-//            }
-        }
-
-        if (inChord) {
-            outStream << "</chord>\n";
-        }
-
-        // Add EventRulers to segment - we call them controllers because of
-        // a historical mistake in naming them.  My bad.  RWB.
-        //
-        Segment::EventRulerList list = segment->getEventRulerList();
-
-        if (list.size()) {
-            outStream << "<gui>\n"; // gui elements
-            Segment::EventRulerListConstIterator it;
-            for (it = list.begin(); it != list.end(); ++it) {
-                outStream << "  <controller type=\"" << strtoqstr((*it)->m_type);
-
-                if ((*it)->m_type == Controller::EventType) {
-                    outStream << "\" value =\"" << (*it)->m_controllerValue;
-                }
-
-                outStream << "\"/>\n";
-            }
-            outStream << "</gui>\n";
-        }
-
-    }
-
-
-    outStream << QString("</%1>\n").arg(segment->getXmlElementName()); //-------------------------
-
-}
-
 bool RosegardenDocument::saveAs(const QString &newName, QString &errMsg)
 {
     QFileInfo newNameInfo(newName);
@@ -1686,7 +1455,7 @@ bool RosegardenDocument::isSoundEnabled() const
 }
 
 bool
-RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
+RosegardenDocument::xmlParse(const QString &filename, QString &errMsg,
                            bool permanent,
                            bool &cancelled)
 {
@@ -1694,24 +1463,33 @@ RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
 
     cancelled = false;
 
-    unsigned int elementCount = 0;
-    for (int i = 0; i < fileContents.length() - 1; ++i) {
-        if (fileContents[i] == '<' && fileContents[i+1] != '/') {
-            ++elementCount;
-        }
+    // Unzip and parse on worker threads while we handle what they
+    // have parsed so far.
+    XmlStreamParser parser(filename);
+    if (!parser.open()) {
+        errMsg = tr("Could not open Rosegarden file");
+        return false;
     }
 
     if (permanent && m_soundEnabled) RosegardenSequencer::getInstance()->removeAllDevices();
 
-    RoseXmlHandler handler(this, elementCount, m_progressDialog, permanent);
+    // We don't know how many elements there are until we have read them
+    // all, so progress is reported from here based on how much of the
+    // file has been read.
+    RoseXmlHandler handler(this, 0, m_progressDialog, permanent);
+
+    while (parser.parseSome(handler)) {
+        if (m_progressDialog) {
+            if (m_progressDialog->wasCanceled())
+                break;
+            m_progressDialog->setValue(parser.getProgress());
+        }
+    }
 
-    QXmlInputSource source;
-    source.setData(fileContents);
-    QXmlSimpleReader reader;
-    reader.setContentHandler(&handler);
-    reader.setErrorHandler(&handler);
+    // In case we stopped early.
+    parser.cancel();
 
-    bool ok = reader.parse(source);
+    bool ok = parser.isOK();
 
     if (m_progressDialog  &&  m_progressDialog->wasCanceled()) {
         QMessageBox::information(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), tr("File load cancelled"));
@@ -1730,7 +1508,10 @@ RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
             return true;
         } else {
 #endif
-            errMsg = handler.errorString();
+            if (parser.isReadOK())
+                errMsg = handler.errorString();
+            else
+                errMsg = tr("Could not open Rosegarden file");
 #if 0
         }
 #endif
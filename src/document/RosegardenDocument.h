@@ -52,6 +52,8 @@ class RosegardenMainViewWidget;
 class MappedEventList;
 class Event;
 class EditViewBase;
+class DocumentSnapshot;
+class DocumentSaveThread;
 class AudioPluginManager;
 
 
@@ -208,6 +210,34 @@ public:
     bool saveDocument(const QString &filename, QString& errMsg,
                       bool autosave = false);
 
+    /// Take a snapshot of the document as it stands, for saving.
+    /**
+     * The caller owns the snapshot, and must delete it on the GUI
+     * thread.
+     *
+     * If copyEvents is false, the snapshot refers to the document's
+     * Segments rather than copying their Events.  It must then be saved
+     * on the GUI thread before the document next changes.
+     *
+     * @see saveSnapshot()
+     */
+    DocumentSnapshot *takeSnapshot(bool copyEvents = true);
+
+    /// Save a snapshot taken with takeSnapshot() to the given file.
+    /**
+     * Like saveDocument(), this saves to a temporary file and then
+     * renames it, so as not to lose the original if a failure occurs
+     * during overwriting.
+     *
+     * This only touches the snapshot and the file, so it can be called
+     * on any thread.  It does not update the modified state of the
+     * document.
+     *
+     * errMsg will be set to a user-readable error message if save fails
+     */
+    static bool saveSnapshot(const DocumentSnapshot &snapshot,
+                             const QString &filename, QString &errMsg);
+
     /// Save under a new name.
     bool saveAs(const QString &newName, QString &errMsg);
 
@@ -553,6 +583,10 @@ signals:
     void docColoursChanged();
     void devicesResyncd();
 
+private slots:
+    /// Connected to the autosave thread's finished() signal.
+    void slotAutoSaveFinished();
+
 private:
     /**
      * initializes the document generally
@@ -565,7 +599,10 @@ private:
     void performAutoload();
 
     /**
-     * Parse the Rosegarden file in \a file
+     * Unzip and parse the Rosegarden file \a filename
+     *
+     * The file is unzipped and parsed on worker threads (see
+     * XmlStreamParser) and handed to RoseXmlHandler here as it arrives.
      *
      * \a errMsg will contains the error messages
      * if parsing failed.
@@ -573,7 +610,7 @@ private:
      * @return false if parsing failed
      * @see RoseXmlHandler
      */
-    bool xmlParse(QString fileContents, QString &errMsg,
+    bool xmlParse(const QString &filename, QString &errMsg,
                   bool permanent,
                   bool &cancelled);
 
@@ -595,21 +632,17 @@ private:
     QString getAutoSaveFileName();
 
     /**
-     * Save document to the given file.  This function does the actual
-     * save of the file to the given filename; saveDocument() wraps
+     * Save a snapshot to the given file.  This function does the actual
+     * save of the file to the given filename; saveSnapshot() wraps
      * this, saving to a temporary file and then renaming to the
      * required file, so as not to lose the original if a failure
      * occurs during overwriting.
      */
-    bool saveDocumentActual(const QString &filename, QString& errMsg,
-                            bool autosave = false);
+    static bool saveSnapshotActual(const DocumentSnapshot &snapshot,
+                                   const QString &filename, QString &errMsg);
 
-    /**
-     * Save one segment to the given text stream
-     */
-    void saveSegment(QTextStream&, Segment*,
-                     long totalNbOfEvents, long &count,
-                     QString extraAttributes = QString::null);
+    /// Wait for any autosave in progress, and tidy up after it.
+    void finishAutoSave();
 
     /// Identifies a specific event within a specific segment.
     /**
@@ -718,6 +751,11 @@ private:
      */
     AudioPeaksThread m_audioPeaksThread;
 
+    /**
+     * writes the autosave file, if an autosave is in progress
+     */
+    DocumentSaveThread *m_autoSaveThread;
+
     typedef std::map<InstrumentId, Segment *> RecordingSegmentMap;
 
     /** 
@@ -0,0 +1,343 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[XmlStreamParser]"
+
+#include "XmlStreamParser.h"
+
+#include "misc/Debug.h"
+
+#include <QMutexLocker>
+#include <QXmlDefaultHandler>
+#include <QXmlInputSource>
+#include <QXmlParseException>
+#include <QXmlSimpleReader>
+
+namespace Rosegarden
+{
+
+
+/// The handler the worker thread parses into.
+/**
+ * Records what it is told in batches and queues them for parseSome().
+ */
+class XmlStreamParser::Recorder : public QXmlDefaultHandler
+{
+public:
+    explicit Recorder(XmlStreamParser *parser) :
+        m_parser(parser)
+    {
+        m_batch.reserve(parser->m_batchSize);
+    }
+
+    bool startElement(const QString &namespaceURI,
+                      const QString &localName,
+                      const QString &qName,
+                      const QXmlAttributes &attributes) override
+    {
+        Item item;
+        item.type = Item::StartElement;
+        item.namespaceURI = namespaceURI;
+        item.localName = localName;
+        item.qName = qName;
+        item.attributes = attributes;
+        return add(item);
+    }
+
+    bool endElement(const QString &namespaceURI,
+                    const QString &localName,
+                    const QString &qName) override
+    {
+        Item item;
+        item.type = Item::EndElement;
+        item.namespaceURI = namespaceURI;
+        item.localName = localName;
+        item.qName = qName;
+        return add(item);
+    }
+
+    bool characters(const QString &ch) override
+    {
+        Item item;
+        item.type = Item::Characters;
+        item.text = ch;
+        return add(item);
+    }
+
+    bool error(const QXmlParseException &exception) override
+    {
+        // Whether to carry on is up to the real handler, so carry on
+        // here and let parseSome() stop if it says so.
+        return addError(Item::Error, exception);
+    }
+
+    bool fatalError(const QXmlParseException &exception) override
+    {
+        addError(Item::FatalError, exception);
+        return false;
+    }
+
+    /// Queue what has been recorded so far.
+    bool flush()
+    {
+        if (m_batch.isEmpty())
+            return true;
+
+        const bool ok = m_parser->queueBatch(m_batch);
+        m_batch.clear();
+        return ok;
+    }
+
+private:
+    bool add(const Item &item)
+    {
+        m_batch.append(item);
+
+        if (m_batch.size() >= m_parser->m_batchSize)
+            return flush();
+
+        return true;
+    }
+
+    bool addError(Item::Type type, const QXmlParseException &exception)
+    {
+        Item item;
+        item.type = type;
+        item.text = exception.message();
+        item.lineNumber = exception.lineNumber();
+        item.columnNumber = exception.columnNumber();
+        return add(item);
+    }
+
+    XmlStreamParser *m_parser;
+    Batch m_batch;
+};
+
+XmlStreamParser::XmlStreamParser(const QString &fileName,
+                                 int batchSize,
+                                 int maxBatches) :
+    m_gzipReader(fileName),
+    m_batchSize(batchSize),
+    m_maxBatches(maxBatches),
+    m_finished(false),
+    m_cancelled(false),
+    m_readOK(false),
+    m_started(false),
+    m_done(false),
+    m_ok(false)
+{
+}
+
+XmlStreamParser::~XmlStreamParser()
+{
+    cancel();
+    wait();
+}
+
+bool
+XmlStreamParser::open()
+{
+    if (!m_gzipReader.open())
+        return false;
+
+    start();
+
+    return true;
+}
+
+bool
+XmlStreamParser::parseSome(QXmlDefaultHandler &handler)
+{
+    if (m_done)
+        return false;
+
+    if (!m_started) {
+        m_started = true;
+        if (!handler.startDocument())
+            return finish(false);
+    }
+
+    Batch batch;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        while (m_queue.isEmpty()  &&  !m_finished  &&  !m_cancelled)
+            m_condition.wait(&m_mutex);
+
+        if (m_cancelled)
+            return finish(false);
+
+        // The worker thread is done and so are we.
+        if (m_queue.isEmpty()) {
+            const bool readOK = m_readOK;
+            locker.unlock();
+
+            if (!readOK)
+                return finish(false);
+
+            return finish(handler.endDocument());
+        }
+
+        batch = m_queue.dequeue();
+        // Make room for the worker thread.
+        m_condition.wakeAll();
+    }
+
+    for (int i = 0; i < batch.size(); ++i) {
+        const Item &item = batch[i];
+
+        bool ok = true;
+
+        switch (item.type) {
+        case Item::StartElement:
+            ok = handler.startElement(item.namespaceURI, item.localName,
+                                      item.qName, item.attributes);
+            break;
+        case Item::EndElement:
+            ok = handler.endElement(item.namespaceURI, item.localName,
+                                    item.qName);
+            break;
+        case Item::Characters:
+            ok = handler.characters(item.text);
+            break;
+        case Item::Error:
+            ok = handler.error(QXmlParseException(
+                    item.text, item.columnNumber, item.lineNumber));
+            break;
+        case Item::FatalError:
+            handler.fatalError(QXmlParseException(
+                    item.text, item.columnNumber, item.lineNumber));
+            ok = false;
+            break;
+        }
+
+        if (!ok)
+            return finish(false);
+    }
+
+    return true;
+}
+
+bool
+XmlStreamParser::isReadOK() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    // If the worker didn't get to the end, we stopped it before it
+    // could find anything wrong.
+    return !m_finished  ||  m_readOK;
+}
+
+bool
+XmlStreamParser::finish(bool ok)
+{
+    m_done = true;
+    m_ok = ok;
+
+    // Stop the worker thread if it is still going.
+    cancel();
+
+    return false;
+}
+
+void
+XmlStreamParser::cancel()
+{
+    // In case the worker thread is waiting for it.
+    m_gzipReader.cancel();
+
+    QMutexLocker locker(&m_mutex);
+    m_cancelled = true;
+    m_queue.clear();
+    m_condition.wakeAll();
+}
+
+bool
+XmlStreamParser::queueBatch(const Batch &batch)
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (m_queue.size() >= m_maxBatches  &&  !m_cancelled)
+        m_condition.wait(&m_mutex);
+
+    if (m_cancelled)
+        return false;
+
+    m_queue.enqueue(batch);
+    m_condition.wakeAll();
+
+    return true;
+}
+
+void
+XmlStreamParser::run()
+{
+    Recorder recorder(this);
+
+    QXmlInputSource source;
+    QXmlSimpleReader reader;
+    reader.setContentHandler(&recorder);
+    reader.setErrorHandler(&recorder);
+
+    bool ok = true;
+    bool started = false;
+    QString chunk;
+
+    // Parse each chunk as soon as it has been unzipped.
+    while (m_gzipReader.readChunk(chunk)) {
+        source.setData(chunk);
+
+        if (!started) {
+            ok = reader.parse(&source, true /*incremental*/);
+            started = true;
+        } else {
+            ok = reader.parseContinue();
+        }
+
+        if (!ok)
+            break;
+    }
+
+    m_gzipReader.cancel();
+
+    // A parse error has been recorded for the handler, so only a
+    // failure to read the file needs reporting separately.
+    bool readOK = true;
+
+    if (ok) {
+        readOK = m_gzipReader.isOK()  &&  started;
+
+        // No more data.  Let the reader know it has reached the end so
+        // that it can check the document is complete.
+        if (readOK)
+            reader.parseContinue();
+    }
+
+    recorder.flush();
+
+    if (!readOK)
+        RG_WARNING << "run(): Could not read the file";
+
+    QMutexLocker locker(&m_mutex);
+    m_readOK = readOK;
+    m_finished = true;
+    m_condition.wakeAll();
+}
+
+
+}
@@ -0,0 +1,175 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_XML_STREAM_PARSER_H
+#define RG_XML_STREAM_PARSER_H
+
+#include "GzipStreamReader.h"
+
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <QXmlAttributes>
+
+#include <rosegardenprivate_export.h>
+
+class QXmlDefaultHandler;
+
+namespace Rosegarden
+{
+
+
+/// Parses a gzip'd XML file on a worker thread.
+/**
+ * The worker thread parses the file as GzipStreamReader unzips it, and
+ * records the elements, text and errors it finds in batches.
+ * parseSome() hands a batch to a SAX handler on the calling thread.
+ *
+ * This way unzipping, decoding and parsing all happen off the GUI
+ * thread, while the handler, which may build the Composition and pop up
+ * dialogs (see RoseXmlHandler), stays on it.
+ *
+ *   XmlStreamParser parser(fileName);
+ *   if (!parser.open())
+ *       ...
+ *   while (parser.parseSome(handler))
+ *       ...
+ *   if (!parser.isOK())
+ *       ...
+ */
+class ROSEGARDENPRIVATE_EXPORT XmlStreamParser : public QThread
+{
+public:
+    /**
+     * batchSize is the number of elements, text runs and errors
+     * recorded in a batch.  At most maxBatches batches are queued
+     * before the worker waits for parseSome() to catch up.
+     */
+    explicit XmlStreamParser(const QString &fileName,
+                             int batchSize = 1000,
+                             int maxBatches = 8);
+    /// Stops the worker thread if it is still running.
+    ~XmlStreamParser() override;
+
+    /// Open the file and start the worker thread.
+    /**
+     * Returns false if the file could not be opened.
+     */
+    bool open();
+
+    /// Hand the next batch to handler.
+    /**
+     * Waits for the worker thread if it has nothing ready yet.  Calls
+     * handler's startDocument() first and its endDocument() once the
+     * whole document has been handed over.  Parse errors go to
+     * handler's error() and fatalError().
+     *
+     * Returns false once there is nothing more to do: the document is
+     * done, a parse error was found, the handler returned false, or
+     * cancel() was called.  Must only be called from one thread.
+     */
+    bool parseSome(QXmlDefaultHandler &handler);
+
+    /// Whether the whole document was parsed and handled.
+    /**
+     * Only meaningful once parseSome() has returned false.
+     */
+    bool isOK() const  { return m_ok; }
+
+    /// Whether the file could be read.
+    /**
+     * If not, the handler has not been told, as it is not a parse
+     * error.  Only meaningful once parseSome() has returned false.
+     */
+    bool isReadOK() const;
+
+    /// How far through the (compressed) file the worker thread is, 0-100.
+    int getProgress() const  { return m_gzipReader.getProgress(); }
+
+    /// Stop parsing.  parseSome() will return false from now on.
+    void cancel();
+
+protected:
+    /// The worker thread.
+    void run() override;
+
+private:
+    /// Records what the parser finds on the worker thread.
+    class Recorder;
+
+    /// Something the parser found.
+    struct Item
+    {
+        enum Type { StartElement, EndElement, Characters,
+                    Error, FatalError };
+
+        Item() : type(Characters), lineNumber(-1), columnNumber(-1)  { }
+
+        Type type;
+
+        QString namespaceURI;
+        QString localName;
+        QString qName;
+        QXmlAttributes attributes;
+
+        /// Characters, or an error message.
+        QString text;
+        /// Where an error is.
+        int lineNumber;
+        int columnNumber;
+    };
+    typedef QVector<Item> Batch;
+
+    /// Queue a batch.  Worker thread.
+    /**
+     * Waits if the queue is full.  Returns false if cancelled.
+     */
+    bool queueBatch(const Batch &batch);
+
+    /// Stop, and remember whether it went well.  Returns false.
+    bool finish(bool ok);
+
+    GzipStreamReader m_gzipReader;
+    int m_batchSize;
+    int m_maxBatches;
+
+    /// Protects m_queue, m_finished, m_cancelled and m_readOK.
+    mutable QMutex m_mutex;
+    /// Signalled whenever any of the above changes.
+    QWaitCondition m_condition;
+    QQueue<Batch> m_queue;
+    /// The worker thread has queued all it is going to queue.
+    bool m_finished;
+    bool m_cancelled;
+    bool m_readOK;
+
+    // Only used by parseSome().
+
+    /// startDocument() has been called.
+    bool m_started;
+    /// parseSome() has returned false.
+    bool m_done;
+    bool m_ok;
+};
+
+
+}
+
+#endif
@@ -0,0 +1,462 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioExporter]"
+
+#include "AudioExporter.h"
+
+#include "base/AudioPluginInstance.h"
+#include "base/Buss.h"
+#include "base/Composition.h"
+#include "base/Instrument.h"
+#include "base/Studio.h"
+#include "document/RosegardenDocument.h"
+#include "gui/application/RosegardenMainWindow.h"
+#include "gui/seqmanager/SequenceManager.h"
+#include "misc/Debug.h"
+#include "misc/Strings.h"
+#include "misc/WorkerPool.h"
+#include "sound/AudioFile.h"
+#include "sound/AudioFileManager.h"
+#include "sound/MappedBufMetaIterator.h"
+#include "sound/MappedEvent.h"
+#include "sound/MappedEventInserter.h"
+#include "sound/MappedEventList.h"
+#include "sound/MappedStudio.h"
+#include "sound/PluginIdentifier.h"
+#include "sound/RunnablePluginInstance.h"
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include <map>
+#include <vector>
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+
+#ifdef HAVE_ALSA
+// As AlsaDriver.
+const int NOTE_OFF_VELOCITY = 64;
+#endif
+
+/// OfflineDriver that sends the soft synths the composition's events
+/// as it goes.
+class DocumentDriver : public OfflineDriver
+{
+public:
+    DocumentDriver(MappedStudio *studio, unsigned int sampleRate,
+                   MappedBufMetaIterator *metaIterator) :
+        OfflineDriver(studio, sampleRate),
+        m_metaIterator(metaIterator),
+        m_fetchedTo(RealTime::zeroTime)
+    { }
+
+    /// Call before render() with its start time.
+    void jumpTo(const RealTime &start);
+
+protected:
+    void prepareBlock(const RealTime &blockStart,
+                      const RealTime &mixedTo) override;
+
+private:
+    /// Send event to its soft synth, if it's on one.
+    void sendSynthEvent(const MappedEvent &event);
+
+    /// Send the pending NOTE OFFs before time.
+    void sendNoteOffs(const RealTime &time);
+
+    MappedBufMetaIterator *m_metaIterator;
+    RealTime m_fetchedTo;
+
+#ifdef HAVE_ALSA
+    struct NoteOff
+    {
+        InstrumentId instrument;
+        snd_seq_event_t event;
+    };
+    /// By the time they're due, as AlsaDriver keeps its NOTE OFFs.
+    std::multimap<RealTime, NoteOff> m_noteOffs;
+#endif
+};
+
+void
+DocumentDriver::jumpTo(const RealTime &start)
+{
+    m_metaIterator->jumpToTime(start);
+    m_fetchedTo = start;
+#ifdef HAVE_ALSA
+    m_noteOffs.clear();
+#endif
+}
+
+void
+DocumentDriver::prepareBlock(const RealTime & /*blockStart*/,
+                             const RealTime &mixedTo)
+{
+    if (mixedTo <= m_fetchedTo)
+        return;
+
+    MappedEventList events;
+    MappedEventInserter inserter(events);
+    m_metaIterator->fetchEvents(inserter, m_fetchedTo, mixedTo);
+    m_fetchedTo = mixedTo;
+
+    // MappedEventList keeps them in time order.
+    for (MappedEventList::const_iterator i = events.begin();
+         i != events.end(); ++i) {
+        sendNoteOffs((*i)->getEventTime());
+        sendSynthEvent(**i);
+    }
+
+    sendNoteOffs(mixedTo);
+}
+
+void
+DocumentDriver::sendSynthEvent(const MappedEvent &event)
+{
+    const InstrumentId id = event.getInstrument();
+    if (id < SoftSynthInstrumentBase ||
+        id >= SoftSynthInstrumentBase + SoftSynthInstrumentCount)
+        return;
+
+    RunnablePluginInstance *synth = getSynthPlugin(id);
+    if (!synth)
+        return;
+
+#ifdef HAVE_ALSA
+    // As AlsaDriver::processMidiOut() makes them for the soft synths.
+    // DSSIPluginInstance ignores the channel.
+
+    snd_seq_event_t ev;
+    snd_seq_ev_clear(&ev);
+
+    const MidiByte channel = event.getRecordedChannel();
+
+    switch (event.getType()) {
+
+    case MappedEvent::MidiNote:
+        if (event.getVelocity() == 0) {
+            snd_seq_ev_set_noteoff(&ev, channel, event.getPitch(),
+                                   NOTE_OFF_VELOCITY);
+            break;
+        }
+        // fall through
+
+    case MappedEvent::MidiNoteOneShot:
+        snd_seq_ev_set_noteon(&ev, channel, event.getPitch(),
+                              event.getVelocity());
+
+        if (event.getDuration() > RealTime(-1, 0)) {
+            NoteOff noteOff;
+            noteOff.instrument = id;
+            snd_seq_ev_clear(&noteOff.event);
+            snd_seq_ev_set_noteoff(&noteOff.event, channel, event.getPitch(),
+                                   NOTE_OFF_VELOCITY);
+            // Notched back, as AlsaDriver does, to come before any
+            // NOTE ON at the same time.
+            m_noteOffs.insert(std::make_pair(
+                    event.getEventTime() + event.getDuration() -
+                            RealTime(0, 1),
+                    noteOff));
+        }
+        break;
+
+    case MappedEvent::MidiProgramChange:
+        snd_seq_ev_set_pgmchange(&ev, channel, event.getData1());
+        break;
+
+    case MappedEvent::MidiKeyPressure:
+        snd_seq_ev_set_keypress(&ev, channel, event.getData1(),
+                                event.getData2());
+        break;
+
+    case MappedEvent::MidiChannelPressure:
+        snd_seq_ev_set_chanpress(&ev, channel, event.getData1());
+        break;
+
+    case MappedEvent::MidiPitchBend:
+        snd_seq_ev_set_pitchbend(
+                &ev, channel,
+                ((int(event.getData1()) << 7) | int(event.getData2())) - 8192);
+        break;
+
+    case MappedEvent::MidiController:
+        snd_seq_ev_set_controller(&ev, channel, event.getData1(),
+                                  event.getData2());
+        break;
+
+    default:
+        // Nothing a synth plays.
+        return;
+    }
+
+    synth->sendEvent(event.getEventTime(), &ev);
+#endif
+}
+
+void
+DocumentDriver::sendNoteOffs(const RealTime &time)
+{
+#ifdef HAVE_ALSA
+    while (!m_noteOffs.empty() && m_noteOffs.begin()->first < time) {
+        const NoteOff &noteOff = m_noteOffs.begin()->second;
+        RunnablePluginInstance *synth = getSynthPlugin(noteOff.instrument);
+        if (synth)
+            synth->sendEvent(m_noteOffs.begin()->first, &noteOff.event);
+        m_noteOffs.erase(m_noteOffs.begin());
+    }
+#else
+    (void)time;
+#endif
+}
+
+}
+
+
+AudioExporter::AudioExporter(RosegardenDocument *doc,
+                             const QString &fileName,
+                             unsigned int sampleRate) :
+    m_doc(doc),
+    m_fileName(fileName),
+    m_sampleRate(sampleRate)
+{
+}
+
+bool
+AudioExporter::write()
+{
+    m_message = QString();
+    m_statistics = OfflineDriver::Statistics();
+
+    Composition &composition = m_doc->getComposition();
+
+    // As MidiFile::convertToMidi().
+    RosegardenMainWindow *mainWindow = RosegardenMainWindow::self();
+    bool haveUI = (mainWindow != nullptr);
+
+    SequenceManager *sequenceManager = nullptr;
+
+    if (haveUI) {
+        sequenceManager = mainWindow->getSequenceManager();
+    } else {
+        sequenceManager = new SequenceManager();
+        sequenceManager->setDocument(m_doc);
+        sequenceManager->resetCompositionMapper();
+    }
+
+    MappedBufMetaIterator *metaIterator =
+            sequenceManager->makeTempMetaiterator();
+
+    const RealTime start =
+            composition.getElapsedRealTime(composition.getStartMarker());
+    const RealTime end =
+            composition.getElapsedRealTime(composition.getEndMarker());
+
+    bool ok = true;
+
+    {
+        MappedStudio studio;
+        DocumentDriver driver(&studio, m_sampleRate, metaIterator);
+        studio.setSoundDriver(&driver);
+        driver.setThreadCount(WorkerPool::getIdealThreadCount());
+
+        setUpStudio(studio);
+
+        AudioFileManager &audioFileManager = m_doc->getAudioFileManager();
+        for (AudioFileManagerIterator i = audioFileManager.begin();
+             i != audioFileManager.end(); ++i) {
+            if (!driver.addAudioFile((*i)->getFilename(), (*i)->getId())) {
+                m_message = tr("Can't open audio file %1")
+                        .arg((*i)->getFilename());
+                ok = false;
+                break;
+            }
+        }
+
+        if (ok) {
+            // Those on muted tracks are left out.
+            std::vector<MappedEvent> audioEvents;
+            metaIterator->getAudioEvents(audioEvents);
+            driver.initialiseAudioQueue(audioEvents);
+
+            driver.jumpTo(start);
+
+            ok = driver.render(start, end, m_fileName);
+            m_statistics = driver.getStatistics();
+
+            if (!ok)
+                m_message = tr("Could not write %1").arg(m_fileName);
+        }
+
+        // Take the plugins down while the driver is still here to
+        // take them down from.
+        studio.clear();
+    }
+
+    delete metaIterator;
+
+    if (!haveUI)
+        delete sequenceManager;
+
+    return ok;
+}
+
+void
+AudioExporter::setUpStudio(MappedStudio &studio)
+{
+    // As RosegardenDocument::initialiseStudio(), but straight onto our
+    // own studio, and leaving the document's mapped IDs alone.
+
+    Studio &documentStudio = m_doc->getStudio();
+
+    std::vector<PluginContainer *> pluginContainers;
+
+    BussList busses = documentStudio.getBusses();
+    std::vector<MappedObjectId> bussIds;
+
+    // For each buss (first one is master)
+    for (size_t i = 0; i < busses.size(); ++i) {
+
+        MappedObject *buss = studio.createObject(MappedObject::AudioBuss);
+
+        buss->setProperty(MappedAudioBuss::BussId, MappedObjectValue(i));
+        buss->setProperty(MappedAudioBuss::Level,
+                          MappedObjectValue(busses[i]->getLevel()));
+        buss->setProperty(MappedAudioBuss::Pan,
+                          MappedObjectValue(busses[i]->getPan()) - 100.0);
+
+        bussIds.push_back(buss->getId());
+        pluginContainers.push_back(busses[i]);
+    }
+
+    InstrumentList instruments = documentStudio.getAllInstruments();
+
+    // For each instrument
+    for (InstrumentList::iterator it = instruments.begin();
+         it != instruments.end(); ++it) {
+        Instrument &instrument = **it;
+
+        if (instrument.getType() != Instrument::Audio  &&
+            instrument.getType() != Instrument::SoftSynth)
+            continue;
+
+        MappedObject *fader = studio.createObject(MappedObject::AudioFader);
+
+        fader->setProperty(MappedObject::Instrument,
+                           MappedObjectValue(instrument.getId()));
+        fader->setProperty(MappedAudioFader::FaderLevel,
+                           MappedObjectValue(instrument.getLevel()));
+        fader->setProperty(MappedAudioFader::FaderRecordLevel,
+                           MappedObjectValue(instrument.getRecordLevel()));
+        fader->setProperty(MappedAudioFader::Channels,
+                           MappedObjectValue(instrument.getAudioChannels()));
+        fader->setProperty(MappedAudioFader::Pan,
+                           MappedObjectValue(instrument.getPan()) - 100.0f);
+
+        // Only the output matters for playback.
+        const BussId outputBuss = instrument.getAudioOutput();
+        if (outputBuss < bussIds.size())
+            studio.connectObjects(fader->getId(), bussIds[outputBuss]);
+
+        pluginContainers.push_back(&instrument);
+    }
+
+    // For each softsynth, audio instrument, and buss
+    for (size_t c = 0; c < pluginContainers.size(); ++c) {
+
+        PluginContainer &pluginContainer = *pluginContainers[c];
+
+        // For each plugin within this instrument or buss
+        for (AudioPluginVector::iterator pli = pluginContainer.beginPlugins();
+             pli != pluginContainer.endPlugins();
+             ++pli) {
+
+            AudioPluginInstance &plugin = **pli;
+
+            if (!plugin.isAssigned())
+                continue;
+
+            MappedPluginSlot *slot = dynamic_cast<MappedPluginSlot *>(
+                    studio.createObject(MappedObject::PluginSlot));
+            if (!slot)
+                continue;
+
+            slot->setProperty(MappedObject::Position,
+                              MappedObjectValue(plugin.getPosition()));
+            slot->setProperty(MappedObject::Instrument,
+                              MappedObjectValue(pluginContainer.getId()));
+            slot->setStringProperty(MappedPluginSlot::Identifier,
+                                    strtoqstr(plugin.getIdentifier()));
+
+            // Opaque string configuration data (e.g. for DSSI plugin)
+
+            MappedObjectPropertyList config;
+
+            for (AudioPluginInstance::ConfigMap::const_iterator i =
+                         plugin.getConfiguration().begin();
+                 i != plugin.getConfiguration().end();
+                 ++i) {
+                if (strtoqstr(i->first) ==
+                    PluginIdentifier::RESERVED_PROJECT_DIRECTORY_KEY)
+                    continue;
+                config.push_back(strtoqstr(i->first));
+                config.push_back(strtoqstr(i->second));
+            }
+
+            config.push_back(PluginIdentifier::RESERVED_PROJECT_DIRECTORY_KEY);
+            config.push_back(m_doc->getAudioFileManager().getAudioPath());
+
+            try {
+                slot->setPropertyList(MappedPluginSlot::Configuration, config);
+            } catch (const QString &error) {
+                RG_WARNING << "setUpStudio(): plugin configuration:" << error;
+            }
+
+            slot->setProperty(MappedPluginSlot::Bypassed,
+                              MappedObjectValue(plugin.isBypassed()));
+
+            for (PortInstanceIterator portIt = plugin.begin();
+                 portIt != plugin.end();
+                 ++portIt) {
+                slot->setPort((*portIt)->number, (*portIt)->value);
+            }
+
+            if (plugin.getProgram() != "") {
+                slot->setStringProperty(MappedPluginSlot::Program,
+                                        strtoqstr(plugin.getProgram()));
+
+                // Set the post-program port values
+                for (PortInstanceIterator portIt = plugin.begin();
+                     portIt != plugin.end();
+                     ++portIt) {
+                    if ((*portIt)->changedSinceProgramChange)
+                        slot->setPort((*portIt)->number, (*portIt)->value);
+                }
+            }
+        }
+    }
+}
+
+
+}
@@ -0,0 +1,83 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIOEXPORTER_H
+#define RG_AUDIOEXPORTER_H
+
+#include <rosegardenprivate_export.h>
+
+#include "sound/OfflineDriver.h"
+
+#include <QCoreApplication>
+#include <QString>
+
+
+namespace Rosegarden
+{
+
+class MappedStudio;
+class RosegardenDocument;
+
+
+/// Renders a document's audio and soft synth tracks to an audio file.
+/**
+ * Needs no sequencer and no JACK.  The composition is mapped as
+ * MidiFile::convertToMidi() maps it, and the studio's busses, faders
+ * and plugins are set up on a MappedStudio of our own, as
+ * RosegardenDocument::initialiseStudio() sets them up on the
+ * sequencer's.  OfflineDriver then mixes the master out from the
+ * composition's start marker to its end marker, as fast as it can,
+ * sending the soft synths their events a block at a time.
+ *
+ * Tracks on MIDI instruments are not heard: there is nothing to play
+ * them.
+ */
+class ROSEGARDENPRIVATE_EXPORT AudioExporter
+{
+    Q_DECLARE_TR_FUNCTIONS(Rosegarden::AudioExporter)
+
+public:
+    /// Write to fileName, in a format AudioWriteStreamFactory knows
+    /// from its extension.
+    AudioExporter(RosegardenDocument *doc, const QString &fileName,
+                  unsigned int sampleRate = 48000);
+
+    bool write();
+
+    /// Why write() failed.
+    QString getMessage() const  { return m_message; }
+
+    /// How the render went.
+    const OfflineDriver::Statistics &getStatistics() const
+            { return m_statistics; }
+
+private:
+    /// Create the document's busses, faders and plugins in studio.
+    void setUpStudio(MappedStudio &studio);
+
+    RosegardenDocument *m_doc;
+    QString m_fileName;
+    unsigned int m_sampleRate;
+
+    QString m_message;
+    OfflineDriver::Statistics m_statistics;
+};
+
+
+}
+
+#endif
@@ -0,0 +1,430 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[BatchConverter]"
+
+#include "BatchConverter.h"
+
+#include "base/AnalysisTypes.h"
+#include "base/BaseProperties.h"
+#include "base/BasicQuantizer.h"
+#include "base/Composition.h"
+#include "base/CompositionTimeSliceAdapter.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "base/SegmentNotationHelper.h"
+#include "base/Selection.h"
+#include "commands/edit/EventQuantizeCommand.h"
+#include "document/CommandHistory.h"
+#include "document/DocumentSnapshot.h"
+#include "document/RosegardenDocument.h"
+#include "document/io/AudioExporter.h"
+#include "document/io/CsoundExporter.h"
+#include "document/io/LilyPondExporter.h"
+#include "document/io/MupExporter.h"
+#include "document/io/MusicXMLLoader.h"
+#include "document/io/MusicXmlExporter.h"
+#include "misc/ConfigGroups.h"
+#include "misc/Debug.h"
+#include "misc/Strings.h"
+#include "misc/WorkerPool.h"
+#include "sound/MidiFile.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+
+#include <algorithm>
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+
+QString extension(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().toLower();
+}
+
+bool isMIDI(const QString &fileName)
+{
+    const QString suffix = extension(fileName);
+    return suffix == "mid" || suffix == "midi";
+}
+
+/// Fill in the tables that are filled in on first use, so that the
+/// threads don't all try to at once.
+void initStaticObjects()
+{
+    Accidentals::getStandardAccidentals();
+    Marks::getStandardMarks();
+    BaseProperties::getMarkPropertyName(0);
+    BasicQuantizer::getStandardQuantizations();
+
+    // Documents connect to it as they are made.
+    CommandHistory::getInstance();
+}
+
+/// Files to convert, shared out on a WorkerPool.
+class ConversionJob
+{
+public:
+    ConversionJob(const BatchConverter &converter,
+                  const QStringList &inputFiles,
+                  const std::vector<int> &indices,
+                  std::vector<BatchConverter::Result> &results) :
+        m_converter(converter),
+        m_inputFiles(inputFiles),
+        m_indices(indices),
+        m_results(results)
+    { }
+
+    /// WorkerPool::Job to convert the next'th of the files.
+    static void run(void *job, size_t next, int worker);
+
+private:
+    const BatchConverter &m_converter;
+    const QStringList &m_inputFiles;
+    const std::vector<int> &m_indices;
+    // Each thread writes only the results of the files it claimed.
+    std::vector<BatchConverter::Result> &m_results;
+};
+
+void
+ConversionJob::run(void *job, size_t next, int /* worker */)
+{
+    ConversionJob *conversionJob = static_cast<ConversionJob *>(job);
+
+    const int index = conversionJob->m_indices[next];
+    conversionJob->m_results[index] = conversionJob->m_converter.convertFile(
+            conversionJob->m_inputFiles[index]);
+}
+
+}
+
+BatchConverter::BatchConverter() :
+    m_threads(0)
+{
+}
+
+QStringList
+BatchConverter::getOutputFormats()
+{
+    return QStringList() << "rg" << "mid" << "ly" << "xml" << "csd" << "mup"
+                         << "wav";
+}
+
+bool
+BatchConverter::canRead(const QString &fileName)
+{
+    const QString suffix = extension(fileName);
+    return suffix == "rg" || isMIDI(fileName) || suffix == "xml";
+}
+
+QStringList
+BatchConverter::findInputFiles(const QString &directory)
+{
+    QStringList inputFiles;
+
+    const QFileInfoList entries = QDir(directory).entryInfoList(
+            QDir::Files | QDir::Readable, QDir::Name);
+    for (int i = 0; i < entries.size(); ++i) {
+        if (canRead(entries[i].fileName()))
+            inputFiles << entries[i].filePath();
+    }
+
+    return inputFiles;
+}
+
+bool
+BatchConverter::needsGUIThread(const QString &inputFile) const
+{
+    return extension(inputFile) == "rg" || m_formats.contains("mid") ||
+            m_formats.contains("wav");
+}
+
+std::vector<BatchConverter::Result>
+BatchConverter::convert(const QStringList &inputFiles)
+{
+    std::vector<Result> results(inputFiles.size());
+
+    initStaticObjects();
+
+    std::vector<int> here;
+    std::vector<int> pooled;
+    for (int i = 0; i < inputFiles.size(); ++i) {
+        if (needsGUIThread(inputFiles[i]))
+            here.push_back(i);
+        else
+            pooled.push_back(i);
+    }
+
+    int threads = m_threads;
+    if (threads <= 0)
+        threads = WorkerPool::getIdealThreadCount();
+    threads = std::min(threads, static_cast<int>(pooled.size()));
+
+    ConversionJob job(*this, inputFiles, pooled, results);
+
+    WorkerPool pool(threads);
+    pool.start(ConversionJob::run, &job, pooled.size());
+
+    // Do those that can only be done here while the pool gets on
+    // with the rest.
+    for (size_t i = 0; i < here.size(); ++i) {
+        results[here[i]] = convertFile(inputFiles[here[i]]);
+        qApp->processEvents(QEventLoop::AllEvents);
+    }
+
+    pool.wait();
+
+    return results;
+}
+
+BatchConverter::Result
+BatchConverter::convertFile(const QString &inputFile) const
+{
+    Result result;
+    result.inputFile = inputFile;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Made here so that it belongs to this thread.
+    RosegardenDocument doc(
+            nullptr,  // parent
+            {},  // audioPluginManager
+            true,  // skipAutoload
+            false,  // clearCommandHistory
+            false);  // enableSound
+
+    result.error = load(inputFile, doc);
+    result.loadSeconds = timer.nsecsElapsed() / 1e9;
+
+    if (!result.error.isEmpty())
+        return result;
+
+    timer.restart();
+
+    for (int i = 0; i < m_formats.size(); ++i) {
+        const QString outputFile = getOutputFile(inputFile, m_formats[i]);
+
+        if (QFileInfo(outputFile).absoluteFilePath() ==
+            QFileInfo(inputFile).absoluteFilePath()) {
+            result.error = tr("Not overwriting the input file with %1")
+                    .arg(outputFile);
+            break;
+        }
+
+        result.error = save(doc, m_formats[i], outputFile, result);
+        if (!result.error.isEmpty())
+            break;
+
+        result.outputFiles << outputFile;
+    }
+
+    result.saveSeconds = timer.nsecsElapsed() / 1e9;
+    result.ok = result.error.isEmpty();
+
+    return result;
+}
+
+QString
+BatchConverter::getOutputFile(const QString &inputFile,
+                              const QString &format) const
+{
+    const QFileInfo inputInfo(inputFile);
+
+    QString baseName = inputInfo.completeBaseName();
+
+    // LilyPondExporter would ask whether to take these out, so we take
+    // them out first.
+    if (format == "ly") {
+        baseName.replace(QRegExp(" "), "");
+        baseName.replace(QRegExp("\\\\"), "");
+        baseName.replace(QRegExp("'"), "");
+        baseName.replace(QRegExp("\""), "");
+    }
+
+    const QString directory = m_outputDirectory.isEmpty() ?
+            inputInfo.path() : m_outputDirectory;
+
+    return QDir(directory).filePath(baseName + "." + format);
+}
+
+QString
+BatchConverter::load(const QString &inputFile, RosegardenDocument &doc) const
+{
+    if (!QFileInfo(inputFile).isReadable())
+        return tr("Can't open file '%1'").arg(inputFile);
+
+    if (extension(inputFile) == "rg") {
+        if (!doc.openDocument(inputFile,
+                              false,  // permanent
+                              true,  // squelchProgressDialog
+                              false))  // enableLock
+            return tr("Error opening rg file: %1").arg(inputFile);
+
+        return QString();
+    }
+
+    if (isMIDI(inputFile)) {
+        MidiFile midiFile;
+        if (!midiFile.convertToRosegarden(inputFile, &doc))
+            return strtoqstr(midiFile.getError());
+
+        prepareForNotation(doc.getComposition());
+
+        return QString();
+    }
+
+    MusicXMLLoader musicxmlLoader(&doc.getStudio());
+    if (!musicxmlLoader.load(inputFile, doc.getComposition(),
+                             doc.getStudio()))
+        return tr("Can't load MusicXML file:\n") +
+                musicxmlLoader.errorMessage();
+
+    return QString();
+}
+
+QString
+BatchConverter::save(RosegardenDocument &doc, const QString &format,
+                     const QString &outputFile, Result &result) const
+{
+    const std::string fileName = qstrtostr(outputFile);
+
+    if (format == "rg") {
+        // Not RosegardenDocument::saveDocument(), which tells the
+        // CommandHistory, nor takeSnapshot(), which asks the sequencer
+        // about connections.
+        DocumentSnapshot snapshot(&doc);
+        QString errMsg;
+        if (!RosegardenDocument::saveSnapshot(snapshot, outputFile, errMsg))
+            return errMsg;
+        return QString();
+    }
+
+    if (format == "mid") {
+        MidiFile midiFile;
+        if (!midiFile.convertToMidi(&doc, outputFile))
+            return tr("Error writing MIDI file: %1").arg(outputFile);
+        return QString();
+    }
+
+    if (format == "wav") {
+        AudioExporter exporter(&doc, outputFile);
+        const bool ok = exporter.write();
+        result.rendered = true;
+        result.renderStatistics = exporter.getStatistics();
+        if (!ok)
+            return exporter.getMessage().isEmpty() ?
+                    tr("Could not write %1").arg(outputFile) :
+                    exporter.getMessage();
+        return QString();
+    }
+
+    bool ok = false;
+
+    if (format == "ly") {
+        LilyPondExporter exporter(&doc, SegmentSelection(), fileName);
+        ok = exporter.write();
+        if (!ok && !exporter.getMessage().isEmpty())
+            return exporter.getMessage();
+    } else if (format == "xml") {
+        MusicXmlExporter exporter(nullptr, &doc, fileName);
+        ok = exporter.write();
+    } else if (format == "csd") {
+        CsoundExporter exporter(nullptr, &doc.getComposition(), fileName);
+        ok = exporter.write();
+    } else if (format == "mup") {
+        MupExporter exporter(nullptr, &doc.getComposition(), fileName);
+        ok = exporter.write();
+    } else {
+        return tr("Unknown output format: %1").arg(format);
+    }
+
+    if (!ok)
+        return tr("Could not write %1").arg(outputFile);
+
+    return QString();
+}
+
+void
+BatchConverter::prepareForNotation(Composition &composition)
+{
+    // As RosegardenMainWindow::createDocumentFromMIDIFile() does, but
+    // quantizing straight away rather than through the CommandHistory.
+
+    for (Composition::iterator i = composition.begin();
+         i != composition.end(); ++i) {
+
+        Segment &segment = **i;
+        SegmentNotationHelper helper(segment);
+        segment.insert(helper.guessClef(segment.begin(),
+                                        segment.getEndMarker())
+                       .getAsEvent(segment.getStartTime()));
+    }
+
+    for (Composition::iterator i = composition.begin();
+         i != composition.end(); ++i) {
+
+        // Find the first key event in each segment.
+        Segment &segment = **i;
+        timeT firstKeyTime = segment.getEndMarkerTime();
+
+        for (Segment::iterator si = segment.begin();
+             segment.isBeforeEndMarker(si); ++si) {
+            if ((*si)->isa(Rosegarden::Key::EventType)) {
+                firstKeyTime = (*si)->getAbsoluteTime();
+                break;
+            }
+        }
+
+        if (firstKeyTime > segment.getStartTime()) {
+            CompositionTimeSliceAdapter adapter
+                (&composition, timeT(0), firstKeyTime);
+            AnalysisHelper helper;
+            segment.insert(helper.guessKey(adapter).getAsEvent
+                           (segment.getStartTime()));
+        }
+    }
+
+    for (Composition::iterator i = composition.begin();
+         i != composition.end(); ++i) {
+
+        Segment &segment = **i;
+
+        EventQuantizeCommand command
+            (segment, segment.getStartTime(), segment.getEndMarkerTime(),
+             NotationOptionsConfigGroup,
+             EventQuantizeCommand::QUANTIZE_NOTATION_ONLY);
+        command.execute();
+    }
+
+    if (composition.getTimeSignatureCount() == 0) {
+        CompositionTimeSliceAdapter adapter(&composition);
+        AnalysisHelper analysisHelper;
+        TimeSignature timeSig =
+            analysisHelper.guessTimeSignature(adapter);
+        composition.addTimeSignature(0, timeSig);
+    }
+}
+
+
+}
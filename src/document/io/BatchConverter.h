@@ -0,0 +1,142 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_BATCHCONVERTER_H
+#define RG_BATCHCONVERTER_H
+
+#include <rosegardenprivate_export.h>
+
+#include "sound/OfflineDriver.h"
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+
+class Composition;
+class RosegardenDocument;
+
+
+/// Converts files from one format to others, many at a time.
+/**
+ * Reads Rosegarden (.rg), MIDI (.mid, .midi) and MusicXML (.xml) files,
+ * and writes any of Rosegarden, MIDI, LilyPond (.ly), MusicXML, Csound
+ * (.csd) and Mup (.mup) files, and audio (.wav) rendered by
+ * AudioExporter, without a main window.  This is what the
+ * rosegarden-convert tool does.
+ *
+ * Files are converted on a pool of threads, except for those that have
+ * to be converted on the GUI thread: reading a .rg file
+ * (RosegardenDocument::openDocument() puts up dialogs) and writing a
+ * MIDI or audio file (MidiFile::convertToMidi() and AudioExporter need
+ * a SequenceManager).  Those are converted on the calling thread
+ * meanwhile.
+ *
+ * MIDI files are prepared for notation as they would be when imported
+ * into the main window: a clef and key are guessed for each segment,
+ * notation is quantized, and a time signature is guessed if there is
+ * none.
+ */
+class ROSEGARDENPRIVATE_EXPORT BatchConverter
+{
+    Q_DECLARE_TR_FUNCTIONS(Rosegarden::BatchConverter)
+
+public:
+    BatchConverter();
+
+    /// Output formats, by file extension.
+    static QStringList getOutputFormats();
+
+    /// Whether fileName has an extension we can read.
+    static bool canRead(const QString &fileName);
+
+    /// The files in directory that we can read, sorted by name.
+    static QStringList findInputFiles(const QString &directory);
+
+    /// Where output files go.  The default is beside each input file.
+    void setOutputDirectory(const QString &directory)
+            { m_outputDirectory = directory; }
+
+    /// Formats to write, from getOutputFormats().
+    void setFormats(const QStringList &formats)  { m_formats = formats; }
+
+    /// Number of threads to convert on.  0, the default, means as many
+    /// as will help.
+    void setThreads(int threads)  { m_threads = threads; }
+
+    struct Result
+    {
+        Result() :
+            ok(false), loadSeconds(0), saveSeconds(0), rendered(false)
+        { }
+
+        QString inputFile;
+        /// Those written, in the order of the formats.
+        QStringList outputFiles;
+        bool ok;
+        /// Why not, if not ok.
+        QString error;
+        /// Time spent reading the input file, and writing the outputs.
+        double loadSeconds;
+        double saveSeconds;
+        /// Whether audio was rendered, and how that went.
+        bool rendered;
+        OfflineDriver::Statistics renderStatistics;
+    };
+
+    /// Convert each of inputFiles to each format.
+    /**
+     * Must be called on the GUI thread.  Returns a Result for each
+     * input file, in the same order.  A file that fails does not stop
+     * the others.
+     */
+    std::vector<Result> convert(const QStringList &inputFiles);
+
+    /// Convert one file.  Call on the GUI thread unless
+    /// needsGUIThread() says otherwise.
+    Result convertFile(const QString &inputFile) const;
+
+    /// Whether converting inputFile has to be done on the GUI thread.
+    bool needsGUIThread(const QString &inputFile) const;
+
+    /// Clean a MIDI import up for notation, as the main window does.
+    static void prepareForNotation(Composition &composition);
+
+private:
+    QString getOutputFile(const QString &inputFile,
+                          const QString &format) const;
+
+    /// Read inputFile into doc.  Returns an error message, or an empty
+    /// string if all went well.
+    QString load(const QString &inputFile, RosegardenDocument &doc) const;
+    /// Write doc to outputFile in the given format.  Render statistics
+    /// go in result.
+    QString save(RosegardenDocument &doc, const QString &format,
+                 const QString &outputFile, Result &result) const;
+
+    QString m_outputDirectory;
+    QStringList m_formats;
+    int m_threads;
+};
+
+
+}
+
+#endif
@@ -101,7 +101,8 @@ LilyPondExporter::LilyPondExporter(RosegardenDocument *doc,
     m_fileName(fileName),
     m_lastClefFound(Clef::Treble),
     m_selection(selection),
-    SKIP_PROPERTY("LilyPondExportSkipThisEvent")
+    SKIP_PROPERTY("LilyPondExportSkipThisEvent"),
+    m_durationRatio(0, 1)
 {
     m_composition = &m_doc->getComposition();
     m_studio = &m_doc->getStudio();
@@ -2252,7 +2253,7 @@ LilyPondExporter::writeBar(Segment *s,
     timeT writtenDuration = 0;
     std::pair<int,int> barDurationRatio(timeSignature.getNumerator(),timeSignature.getDenominator());
     std::pair<int,int> durationRatioSum(0,1);
-    static std::pair<int,int> durationRatio(0,1);
+    std::pair<int,int> &durationRatio = m_durationRatio;
 
     if (absTime > barStart) {
         Note note(Note::getNearestNote(absTime - barStart, MAX_DOTS));
@@ -288,6 +288,10 @@ private:
 
     QPointer<QProgressDialog> m_progressDialog;
 
+    // Duration of the last note or rest written, carried from one bar
+    // to the next by writeBar().
+    std::pair<int,int> m_durationRatio;
+
     std::pair<int,int> fractionSum(std::pair<int,int> x,std::pair<int,int> y) {
 	std::pair<int,int> z(
 	    x.first * y.second + x.second * y.first,
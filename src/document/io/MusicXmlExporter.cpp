@@ -61,7 +61,8 @@ MusicXmlExporter::MusicXmlExporter(RosegardenMainWindow *parent,
         m_fileName(fileName)
 {
     m_composition = &m_doc->getComposition();
-    m_view = parent->getView();
+    // No main window when converting from the command line.
+    m_view = parent ? parent->getView() : nullptr;
     readConfigVariables();
 }
 
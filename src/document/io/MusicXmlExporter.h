@@ -136,7 +136,7 @@ public:
     /**
      * Constructs a MusicXmlExporter object
      *
-     * @param parent the parent object.
+     * @param parent the parent object, or nullptr with no main window.
      * @param doc the Rosegarden document.
      * @param filename name of the outfile MusicXML file.
      */
@@ -203,6 +203,7 @@
 #include <QByteArray>
 #include <QCursor>
 #include <QDataStream>
+#include <QDateTime>
 #include <QDialog>
 #include <QDir>
 #include <QFile>
@@ -579,6 +580,11 @@ RosegardenMainWindow::installSignalHandlers()
         return false;
     }
 
+    if (sigaction(SIGUSR2, &action, nullptr) == -1) {
+        RG_WARNING << "installSignalHandlers(): sigaction() failed:" << std::strerror(errno);
+        return false;
+    }
+
     return true;
 }
 
@@ -598,12 +604,37 @@ RosegardenMainWindow::signalAction(int fd)
         case SIGUSR1:
             slotFileSave();
             break;
+        case SIGUSR2:
+            toggleProfileTrace();
+            break;
         default:
             RG_WARNING << "signalAction(): Unexpected signal received:" << message;
             break;
     }
 }
 
+void
+RosegardenMainWindow::toggleProfileTrace()
+{
+    if (!ProfileTrace::isRecording()) {
+        ProfileTrace::start();
+        RG_WARNING << "toggleProfileTrace(): Recording profile trace";
+        return;
+    }
+
+    ProfileTrace::stop();
+
+    const QString fileName = QDir::tempPath() +
+            QString("/rosegarden-trace-%1-%2.json").
+                arg(QCoreApplication::applicationPid()).
+                arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+
+    if (ProfileTrace::exportChromeTrace(fileName))
+        RG_WARNING << "toggleProfileTrace(): Profile trace written to" << fileName;
+    else
+        RG_WARNING << "toggleProfileTrace(): Failed to write profile trace to" << fileName;
+}
+
 void
 RosegardenMainWindow::closeEvent(QCloseEvent *event)
 {
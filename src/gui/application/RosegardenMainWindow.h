@@ -1717,6 +1717,13 @@ private:
     static void handleSignal(int);
     bool installSignalHandlers();
 
+    /// SIGUSR2: start or stop recording a ProfileTrace.
+    /**
+     * Stopping exports the trace to a file in the temporary directory
+     * which can be loaded into chrome://tracing.
+     */
+    void toggleProfileTrace();
+
     // See slotUpdateCPUMeter()
     QTimer *m_cpuMeterTimer;
 
@@ -0,0 +1,165 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[convert]"
+
+// rosegarden-convert: converts files between the formats Rosegarden
+// reads and writes, with no main window and no sequencer, for use in
+// scripts.  See BatchConverter.
+
+#include "document/io/BatchConverter.h"
+#include "sound/OfflineDriver.h"
+#include "misc/Strings.h"
+#include "rosegarden-version.h"
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStringList>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace Rosegarden;
+
+static void usage()
+{
+    std::cerr << "Rosegarden: A sequencer and musical notation editor\n";
+    std::cerr << "Usage: rosegarden-convert --to format[,format...] [--output directory]\n"
+              << "                          [--jobs n] (file|directory)...\n";
+    std::cerr << "       rosegarden-convert --version\n";
+    std::cerr << "\n";
+    std::cerr << "Reads .rg, .mid, .midi and .xml (MusicXML) files, and each such file\n"
+              << "in a directory.  Writes the formats given, by extension: "
+              << BatchConverter::getOutputFormats().join(", ") << ".\n";
+    std::cerr << "Output files go beside their input files unless --output is given.\n";
+    std::cerr << "Audio (.wav) is rendered from the audio and soft synth tracks.\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--version")) {
+            std::cout << "Rosegarden version: " << VERSION << std::endl;
+            return 0;
+        }
+    }
+
+    // Reading .rg files and writing MIDI and audio files still make
+    // widgets, so we need a QApplication, but nothing needs to be shown.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication theApp(argc, argv);
+
+    // Use the user's settings for notation, LilyPond export, etc...
+    theApp.setOrganizationName("rosegardenmusic");
+    theApp.setOrganizationDomain("rosegardenmusic.com");
+    theApp.setApplicationName(QObject::tr("Rosegarden"));
+
+    const QStringList args = theApp.arguments();
+
+    QStringList formats;
+    QString outputDirectory;
+    int threads = 0;
+    QStringList inputFiles;
+
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "--to" && i + 1 < args.size()) {
+            formats << args[++i].toLower().split(',', QString::SkipEmptyParts);
+        } else if (args[i] == "--output" && i + 1 < args.size()) {
+            outputDirectory = args[++i];
+        } else if (args[i] == "--jobs" && i + 1 < args.size()) {
+            bool ok = false;
+            threads = args[++i].toInt(&ok);
+            if (!ok || threads < 1) usage();
+        } else if (args[i].startsWith("-")) {
+            usage();
+        } else if (QFileInfo(args[i]).isDir()) {
+            inputFiles << BatchConverter::findInputFiles(args[i]);
+        } else {
+            inputFiles << args[i];
+        }
+    }
+
+    if (formats.isEmpty() || inputFiles.isEmpty()) usage();
+
+    for (int i = 0; i < formats.size(); ++i) {
+        if (!BatchConverter::getOutputFormats().contains(formats[i])) {
+            std::cerr << "Unknown output format: " << formats[i] << "\n";
+            usage();
+        }
+    }
+
+    if (!outputDirectory.isEmpty() && !QFileInfo(outputDirectory).isDir()) {
+        std::cerr << "Not a directory: " << outputDirectory << "\n";
+        return 1;
+    }
+
+    BatchConverter converter;
+    converter.setFormats(formats);
+    converter.setOutputDirectory(outputDirectory);
+    converter.setThreads(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const std::vector<BatchConverter::Result> results =
+            converter.convert(inputFiles);
+
+    const double seconds = timer.nsecsElapsed() / 1e9;
+
+    int failed = 0;
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BatchConverter::Result &result = results[i];
+
+        char timing[64];
+        snprintf(timing, sizeof(timing), "load %.3fs, save %.3fs",
+                 result.loadSeconds, result.saveSeconds);
+
+        if (result.ok) {
+            std::cout << result.inputFile << ": " << timing << ": "
+                      << result.outputFiles.join(" ") << "\n";
+        } else {
+            ++failed;
+            std::cout << result.inputFile << ": " << timing << ": failed: "
+                      << result.error << "\n";
+        }
+
+        if (result.rendered) {
+            const OfflineDriver::Statistics &stats = result.renderStatistics;
+            char render[128];
+            snprintf(render, sizeof(render),
+                     "rendered %lu frames in %.3fs (%.1fx realtime), "
+                     "peak %.3f, %d underruns",
+                     (unsigned long)stats.frames, stats.seconds,
+                     stats.realtimeFactor, double(stats.peak),
+                     stats.underruns);
+            std::cout << result.inputFile << ": " << render << "\n";
+        }
+    }
+
+    char summary[128];
+    snprintf(summary, sizeof(summary),
+             "%d of %d files converted in %.3fs",
+             int(results.size()) - failed, int(results.size()), seconds);
+    std::cout << summary << std::endl;
+
+    return failed ? 1 : 0;
+}
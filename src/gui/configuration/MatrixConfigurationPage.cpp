@@ -23,6 +23,7 @@
 #include "misc/ConfigGroups.h"
 #include "gui/editors/matrix/MatrixView.h"
 #include "TabbedConfigurationPage.h"
+#include <QCheckBox>
 #include <QSettings>
 #include <QFrame>
 #include <QLabel>
@@ -37,21 +38,39 @@ namespace Rosegarden
 MatrixConfigurationPage::MatrixConfigurationPage(QWidget *parent) :
         TabbedConfigurationPage(parent)
 {
+    QSettings settings;
+    settings.beginGroup(MatrixViewConfigGroup);
+
     QFrame *frame = new QFrame(m_tabWidget);
     frame->setContentsMargins(10, 10, 10, 10);
     QGridLayout *layout = new QGridLayout(frame);
     layout->setSpacing(5);
 
-    layout->addWidget(new QLabel("Nothing here yet", frame), 0, 0);
+    int row = 0;
+
+    layout->addWidget
+        (new QLabel
+         (tr("Only draw the notes near the visible area"), frame),
+         row, 0, 1, 2);
+    m_virtualised = new QCheckBox(frame);
+    m_virtualised->setToolTip(tr("Opens and scrolls long, busy segments faster.  "
+                                 "Takes effect in newly opened editors."));
+    connect(m_virtualised, &QCheckBox::stateChanged, this, &MatrixConfigurationPage::slotModified);
+    m_virtualised->setChecked(settings.value("Virtualised rendering", false).toBool());
+    layout->addWidget(m_virtualised, row, 2);
+    ++row;
+
+    layout->setRowStretch(row, 10);
 
     addTab(frame, tr("General"));
 }
 
 void MatrixConfigurationPage::apply()
 {
-    //@@@ Next two lines not need.  Commented out.
-    //@@@ QSettings settings;
-    //@@@ settings.beginGroup( MatrixViewConfigGroup );
+    QSettings settings;
+    settings.beginGroup(MatrixViewConfigGroup);
+
+    settings.setValue("Virtualised rendering", m_virtualised->isChecked());
 }
 
 }
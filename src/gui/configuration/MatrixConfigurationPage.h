@@ -23,6 +23,7 @@
 
 
 class QWidget;
+class QCheckBox;
 
 
 namespace Rosegarden
@@ -50,6 +51,8 @@ protected slots:
 protected:
 
     //--------------- Data members ---------------------------------
+
+    QCheckBox *m_virtualised;
 };
 
 
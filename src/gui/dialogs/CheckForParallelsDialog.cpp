@@ -28,6 +28,7 @@
 #include "base/Segment.h"
 #include "base/Event.h"
 #include "base/BaseProperties.h"
+#include "base/NotationTypes.h"
 #include "gui/widgets/FileDialog.h"
 #include "misc/ConfigGroups.h"
 
@@ -238,7 +239,7 @@ CheckForParallelsDialog::clear()
 
             // if it's a note, clear it
 
-            if ((*ia)->isa("note")) (*ia)->set<Bool>(BaseProperties::MEMBER_OF_PARALLEL, false);
+            if ((*ia)->isa(Note::EventType)) (*ia)->set<Bool>(BaseProperties::MEMBER_OF_PARALLEL, false);
 
             ++ia;
 
@@ -466,7 +467,7 @@ CheckForParallelsDialog::startCheck()
             // if we have a predecessor and the current event is a note then we have a potential transition
             // but we need to check whether we have multiple notes at the same time
 
-            if ((*ia)->isa("note")) {
+            if ((*ia)->isa(Note::EventType)) {
 
                 if (currentTrackLabel == QString("v4") )
                         text = "";
@@ -539,7 +540,7 @@ CheckForParallelsDialog::startCheck()
 
                 // are there other events that also should break the transition?
 
-                if ((*ia)->isa("rest"))
+                if ((*ia)->isa(Note::EventRestType))
                     currentPredecessor = segment[i]->end();
             }
         }
@@ -27,7 +27,7 @@ namespace Rosegarden
 
 namespace Guitar
 {
-const std::string Chord::EventType              = "guitarchord";
+const EventTypeName Chord::EventType              = "guitarchord";
 const short Chord::EventSubOrdering             = -60;
 
 static const PropertyName RootPropertyName = "root";
@@ -44,7 +44,13 @@ MatrixElement::MatrixElement(MatrixScene *scene, Event *event,
     m_scene(scene),
     m_drum(drum),
     m_current(true),
+    m_selected(false),
     m_item(nullptr),
+    m_width(0),
+    m_velocity(0),
+    m_itemWidth(0),
+    m_itemHeight(0),
+    m_tied(false),
     m_pitchOffset(pitchOffset)
 {
     reconfigure();
@@ -52,7 +58,7 @@ MatrixElement::MatrixElement(MatrixScene *scene, Event *event,
 
 MatrixElement::~MatrixElement()
 {
-    delete m_item;
+    releaseItem();
 }
 
 void
@@ -107,7 +113,6 @@ MatrixElement::reconfigure(timeT time, timeT duration, int pitch, int velocity)
     // different fill pattern
     bool tiedNote = (event()->has(BaseProperties::TIED_FORWARD) ||
                      event()->has(BaseProperties::TIED_BACKWARD));
-    Qt::BrushStyle brushPattern = (tiedNote ? Qt::Dense2Pattern : Qt::SolidPattern);
 
     QColor colour;
     if (event()->has(BaseProperties::TRIGGER_SEGMENT_ID)) {
@@ -125,46 +130,22 @@ MatrixElement::reconfigure(timeT time, timeT duration, int pitch, int velocity)
 
     if (m_drum) {
         fres = resolution + 1;
-        QGraphicsPolygonItem *item = dynamic_cast<QGraphicsPolygonItem *>(m_item);
-        if (!item) {
-            delete m_item;
-            item = new QGraphicsPolygonItem;
-            m_item = item;
-            m_scene->addItem(m_item);
-        }
-        QPolygonF polygon;
-        polygon << QPointF(0, 0)
-                << QPointF(fres/2, fres/2)
-                << QPointF(0, fres)
-                << QPointF(-fres/2, fres/2)
-                << QPointF(0, 0);
-        item->setPolygon(polygon);
-        item->setPen
-            (QPen(GUIPalette::getColour(GUIPalette::MatrixElementBorder), 0));
-        item->setBrush(QBrush(colour, brushPattern));
+        m_itemWidth = fres;
+        m_itemHeight = fres;
     } else {
-        QGraphicsRectItem *item = dynamic_cast<QGraphicsRectItem *>(m_item);
-        if (!item) {
-            delete m_item;
-            item = new QGraphicsRectItem;
-            m_item = item;
-            m_scene->addItem(m_item);
-        }
         float width = m_width;
         if (width < 1) {
             x0 = std::max(0.0, x1 - 1);
             width = 1;
         }
-        QRectF rect(0, 0, width, fres + 1);
-        item->setRect(rect);
-        item->setPen
-            (QPen(GUIPalette::getColour(GUIPalette::MatrixElementBorder), 0));
-        item->setBrush(QBrush(colour, brushPattern));
+        m_itemWidth = width;
+        m_itemHeight = fres + 1;
     }
 
-    setLayoutX(x0);
+    m_tied = tiedNote;
+    m_colour = colour;
 
-    m_item->setData(MatrixElementData, QVariant::fromValue((void *)this));
+    setLayoutX(x0);
 
     // set the Y position taking m_pitchOffset into account, subtracting the
     // opposite of whatever the originating segment transpose was
@@ -173,10 +154,80 @@ MatrixElement::reconfigure(timeT time, timeT duration, int pitch, int velocity)
 //              << (pitch ) << " m_pitchOffset: " << m_pitchOffset
 //              << std::endl;
 
-    m_item->setPos(x0, (127 - pitch - m_pitchOffset) * (resolution + 1));
+    m_pos = QPointF(x0, (127 - pitch - m_pitchOffset) * (resolution + 1));
+
+    // Keep an item we have, even if the note has moved out of view: the
+    // scene takes it back when the view next moves.
+    if (m_item || m_scene->isNearVisibleRect(getSceneRect())) updateItem();
+}
+
+QRectF
+MatrixElement::getSceneRect() const
+{
+    if (m_drum) {
+        // a diamond on its point at m_pos
+        return QRectF(m_pos.x() - m_itemWidth / 2, m_pos.y(),
+                      m_itemWidth, m_itemHeight);
+    }
+    return QRectF(m_pos.x(), m_pos.y(), m_itemWidth, m_itemHeight);
+}
+
+void
+MatrixElement::createItem()
+{
+    if (!m_item) updateItem();
+}
+
+void
+MatrixElement::releaseItem()
+{
+    if (!m_item) return;
+    m_item->setData(MatrixElementData, QVariant());
+    m_scene->recycleItem(this, m_item);
+    m_item = nullptr;
+}
+
+void
+MatrixElement::updateItem()
+{
+    if (!m_item) m_item = m_scene->takeItem(this, m_drum);
+
+    Qt::BrushStyle brushPattern =
+        (m_tied ? Qt::Dense2Pattern : Qt::SolidPattern);
+
+    if (m_drum) {
+        QGraphicsPolygonItem *item = static_cast<QGraphicsPolygonItem *>(m_item);
+        const double fres = m_itemHeight;
+        QPolygonF polygon;
+        polygon << QPointF(0, 0)
+                << QPointF(fres/2, fres/2)
+                << QPointF(0, fres)
+                << QPointF(-fres/2, fres/2)
+                << QPointF(0, 0);
+        item->setPolygon(polygon);
+    } else {
+        QGraphicsRectItem *item = static_cast<QGraphicsRectItem *>(m_item);
+        item->setRect(QRectF(0, 0, m_itemWidth, m_itemHeight));
+    }
+
+    m_item->setPen
+        (QPen(GUIPalette::getColour(GUIPalette::MatrixElementBorder), 0));
+    m_item->setBrush(QBrush(m_colour, brushPattern));
+
+    m_item->setData(MatrixElementData, QVariant::fromValue((void *)this));
+
+    m_item->setPos(m_pos);
 
     // set a tooltip explaining why this event is drawn in a different pattern
-    if (tiedNote) m_item->setToolTip(QObject::tr("This event is tied to another event."));
+    if (m_tied) {
+        m_item->setToolTip(QObject::tr("This event is tied to another event."));
+    } else {
+        m_item->setToolTip(QString());
+    }
+
+    // A reused item, or a note in a segment that isn't current
+    if (!m_current) applyCurrent();
+    if (m_selected) applySelected();
 }
 
 bool
@@ -188,17 +239,22 @@ MatrixElement::isNote() const
 void
 MatrixElement::setSelected(bool selected)
 {
-    QAbstractGraphicsShapeItem *item =
-        dynamic_cast<QAbstractGraphicsShapeItem *>(m_item);
-    if (!item) return;
+    m_selected = selected;
+    applySelected();
+}
 
-    if (selected) {
+void
+MatrixElement::applySelected()
+{
+    if (!m_item) return;
+
+    if (m_selected) {
         QPen pen(GUIPalette::getColour(GUIPalette::SelectedElement), 2,
                  Qt::SolidLine, Qt::SquareCap, Qt::MiterJoin);
         pen.setCosmetic(!m_drum);
-        item->setPen(pen);
+        m_item->setPen(pen);
     } else {
-        item->setPen
+        m_item->setPen
             (QPen(GUIPalette::getColour(GUIPalette::MatrixElementBorder), 0));
     }
 }
@@ -207,14 +263,18 @@ void
 MatrixElement::setCurrent(bool current)
 {
     if (m_current == current) return;
+    m_current = current;
+    applyCurrent();
+}
 
-    QAbstractGraphicsShapeItem *item =
-        dynamic_cast<QAbstractGraphicsShapeItem *>(m_item);
-    if (!item) return;
+void
+MatrixElement::applyCurrent()
+{
+    if (!m_item) return;
 
     QColor colour;
     
-    if (!current) {
+    if (!m_current) {
         colour = QColor(200, 200, 200);
     } else {
         if (event()->has(BaseProperties::TRIGGER_SEGMENT_ID)) {
@@ -226,18 +286,16 @@ MatrixElement::setCurrent(bool current)
         }
     }
 
-    item->setBrush(colour);
-    item->setZValue(current ? 1 : 0);
+    m_item->setBrush(colour);
+    m_item->setZValue(m_current ? 1 : 0);
 
-    if (current) {
-        item->setPen
+    if (m_current) {
+        m_item->setPen
             (QPen(GUIPalette::getColour(GUIPalette::MatrixElementBorder), 0));
     } else {
-        item->setPen
+        m_item->setPen
             (QPen(GUIPalette::getColour(GUIPalette::MatrixElementLightBorder), 0));
     }
-
-    m_current = current;
 }
 
 MatrixElement *
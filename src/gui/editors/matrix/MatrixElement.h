@@ -18,10 +18,16 @@
 #ifndef RG_MATRIXELEMENT_H
 #define RG_MATRIXELEMENT_H
 
+#include <rosegardenprivate_export.h>
+
 #include "base/ViewElement.h"
 
-class QColor;
+#include <QColor>
+#include <QPointF>
+#include <QRectF>
+
 class QGraphicsItem;
+class QAbstractGraphicsShapeItem;
 
 namespace Rosegarden
 {
@@ -29,7 +35,13 @@ namespace Rosegarden
 class MatrixScene;
 class Event;
 
-class MatrixElement : public ViewElement
+/**
+ * A note in the matrix.  The element knows where and how its note is
+ * drawn, and has a graphics item to draw it with unless the scene is
+ * virtualised and the note is far from view: see
+ * MatrixScene::setVirtualised().
+ */
+class ROSEGARDENPRIVATE_EXPORT MatrixElement : public ViewElement
 {
 public:
     MatrixElement(MatrixScene *scene,
@@ -67,14 +79,36 @@ public:
 
     static MatrixElement *getMatrixElement(QGraphicsItem *);
 
+    /// Where the note is drawn, in scene coordinates.
+    QRectF getSceneRect() const;
+
+    bool hasItem() const { return m_item; }
+
+    /// Get an item from the scene and draw the note with it.
+    void createItem();
+
+    /// Give the item back to the scene to be reused.
+    void releaseItem();
+
 protected:
+    /// Bring the item up to date, getting one first if need be.
+    void updateItem();
+
     MatrixScene *m_scene;
     bool m_drum;
     bool m_current;
-    QGraphicsItem *m_item;
+    bool m_selected;
+    QAbstractGraphicsShapeItem *m_item;
     double m_width;
     double m_velocity;
 
+    // What updateItem() draws, worked out by reconfigure()
+    QPointF m_pos;
+    double m_itemWidth;
+    double m_itemHeight;
+    QColor m_colour;
+    bool m_tied;
+
     /** Events don't know anything about what segment owns them, so neither do
      * MatrixElements.  In order to handle transposing segments properly, we
      * have to adjust the pitch relative to the segment transpose, and this can
@@ -87,6 +121,10 @@ private:
     /// Adjust the item to reflect the given values, not those of our event
     void reconfigure(timeT time, timeT duration, int pitch, int velocity);
 
+    /// Show m_current and m_selected on the item.
+    void applyCurrent();
+    void applySelected();
+
 };
 
 
@@ -24,7 +24,6 @@
 #include "MatrixWidget.h"
 #include "MatrixElement.h"
 
-#include "gui/application/RosegardenMainWindow.h"
 #include "document/RosegardenDocument.h"
 #include "document/CommandHistory.h"
 #include "misc/ConfigGroups.h"
@@ -42,9 +41,14 @@
 
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsLineItem>
+#include <QGraphicsPolygonItem>
+#include <QGraphicsRectItem>
+#include <QLineF>
+#include <QPainter>
 #include <QSettings>
 #include <QPointF>
 #include <QRectF>
+#include <QVector>
 
 #include <algorithm>  // for std::sort
 
@@ -64,7 +68,10 @@ MatrixScene::MatrixScene() :
     m_snapGrid(nullptr),
     m_resolution(8),
     m_selection(nullptr),
-    m_currentSegmentIndex(0)
+    m_currentSegmentIndex(0),
+    m_virtualised(false),
+    m_gridStart(0),
+    m_gridEnd(0)
 {
     connect(CommandHistory::getInstance(), SIGNAL(commandExecuted()),
             this, SLOT(slotCommandExecuted()));
@@ -94,9 +101,8 @@ namespace
 {
     // Functor for std::sort that compares the track positions of two Segments.
     struct TrackPositionLess {
-        TrackPositionLess() :
-            m_composition(RosegardenMainWindow::self()->getDocument()->
-                              getComposition())
+        TrackPositionLess(const Composition &composition) :
+            m_composition(composition)
         {
         }
 
@@ -129,7 +135,8 @@ MatrixScene::setSegments(RosegardenDocument *document,
     // Sort the Segments into TrackPosition order.  This makes the
     // Segment changer wheel in the Matrix editor
     // (MatrixWidget::m_segmentChanger) easier to understand.
-    std::sort(m_segments.begin(), m_segments.end(), TrackPositionLess());
+    std::sort(m_segments.begin(), m_segments.end(),
+              TrackPositionLess(m_document->getComposition()));
 
     m_document->getComposition().addObserver(this);
 
@@ -215,6 +222,7 @@ MatrixScene::setSegments(RosegardenDocument *document,
 
     recreateLines();
     updateCurrentSegment();
+    updateVisibleElements();
 }
 
 Segment *
@@ -302,9 +310,16 @@ MatrixScene::recreateLines()
     double startPos = m_scale->getXForTime(start);
     double endPos = m_scale->getXForTime(end);
 
-    // Draw horizontal lines
+    if (m_virtualised) {
+        m_gridStart = startPos;
+        m_gridEnd = endPos;
+        m_barLines.clear();
+        m_beatLines.clear();
+    }
+
+    // Draw horizontal lines, unless drawBackground() paints them
     int i = 0; 	   	 
-    while (i < 127) { 	 
+    while (i < 127 && !m_virtualised) { 	 
          int y = (i + 1) * (m_resolution + 1); 	 
          QGraphicsLineItem *line; 	 
          if (i < (int)m_horizontals.size()) { 	 
@@ -375,6 +390,13 @@ MatrixScene::recreateLines()
                 break;
             }
 
+            if (m_virtualised) {
+                if (index == 0) m_barLines.push_back(x);
+                else m_beatLines.push_back(x);
+                x += dx;
+                continue;
+            }
+
             QGraphicsLineItem *line;
 
             if (i < (int)m_verticals.size()) {
@@ -424,6 +446,8 @@ MatrixScene::recreatePitchHighlights()
 
     int i = 0;
 
+    if (m_virtualised) m_paintedHighlights.clear();
+
     while (k0 < segment->getEndMarkerTime()) {
 
         Rosegarden::Key key = segment->getKeyAtTime(k0);
@@ -472,6 +496,16 @@ MatrixScene::recreatePitchHighlights()
             int pitch = hsteps[j];
             while (pitch < 128) {
 
+                if (m_virtualised) {
+                    Highlight highlight;
+                    highlight.rect = QRectF(x0, (127 - pitch) * (m_resolution + 1),
+                                            x1 - x0, m_resolution + 1);
+                    highlight.tonic = (j == 0);
+                    m_paintedHighlights.push_back(highlight);
+                    pitch += 12;
+                    continue;
+                }
+
                 QGraphicsRectItem *rect;
 
                 if (i < (int)m_highlights.size()) {
@@ -509,6 +543,188 @@ MatrixScene::recreatePitchHighlights()
         m_highlights[i]->hide();
         ++i;
     }
+
+    if (m_virtualised) update();
+}
+
+void
+MatrixScene::drawBackground(QPainter *painter, const QRectF &rect)
+{
+    QGraphicsScene::drawBackground(painter, rect);
+
+    if (!m_virtualised) return;
+
+    painter->save();
+
+    // In the order the items would be stacked: highlights, beat lines,
+    // horizontal lines, bar lines.
+
+    const QColor tonic =
+        GUIPalette::getColour(GUIPalette::MatrixTonicHighlight);
+    const QColor pitch =
+        GUIPalette::getColour(GUIPalette::MatrixPitchHighlight);
+    for (size_t i = 0; i < m_paintedHighlights.size(); ++i) {
+        const QRectF area = m_paintedHighlights[i].rect & rect;
+        if (area.isEmpty()) continue;
+        painter->fillRect(area, m_paintedHighlights[i].tonic ? tonic : pitch);
+    }
+
+    const double height = 128 * (m_resolution + 1);
+    const double top = std::max(rect.top(), 0.0);
+    const double bottom = std::min(rect.bottom(), height);
+    const double left = std::max(rect.left(), m_gridStart);
+    const double right = std::min(rect.right(), m_gridEnd);
+    if (top > bottom || left > right) {
+        painter->restore();
+        return;
+    }
+
+    // Beat lines, unless zoomed out so far that they'd be a smear.
+    const double pixelsPerX = painter->worldTransform().m11();
+    std::vector<double>::const_iterator from =
+        std::lower_bound(m_beatLines.begin(), m_beatLines.end(), left);
+    std::vector<double>::const_iterator to =
+        std::upper_bound(m_beatLines.begin(), m_beatLines.end(), right);
+    if ((to - from) * 3 < (right - left) * pixelsPerX) {
+        QVector<QLineF> lines;
+        for (; from != to; ++from) {
+            lines.push_back(QLineF(*from, top, *from, bottom));
+        }
+        painter->setPen(QPen(GUIPalette::getColour(GUIPalette::BeatLine), 0));
+        painter->drawLines(lines);
+    }
+
+    QVector<QLineF> lines;
+    for (int i = 0; i < 127; ++i) {
+        const double y = (i + 1) * (m_resolution + 1);
+        if (y < top || y > bottom) continue;
+        lines.push_back(QLineF(left, y, right, y));
+    }
+    painter->setPen(QPen(GUIPalette::getColour
+                         (GUIPalette::MatrixHorizontalLine), 0));
+    painter->drawLines(lines);
+
+    lines.clear();
+    from = std::lower_bound(m_barLines.begin(), m_barLines.end(), left);
+    to = std::upper_bound(m_barLines.begin(), m_barLines.end(), right);
+    for (; from != to; ++from) {
+        lines.push_back(QLineF(*from, top, *from, bottom));
+    }
+    painter->setPen(QPen(GUIPalette::getColour(GUIPalette::MatrixBarLine), 0));
+    painter->drawLines(lines);
+
+    painter->restore();
+}
+
+void
+MatrixScene::setVisibleRect(const QRectF &rect)
+{
+    if (rect == m_visibleRect) return;
+    m_visibleRect = rect;
+    updateVisibleElements();
+}
+
+QRectF
+MatrixScene::getNearVisibleRect() const
+{
+    // A viewport's worth either side, so that scrolling a little way
+    // doesn't show the notes appearing.
+    const double w = m_visibleRect.width();
+    const double h = m_visibleRect.height();
+    return m_visibleRect.adjusted(-w, -h, w, h);
+}
+
+bool
+MatrixScene::isNearVisibleRect(const QRectF &rect) const
+{
+    if (!m_virtualised) return true;
+    if (m_visibleRect.isNull()) return false;
+    return getNearVisibleRect().intersects(rect);
+}
+
+void
+MatrixScene::updateVisibleElements()
+{
+    if (!m_virtualised || m_visibleRect.isNull() || !m_scale) return;
+
+    const QRectF nearRect = getNearVisibleRect();
+
+    // Take back the items of notes that are no longer near...
+    std::vector<MatrixElement *> farElements;
+    for (std::set<MatrixElement *>::const_iterator i = m_itemElements.begin();
+         i != m_itemElements.end(); ++i) {
+        if (!nearRect.intersects((*i)->getSceneRect())) {
+            farElements.push_back(*i);
+        }
+    }
+    for (size_t i = 0; i < farElements.size(); ++i) {
+        farElements[i]->releaseItem();
+    }
+
+    // ...and give them to those that have come near.
+    const timeT t0 = m_scale->getTimeForX(nearRect.left());
+    const timeT t1 = m_scale->getTimeForX(nearRect.right());
+
+    for (size_t i = 0; i < m_viewSegments.size(); ++i) {
+        ViewElementList *vel = m_viewSegments[i]->getViewElementList();
+        ViewElementList::iterator j =
+            vel->findTime(t0 - m_viewSegments[i]->getLongestDuration());
+        for (; j != vel->end() && (*j)->getViewAbsoluteTime() <= t1; ++j) {
+            MatrixElement *element = static_cast<MatrixElement *>(*j);
+            if (element->hasItem()) continue;
+            if (nearRect.intersects(element->getSceneRect())) {
+                element->createItem();
+            }
+        }
+    }
+}
+
+QAbstractGraphicsShapeItem *
+MatrixScene::takeItem(MatrixElement *element, bool drum)
+{
+    QAbstractGraphicsShapeItem *item = nullptr;
+
+    if (drum) {
+        if (!m_sparePolygons.empty()) {
+            item = m_sparePolygons.back();
+            m_sparePolygons.pop_back();
+        } else {
+            item = new QGraphicsPolygonItem;
+            addItem(item);
+        }
+    } else {
+        if (!m_spareRects.empty()) {
+            item = m_spareRects.back();
+            m_spareRects.pop_back();
+        } else {
+            item = new QGraphicsRectItem;
+            addItem(item);
+        }
+    }
+
+    item->show();
+    if (m_virtualised) m_itemElements.insert(element);
+    return item;
+}
+
+void
+MatrixScene::recycleItem(MatrixElement *element,
+                         QAbstractGraphicsShapeItem *item)
+{
+    if (!m_virtualised) {
+        delete item;
+        return;
+    }
+
+    m_itemElements.erase(element);
+    item->hide();
+
+    QGraphicsPolygonItem *polygon = dynamic_cast<QGraphicsPolygonItem *>(item);
+    if (polygon) {
+        m_sparePolygons.push_back(polygon);
+    } else {
+        m_spareRects.push_back(static_cast<QGraphicsRectItem *>(item));
+    }
 }
 
 void
@@ -18,12 +18,21 @@
 #ifndef RG_MATRIXSCENE_H
 #define RG_MATRIXSCENE_H
 
+#include <rosegardenprivate_export.h>
+
 #include <QGraphicsScene>
+#include <QRectF>
 
 #include "base/Composition.h"
 #include "gui/general/SelectionManager.h"
 
+#include <set>
+#include <vector>
+
 class QGraphicsLineItem;
+class QAbstractGraphicsShapeItem;
+class QGraphicsRectItem;
+class QGraphicsPolygonItem;
 
 namespace Rosegarden
 {
@@ -68,9 +77,9 @@ class SnapGrid;
  * resolved.  In this case, the user must intervene to ensure sanity of the
  * results.
  */
-class MatrixScene : public QGraphicsScene,
-                    public CompositionObserver,
-                    public SelectionManager
+class ROSEGARDENPRIVATE_EXPORT MatrixScene : public QGraphicsScene,
+                                             public CompositionObserver,
+                                             public SelectionManager
 {
     Q_OBJECT
 
@@ -81,8 +90,33 @@ public:
     void setMatrixWidget(MatrixWidget *w) { m_widget = w; };
     MatrixWidget *getMatrixWidget() { return m_widget; };
 
+    /// Paint the grid and give only notes near the view items.
+    /**
+     * Call before setSegments().  The scene then needs to be told what is
+     * in view with setVisibleRect().
+     */
+    void setVirtualised(bool virtualised) { m_virtualised = virtualised; }
+    bool isVirtualised() const { return m_virtualised; }
+
     void setSegments(RosegardenDocument *doc, std::vector<Segment *> segments);
 
+    /// The area of the scene in view, in scene coordinates.
+    /**
+     * When virtualised, notes within a viewport's width and height of it get
+     * items, and the rest give theirs back to be reused.
+     */
+    void setVisibleRect(const QRectF &rect);
+
+    /// Whether a note drawn here should have an item.  Always true unless
+    /// virtualised.
+    bool isNearVisibleRect(const QRectF &rect) const;
+
+    /// For MatrixElement: an item to draw a note with, reused if possible.
+    QAbstractGraphicsShapeItem *takeItem(MatrixElement *element, bool drum);
+
+    /// For MatrixElement: give back an item from takeItem().
+    void recycleItem(MatrixElement *element, QAbstractGraphicsShapeItem *item);
+
     void handleEventAdded(Event *);
     void handleEventRemoved(Event *);
 
@@ -172,6 +206,9 @@ protected:
     void segmentRemoved(const Composition *, Segment *) override; // CompositionObserver
     void timeSignatureChanged(const Composition *) override; // CompositionObserver
 
+    /// Paints the grid and highlights when virtualised.
+    void drawBackground(QPainter *painter, const QRectF &rect) override;
+
 private:
     MatrixWidget *m_widget; // I do not own this
 
@@ -197,6 +234,30 @@ private:
     std::vector<QGraphicsLineItem *> m_verticals;
     std::vector<QGraphicsRectItem *> m_highlights;
 
+    bool m_virtualised;
+    QRectF m_visibleRect;
+
+    // What drawBackground() paints in place of the above when virtualised
+    double m_gridStart;
+    double m_gridEnd;
+    std::vector<double> m_barLines;
+    std::vector<double> m_beatLines;
+    struct Highlight
+    {
+        QRectF rect;
+        bool tonic;
+    };
+    std::vector<Highlight> m_paintedHighlights;
+
+    // Note items, when virtualised: the elements that have them and those
+    // waiting to be reused
+    std::set<MatrixElement *> m_itemElements;
+    std::vector<QGraphicsRectItem *> m_spareRects;
+    std::vector<QGraphicsPolygonItem *> m_sparePolygons;
+
+    QRectF getNearVisibleRect() const;
+    void updateVisibleElements();
+
     void setupMouseEvent(QGraphicsSceneMouseEvent *, MatrixMouseEvent &) const;
     void recreateLines();
     void recreatePitchHighlights();
@@ -43,6 +43,10 @@ public:
 
     void updateElements(timeT from, timeT to);
 
+    /// The longest duration of any note this has made an element for.
+    /// A note overlapping time t starts no earlier than t minus this.
+    timeT getLongestDuration() const { return m_longestDuration; }
+
 protected:
 //!!!    const MidiKeyMapping *getKeyMapping() const;
 
@@ -68,6 +72,7 @@ protected:
     MatrixScene *m_scene;
     bool m_drum;
     unsigned int m_refreshStatusId;
+    timeT m_longestDuration;
 };
 
 }
@@ -53,6 +53,7 @@
 
 #include "gui/studio/StudioControl.h"
 
+#include "misc/ConfigGroups.h"
 #include "misc/Debug.h"
 
 #include "base/Composition.h"
@@ -76,6 +77,7 @@
 #include <QGridLayout>
 #include <QLabel>
 #include <QScrollBar>
+#include <QSettings>
 #include <QTimer>
 #include <QGraphicsScene>
 #include <QGraphicsProxyWidget>
@@ -401,6 +403,13 @@ MatrixWidget::setSegments(RosegardenDocument *document,
     delete m_scene;
     m_scene = new MatrixScene();
     m_scene->setMatrixWidget(this);
+    {
+        QSettings settings;
+        settings.beginGroup(MatrixViewConfigGroup);
+        m_scene->setVirtualised(
+                settings.value("Virtualised rendering", false).toBool());
+        settings.endGroup();
+    }
     m_scene->setSegments(document, segments);
 
     m_referenceScale = m_scene->getReferenceScale();
@@ -425,6 +434,12 @@ MatrixWidget::setSegments(RosegardenDocument *document,
 
     m_view->setScene(m_scene);
 
+    // A virtualised scene needs to know what is in view.
+    connect(m_view, &Panned::viewportChanged,
+            m_scene, &MatrixScene::setVisibleRect);
+    m_scene->setVisibleRect(
+            m_view->mapToScene(m_view->viewport()->rect()).boundingRect());
+
     m_toolBox->setScene(m_scene);
 
     m_panner->setScene(m_scene);
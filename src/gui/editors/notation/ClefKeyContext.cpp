@@ -145,6 +145,12 @@ ClefKeyContext::setSegments(NotationScene *scene)
     m_changed = false;
 }
 
+void
+ClefKeyContext::update()
+{
+    if (m_changed && m_scene) setSegments(m_scene);
+}
+
 Clef
 ClefKeyContext::getClefFromContext(TrackId track, timeT time)
 {
@@ -67,6 +67,13 @@ public:
 
     void setSegments(NotationScene *scene);
 
+    /**
+     * Bring the context up to date with changes to the segments now,
+     * rather than at the next lookup, so that lookups from several
+     * layout threads at once find it unchanging.
+     */
+    void update();
+
     /**
      * Returns the clef which should be in used on given track at given time
      * without looking at possible clef event on this precise place.
@@ -132,10 +132,11 @@ NotationHLayout::getBarData(ViewSegment &staff)
 {
     BarDataMap::iterator i = m_barData.find(&staff);
     if (i == m_barData.end()) {
-        m_barData[&staff] = BarDataList();
+        i = m_barData.insert(BarDataMap::value_type(&staff,
+                                                    BarDataList())).first;
     }
 
-    return m_barData[&staff];
+    return i->second;
 }
 
 const NotationHLayout::BarDataList &
@@ -184,26 +185,126 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
     //throwIfCancelled();
     Profiler profiler("NotationHLayout::scanViewSegment");
 
+    if (full) {
+        Segment &segment(staff.getSegment());
+        prepareScan(staff);
+        clearBarList(staff);
+        m_dirtyBars.find(&staff)->second.clear();
+        scanBars(staff, segment.getStartTime(), segment.getEndMarkerTime(),
+                 true);
+    } else {
+        setBarsDirty(staff, startTime, endTime);
+        scanDirtyBars(staff);
+    }
+}
+
+void
+NotationHLayout::setBarsDirty(ViewSegment &staff, timeT startTime,
+                              timeT endTime)
+{
+    if (endTime < startTime) std::swap(startTime, endTime);
+
+    int startBarNo = getComposition()->getBarNumber(startTime);
+    int endBarNo = getComposition()->getBarNumber(endTime);
+
+    // An empty range still means the bar it's in
+    if (endBarNo > startBarNo &&
+        getComposition()->getBarStart(endBarNo) == endTime) {
+        --endBarNo;
+    }
+
+    BarNumberSet &dirty = m_dirtyBars[&staff];
+    for (int barNo = startBarNo; barNo <= endBarNo; ++barNo) {
+        dirty.insert(barNo);
+    }
+}
+
+void
+NotationHLayout::setEventDirty(ViewSegment &staff, const Event *event)
+{
+    // The element's bar is found by its notation time, which
+    // quantization may have put in a different bar from the event's
+    // own time.
+    setBarsDirty(staff, event->getAbsoluteTime(),
+                 event->getNotationAbsoluteTime());
+}
+
+bool
+NotationHLayout::hasDirtyBars(ViewSegment &staff) const
+{
+    DirtyBarMap::const_iterator i = m_dirtyBars.find(&staff);
+    return i != m_dirtyBars.end() && !i->second.empty();
+}
+
+void
+NotationHLayout::scanDirtyBars(ViewSegment &staff)
+{
+    DirtyBarMap::iterator di = m_dirtyBars.find(&staff);
+    if (di == m_dirtyBars.end()) return;
+
+    // Emptied rather than erased, as other staffs may be being
+    // scanned at the same time
+    BarNumberSet dirty;
+    dirty.swap(di->second);
+
     Segment &segment(staff.getSegment());
     timeT segStartTime = segment.getStartTime();
     timeT segEndTime = segment.getEndMarkerTime();
 
-    int startBarOfViewSegment = getComposition()->getBarNumber(segment.getStartTime());
+    BarNumberSet::const_iterator i = dirty.begin();
+
+    while (i != dirty.end()) {
+
+        int firstBarNo = *i;
+        int lastBarNo = *i;
+        while (++i != dirty.end() && *i == lastBarNo + 1) lastBarNo = *i;
 
-    if (full) {
-        clearBarList(staff);
-        startTime = segStartTime;
-        endTime = segEndTime;
-    } else {
         // Time must be limited to values inside segment to avoid the extension
         // of the staff toward the start of the composition (experienced with
         // linked segments) with various effects as the display of an
         // unnecessary time signature at a wrong place.
-        startTime = getComposition()->getBarStartForTime(startTime);
-        endTime = getComposition()->getBarEndForTime(endTime);
+        timeT startTime = getComposition()->getBarStart(firstBarNo);
+        timeT endTime = getComposition()->getBarEnd(lastBarNo);
         if (segStartTime > startTime) startTime = segStartTime;
         if (segEndTime < endTime) endTime = segEndTime;
+        if (startTime > endTime) continue;
+
+        scanBars(staff, startTime, endTime, false);
+    }
+}
+
+void
+NotationHLayout::prepareScan(ViewSegment &staff)
+{
+    // Looked up before being made, so that a staff made ready already
+    // is only looked up, as it may be while other staffs are scanned.
+    getBarData(staff);
+    if (m_dirtyBars.find(&staff) == m_dirtyBars.end()) {
+        m_dirtyBars.insert(DirtyBarMap::value_type(&staff, BarNumberSet()));
+    }
+    if (m_staffNameWidths.find(&staff) == m_staffNameWidths.end()) {
+        m_staffNameWidths.insert(ViewSegmentIntMap::value_type(&staff, 0));
+    }
+    if (m_haveOttavaSomewhere.find(&staff) == m_haveOttavaSomewhere.end()) {
+        m_haveOttavaSomewhere.insert(std::pair<ViewSegment *, bool>
+                                     (&staff, false));
     }
+    staff.getViewElementList();
+}
+
+void
+NotationHLayout::scanBars(ViewSegment &staff, timeT startTime,
+                          timeT endTime, bool full)
+{
+    prepareScan(staff);
+    int &staffNameWidth = m_staffNameWidths.find(&staff)->second;
+    bool &haveOttavaSomewhere = m_haveOttavaSomewhere.find(&staff)->second;
+
+    Segment &segment(staff.getSegment());
+    timeT segStartTime = segment.getStartTime();
+    timeT segEndTime = segment.getEndMarkerTime();
+
+    int startBarOfViewSegment = getComposition()->getBarNumber(segment.getStartTime());
 
     NotationElementList *notes = staff.getViewElementList();
     BarDataList &barList(getBarData(staff));
@@ -221,11 +322,11 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
     TrackId trackId = segment.getTrack();
     std::string name =
         segment.getComposition()->getTrackById(trackId)->getLabel();
-    m_staffNameWidths[&staff] =
+    staffNameWidth =
         npf->getNoteBodyWidth() * 2 +
         npf->getTextWidth(Text(name, Text::StaffName));
 
-    RG_DEBUG << "scanViewSegment: full scan " << full << ", times " << startTime << "->" << endTime << ", bars " << startBarNo << "->" << endBarNo << ", staff name \"" << segment.getLabel() << "\", width " << m_staffNameWidths[&staff];
+    RG_DEBUG << "scanViewSegment: full scan " << full << ", times " << startTime << "->" << endTime << ", bars " << startBarNo << "->" << endBarNo << ", staff name \"" << segment.getLabel() << "\", width " << staffNameWidth;
 
     SegmentNotationHelper helper(segment);
     if (full) {
@@ -249,14 +350,16 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
 
         RG_DEBUG << "full scan: setting haveOttava false";
 
-        m_haveOttavaSomewhere[&staff] = false;
+        haveOttavaSomewhere = false;
 
-    } else if (m_haveOttavaSomewhere[&staff]) {
+    } else if (haveOttavaSomewhere) {
 
         RG_DEBUG << "not full scan but ottava is listed";
 
+        // Anything from startTime on is found by the scan itself
         Segment::iterator i = segment.findTime(startTime);
-        while (1) {
+        while (i != segment.begin()) {
+            --i;
             if ((*i)->isa(Indication::EventType)) {
                 try {
                     Indication indication(**i);
@@ -268,9 +371,6 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
                     }
                 } catch (...) { }
             }
-            if (i == segment.begin())
-                break;
-            --i;
         }
     }
 
@@ -302,6 +402,18 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
         }
     }
 
+    // Whether the first bar is correct depends on the one before it,
+    // which a partial scan doesn't see
+    if (!full) {
+        BarDataList::iterator prev(barList.find(startBarNo - 1));
+        if (prev != barList.end()) {
+            std::pair<timeT, timeT> prevTimes =
+                getComposition()->getBarRange(startBarNo - 1);
+            barCorrect = (prev->second.sizeData.actualDuration ==
+                          prevTimes.second - prevTimes.first);
+        }
+    }
+
     AccidentalTable accTable(key, clef, octaveType, barResetType);
 
     for (int barNo = startBarNo; barNo <= endBarNo; ++barNo) {
@@ -475,7 +587,7 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
                         ottavaShift = indication.getOttavaShift();
                         ottavaEnd = el->event()->getAbsoluteTime() +
                                     indication.getIndicationDuration();
-                        m_haveOttavaSomewhere[&staff] = true;
+                        haveOttavaSomewhere = true;
                     }
                 } catch (...) {
                     RG_DEBUG << "Bad indication!";
@@ -522,8 +634,7 @@ NotationHLayout::scanViewSegment(ViewSegment &staff, timeT startTime,
 void
 NotationHLayout::clearBarList(ViewSegment &staff)
 {
-    BarDataList &bdl = m_barData[&staff];
-    bdl.clear();
+    getBarData(staff).clear();
 }
 
 void
@@ -539,7 +650,7 @@ NotationHLayout::setBarBasicData(ViewSegment &staff,
 {
     //    RG_DEBUG << "setBarBasicData for " << barNo;
 
-    BarDataList &bdl(m_barData[&staff]);
+    BarDataList &bdl(getBarData(staff));
 
     BarDataList::iterator i(bdl.find(barNo));
     if (i == bdl.end()) {
@@ -566,7 +677,7 @@ NotationHLayout::setBarSizeData(ViewSegment &staff,
 {
     //    RG_DEBUG << "setBarSizeData for " << barNo;
 
-    BarDataList &bdl(m_barData[&staff]);
+    BarDataList &bdl(getBarData(staff));
 
     BarDataList::iterator i(bdl.find(barNo));
     if (i == bdl.end()) {
@@ -781,6 +892,12 @@ NotationHLayout::preSquishBar(int barNo)
     columns.clear();
     timeSigMap.clear();
 
+    // The time signature as the scan found it, as staffs that haven't
+    // been rescanned since the last call still have the one it hid.
+    bool newTimeSig = false;
+    TimeSignature timeSignature =
+        getComposition()->getTimeSignatureInBar(barNo, newTimeSig);
+
     for (BarDataMap::iterator mi = m_barData.begin();
             mi != m_barData.end(); ++mi) {
 
@@ -792,6 +909,9 @@ NotationHLayout::preSquishBar(int barNo)
             haveSomething = true;
             ChunkList &cl(bdli->second.chunks);
 
+            bdli->second.basicData.timeSignature = timeSignature;
+            bdli->second.sizeData.fixedWidth = 0;
+
             // Delay between start of bar and start of segment have to be
             // added to event durations to avoid wrong position of notes
             // when a segment is not precisely beginning at a start of a bar.
@@ -1227,6 +1347,19 @@ NotationHLayout::reconcileBarsPage()
             pageWidthSoFar = maxWidth + maxClefKeyWidth;
             stretchFactor = m_pageWidth / pageWidthSoFar;
         } else {
+            // Not the start of a row, though it may have been at the
+            // last layout if this bar wasn't rescanned since
+            for (BarDataMap::iterator i = m_barData.begin();
+                    i != m_barData.end(); ++i) {
+
+                BarDataList &list = i->second;
+                BarDataList::iterator bdli = list.find(barNo);
+
+                if (bdli != list.end()) {
+                    bdli->second.sizeData.clefKeyWidth = 0;
+                }
+            }
+
             ++barNoThisRow;
             pageWidthSoFar = nextPageWidth;
             stretchFactor = nextStretchFactor;
@@ -2018,6 +2151,7 @@ NotationHLayout::reset()
     }
 
     m_barData.clear();
+    m_dirtyBars.clear();
     m_barPositions.clear();
     m_totalWidth = 0;
 }
@@ -22,6 +22,7 @@
 #include "base/NotationTypes.h"
 #include "NotationElement.h"
 #include <map>
+#include <set>
 #include <vector>
 #include "base/Event.h"
 
@@ -73,12 +74,48 @@ public:
      * the entire map is then used by reconcileBars() and layout().
      * The map should be cleared (by calling reset()) before a full
      * set of staffs is preparsed.
+     *
+     * A scan that isn't full marks the bars from startTime to endTime
+     * dirty and then rescans the staff's dirty bars, see scanDirtyBars().
      */
     void scanViewSegment(ViewSegment &staff,
                                  timeT startTime,
                                  timeT endTime,
                                  bool full) override;
 
+    /**
+     * Marks the bars of the staff from startTime to endTime as needing
+     * to be scanned again.
+     */
+    void setBarsDirty(ViewSegment &staff, timeT startTime, timeT endTime);
+
+    /**
+     * Marks the bars an added or removed event was in as needing to be
+     * scanned again.  For the staff's SegmentObserver methods: the bar
+     * data holds iterators into the staff's element list, which must
+     * not outlive the elements they point to.
+     */
+    void setEventDirty(ViewSegment &staff, const Event *event);
+
+    /// Whether any of the staff's bars need to be scanned again.
+    bool hasDirtyBars(ViewSegment &staff) const;
+
+    /**
+     * Rescans only the staff's dirty bars, and leaves the rest of its
+     * bar data as it was.  Each run of consecutive dirty bars is scanned
+     * as a partial scanViewSegment() of it would be, so that finishLayout()
+     * gives the same result as after a full scan.
+     */
+    void scanDirtyBars(ViewSegment &staff);
+
+    /**
+     * Makes what a scan of the staff keeps in the layout's maps, which
+     * the scan itself then only looks up.  Call this for each staff
+     * before scanning staffs on several threads at once: scans of
+     * different staffs share nothing else in the layout.
+     */
+    void prepareScan(ViewSegment &staff);
+
     /**
      * Resets internal data stores, notably the BarDataMap that is
      * used to retain the data computed by scanViewSegment().
@@ -314,6 +351,9 @@ protected:
     typedef std::map<ViewSegment *, int> ViewSegmentIntMap;
     typedef std::map<long, NotationGroup *> NotationGroupMap;
 
+    typedef std::set<int> BarNumberSet;
+    typedef std::map<ViewSegment *, BarNumberSet> DirtyBarMap;
+
 
     /**
      * Internally used as a key when removing unnecessary time signatures
@@ -342,6 +382,13 @@ protected:
 
     void clearBarList(ViewSegment &);
 
+    /**
+     * Scans the bars from startTime to endTime, which must be the
+     * start of a bar and lie within the segment, and the bar after.
+     */
+    void scanBars(ViewSegment &staff, timeT startTime, timeT endTime,
+                  bool full);
+
 
     /**
      * Set the basic data for the given barNo.  If barNo is
@@ -437,6 +484,7 @@ protected:
     //--------------- Data members ---------------------------------
 
     BarDataMap m_barData;
+    DirtyBarMap m_dirtyBars;
     ViewSegmentIntMap m_staffNameWidths;
     BarPositionList m_barPositions;
     NotationGroupMap m_groupsExtant;
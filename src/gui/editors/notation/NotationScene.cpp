@@ -32,11 +32,13 @@
 #include "NotationTool.h"
 #include "NotationWidget.h"
 #include "NotationMouseEvent.h"
+#include "NoteFont.h"
 #include "NoteFontFactory.h"
 #include "gui/widgets/Panned.h"
 
 #include "misc/Debug.h"
 #include "misc/Strings.h"
+#include "misc/WorkerPool.h"
 
 #include "misc/ConfigGroups.h"
 #include "document/CommandHistory.h"
@@ -51,6 +53,8 @@
 #include <QGraphicsSceneMouseEvent>
 #include <QKeyEvent>
 
+#include <algorithm>
+
 using std::vector;
 
 namespace Rosegarden
@@ -58,6 +62,65 @@ namespace Rosegarden
 
 static int instanceCount = 0;
 
+namespace
+{
+
+/// Scan each staff for layout, shared out between the threads of a
+/// WorkerPool a staff at a time.
+class StaffScanJob
+{
+public:
+    StaffScanJob(const std::vector<NotationStaff *> &staffs,
+                 NotationHLayout *hlayout, NotationVLayout *vlayout,
+                 timeT startTime, timeT endTime, bool full) :
+        m_staffs(staffs),
+        m_hlayout(hlayout),
+        m_vlayout(vlayout),
+        m_startTime(startTime),
+        m_endTime(endTime),
+        m_full(full)
+    { }
+
+    /// WorkerPool::Job to scan the staff'th staff.
+    static void run(void *job, size_t staff, int worker);
+
+    /// Scan every staff on the calling thread.
+    void runAll();
+
+private:
+    const std::vector<NotationStaff *> &m_staffs;
+    NotationHLayout *m_hlayout;
+    NotationVLayout *m_vlayout;
+    timeT m_startTime;
+    timeT m_endTime;
+    bool m_full;
+};
+
+void
+StaffScanJob::run(void *job, size_t staffIndex, int /* worker */)
+{
+    StaffScanJob *scanJob = static_cast<StaffScanJob *>(job);
+    NotationStaff &staff = *scanJob->m_staffs[staffIndex];
+
+    if (scanJob->m_full) {
+        scanJob->m_hlayout->scanViewSegment(
+                staff, scanJob->m_startTime, scanJob->m_endTime, true);
+    } else {
+        scanJob->m_hlayout->scanDirtyBars(staff);
+    }
+    scanJob->m_vlayout->scanViewSegment(
+            staff, scanJob->m_startTime, scanJob->m_endTime, scanJob->m_full);
+}
+
+void
+StaffScanJob::runAll()
+{
+    for (size_t i = 0; i < m_staffs.size(); ++i)
+        run(this, i, 0);
+}
+
+}
+
 NotationScene::NotationScene() :
     m_widget(nullptr),
     m_document(nullptr),
@@ -80,6 +143,8 @@ NotationScene::NotationScene() :
     m_compositionRefreshStatusId(0),
     m_timeSignatureChanged(false),
     m_updatesSuspended(false),
+    m_layoutThreads(0),
+    m_layoutPool(nullptr),
     m_minTrack(0),
     m_maxTrack(0),
     m_finished(false),
@@ -104,6 +169,7 @@ NotationScene::~NotationScene()
             m_document->getComposition().removeObserver(this);
         }
     }
+    delete m_layoutPool;
     delete m_hlayout;
     delete m_vlayout;
     delete m_notePixmapFactory;
@@ -1171,6 +1237,9 @@ NotationScene::checkUpdate()
             if (!need || rs.from() < start) start = rs.from();
             if (!need || rs.to() > end) end = rs.to();
 
+            // Only this staff's own range is rescanned
+            m_hlayout->setBarsDirty(*m_staffs[i], rs.from(), rs.to());
+
             need = true;
 
             single = m_staffs[i];
@@ -1700,6 +1769,16 @@ NotationScene::positionStaffs()
     emit staffsPositionned();
 }
 
+void
+NotationScene::setLayoutThreadCount(int threads)
+{
+    m_layoutThreads = threads;
+
+    // Made again to suit at the next layout
+    delete m_layoutPool;
+    m_layoutPool = nullptr;
+}
+
 void
 NotationScene::layoutAll()
 {
@@ -1743,15 +1822,70 @@ NotationScene::layout(NotationStaff *singleStaff,
 
     {
         Profiler profiler("NotationScene::layout: Scan layouts", true);
-    for (unsigned int i = 0; i < m_staffs.size(); ++i) {
 
-        NotationStaff *staff = m_staffs[i];
+        std::vector<NotationStaff *> staffs;
 
-        if (singleStaff && staff != singleStaff) continue;
+        for (unsigned int i = 0; i < m_staffs.size(); ++i) {
 
-        m_hlayout->scanViewSegment(*staff, startTime, endTime, full);
-        m_vlayout->scanViewSegment(*staff, startTime, endTime, full);
-    }
+            NotationStaff *staff = m_staffs[i];
+
+            if (singleStaff && staff != singleStaff) continue;
+
+            // A staff with nothing changed keeps the scan it had, even
+            // when the edits on other staffs span it.
+            if (!full && !m_hlayout->hasDirtyBars(*staff)) continue;
+
+            staffs.push_back(staff);
+        }
+
+        int threads = 1;
+        if (full) {
+            threads = m_layoutThreads;
+            if (threads <= 0) {
+                threads = WorkerPool::getIdealThreadCount();
+            }
+        }
+
+        StaffScanJob job(staffs, m_hlayout, m_vlayout,
+                         startTime, endTime, full);
+
+        if (threads > 1 && staffs.size() > 1) {
+
+            // Everything the scans share is made or brought up to date
+            // here first, so that on the workers they only look it up.
+            for (size_t i = 0; i < staffs.size(); ++i) {
+                m_hlayout->prepareScan(*staffs[i]);
+                m_vlayout->prepareScan(*staffs[i]);
+            }
+            // The staffs all draw with these two.
+            m_notePixmapFactory->prepareLayoutWidths();
+            m_notePixmapFactorySmall->prepareLayoutWidths();
+            m_clefKeyContext->update();
+            m_document->getComposition().getBarNumber(endTime);
+
+            // This thread scans too, so one fewer in the pool.
+            if (!m_layoutPool ||
+                m_layoutPool->getWorkerCount() != threads) {
+                delete m_layoutPool;
+                m_layoutPool = new WorkerPool(threads - 1);
+            }
+
+            const int misses = NoteFont::getOffThreadMissCount();
+
+            m_layoutPool->run(StaffScanJob::run, &job, staffs.size());
+
+            // A character that wasn't prepared has been laid out with
+            // no size.  Do it again here, where it can be measured.
+            if (NoteFont::getOffThreadMissCount() != misses) {
+                RG_WARNING << "layout(): characters missing from the"
+                           << "prepared widths, scanning again on the"
+                           << "GUI thread";
+                job.runAll();
+            }
+
+        } else {
+            job.runAll();
+        }
     }
 
     m_hlayout->finishLayout(startTime, endTime, full);
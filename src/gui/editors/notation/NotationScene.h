@@ -18,6 +18,8 @@
 #ifndef RG_NOTATION_SCENE_H
 #define RG_NOTATION_SCENE_H
 
+#include <rosegardenprivate_export.h>
+
 #include <QGraphicsScene>
 #include <QSharedPointer>
 
@@ -50,12 +52,13 @@ class RosegardenDocument;
 class Segment;
 class ViewSegment;
 class RulerScale;
+class WorkerPool;
 
 typedef std::map<int, int> TrackIntMap;
 
-class NotationScene : public QGraphicsScene,
-                      public CompositionObserver,
-                      public SelectionManager
+class ROSEGARDENPRIVATE_EXPORT NotationScene : public QGraphicsScene,
+                                               public CompositionObserver,
+                                               public SelectionManager
 {
     Q_OBJECT
 
@@ -154,6 +157,14 @@ public:
     void suspendLayoutUpdates();
     void resumeLayoutUpdates();
 
+    /**
+     * Scan the staffs for a full layout on up to the given number of
+     * threads at once (including the calling thread).  1 scans them one
+     * after another, and 0, the default, picks a number to suit the
+     * machine.
+     */
+    void setLayoutThreadCount(int threads);
+
     /**
      * Show and sound the given note.  The height is used for display,
      * the pitch for performance, so the two need not correspond (e.g.
@@ -333,6 +344,10 @@ private:
     bool m_timeSignatureChanged;
 
     bool m_updatesSuspended;
+    int m_layoutThreads;
+
+    /// Scans staffs alongside the GUI thread in a full layout.
+    WorkerPool *m_layoutPool;
 
     /// Returns the page width according to the layout mode (page/linear)
     int getPageWidth();
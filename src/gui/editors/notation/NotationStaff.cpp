@@ -1667,11 +1667,20 @@ NotationStaff::wrapEvent(Event *e)
     return wrap;
 }
 
+void
+NotationStaff::eventAdded(const Segment *segment,
+                          Event *event)
+{
+    ViewSegment::eventAdded(segment, event);
+    m_notationScene->getHLayout()->setEventDirty(*this, event);
+}
+
 void
 NotationStaff::eventRemoved(const Segment *segment,
                             Event *event)
 {
     ViewSegment::eventRemoved(segment, event);
+    m_notationScene->getHLayout()->setEventDirty(*this, event);
     m_notationScene->handleEventRemoved(event);
 }
 
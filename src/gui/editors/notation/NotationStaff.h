@@ -244,7 +244,14 @@ public:
 
     /**
      * Override from Staff<T>
-     * Let tools know if their current element has gone
+     * Mark the event's bar for the layout to rescan
+     */
+    void eventAdded(const Segment *, Event *) override;
+
+    /**
+     * Override from Staff<T>
+     * Let tools know if their current element has gone, and mark its
+     * bar for the layout to rescan
      */
     void eventRemoved(const Segment *, Event *) override;
 
@@ -75,10 +75,17 @@ NotationVLayout::getSlurList(ViewSegment &staff)
 {
     SlurListMap::iterator i = m_slurs.find(&staff);
     if (i == m_slurs.end()) {
-        m_slurs[&staff] = SlurList();
+        i = m_slurs.insert(SlurListMap::value_type(&staff, SlurList())).first;
     }
 
-    return m_slurs[&staff];
+    return i->second;
+}
+
+void
+NotationVLayout::prepareScan(ViewSegment &staff)
+{
+    getSlurList(staff);
+    staff.getViewElementList();
 }
 
 void
@@ -85,6 +85,12 @@ public:
                               timeT endTime,
 			      bool full) override;
 
+    /**
+     * Makes the staff's slur list, so that scans of different staffs
+     * can run on several threads at once.
+     */
+    void prepareScan(ViewSegment &staff);
+
 private:
     void positionSlur(NotationStaff &staff, NotationElementList::iterator i);
 
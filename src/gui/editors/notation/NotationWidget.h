@@ -18,6 +18,8 @@
 #ifndef RG_NOTATION_WIDGET_H
 #define RG_NOTATION_WIDGET_H
 
+#include <rosegardenprivate_export.h>
+
 #include "StaffLayout.h"
 
 #include "gui/general/AutoScroller.h"
@@ -60,8 +62,8 @@ class RawNoteRuler;
 class ControlRulerWidget;
 class HeadersGroup;
 
-class NotationWidget : public QWidget,
-                       public SelectionManager
+class ROSEGARDENPRIVATE_EXPORT NotationWidget : public QWidget,
+                                                public SelectionManager
 {
     Q_OBJECT
 
@@ -28,12 +28,15 @@
 #include "NoteFontMap.h"
 #include "SystemFont.h"
 #include <QBitmap>
+#include <QCoreApplication>
 #include <QImage>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QPixmap>
 #include <QPoint>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 #include <iostream>
 
 namespace Rosegarden
@@ -43,6 +46,8 @@ NoteFont::FontPixmapMap *NoteFont::m_fontPixmapMap = nullptr;
 
 NoteFont::DrawRepMap *NoteFont::m_drawRepMap = nullptr;
 QPixmap *NoteFont::m_blankPixmap = nullptr;
+QMutex NoteFont::m_dimensionsMutex;
+QAtomicInt NoteFont::m_offThreadMisses;
 
 
 NoteFont::NoteFont(QString fontName, int size) :
@@ -438,11 +443,40 @@ NoteFont::getNameShaded(CharName base) const
 bool
 NoteFont::getDimensions(CharName charName, int &x, int &y, bool inverted) const
 {
-    QPixmap pixmap;
-    bool ok = getPixmap(charName, pixmap, inverted);
-    x = pixmap.width();
-    y = pixmap.height();
-    return ok;
+    QMutexLocker locker(&m_dimensionsMutex);
+
+    const std::pair<CharName, bool> key(charName, inverted);
+    DimensionMap::const_iterator i = m_dimensions.find(key);
+    if (i == m_dimensions.end()) {
+        // Pixmaps are for the GUI thread only.  Notation layout asks
+        // for what its scans need before starting them (see
+        // NotePixmapFactory::prepareLayoutWidths()), so this is a
+        // character it did not expect.  Counted, so that the layout
+        // knows to scan again on the GUI thread.
+        if (QCoreApplication::instance()  &&
+            QThread::currentThread() !=
+                QCoreApplication::instance()->thread()) {
+            std::cerr << "NoteFont::getDimensions: Warning: No dimensions "
+                      << "for character \"" << charName << "\""
+                      << (inverted ? " (inverted)" : "")
+                      << " outside the GUI thread" << std::endl;
+            m_offThreadMisses.fetchAndAddOrdered(1);
+            x = 0;
+            y = 0;
+            return false;
+        }
+
+        QPixmap pixmap;
+        Dimensions dimensions;
+        dimensions.ok = getPixmap(charName, pixmap, inverted);
+        dimensions.x = pixmap.width();
+        dimensions.y = pixmap.height();
+        i = m_dimensions.insert(DimensionMap::value_type(key, dimensions)).first;
+    }
+
+    x = i->second.x;
+    y = i->second.y;
+    return i->second.ok;
 }
 
 int
@@ -23,6 +23,8 @@
 #include "NoteCharacter.h"
 #include "NoteFontMap.h"
 #include <set>
+#include <QAtomicInt>
+#include <QMutex>
 #include <QString>
 #include <QPoint>
 #include <utility>
@@ -112,9 +114,22 @@ public:
                                      bool inverted = false);
 
     /// Returns false + dimensions of blank pixmap if none found
+    /**
+     * Off the GUI thread, only what has been asked for on it before is
+     * found, as finding anything else means making a pixmap.
+     */
     bool getDimensions(CharName charName, int &x, int &y,
                        bool inverted = false) const;
 
+    /// How many times getDimensions() has had nothing for a character
+    /// off the GUI thread, and so given it no size.
+    /**
+     * Notation layout compares this before and after scanning on
+     * several threads, and scans again on the GUI thread if it moved.
+     */
+    static int getOffThreadMissCount()
+            { return m_offThreadMisses.loadAcquire(); }
+
     /// Ignores problems, returning dimension of blank pixmap if necessary
     int getWidth(CharName charName) const;
 
@@ -161,6 +176,14 @@ private:
 
     typedef std::map<QPixmap *, NoteCharacterDrawRep *> DrawRepMap;
 
+    struct Dimensions
+    {
+        int x;
+        int y;
+        bool ok;
+    };
+    typedef std::map<std::pair<CharName, bool>, Dimensions> DimensionMap;
+
     //--------------- Data members ---------------------------------
 
     int m_size;
@@ -168,6 +191,14 @@ private:
 
     mutable PixmapMap *m_map; // pointer at a member of m_fontPixmapMap
 
+    /// What getDimensions() has found, so that widths for layout need
+    /// no pixmaps.  Notation layout asks for them from several threads
+    /// at once, hence the mutex, which is shared as a miss may load a
+    /// system font through the caches all fonts share.
+    mutable DimensionMap m_dimensions;
+    static QMutex m_dimensionsMutex;
+    static QAtomicInt m_offThreadMisses;
+
     static FontPixmapMap *m_fontPixmapMap;
     static DrawRepMap *m_drawRepMap;
 
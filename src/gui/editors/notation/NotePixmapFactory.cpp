@@ -60,6 +60,7 @@
 #include <QFont>
 #include <QFontMetrics>
 #include <QImage>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QPen>
 #include <QPixmap>
@@ -3240,6 +3241,8 @@ NotePixmapFactory::makeTimeSig(const TimeSignature& sig)
 
 int NotePixmapFactory::getTimeSigWidth(const TimeSignature &sig) const
 {
+    QMutexLocker locker(&m_widthMutex);
+
     if (sig.isCommon()) {
 
         QRect r(m_bigTimeSigFontMetrics.boundingRect("c"));
@@ -3870,31 +3873,70 @@ int NotePixmapFactory::getKeyWidth(const Key &key,
     else
         keyCharName = NoteCharacterNames::FLAT;
 
-    NoteCharacter keyCharacter;
-    NoteCharacter cancelCharacter;
+    // Only the dimensions, not the characters, which would mean making
+    // pixmaps on whichever layout thread asked
+    int keyWidth = 0, keyHotspotX = 0, height = 0;
+    if (m_font->getDimensions(keyCharName, keyWidth, height)) {
+        keyHotspotX = m_font->getHotspot(keyCharName).x();
+    } else {
+        keyWidth = 0;
+    }
 
-    keyCharacter = m_font->getCharacter(keyCharName);
+    int cancelWidth = 0;
     if (cancelCount > 0) {
-        cancelCharacter = m_font->getCharacter(NoteCharacterNames::NATURAL);
+        if (!m_font->getDimensions(NoteCharacterNames::NATURAL,
+                                   cancelWidth, height)) {
+            cancelWidth = 0;
+        }
     }
 
     //int x = 0;
     //int lw = getLineSpacing();
-    int keyDelta = keyCharacter.getWidth() - keyCharacter.getHotspot().x();
+    int keyDelta = keyWidth - keyHotspotX;
 
     int cancelDelta = 0;
     int between = 0;
     if (cancelCount > 0) {
-        cancelDelta = cancelCharacter.getWidth() + cancelCharacter.getWidth() / 3;
-        between = cancelCharacter.getWidth();
+        cancelDelta = cancelWidth + cancelWidth / 3;
+        between = cancelWidth;
     }
 
     return (keyDelta * ah1.size() + cancelDelta * cancelCount + between +
-            keyCharacter.getWidth() / 4);
+            keyWidth / 4);
+}
+
+void NotePixmapFactory::prepareLayoutWidths() const
+{
+    for (int type = Note::Shortest; type <= Note::Longest; ++type) {
+        (void)getNoteBodyWidth(type);
+        (void)getRestWidth(Note(type));
+    }
+    (void)getDotWidth();
+
+    const Clef::ClefList clefs = Clef::getClefs();
+    for (size_t i = 0; i < clefs.size(); ++i) {
+        (void)getClefWidth(clefs[i]);
+    }
+
+    Accidentals::AccidentalList accidentals =
+        Accidentals::getStandardAccidentals();
+    accidentals.push_back(Accidentals::QuarterFlat);
+    accidentals.push_back(Accidentals::ThreeQuarterFlat);
+    accidentals.push_back(Accidentals::QuarterSharp);
+    accidentals.push_back(Accidentals::ThreeQuarterSharp);
+    for (size_t i = 0; i < accidentals.size(); ++i) {
+        (void)getAccidentalWidth(accidentals[i]);
+    }
+
+    // Sharps cancelling flats and flats cancelling sharps
+    (void)getKeyWidth(Key("A major"), Key("Eb major"));
+    (void)getKeyWidth(Key("Eb major"), Key("A major"));
 }
 
 int NotePixmapFactory::getTextWidth(const Text &text) const
 {
+    QMutexLocker locker(&m_widthMutex);
+
     QFontMetrics metrics(getTextFont(text));
     return metrics.boundingRect(strtoqstr(text.getText())).width() + 4;
 }
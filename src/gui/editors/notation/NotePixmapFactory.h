@@ -30,6 +30,7 @@
 
 #include <QFont>
 #include <QFontMetrics>
+#include <QMutex>
 #include <QPixmap>
 #include <QPoint>
 #include <QCoreApplication> // for Q_DECLARE_TR_FUNCTIONS
@@ -231,6 +232,13 @@ public:
                     Key previousKey = Key::DefaultKey) const;
     int getTextWidth(const Text &text) const;
 
+    /**
+     * Looks up every character the width methods above may need, so
+     * that they can then be called off the GUI thread.  Notation
+     * layout calls this before scanning staffs on several threads.
+     */
+    void prepareLayoutWidths() const;
+
     /**
      * Returns the width of clef and key signature drawn in a track header.
      */
@@ -411,6 +419,10 @@ protected:
 
     typedef std::map<const char *, QFont> TextFontCache;
     mutable TextFontCache m_textFontCache;
+
+    /// Notation layout asks for text and time signature widths from
+    /// several threads at once.
+    mutable QMutex m_widthMutex;
 };
 
 
@@ -29,6 +29,7 @@
 #include "gui/general/ResourceFinder.h"
 #include <QDir>
 #include <QFileInfo>
+#include <QMutexLocker>
 #include <QString>
 #include <QStringList>
 
@@ -64,6 +65,10 @@ NoteStyleFactory::getAvailableStyleNames()
 QSharedPointer<NoteStyle>
 NoteStyleFactory::getStyle(NoteStyleName name)
 {
+    // Notation layout threads look styles up for the chords they scan.
+    // Recursive, as reading a style file gets its base style from here.
+    QMutexLocker locker(&m_mutex);
+
     StyleMap::iterator i = m_styles.find(name);
 
     if (i == m_styles.end()) {
@@ -97,6 +102,7 @@ NoteStyleFactory::getStyleForEvent(Event *event)
 }
 
 NoteStyleFactory::StyleMap NoteStyleFactory::m_styles;
+QMutex NoteStyleFactory::m_mutex(QMutex::Recursive);
 
 
 }
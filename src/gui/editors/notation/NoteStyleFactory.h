@@ -23,6 +23,7 @@
 #include "NoteStyle.h"
 #include "base/Exception.h"
 
+#include <QMutex>
 #include <QSharedPointer>
 
 #include <map>
@@ -48,6 +49,7 @@ public:
 private:
     typedef std::map<QString, QSharedPointer<NoteStyle> > StyleMap;
     static StyleMap m_styles;
+    static QMutex m_mutex;
 };
 
 
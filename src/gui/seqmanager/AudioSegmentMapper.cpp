@@ -68,8 +68,6 @@ AudioSegmentMapper::fillBuffer()
     if (repeatCount > 0)
         repeatEndTime = m_segment->getRepeatEndTime();
 
-    int index = 0;
-
     for (int repeatNo = 0; repeatNo <= repeatCount; ++repeatNo) {
 
         timeT playTime = segmentStartTime + repeatNo * segmentDuration;
@@ -106,11 +104,9 @@ AudioSegmentMapper::fillBuffer()
             //                      << "NO AUTOFADE SET ON SEGMENT";
         }
 
-        getBuffer()[index] = e;
-        ++index;
+        mapAnEvent(&e);
     }
 
-    resize(index);
     // Instead of calling setStartEnd, we let m_start and m_end remain
     // at their defaults because metaiterator does nothing special for
     // audio segments.
@@ -72,6 +72,18 @@ CompositionMapper::segmentModified(Segment *segment)
     return mapper->refresh();
 }
 
+bool
+CompositionMapper::segmentModified(Segment *segment, timeT from, timeT to)
+{
+    SegmentMappers::iterator mapperIter = m_segmentMappers.find(segment);
+    if (mapperIter == m_segmentMappers.end()) return false;
+
+    QSharedPointer<SegmentMapper> mapper = mapperIter->second;
+    if (!mapper) return false;
+
+    return mapper->refresh(from, to);
+}
+
 void
 CompositionMapper::segmentAdded(Segment *segment)
 {
@@ -18,6 +18,8 @@
 #ifndef RG_COMPOSITIONMAPPER_H
 #define RG_COMPOSITIONMAPPER_H
 
+#include "base/TimeT.h"
+
 #include <QSharedPointer>
 
 #include <map>
@@ -48,6 +50,11 @@ public:
     QSharedPointer<MappedEventBuffer> getMappedEventBuffer(Segment *);
 
     bool segmentModified(Segment *);
+    /// The Segment has changed between two times.
+    /**
+     * Lets the SegmentMapper re-map just that part of the Segment.
+     */
+    bool segmentModified(Segment *, timeT from, timeT to);
     void segmentAdded(Segment *);
     void segmentDeleted(Segment *);
 
@@ -48,7 +48,10 @@ InternalSegmentMapper::InternalSegmentMapper(RosegardenDocument *doc,
                                              Segment *segment)
     : SegmentMapper(doc, segment),
       m_channelManager(doc->getInstrument(segment)),
-      m_triggeredEvents(new Segment)
+      m_triggeredEvents(new Segment),
+      m_filledWith(),
+      m_filled(false),
+      m_hasNonLocalEvents(false)
 {}
 
 InternalSegmentMapper::
@@ -103,6 +106,8 @@ void InternalSegmentMapper::fillBuffer()
     m_triggeredEvents->clear(); 
     m_controllerCache.clear();
     m_noteOffs = NoteoffContainer();
+    m_sources.clear();
+    m_hasNonLocalEvents = false;
 
     for (int repeatNo = 0; repeatNo <= repeatCount; ++repeatNo) {
 
@@ -159,6 +164,9 @@ void InternalSegmentMapper::fillBuffer()
             // trigger events won't be found in implied.
             if (!usingImplied) { 
 
+                if (isNonLocal(**k))
+                    m_hasNonLocalEvents = true;
+
                 long triggerId = -1;
                 (**k)->get<Int>(BaseProperties::TRIGGER_SEGMENT_ID, triggerId);
 
@@ -218,61 +226,25 @@ void InternalSegmentMapper::fillBuffer()
                     helper.getSoundingAbsoluteTime(*k) + timeForRepeats;
                 if (playTime >= repeatEndTime) break;
 
-                timeT playDuration = helper.getSoundingDuration(*k);
-
-                // Ignore notes without duration -- they're probably in a tied
-                // series but not as first note
-                //
-                if (playDuration > 0 || !(**k)->isa(Note::EventType)) {
-
-                    if (playTime + playDuration > repeatEndTime)
-                        playDuration = repeatEndTime - playTime;
-
-                    playTime = playTime + m_segment->getDelay();
-                    const RealTime eventTime = toRealTime(comp, playTime);
-
-                    // slightly quicker than calling helper.getRealSoundingDuration()
-                    RealTime endTime =
-                        toRealTime(comp, playTime + playDuration);
-                    const RealTime duration = endTime - eventTime;
-
-                    try {
-                        // Create mapped event and put it in buffer.
-                        // The instrument will be set later by
-                        // ChannelManager, so we set it to zero here.
-                        MappedEvent e(0,
-                                      ***k,  // three stars! what an accolade
-                                      eventTime,
-                                      duration);
-
-                        // Somewhat hacky: The MappedEvent ctor makes
-                        // events that needn't be inserted invalid.
-                        if (e.isValid()) {
-                            e.setTrackId(track->getId());
-
-                            if ((**k)->isa(Controller::EventType) ||
-                                (**k)->isa(PitchBend::EventType)) {
-                                m_controllerCache.storeLatestValue((**k));
-                            }
-                            
-                            if ((**k)->isa(Note::EventType)) {
-                                if (m_segment->getTranspose() != 0) {
-                                    e.setPitch(e.getPitch() +
-                                               m_segment->getTranspose());
-                                }
-                                if (e.getType() != MappedEvent::MidiNoteOneShot) {
-                                    enqueueNoteoff(playTime + playDuration,
-                                                   e.getPitch());
-                                }
-                            }
-                            mapAnEvent(&e); 
-                        } else {}
-                        
-                    } catch (...) {
-#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
-                        RG_DEBUG << "fillBuffer() - caught exception while trying to create MappedEvent";
-#endif
+                MappedEvent e;
+                timeT noteoffTime;
+
+                if (mapEvent(helper, *k, playTime, repeatEndTime,
+                             track->getId(), comp, e, noteoffTime)) {
+                    if ((**k)->isa(Controller::EventType) ||
+                        (**k)->isa(PitchBend::EventType)) {
+                        m_controllerCache.storeLatestValue((**k));
                     }
+
+                    const MappingSource source =
+                            makeSource(helper, *k,
+                                       bestBaseTime + timeForRepeats);
+
+                    if (noteoffTime != -1)
+                        enqueueNoteoff(noteoffTime, e.getPitch(), source);
+
+                    mapAnEvent(&e);
+                    m_sources.push_back(source);
                 }
             }
 
@@ -285,14 +257,371 @@ void InternalSegmentMapper::fillBuffer()
         popInsertNoteoff(track->getId(), comp);
     }
 
+    m_filledWith = getFillParameters();
+    m_filled = true;
+
+    updateSoundingInterval(track->getId());
+}
+
+bool
+InternalSegmentMapper::updateBuffer(timeT from, timeT to)
+{
+    Profiler profiler("InternalSegmentMapper::updateBuffer()");
+
+    if (!m_filled  ||  m_hasNonLocalEvents)
+        return false;
+
+    // Anything that moves every event (timing, repeats, transpose,
+    // etc...) needs the whole buffer.
+    if (!(getFillParameters() == m_filledWith))
+        return false;
+
+    // With a negative delay a noteoff can be queued for before its own
+    // note-on and the buffer is no longer in MappingSource order.
+    if (m_segment->getDelay() < 0)
+        return false;
+
+    Composition &comp = m_doc->getComposition();
+    const TrackId trackId = m_filledWith.trackId;
+    const timeT repeatEndTime = m_filledWith.repeatEndTime;
+    const timeT segmentDuration =
+            m_filledWith.endMarkerTime - m_filledWith.startTime;
+
+    std::vector<MappedEvent> newEvents;
+    std::vector<MappingSource> newSources;
+
+    SegmentPerformanceHelper helper(*m_segment);
+
+    for (;;) {
+        // Widen the range to take in everything that was mapped from
+        // Events overlapping it.  E.g. the first note of a tied series
+        // that ends in the range.
+        bool widened = true;
+        while (widened) {
+            widened = false;
+            for (const MappingSource &source : m_sources) {
+                if (!source.overlaps(from, to))
+                    continue;
+                if (source.from < from) {
+                    from = source.from;
+                    widened = true;
+                }
+                if (source.to > to) {
+                    to = source.to;
+                    widened = true;
+                }
+            }
+        }
+
+        newEvents.clear();
+        newSources.clear();
+
+        // Re-map the Events in the range, once for each repeat.
+        for (Segment::iterator i = m_segment->findTime(from);
+             m_segment->isBeforeEndMarker(i)  &&
+                 (*i)->getAbsoluteTime() <= to;
+             ++i) {
+
+            if (isNonLocal(*i))
+                return false;
+
+            if ((*i)->isa(Note::EventRestType))
+                continue;
+
+            const timeT soundingTime = helper.getSoundingAbsoluteTime(i);
+
+            for (int repeatNo = 0;
+                 repeatNo <= m_filledWith.repeatCount;
+                 ++repeatNo) {
+                const timeT timeForRepeats = repeatNo * segmentDuration;
+                const timeT playTime = soundingTime + timeForRepeats;
+                if (playTime >= repeatEndTime)
+                    break;
+
+                MappedEvent e;
+                timeT noteoffTime;
+
+                if (!mapEvent(helper, i, playTime, repeatEndTime, trackId,
+                              comp, e, noteoffTime))
+                    continue;
+
+                const MappingSource source =
+                        makeSource(helper, i,
+                                   (*i)->getAbsoluteTime() + timeForRepeats);
+
+                newEvents.push_back(e);
+                newSources.push_back(source);
+
+                if (noteoffTime != -1) {
+                    MappedEvent noteoff(0, MappedEvent::MidiNote,
+                                        e.getPitch(), 0);
+                    noteoff.setEventTime(toRealTime(comp, noteoffTime));
+                    noteoff.setTrackId(trackId);
+                    newEvents.push_back(noteoff);
+
+                    MappingSource noteoffSource = source;
+                    noteoffSource.noteOnTime = source.time;
+                    noteoffSource.time = noteoffTime;
+                    noteoffSource.noteOff = true;
+                    newSources.push_back(noteoffSource);
+                }
+            }
+        }
+
+        // If what we mapped reaches outside the range (a new tie, say),
+        // widen the range and try again.
+        bool contained = true;
+        for (const MappingSource &source : newSources) {
+            if (source.from < from) {
+                from = source.from;
+                contained = false;
+            }
+            if (source.to > to) {
+                to = source.to;
+                contained = false;
+            }
+        }
+        if (contained)
+            break;
+    }
+
+    // Put the new events in buffer order.  A stable sort so that
+    // events at the same time stay in Segment order, as fillBuffer()
+    // leaves them.
+    std::vector<size_t> order(newSources.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&newSources](size_t a, size_t b) {
+                         return mappedBefore(newSources[a], newSources[b]);
+                     });
+
+    const size_t oldSize = m_sources.size();
+
+    // Everything before the first replaced or inserted event stays
+    // where it is.
+    size_t first = 0;
+    while (first < oldSize  &&
+           !m_sources[first].overlaps(from, to)  &&
+           (order.empty()  ||
+            !mappedBefore(newSources[order.front()], m_sources[first]))) {
+        ++first;
+    }
+
+    // And everything after the last replaced event and the last
+    // inserted one.
+    size_t lastReplaced = first;
+    for (size_t i = first; i < oldSize; ++i) {
+        if (m_sources[i].overlaps(from, to))
+            lastReplaced = i + 1;
+    }
+
+    // Merge the old events in between, minus the replaced ones, with
+    // the new events.
+    std::vector<MappedEvent> midEvents;
+    std::vector<MappingSource> midSources;
+
+    bool controllersChanged = false;
+
+    std::vector<size_t>::const_iterator newIter = order.begin();
+    size_t last = first;
+    for ( ; last < oldSize; ++last) {
+        if (last >= lastReplaced  &&  newIter == order.end())
+            break;
+
+        const MappingSource &source = m_sources[last];
+
+        if (source.overlaps(from, to)) {
+            const MappedEvent &replaced = at(last);
+            if (replaced.getType() == MappedEvent::MidiController  ||
+                replaced.getType() == MappedEvent::MidiPitchBend)
+                controllersChanged = true;
+            continue;
+        }
+
+        while (newIter != order.end()  &&
+               mappedBefore(newSources[*newIter], source)) {
+            midEvents.push_back(newEvents[*newIter]);
+            midSources.push_back(newSources[*newIter]);
+            ++newIter;
+        }
+
+        midEvents.push_back(at(last));
+        midSources.push_back(source);
+    }
+    for ( ; newIter != order.end(); ++newIter) {
+        midEvents.push_back(newEvents[*newIter]);
+        midSources.push_back(newSources[*newIter]);
+    }
+
+    for (const MappedEvent &e : newEvents) {
+        if (e.getType() == MappedEvent::MidiController  ||
+            e.getType() == MappedEvent::MidiPitchBend)
+            controllersChanged = true;
+    }
+
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+    RG_DEBUG << "updateBuffer(): range" << from << "to" << to
+             << "replaced" << (last - first)
+             << "events with" << midEvents.size();
+#endif
+
+    // Only the part of the buffer around the change is copied.
+    replace(int(first), int(last), midEvents);
+    m_sources.erase(m_sources.begin() + first, m_sources.begin() + last);
+    m_sources.insert(m_sources.begin() + first,
+                     midSources.begin(), midSources.end());
+
+    if (controllersChanged)
+        refreshControllerCache();
+
+    updateSoundingInterval(trackId);
+
+    return true;
+}
+
+bool
+InternalSegmentMapper::mapEvent(SegmentPerformanceHelper &helper,
+                                Segment::iterator i,
+                                timeT playTime, timeT repeatEndTime,
+                                TrackId trackId, Composition &comp,
+                                MappedEvent &mappedEvent, timeT &noteoffTime)
+{
+    noteoffTime = -1;
+
+    timeT playDuration = helper.getSoundingDuration(i);
+
+    // Ignore notes without duration -- they're probably in a tied
+    // series but not as first note
+    //
+    if (playDuration <= 0  &&  (*i)->isa(Note::EventType))
+        return false;
+
+    if (playTime + playDuration > repeatEndTime)
+        playDuration = repeatEndTime - playTime;
+
+    playTime = playTime + m_segment->getDelay();
+    const RealTime eventTime = toRealTime(comp, playTime);
+
+    // slightly quicker than calling helper.getRealSoundingDuration()
+    RealTime endTime =
+        toRealTime(comp, playTime + playDuration);
+    const RealTime duration = endTime - eventTime;
+
+    try {
+        // Create mapped event.
+        // The instrument will be set later by
+        // ChannelManager, so we set it to zero here.
+        mappedEvent = MappedEvent(0,
+                                  **i,
+                                  eventTime,
+                                  duration);
+    } catch (...) {
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+        RG_DEBUG << "mapEvent() - caught exception while trying to create MappedEvent";
+#endif
+        return false;
+    }
+
+    // Somewhat hacky: The MappedEvent ctor makes
+    // events that needn't be inserted invalid.
+    if (!mappedEvent.isValid())
+        return false;
+
+    mappedEvent.setTrackId(trackId);
+
+    if ((*i)->isa(Note::EventType)) {
+        if (m_segment->getTranspose() != 0) {
+            mappedEvent.setPitch(mappedEvent.getPitch() +
+                                 m_segment->getTranspose());
+        }
+        if (mappedEvent.getType() != MappedEvent::MidiNoteOneShot) {
+            noteoffTime = playTime + playDuration;
+        }
+    }
+
+    return true;
+}
+
+InternalSegmentMapper::MappingSource
+InternalSegmentMapper::makeSource(SegmentPerformanceHelper &helper,
+                                  Segment::iterator i, timeT time)
+{
+    const Event *e = *i;
+
+    MappingSource source;
+    source.time = time;
+    source.noteOff = false;
+    source.noteOnTime = time;
+    source.from = std::min(e->getAbsoluteTime(),
+                           e->getNotationAbsoluteTime());
+    source.to = std::max(e->getAbsoluteTime() + e->getDuration(),
+                         e->getNotationAbsoluteTime() +
+                             e->getNotationDuration());
+
+    // The first note of a tied series sounds for the whole series,
+    // so it depends on all of it.
+    if (e->isa(Note::EventType)  &&  e->has(BaseProperties::TIED_FORWARD)) {
+        SegmentPerformanceHelper::iteratorcontainer tied =
+                helper.getTiedNotes(i);
+        for (Segment::iterator j : tied) {
+            const Event *t = *j;
+            source.from = std::min(
+                    source.from,
+                    std::min(t->getAbsoluteTime(),
+                             t->getNotationAbsoluteTime()));
+            source.to = std::max(
+                    source.to,
+                    std::max(t->getAbsoluteTime() + t->getDuration(),
+                             t->getNotationAbsoluteTime() +
+                                 t->getNotationDuration()));
+        }
+    }
+
+    return source;
+}
+
+bool
+InternalSegmentMapper::isNonLocal(const Event *e)
+{
+    // Triggered segments expand into m_triggeredEvents and grace
+    // notes borrow time from their neighbours.
+    return e->has(BaseProperties::TRIGGER_SEGMENT_ID)  ||
+           e->has(BaseProperties::IS_GRACE_NOTE)  ||
+           e->has(BaseProperties::MAY_HAVE_GRACE_NOTES);
+}
+
+bool
+InternalSegmentMapper::mappedBefore(const MappingSource &a,
+                                    const MappingSource &b)
+{
+    if (a.time != b.time)
+        return a.time < b.time;
+
+    // At the same time, noteoffs come first.  See haveEarlierNoteoff().
+    if (a.noteOff != b.noteOff)
+        return a.noteOff;
+
+    // Noteoffs at the same time come out in the order they were
+    // queued, which is the order of their note-ons.
+    if (a.noteOff)
+        return a.noteOnTime < b.noteOnTime;
+
+    return false;
+}
+
+void
+InternalSegmentMapper::updateSoundingInterval(TrackId trackId)
+{
     bool anything = (size() != 0);
 
     RealTime minRealTime;
     RealTime maxRealTime;
     if (anything) {
-        minRealTime = getBuffer()[0].getEventTime();
+        minRealTime = at(0).getEventTime();
         // ??? Shouldn't we add the duration of the event?  getDuration().
-        maxRealTime = getBuffer()[size() - 1].getEventTime();
+        maxRealTime = at(size() - 1).getEventTime();
 
         // Fix for bug #1378.  Start slightly before the first note so
         // that program etc is sent then.  We'll allow it to be before
@@ -308,8 +637,8 @@ void InternalSegmentMapper::fillBuffer()
                                          RealTime::zeroTime, RealTime(1,0));
 
     // If the track is making sound
-    if (!ControlBlock::getInstance()->isTrackMuted(track->getId())  &&
-        !ControlBlock::getInstance()->isTrackArchived(track->getId())) {
+    if (!ControlBlock::getInstance()->isTrackMuted(trackId)  &&
+        !ControlBlock::getInstance()->isTrackArchived(trackId)) {
         // Track is unmuted, so get a channel interval to play on.
         // This also releases the old channel interval (possibly
         // getting it again)
@@ -329,6 +658,63 @@ void InternalSegmentMapper::fillBuffer()
     setStartEnd(minRealTime, maxRealTime);
 }
 
+void
+InternalSegmentMapper::refreshControllerCache()
+{
+    // As fillBuffer() leaves it: the last value of each controller
+    // that was mapped.
+    m_controllerCache.clear();
+
+    for (Segment::iterator i = m_segment->begin();
+         m_segment->isBeforeEndMarker(i);
+         ++i) {
+        if (!(*i)->isa(Controller::EventType)  &&
+            !(*i)->isa(PitchBend::EventType))
+            continue;
+        if ((*i)->getAbsoluteTime() >= m_filledWith.repeatEndTime)
+            break;
+        try {
+            // Only the ones that make valid MappedEvents get cached.
+            MappedEvent e(0, **i, RealTime::zeroTime, RealTime::zeroTime);
+            if (e.isValid())
+                m_controllerCache.storeLatestValue(*i);
+        } catch (...) {
+        }
+    }
+}
+
+InternalSegmentMapper::FillParameters
+InternalSegmentMapper::getFillParameters()
+{
+    FillParameters parameters;
+
+    parameters.startTime = m_segment->getStartTime();
+    parameters.endMarkerTime = m_segment->getEndMarkerTime();
+    parameters.repeatCount = getSegmentRepeatCount();
+    parameters.repeatEndTime = parameters.repeatCount > 0 ?
+            m_segment->getRepeatEndTime() : parameters.endMarkerTime;
+    parameters.delay = m_segment->getDelay();
+    parameters.realTimeDelay = m_segment->getRealTimeDelay();
+    parameters.transpose = m_segment->getTranspose();
+    parameters.trackId = m_segment->getTrack();
+
+    return parameters;
+}
+
+bool
+InternalSegmentMapper::FillParameters::operator==(
+        const FillParameters &other) const
+{
+    return startTime == other.startTime  &&
+           endMarkerTime == other.endMarkerTime  &&
+           repeatEndTime == other.repeatEndTime  &&
+           repeatCount == other.repeatCount  &&
+           delay == other.delay  &&
+           realTimeDelay == other.realTimeDelay  &&
+           transpose == other.transpose  &&
+           trackId == other.trackId;
+}
+
     /** Functions about the noteoff queue **/
 
 bool
@@ -337,16 +723,16 @@ haveEarlierNoteoff(timeT t)
 {
     return
         (!m_noteOffs.empty()) &&
-        (m_noteOffs.begin()->first <= t);
+        (m_noteOffs.begin()->time <= t);
 }
 
 void
 InternalSegmentMapper::
-enqueueNoteoff(timeT time, int pitch)
+enqueueNoteoff(timeT time, int pitch, const MappingSource &noteOn)
 {
     for (NoteoffContainer::iterator i = m_noteOffs.begin();
          i != m_noteOffs.end(); ++i) {
-        if (i->second == pitch) {
+        if (i->pitch == pitch) {
 #ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
             RG_DEBUG << "enqueueNoteoff(): duplicated NOTE OFF  pitch: " << pitch << " at " << time;
 #endif
@@ -354,8 +740,13 @@ enqueueNoteoff(timeT time, int pitch)
         }
     }
 
+    MappingSource source = noteOn;
+    source.noteOnTime = noteOn.time;
+    source.time = time;
+    source.noteOff = true;
+
     // Enqueue this noteoff
-    m_noteOffs.insert(Noteoff(time, pitch));
+    m_noteOffs.insert(Noteoff(time, pitch, source));
 }
 
 
@@ -364,8 +755,8 @@ InternalSegmentMapper::
 popInsertNoteoff(int trackid, Composition &comp)
 {
     // Look at top element
-    timeT internalTime = m_noteOffs.begin()->first;
-    int pitch          = m_noteOffs.begin()->second;
+    timeT internalTime = m_noteOffs.begin()->time;
+    int pitch          = m_noteOffs.begin()->pitch;
 
     // A noteoff looks like a note with velocity = 0.
     // Our noteoffs already have performance pitch, so
@@ -374,6 +765,7 @@ popInsertNoteoff(int trackid, Composition &comp)
     event.setEventTime(toRealTime(comp, internalTime));
     event.setTrackId(trackid);
     mapAnEvent(&event);
+    m_sources.push_back(m_noteOffs.begin()->source);
 
     // pop
     m_noteOffs.erase(m_noteOffs.begin());
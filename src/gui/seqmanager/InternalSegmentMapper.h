@@ -19,11 +19,13 @@
 #define RG_INTERNALSEGMENTMAPPER_H
 
 #include "base/ControllerContext.h"
+#include "base/Segment.h"
 #include "gui/seqmanager/MappedEventBuffer.h"
 #include "gui/seqmanager/SegmentMapper.h"
 #include "gui/seqmanager/ChannelManager.h"
 
 #include <set>
+#include <vector>
 
 namespace Rosegarden
 {
@@ -31,6 +33,7 @@ namespace Rosegarden
 class TriggerSegmentRec;
 class Composition;
 class RealTime;
+class SegmentPerformanceHelper;
  
 /// Converts (maps) Event objects into MappedEvent objects for a Segment
 /**
@@ -67,6 +70,20 @@ protected:
     /// dump all segment data in the file
     void fillBuffer() override;
 
+    /// Re-map only the Events between from and to.
+    /**
+     * Removes everything in the buffer that was mapped from Events
+     * overlapping the range, re-maps the Events now in the range (for
+     * every repeat) and merges the result back in.  The range is
+     * widened as needed to cover tied notes that cross its ends.
+     *
+     * Gives up (returns false) when the Segment's timing has changed
+     * since the last fillBuffer(), or when the Segment has triggered
+     * segments or grace notes, whose performance depends on Events
+     * arbitrarily far away.
+     */
+    bool updateBuffer(timeT from, timeT to) override;
+
     // Return whether the event should be played.
     bool shouldPlay(MappedEvent *evt, RealTime startTime) override;
 
@@ -97,12 +114,55 @@ private:
      */
     ControllerAndPBList getControllers(Instrument *instrument, RealTime start);
 
-    typedef std::pair<timeT, int> Noteoff;
+    /// Where a MappedEvent in the buffer came from.
+    /**
+     * Kept for each MappedEvent in the buffer (see m_sources) so that
+     * updateBuffer() can find the ones to replace and where to put the
+     * new ones.
+     */
+    struct MappingSource
+    {
+        /// Performance time used to order the buffer.
+        /**
+         * The Event's time plus the time for repeats, or for a
+         * noteoff, the time it is queued for.
+         */
+        timeT time;
+        /// Noteoffs go before other events at the same time.
+        bool noteOff;
+        /// For noteoffs, the time of the note-on.  Keeps chords in order.
+        timeT noteOnTime;
+        /// The span of Segment time covered by the Event(s) mapped.
+        /**
+         * Covers both performance and notation times, and for the
+         * first note of a tied series, the whole series.
+         */
+        timeT from;
+        timeT to;
+
+        bool overlaps(timeT rangeFrom, timeT rangeTo) const
+            { return from <= rangeTo  &&  to >= rangeFrom; }
+    };
+    /// Whether a belongs before b in the buffer.
+    static bool mappedBefore(const MappingSource &a, const MappingSource &b);
+
+    struct Noteoff
+    {
+        Noteoff(timeT time_, int pitch_, const MappingSource &source_) :
+            time(time_),
+            pitch(pitch_),
+            source(source_)
+        { }
+
+        timeT time;
+        int pitch;
+        MappingSource source;
+    };
     struct NoteoffCmp
     {
         typedef InternalSegmentMapper::Noteoff Noteoff;
         bool operator()(const Noteoff &e1, const Noteoff &e2) const {
-            return e1.first < e2.first;
+            return e1.time < e2.time;
         }
         bool operator()(const Noteoff *e1, const Noteoff *e2) const {
             return operator()(*e1, *e2);
@@ -118,7 +178,51 @@ private:
         { return m_channelManager.getInstrument(); }
 
     void popInsertNoteoff(int trackid, Composition &comp);
-    void enqueueNoteoff(timeT time, int pitch);
+    void enqueueNoteoff(timeT time, int pitch, const MappingSource &noteOn);
+
+    /// Convert a single Event for one time through the Segment.
+    /**
+     * playTime is the Event's sounding time plus the time for repeats.
+     * Returns false if the Event doesn't make a MappedEvent.  For a
+     * note that needs a noteoff, sets noteoffTime to its time.
+     * Otherwise sets noteoffTime to -1.
+     */
+    bool mapEvent(SegmentPerformanceHelper &helper, Segment::iterator i,
+                  timeT playTime, timeT repeatEndTime, TrackId trackId,
+                  Composition &comp, MappedEvent &mappedEvent,
+                  timeT &noteoffTime);
+
+    /// Make the MappingSource for an Event.
+    /**
+     * time is the Event's absolute time plus the time for repeats.
+     */
+    MappingSource makeSource(SegmentPerformanceHelper &helper,
+                             Segment::iterator i, timeT time);
+
+    /// Whether an Event can't be re-mapped by updateBuffer().
+    static bool isNonLocal(const Event *e);
+
+    /// Channel setup and start/end times, after filling the buffer.
+    void updateSoundingInterval(TrackId trackId);
+
+    /// Rebuild m_controllerCache from the Segment.
+    void refreshControllerCache();
+
+    /// Segment settings that affect every event in the buffer.
+    struct FillParameters
+    {
+        timeT startTime;
+        timeT endMarkerTime;
+        timeT repeatEndTime;
+        int repeatCount;
+        timeT delay;
+        RealTime realTimeDelay;
+        int transpose;
+        TrackId trackId;
+
+        bool operator==(const FillParameters &other) const;
+    };
+    FillParameters getFillParameters();
 
     bool haveEarlierNoteoff(timeT t);
     RealTime toRealTime(Composition &comp, timeT t);
@@ -141,6 +245,19 @@ private:
 
     /// Queue of noteoffs.
     NoteoffContainer m_noteOffs;
+
+    /// Where each MappedEvent in the buffer came from.
+    /**
+     * Parallel to the buffer: m_sources[i] is the source of at(i).
+     */
+    std::vector<MappingSource> m_sources;
+
+    /// The settings the buffer was last filled with.
+    FillParameters m_filledWith;
+    /// Whether fillBuffer() has been called.
+    bool m_filled;
+    /// Whether the last fillBuffer() found any isNonLocal() Events.
+    bool m_hasNonLocalEvents;
 };
 
 
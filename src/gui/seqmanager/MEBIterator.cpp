@@ -27,6 +27,7 @@ namespace Rosegarden
 MEBIterator::MEBIterator(
         QSharedPointer<MappedEventBuffer> mappedEventBuffer) :
     m_mappedEventBuffer(mappedEventBuffer),
+    m_snapshot(nullptr),
     m_index(0),
     m_ready(false),
     m_active(false),
@@ -34,11 +35,32 @@ MEBIterator::MEBIterator(
 {
 }
 
+MEBIterator::~MEBIterator()
+{
+    if (m_snapshot)
+        m_mappedEventBuffer->unpin(m_snapshot);
+}
+
+const MappedEventBuffer::Snapshot *
+MEBIterator::latestSnapshot() const
+{
+    if (m_snapshot != m_mappedEventBuffer->m_current.loadAcquire()) {
+        const MappedEventBuffer::Snapshot *old = m_snapshot;
+        m_snapshot = m_mappedEventBuffer->pin();
+        if (old)
+            m_mappedEventBuffer->unpin(old);
+    }
+
+    return m_snapshot;
+}
+
 // ++prefix
 MEBIterator &
 MEBIterator::operator++()
 {
-    if (m_index < m_mappedEventBuffer->size())
+    // Stay on the version we have pinned, since the caller may still
+    // be using the event it got from peek().
+    if (m_index < pinnedSnapshot()->size)
         ++m_index;
 
     return *this;
@@ -47,22 +69,14 @@ MEBIterator::operator++()
 void
 MEBIterator::moveTo(const RealTime &time)
 {
-    // Rather than briefly unlock and immediately relock each
-    // iteration, we leave the lock on until we're done.
-    QReadLocker locker(getLock());
+    // Work on one version of the buffer throughout, even if the
+    // writer publishes a new one while we are at it.
+    const MappedEventBuffer::Snapshot *snapshot = latestSnapshot();
 
     // For each event from the current iterator position
-    while (1) {
-        if (atEnd())
-            break;
+    while (m_index < snapshot->size) {
 
-        // We use peek because it's safe even if we have not fully
-        // filled the buffer yet.  That means we can get nullptr.
-        const MappedEvent *event = peek();
-
-        // We know nothing about the event yet.  Stop here.
-        if (!event)
-            break;
+        const MappedEvent *event = &snapshot->at(m_index);
 
 #if 1
         // If the event sounds past time, stop here.
@@ -76,7 +90,7 @@ MEBIterator::moveTo(const RealTime &time)
             break;
 #endif
 
-        operator++();
+        ++m_index;
     }
 
     // Since we moved, we need to send a channel setup again.
@@ -97,14 +111,15 @@ MEBIterator::operator*()
 MappedEvent *
 MEBIterator::peek() const
 {
-    // The lock formerly here has moved out to callers.
+    const MappedEventBuffer::Snapshot *snapshot = latestSnapshot();
 
     // If we're at the end, return nullptr
-    if (m_index >= m_mappedEventBuffer->size())
+    if (m_index >= snapshot->size)
         return nullptr;
 
-    // Otherwise return a pointer into the buffer.
-    return &m_mappedEventBuffer->m_buffer[m_index];
+    // Otherwise return a pointer into the buffer.  It is safe to use
+    // even if a new version is published, as we have this one pinned.
+    return &snapshot->at(m_index);
 }
 
 void
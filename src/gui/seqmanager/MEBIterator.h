@@ -22,6 +22,8 @@
 
 #include <QSharedPointer>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden {
 
 
@@ -29,17 +31,22 @@ namespace Rosegarden {
 /**
  * MappedBufMetaIterator creates and manages these.
  * MappedBufMetaIterator::m_iterators is a std::vector of these.
+ *
+ * An iterator pins the version of the buffer it reads (see
+ * MappedEventBuffer::pin()).  atEnd(), peek(), operator*() and moveTo()
+ * move it on to the latest version, if there is a newer one.
  */
-class MEBIterator
+class ROSEGARDENPRIVATE_EXPORT MEBIterator
 {
 public:
     MEBIterator(QSharedPointer<MappedEventBuffer> mappedEventBuffer);
+    ~MEBIterator();
 
     /// Go back to the beginning of the MappedEventBuffer
     void reset()  { m_index = 0; }
 
     bool atEnd() const
-        { return (m_index >= m_mappedEventBuffer->size()); }
+        { return (m_index >= latestSnapshot()->size); }
 
     /// Prefix operator++
     MEBIterator& operator++();
@@ -64,8 +71,10 @@ public:
      *
      * Returns 0 if atEnd().
      *
-     * Callers should lock getLock() with QReadLocker for as long
-     * as they are holding the pointer.
+     * The pointer stays valid, even if the MappedEventBuffer is
+     * refreshed in the meantime, until the next call to atEnd(),
+     * peek(), operator*() or moveTo(), or until the iterator is
+     * destroyed.
      *
      * @see operator*()
      */
@@ -157,18 +166,27 @@ public:
     bool shouldPlay(MappedEvent *evt, RealTime startTime)
         { return m_mappedEventBuffer->shouldPlay(evt, startTime); }
 
-    /// Get a pointer to the MappedEventBuffer's lock.
+private:
+    /// Hidden and not implemented as dtor is non-trivial.
+    MEBIterator(const MEBIterator &);
+    /// Hidden and not implemented as dtor is non-trivial.
+    MEBIterator &operator=(const MEBIterator &);
+
+    /// Pin the version of the buffer that the writer last published.
     /**
-     * This is used when reading to prevent MappedEventBuffer from
-     * reallocating the buffer while we are holding a pointer.
+     * And let go of the one we had, if it is older.
      */
-    QReadWriteLock *getLock() const
-        { return &m_mappedEventBuffer->m_lock; }
+    const MappedEventBuffer::Snapshot *latestSnapshot() const;
+    /// The version we have pinned, pinning one if there is none.
+    const MappedEventBuffer::Snapshot *pinnedSnapshot() const
+        { return m_snapshot ? m_snapshot : latestSnapshot(); }
 
-private:
     /// The buffer this iterator points into.
     QSharedPointer<MappedEventBuffer> m_mappedEventBuffer;
 
+    /// The version of the buffer we have pinned.
+    mutable const MappedEventBuffer::Snapshot *m_snapshot;
+
     /// Position of the iterator in the buffer.
     int m_index;
 
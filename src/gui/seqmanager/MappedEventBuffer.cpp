@@ -24,6 +24,7 @@
 #include "sound/MappedEvent.h"
 #include "sound/MappedInserterBase.h"
 
+#include <algorithm>
 #include <limits>  // for std::numeric_limits
 
 // #define DEBUG_MAPPED_EVENT_BUFFER 1
@@ -31,22 +32,215 @@
 namespace Rosegarden
 {
 
+namespace
+{
+    // Events per Chunk.  Small enough that copying the Chunks around a
+    // change is cheap, big enough that finding one is quick.
+    const int ChunkCapacity = 512;
+}
+
+MappedEventBuffer::Chunk::Chunk(int initialCapacity) :
+    events(new MappedEvent[initialCapacity]),
+    capacity(initialCapacity),
+    size(0),
+    refCount(1)
+{
+}
+
+MappedEventBuffer::Chunk::~Chunk()
+{
+    delete[] events;
+}
+
+void
+MappedEventBuffer::releaseChunk(Chunk *chunk)
+{
+    if (--chunk->refCount == 0)
+        delete chunk;
+}
+
+MappedEventBuffer::Snapshot::Snapshot() :
+    capacity(0),
+    size(0),
+    pins(0)
+{
+}
+
+MappedEventBuffer::Snapshot::~Snapshot()
+{
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        releaseChunk(chunks[i]);
+    }
+}
+
+MappedEvent &
+MappedEventBuffer::Snapshot::at(int index) const
+{
+    // The Chunk holding index is the last one that starts at or
+    // before it.
+    const size_t chunk =
+            std::upper_bound(starts.begin(), starts.end(), index) -
+            starts.begin() - 1;
+
+    return chunks[chunk]->events[index - starts[chunk]];
+}
+
+void
+MappedEventBuffer::Snapshot::addChunk(Chunk *chunk)
+{
+    if (chunk->size == 0) {
+        releaseChunk(chunk);
+        return;
+    }
+
+    chunks.push_back(chunk);
+    starts.push_back(size);
+    size += chunk->size;
+}
+
+void
+MappedEventBuffer::Snapshot::append(const MappedEvent &event)
+{
+    Chunk *last = chunks.empty() ? nullptr : chunks.back();
+
+    // Only a Chunk made for this version can be added to.  Any other
+    // is shared with a published version.
+    if (!last  ||  last->refCount != 1  ||  last->size == last->capacity) {
+        last = new Chunk(ChunkCapacity);
+        chunks.push_back(last);
+        starts.push_back(size);
+    }
+
+    last->events[last->size] = event;
+    ++last->size;
+    ++size;
+}
+
+void
+MappedEventBuffer::Snapshot::truncate(int newSize)
+{
+    while (!chunks.empty()  &&  starts.back() >= newSize) {
+        releaseChunk(chunks.back());
+        chunks.pop_back();
+        starts.pop_back();
+    }
+
+    if (!chunks.empty()) {
+        Chunk *last = chunks.back();
+        const int keep = newSize - starts.back();
+
+        if (keep < last->size) {
+            if (last->refCount == 1) {
+                last->size = keep;
+            } else {
+                // Shared, so copy what we keep.
+                Chunk *copy = new Chunk(std::max(keep, ChunkCapacity));
+                std::copy(last->events, last->events + keep, copy->events);
+                copy->size = keep;
+                releaseChunk(last);
+                chunks.back() = copy;
+            }
+        }
+    }
+
+    size = newSize;
+}
+
 MappedEventBuffer::MappedEventBuffer(RosegardenDocument *doc) :
     m_doc(doc),
     m_start(RealTime::zeroTime),
     m_end(std::numeric_limits<int>::max(), 0),  // 68 years
-    m_buffer(nullptr),
-    m_capacity(0),
-    m_size(0),
-    m_lock(),
+    m_current(new Snapshot),
+    m_next(nullptr),
+    m_entering(0),
     m_refCount(0)
 {
 }
 
 MappedEventBuffer::~MappedEventBuffer()
 {
-    // Safe even if nullptr.
-    delete[] m_buffer;
+    // Nobody can be reading by now since the readers share ownership
+    // of us.
+    delete m_current.load();
+    delete m_next;
+    for (size_t i = 0; i < m_retired.size(); ++i) {
+        delete m_retired[i];
+    }
+}
+
+void
+MappedEventBuffer::beginUpdate(int capacity, bool keepEvents)
+{
+    Snapshot *current = m_current.load();
+
+    delete m_next;
+    m_next = new Snapshot;
+    m_next->capacity = capacity;
+
+    if (keepEvents) {
+        // Share the current version's Chunks.  updateBuffer() copies
+        // just the ones it changes.
+        for (size_t i = 0; i < current->chunks.size(); ++i) {
+            ++current->chunks[i]->refCount;
+        }
+        m_next->chunks = current->chunks;
+        m_next->starts = current->starts;
+        m_next->size = current->size;
+        m_next->capacity = std::max(capacity, current->size);
+    }
+}
+
+void
+MappedEventBuffer::publish()
+{
+    // Ordered, so that the events are all there before a reader can
+    // get at them, and so that reclaim() looks at m_entering after
+    // the swap.
+    Snapshot *old = m_current.fetchAndStoreOrdered(m_next);
+    m_next = nullptr;
+
+    m_retired.push_back(old);
+    reclaim();
+}
+
+void
+MappedEventBuffer::reclaim()
+{
+    // A reader that loaded a retired version from m_current before we
+    // replaced it has either pinned it by now or is still between the
+    // load and the pin.  So if nobody is in between, anything retired
+    // and unpinned is out of reach.  Otherwise try again next time.
+    if (m_entering.loadAcquire() != 0)
+        return;
+
+    std::vector<Snapshot *> stillPinned;
+
+    for (size_t i = 0; i < m_retired.size(); ++i) {
+        if (m_retired[i]->pins.loadAcquire() == 0)
+            delete m_retired[i];
+        else
+            stillPinned.push_back(m_retired[i]);
+    }
+
+    m_retired.swap(stillPinned);
+}
+
+const MappedEventBuffer::Snapshot *
+MappedEventBuffer::pin() const
+{
+    // See reclaim().
+    m_entering.ref();
+    const Snapshot *snapshot = m_current.loadAcquire();
+    snapshot->pins.ref();
+    m_entering.deref();
+
+    return snapshot;
+}
+
+void
+MappedEventBuffer::unpin(const Snapshot *snapshot) const
+{
+    snapshot->pins.deref();
 }
 
 void
@@ -55,11 +249,12 @@ MappedEventBuffer::init()
     int size = calculateSize();
 
     if (size > 0) {
-        reserve(size);
+        beginUpdate(size, false);
 
         //RG_DEBUG << "init() : size = " << size;
 
         fillBuffer();
+        publish();
     } else {
         //RG_DEBUG << "init() : mmap size = 0 - skipping mmapping for now";
     }
@@ -81,27 +276,55 @@ MappedEventBuffer::refresh()
 #endif
 
     // If we need to expand the buffer to hold the events
-    if (newFill > oldSize) {
+    if (newFill > oldSize)
         resized = true;
-        reserve(newFill);
-    }
 
-    // Ask the deriver to fill the buffer from the document
+    // Ask the deriver to fill a new buffer from the document
+    beginUpdate(std::max(newFill, oldSize), false);
     fillBuffer();
+    publish();
+
+    return resized;
+}
+
+bool
+MappedEventBuffer::refresh(timeT from, timeT to)
+{
+    bool resized = false;
+
+    int newFill = calculateSize();
+    int oldSize = capacity();
+
+    // If we need to expand the buffer to hold the events
+    if (newFill > oldSize)
+        resized = true;
+
+    // Ask the deriver to update just the changed range of a copy of
+    // the buffer.  If it can't, fill the whole thing.
+    beginUpdate(std::max(newFill, oldSize), true);
+    if (!updateBuffer(from, to))
+        fillBuffer();
+    publish();
 
     return resized;
 }
 
+const MappedEvent &
+MappedEventBuffer::at(int index) const
+{
+    return writeSnapshot()->at(index);
+}
+
 int
 MappedEventBuffer::capacity() const
 {
-    return m_capacity.load();
+    return writeSnapshot()->capacity;
 }
 
 int
 MappedEventBuffer::size() const
 {
-    return m_size.load();
+    return writeSnapshot()->size;
 }
 
 void
@@ -109,51 +332,116 @@ MappedEventBuffer::reserve(int newSize)
 {
     if (newSize <= capacity())  return;
 
-    MappedEvent *oldBuffer = m_buffer;
-    MappedEvent *newBuffer = new MappedEvent[newSize];
-
-    if (oldBuffer) {
-        for (int i = 0; i < m_size.load(); ++i) {
-            newBuffer[i] = m_buffer[i];
-        }
+    // Only the new version can grow.  Chunks are allocated as events
+    // are added, so there is nothing else to do.
+    if (!m_next) {
+        RG_WARNING << "reserve(): Called outside init() and refresh()";
+        return;
     }
 
-    {
-        QWriteLocker locker(&m_lock);
-        m_buffer = newBuffer;
-        m_capacity.storeRelease(newSize);
-    }
+    m_next->capacity = newSize;
 
 #ifdef DEBUG_MAPPED_EVENT_BUFFER
     SEQUENCER_DEBUG << "MappedEventBuffer::reserve: Resized to " << newSize << " events";
 #endif
-
-    delete[] oldBuffer;
 }
 
 void
 MappedEventBuffer::resize(int newFill)
 {
-    m_size.store(newFill);
+    if (!m_next) {
+        RG_WARNING << "resize(): Called outside init() and refresh()";
+        return;
+    }
+    if (newFill < 0  ||  newFill > m_next->size) {
+        RG_WARNING << "resize(): Can't resize from" << m_next->size
+                   << "to" << newFill << "events";
+        return;
+    }
+
+    m_next->truncate(newFill);
 }
 
 void
 MappedEventBuffer::
 mapAnEvent(MappedEvent *e)
 {
-    if (size() >= capacity()) {
-        // We need a bigger buffer.  We scale by 1.5, a compromise
-        // between allocating too often and wasting too much space.
-        // We also add 1 in case the space didn't increase due to
-        // rounding.
-        int newSize = 1 + float(capacity()) * 1.5;
-        reserve(newSize);
+    if (!m_next) {
+        RG_WARNING << "mapAnEvent(): Called outside init() and refresh()";
+        return;
+    }
+
+    m_next->append(*e);
+
+    if (m_next->size > m_next->capacity)
+        m_next->capacity = m_next->size;
+}
+
+void
+MappedEventBuffer::replace(int first, int last,
+                           const std::vector<MappedEvent> &events)
+{
+    if (!m_next) {
+        RG_WARNING << "replace(): Called outside init() and refresh()";
+        return;
+    }
+    if (first < 0  ||  first > last  ||  last > m_next->size) {
+        RG_WARNING << "replace(): Bad range" << first << "to" << last
+                   << "in" << m_next->size << "events";
+        return;
+    }
+
+    // Take the Chunks out, then put back the ones that don't change
+    // and copies of what we keep from the ones that do.
+    std::vector<Chunk *> chunks;
+    std::vector<int> starts;
+    chunks.swap(m_next->chunks);
+    starts.swap(m_next->starts);
+    m_next->size = 0;
+
+    bool inserted = false;
+
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        Chunk *chunk = chunks[i];
+        const int start = starts[i];
+        const int end = start + chunk->size;
+
+        // Before the change.
+        if (end <= first) {
+            m_next->addChunk(chunk);
+            continue;
+        }
+
+        if (!inserted) {
+            for (int j = start; j < first; ++j) {
+                m_next->append(chunk->events[j - start]);
+            }
+            for (size_t j = 0; j < events.size(); ++j) {
+                m_next->append(events[j]);
+            }
+            inserted = true;
+        }
+
+        // After the change.
+        if (start >= last) {
+            m_next->addChunk(chunk);
+            continue;
+        }
+
+        for (int j = std::max(start, last); j < end; ++j) {
+            m_next->append(chunk->events[j - start]);
+        }
+        releaseChunk(chunk);
+    }
+
+    if (!inserted) {
+        for (size_t j = 0; j < events.size(); ++j) {
+            m_next->append(events[j]);
+        }
     }
 
-    getBuffer()[size()] = e;
-    // Some mappers need this to be done now because they may resize
-    // the buffer later, which will only copy the filled part.
-    resize(size() + 1);
+    if (m_next->size > m_next->capacity)
+        m_next->capacity = m_next->size;
 }
 
 void
@@ -19,10 +19,15 @@
 #define RG_MAPPEDEVENTBUFFER_H
 
 #include "base/RealTime.h"
+#include "base/TimeT.h"
 #include "base/Track.h"
 
-#include <QReadWriteLock>
 #include <QAtomicInt>
+#include <QAtomicPointer>
+
+#include <vector>
+
+#include <rosegardenprivate_export.h>
 
 namespace Rosegarden
 {
@@ -46,13 +51,19 @@ class RosegardenDocument;
  * The mapping logic is handled by mappers derived from this class; this
  * class provides the basic container and the reading logic.
  *
- * Reading and writing may take place simultaneously without locks (we are
- * prepared to accept the lossage from individual mangled MappedEvent
- * reads) but a read/write lock (m_lock) on the buffer space guards
- * against bad
- * access caused by resizes.  [Actually, it doesn't at all since the
- * caller of peek() has a pointer they can access after the lock has
- * been released.  See comments on m_lock below and in iterator::peek().]
+ * Reading and writing take place simultaneously without locks.  The
+ * writer (the GUI thread, via init() and refresh()) never modifies what
+ * the readers (the sequencer thread, via MEBIterator) can see.  Instead
+ * it builds a new version of the buffer and publishes it with a single
+ * atomic pointer swap when it is done.  This means the sequencer never
+ * waits on the GUI, and it never sees a half-filled buffer.
+ *
+ * A version holds its events in chunks.  A new version shares the
+ * chunks of the old one that it doesn't change, so refresh(from, to)
+ * only copies the events around the changed range.
+ *
+ * Readers pin the version they are reading (see pin()), and a retired
+ * version is only deleted once nobody has it pinned.  See m_current.
  *
  * MappedEventBuffer only concerns itself with the state of the
  * composition, as opposed to the state of performance.  No matter how
@@ -63,7 +74,7 @@ class RosegardenDocument;
  * metaiterators (MappedBufMetaIterator?) and by ChannelManager and deletes
  * itself when the last owner is removed.  See addOwner() and removeOwner().
  */
-class MappedEventBuffer
+class ROSEGARDENPRIVATE_EXPORT MappedEventBuffer
 {
    
 public:
@@ -77,35 +88,44 @@ public:
      */
     void init();
 
-    /// Access to the internal buffer of events.  NOT LOCKED
+    /// An event in the buffer.
     /**
-     * un-locked, use only from write/resize thread
+     * Use only from the writing thread.  During init() and refresh()
+     * this is the new version of the buffer that is being filled.
+     * Otherwise it is the current version.
      *
-     * This is always used along with [] to access a specific MappedEvent.
-     *
-     * ??? Unsafe.  This allows direct access to the buffer without any
-     *     sort of range checking.  Recommend adding an operator[] and/or an
-     *     at() that asserts on range problems.
+     * index must be less than size().  Events are added with
+     * mapAnEvent(), never changed in place.
      */
-    MappedEvent *getBuffer()  { return m_buffer; }
+    const MappedEvent &at(int index) const;
 
     /// Capacity of the buffer in MappedEvent's.
+    /**
+     * Like at(), for the writing thread.
+     */
     int capacity() const;
     /// Number of MappedEvent objects in the buffer.
+    /**
+     * Like at(), for the writing thread.  Readers see the size of the
+     * version they are reading through MEBIterator.
+     */
     int size() const;
 
     /// Sets the buffer capacity.
     /**
-     * Ignored if smaller than old capacity.
+     * Ignored if smaller than old capacity.  Only allowed during
+     * init() and refresh(); a warning is logged otherwise.
      *
      * @see capacity()
      *
      */
     void reserve(int newSize);
 
-    /// Sets the number of events in the buffer.
+    /// Drops events from the end of the buffer.
     /**
-     * Must be no bigger than buffer capacity.
+     * Must be no bigger than size(), as events can only be added by
+     * mapAnEvent().  Only allowed during init() and refresh().  A
+     * warning is logged and nothing is done otherwise.
      *
      * @see size()
      *
@@ -122,6 +142,18 @@ public:
      */
     bool refresh();
 
+    /// Refresh the buffer after a change between two times
+    /**
+     * As refresh(), but gives the deriver the chance to re-map just
+     * the part of the buffer that depends on the Events between from
+     * and to (see updateBuffer()).  Falls back to a full refresh()
+     * when it can't.
+     *
+     * The range is a Segment time range such as the one accumulated
+     * by SegmentRefreshStatus.
+     */
+    bool refresh(timeT from, timeT to);
+
     /// Get the earliest and latest sounding times.
     /**
      * Called by MappedBufMetaIterator::fetchEvents() and
@@ -195,6 +227,17 @@ protected:
      */
     virtual void fillBuffer() = 0;
 
+    /// Update the buffer for a change between two Segment times
+    /**
+     * Derivers that can re-map part of a Segment override this.  The
+     * result must be identical to what fillBuffer() would produce.
+     *
+     * Returns false if the update couldn't be done, in which case
+     * refresh() falls back to fillBuffer().  The default always
+     * returns false.
+     */
+    virtual bool updateBuffer(timeT /*from*/, timeT /*to*/)  { return false; }
+
     /// Return whether the event would even sound.
     /**
      * For instance, it might be on a muted track and shouldn't be
@@ -232,6 +275,13 @@ protected:
     /// Add an event to the buffer.
     void mapAnEvent(MappedEvent *e);
 
+    /// Replace the events from first up to (not including) last.
+    /**
+     * For updateBuffer().  Only the chunks holding first and last are
+     * copied; the others are shared with the current version.
+     */
+    void replace(int first, int last, const std::vector<MappedEvent> &events);
+
     /// Set the sounding times (m_start, m_end).
     /**
      * InternalSegmentMapper::fillBuffer() keeps this updated.
@@ -250,8 +300,7 @@ private:
     MappedEventBuffer &operator=(const MappedEventBuffer &);
 
     // MEBIterator needs:
-    //   m_buffer
-    //   m_lock
+    //   m_current, pin() and unpin()
     //   makeReady()
     //   shouldPlay()
     //   doInsert()
@@ -259,37 +308,112 @@ private:
     //     just make those public and get rid of this.
     friend class MEBIterator;
 
-    /// The Mapped Event Buffer
-    MappedEvent *m_buffer;
+    /// A run of events that one or more versions of the buffer share.
+    /**
+     * Never modified once a published version refers to it.  Only the
+     * writing thread makes, shares and deletes Chunks.
+     */
+    struct Chunk
+    {
+        explicit Chunk(int initialCapacity);
+        ~Chunk();
+
+        MappedEvent *events;
+        int capacity;
+        int size;
+
+        /// How many versions refer to this.
+        int refCount;
+
+    private:
+        Chunk(const Chunk &);
+        Chunk &operator=(const Chunk &);
+    };
+
+    /// One version of the buffer.
+    struct Snapshot
+    {
+        Snapshot();
+        ~Snapshot();
+
+        /// The event at index.  Finds the Chunk by binary search.
+        MappedEvent &at(int index) const;
+
+        /// Add a Chunk, taking over a reference to it.
+        void addChunk(Chunk *chunk);
+        /// Add an event.  Writing thread only, before publishing.
+        void append(const MappedEvent &event);
+        /// Drop events from the end.  Writing thread only.
+        void truncate(int newSize);
+
+        /// The events, in order.
+        std::vector<Chunk *> chunks;
+        /// Index of the first event in each Chunk.
+        std::vector<int> starts;
+
+        int capacity;
+        int size;
+
+        /// How many readers are using this version.  See pin().
+        mutable QAtomicInt pins;
+
+    private:
+        Snapshot(const Snapshot &);
+        Snapshot &operator=(const Snapshot &);
+    };
+
+    /// Drop a reference to a Chunk, deleting it if it was the last.
+    static void releaseChunk(Chunk *chunk);
+
+    /// The version of the buffer the readers see.
+    /**
+     * Never nullptr.  Never modified once published, except by
+     * replacing it.  A reader pins the version it loads from here with
+     * pin(), and the writer only deletes a replaced version once it is
+     * unpinned.  See reclaim().
+     */
+    QAtomicPointer<Snapshot> m_current;
 
-    /// Capacity of the buffer.
+    /// The version being filled by init() or refresh().
     /**
-     * ??? While storeRelease() is used with this, it's somewhat dubious
-     *     as to whether that is necessary.  There are no other uses
-     *     of m_capacity anywhere near that one.  It's very likely that
-     *     QAtomicInt is not needed here.
+     * nullptr except during init() and refresh().  Only the writing
+     * thread ever sees this.
      */
-    mutable QAtomicInt m_capacity;
+    Snapshot *m_next;
 
-    /// Number of events in the buffer.
+    /// Replaced versions that haven't been deleted yet.
     /**
-     * ??? We only use load() and store().  This doesn't need to be a
-     *     QAtomicInt.
+     * Only the writing thread uses this.
      */
-    mutable QAtomicInt m_size;
+    std::vector<Snapshot *> m_retired;
+
+    /// How many readers are between loading m_current and pinning it.
+    mutable QAtomicInt m_entering;
 
-    /// Lock for reserve() and callers to iterator::peek()
+    /// The Snapshot the writer functions (at(), etc...) work on.
+    Snapshot *writeSnapshot() const
+        { return m_next ? m_next : m_current.load(); }
+
+    /// Start a new version of the buffer.
     /**
-     * Used by reserve() to lock the swapping of the old for the new
-     * and the changing of the buffer capacity.
-     *
-     * Used by callers to MappedEventBuffer::iterator::peek() to
-     * ensure that buffer isn't reallocated while the caller is
-     * holding the current item.  Doing so avoids the scenario where
-     * peek() gets a pointer to the element and then reserve() swaps
-     * the entire buffer out from under it.
+     * With keepEvents, the new version starts out sharing the chunks
+     * of the current one, for updateBuffer().  Otherwise it starts out
+     * empty.
+     */
+    void beginUpdate(int capacity, bool keepEvents);
+    /// Make the new version current, and retire the old one.
+    void publish();
+    /// Delete the retired versions that no reader can get at any more.
+    void reclaim();
+
+    /// Get the current version for reading and pin it.
+    /**
+     * The version stays valid until unpin() even if the writer replaces
+     * it in the meantime.  Any thread.  Lock-free.
      */
-    QReadWriteLock m_lock;
+    const Snapshot *pin() const;
+    /// Let go of a version returned by pin().
+    void unpin(const Snapshot *snapshot) const;
 
     /// How many metaiterators share this mapper.
     /**
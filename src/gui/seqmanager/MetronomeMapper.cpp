@@ -182,6 +182,17 @@ void MetronomeMapper::fillBuffer()
 
     const RealTime tickDuration(0, 100000000);
 
+    // The ticks are sorted, so convert them all to RealTime in one go.
+    std::vector<timeT> tickTimes;
+    tickTimes.reserve(m_ticks.size());
+    for (TickContainer::const_iterator tick = m_ticks.begin();
+         tick != m_ticks.end();
+         ++tick) {
+        tickTimes.push_back(tick->first);
+    }
+    std::vector<RealTime> tickRealTimes;
+    composition.getElapsedRealTimes(tickTimes, tickRealTimes);
+
     int index = 0;
 
     // For each tick
@@ -191,7 +202,7 @@ void MetronomeMapper::fillBuffer()
 
         //RG_DEBUG << "fillBuffer(): velocity = " << int(velocity);
 
-        RealTime eventTime = composition.getElapsedRealTime(tick->first);
+        const RealTime &eventTime = tickRealTimes[index];
 
         MappedEvent e;
 
@@ -232,7 +243,7 @@ void MetronomeMapper::fillBuffer()
         }
 
         // Add the event to the buffer.
-        getBuffer()[index] = e;
+        mapAnEvent(&e);
 
         ++index;
     }
@@ -240,8 +251,6 @@ void MetronomeMapper::fillBuffer()
     //RG_DEBUG << "fillBuffer(): capacity: " << capacity();
     //RG_DEBUG << "  Total events written: " << index;
 
-    resize(index);
-
     m_channelManager.allocateChannelInterval(false);
     m_channelManager.setDirty();
 }
@@ -1422,11 +1422,16 @@ void SequenceManager::refresh()
 
     for (SegmentRefreshMap::iterator i = m_segments.begin();
             i != m_segments.end(); ++i) {
-        // If this Segment needs a refresh
-        if (i->first->getRefreshStatus(i->second).needsRefresh() ||
-                ridset.find(i->first->getRuntimeId()) != ridset.end()) {
+        SegmentRefreshStatus &status = i->first->getRefreshStatus(i->second);
+
+        // If a trigger Segment it uses has changed, remap it all.
+        if (ridset.find(i->first->getRuntimeId()) != ridset.end()) {
             segmentModified(i->first);
-            i->first->getRefreshStatus(i->second).setNeedsRefresh(false);
+            status.setNeedsRefresh(false);
+        } else if (status.needsRefresh()) {
+            // Just the part that changed.
+            segmentModified(i->first, status.from(), status.to());
+            status.setNeedsRefresh(false);
         }
     }
 
@@ -1451,6 +1456,19 @@ SequenceManager::segmentModified(Segment* s)
         (m_compositionMapper->getMappedEventBuffer(s));
 }
 
+void
+SequenceManager::segmentModified(Segment *s, timeT from, timeT to)
+{
+    RG_DEBUG << "segmentModified(" << s << "," << from << "," << to << ")";
+
+    bool sizeChanged = m_compositionMapper->segmentModified(s, from, to);
+
+    RG_DEBUG << "segmentModified() : size changed = " << sizeChanged;
+
+    RosegardenSequencer::getInstance()->segmentModified
+        (m_compositionMapper->getMappedEventBuffer(s));
+}
+
 void SequenceManager::segmentAdded(const Composition*, Segment* s)
 {
     RG_DEBUG << "segmentAdded(" << s << "); queueing";
@@ -380,6 +380,8 @@ private:
     void segmentAdded(Segment *);
     /// Inform CompositionMapper and RosegardenSequencer that a Segment has changed.
     void segmentModified(Segment *);
+    /// As segmentModified(Segment *), for a change between two times.
+    void segmentModified(Segment *, timeT from, timeT to);
     /**
      * Remove Segment from CompositionMapper, RosegardenSequencer, and the
      * SegmentRefreshMap (m_segments).
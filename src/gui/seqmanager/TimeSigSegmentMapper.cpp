@@ -34,8 +34,6 @@ TimeSigSegmentMapper::fillBuffer()
 
     Composition& comp = m_doc->getComposition();
 
-    int index = 0;
-
     for (int i = 0; i < comp.getTimeSignatureCount(); ++i) {
 
         std::pair<timeT, TimeSignature> timeSigChange = comp.getTimeSignatureChange(i);
@@ -48,11 +46,8 @@ TimeSigSegmentMapper::fillBuffer()
         e.setData1(timeSigChange.second.getNumerator());
         e.setData2(timeSigChange.second.getDenominator());
 
-        getBuffer()[index] = e;
-        ++index;
+        mapAnEvent(&e);
     }
-
-    resize(index);
 }
 
 int
@@ -0,0 +1,220 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[WorkerPool]"
+
+#include "WorkerPool.h"
+#include "misc/Debug.h"
+
+#include <QCoreApplication>
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+namespace Rosegarden
+{
+
+WorkerPool::WorkerPool(int threads, int priority) :
+    m_job(nullptr),
+    m_context(nullptr),
+    m_count(0),
+    m_started(0),
+    m_next(0),
+    m_finished(0),
+    m_cancelled(0),
+    m_stopping(0)
+{
+    sem_init(&m_start, 0, 0);
+    sem_init(&m_done, 0, 0);
+
+    for (int i = 0; i < threads; ++i) {
+        Worker *worker = new Worker(this, i + 1, priority);
+        worker->start();
+        m_workers.push_back(worker);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    // Don't leave threads working on a batch nobody waited for.
+    if (m_started > 0) {
+        cancel();
+        for (size_t i = 0; i < m_started; ++i) {
+            while (sem_wait(&m_done) != 0) {
+                // interrupted by a signal
+            }
+        }
+    }
+
+    // Let the threads exit of their own accord.
+    m_stopping.storeRelease(1);
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        sem_post(&m_start);
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i]->wait();
+        delete m_workers[i];
+    }
+
+    sem_destroy(&m_start);
+    sem_destroy(&m_done);
+}
+
+int
+WorkerPool::getIdealThreadCount()
+{
+    return std::max(1, std::min(QThread::idealThreadCount(), 8));
+}
+
+size_t
+WorkerPool::begin(Job job, void *context, size_t count, size_t wake)
+{
+    m_job = job;
+    m_context = context;
+    m_count = count;
+    m_next.storeRelease(0);
+    m_finished.storeRelease(0);
+    m_cancelled.storeRelease(0);
+
+    // No point waking more threads than there are jobs for them.
+    wake = std::min(wake, count);
+    for (size_t i = 0; i < wake; ++i)
+        sem_post(&m_start);
+
+    return wake;
+}
+
+void
+WorkerPool::run(Job job, void *context, size_t count)
+{
+    // Needs to be RT safe
+
+    if (count == 0)
+        return;
+
+    // The calling thread takes the first job.
+    const size_t wake = begin(job, context, count,
+                              std::min(m_workers.size(), count - 1));
+
+    work(0);
+
+    // Each thread that woke posts once when it has run out of jobs.
+    // A thread may get round to more than one post on m_start, in
+    // which case it also posts m_done more than once, so the count
+    // still comes out right.
+    for (size_t i = 0; i < wake; ++i) {
+        while (sem_wait(&m_done) != 0) {
+            // interrupted by a signal
+        }
+    }
+}
+
+void
+WorkerPool::start(Job job, void *context, size_t count)
+{
+    m_started = begin(job, context, count, m_workers.size());
+}
+
+bool
+WorkerPool::wait(QPointer<QProgressDialog> progressDialog,
+                 int progressFrom, int progressTo)
+{
+    // With no threads of our own, do the work here.
+    if (m_workers.empty())
+        work(0);
+
+    while (m_started > 0) {
+
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_nsec += 100000000;  // 100ms
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_nsec -= 1000000000;
+            ++timeout.tv_sec;
+        }
+
+        if (sem_timedwait(&m_done, &timeout) == 0) {
+            --m_started;
+            continue;
+        }
+
+        // Timed out (or interrupted).  Keep the progress dialog going.
+        if (progressDialog  &&  !m_cancelled.loadAcquire()) {
+            if (progressDialog->wasCanceled()) {
+                cancel();
+            } else if (m_count > 0) {
+                progressDialog->setValue(progressFrom + int(
+                        double(getJobsDone()) / double(m_count) *
+                        double(progressTo - progressFrom)));
+            }
+        }
+
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+    }
+
+    return !m_cancelled.loadAcquire();
+}
+
+void
+WorkerPool::work(int worker)
+{
+    while (!m_cancelled.loadAcquire()) {
+        const int index = m_next.fetchAndAddOrdered(1);
+        if (index >= int(m_count))
+            break;
+        m_job(m_context, size_t(index), worker);
+        m_finished.fetchAndAddOrdered(1);
+    }
+}
+
+WorkerPool::Worker::Worker(WorkerPool *pool, int index, int priority) :
+    m_pool(pool),
+    m_index(index),
+    m_priority(priority)
+{
+}
+
+void
+WorkerPool::Worker::run()
+{
+    if (m_priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(struct sched_param));
+        param.sched_priority = m_priority;
+
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+            RG_WARNING << "run(): couldn't set FIFO scheduling at priority"
+                       << m_priority << "on worker thread";
+        }
+    }
+
+    while (true) {
+
+        if (sem_wait(&m_pool->m_start) != 0)
+            continue;
+
+        if (m_pool->m_stopping.loadAcquire())
+            break;
+
+        m_pool->work(m_index);
+
+        sem_post(&m_pool->m_done);
+    }
+}
+
+}
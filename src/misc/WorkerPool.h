@@ -0,0 +1,156 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_WORKER_POOL_H
+#define RG_WORKER_POOL_H
+
+#include <rosegardenprivate_export.h>
+
+#include <QAtomicInt>
+#include <QPointer>
+#include <QProgressDialog>
+#include <QThread>
+
+#include <semaphore.h>
+#include <stddef.h>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+/// Threads that share out a batch of independent jobs.
+/**
+ * Each thread claims the next unclaimed job from a shared atomic
+ * counter until there are none left.  A thread that gets through its
+ * jobs quickly simply claims more, so one slow job doesn't hold the
+ * others up.
+ *
+ * There are two ways to hand out a batch:
+ *
+ * run() has the calling thread work through the jobs alongside the
+ * pool's threads and returns when they are all done.  It wakes the
+ * threads with a semaphore and waits on another, so it is realtime
+ * safe, but as it waits the pool's threads must run at no lower a
+ * priority than the thread that calls it.
+ *
+ * start() leaves the jobs to the pool's threads and returns at once.
+ * The GUI thread can then get on with something else and call wait(),
+ * which keeps a progress dialog and the event loop going until the
+ * batch is done.
+ *
+ * Only one batch may be in hand at a time.
+ */
+class ROSEGARDENPRIVATE_EXPORT WorkerPool
+{
+public:
+    /// job(context, index, worker) processes job number index.
+    /**
+     * worker is 0 for the thread that called run() (or wait(), for a
+     * pool with no threads) and 1 to getWorkerCount() - 1 for the
+     * pool's own threads, for indexing per-thread scratch space.
+     */
+    typedef void (*Job)(void *context, size_t index, int worker);
+
+    /**
+     * Start threads threads at the given SCHED_FIFO priority (or
+     * normal scheduling if 0, or if not permitted).
+     */
+    explicit WorkerPool(int threads, int priority = 0);
+    ~WorkerPool();
+
+    /// How many threads to use for a job that should use all the CPUs.
+    /**
+     * QThread::idealThreadCount(), between 1 and 8.
+     */
+    static int getIdealThreadCount();
+
+    /// The pool's threads, plus the thread that calls run().
+    int getWorkerCount() const  { return int(m_workers.size()) + 1; }
+
+    /// Process jobs 0 to count - 1 and return when all are done.
+    void run(Job job, void *context, size_t count);
+
+    /// Have the pool's threads start on jobs 0 to count - 1.
+    /**
+     * Call wait() before starting anything else.
+     */
+    void start(Job job, void *context, size_t count);
+
+    /// Wait for the jobs handed out by start().
+    /**
+     * Processes events as it waits, and moves progressDialog from
+     * progressFrom to progressTo as the jobs get done.  If the dialog
+     * is cancelled, so are the jobs nobody has started on yet.
+     *
+     * Returns false if the jobs were cancelled.
+     */
+    bool wait(QPointer<QProgressDialog> progressDialog = nullptr,
+              int progressFrom = 0, int progressTo = 100);
+
+    /// Don't start any more jobs from the current batch.
+    void cancel()  { m_cancelled.storeRelease(1); }
+
+    /// Jobs finished so far in the current batch.
+    size_t getJobsDone() const  { return size_t(m_finished.loadAcquire()); }
+
+private:
+    WorkerPool(const WorkerPool &); // not provided
+    WorkerPool &operator=(const WorkerPool &); // not provided
+
+    class Worker : public QThread
+    {
+    public:
+        Worker(WorkerPool *pool, int index, int priority);
+
+    protected:
+        void run() override;
+
+    private:
+        WorkerPool *m_pool;
+        int m_index;
+        int m_priority;
+    };
+
+    /// Set up a batch and wake up to wake threads for it.
+    size_t begin(Job job, void *context, size_t count, size_t wake);
+
+    /// Claim and process jobs until there are none left.
+    void work(int worker);
+
+    std::vector<Worker *> m_workers;
+
+    /// Posted once per thread to be woken.
+    sem_t m_start;
+    /// Posted by each woken thread when it has run out of jobs.
+    sem_t m_done;
+
+    Job m_job;
+    void *m_context;
+    size_t m_count;
+    /// Threads woken by start() that wait() has yet to hear from.
+    size_t m_started;
+
+    /// The next job to claim.
+    QAtomicInt m_next;
+    QAtomicInt m_finished;
+    QAtomicInt m_cancelled;
+    /// Set by the destructor to tell the threads to exit.
+    QAtomicInt m_stopping;
+};
+
+}
+
+#endif
@@ -26,8 +26,10 @@
 //#include <unistd.h>
 //#include <errno.h>
 
+#include <QSettings>
 #include <QVector>
 
+#include "misc/ConfigGroups.h"
 #include "misc/Debug.h"
 #include "misc/Strings.h"
 #include "sound/ControlBlock.h"
@@ -66,12 +68,17 @@ RosegardenSequencer::RosegardenSequencer() :
     // 160 msecs for low latency mode.  Historically, we used
     // 500 msecs for "high" latency mode.
     m_readAhead(0, 160000000),
+    m_minReadAhead(m_readAhead),
+    m_adaptiveReadAhead(true),
+    m_wakeOnDemand(true),
     // 60 msecs for low latency mode.  Historically, we used
     // 400 msecs for "high" latency mode.
     m_audioMix(0, 60000000),
     m_audioRead(2, 500000000),  // 2.5 secs
     m_audioWrite(4, 0),  // 4.0 secs
     m_smallFileSize(256),  // 256 kbytes
+    m_smallFileCacheSize(65536),  // 64 Mbytes
+    m_preloadSmallFiles(true),
     m_loopStart(0, 0),
     m_loopEnd(0, 0),
     m_studio(new MappedStudio()),
@@ -79,6 +86,29 @@ RosegardenSequencer::RosegardenSequencer() :
     m_isEndOfCompReached(false),
     m_mutex(QMutex::Recursive) // recursive
 {
+    QSettings settings;
+    settings.beginGroup(SequencerOptionsConfigGroup);
+    m_wakeOnDemand = settings.value("wakeondemand", true).toBool();
+    m_adaptiveReadAhead = settings.value("adaptivereadahead", true).toBool();
+    int readAheadMsec = settings.value("readaheadmsec", 160).toInt();
+    if (readAheadMsec < 20)
+        readAheadMsec = 20;
+    m_smallFileCacheSize =
+            settings.value("smallfilecachekb", m_smallFileCacheSize).toInt();
+    if (m_smallFileCacheSize < 0)
+        m_smallFileCacheSize = 0;
+    m_preloadSmallFiles =
+            settings.value("preloadsmallfiles", m_preloadSmallFiles).toBool();
+    // Write them to the file to make them easier to find.
+    settings.setValue("wakeondemand", m_wakeOnDemand);
+    settings.setValue("adaptivereadahead", m_adaptiveReadAhead);
+    settings.setValue("readaheadmsec", readAheadMsec);
+    settings.setValue("smallfilecachekb", m_smallFileCacheSize);
+    settings.setValue("preloadsmallfiles", m_preloadSmallFiles);
+    settings.endGroup();
+
+    m_minReadAhead = m_readAhead = RealTime::fromMilliseconds(readAheadMsec);
+
     // Initialise the MappedStudio
     //
     initialiseStudio();
@@ -99,6 +129,7 @@ RosegardenSequencer::RosegardenSequencer() :
 
     m_driver->setAudioBufferSizes(m_audioMix, m_audioRead, m_audioWrite,
                                   m_smallFileSize);
+    m_driver->setSmallFileCache(m_smallFileCacheSize, m_preloadSmallFiles);
 
     // Connect for high-frequency control change notifications.
     // Note that we must use a DirectConnection or else the signals may
@@ -173,6 +204,8 @@ RosegardenSequencer::quit()
 #endif
     // and break out of the loop next time around
     m_transportStatus = QUIT;
+
+    wake();
 }
 
 
@@ -226,6 +259,8 @@ RosegardenSequencer::play(const RealTime &time)
 //!!!
 //    dumpFirstSegment();
 
+    wake();
+
     // keep it simple
     return true;
 }
@@ -338,6 +373,7 @@ RosegardenSequencer::record(const RealTime &time,
     m_transportStatus = localRecordMode;
 
     if (localRecordMode == RECORDING) { // punch in
+        wake();
         return true;
     } else {
 
@@ -379,6 +415,8 @@ RosegardenSequencer::stop()
     Profiles::getInstance()->dump();
 
     incrementTransportToken();
+
+    wake();
 }
 
 bool
@@ -391,6 +429,7 @@ RosegardenSequencer::punchOut()
     if (m_transportStatus == RECORDING) {
         m_driver->punchOut();
         m_transportStatus = PLAYING;
+        wake();
         return true;
     }
     return false;
@@ -439,7 +478,7 @@ RosegardenSequencer::jumpTo(const RealTime &pos)
 
     m_driver->startClocks();
 
-    return ;
+    wake();
 }
 
 void
@@ -452,6 +491,8 @@ RosegardenSequencer::setLoop(const RealTime &loopStart,
     m_loopEnd = loopEnd;
 
     m_driver->setLoop(loopStart, loopEnd);
+
+    wake();
 }
 
 
@@ -508,10 +549,15 @@ RosegardenSequencer::setMappedInstrument(int type, unsigned int id)
 void
 RosegardenSequencer::processMappedEvent(MappedEvent mE)
 {
-    QMutexLocker locker(&m_asyncQueueMutex);
-    m_asyncOutQueue.push_back(new MappedEvent(mE));
-//    SEQUENCER_DEBUG << "processMappedEvent: Have " << m_asyncOutQueue.size()
-//                    << " events in async out queue" << endl;
+    {
+        QMutexLocker locker(&m_asyncQueueMutex);
+        m_asyncOutQueue.push_back(new MappedEvent(mE));
+//        SEQUENCER_DEBUG << "processMappedEvent: Have " << m_asyncOutQueue.size()
+//                        << " events in async out queue" << endl;
+    }
+
+    // Send it now rather than on the next tick.
+    wake();
 }
 
 bool
@@ -1039,6 +1085,9 @@ RosegardenSequencer::segmentModified(QSharedPointer<MappedEventBuffer> mapper)
       might be introduced. */
    bool immediate = (m_transportStatus == PLAYING);
    m_metaIterator.resetIteratorForBuffer(mapper, immediate);
+
+   if (immediate)
+       wake();
 }
 
 void
@@ -1054,6 +1103,9 @@ RosegardenSequencer::segmentAdded(QSharedPointer<MappedEventBuffer> mapper)
     // m_metaIterator takes ownership of the mapper, shared with other
     // MappedBufMetaIterators
     m_metaIterator.addBuffer(mapper);
+
+    if (m_transportStatus == PLAYING)
+        wake();
 }
 
 void
@@ -1198,6 +1250,9 @@ RosegardenSequencer::applyLatencyCompensation(MappedEventList &mappedEventList)
 bool
 RosegardenSequencer::startPlaying()
 {
+    // Each playback starts out with the configured read-ahead.
+    m_readAhead = m_minReadAhead;
+
     // Fetch up to m_readAhead microseconds worth of events
     m_lastFetchSongPosition = m_songPosition + m_readAhead;
 
@@ -1234,6 +1289,26 @@ RosegardenSequencer::keepPlaying()
 
     MappedEventList c;
 
+    if (m_adaptiveReadAhead) {
+        // If less than a quarter of the read-ahead was left since the
+        // last fetch, this thread isn't getting to run often enough
+        // (system load, a slow fetch...).  Fetch further ahead so that
+        // events aren't sent late.  (Near the end of a loop the last
+        // fetch was cut short, so there's nothing to learn there.)
+        const RealTime maxReadAhead(1, 0);
+        const bool fetchCutShort =
+                isLooping()  &&
+                m_lastFetchSongPosition >= m_loopEnd - RealTime(0, 1);
+        if (!fetchCutShort  &&
+            m_readAhead < maxReadAhead  &&
+            m_lastFetchSongPosition - m_songPosition < m_readAhead / 4) {
+            m_readAhead = m_readAhead * 1.5;
+            if (m_readAhead > maxReadAhead)
+                m_readAhead = maxReadAhead;
+            RG_DEBUG << "keepPlaying(): read-ahead increased to" << m_readAhead;
+        }
+    }
+
     RealTime fetchEnd = m_songPosition + m_readAhead;
     if (isLooping() && fetchEnd >= m_loopEnd) {
         fetchEnd = m_loopEnd - RealTime(0, 1);
@@ -1320,6 +1395,36 @@ RosegardenSequencer::sleep(const RealTime &rt)
     m_driver->sleep(rt);
 }
 
+void
+RosegardenSequencer::wake()
+{
+    if (m_wakeOnDemand  &&  m_driver)
+        m_driver->wake();
+}
+
+RealTime
+RosegardenSequencer::getSleepTime()
+{
+    const RealTime pollTime = RealTime::fromMilliseconds(10);
+
+    if (!m_wakeOnDemand)
+        return pollTime;
+
+    if (m_transportStatus == PLAYING  ||  m_transportStatus == RECORDING) {
+        // Keep the GUI's pointer moving smoothly and top up the events
+        // well before the read-ahead runs out.
+        RealTime sleepTime = m_readAhead / 8;
+        if (sleepTime > pollTime)
+            sleepTime = pollTime;
+        return sleepTime;
+    }
+
+    // Stopped.  Transport changes and outgoing events wake us, incoming
+    // MIDI wakes the driver, and the driver shortens this if it has
+    // something of its own to do.
+    return m_driver->limitSleepTime(RealTime::fromMilliseconds(100));
+}
+
 void
 RosegardenSequencer::processRecordedMidi()
 {
@@ -391,11 +391,30 @@ public:
     /**
      * Called from the main loop in order to lighten CPU load (i.e. the
      * timing quality of the sequencer does not depend on this being
-     * accurate).  A good implementation of this call would return right
-     * away when an incoming MIDI event needed to be handled.
+     * accurate).  Returns early when an incoming MIDI event needs to be
+     * handled or wake() is called.
      */
     void sleep(const RealTime &rt);
 
+    /// Get the sequencer thread out of sleep() right away.
+    /**
+     * Called by the transport functions (play(), stop(), jumpTo()...),
+     * when a MappedEvent is queued and when a segment's mapper changes.
+     * Does nothing unless wake-on-demand is enabled.
+     */
+    void wake();
+
+    /// How long the main loop should sleep() for when there's nothing to do.
+    /**
+     * With wake-on-demand (the default), the loop only needs to wake up
+     * regularly while playing.  When stopped it sleeps for much longer
+     * and relies on wake() and the driver.  Without it, the loop polls
+     * every 10msecs as it always has.
+     *
+     * Call with the sequencer locked.
+     */
+    RealTime getSleepTime();
+
     /// Removes events not matching a MidiFilter from a MappedEventsList.
     /**
      * From the menu, Studio > Modify MIDI Filters... allows the user to
@@ -483,7 +502,21 @@ private:
     RealTime m_songPosition;
     RealTime m_lastFetchSongPosition;
 
+    /// How far ahead of the song position we fetch events while playing.
+    /**
+     * With adaptive read-ahead this starts at m_minReadAhead for each
+     * playback and grows if keepPlaying() finds that the sequencer
+     * thread came close to running out of events.
+     */
     RealTime m_readAhead;
+    /// The configured read-ahead.  [Sequencer_Options] readaheadmsec.
+    RealTime m_minReadAhead;
+    /// [Sequencer_Options] adaptivereadahead.
+    bool m_adaptiveReadAhead;
+
+    /// [Sequencer_Options] wakeondemand.  See getSleepTime().
+    bool m_wakeOnDemand;
+
     // ??? Rumor has it that this is ignored in low latency mode.  Track
     //     this down and decide whether to remove altogether.  We default to
     //     low latency mode now and likely have no need for "high latency"
@@ -492,6 +525,11 @@ private:
     RealTime m_audioRead;
     RealTime m_audioWrite;
     int m_smallFileSize;
+    /// Small file cache memory limit in kbytes.  "smallfilecachekb" in
+    /// the settings.
+    int m_smallFileCacheSize;
+    /// "preloadsmallfiles" in the settings.
+    bool m_preloadSmallFiles;
 
     RealTime m_loopStart;
     RealTime m_loopEnd;
@@ -37,8 +37,6 @@ SequencerThread::run()
 
     TransportStatus lastSeqStatus = seq.getStatus();
 
-    const RealTime sleepTime = RealTime::fromMilliseconds(10);
-
     QTime timer;
     timer.start();
 
@@ -164,18 +162,19 @@ SequencerThread::run()
             timer.restart();
         }
 
+        // Work this out while we still have the lock.
+        const RealTime sleepTime = seq.getSleepTime();
+
         seq.unlock();
 
         // permitting synchronised calls from the gui or wherever to
         // be made now
 
-        // If the sequencer status hasn't changed, sleep for a bit
-        if (atLeisure) {
-            // ??? Could we use a QWaitCondition/QMutex here to reduce the
-            //     (upwards of sleepTime) delay between pressing play and
-            //     playing?
+        // If the sequencer status hasn't changed, sleep for a bit.
+        // play(), stop() and friends cut this short with
+        // RosegardenSequencer::wake().
+        if (atLeisure)
             seq.sleep(sleepTime);
-        }
 
         seq.lock();
     }
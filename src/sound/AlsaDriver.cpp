@@ -62,6 +62,7 @@
 #include <pthread.h>
 #include <math.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 
 
 // #define DEBUG_ALSA 1
@@ -147,7 +148,8 @@ AlsaDriver::AlsaDriver(MappedStudio *studio):
     m_loopEndTime(0, 0),
     m_eat_mtc(0),
     m_looping(false),
-    m_haveShutdown(false)
+    m_haveShutdown(false),
+    m_wakeFd(-1)
 #ifdef HAVE_LIBJACK
     , m_jackDriver(nullptr)
 #endif
@@ -171,6 +173,10 @@ AlsaDriver::AlsaDriver(MappedStudio *studio):
 
     m_pendSysExcMap = new DeviceEventMap();
 
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd < 0)
+        RG_WARNING << "ctor: WARNING: eventfd() failed, wake() will have no effect";
+
     QSettings settings;
     settings.beginGroup(GeneralOptionsConfigGroup);
     // Accept transport CCs (116-118)
@@ -199,6 +205,9 @@ AlsaDriver::~AlsaDriver()
     clearPendSysExcMap();
 
     delete m_pendSysExcMap;
+
+    if (m_wakeFd >= 0)
+        close(m_wakeFd);
 }
 
 int
@@ -233,6 +242,8 @@ AlsaDriver::shutdown()
     m_jackDriver = nullptr;
 #endif
 
+    PlayableAudioFile::stopSmallFilePreloader();
+
     if (m_midiHandle) {
 
         RG_DEBUG << "shutdown(): stopping queue...";
@@ -4326,6 +4337,11 @@ AlsaDriver::processEventsOut(const MappedEventList &rgEventList,
 
     AudioFile *audioFile = nullptr;
     bool haveNewAudio = false;
+#ifdef HAVE_LIBJACK
+    // The audio threads may be reading the current queue, so new files
+    // are added to a copy, which is published once they are all in.
+    AudioPlayQueue *newQueue = nullptr;
+#endif
 
     // For each incoming event, insert audio events if we find them
     for (const MappedEvent *mappedEvent : rgEventList) {
@@ -4423,7 +4439,9 @@ AlsaDriver::processEventsOut(const MappedEventList &rgEventList,
                 // segment runtime id
                 paf->setRuntimeSegmentId(mappedEvent->getRuntimeSegmentId());
 
-                m_audioQueue->addUnscheduled(paf);
+                if (!newQueue)
+                    newQueue = new AudioPlayQueue(*m_audioQueue.loadAcquire());
+                newQueue->addUnscheduled(paf);
 
                 haveNewAudio = true;
             } else {
@@ -4441,6 +4459,11 @@ AlsaDriver::processEventsOut(const MappedEventList &rgEventList,
         // runtime segment ID and optionally start time)
         //
         if (mappedEvent->getType() == MappedEvent::AudioCancel) {
+            // The file to cancel may be among those not published yet.
+            if (newQueue) {
+                setAudioQueue(newQueue);
+                newQueue = nullptr;
+            }
             cancelAudioFile(mappedEvent);
         }
 #endif // HAVE_LIBJACK
@@ -4655,6 +4678,11 @@ AlsaDriver::processEventsOut(const MappedEventList &rgEventList,
         }
     }
 
+#ifdef HAVE_LIBJACK
+    if (newQueue)
+        setAudioQueue(newQueue);
+#endif
+
     // Process Midi and Audio
     //
     processMidiOut(rgEventList, sliceStart, sliceEnd);
@@ -5374,13 +5402,54 @@ AlsaDriver::getStatusLog()
     return strtoqstr(AUDIT.str());
 }
 
+RealTime
+AlsaDriver::limitSleepTime(const RealTime &rt)
+{
+    // Note-offs for notes played while stopped (e.g. previews) are sent
+    // by processPending() rather than being queued in ALSA, so don't
+    // sleep past the first one.
+    if (m_playing  ||  m_noteOffQueue.empty())
+        return rt;
+
+    const RealTime untilNoteOff =
+            (*m_noteOffQueue.begin())->realTime - getAlsaTime();
+    if (untilNoteOff < RealTime::zeroTime)
+        return RealTime::zeroTime;
+    if (untilNoteOff < rt)
+        return untilNoteOff;
+    return rt;
+}
+
 void
 AlsaDriver::sleep(const RealTime &rt)
 {
     int npfd = snd_seq_poll_descriptors_count(m_midiHandle, POLLIN);
-    struct pollfd *pfd = (struct pollfd *)alloca(npfd * sizeof(struct pollfd));
+    struct pollfd *pfd =
+            (struct pollfd *)alloca((npfd + 1) * sizeof(struct pollfd));
     snd_seq_poll_descriptors(m_midiHandle, pfd, npfd, POLLIN);
+
+    if (m_wakeFd >= 0) {
+        pfd[npfd].fd = m_wakeFd;
+        pfd[npfd].events = POLLIN;
+        pfd[npfd].revents = 0;
+        ++npfd;
+    }
+
     poll(pfd, npfd, rt.sec * 1000 + rt.msec());
+
+    if (m_wakeFd >= 0) {
+        // Reset the counter.  Non-blocking, so this is harmless if
+        // nobody called wake().
+        eventfd_t value;
+        eventfd_read(m_wakeFd, &value);
+    }
+}
+
+void
+AlsaDriver::wake()
+{
+    if (m_wakeFd >= 0)
+        eventfd_write(m_wakeFd, 1);
 }
 
 void
@@ -5818,12 +5887,13 @@ AlsaDriver::cancelAudioFile(const MappedEvent *mE)
 {
     RG_DEBUG << "cancelAudioFile()";
 
-    if (!m_audioQueue)
+    const AudioPlayQueue *queue = m_audioQueue.loadAcquire();
+    if (!queue)
         return ;
 
     // For now we only permit cancelling unscheduled files.
 
-    const AudioPlayQueue::FileList &files = m_audioQueue->getAllUnscheduledFiles();
+    const AudioPlayQueue::FileList &files = queue->getAllUnscheduledFiles();
     for (AudioPlayQueue::FileList::const_iterator fi = files.begin();
             fi != files.end(); ++fi) {
         PlayableAudioFile *file = *fi;
@@ -5849,14 +5919,10 @@ AlsaDriver::clearAudioQueue()
 {
     RG_DEBUG << "clearAudioQueue()";
 
-    if (m_audioQueue->empty())
+    if (m_audioQueue.loadAcquire()->empty())
         return ;
 
-    AudioPlayQueue *newQueue = new AudioPlayQueue();
-    AudioPlayQueue *oldQueue = m_audioQueue;
-    m_audioQueue = newQueue;
-    if (oldQueue)
-        m_audioQueueScavenger.claim(oldQueue);
+    setAudioQueue(new AudioPlayQueue());
 }
 
 
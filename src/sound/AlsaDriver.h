@@ -347,7 +347,11 @@ public:
 
     void setLoop(const RealTime &loopStart, const RealTime &loopEnd) override;
 
+    /// Don't sleep past a note-off that processPending() has to send.
+    RealTime limitSleepTime(const RealTime &rt) override;
+    /// Waits on the ALSA sequencer and m_wakeFd.
     void sleep(const RealTime &) override;
+    void wake() override;
 
     // ----------------------- End of Virtuals ----------------------
 
@@ -594,6 +598,9 @@ private:
 
     bool                         m_haveShutdown;
 
+    /// eventfd that wake() writes to so that sleep()'s poll() returns.
+    int                          m_wakeFd;
+
     // Track System Exclusive Event across several ALSA messages
     // ALSA may break long system exclusive messages into chunks.
     typedef std::map<unsigned int,
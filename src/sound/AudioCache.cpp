@@ -18,11 +18,20 @@
 #include "AudioCache.h"
 #include "misc/Debug.h"
 
+#include <QMutexLocker>
+
 //#define DEBUG_AUDIO_CACHE 1
 
 namespace Rosegarden
 {
 
+AudioCache::AudioCache() :
+    m_memoryLimit(64 * 1024 * 1024),
+    m_bytes(0),
+    m_unreferencedBytes(0)
+{
+}
+
 AudioCache::~AudioCache()
 {
     clear();
@@ -31,55 +40,184 @@ AudioCache::~AudioCache()
 bool
 AudioCache::has(void *index)
 {
-    return m_cache.find(index) != m_cache.end();
+    QMutexLocker locker(&m_mutex);
+
+    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+    return i != m_cache.end()  &&  !i->second->removed;
 }
 
 float **
 AudioCache::getData(void *index, size_t &channels, size_t &frames)
 {
-    if (m_cache.find(index) == m_cache.end())
+    QMutexLocker locker(&m_mutex);
+
+    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+    if (i == m_cache.end())
         return nullptr;
-    CacheRec *rec = m_cache[index];
+    CacheRec *rec = i->second;
     channels = rec->channels;
     frames = rec->nframes;
     return rec->data;
 }
 
-void
+float **
+AudioCache::acquire(void *index, size_t &channels, size_t &frames)
+{
+    QMutexLocker locker(&m_mutex);
+
+    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+    if (i == m_cache.end()  ||  i->second->removed) {
+        ++m_statistics.misses;
+        return nullptr;
+    }
+    ++m_statistics.hits;
+
+    CacheRec *rec = i->second;
+    if (rec->refCount++ == 0) {
+        m_unreferenced.erase(rec->lruPosition);
+        m_unreferencedBytes -= rec->getBytes();
+    }
+
+#ifdef DEBUG_AUDIO_CACHE
+    RG_DEBUG << "AudioCache::acquire(" << index << ") [to " << rec->refCount << "]";
+#endif
+
+    channels = rec->channels;
+    frames = rec->nframes;
+    return rec->data;
+}
+
+bool
 AudioCache::addData(void *index, size_t channels, size_t nframes, float **data)
 {
 #ifdef DEBUG_AUDIO_CACHE
     RG_DEBUG << "AudioCache::addData(" << index << ")";
 #endif
 
-    if (m_cache.find(index) != m_cache.end()) {
+    QMutexLocker locker(&m_mutex);
+
+    return insert(index, channels, nframes, data, true);
+}
+
+bool
+AudioCache::addUnreferencedData(void *index, size_t channels, size_t nframes,
+                                float **data)
+{
+#ifdef DEBUG_AUDIO_CACHE
+    RG_DEBUG << "AudioCache::addUnreferencedData(" << index << ")";
+#endif
+
+    QMutexLocker locker(&m_mutex);
+
+    return insert(index, channels, nframes, data, false);
+}
+
+bool
+AudioCache::insert(void *index, size_t channels, size_t nframes, float **data,
+                   bool referenced)
+{
+    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+
+    // Out of date, but still in use.  Nothing new can go in its place
+    // until it has been released.
+    if (i != m_cache.end()  &&  i->second->removed) {
+        ++m_statistics.refusals;
+        return false;
+    }
+
+    if (i != m_cache.end()) {
         RG_WARNING << "WARNING: AudioCache::addData(" << index << ", "
         << channels << ", " << nframes
         << ": already cached";
-        return ;
+        return false;
     }
 
-    m_cache[index] = new CacheRec(data, channels, nframes);
+    const size_t bytes = channels * nframes * sizeof(float);
+
+    if (!makeRoom(bytes)) {
+#ifdef DEBUG_AUDIO_CACHE
+        RG_DEBUG << "AudioCache::addData(" << index << "): " << bytes << " bytes won't fit, " << m_bytes << " of " << m_memoryLimit << " in use";
+#endif
+        ++m_statistics.refusals;
+        return false;
+    }
+
+    CacheRec *rec = new CacheRec(data, channels, nframes);
+    m_cache[index] = rec;
+    m_bytes += bytes;
+
+    if (!referenced) {
+        rec->refCount = 0;
+        rec->lruPosition = m_unreferenced.insert(m_unreferenced.end(), index);
+        m_unreferencedBytes += bytes;
+    }
+
+    return true;
+}
+
+bool
+AudioCache::makeRoom(size_t bytes)
+{
+    // Don't throw anything out unless we can then fit.
+    if (bytes > m_memoryLimit ||
+        m_bytes - m_unreferencedBytes > m_memoryLimit - bytes)
+        return false;
+
+    while (m_bytes > m_memoryLimit - bytes) {
+        std::map<void *, CacheRec *>::iterator i =
+            m_cache.find(m_unreferenced.front());
+#ifdef DEBUG_AUDIO_CACHE
+        RG_DEBUG << "AudioCache::makeRoom(" << bytes << "): evicting " << i->first;
+#endif
+        erase(i);
+        ++m_statistics.evictions;
+    }
+
+    return true;
+}
+
+void
+AudioCache::erase(std::map<void *, CacheRec *>::iterator i)
+{
+    CacheRec *rec = i->second;
+    if (rec->refCount == 0) {
+        m_unreferenced.erase(rec->lruPosition);
+        m_unreferencedBytes -= rec->getBytes();
+    }
+    m_bytes -= rec->getBytes();
+    delete rec;
+    m_cache.erase(i);
 }
 
 void
 AudioCache::incrementReference(void *index)
 {
-    if (m_cache.find(index) == m_cache.end()) {
+    QMutexLocker locker(&m_mutex);
+
+    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+
+    if (i == m_cache.end()) {
         RG_WARNING << "WARNING: AudioCache::incrementReference(" << index
         << "): not found";
         return ;
     }
-    ++m_cache[index]->refCount;
+
+    CacheRec *rec = i->second;
+    if (rec->refCount++ == 0) {
+        m_unreferenced.erase(rec->lruPosition);
+        m_unreferencedBytes -= rec->getBytes();
+    }
 
 #ifdef DEBUG_AUDIO_CACHE
-    RG_DEBUG << "AudioCache::incrementReference(" << index << ") [to " << (m_cache[index]->refCount) << "]";
+    RG_DEBUG << "AudioCache::incrementReference(" << index << ") [to " << rec->refCount << "]";
 #endif
 }
 
 void
 AudioCache::decrementReference(void *index)
 {
+    QMutexLocker locker(&m_mutex);
+
     std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
 
     if (i == m_cache.end()) {
@@ -87,22 +225,114 @@ AudioCache::decrementReference(void *index)
         << "): not found";
         return ;
     }
-    if (i->second->refCount <= 1) {
-        delete i->second;
+
+    CacheRec *rec = i->second;
+
+    if (rec->refCount <= 0) {
+        RG_WARNING << "WARNING: AudioCache::decrementReference(" << index
+        << "): not referenced";
+        return ;
+    }
+
+    if (rec->refCount == 1 && rec->removed) {
+        rec->refCount = 0;
+        m_bytes -= rec->getBytes();
+        delete rec;
         m_cache.erase(i);
 #ifdef DEBUG_AUDIO_CACHE
         RG_DEBUG << "AudioCache::decrementReference(" << index << ") [deleting]";
 #endif
+        return ;
+    }
+
+    if (--rec->refCount == 0) {
+        // Most recently used, so last out.
+        rec->lruPosition = m_unreferenced.insert(m_unreferenced.end(), index);
+        m_unreferencedBytes += rec->getBytes();
+    }
 
-    } else {
-        --i->second->refCount;
 #ifdef DEBUG_AUDIO_CACHE
-        RG_DEBUG << "AudioCache::decrementReference(" << index << ") [to " << (m_cache[index]->refCount) << "]";
+    RG_DEBUG << "AudioCache::decrementReference(" << index << ") [to " << rec->refCount << "]";
 #endif
+}
+
+void
+AudioCache::remove(void *index)
+{
+    QMutexLocker locker(&m_mutex);
+
+    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+    if (i == m_cache.end())
+        return ;
+
+    if (i->second->refCount > 0) {
+        RG_WARNING << "WARNING: AudioCache::remove(" << index << "): still referenced, deleting when released";
+        i->second->removed = true;
+        return ;
+    }
+
+    erase(i);
+}
+
+void
+AudioCache::removeAll()
+{
+    QMutexLocker locker(&m_mutex);
 
+    std::map<void *, CacheRec *>::iterator i = m_cache.begin();
+    while (i != m_cache.end()) {
+        std::map<void *, CacheRec *>::iterator next = i;
+        ++next;
+        if (i->second->refCount > 0)
+            i->second->removed = true;
+        else
+            erase(i);
+        i = next;
     }
 }
 
+void
+AudioCache::purge()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_unreferenced.empty())
+        erase(m_cache.find(m_unreferenced.front()));
+}
+
+void
+AudioCache::setMemoryLimit(size_t bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_memoryLimit = bytes;
+
+    while (m_bytes > m_memoryLimit && !m_unreferenced.empty()) {
+        erase(m_cache.find(m_unreferenced.front()));
+        ++m_statistics.evictions;
+    }
+}
+
+AudioCache::Statistics
+AudioCache::getStatistics()
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics = m_statistics;
+    statistics.entries = m_cache.size();
+    statistics.bytes = m_bytes;
+    statistics.unreferencedBytes = m_unreferencedBytes;
+    return statistics;
+}
+
+void
+AudioCache::resetStatistics()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_statistics = Statistics();
+}
+
 void
 AudioCache::clear()
 {
@@ -110,13 +340,19 @@ AudioCache::clear()
     RG_DEBUG << "AudioCache::clear()";
 #endif
 
+    QMutexLocker locker(&m_mutex);
+
     for (std::map<void *, CacheRec *>::iterator i = m_cache.begin();
             i != m_cache.end(); ++i) {
         if (i->second->refCount > 0) {
             RG_WARNING << "WARNING: AudioCache::clear: deleting cached data with refCount " << i->second->refCount;
         }
+        delete i->second;
     }
     m_cache.clear();
+    m_unreferenced.clear();
+    m_bytes = 0;
+    m_unreferencedBytes = 0;
 }
 
 AudioCache::CacheRec::~CacheRec()
@@ -127,5 +363,3 @@ AudioCache::CacheRec::~CacheRec()
 }
 
 }
-
-
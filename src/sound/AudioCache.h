@@ -16,9 +16,14 @@
 #ifndef RG_AUDIO_CACHE_H
 #define RG_AUDIO_CACHE_H
 
+#include <QMutex>
+
+#include <list>
 #include <map>
 #include <stddef.h>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
@@ -26,17 +31,26 @@ namespace Rosegarden
  * A simple cache for smallish bits of audio data, indexed by some
  * opaque pointer type.  (The PlayableAudioFile uses this with an
  * AudioFile* index type, for example.)  With reference counting.
+ *
+ * Data nobody holds a reference to is kept, least recently used
+ * first out, for as long as the memory limit allows.  The limit
+ * covers all the data in the cache, referenced or not: data that
+ * would take the cache over it is refused rather than added.
+ *
+ * All the functions are thread safe, and all take a lock, so keep
+ * them out of the realtime threads.  The data itself stays put for as
+ * long as you hold a reference to it.
  */
 
-class AudioCache
+class ROSEGARDENPRIVATE_EXPORT AudioCache
 {
 public:
-    AudioCache() { }
+    AudioCache();
     virtual ~AudioCache();
 
     /**
      * Look some audio data up in the cache and report whether it
-     * exists.
+     * exists.  Removed data that is still referenced doesn't count.
      */
     bool has(void *index);
 
@@ -52,12 +66,31 @@ public:
      */
     float **getData(void *index, size_t &channels, size_t &frames);
 
+    /**
+     * Look some audio data up as getData does and, if it exists,
+     * increment its reference count.  Counts as a hit or a miss in
+     * the statistics.  Removed data that is still referenced is a
+     * miss.
+     */
+    float **acquire(void *index, size_t &channels, size_t &frames);
+
     /**
      * Add a piece of data to the cache, and increment the reference
      * count for that data (to 1).  Ownership of the data is passed
      * to the cache, which will delete it with delete[] when done.
+     *
+     * Returns false, leaving ownership with the caller, if the data
+     * is already cached or would take the cache over its limit.
      */
-    void addData(void *index, size_t channels, size_t nframes, float **data);
+    bool addData(void *index, size_t channels, size_t nframes, float **data);
+
+    /**
+     * Add a piece of data to the cache as addData does, but without
+     * a reference to it, as the most recently used of the data nobody
+     * holds.  For reading data in before anyone asks for it.
+     */
+    bool addUnreferencedData(void *index, size_t channels, size_t nframes,
+                             float **data);
 
     /**
      * Increment the reference count for a given piece of data.
@@ -65,27 +98,92 @@ public:
     void incrementReference(void *index);
 
     /**
-     * Decrement the reference count for a given piece of data,
-     * and delete the data from the cache if the reference count has
-     * reached zero.
+     * Decrement the reference count for a given piece of data.  Data
+     * whose count reaches zero stays in the cache until it is the
+     * least recently used and room is needed, or until it is
+     * removed.
      */
     void decrementReference(void *index);
 
+    /**
+     * Remove a piece of data, when whatever the index refers to is
+     * going away.  Data somebody still holds a reference to is
+     * deleted when the last reference goes.  Until then, acquire()
+     * misses it and addData() refuses anything new for the index.
+     */
+    void remove(void *index);
+
+    /**
+     * remove() everything, when all the data is out of date.
+     */
+    void removeAll();
+
+    /**
+     * Delete all the data nobody holds a reference to.
+     */
+    void purge();
+
+    /**
+     * The most bytes of sample data to hold at once.  Lowering it
+     * deletes unreferenced data at once to fit.
+     */
+    void setMemoryLimit(size_t bytes);
+    size_t getMemoryLimit() const { return m_memoryLimit; }
+
+    struct Statistics {
+        Statistics() :
+            hits(0), misses(0), evictions(0), refusals(0),
+            entries(0), bytes(0), unreferencedBytes(0) { }
+        size_t hits;                // acquire() found the data
+        size_t misses;              // acquire() didn't
+        size_t evictions;           // data deleted to make room
+        size_t refusals;            // data turned away as too big
+        size_t entries;
+        size_t bytes;
+        size_t unreferencedBytes;
+    };
+
+    Statistics getStatistics();
+    void resetStatistics();
+
 protected:
     void clear();
 
     struct CacheRec {
-        CacheRec() : data(nullptr), channels(0), nframes(0), refCount(0) { }
+        CacheRec() :
+            data(nullptr), channels(0), nframes(0), refCount(0),
+            removed(false) { }
         CacheRec(float **d, size_t c, size_t n) :
-            data(d), channels(c), nframes(n), refCount(1) { }
+            data(d), channels(c), nframes(n), refCount(1),
+            removed(false) { }
         ~CacheRec();
+        size_t getBytes() const { return channels * nframes * sizeof(float); }
         float **data;
         size_t channels;
         size_t nframes;
         int refCount;
+        bool removed;
+        // Place in m_unreferenced, when refCount is 0.
+        std::list<void *>::iterator lruPosition;
     };
 
+    bool insert(void *index, size_t channels, size_t nframes, float **data,
+                bool referenced);
+    void erase(std::map<void *, CacheRec *>::iterator i);
+    bool makeRoom(size_t bytes);
+
     std::map<void *, CacheRec *> m_cache;
+
+    // Indices of the data with no references, least recently used
+    // first.
+    std::list<void *> m_unreferenced;
+
+    size_t m_memoryLimit;
+    size_t m_bytes;
+    size_t m_unreferencedBytes;
+    Statistics m_statistics;
+
+    QMutex m_mutex;
 };
 
 }
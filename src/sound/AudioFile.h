@@ -15,6 +15,8 @@
 #ifndef RG_AUDIOFILE_H
 #define RG_AUDIOFILE_H
 
+#include <rosegardenprivate_export.h>
+
 #include <string>
 #include <vector>
 #include <cmath>
@@ -48,7 +50,7 @@ typedef enum
 
 } AudioFileType;
 
-class AudioFile : public SoundFile
+class ROSEGARDENPRIVATE_EXPORT AudioFile : public SoundFile
 {
 public:
     /// The "read" constructor - open a file
@@ -157,7 +159,7 @@ public:
 
     /// Offset to start of sample data
     ///
-    virtual std::streampos getDataOffset() = 0;
+    virtual std::streampos getDataOffset() const = 0;
 
     /// Return the peak file filename
     ///
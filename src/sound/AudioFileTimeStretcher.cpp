@@ -21,6 +21,7 @@
 
 #include "AudioTimeStretcher.h"
 #include "AudioFileManager.h"
+#include "AudioKernels.h"
 #include "WAVAudioFile.h"
 #include "base/RealTime.h"
 #include "misc/Debug.h"
@@ -218,14 +219,7 @@ AudioFileTimeStretcher::getStretchedAudioFile(AudioFileId source,
                 
             stretcher.getOutput(obfs, count);
                 
-            char *encodePointer = oebf;
-            for (unsigned int i = 0; i < count; ++i) {
-                for (int c = 0; c < ch; ++c) {
-                    float sample = obfs[c][i];
-                    *(float *)encodePointer = sample;
-                    encodePointer += sizeof(float);
-                }
-            }
+            AudioKernels::interleave(obfs, ch, count, (float *)oebf);
                 
             if (totalOut < expectedOut &&
                 totalOut + int(count) > expectedOut) {
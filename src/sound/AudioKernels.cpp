@@ -0,0 +1,704 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioKernels]"
+
+#include "AudioKernels.h"
+#include "misc/Debug.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// The SSE2 and AVX2 versions are compiled with target attributes, so
+// that the rest of the build needn't assume either, and picked at
+// runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RG_AUDIO_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+
+
+// ---------------------------------------------------------------------
+// Plain versions.  These are the reference for the others.
+
+// Exactly as RIFFAudioFile::convertBytesToSample().  The divisions are
+// by powers of two, so multiplying by the reciprocal is exact.
+
+inline float pcm8(const unsigned char *p)
+{
+    return float(int(p[0]) - 128) * (1.0f / 128.0f);
+}
+
+inline float pcm16(const unsigned char *p)
+{
+    return float(int16_t(uint16_t(p[0] | (p[1] << 8)))) * (1.0f / 32768.0f);
+}
+
+inline int32_t pcm24Bits(const unsigned char *p)
+{
+    // Shifted up 8 bits so as to get the sign bit in the right place.
+    return int32_t((uint32_t(p[0]) << 8) | (uint32_t(p[1]) << 16) |
+                   (uint32_t(p[2]) << 24));
+}
+
+inline float pcm24(const unsigned char *p)
+{
+    return float(pcm24Bits(p)) * (1.0f / 2147483648.0f);
+}
+
+inline float pcm32(const unsigned char *p)
+{
+    float f;
+    memcpy(&f, p, sizeof(float));
+    return f;
+}
+
+void addPCMScalarFrom(const unsigned char *source, int bitsPerSample,
+                      size_t stride, float *target, size_t i, size_t count)
+{
+    const size_t step = stride * size_t(bitsPerSample / 8);
+    const unsigned char *p = source + i * step;
+
+    switch (bitsPerSample) {
+    case 8:
+        for (; i < count; ++i, p += step) target[i] += pcm8(p);
+        break;
+    case 16:
+        for (; i < count; ++i, p += step) target[i] += pcm16(p);
+        break;
+    case 24:
+        for (; i < count; ++i, p += step) target[i] += pcm24(p);
+        break;
+    case 32:
+        for (; i < count; ++i, p += step) target[i] += pcm32(p);
+        break;
+    default:
+        break;
+    }
+}
+
+void addPCMScalar(const unsigned char *source, int bitsPerSample,
+                  size_t stride, float *target, size_t count)
+{
+    addPCMScalarFrom(source, bitsPerSample, stride, target, 0, count);
+}
+
+void interleaveScalarFrom(const float *const *source, size_t channels,
+                          size_t frames, float *target, size_t i)
+{
+    for (; i < frames; ++i) {
+        for (size_t ch = 0; ch < channels; ++ch) {
+            target[i * channels + ch] = source[ch][i];
+        }
+    }
+}
+
+void interleaveScalar(const float *const *source, size_t channels,
+                      size_t frames, float *target)
+{
+    interleaveScalarFrom(source, channels, frames, target, 0);
+}
+
+void deinterleaveScalarFrom(const float *source, size_t channels,
+                            size_t frames, float *const *target, size_t i)
+{
+    for (; i < frames; ++i) {
+        for (size_t ch = 0; ch < channels; ++ch) {
+            target[ch][i] = source[i * channels + ch];
+        }
+    }
+}
+
+void deinterleaveScalar(const float *source, size_t channels,
+                        size_t frames, float *const *target)
+{
+    deinterleaveScalarFrom(source, channels, frames, target, 0);
+}
+
+void addScalar(float *target, const float *source, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) target[i] += source[i];
+}
+
+void applyGainScalar(float *buffer, size_t count, float gain)
+{
+    for (size_t i = 0; i < count; ++i) buffer[i] *= gain;
+}
+
+void copyWithGainScalar(float *target, const float *source,
+                        size_t count, float gain)
+{
+    for (size_t i = 0; i < count; ++i) target[i] = source[i] * gain;
+}
+
+bool isSilentScalar(const float *buffer, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (buffer[i] != 0.0f) return false;
+    }
+    return true;
+}
+
+void fadeInScalar(float *buffer, size_t count, float length)
+{
+    for (size_t i = 0; i < count; ++i) {
+        buffer[i] *= float(i + 1) / length;
+    }
+}
+
+void fadeOutScalar(float *buffer, size_t count, float length)
+{
+    for (size_t i = 0; i < count; ++i) {
+        buffer[i] *= float(count - i) / length;
+    }
+}
+
+const AudioKernels::Functions scalarFunctions = {
+    addPCMScalar,
+    interleaveScalar,
+    deinterleaveScalar,
+    addScalar,
+    applyGainScalar,
+    copyWithGainScalar,
+    isSilentScalar,
+    fadeInScalar,
+    fadeOutScalar
+};
+
+
+#ifdef RG_AUDIO_KERNELS_X86
+
+// ---------------------------------------------------------------------
+// SSE2, four samples at a time.
+//
+// Loops that read a sample's bytes as a wider integer than the sample
+// stop one sample short of the end, so as not to read past it, and
+// leave the rest to the plain version.
+
+#define RG_SSE2 __attribute__((target("sse2")))
+
+RG_SSE2 inline int32_t load32(const unsigned char *p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+RG_SSE2 inline void addScaledSSE2(float *target, __m128i samples, __m128 scale)
+{
+    const __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(samples), scale);
+    _mm_storeu_ps(target, _mm_add_ps(_mm_loadu_ps(target), f));
+}
+
+RG_SSE2 void addPCMSSE2(const unsigned char *source, int bitsPerSample,
+                        size_t stride, float *target, size_t count)
+{
+    size_t i = 0;
+
+    if (bitsPerSample == 16) {
+
+        const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+
+        if (stride == 1) {
+            for (; i + 8 <= count; i += 8) {
+                const __m128i s =
+                    _mm_loadu_si128((const __m128i *)(source + i * 2));
+                // Each 16-bit sample into the top half of a 32-bit
+                // lane, then shift down with sign extension.
+                addScaledSSE2(target + i,
+                              _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16),
+                              scale);
+                addScaledSSE2(target + i + 4,
+                              _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16),
+                              scale);
+            }
+        } else if (stride == 2) {
+            for (; i + 4 < count; i += 4) {
+                // Our samples are the low halves of each 32-bit lane.
+                const __m128i s =
+                    _mm_loadu_si128((const __m128i *)(source + i * 4));
+                addScaledSSE2(target + i,
+                              _mm_srai_epi32(_mm_slli_epi32(s, 16), 16),
+                              scale);
+            }
+        } else {
+            const size_t step = stride * 2;
+            for (; i + 4 < count; i += 4) {
+                const unsigned char *p = source + i * step;
+                const __m128i s = _mm_set_epi32(
+                        load32(p + 3 * step), load32(p + 2 * step),
+                        load32(p + step), load32(p));
+                addScaledSSE2(target + i,
+                              _mm_srai_epi32(_mm_slli_epi32(s, 16), 16),
+                              scale);
+            }
+        }
+
+    } else if (bitsPerSample == 24) {
+
+        const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+        const size_t step = stride * 3;
+
+        for (; i + 4 < count; i += 4) {
+            const unsigned char *p = source + i * step;
+            const __m128i s = _mm_set_epi32(
+                    load32(p + 3 * step), load32(p + 2 * step),
+                    load32(p + step), load32(p));
+            addScaledSSE2(target + i, _mm_slli_epi32(s, 8), scale);
+        }
+
+    } else if (bitsPerSample == 32) {
+
+        const float *f = (const float *)source;
+
+        if (stride == 1) {
+            for (; i + 4 <= count; i += 4) {
+                _mm_storeu_ps(target + i,
+                              _mm_add_ps(_mm_loadu_ps(target + i),
+                                         _mm_loadu_ps(f + i)));
+            }
+        } else if (stride == 2) {
+            for (; i + 4 <= count; i += 4) {
+                const __m128 a = _mm_loadu_ps(f + i * 2);
+                const __m128 b = _mm_loadu_ps(f + i * 2 + 4);
+                _mm_storeu_ps(target + i,
+                              _mm_add_ps(_mm_loadu_ps(target + i),
+                                         _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+            }
+        }
+    }
+
+    addPCMScalarFrom(source, bitsPerSample, stride, target, i, count);
+}
+
+RG_SSE2 void interleaveSSE2(const float *const *source, size_t channels,
+                            size_t frames, float *target)
+{
+    size_t i = 0;
+
+    if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            const __m128 l = _mm_loadu_ps(source[0] + i);
+            const __m128 r = _mm_loadu_ps(source[1] + i);
+            _mm_storeu_ps(target + i * 2, _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(target + i * 2 + 4, _mm_unpackhi_ps(l, r));
+        }
+    }
+
+    interleaveScalarFrom(source, channels, frames, target, i);
+}
+
+RG_SSE2 void deinterleaveSSE2(const float *source, size_t channels,
+                              size_t frames, float *const *target)
+{
+    size_t i = 0;
+
+    if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            const __m128 a = _mm_loadu_ps(source + i * 2);
+            const __m128 b = _mm_loadu_ps(source + i * 2 + 4);
+            _mm_storeu_ps(target[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(target[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+
+    deinterleaveScalarFrom(source, channels, frames, target, i);
+}
+
+RG_SSE2 void addSSE2(float *target, const float *source, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(target + i, _mm_add_ps(_mm_loadu_ps(target + i),
+                                             _mm_loadu_ps(source + i)));
+    }
+    for (; i < count; ++i) target[i] += source[i];
+}
+
+RG_SSE2 void applyGainSSE2(float *buffer, size_t count, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), g));
+    }
+    for (; i < count; ++i) buffer[i] *= gain;
+}
+
+RG_SSE2 void copyWithGainSSE2(float *target, const float *source,
+                              size_t count, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(target + i, _mm_mul_ps(_mm_loadu_ps(source + i), g));
+    }
+    for (; i < count; ++i) target[i] = source[i] * gain;
+}
+
+RG_SSE2 bool isSilentSSE2(const float *buffer, size_t count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        // Not-equal is true for NaN, as with the plain version.
+        if (_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(buffer + i), zero)))
+            return false;
+    }
+    for (; i < count; ++i) {
+        if (buffer[i] != 0.0f) return false;
+    }
+    return true;
+}
+
+// The fades count samples in floats, which is exact up to 2^24.
+
+RG_SSE2 void fadeInSSE2(float *buffer, size_t count, float length)
+{
+    const __m128 len = _mm_set1_ps(length);
+    const __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 n = _mm_add_ps(_mm_set1_ps(float(i + 1)), offsets);
+        _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i),
+                                             _mm_div_ps(n, len)));
+    }
+    for (; i < count; ++i) buffer[i] *= float(i + 1) / length;
+}
+
+RG_SSE2 void fadeOutSSE2(float *buffer, size_t count, float length)
+{
+    const __m128 len = _mm_set1_ps(length);
+    const __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 n = _mm_sub_ps(_mm_set1_ps(float(count - i)), offsets);
+        _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i),
+                                             _mm_div_ps(n, len)));
+    }
+    for (; i < count; ++i) buffer[i] *= float(count - i) / length;
+}
+
+const AudioKernels::Functions sse2Functions = {
+    addPCMSSE2,
+    interleaveSSE2,
+    deinterleaveSSE2,
+    addSSE2,
+    applyGainSSE2,
+    copyWithGainSSE2,
+    isSilentSSE2,
+    fadeInSSE2,
+    fadeOutSSE2
+};
+
+
+// ---------------------------------------------------------------------
+// AVX2, eight samples at a time, with the same care not to read past
+// the last sample.
+
+#define RG_AVX2 __attribute__((target("avx2")))
+
+RG_AVX2 inline void addScaledAVX2(float *target, __m256i samples, __m256 scale)
+{
+    const __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale);
+    _mm256_storeu_ps(target, _mm256_add_ps(_mm256_loadu_ps(target), f));
+}
+
+/// Eight 32-bit loads, step bytes apart.  Gathers are slower than
+/// this on most CPUs.
+RG_AVX2 inline __m256i load8AVX2(const unsigned char *p, size_t step)
+{
+    return _mm256_setr_epi32(
+            load32(p), load32(p + step),
+            load32(p + 2 * step), load32(p + 3 * step),
+            load32(p + 4 * step), load32(p + 5 * step),
+            load32(p + 6 * step), load32(p + 7 * step));
+}
+
+RG_AVX2 void addPCMAVX2(const unsigned char *source, int bitsPerSample,
+                        size_t stride, float *target, size_t count)
+{
+    size_t i = 0;
+
+    if (bitsPerSample == 16) {
+
+        const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+
+        if (stride == 1) {
+            for (; i + 8 <= count; i += 8) {
+                const __m128i s =
+                    _mm_loadu_si128((const __m128i *)(source + i * 2));
+                addScaledAVX2(target + i, _mm256_cvtepi16_epi32(s), scale);
+            }
+        } else {
+            const size_t step = stride * 2;
+            for (; i + 8 < count; i += 8) {
+                const __m256i s = load8AVX2(source + i * step, step);
+                addScaledAVX2(target + i,
+                              _mm256_srai_epi32(_mm256_slli_epi32(s, 16), 16),
+                              scale);
+            }
+        }
+
+    } else if (bitsPerSample == 24) {
+
+        const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+        const size_t step = stride * 3;
+
+        for (; i + 8 < count; i += 8) {
+            const __m256i s = load8AVX2(source + i * step, step);
+            addScaledAVX2(target + i, _mm256_slli_epi32(s, 8), scale);
+        }
+
+    } else if (bitsPerSample == 32) {
+
+        const float *f = (const float *)source;
+
+        if (stride == 1) {
+            for (; i + 8 <= count; i += 8) {
+                _mm256_storeu_ps(target + i,
+                                 _mm256_add_ps(_mm256_loadu_ps(target + i),
+                                               _mm256_loadu_ps(f + i)));
+            }
+        } else {
+            const size_t step = stride * 4;
+            for (; i + 8 <= count; i += 8) {
+                const __m256 s = _mm256_castsi256_ps(
+                        load8AVX2(source + i * step, step));
+                _mm256_storeu_ps(target + i,
+                                 _mm256_add_ps(_mm256_loadu_ps(target + i), s));
+            }
+        }
+    }
+
+    addPCMScalarFrom(source, bitsPerSample, stride, target, i, count);
+}
+
+RG_AVX2 void interleaveAVX2(const float *const *source, size_t channels,
+                            size_t frames, float *target)
+{
+    size_t i = 0;
+
+    if (channels == 2) {
+        for (; i + 8 <= frames; i += 8) {
+            const __m256 l = _mm256_loadu_ps(source[0] + i);
+            const __m256 r = _mm256_loadu_ps(source[1] + i);
+            // Unpacking works within each 128-bit half, so the halves
+            // then need putting in order.
+            const __m256 lo = _mm256_unpacklo_ps(l, r);
+            const __m256 hi = _mm256_unpackhi_ps(l, r);
+            _mm256_storeu_ps(target + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(target + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+    }
+
+    interleaveScalarFrom(source, channels, frames, target, i);
+}
+
+RG_AVX2 void deinterleaveAVX2(const float *source, size_t channels,
+                              size_t frames, float *const *target)
+{
+    size_t i = 0;
+
+    if (channels == 2) {
+        const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+        for (; i + 8 <= frames; i += 8) {
+            const __m256 a = _mm256_loadu_ps(source + i * 2);
+            const __m256 b = _mm256_loadu_ps(source + i * 2 + 8);
+            // Shuffling works within each 128-bit half too.
+            const __m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm256_storeu_ps(target[0] + i, _mm256_permutevar8x32_ps(l, order));
+            _mm256_storeu_ps(target[1] + i, _mm256_permutevar8x32_ps(r, order));
+        }
+    }
+
+    deinterleaveScalarFrom(source, channels, frames, target, i);
+}
+
+RG_AVX2 void addAVX2(float *target, const float *source, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(target + i, _mm256_add_ps(_mm256_loadu_ps(target + i),
+                                                   _mm256_loadu_ps(source + i)));
+    }
+    for (; i < count; ++i) target[i] += source[i];
+}
+
+RG_AVX2 void applyGainAVX2(float *buffer, size_t count, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(buffer + i, _mm256_mul_ps(_mm256_loadu_ps(buffer + i), g));
+    }
+    for (; i < count; ++i) buffer[i] *= gain;
+}
+
+RG_AVX2 void copyWithGainAVX2(float *target, const float *source,
+                              size_t count, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(target + i, _mm256_mul_ps(_mm256_loadu_ps(source + i), g));
+    }
+    for (; i < count; ++i) target[i] = source[i] * gain;
+}
+
+RG_AVX2 bool isSilentAVX2(const float *buffer, size_t count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 ne = _mm256_cmp_ps(_mm256_loadu_ps(buffer + i), zero,
+                                        _CMP_NEQ_UQ);
+        if (_mm256_movemask_ps(ne))
+            return false;
+    }
+    for (; i < count; ++i) {
+        if (buffer[i] != 0.0f) return false;
+    }
+    return true;
+}
+
+RG_AVX2 void fadeInAVX2(float *buffer, size_t count, float length)
+{
+    const __m256 len = _mm256_set1_ps(length);
+    const __m256 offsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 n = _mm256_add_ps(_mm256_set1_ps(float(i + 1)), offsets);
+        _mm256_storeu_ps(buffer + i, _mm256_mul_ps(_mm256_loadu_ps(buffer + i),
+                                                   _mm256_div_ps(n, len)));
+    }
+    for (; i < count; ++i) buffer[i] *= float(i + 1) / length;
+}
+
+RG_AVX2 void fadeOutAVX2(float *buffer, size_t count, float length)
+{
+    const __m256 len = _mm256_set1_ps(length);
+    const __m256 offsets = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 n = _mm256_sub_ps(_mm256_set1_ps(float(count - i)), offsets);
+        _mm256_storeu_ps(buffer + i, _mm256_mul_ps(_mm256_loadu_ps(buffer + i),
+                                                   _mm256_div_ps(n, len)));
+    }
+    for (; i < count; ++i) buffer[i] *= float(count - i) / length;
+}
+
+const AudioKernels::Functions avx2Functions = {
+    addPCMAVX2,
+    interleaveAVX2,
+    deinterleaveAVX2,
+    addAVX2,
+    applyGainAVX2,
+    copyWithGainAVX2,
+    isSilentAVX2,
+    fadeInAVX2,
+    fadeOutAVX2
+};
+
+#endif // RG_AUDIO_KERNELS_X86
+
+
+const AudioKernels::Functions *functionsFor(AudioKernels::InstructionSet set)
+{
+    switch (set) {
+#ifdef RG_AUDIO_KERNELS_X86
+    case AudioKernels::AVX2:
+        return &avx2Functions;
+    case AudioKernels::SSE2:
+        return &sse2Functions;
+#else
+    case AudioKernels::AVX2:
+    case AudioKernels::SSE2:
+#endif
+    case AudioKernels::Scalar:
+    default:
+        return &scalarFunctions;
+    }
+}
+
+// Switches to the best supported set once the program starts.  Until
+// then (during static initialisation) the plain versions are used.
+struct Selector
+{
+    Selector()
+    {
+        if (AudioKernels::isSupported(AudioKernels::AVX2)) {
+            AudioKernels::setInstructionSet(AudioKernels::AVX2);
+        } else if (AudioKernels::isSupported(AudioKernels::SSE2)) {
+            AudioKernels::setInstructionSet(AudioKernels::SSE2);
+        }
+    }
+} selector;
+
+
+}
+
+
+const AudioKernels::Functions *AudioKernels::m_functions = &scalarFunctions;
+AudioKernels::InstructionSet AudioKernels::m_instructionSet = AudioKernels::Scalar;
+
+bool
+AudioKernels::isSupported(InstructionSet set)
+{
+    switch (set) {
+    case Scalar:
+        return true;
+#ifdef RG_AUDIO_KERNELS_X86
+    case SSE2:
+        return __builtin_cpu_supports("sse2");
+    case AVX2:
+        return __builtin_cpu_supports("avx2");
+#else
+    case SSE2:
+    case AVX2:
+#endif
+    default:
+        return false;
+    }
+}
+
+AudioKernels::InstructionSet
+AudioKernels::getInstructionSet()
+{
+    return m_instructionSet;
+}
+
+bool
+AudioKernels::setInstructionSet(InstructionSet set)
+{
+    if (!isSupported(set))
+        return false;
+
+    m_functions = functionsFor(set);
+    m_instructionSet = set;
+
+    return true;
+}
+
+
+}
@@ -0,0 +1,126 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIO_KERNELS_H
+#define RG_AUDIO_KERNELS_H
+
+#include <rosegardenprivate_export.h>
+
+#include <stddef.h>
+
+namespace Rosegarden
+{
+
+
+/// Sample conversion and mixing loops for the audio threads.
+/**
+ * Each function has a plain C++ version and, on x86, SSE2 and AVX2
+ * versions.  The best one the CPU supports is picked at startup.  The
+ * vector versions give bit-for-bit the same results as the plain ones:
+ * they do the same float operations in the same order for each sample,
+ * just several samples at a time.
+ *
+ * All are realtime safe.
+ */
+class ROSEGARDENPRIVATE_EXPORT AudioKernels
+{
+public:
+    enum InstructionSet {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /// Whether this build and this CPU can use the given set.
+    static bool isSupported(InstructionSet set);
+
+    static InstructionSet getInstructionSet();
+
+    /// Use the given set from now on, if supported.  For testing.
+    /**
+     * Not thread safe: don't call it with the audio threads running.
+     */
+    static bool setInstructionSet(InstructionSet set);
+
+    /// Convert little-endian PCM samples to float and add them to target.
+    /**
+     * bitsPerSample is 8 (unsigned), 16 or 24 (signed), or 32 (IEEE
+     * float), scaled as RIFFAudioFile::convertBytesToSample() does.
+     * The samples are stride samples apart, so pass the address of a
+     * channel's first sample and the channel count to deinterleave
+     * one channel of a WAV file.
+     */
+    static void addPCM(const unsigned char *source, int bitsPerSample,
+                       size_t stride, float *target, size_t count)
+        { m_functions->addPCM(source, bitsPerSample, stride, target, count); }
+
+    /// target[frame * channels + ch] = source[ch][frame]
+    static void interleave(const float *const *source, size_t channels,
+                           size_t frames, float *target)
+        { m_functions->interleave(source, channels, frames, target); }
+
+    /// target[ch][frame] = source[frame * channels + ch]
+    static void deinterleave(const float *source, size_t channels,
+                             size_t frames, float *const *target)
+        { m_functions->deinterleave(source, channels, frames, target); }
+
+    /// target[i] += source[i]
+    static void add(float *target, const float *source, size_t count)
+        { m_functions->add(target, source, count); }
+
+    /// buffer[i] *= gain
+    static void applyGain(float *buffer, size_t count, float gain)
+        { m_functions->applyGain(buffer, count, gain); }
+
+    /// target[i] = source[i] * gain
+    static void copyWithGain(float *target, const float *source,
+                             size_t count, float gain)
+        { m_functions->copyWithGain(target, source, count, gain); }
+
+    /// Whether every sample is zero.
+    static bool isSilent(const float *buffer, size_t count)
+        { return m_functions->isSilent(buffer, count); }
+
+    /// buffer[i] *= (i + 1) / length
+    static void fadeIn(float *buffer, size_t count, float length)
+        { m_functions->fadeIn(buffer, count, length); }
+
+    /// buffer[i] *= (count - i) / length
+    static void fadeOut(float *buffer, size_t count, float length)
+        { m_functions->fadeOut(buffer, count, length); }
+
+    /// One implementation of each of the above.
+    struct Functions
+    {
+        void (*addPCM)(const unsigned char *, int, size_t, float *, size_t);
+        void (*interleave)(const float *const *, size_t, size_t, float *);
+        void (*deinterleave)(const float *, size_t, size_t, float *const *);
+        void (*add)(float *, const float *, size_t);
+        void (*applyGain)(float *, size_t, float);
+        void (*copyWithGain)(float *, const float *, size_t, float);
+        bool (*isSilent)(const float *, size_t);
+        void (*fadeIn)(float *, size_t, float);
+        void (*fadeOut)(float *, size_t, float);
+    };
+
+private:
+    static const Functions *m_functions;
+    static InstructionSet m_instructionSet;
+};
+
+
+}
+
+#endif
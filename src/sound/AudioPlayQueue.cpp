@@ -21,6 +21,8 @@
 #include "PlayableAudioFile.h"
 #include "base/Profiler.h"
 
+#include <algorithm>
+
 //#define DEBUG_AUDIO_PLAY_QUEUE 1
 //#define FINE_DEBUG_AUDIO_PLAY_QUEUE 1
 
@@ -58,11 +60,26 @@ AudioPlayQueue::FileTimeCmp::operator()(const PlayableAudioFile *f1,
 
 
 AudioPlayQueue::AudioPlayQueue() :
-        m_maxBuffers(0)
+        m_indexStale(false),
+        m_maxBuffers(0),
+        m_ownsFiles(true)
 {
     // nothing to do
 }
 
+AudioPlayQueue::AudioPlayQueue(AudioPlayQueue &previous) :
+        m_files(previous.m_files),
+        m_index(previous.m_index),
+        m_instrumentIndex(previous.m_instrumentIndex),
+        m_indexStale(previous.m_indexStale),
+        m_unscheduled(previous.m_unscheduled),
+        m_counts(previous.m_counts),
+        m_maxBuffers(previous.m_maxBuffers),
+        m_ownsFiles(previous.m_ownsFiles)
+{
+    previous.m_ownsFiles = false;
+}
+
 AudioPlayQueue::~AudioPlayQueue()
 {
     RG_DEBUG << "dtor";
@@ -79,34 +96,24 @@ AudioPlayQueue::addScheduled(PlayableAudioFile *file)
     }
 
     m_files.insert(file);
+    m_indexStale = true;
 
-    RealTime startTime = file->getStartTime();
-    RealTime endTime = file->getStartTime() + file->getDuration();
+#ifdef DEBUG_AUDIO_PLAY_QUEUE
+    RG_DEBUG << "[" << this << "]::addScheduled(" << file << "): start " << file->getStartTime() << ", end " << file->getEndTime();
+#endif
 
-    InstrumentId instrument = file->getInstrument();
-    unsigned int index = instrumentId2Index(instrument);
+    if (file->isSmallFile())
+        return;
 
-    while ((unsigned int)m_instrumentIndex.size() <= index) {
-        m_instrumentIndex.push_back(ReverseFileMap());
-    }
+    // Count the ring buffers needed in each second the file touches.
 
-#ifdef DEBUG_AUDIO_PLAY_QUEUE
-    RG_DEBUG << "[" << this << "]::addScheduled(" << file << "): start " << file->getStartTime() << ", end " << file->getEndTime() << ", slots: ";
-#endif
+    const RealTime endTime = file->getEndTime();
 
-    for (int i = startTime.sec; i <= endTime.sec; ++i) {
-        m_index[i].push_back(file);
-        m_instrumentIndex[index][i].push_back(file);
-        if (!file->isSmallFile()) {
-            m_counts[i] += file->getTargetChannels();
-            if (m_counts[i] > m_maxBuffers) {
-                m_maxBuffers = m_counts[i];
-            }
+    for (int i = file->getStartTime().sec; i <= endTime.sec; ++i) {
+        m_counts[i] += file->getTargetChannels();
+        if (m_counts[i] > m_maxBuffers) {
+            m_maxBuffers = m_counts[i];
         }
-#ifdef DEBUG_AUDIO_PLAY_QUEUE
-        RG_DEBUG << "  " << i;
-#endif
-
     }
 
 #ifdef DEBUG_AUDIO_PLAY_QUEUE
@@ -142,71 +149,156 @@ AudioPlayQueue::erase(PlayableAudioFile *file)
                 fli != m_unscheduled.end(); ++fli) {
             if (*fli == file) {
                 m_unscheduled.erase(fli);
-                delete file;
+                if (m_ownsFiles)
+                    delete file;
                 return ;
             }
         }
         return ;
     }
     m_files.erase(fi);
+    m_indexStale = true;
 
-    InstrumentId instrument = file->getInstrument();
-    unsigned int index = instrumentId2Index(instrument);
+    if (!file->isSmallFile()) {
+        const RealTime endTime = file->getEndTime();
+        for (int i = file->getStartTime().sec; i <= endTime.sec; ++i) {
+            size_t &count = m_counts[i];
+            count -= std::min(count, size_t(file->getTargetChannels()));
+        }
+    }
 
-    for (ReverseFileMap::iterator mi = m_instrumentIndex[index].begin();
-            mi != m_instrumentIndex[index].end(); ++mi) {
+    if (m_ownsFiles)
+        delete file;
+}
 
-        for (FileVector::iterator fi = mi->second.begin();
-                fi != mi->second.end(); ++fi) {
+void
+AudioPlayQueue::clear()
+{
+#ifdef DEBUG_AUDIO_PLAY_QUEUE
+    RG_DEBUG << "clear()";
+#endif
 
-            if (*fi == file) {
-                mi->second.erase(fi);
-                if (m_counts[mi->first] > 0)
-                    --m_counts[mi->first];
-                break;
-            }
+    if (m_ownsFiles) {
+        for (FileSet::iterator fi = m_files.begin();
+                fi != m_files.end(); ++fi) {
+            delete *fi;
+        }
+        for (FileList::iterator fli = m_unscheduled.begin();
+                fli != m_unscheduled.end(); ++fli) {
+            delete *fli;
         }
     }
 
-    for (ReverseFileMap::iterator mi = m_index.begin();
-            mi != m_index.end(); ++mi) {
+    m_files.clear();
+    m_unscheduled.clear();
 
-        for (FileVector::iterator fi = mi->second.begin();
-                fi != mi->second.end(); ++fi) {
+    m_instrumentIndex.clear();
+    m_index.intervals.clear();
+    m_index.maxEnd.clear();
+    m_indexStale = false;
+    m_counts.clear();
+    m_maxBuffers = 0;
+}
 
-            if (*fi == file) {
-                mi->second.erase(fi);
-                if (m_counts[mi->first] > 0)
-                    --m_counts[mi->first];
-                break;
-            }
+void
+AudioPlayQueue::buildIndex()
+{
+    if (!m_indexStale)
+        return;
+
+    m_index.intervals.clear();
+    m_instrumentIndex.clear();
+
+    // m_files is already in order of start time.
+    for (FileSet::const_iterator fi = m_files.begin();
+            fi != m_files.end(); ++fi) {
+
+        PlayableAudioFile *file = *fi;
+
+        Interval interval;
+        interval.start = file->getStartTime();
+        interval.end = file->getEndTime();
+        interval.file = file;
+
+        m_index.intervals.push_back(interval);
+
+        unsigned int index = instrumentId2Index(file->getInstrument());
+        if ((unsigned int)m_instrumentIndex.size() <= index) {
+            m_instrumentIndex.resize(index + 1);
         }
+        m_instrumentIndex[index].intervals.push_back(interval);
+    }
+
+    m_index.build();
+    for (size_t i = 0; i < m_instrumentIndex.size(); ++i) {
+        m_instrumentIndex[i].build();
     }
 
-    delete file;
+    m_indexStale = false;
+
+#ifdef DEBUG_AUDIO_PLAY_QUEUE
+    RG_DEBUG << "[" << this << "]::buildIndex(): " << m_index.intervals.size() << " files on " << m_instrumentIndex.size() << " instrument slots";
+#endif
 }
 
 void
-AudioPlayQueue::clear()
+AudioPlayQueue::IntervalIndex::build()
 {
-#ifdef DEBUG_AUDIO_PLAY_QUEUE
-    RG_DEBUG << "clear()";
-#endif
+    maxEnd.resize(intervals.size());
+    if (!intervals.empty())
+        build(0, intervals.size());
+}
 
-    while (m_files.begin() != m_files.end()) {
-        delete *m_files.begin();
-        m_files.erase(m_files.begin());
-    }
+RealTime
+AudioPlayQueue::IntervalIndex::build(size_t begin, size_t end)
+{
+    // The same split as find() makes.
+    const size_t root = begin + (end - begin) / 2;
+
+    RealTime latest = intervals[root].end;
+    if (begin < root)
+        latest = std::max(latest, build(begin, root));
+    if (root + 1 < end)
+        latest = std::max(latest, build(root + 1, end));
+
+    maxEnd[root] = latest;
+    return latest;
+}
+
+template <typename Visitor>
+bool
+AudioPlayQueue::IntervalIndex::find(size_t begin, size_t end,
+                                    const RealTime &sliceStart,
+                                    const RealTime &sliceEnd,
+                                    Visitor &visit) const
+{
+    // Needs to be RT safe.  Recurses into the earlier half of each
+    // range and loops over the later, so the depth is the log of the
+    // number of files.
+
+    while (begin < end) {
 
-    while (m_unscheduled.begin() != m_unscheduled.end()) {
-        delete *m_unscheduled.begin();
-        m_unscheduled.erase(m_unscheduled.begin());
+        const size_t root = begin + (end - begin) / 2;
+
+        // Everything in this range has ended by the start of the slice.
+        if (maxEnd[root] <= sliceStart)
+            return true;
+
+        if (!find(begin, root, sliceStart, sliceEnd, visit))
+            return false;
+
+        // This and everything after it starts after the end of the slice.
+        const Interval &interval = intervals[root];
+        if (interval.start > sliceEnd)
+            return true;
+
+        if (interval.end > sliceStart  &&  !visit(interval.file))
+            return false;
+
+        begin = root + 1;
     }
 
-    m_instrumentIndex.clear();
-    m_index.clear();
-    m_counts.clear();
-    m_maxBuffers = 0;
+    return true;
 }
 
 bool
@@ -234,28 +326,15 @@ AudioPlayQueue::getPlayingFiles(const RealTime &sliceStart,
 
     RealTime sliceEnd = sliceStart + sliceDuration;
 
-    for (int i = sliceStart.sec; i <= sliceEnd.sec; ++i) {
-
-        ReverseFileMap::const_iterator mi(m_index.find(i));
-        if (mi == m_index.end())
-            continue;
-
-        for (FileVector::const_iterator fi = mi->second.begin();
-                fi != mi->second.end(); ++fi) {
-
-            PlayableAudioFile *f = *fi;
-
-            if (f->getStartTime() > sliceEnd ||
-                    f->getStartTime() + f->getDuration() <= sliceStart)
-                continue;
-
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-            RG_DEBUG << "getPlayingFiles(): found " << f << " in slot " << i;
-#endif
-
-            playing.insert(f);
+    struct Inserter {
+        FileSet &playing;
+        bool operator()(PlayableAudioFile *file) {
+            playing.insert(file);
+            return true;
         }
-    }
+    } inserter = { playing };
+
+    m_index.find(0, m_index.intervals.size(), sliceStart, sliceEnd, inserter);
 
     for (FileList::const_iterator fli = m_unscheduled.begin();
             fli != m_unscheduled.end(); ++fli) {
@@ -281,104 +360,39 @@ AudioPlayQueue::getPlayingFilesForInstrument(const RealTime &sliceStart,
         size_t &size) const
 {
 #ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-    bool printed = false;
     Profiler profiler("AudioPlayQueue::getPlayingFilesForInstrument", true);
 #endif
 
     // This one needs to be quick.
 
-    size_t written = 0;
-
     RealTime sliceEnd = sliceStart + sliceDuration;
 
-    unsigned int index = instrumentId2Index(instrumentId);
-    if (index >= (unsigned int)m_instrumentIndex.size()) {
-        goto unscheduled; // nothing scheduled here
-    }
-
-    for (int i = sliceStart.sec; i <= sliceEnd.sec; ++i) {
-
-        ReverseFileMap::const_iterator mi
-        (m_instrumentIndex[index].find(i));
-
-        if (mi == m_instrumentIndex[index].end())
-            continue;
-
-        for (FileVector::const_iterator fi = mi->second.begin();
-                fi != mi->second.end(); ++fi) {
-
-            PlayableAudioFile *f = *fi;
-
-            if (f->getInstrument() != instrumentId)
-                continue;
-
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-            if (!printed) {
-                RG_DEBUG << "getPlayingFilesForInstrument(" << sliceStart << ", " << sliceDuration << ", " << instrumentId << ")";
-                printed = true;
-            }
-#endif
-
-            if (f->getStartTime() > sliceEnd ||
-                    f->getEndTime() <= sliceStart) {
-
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-                RG_DEBUG << "  rejected " << f << " in slot " << i;
-                if (f->getStartTime() > sliceEnd) {
-                    RG_DEBUG << "  (" << f->getStartTime() << " > " << sliceEnd << ")";
-                } else {
-                    RG_DEBUG << "  (" << f->getEndTime() << " <= " << sliceStart << ")";
-                }
-#endif
-
-                continue;
-            }
-
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-            RG_DEBUG << "  found " << f << " in slot " << i << " (" << f->getStartTime() << " -> " << f->getEndTime() << ")";
-#endif
-
-            size_t j = 0;
-            for (j = 0; j < written; ++j) {
-                if (playing[j] == f)
-                    break;
-            }
-            if (j < written)
-                break; // already have it
-
-            if (written >= size) {
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-                RG_DEBUG << "  No room to write it!";
-#endif
-
-                break;
-            }
-
-            playing[written++] = f;
+    struct Writer {
+        PlayableAudioFile **playing;
+        size_t size;
+        size_t written;
+        bool operator()(PlayableAudioFile *file) {
+            if (written >= size)
+                return false; // no room to write it
+            playing[written++] = file;
+            return true;
         }
-    }
+    } writer = { playing, size, 0 };
 
-unscheduled:
+    unsigned int index = instrumentId2Index(instrumentId);
+    if (index < (unsigned int)m_instrumentIndex.size()) {
+        const IntervalIndex &instrumentIndex = m_instrumentIndex[index];
+        instrumentIndex.find(0, instrumentIndex.intervals.size(),
+                             sliceStart, sliceEnd, writer);
+    }
 
     for (FileList::const_iterator fli = m_unscheduled.begin();
             fli != m_unscheduled.end(); ++fli) {
 
         PlayableAudioFile *f = *fli;
 
-        if (f->getInstrument() != instrumentId) {
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-            RG_DEBUG << "  rejecting unscheduled " << f << " as wrong instrument (" << f->getInstrument() << " != " << instrumentId << ")";
-#endif
-
+        if (f->getInstrument() != instrumentId)
             continue;
-        }
-
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-        if (!printed) {
-            RG_DEBUG << "getPlayingFilesForInstrument(" << sliceStart << ", " << sliceDuration << ", " << instrumentId << ")";
-            printed = true;
-        }
-#endif
 
         if (f->getStartTime() <= sliceEnd &&
                 f->getStartTime() + f->getDuration() > sliceStart) {
@@ -387,32 +401,18 @@ unscheduled:
             RG_DEBUG << "  found " << f << " in unscheduled list (" << f->getStartTime() << " -> " << f->getEndTime() << ")";
 #endif
 
-            if (written >= size)
+            if (!writer(f))
                 break;
-            playing[written++] = f;
-
-#ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-
-        } else {
-
-            RG_DEBUG << "  rejected " << f << " in unscheduled list";
-            if (f->getStartTime() > sliceEnd) {
-                RG_DEBUG << "  (" << f->getStartTime() << " > " << sliceEnd << ")";
-            } else {
-                RG_DEBUG << "  (" << f->getEndTime() << " <= " << sliceStart << ")";
-            }
-#endif
-
         }
     }
 
 #ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
-    if (written > 0) {
-        RG_DEBUG << "getPlayingFilesForInstrument(): total " << written << " files";
+    if (writer.written > 0) {
+        RG_DEBUG << "getPlayingFilesForInstrument(" << sliceStart << ", " << sliceDuration << ", " << instrumentId << "): total " << writer.written << " files";
     }
 #endif
 
-    size = written;
+    size = writer.written;
 }
 
 bool
@@ -425,7 +425,7 @@ AudioPlayQueue::haveFilesForInstrument(InstrumentId instrumentId) const
     unsigned int index = instrumentId2Index(instrumentId);
 
     if (index < (unsigned int)m_instrumentIndex.size() &&
-            !m_instrumentIndex[index].empty()) {
+            !m_instrumentIndex[index].intervals.empty()) {
 #ifdef FINE_DEBUG_AUDIO_PLAY_QUEUE
         RG_DEBUG << "  yes (scheduled)";
 #endif
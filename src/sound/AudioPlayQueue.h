@@ -16,6 +16,8 @@
 #ifndef RG_AUDIO_PLAY_QUEUE_H
 #define RG_AUDIO_PLAY_QUEUE_H
 
+#include <rosegardenprivate_export.h>
+
 #include "base/RealTime.h"
 #include "base/Instrument.h"
 
@@ -34,15 +36,34 @@ class PlayableAudioFile;
  * to add to or remove files from, but that aims to quickly answer the
  * question of which files are playing within a given time slice.
  *
- * Note that there is no locking between audio file add/remove and
- * lookup.  Add/remove should only be carried out when it is known
- * that no threads will be performing lookup.
+ * Scheduled files are kept in an interval index (files sorted by start
+ * time, with the latest end time of each half of each range), so a
+ * lookup costs a binary search plus the files it finds, however many
+ * files there are and however long they last.
+ *
+ * There is no locking between audio file add/remove and lookup.
+ * Instead a queue is filled in, then published to the audio threads
+ * with SoundDriver::setAudioQueue(), and never changed after that.
+ * To change a published queue, make a new one from it with the
+ * taking-over constructor, change that, and publish it in its place;
+ * the old one goes to a Scavenger, to be deleted once no audio thread
+ * can still be looking at it.
  */
 
-class AudioPlayQueue
+class ROSEGARDENPRIVATE_EXPORT AudioPlayQueue
 {
 public:
     AudioPlayQueue();
+
+    /**
+     * Make a queue with the same files as a published one, for adding
+     * to and publishing in its place.  The new queue takes over the
+     * files, so that the old one can be scavenged without deleting
+     * them.  The old one is otherwise left as it is, and may still be
+     * read by the audio threads while this is going on.
+     */
+    explicit AudioPlayQueue(AudioPlayQueue &previous);
+
     virtual ~AudioPlayQueue();
 
     struct FileTimeCmp {
@@ -54,7 +75,8 @@ public:
 
     /**
      * Add a file to the queue.  AudioPlayQueue takes ownership of the
-     * file and will delete it when removed.
+     * file and will delete it when removed.  Lookups won't find it
+     * until buildIndex() has been called.
      */
     void addScheduled(PlayableAudioFile *file);
 
@@ -70,7 +92,8 @@ public:
 
     /**
      * Remove a scheduled or unscheduled file from the queue and
-     * delete it.
+     * delete it.  Not for a queue that has been published, or a file
+     * that one that has been published may still have.
      */
     void erase(PlayableAudioFile *file);
 
@@ -79,6 +102,14 @@ public:
      */
     void clear();
 
+    /**
+     * Index the scheduled files for lookup.  Called by
+     * SoundDriver::setAudioQueue() when the queue is published, so
+     * there is no need to call it otherwise.  Does nothing if no files
+     * have been added or erased since the last call.
+     */
+    void buildIndex();
+
     /**
      * Return true if the queue is empty.
      */
@@ -100,10 +131,11 @@ public:
 
     /**
      * Look up the files playing during a given slice on a given
-     * instrument and return them in the passed array.  The size arg
-     * gives the available size of the array and is used to return the
-     * number of file pointers written.  The pointers returned are
-     * still owned by me and the caller should not delete them.
+     * instrument and return them in the passed array, scheduled files
+     * in order of start time.  The size arg gives the available size
+     * of the array and is used to return the number of file pointers
+     * written.  The pointers returned are still owned by me and the
+     * caller should not delete them.  RT safe.
      */
     void getPlayingFilesForInstrument(const RealTime &sliceStart,
                                       const RealTime &sliceDuration,
@@ -114,6 +146,7 @@ public:
     /**
      * Return true if at least one scheduled or unscheduled file is
      * associated with the given instrument somewhere in the queue.
+     * RT safe.
      */
     bool haveFilesForInstrument(InstrumentId instrumentId) const;
 
@@ -138,14 +171,46 @@ public:
     size_t getMaxBuffersRequired() const { return m_maxBuffers; }
 
 private:
+    /// A scheduled file, with its times to hand for lookup.
+    struct Interval
+    {
+        RealTime start;
+        RealTime end;
+        PlayableAudioFile *file;
+    };
+
+    /**
+     * Files sorted by start time, treated as a balanced binary tree:
+     * the root of each range is its middle element, and maxEnd holds,
+     * for each root, the latest end time in its range.  A range whose
+     * latest end is before the slice, or whose root starts after it
+     * (for the root and everything to its right), can be skipped.
+     */
+    struct IntervalIndex
+    {
+        std::vector<Interval> intervals;
+        std::vector<RealTime> maxEnd;
+
+        void build();
+        RealTime build(size_t begin, size_t end);
+
+        /// Call visit(file) on each file playing in the slice, until
+        /// it returns false.  Returns false if it was stopped.
+        template <typename Visitor>
+        bool find(size_t begin, size_t end,
+                  const RealTime &sliceStart, const RealTime &sliceEnd,
+                  Visitor &visit) const;
+    };
+
     FileSet m_files;
 
-    typedef std::vector<PlayableAudioFile *> FileVector;
-    typedef std::map<int, FileVector> ReverseFileMap;
-    ReverseFileMap m_index;
+    IntervalIndex m_index;
 
-    typedef std::vector<ReverseFileMap> InstrumentReverseFileMap;
-    InstrumentReverseFileMap m_instrumentIndex;
+    typedef std::vector<IntervalIndex> InstrumentIndex;
+    InstrumentIndex m_instrumentIndex;
+
+    /// Files added or erased since the last buildIndex().
+    bool m_indexStale;
 
     FileList m_unscheduled;
 
@@ -153,6 +218,9 @@ private:
     FileCountMap m_counts;
 
     size_t m_maxBuffers;
+
+    /// False once another queue has taken over the files.
+    bool m_ownsFiles;
 };
 
 
@@ -19,17 +19,23 @@
 #include "PlayableAudioFile.h"
 #include "RecordableAudioFile.h"
 #include "WAVAudioFile.h"
+#include "AudioKernels.h"
 #include "MappedStudio.h"
 #include "base/Profiler.h"
 #include "base/AudioLevel.h"
 #include "AudioPlayQueue.h"
 #include "PluginFactory.h"
 #include "ControlBlock.h"
+#include "RealtimeAudit.h"
 
 #include "misc/Strings.h"
+#include "misc/WorkerPool.h"
 #include <sys/time.h>
 #include <pthread.h>
 
+#include <QThread>
+
+#include <algorithm>
 #include <cmath>
 
 #ifdef __FreeBSD__
@@ -65,6 +71,8 @@ static inline void denormalKill(float *buffer, int size)
     }
 }
 
+static const size_t MAX_FILES_PER_INSTRUMENT = 500;
+
 AudioThread::AudioThread(std::string name,
                          SoundDriver *driver,
                          unsigned int sampleRate) :
@@ -769,9 +777,8 @@ AudioBussMixer::processBlocks()
                 if (dormant) {
                     rec.buffers[ch]->zero(m_blockSize);
                 } else {
-                    for (size_t j = 0; j < m_blockSize; ++j) {
-                        m_processBuffers[ch][j] *= gain[ch];
-                    }
+                    AudioKernels::applyGain(m_processBuffers[ch], m_blockSize,
+                                            gain[ch]);
                     rec.buffers[ch]->write(m_processBuffers[ch], m_blockSize);
                 }
             }
@@ -854,7 +861,8 @@ AudioInstrumentMixer::AudioInstrumentMixer(SoundDriver *driver,
         AudioThread("AudioInstrumentMixer", driver, sampleRate),
         m_fileReader(fileReader),
         m_bussMixer(nullptr),
-        m_blockSize(blockSize)
+        m_blockSize(blockSize),
+        m_workerPool(nullptr)
 {
     // Pregenerate empty plugin slots
 
@@ -897,9 +905,12 @@ AudioInstrumentMixer::~AudioInstrumentMixer()
 
     removeAllPlugins();
 
-    for (std::vector<sample_t *>::iterator i = m_processBuffers.begin();
-            i != m_processBuffers.end(); ++i) {
-        delete[] *i;
+    delete m_workerPool;
+
+    for (size_t c = 0; c < m_contexts.size(); ++c) {
+        std::vector<sample_t *> &buffers = m_contexts[c].processBuffers;
+        for (size_t i = 0; i < buffers.size(); ++i)
+            delete[] buffers[i];
     }
 
     //std::cerr << "AudioInstrumentMixer::~AudioInstrumentMixer exiting" << std::endl;
@@ -1443,15 +1454,24 @@ AudioInstrumentMixer::generateBuffers()
         }
     }
 
-    while ((unsigned int)m_processBuffers.size() > maxChannels) {
-        std::vector<sample_t *>::iterator bi = m_processBuffers.end();
-        --bi;
-        delete[] *bi;
-        m_processBuffers.erase(bi);
-    }
-    while ((unsigned int)m_processBuffers.size() < maxChannels) {
-        m_processBuffers.push_back(new sample_t[m_blockSize]);
+    // Scratch space for each thread that may process instruments.
+    const size_t contextCount =
+            m_workerPool ? size_t(m_workerPool->getWorkerCount()) : 1;
+    m_contexts.resize(contextCount);
+
+    for (size_t c = 0; c < m_contexts.size(); ++c) {
+        std::vector<sample_t *> &buffers = m_contexts[c].processBuffers;
+        while ((unsigned int)buffers.size() > maxChannels) {
+            delete[] buffers.back();
+            buffers.pop_back();
+        }
+        while ((unsigned int)buffers.size() < maxChannels) {
+            buffers.push_back(new sample_t[m_blockSize]);
+        }
+        m_contexts[c].playing.resize(MAX_FILES_PER_INSTRUMENT);
     }
+
+    m_jobs.reserve(m_bufferMap.size());
 }
 
 void
@@ -1525,6 +1545,7 @@ AudioInstrumentMixer::emptyBuffers(RealTime currentTime)
         m_bufferMap[id].muted = false;
         m_bufferMap[id].zeroFrames = 0;
         m_bufferMap[id].filledTo = currentTime;
+        m_bufferMap[id].processingTime = ProcessingTime();
 
         for (size_t i = 0; i < m_bufferMap[id].buffers.size(); ++i) {
             m_bufferMap[id].buffers[i]->reset();
@@ -1571,6 +1592,52 @@ AudioInstrumentMixer::updateInstrumentMuteStates()
     }
 }
 
+void
+AudioInstrumentMixer::setThreadCount(int threads, int priority)
+{
+    // Not RT safe
+
+    if (threads <= 0) {
+        // Leave a core for the JACK process thread and everyone else.
+        threads = std::max(1, std::min(QThread::idealThreadCount() - 1, 8));
+    }
+
+    getLock();
+
+    delete m_workerPool;
+    m_workerPool = nullptr;
+
+    if (threads > 1) {
+        m_workerPool = new WorkerPool(threads - 1, priority);
+    }
+
+    // Scratch space for the new threads is made by the next
+    // generateBuffers().  Until then processBlocks() sticks to the
+    // mixer thread.
+
+    releaseLock();
+}
+
+int
+AudioInstrumentMixer::getThreadCount() const
+{
+    return m_workerPool ? m_workerPool->getWorkerCount() : 1;
+}
+
+std::map<InstrumentId, AudioInstrumentMixer::ProcessingTime>
+AudioInstrumentMixer::getProcessingTimes() const
+{
+    std::map<InstrumentId, ProcessingTime> times;
+
+    for (BufferMap::const_iterator i = m_bufferMap.begin();
+         i != m_bufferMap.end(); ++i) {
+        if (i->second.processingTime.blocks > 0)
+            times[i->first] = i->second.processingTime;
+    }
+
+    return times;
+}
+
 void
 AudioInstrumentMixer::processBlocks(bool &readSomething)
 {
@@ -1642,23 +1709,45 @@ AudioInstrumentMixer::processBlocks(bool &readSomething)
 
         rec.empty = empty;
 
+        SynthPluginMap::iterator si = m_synths.find(id);
+        rec.grouped = (si != m_synths.end() && si->second &&
+                       si->second->isInGroup());
+        for (PluginList::iterator j = m_plugins[id].begin();
+                j != m_plugins[id].end(); ++j) {
+            if (*j && (*j)->isInGroup())
+                rec.grouped = true;
+        }
+
         // For a while we were setting empty to true if the volume on
         // the track was zero, but that breaks continuity if there is
         // actually a file on the track -- processEmptyBlocks won't
         // read it, so it'll fall behind if we put the volume up again.
     }
 
-    bool more = true;
+    for (size_t c = 0; c < m_contexts.size(); ++c) {
+        m_contexts[c].queue = queue;
+        m_contexts[c].readSomething = false;
+        m_contexts[c].discUnderrun = false;
+    }
 
-    static const int MAX_FILES_PER_INSTRUMENT = 500;
-    static PlayableAudioFile *playing[MAX_FILES_PER_INSTRUMENT];
+    // Use the worker pool if there is more than one instrument to
+    // share out.  Each round processes (at most) one block on every
+    // non-empty instrument, as the instruments are independent of
+    // each other the result is the same whichever thread processes
+    // which instrument and in whatever order.
 
-    RealTime blockDuration = RealTime::frame2RealTime(m_blockSize, m_sampleRate);
+    const bool parallel =
+            m_workerPool  &&
+            m_contexts.size() >= size_t(m_workerPool->getWorkerCount());
+
+    bool more = true;
 
     while (more) {
 
         more = false;
 
+        m_jobs.clear();
+
         for (BufferMap::iterator i = m_bufferMap.begin();
                 i != m_bufferMap.end(); ++i) {
 
@@ -1667,38 +1756,103 @@ AudioInstrumentMixer::processBlocks(bool &readSomething)
 
             if (rec.empty) {
                 rec.dormant = true;
+                rec.haveMore = false;
                 continue;
             }
 
-            size_t playCount = MAX_FILES_PER_INSTRUMENT;
-
-            if (id >= SoftSynthInstrumentBase)
-                playCount = 0;
-            else {
-                queue->getPlayingFilesForInstrument(rec.filledTo,
-                                                    blockDuration, id,
-                                                    playing, playCount);
+            if (parallel  &&  !rec.grouped  &&
+                m_jobs.size() < m_jobs.capacity()) {
+                m_jobs.push_back(std::make_pair(id, &rec));
+            } else {
+                processInstrument(id, rec, m_contexts[0]);
             }
+        }
+
+        if (m_jobs.size() > 1) {
+            m_workerPool->run(processJob, this, m_jobs.size());
+        } else if (m_jobs.size() == 1) {
+            processInstrument(m_jobs[0].first, *m_jobs[0].second,
+                              m_contexts[0]);
+        }
 
-            if (processBlock(id, playing, playCount, readSomething)) {
+        for (BufferMap::iterator i = m_bufferMap.begin();
+                i != m_bufferMap.end(); ++i) {
+            if (i->second.haveMore) {
                 more = true;
+                break;
             }
         }
     }
+
+    for (size_t c = 0; c < m_contexts.size(); ++c) {
+        if (m_contexts[c].readSomething)
+            readSomething = true;
+        // Reported from here, as reportFailure() isn't safe to call
+        // from more than one thread at once.
+        if (m_contexts[c].discUnderrun)
+            m_driver->reportFailure(MappedEvent::FailureDiscUnderrun);
+    }
+}
+
+void
+AudioInstrumentMixer::processJob(void *mixer, size_t index, int worker)
+{
+    // Needs to be RT safe
+
+    RealtimeAudit::Scope realtime;
+
+    AudioInstrumentMixer *inst = static_cast<AudioInstrumentMixer *>(mixer);
+    std::pair<InstrumentId, BufferRec *> &job = inst->m_jobs[index];
+    inst->processInstrument(job.first, *job.second, inst->m_contexts[worker]);
+}
+
+void
+AudioInstrumentMixer::processInstrument(InstrumentId id, BufferRec &rec,
+                                        ProcessContext &context)
+{
+    // Needs to be RT safe, and safe to call for different instruments
+    // on different threads at once.
+
+    ProfileTrace::Scope trace("AudioInstrumentMixer::processInstrument");
+
+    const qint64 start = ProfileTrace::now();
+
+    size_t playCount = 0;
+
+    if (id < SoftSynthInstrumentBase && !context.playing.empty()) {
+        const RealTime blockDuration =
+                RealTime::frame2RealTime(m_blockSize, m_sampleRate);
+        playCount = context.playing.size();
+        context.queue->getPlayingFilesForInstrument(
+                rec.filledTo, blockDuration, id,
+                &context.playing[0], playCount);
+    }
+
+    rec.haveMore = processBlock(id, rec,
+                                playCount ? &context.playing[0] : nullptr,
+                                playCount, context);
+
+    const qint64 elapsed = ProfileTrace::now() - start;
+    ProcessingTime &time = rec.processingTime;
+    ++time.blocks;
+    time.totalNsec += elapsed;
+    if (elapsed > time.worstNsec)
+        time.worstNsec = elapsed;
 }
 
 
 bool
 AudioInstrumentMixer::processBlock(InstrumentId id,
+                                   BufferRec &rec,
                                    PlayableAudioFile **playing,
                                    size_t playCount,
-                                   bool &readSomething)
+                                   ProcessContext &context)
 {
     // Needs to be RT safe
 
     //    Profiler profiler("processBlock", true);
 
-    BufferRec &rec = m_bufferMap[id];
+    std::vector<sample_t *> &processBuffers = context.processBuffers;
     RealTime bufferTime = rec.filledTo;
 
 #ifdef DEBUG_MIXER 
@@ -1711,12 +1865,12 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
     unsigned int channels = rec.channels;
     if (channels > (unsigned int)rec.buffers.size())
         channels = (unsigned int)rec.buffers.size();
-    if (channels > (unsigned int)m_processBuffers.size())
-        channels = (unsigned int)m_processBuffers.size();
+    if (channels > (unsigned int)processBuffers.size())
+        channels = (unsigned int)processBuffers.size();
     if (channels == 0) {
 #ifdef DEBUG_MIXER
         if ((id % 100) == 0)
-            std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): nominal channels " << rec.channels << ", ring buffers " << rec.buffers.size() << ", process buffers " << m_processBuffers.size() << std::endl;
+            std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): nominal channels " << rec.channels << ", ring buffers " << rec.buffers.size() << ", process buffers " << processBuffers.size() << std::endl;
 #endif
 
         return false; // buffers just haven't been set up yet
@@ -1744,7 +1898,12 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
         }
     }
 
-    PluginList &plugins = m_plugins[id];
+    // find() rather than operator[], which may insert, as other
+    // instruments may be being processed on other threads.
+    PluginMap::iterator pluginsIter = m_plugins.find(id);
+    if (pluginsIter == m_plugins.end())
+        return false;
+    PluginList &plugins = pluginsIter->second;
 
 #ifdef DEBUG_MIXER
 
@@ -1811,7 +1970,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
                 // to accept that it won't be available for a while
                 // and just read silence from it instead.
                 if (file->isBuffered()) {
-                    m_driver->reportFailure(MappedEvent::FailureDiscUnderrun);
+                    context.discUnderrun = true;
                     haveBlock = false;
                 } else {
                     // ignore happily.
@@ -1832,10 +1991,12 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 #endif
 
     for (unsigned int ch = 0; ch < targetChannels; ++ch) {
-        memset(m_processBuffers[ch], 0, sizeof(sample_t) * m_blockSize);
+        memset(processBuffers[ch], 0, sizeof(sample_t) * m_blockSize);
     }
 
-    RunnablePluginInstance *synth = m_synths[id];
+    SynthPluginMap::iterator synthIter = m_synths.find(id);
+    RunnablePluginInstance *synth =
+            (synthIter == m_synths.end() ? nullptr : synthIter->second);
 
     if (synth && !synth->isBypassed()) {
 
@@ -1846,7 +2007,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
         while (ch < synth->getAudioOutputCount() && ch < channels) {
             denormalKill(synth->getAudioOutputBuffers()[ch],
                          m_blockSize);
-            memcpy(m_processBuffers[ch],
+            memcpy(processBuffers[ch],
                    synth->getAudioOutputBuffers()[ch],
                    m_blockSize * sizeof(sample_t));
             ++ch;
@@ -1889,8 +2050,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
             // pooled buffers.
 
             if (blockSize > 0) {
-                file->addSamples(m_processBuffers, channels, blockSize, offset);
-                readSomething = true;
+                file->addSamples(processBuffers, channels, blockSize, offset);
+                context.readSomething = true;
             }
         }
     }
@@ -1919,7 +2080,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
             if (ch < channels || ch < 2) {
                 memcpy(plugin->getAudioInputBuffers()[ch],
-                       m_processBuffers[ch % channels],
+                       processBuffers[ch % channels],
                        m_blockSize * sizeof(sample_t));
             } else {
                 memset(plugin->getAudioInputBuffers()[ch], 0,
@@ -1943,15 +2104,15 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
                          m_blockSize);
 
             if (ch < channels) {
-                memcpy(m_processBuffers[ch],
+                memcpy(processBuffers[ch],
                        plugin->getAudioOutputBuffers()[ch],
                        m_blockSize * sizeof(sample_t));
             } else if (ch == 1) {
                 // stereo output from plugin on a mono track
                 for (size_t i = 0; i < m_blockSize; ++i) {
-                    m_processBuffers[0][i] +=
+                    processBuffers[0][i] +=
                         plugin->getAudioOutputBuffers()[ch][i];
-                    m_processBuffers[0][i] /= 2;
+                    processBuffers[0][i] /= 2;
                 }
             } else {
                 break;
@@ -1967,19 +2128,14 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
     if (targetChannels == 2 && channels == 1) {
 
-        for (size_t i = 0; i < m_blockSize; ++i) {
-
-            sample_t sample = m_processBuffers[0][i];
+        allZeros = AudioKernels::isSilent(processBuffers[0], m_blockSize);
 
-            m_processBuffers[0][i] = sample * rec.gainLeft;
-            m_processBuffers[1][i] = sample * rec.gainRight;
+        AudioKernels::copyWithGain(processBuffers[1], processBuffers[0],
+                                   m_blockSize, rec.gainRight);
+        AudioKernels::applyGain(processBuffers[0], m_blockSize, rec.gainLeft);
 
-            if (allZeros && sample != 0.0)
-                allZeros = false;
-        }
-
-        rec.buffers[0]->write(m_processBuffers[0], m_blockSize);
-        rec.buffers[1]->write(m_processBuffers[1], m_blockSize);
+        rec.buffers[0]->write(processBuffers[0], m_blockSize);
+        rec.buffers[1]->write(processBuffers[1], m_blockSize);
 
     } else {
 
@@ -1988,16 +2144,13 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
             float gain = ((ch == 0) ? rec.gainLeft :
                           (ch == 1) ? rec.gainRight : rec.volume);
 
-            for (size_t i = 0; i < m_blockSize; ++i) {
-
-                // handle volume and pan
-                m_processBuffers[ch][i] *= gain;
+            // handle volume and pan
+            AudioKernels::applyGain(processBuffers[ch], m_blockSize, gain);
 
-                if (allZeros && m_processBuffers[ch][i] != 0.0)
-                    allZeros = false;
-            }
+            if (allZeros)
+                allZeros = AudioKernels::isSilent(processBuffers[ch], m_blockSize);
 
-            rec.buffers[ch]->write(m_processBuffers[ch], m_blockSize);
+            rec.buffers[ch]->write(processBuffers[ch], m_blockSize);
         }
     }
 
@@ -2117,6 +2270,9 @@ AudioFileReader::fillBuffers(const RealTime &currentTime)
     for (AudioPlayQueue::FileSet::const_iterator fi = files.begin();
             fi != files.end(); ++fi) {
         (*fi)->clearBuffers();
+        // Get the disk reading the first block of every file at
+        // once, rather than waiting on each in turn below.
+        (*fi)->prefetch(currentTime, bufferLength);
     }
 
     int allocated = 0;
@@ -2144,16 +2300,28 @@ AudioFileReader::kick(bool wantLock)
     bool someFilled = false;
 
     // Tell files that are playing or will be playing in the next few
-    // seconds to update.
+    // seconds to update, and take back the buffers of those that
+    // finished in the last second.  The mixer is never behind now, so
+    // it has finished with them, and returning them to the pool isn't
+    // something it can do itself.
 
     AudioPlayQueue::FileSet playing;
 
+    const RealTime lookBehind(1, 0);
+
     queue->getPlayingFiles
-    (now, RealTime(3, 0) + m_driver->getAudioReadBufferLength(), playing);
+    (now - lookBehind,
+     lookBehind + RealTime(3, 0) + m_driver->getAudioReadBufferLength(),
+     playing);
 
     for (AudioPlayQueue::FileSet::iterator fi = playing.begin();
             fi != playing.end(); ++fi) {
 
+        if ((*fi)->getEndTime() < now) {
+            (*fi)->clearBuffers();
+            continue;
+        }
+
         if (!(*fi)->isBuffered()) {
             // fillBuffers has not been called on this file.  This
             // happens when a file is unmuted during playback.  The
@@ -16,6 +16,8 @@
 #ifndef RG_AUDIO_PROCESS_H
 #define RG_AUDIO_PROCESS_H
 
+#include <rosegardenprivate_export.h>
+
 #include "SoundDriver.h"
 #include "base/Instrument.h"
 #include "base/RealTime.h"
@@ -27,7 +29,7 @@
 namespace Rosegarden
 {
 
-class AudioThread
+class ROSEGARDENPRIVATE_EXPORT AudioThread
 {
 public:
     typedef float sample_t;
@@ -75,7 +77,7 @@ private:
 
 class AudioInstrumentMixer;
 
-class AudioBussMixer : public AudioThread
+class ROSEGARDENPRIVATE_EXPORT AudioBussMixer : public AudioThread
 {
 public:
     AudioBussMixer(SoundDriver *driver,
@@ -163,8 +165,9 @@ protected:
 
 class AudioFileReader;
 class AudioFileWriter;
+class WorkerPool;
 
-class AudioInstrumentMixer : public AudioThread
+class ROSEGARDENPRIVATE_EXPORT AudioInstrumentMixer : public AudioThread
 {
 public:
     typedef std::vector<RunnablePluginInstance *> PluginList;
@@ -244,8 +247,9 @@ public:
      * plugins assigned to it, and so cannot generate sound.  Empty
      * instruments can safely be ignored during playback.
      */
-    bool isInstrumentEmpty(InstrumentId id) {
-        return m_bufferMap[id].empty;
+    bool isInstrumentEmpty(InstrumentId id) const {
+        BufferMap::const_iterator i = m_bufferMap.find(id);
+        return i == m_bufferMap.end() || i->second.empty;
     }
 
     /**
@@ -254,8 +258,9 @@ public:
      * skipped rather than mixed during playback, but they should not
      * be ignored (unless also empty).
      */
-    bool isInstrumentDormant(InstrumentId id) {
-        return m_bufferMap[id].dormant;
+    bool isInstrumentDormant(InstrumentId id) const {
+        BufferMap::const_iterator i = m_bufferMap.find(id);
+        return i == m_bufferMap.end() || i->second.dormant;
     }
 
     /**
@@ -263,10 +268,16 @@ public:
      * this point, because even on a mono instrument we still have a
      * Pan setting which will have been applied by the time we get to
      * these buffers.
+     *
+     * Like the two above, this is called from the realtime threads,
+     * so it mustn't add an entry for an instrument that has no fader
+     * (and so no buffers).
      */
-    RingBuffer<sample_t, 2> *getRingBuffer(InstrumentId id, unsigned int channel) {
-        if (channel < (unsigned int)m_bufferMap[id].buffers.size()) {
-            return m_bufferMap[id].buffers[channel];
+    RingBuffer<sample_t, 2> *getRingBuffer(InstrumentId id, unsigned int channel) const {
+        BufferMap::const_iterator i = m_bufferMap.find(id);
+        if (i != m_bufferMap.end() &&
+            channel < (unsigned int)i->second.buffers.size()) {
+            return i->second.buffers[channel];
         } else {
             return nullptr;
         }
@@ -278,16 +289,78 @@ public:
     /// For call regularly from anywhere in a non-RT thread
     void updateInstrumentMuteStates();
 
+    /**
+     * Process instruments on up to the given number of threads at once
+     * (including the calling thread).  1 processes them one after
+     * another, and 0 picks a number to suit the machine.  Not RT safe;
+     * call before starting playback.
+     *
+     * The threads run at the given SCHED_FIFO priority, or with normal
+     * scheduling if 0.  kick() waits on them, so they should run at no
+     * lower a priority than whatever calls kick().
+     */
+    void setThreadCount(int threads, int priority = 0);
+    int getThreadCount() const;
+
+    /**
+     * Time spent processing an instrument since the last
+     * emptyBuffers() (which fillBuffers() calls), for finding out which
+     * plugin chains are the expensive ones.
+     */
+    struct ProcessingTime
+    {
+        ProcessingTime() : blocks(0), totalNsec(0), worstNsec(0) { }
+
+        size_t blocks;
+        qint64 totalNsec;
+        qint64 worstNsec;
+    };
+
+    /// Processing times for each instrument that has done any.
+    /**
+     * Call from a non-RT thread.  The times are updated by the mixing
+     * threads without locking, so may be slightly stale.
+     */
+    std::map<InstrumentId, ProcessingTime> getProcessingTimes() const;
+
 protected:
     void threadRun() override;
 
     int getPriority() override { return 3; }
 
+    struct BufferRec;
+
+    /// Scratch space for one thread processing instruments.
+    struct ProcessContext
+    {
+        ProcessContext() : queue(nullptr), readSomething(false),
+                           discUnderrun(false) { }
+
+        // maintain the same number of these as the maximum number of
+        // channels on any audio instrument
+        std::vector<sample_t *> processBuffers;
+        std::vector<PlayableAudioFile *> playing;
+
+        /// The queue for this processBlocks(), so that every instrument
+        /// plays from the same one even if a new one is published.
+        const AudioPlayQueue *queue;
+
+        bool readSomething;
+        bool discUnderrun;
+    };
+
     void processBlocks(bool &readSomething);
     void processEmptyBlocks(InstrumentId id);
-    bool processBlock(InstrumentId id, PlayableAudioFile **, size_t, bool &readSomething);
+    void processInstrument(InstrumentId id, BufferRec &rec,
+                           ProcessContext &context);
+    bool processBlock(InstrumentId id, BufferRec &rec,
+                      PlayableAudioFile **, size_t,
+                      ProcessContext &context);
     void generateBuffers();
 
+    /// WorkerPool::Job for processBlocks().
+    static void processJob(void *mixer, size_t index, int worker);
+
     AudioFileReader  *m_fileReader;
     AudioBussMixer   *m_bussMixer;
     size_t            m_blockSize;
@@ -299,16 +372,18 @@ protected:
     PluginMap m_plugins;
     SynthPluginMap m_synths;
 
-    // maintain the same number of these as the maximum number of
-    // channels on any audio instrument
-    std::vector<sample_t *> m_processBuffers;
+    /// One for each thread that may process instruments.
+    std::vector<ProcessContext> m_contexts;
+
+    /// nullptr when processing on the mixer thread alone.
+    WorkerPool *m_workerPool;
 
     struct BufferRec
     {
         BufferRec() : empty(true), dormant(true), zeroFrames(0),
                       filledTo(RealTime::zeroTime), channels(2),
                       buffers(), gainLeft(0.0), gainRight(0.0), volume(0.0),
-                      muted(false) { }
+                      muted(false), grouped(false), haveMore(false) { }
         ~BufferRec();
 
         bool empty;
@@ -323,14 +398,27 @@ protected:
         float gainRight;
         float volume;
         bool muted;
+
+        /// Has a plugin that shares state with other instances (see
+        /// RunnablePluginInstance::isInGroup()), so mustn't be
+        /// processed at the same time as other instruments.
+        bool grouped;
+        /// Result of the last processBlock().
+        bool haveMore;
+
+        ProcessingTime processingTime;
     };
 
     typedef std::map<InstrumentId, BufferRec> BufferMap;
     BufferMap m_bufferMap;
+
+    /// The instruments for the worker pool in the current round of
+    /// processBlocks().  Reserved in generateBuffers().
+    std::vector<std::pair<InstrumentId, BufferRec *> > m_jobs;
 };
 
 
-class AudioFileReader : public AudioThread
+class ROSEGARDENPRIVATE_EXPORT AudioFileReader : public AudioThread
 {
 public:
     AudioFileReader(SoundDriver *driver,
@@ -142,12 +142,7 @@ BWFAudioFile::parseHeader()
     //
     readFormatChunk();
 
-}
-
-std::streampos
-BWFAudioFile::getDataOffset()
-{
-    return 0;
+    findDataChunk();
 }
 
 
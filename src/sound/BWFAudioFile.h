@@ -58,10 +58,6 @@ public:
     // 
     //virtual std::vector<float> getPreview(const RealTime &resolution);
 
-    // Offset to start of sample data
-    //
-    std::streampos getDataOffset() override;
-
     // Peak file name
     //
     QString getPeakFilename() override
@@ -20,12 +20,14 @@
 #include <QObject>
 #include <QString>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
 
 /// Allow Rosegarden to run without sound support.
-class DummyDriver : public SoundDriver
+class ROSEGARDENPRIVATE_EXPORT DummyDriver : public SoundDriver
 {
 public:
     DummyDriver(MappedStudio *studio, const QString &pastLog = "") :
@@ -23,6 +23,7 @@
 #include "base/AudioLevel.h"
 #include "Audit.h"
 #include "PluginFactory.h"
+#include "RealtimeAudit.h"
 #include "SequencerDataBlock.h"
 
 #include "misc/ConfigGroups.h"
@@ -31,6 +32,8 @@
 #include <QSettings>
 #include <QtGlobal>
 
+#include <algorithm>
+
 #ifdef HAVE_ALSA
 #ifdef HAVE_LIBJACK
 
@@ -93,6 +96,12 @@ JackDriver::~JackDriver()
         }
     }
 
+    if (RealtimeAudit::getViolationCount() > 0) {
+        RG_WARNING << "dtor: WARNING:" << RealtimeAudit::getViolationCount()
+                   << "realtime safety violations in the JACK process thread:\n"
+                   << RealtimeAudit::getReport();
+    }
+
 #ifdef DEBUG_JACK_DRIVER
     RG_DEBUG << "dtor: terminating buss mixer";
 #endif
@@ -246,6 +255,7 @@ JackDriver::initialise(bool reinitialise)
 
     // set callbacks
     //
+    RealtimeAudit::initialise();
     jack_set_process_callback(m_client, jackProcessStatic, this);
     jack_set_buffer_size_callback(m_client, jackBufferSize, this);
     jack_set_sample_rate_callback(m_client, jackSampleRate, this);
@@ -283,6 +293,26 @@ JackDriver::initialise(bool reinitialise)
                       (m_alsaDriver, m_instrumentMixer, m_sampleRate, m_bufferSize);
         m_instrumentMixer->setBussMixer(m_bussMixer);
 
+        // Threads for processing instruments' plugins and synths at
+        // the same time.  0 for automatic, 1 for just the thread that
+        // mixes.  audiomixpool false turns them off whatever the count.
+        settings.beginGroup(SequencerOptionsConfigGroup);
+        const bool mixPool = settings.value("audiomixpool", true).toBool();
+        int mixThreads = settings.value("audiomixthreads", 0).toInt();
+        // Write them to the file to make them easier to find.
+        settings.setValue("audiomixpool", mixPool);
+        settings.setValue("audiomixthreads", mixThreads);
+        settings.endGroup();
+        if (!mixPool)
+            mixThreads = 1;
+        // The JACK process callback does the mixing and waits for the
+        // threads, so they run at its priority.
+        const int mixPriority = jack_client_real_time_priority(m_client);
+        m_instrumentMixer->setThreadCount(mixThreads,
+                                          std::max(mixPriority, 0));
+        AUDIT << "Processing instruments on " <<
+                 m_instrumentMixer->getThreadCount() << " thread(s)\n";
+
         // We run the file reader whatever, but we only run the other
         // threads (instrument mixer, buss mixer, file writer) when we
         // actually need them.  (See updateAudioData and createRecordFile.)
@@ -790,6 +820,9 @@ JackDriver::jackProcessStatic(jack_nframes_t nframes, void *arg)
 int
 JackDriver::jackProcess(jack_nframes_t nframes)
 {
+    ProfileTrace::Scope trace("JackDriver::jackProcess");
+    RealtimeAudit::Scope realtime;
+
     if (!m_ok || !m_client) {
 #ifdef DEBUG_JACK_PROCESS
         RG_DEBUG << "jackProcess(): not OK";
@@ -1800,8 +1833,22 @@ JackDriver::stopTransport()
         }
     }
 
-    if (m_instrumentMixer)
+    if (m_instrumentMixer) {
         m_instrumentMixer->resetAllPlugins(true); // discard events too
+
+#ifdef DEBUG_JACK_DRIVER
+        typedef std::map<InstrumentId, AudioInstrumentMixer::ProcessingTime>
+                ProcessingTimes;
+        const ProcessingTimes times = m_instrumentMixer->getProcessingTimes();
+        for (ProcessingTimes::const_iterator i = times.begin();
+             i != times.end(); ++i) {
+            RG_DEBUG << "stopTransport(): instrument" << i->first <<
+                        "processed" << i->second.blocks << "blocks, average" <<
+                        i->second.totalNsec / qint64(i->second.blocks) / 1000 <<
+                        "us, worst" << i->second.worstNsec / 1000 << "us";
+        }
+#endif
+    }
 }
 
 
@@ -289,14 +289,10 @@ fetchEventsNoncompeting(MappedInserterBase &inserter,
                 continue;
             }
 
-            // This locks the iterator's buffer against writes, lest
-            // writing cause reallocating the buffer while we are
-            // holding a pointer into it.  No function we call will
-            // hold the `event' pointer past its own scope, implying
-            // that nothing holds it past an iteration of this loop,
-            // which is this lock's scope.
-            QReadLocker locker(iter->getLock());
-
+            // No locking.  The buffer is never modified in place and
+            // the version we are pointing into outlives this loop.  No
+            // function we call will hold the `event' pointer past its
+            // own scope.
             MappedEvent *event = iter->peek();
 
             // We couldn't fetch an event or it failed a sanity check.
@@ -406,10 +402,7 @@ MappedBufMetaIterator::getAudioEvents(std::vector<MappedEvent> &audioEvents)
          i != m_buffers.end(); ++i) {
 
         // ??? The various features of MEBIterator are not needed here.
-        //     Instead, we should probably lock the buffer for read
-        //     (MappedEventBuffer::m_lock which should probably be
-        //     public) and get at it directly via
-        //     MappedEventBuffer::getBuffer() (or just make m_buffer public).
+        //     But it does give us a safe read of the buffer.
         MEBIterator iter(*i);
 
         // For each event
@@ -27,6 +27,8 @@
 #include <set>
 #include <vector>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden {
 
 
@@ -57,7 +59,7 @@ class MEBIterator;
  * in a Composition into MappedEvent objects that can be sent to ALSA.  For
  * the first part of this conversion, see InternalSegmentMapper.
  */
-class MappedBufMetaIterator
+class ROSEGARDENPRIVATE_EXPORT MappedBufMetaIterator
 {
 public:
     void addBuffer(QSharedPointer<MappedEventBuffer>);
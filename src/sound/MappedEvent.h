@@ -21,6 +21,8 @@
 #include "base/Track.h"
 #include "base/Event.h"
 
+#include <rosegardenprivate_export.h>
+
 
 namespace Rosegarden
 {
@@ -92,7 +94,7 @@ protected:
  *  the "getSequencerSlice" and "processAsync/Recorded" interfaces on
  *  which the control messages can piggyback and eventually stripped out.
  */
-class MappedEvent
+class ROSEGARDENPRIVATE_EXPORT MappedEvent
 {
 public:
     typedef enum
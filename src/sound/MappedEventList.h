@@ -22,6 +22,8 @@
 #include <set>
 #include <QDataStream>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
@@ -37,8 +39,8 @@ namespace Rosegarden
  * it's just the container that happens to be used in sequencer
  * threads when a set of MappedEvents is called for.
  */
-class MappedEventList : public std::multiset<MappedEvent *,
-                                             MappedEvent::MappedEventCmp>
+class ROSEGARDENPRIVATE_EXPORT MappedEventList :
+        public std::multiset<MappedEvent *, MappedEvent::MappedEventCmp>
 {
 public:
     MappedEventList() { }
@@ -15,6 +15,8 @@
 #ifndef RG_MAPPEDSTUDIO_H
 #define RG_MAPPEDSTUDIO_H
 
+#include <rosegardenprivate_export.h>
+
 #include <map>
 #include <string>
 #include <vector>
@@ -37,7 +39,7 @@ class SoundDriver;
 
 // Types are in MappedCommon.h
 //
-class MappedObject
+class ROSEGARDENPRIVATE_EXPORT MappedObject
 {
 public:
 
@@ -162,7 +164,7 @@ class MappedAudioInput;
  *     "Mapped" should either be dropped or something related to the problem
  *     domain should be used in its place.
  */
-class MappedStudio : public MappedObject
+class ROSEGARDENPRIVATE_EXPORT MappedStudio : public MappedObject
 {
 public:
     MappedStudio();
@@ -265,7 +267,7 @@ private:
 // can do the cleverness if n != m
 //
 
-class MappedConnectableObject : public MappedObject
+class ROSEGARDENPRIVATE_EXPORT MappedConnectableObject : public MappedObject
 {
 public:
     static const MappedObjectProperty ConnectionsIn;
@@ -302,7 +304,7 @@ protected:
 
 // Audio fader
 //
-class MappedAudioFader : public MappedConnectableObject
+class ROSEGARDENPRIVATE_EXPORT MappedAudioFader : public MappedConnectableObject
 {
 public:
     static const MappedObjectProperty Channels;
@@ -350,7 +352,7 @@ protected:
     MappedObjectValue             m_inputChannel;
 };
 
-class MappedAudioBuss : public MappedConnectableObject
+class ROSEGARDENPRIVATE_EXPORT MappedAudioBuss : public MappedConnectableObject
 {
 public:
     // A buss is much simpler than an instrument fader.  It's always
@@ -0,0 +1,87 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[MemoryMappedFile]"
+
+#include "MemoryMappedFile.h"
+#include "misc/Debug.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Rosegarden
+{
+
+MemoryMappedFile::MemoryMappedFile(const QString &fileName) :
+    m_data(nullptr),
+    m_size(0)
+{
+    int fd = ::open(fileName.toLocal8Bit().constData(), O_RDONLY);
+    if (fd < 0) {
+        RG_WARNING << "MemoryMappedFile: failed to open" << fileName;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0  ||  st.st_size <= 0) {
+        ::close(fd);
+        return;
+    }
+
+    void *data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping holds its own reference to the file.
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        RG_WARNING << "MemoryMappedFile: failed to map" << fileName;
+        return;
+    }
+
+    m_data = static_cast<unsigned char *>(data);
+    m_size = size_t(st.st_size);
+
+    // Audio files are mostly played from start to finish, so let the
+    // kernel read ahead aggressively.
+    posix_madvise(m_data, m_size, POSIX_MADV_SEQUENTIAL);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    if (m_data)
+        munmap(m_data, m_size);
+}
+
+void
+MemoryMappedFile::willNeed(size_t offset, size_t length) const
+{
+    if (!m_data  ||  offset >= m_size)
+        return;
+    if (length > m_size - offset)
+        length = m_size - offset;
+    if (length == 0)
+        return;
+
+    // madvise wants a page aligned start.
+    static const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    const size_t start = offset - offset % pageSize;
+
+    posix_madvise(m_data + start, length + (offset - start),
+                  POSIX_MADV_WILLNEED);
+}
+
+}
@@ -0,0 +1,63 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_MEMORY_MAPPED_FILE_H
+#define RG_MEMORY_MAPPED_FILE_H
+
+#include <QString>
+
+#include <stddef.h>
+
+namespace Rosegarden
+{
+
+/**
+ * A read-only memory mapping of a whole file.  PlayableAudioFile uses
+ * this to decode samples straight out of the page cache, rather than
+ * copying them through an ifstream into a buffer first.
+ *
+ * The mapping is of the file's size when it was opened.  Anything
+ * appended afterwards is not seen, and truncating the file while it is
+ * mapped will get the reader a SIGBUS, as with any mmap.
+ */
+class MemoryMappedFile
+{
+public:
+    /// Map fileName.  Check isValid() to see whether that worked.
+    explicit MemoryMappedFile(const QString &fileName);
+    ~MemoryMappedFile();
+
+    bool isValid() const { return m_data != nullptr; }
+
+    const unsigned char *getData() const { return m_data; }
+    size_t getSize() const { return m_size; }
+
+    /// Ask the kernel to start reading [offset, offset + length) in.
+    /**
+     * Doesn't wait for it.  Out of range parts are ignored.
+     */
+    void willNeed(size_t offset, size_t length) const;
+
+private:
+    MemoryMappedFile(const MemoryMappedFile &); // not provided
+    MemoryMappedFile &operator=(const MemoryMappedFile &); // not provided
+
+    unsigned char *m_data;
+    size_t m_size;
+};
+
+}
+
+#endif
@@ -21,6 +21,7 @@
 
 #include "Midi.h"
 #include "MidiEvent.h"
+#include "MemoryMappedFile.h"
 #include "base/Segment.h"
 //#include "base/NotationTypes.h"
 #include "base/BaseProperties.h"
@@ -34,13 +35,17 @@
 #include "gui/seqmanager/SequenceManager.h"
 #include "misc/Debug.h"
 #include "misc/Strings.h"
+#include "misc/WorkerPool.h"
 #include "sound/MappedBufMetaIterator.h"
 #include "sound/MidiInserter.h"
 #include "sound/SortingInserter.h"
 
 #include <QProgressDialog>
 
+#include <algorithm>
+#include <cstring>  // memcmp()
 #include <fstream>
+#include <functional>
 #include <string>
 #include <sstream>
 
@@ -58,10 +63,7 @@ MidiFile::MidiFile() :
     m_timingDivision(0),
     m_fps(0),
     m_subframes(0),
-    m_fileSize(0),
-    m_trackByteCount(0),
-    m_decrementCount(false),
-    m_bytesRead(0)
+    m_fileSize(0)
 {
 }
 
@@ -72,123 +74,110 @@ MidiFile::~MidiFile()
 }
 
 long
-MidiFile::midiBytesToLong(const std::string &bytes)
+MidiFile::midiBytesToLong(const MidiByte *bytes)
 {
-    if (bytes.length() != 4) {
-        RG_WARNING << "midiBytesToLong(): WARNING: Wrong length for long data (" << bytes.length() << ", should be 4)";
-
-        // TRANSLATOR: "long" is a C++ data type
-        throw Exception(qstrtostr(tr("Wrong length for long data in MIDI stream")));
-    }
-
-    long longRet = static_cast<long>(static_cast<MidiByte>(bytes[0])) << 24 |
-                   static_cast<long>(static_cast<MidiByte>(bytes[1])) << 16 |
-                   static_cast<long>(static_cast<MidiByte>(bytes[2])) << 8 |
-                   static_cast<long>(static_cast<MidiByte>(bytes[3]));
-
-    RG_DEBUG << "midiBytesToLong(" << static_cast<long>(static_cast<MidiByte>(bytes[0])) << "," << static_cast<long>(static_cast<MidiByte>(bytes[1])) << "," << static_cast<long>(static_cast<MidiByte>(bytes[2])) << "," << static_cast<long>(static_cast<MidiByte>(bytes[3])) << ") -> " << longRet;
-
-    return longRet;
+    return static_cast<long>(bytes[0]) << 24 |
+           static_cast<long>(bytes[1]) << 16 |
+           static_cast<long>(bytes[2]) << 8 |
+           static_cast<long>(bytes[3]);
 }
 
 int
-MidiFile::midiBytesToInt(const std::string &bytes)
+MidiFile::midiBytesToInt(const MidiByte *bytes)
 {
-    if (bytes.length() != 2) {
-        RG_WARNING << "midiBytesToInt(): WARNING: Wrong length for int data (" << bytes.length() << ", should be 2)";
-
-        // TRANSLATOR: "int" is a C++ data type
-        throw Exception(qstrtostr(tr("Wrong length for int data in MIDI stream")));
-    }
-
-    return static_cast<int>(static_cast<MidiByte>(bytes[0])) << 8 |
-           static_cast<int>(static_cast<MidiByte>(bytes[1]));
+    return static_cast<int>(bytes[0]) << 8 |
+           static_cast<int>(bytes[1]);
 }
 
-MidiByte
-MidiFile::read(std::ifstream *midiFile)
+namespace
 {
-    return static_cast<MidiByte>(read(midiFile, 1)[0]);
-}
 
-std::string
-MidiFile::read(std::ifstream *midiFile, unsigned long numberOfBytes)
+/// Reads a MIDI file, or a track chunk of one, from memory.
+/**
+ * As reading a byte at a time from the file used to, this throws on
+ * any attempt to read past the end of the track chunk or the file.
+ */
+class MidiFileReader
 {
-    if (midiFile->eof()) {
-        RG_WARNING << "read(): MIDI file EOF - got 0 bytes out of " << numberOfBytes;
-
-        throw Exception(qstrtostr(tr("End of MIDI file encountered while reading")));
-    }
-
-    // For each track section we can read only m_trackByteCount bytes.
-    if (m_decrementCount  &&
-        numberOfBytes > static_cast<unsigned long>(m_trackByteCount)) {
-
-        RG_WARNING << "read(): Attempt to get more bytes than allowed on Track (" << numberOfBytes << " > " << m_trackByteCount << ")";
-
-        throw Exception(qstrtostr(tr("Attempt to get more bytes than expected on Track")));
+public:
+    /**
+     * There are size bytes at data.  If limit is not negative, only
+     * that many of them may be read: the size of a track chunk.
+     */
+    MidiFileReader(const MidiByte *data, size_t size, long limit = -1) :
+        m_data(data),
+        m_size(size),
+        m_position(0),
+        m_limit(limit)
+    { }
+
+    size_t getPosition() const  { return m_position; }
+    /// Number of bytes left to read in the track chunk.
+    long getRemaining() const  { return m_limit; }
+
+    /// Move past numberOfBytes bytes, returning the first of them.
+    const MidiByte *get(unsigned long numberOfBytes);
+
+    MidiByte read()  { return *get(1); }
+    std::string read(unsigned long numberOfBytes)
+    {
+        return std::string(reinterpret_cast<const char *>(get(numberOfBytes)),
+                           numberOfBytes);
     }
 
-    char fileMidiByte;
-    std::string stringRet;
+    /// Read a "variable-length quantity".
+    /**
+     * In case the first byte has already been read, it can be sent
+     * in as firstByte.
+     */
+    long readNumber(int firstByte = -1);
+
+private:
+    const MidiByte *m_data;
+    size_t m_size;
+    size_t m_position;
+    long m_limit;
+};
+
+const MidiByte *
+MidiFileReader::get(unsigned long numberOfBytes)
+{
+    // For each track chunk we can read only m_limit bytes.
+    if (m_limit >= 0  &&
+        numberOfBytes > static_cast<unsigned long>(m_limit)) {
 
-    // ??? Reading one byte at a time is terribly slow.  However, this
-    //     routine is usually called with numberOfBytes == 1.
-    while (stringRet.length() < numberOfBytes  &&
-           midiFile->read(&fileMidiByte, 1)) {
-        stringRet += fileMidiByte;
+        RG_WARNING << "read(): Attempt to get more bytes than allowed on Track (" << numberOfBytes << " > " << m_limit << ")";
 
-        // Kick the event loop to make sure the UI doesn't become
-        // unresponsive during a long load.
-        qApp->processEvents();
+        throw Exception(qstrtostr(MidiFile::tr("Attempt to get more bytes than expected on Track")));
     }
 
     // Unexpected EOF
-    if (stringRet.length() < numberOfBytes) {
-        RG_WARNING << "read(): Attempt to read past file end - got " << stringRet.length() << " bytes out of " << numberOfBytes;
+    if (numberOfBytes > m_size - m_position) {
+        RG_WARNING << "read(): Attempt to read past file end - got " << m_size - m_position << " bytes out of " << numberOfBytes;
 
-        throw Exception(qstrtostr(tr("Attempt to read past MIDI file end")));
+        throw Exception(qstrtostr(MidiFile::tr("Attempt to read past MIDI file end")));
     }
 
-    if (m_decrementCount)
-        m_trackByteCount -= numberOfBytes;
-
-    m_bytesRead += numberOfBytes;
+    const MidiByte *bytes = m_data + m_position;
 
-    // Every 2000 bytes...
-    if (m_bytesRead >= 2000) {
-        m_bytesRead = 0;
+    m_position += numberOfBytes;
 
-        // Update the progress dialog if one is connected.
-        if (m_progressDialog) {
-            if (m_progressDialog->wasCanceled())
-                throw Exception(qstrtostr(tr("Cancelled by user")));
-
-            // This is the first 20% of the "reading" process.
-            int progressValue = static_cast<int>(
-                    static_cast<double>(midiFile->tellg()) /
-                    static_cast<double>(m_fileSize) * 20.0);
-
-            m_progressDialog->setValue(progressValue);
-        }
-    }
+    if (m_limit >= 0)
+        m_limit -= numberOfBytes;
 
-    return stringRet;
+    return bytes;
 }
 
 long
-MidiFile::readNumber(std::ifstream *midiFile, int firstByte)
+MidiFileReader::readNumber(int firstByte)
 {
-    if (midiFile->eof())
-        return 0;
-
     MidiByte midiByte;
 
     // If we already have the first byte, use it
     if (firstByte >= 0) {
         midiByte = static_cast<MidiByte>(firstByte);
     } else {  // read it
-        midiByte = read(midiFile);
+        midiByte = read();
     }
 
     long longRet = midiByte;
@@ -198,47 +187,84 @@ MidiFile::readNumber(std::ifstream *midiFile, int firstByte)
     if (midiByte & 0x80) {
         longRet &= 0x7F;
         do {
-            midiByte = read(midiFile);
+            midiByte = read();
             longRet = (longRet << 7) + (midiByte & 0x7F);
-        } while (!midiFile->eof() && (midiByte & 0x80));
+        } while (midiByte & 0x80);
     }
 
     return longRet;
 }
 
+/// WorkerPool::Job that calls a std::function<void (int)> for a track.
 void
-MidiFile::findNextTrack(std::ifstream *midiFile)
+trackJob(void *work, size_t track, int /* worker */)
+{
+    (*static_cast<std::function<void (int)> *>(work))(static_cast<int>(track));
+}
+
+/// Call work for each of tracks tracks on as many threads as will help,
+/// taking the progress dialog from progressFrom to progressTo meanwhile.
+/**
+ * Returns false if the user cancelled.
+ */
+bool
+forEachTrack(int tracks, std::function<void (int)> work,
+             QPointer<QProgressDialog> progressDialog,
+             int progressFrom, int progressTo)
+{
+    WorkerPool pool(std::min(WorkerPool::getIdealThreadCount(), tracks));
+    pool.start(trackJob, &work, size_t(tracks));
+
+    // Keep the progress dialog going while they work.
+    return pool.wait(progressDialog, progressFrom, progressTo);
+}
+
+}
+
+size_t
+MidiFile::findNextTrack(const MidiByte *data, size_t size, size_t position,
+                        ParsedTrack &track)
 {
+    // If the last track chunk ran past the end of the file, it was
+    // missing no more than its padding byte (or it would have failed
+    // to parse), but there is nothing left to find.
+    if (position > size) {
+        RG_WARNING << "findNextTrack(): Couldn't find Track";
+        throw Exception(qstrtostr(tr("File corrupted or in non-standard format")));
+    }
+
     // Conforms to recommendation in the MIDI spec, section 4, page 3:
     // "Your programs should /expect/ alien chunks and treat them as if
     // they weren't there."  (Emphasis theirs.)
 
-    // Assume not found.
-    m_decrementCount = false;
-    m_trackByteCount = -1;
-
     // For each chunk
-    while (!midiFile->eof()) {
+    while (true) {
+        MidiFileReader reader(data + position, size - position);
+
         // Read the chunk type and size.
-        std::string chunkType = read(midiFile, 4);
-        long chunkSize = midiBytesToLong(read(midiFile, 4));
+        const MidiByte *chunkType = reader.get(4);
+        const unsigned long chunkSize = midiBytesToLong(reader.get(4));
+
+        position += reader.getPosition();
+
+        const size_t available =
+                std::min(static_cast<size_t>(chunkSize), size - position);
 
         // If we've found a track chunk
-        if (chunkType.compare(0, 4, MIDI_TRACK_HEADER) == 0) {
-            m_trackByteCount = chunkSize;
-            m_decrementCount = true;
-            return;
+        if (memcmp(chunkType, MIDI_TRACK_HEADER, 4) == 0) {
+            track.data = data + position;
+            track.size = chunkSize;
+            track.available = available;
+
+            // Past the end of the file, if the chunk runs past it.
+            return available < chunkSize ? size + 1 : position + chunkSize;
         }
 
-        RG_DEBUG << "findNextTrack(): skipping alien chunk.  Type:" << chunkType;
+        RG_DEBUG << "findNextTrack(): skipping alien chunk.  Type:" << std::string(reinterpret_cast<const char *>(chunkType), 4);
 
         // Alien chunk encountered, initiate evasive maneuvers (skip it).
-        midiFile->seekg(chunkSize, std::ios::cur);
+        position += available;
     }
-
-    // Track not found.
-    RG_WARNING << "findNextTrack(): Couldn't find Track";
-    throw Exception(qstrtostr(tr("File corrupted or in non-standard format")));
 }
 
 bool
@@ -248,41 +274,65 @@ MidiFile::read(const QString &filename)
 
     clearMidiComposition();
 
-    // Open the file
-    std::ifstream *midiFile =
-            new std::ifstream(filename.toLocal8Bit(),
-                              std::ios::in | std::ios::binary);
+    // Map the file into memory, or failing that, read it all in.
+    MemoryMappedFile mapped(filename);
+    std::vector<MidiByte> contents;
+    const MidiByte *data = nullptr;
+
+    if (mapped.isValid()) {
+        data = mapped.getData();
+        m_fileSize = mapped.getSize();
+    } else {
+        std::ifstream midiFile(filename.toLocal8Bit(),
+                               std::ios::in | std::ios::binary);
+
+        if (!midiFile) {
+            m_error = "File not found or not readable.";
+            m_format = MIDI_FILE_NOT_LOADED;
+            return false;
+        }
 
-    if (!(*midiFile)) {
-        m_error = "File not found or not readable.";
-        m_format = MIDI_FILE_NOT_LOADED;
-        return false;
+        midiFile.seekg(0, std::ios::end);
+        contents.resize(static_cast<size_t>(midiFile.tellg()));
+        midiFile.seekg(0, std::ios::beg);
+
+        if (!contents.empty()) {
+            midiFile.read(reinterpret_cast<char *>(&contents[0]),
+                          contents.size());
+            contents.resize(static_cast<size_t>(midiFile.gcount()));
+        }
+
+        data = contents.empty() ? nullptr : &contents[0];
+        m_fileSize = contents.size();
     }
 
-    // Compute the file size so we can report progress.
-    midiFile->seekg(0, std::ios::end);
-    m_fileSize = midiFile->tellg();
-    midiFile->seekg(0, std::ios::beg);
+    std::vector<ParsedTrack> tracks;
+
+    // Why the track chunks couldn't all be found, if they couldn't.
+    // This only matters if those that were found parse.
+    std::string findError;
 
     // The parsing process throws string exceptions back up here if we
     // run into trouble which we can then pass back out to whomever
     // called us using m_error and a nice bool.
     try {
         // Parse the MIDI header first.
-        parseHeader(midiFile);
-
-        // For each track chunk in the MIDI file.
-        for (unsigned track = 0; track < m_numberOfTracks; ++track) {
+        size_t position = parseHeader(data, m_fileSize);
 
-            RG_DEBUG << "read(): Parsing MIDI file track " << track;
+        tracks.resize(m_numberOfTracks);
 
-            // Skip any alien chunks.
-            findNextTrack(midiFile);
-
-            RG_DEBUG << "read(): Track has " << m_trackByteCount << " bytes";
+        // Find each track chunk in the MIDI file.
+        for (unsigned track = 0; track < m_numberOfTracks; ++track) {
+            try {
+                position = findNextTrack(data, m_fileSize, position,
+                                         tracks[track]);
+            } catch (const Exception &e) {
+                findError = e.getMessage();
+                tracks.resize(track);
+                break;
+            }
 
-            // Read the track into m_midiComposition.
-            parseTrack(midiFile);
+            RG_DEBUG << "read(): Track " << track << " has " << tracks[track].size << " bytes";
         }
 
     } catch (const Exception &e) {
@@ -293,32 +343,80 @@ MidiFile::read(const QString &filename)
         return false;
     }
 
-    midiFile->close();
+    // Parse the track chunks in parallel.  This is the first 20% of
+    // the "reading" process.
+    const bool cancelled = !forEachTrack(
+            static_cast<int>(tracks.size()),
+            [&tracks](int track) { parseTrack(tracks[track]); },
+            m_progressDialog, 0, 20);
+
+    // The first error in the file wins.
+    std::string error = findError;
+    for (size_t track = 0; track < tracks.size(); ++track) {
+        if (!tracks[track].error.empty()) {
+            error = tracks[track].error;
+            break;
+        }
+    }
+    if (cancelled)
+        error = qstrtostr(tr("Cancelled by user"));
+
+    if (!error.empty()) {
+        RG_WARNING << "read() - caught exception - " << error;
+
+        for (size_t track = 0; track < tracks.size(); ++track) {
+            for (size_t i = 0; i < tracks[track].tracks.size(); ++i) {
+                MidiTrack &midiTrack = tracks[track].tracks[i];
+                for (size_t j = 0; j < midiTrack.size(); ++j)
+                    delete midiTrack[j];
+            }
+        }
+
+        m_error = error;
+        m_format = MIDI_FILE_NOT_LOADED;
+        return false;
+    }
+
+    // Move the tracks into m_midiComposition, in order.
+    for (size_t track = 0; track < tracks.size(); ++track) {
+        ParsedTrack &parsedTrack = tracks[track];
+
+        const TrackId firstTrackId = m_midiComposition.size();
+
+        for (size_t i = 0; i < parsedTrack.tracks.size(); ++i) {
+            const TrackId trackId = firstTrackId + i;
+
+            // Only tracks with events make it into m_midiComposition.
+            if (!parsedTrack.tracks[i].empty())
+                m_midiComposition[trackId].swap(parsedTrack.tracks[i]);
+
+            if (parsedTrack.channels[i] >= 0)
+                m_trackChannelMap[trackId] = parsedTrack.channels[i];
+
+            m_trackNames.push_back(parsedTrack.name);
+        }
+    }
 
     return true;
 }
 
-void
-MidiFile::parseHeader(std::ifstream *midiFile)
+size_t
+MidiFile::parseHeader(const MidiByte *data, size_t size)
 {
-    // The basic MIDI header is 14 bytes.
-    std::string midiHeader = read(midiFile, 14);
+    MidiFileReader reader(data, size);
 
-    if (midiHeader.size() < 14) {
-        RG_WARNING << "parseHeader() - file header undersized";
-        throw Exception(qstrtostr(tr("Not a MIDI file")));
-    }
+    // The basic MIDI header is 14 bytes.
+    const MidiByte *midiHeader = reader.get(14);
 
-    if (midiHeader.compare(0, 4, MIDI_FILE_HEADER) != 0) {
+    if (memcmp(midiHeader, MIDI_FILE_HEADER, 4) != 0) {
         RG_WARNING << "parseHeader() - file header not found or malformed";
         throw Exception(qstrtostr(tr("Not a MIDI file")));
     }
 
-    long chunkSize = midiBytesToLong(midiHeader.substr(4, 4));
-    m_format = static_cast<FileFormatType>(
-            midiBytesToInt(midiHeader.substr(8, 2)));
-    m_numberOfTracks = midiBytesToInt(midiHeader.substr(10, 2));
-    m_timingDivision = midiBytesToInt(midiHeader.substr(12, 2));
+    long chunkSize = midiBytesToLong(midiHeader + 4);
+    m_format = static_cast<FileFormatType>(midiBytesToInt(midiHeader + 8));
+    m_numberOfTracks = midiBytesToInt(midiHeader + 10);
+    m_timingDivision = midiBytesToInt(midiHeader + 12);
     m_timingFormat = MIDI_TIMING_PPQ_TIMEBASE;
 
     if (m_format == MIDI_SEQUENTIAL_TRACK_FILE) {
@@ -334,27 +432,39 @@ MidiFile::parseHeader(std::ifstream *midiFile)
         m_subframes = (m_timingDivision & 0xff);
     }
 
+    size_t position = reader.getPosition();
+
     if (chunkSize > 6) {
         // Skip any remaining bytes in the header chunk.
         // MIDI spec section 4, page 5: "[...] more parameters may be
         // added to the MThd chunk in the future: it is important to
         // read and honor the length, even if it is longer than 6."
-        midiFile->seekg(chunkSize - 6, std::ios::cur);
+        position = std::min(size, position + static_cast<size_t>(chunkSize - 6));
     }
+
+    return position;
 }
 
 static const std::string defaultTrackName = "Imported MIDI";
 
 void
-MidiFile::parseTrack(std::ifstream *midiFile)
+MidiFile::parseTrack(ParsedTrack &parsedTrack)
 {
     // The term "Track" is overloaded in this routine.  The first
     // meaning is a track in the MIDI file.  That is what this routine
     // processes.  A single track from a MIDI file.  The second meaning
-    // is a track in m_midiComposition.  This is the most common usage.
-    // To improve clarity, "MIDI file track" will be used to refer to
-    // the first sense of the term.  Occasionally, "m_midiComposition
-    // track" will be used to refer to the second sense.
+    // is a track in m_midiComposition, here one of parsedTrack.tracks.
+    // This is the most common usage.  To improve clarity, "MIDI file
+    // track" will be used to refer to the first sense of the term.
+    // Occasionally, "m_midiComposition track" will be used to refer to
+    // the second sense.
+
+    parsedTrack.tracks.assign(1, MidiTrack());
+    parsedTrack.channels.assign(1, -1);
+    parsedTrack.name = defaultTrackName;
+
+    MidiFileReader reader(parsedTrack.data, parsedTrack.available,
+                          static_cast<long>(parsedTrack.size));
 
     // Absolute time of the last event on any track.
     unsigned long eventTime = 0;
@@ -363,7 +473,7 @@ MidiFile::parseTrack(std::ifstream *midiFile)
     // all on the same channel.  If we find events on more than one
     // channel, we increment lastTrackNum and record the mapping from
     // channel to trackNum in channelToTrack.
-    TrackId lastTrackNum = m_midiComposition.size();
+    TrackId lastTrackNum = 0;
 
     // MIDI channel to m_midiComposition track.
     // Note: This would be a vector<TrackId> but TrackId is unsigned
@@ -373,14 +483,12 @@ MidiFile::parseTrack(std::ifstream *midiFile)
     // This is used to store the last absolute time found on each track,
     // allowing us to modify delta-times correctly when separating events
     // out from one to multiple tracks
-    std::map<int /*track*/, unsigned long /*lastTime*/> lastEventTime;
-    lastEventTime[lastTrackNum] = 0;
+    std::vector<unsigned long> lastEventTime(1, 0);
 
     // Meta-events don't have a channel, so we place them in a fixed
     // track number instead
-    TrackId metaTrack = lastTrackNum;
+    const TrackId metaTrack = lastTrackNum;
 
-    std::string trackName = defaultTrackName;
     std::string instrumentName;
 
     // Remember the last non-meta status byte (-1 if we haven't seen one)
@@ -388,208 +496,188 @@ MidiFile::parseTrack(std::ifstream *midiFile)
 
     bool firstTrack = true;
 
-    RG_DEBUG << "parseTrack(): last track number is " << lastTrackNum;
-
-    // While there is still data to read in the MIDI file track.
-    // Why "m_trackByteCount > 1" instead of "m_trackByteCount > 0"?  Since
-    // no event and its associated delta time can fit in just one
-    // byte, a single remaining byte in the MIDI file track has to be padding.
-    // This is obscure and non-standard, but such files do exist; ordinarily
-    // there should be no bytes in the MIDI file track after the last event.
-    while (!midiFile->eof()  &&  m_trackByteCount > 1) {
-
-        unsigned long deltaTime = readNumber(midiFile);
-
-        RG_DEBUG << "parseTrack(): read delta time " << deltaTime;
+    try {
+        // While there is still data to read in the MIDI file track.
+        // Why "> 1" instead of "> 0"?  Since no event and its associated
+        // delta time can fit in just one byte, a single remaining byte in
+        // the MIDI file track has to be padding.  This is obscure and
+        // non-standard, but such files do exist; ordinarily there should
+        // be no bytes in the MIDI file track after the last event.
+        while (reader.getRemaining() > 1) {
 
-        // Compute the absolute time for the event.
-        eventTime += deltaTime;
+            unsigned long deltaTime = reader.readNumber();
 
-        // Get a single byte
-        MidiByte midiByte = read(midiFile);
+            RG_DEBUG << "parseTrack(): read delta time " << deltaTime;
 
-        MidiByte statusByte = 0;
-        MidiByte data1 = 0;
+            // Compute the absolute time for the event.
+            eventTime += deltaTime;
 
-        // If this is a status byte, use it.
-        if (midiByte & MIDI_STATUS_BYTE_MASK) {
-            RG_DEBUG << "parseTrack(): have new status byte" << QString("0x%1").arg(midiByte, 0, 16);
+            // Get a single byte
+            MidiByte midiByte = reader.read();
 
-            statusByte = midiByte;
-            data1 = read(midiFile);
-        } else {  // Use running status.
-            // If we haven't seen a status byte yet, fail.
-            if (runningStatus < 0)
-                throw Exception(qstrtostr(tr("Running status used for first event in track")));
+            MidiByte statusByte = 0;
+            MidiByte data1 = 0;
 
-            statusByte = static_cast<MidiByte>(runningStatus);
-            data1 = midiByte;
+            // If this is a status byte, use it.
+            if (midiByte & MIDI_STATUS_BYTE_MASK) {
+                RG_DEBUG << "parseTrack(): have new status byte" << QString("0x%1").arg(midiByte, 0, 16);
 
-            RG_DEBUG << "parseTrack(): using running status (byte " << QString("0x%1").arg(midiByte, 0, 16) << " found)";
-        }
+                statusByte = midiByte;
+                data1 = reader.read();
+            } else {  // Use running status.
+                // If we haven't seen a status byte yet, fail.
+                if (runningStatus < 0)
+                    throw Exception(qstrtostr(tr("Running status used for first event in track")));
 
-        if (statusByte == MIDI_FILE_META_EVENT) {
+                statusByte = static_cast<MidiByte>(runningStatus);
+                data1 = midiByte;
 
-            MidiByte metaEventCode = data1;
-            unsigned messageLength = readNumber(midiFile);
+                RG_DEBUG << "parseTrack(): using running status (byte " << QString("0x%1").arg(midiByte, 0, 16) << " found)";
+            }
 
-            RG_DEBUG << "parseTrack(): Meta event of type " << QString("0x%1").arg(metaEventCode, 0, 16) << " and " << messageLength << " bytes found";
+            if (statusByte == MIDI_FILE_META_EVENT) {
 
-            std::string metaMessage = read(midiFile, messageLength);
+                MidiByte metaEventCode = data1;
+                unsigned messageLength = reader.readNumber();
 
-            // Compute the difference between this event and the previous
-            // event on this track.
-            deltaTime = eventTime - lastEventTime[metaTrack];
-            // Store the absolute time of the last event on this track.
-            lastEventTime[metaTrack] = eventTime;
+                RG_DEBUG << "parseTrack(): Meta event of type " << QString("0x%1").arg(metaEventCode, 0, 16) << " and " << messageLength << " bytes found";
 
-            // create and store our event
-            MidiEvent *e = new MidiEvent(deltaTime,
-                                         MIDI_FILE_META_EVENT,
-                                         metaEventCode,
-                                         metaMessage);
-            m_midiComposition[metaTrack].push_back(e);
+                std::string metaMessage = reader.read(messageLength);
 
-            if (metaEventCode == MIDI_TRACK_NAME)
-                trackName = metaMessage;
-            else if (metaEventCode == MIDI_INSTRUMENT_NAME)
-                instrumentName = metaMessage;
+                // Compute the difference between this event and the previous
+                // event on this track.
+                deltaTime = eventTime - lastEventTime[metaTrack];
+                // Store the absolute time of the last event on this track.
+                lastEventTime[metaTrack] = eventTime;
 
-            // Get the next event.
-            continue;
-        }
-
-        runningStatus = statusByte;
-
-        int channel = (statusByte & MIDI_CHANNEL_NUM_MASK);
-
-        // If this channel hasn't been seen yet in this MIDI file track
-        if (channelToTrack[channel] == -1) {
-            // If this is the first m_midiComposition track we've
-            // used
-            if (firstTrack) {
-                // We've already allocated an m_midiComposition track for
-                // the first channel we encounter.  Use it.
-                firstTrack = false;
-            } else {  // We need a new track.
-                // Allocate a new track for this channel.
-                ++lastTrackNum;
-                lastEventTime[lastTrackNum] = 0;
+                // create and store our event
+                MidiEvent *e = new MidiEvent(deltaTime,
+                                             MIDI_FILE_META_EVENT,
+                                             metaEventCode,
+                                             metaMessage);
+                parsedTrack.tracks[metaTrack].push_back(e);
+
+                if (metaEventCode == MIDI_TRACK_NAME)
+                    parsedTrack.name = metaMessage;
+                else if (metaEventCode == MIDI_INSTRUMENT_NAME)
+                    instrumentName = metaMessage;
+
+                // Get the next event.
+                continue;
             }
 
-            RG_DEBUG << "parseTrack(): new channel map entry: channel " << channel << " -> track " << lastTrackNum;
+            runningStatus = statusByte;
+
+            int channel = (statusByte & MIDI_CHANNEL_NUM_MASK);
+
+            // If this channel hasn't been seen yet in this MIDI file track
+            if (channelToTrack[channel] == -1) {
+                // If this is the first m_midiComposition track we've
+                // used
+                if (firstTrack) {
+                    // We've already allocated an m_midiComposition track for
+                    // the first channel we encounter.  Use it.
+                    firstTrack = false;
+                } else {  // We need a new track.
+                    // Allocate a new track for this channel.
+                    ++lastTrackNum;
+                    parsedTrack.tracks.push_back(MidiTrack());
+                    parsedTrack.channels.push_back(-1);
+                    lastEventTime.push_back(0);
+                }
 
-            channelToTrack[channel] = lastTrackNum;
-            m_trackChannelMap[lastTrackNum] = channel;
-        }
+                RG_DEBUG << "parseTrack(): new channel map entry: channel " << channel << " -> track " << lastTrackNum;
 
-        TrackId trackNum = channelToTrack[channel];
+                channelToTrack[channel] = lastTrackNum;
+                parsedTrack.channels[lastTrackNum] = channel;
+            }
 
-#ifdef DEBUG
-        {
-            static int prevTrackNum = -1;
-            static int prevChannel = -1;
+            TrackId trackNum = channelToTrack[channel];
 
-            // If we're on a different track or channel
-            if (prevTrackNum != static_cast<int>(trackNum)  ||
-                prevChannel != channel) {
+            // Compute the difference between this event and the previous
+            // event on this track.
+            deltaTime = eventTime - lastEventTime[trackNum];
+            // Store the absolute time of the last event on this track.
+            lastEventTime[trackNum] = eventTime;
 
-                // Report it for debugging.
-                RG_DEBUG << "parseTrack(): track number for channel " << channel << " is " << trackNum;
+            switch (statusByte & MIDI_MESSAGE_TYPE_MASK) {
+            case MIDI_NOTE_ON:        // These events have two data bytes.
+            case MIDI_NOTE_OFF:
+            case MIDI_POLY_AFTERTOUCH:
+            case MIDI_CTRL_CHANGE:
+            case MIDI_PITCH_BEND:
+                {
+                    MidiByte data2 = reader.read();
 
-                prevTrackNum = trackNum;
-                prevChannel = channel;
-            }
-        }
-#endif
+                    // create and store our event
+                    MidiEvent *midiEvent =
+                            new MidiEvent(deltaTime, statusByte, data1, data2);
+                    parsedTrack.tracks[trackNum].push_back(midiEvent);
 
-        // Compute the difference between this event and the previous
-        // event on this track.
-        deltaTime = eventTime - lastEventTime[trackNum];
-        // Store the absolute time of the last event on this track.
-        lastEventTime[trackNum] = eventTime;
-
-        switch (statusByte & MIDI_MESSAGE_TYPE_MASK) {
-        case MIDI_NOTE_ON:        // These events have two data bytes.
-        case MIDI_NOTE_OFF:
-        case MIDI_POLY_AFTERTOUCH:
-        case MIDI_CTRL_CHANGE:
-        case MIDI_PITCH_BEND:
-            {
-                MidiByte data2 = read(midiFile);
+                    if (statusByte != MIDI_PITCH_BEND) {
+                        RG_DEBUG << "parseTrack(): MIDI event for channel " << channel + 1 << " (track " << trackNum << ')';
+                        RG_DEBUG << *midiEvent;
+                    }
+                }
+                break;
 
-                // create and store our event
-                MidiEvent *midiEvent =
-                        new MidiEvent(deltaTime, statusByte, data1, data2);
-                m_midiComposition[trackNum].push_back(midiEvent);
+            case MIDI_PROG_CHANGE:    // These events have a single data byte.
+            case MIDI_CHNL_AFTERTOUCH:
+                {
+                    RG_DEBUG << "parseTrack(): Program change (Cn) or channel aftertouch (Dn): time " << deltaTime << ", code " << QString("0x%1").arg(statusByte, 0, 16) << ", data " << (int) data1  << " going to track " << trackNum;
 
-                if (statusByte != MIDI_PITCH_BEND) {
-                    RG_DEBUG << "parseTrack(): MIDI event for channel " << channel + 1 << " (track " << trackNum << ')';
-                    RG_DEBUG << *midiEvent;
+                    // create and store our event
+                    MidiEvent *midiEvent =
+                            new MidiEvent(deltaTime, statusByte, data1);
+                    parsedTrack.tracks[trackNum].push_back(midiEvent);
                 }
-            }
-            break;
+                break;
 
-        case MIDI_PROG_CHANGE:    // These events have a single data byte.
-        case MIDI_CHNL_AFTERTOUCH:
-            {
-                RG_DEBUG << "parseTrack(): Program change (Cn) or channel aftertouch (Dn): time " << deltaTime << ", code " << QString("0x%1").arg(statusByte, 0, 16) << ", data " << (int) data1  << " going to track " << trackNum;
+            case MIDI_SYSTEM_EXCLUSIVE:
+                {
+                    unsigned messageLength = reader.readNumber(data1);
 
-                // create and store our event
-                MidiEvent *midiEvent =
-                        new MidiEvent(deltaTime, statusByte, data1);
-                m_midiComposition[trackNum].push_back(midiEvent);
-            }
-            break;
+                    RG_DEBUG << "parseTrack(): SysEx of " << messageLength << " bytes found";
 
-        case MIDI_SYSTEM_EXCLUSIVE:
-            {
-                unsigned messageLength = readNumber(midiFile, data1);
+                    std::string sysex = reader.read(messageLength);
 
-                RG_DEBUG << "parseTrack(): SysEx of " << messageLength << " bytes found";
+                    if (sysex.empty()  ||
+                        MidiByte(sysex[sysex.length() - 1]) !=
+                            MIDI_END_OF_EXCLUSIVE) {
+                        RG_WARNING << "parseTrack() - malformed or unsupported SysEx type";
+                        continue;
+                    }
 
-                std::string sysex = read(midiFile, messageLength);
+                    // Chop off the EOX.
+                    sysex = sysex.substr(0, sysex.length() - 1);
 
-                if (MidiByte(sysex[sysex.length() - 1]) !=
-                        MIDI_END_OF_EXCLUSIVE) {
-                    RG_WARNING << "parseTrack() - malformed or unsupported SysEx type";
-                    continue;
+                    // create and store our event
+                    MidiEvent *midiEvent =
+                            new MidiEvent(deltaTime,
+                                          MIDI_SYSTEM_EXCLUSIVE,
+                                          sysex);
+                    parsedTrack.tracks[trackNum].push_back(midiEvent);
                 }
+                break;
 
-                // Chop off the EOX.
-                sysex = sysex.substr(0, sysex.length() - 1);
+            case MIDI_END_OF_EXCLUSIVE:
+                RG_WARNING << "parseTrack() - Found a stray MIDI_END_OF_EXCLUSIVE";
+                break;
 
-                // create and store our event
-                MidiEvent *midiEvent =
-                        new MidiEvent(deltaTime,
-                                      MIDI_SYSTEM_EXCLUSIVE,
-                                      sysex);
-                m_midiComposition[trackNum].push_back(midiEvent);
+            default:
+                RG_WARNING << "parseTrack() - Unsupported MIDI Status Byte:  " << QString("0x%1").arg(statusByte, 0, 16);
+                break;
             }
-            break;
-
-        case MIDI_END_OF_EXCLUSIVE:
-            RG_WARNING << "parseTrack() - Found a stray MIDI_END_OF_EXCLUSIVE";
-            break;
-
-        default:
-            RG_WARNING << "parseTrack() - Unsupported MIDI Status Byte:  " << QString("0x%1").arg(statusByte, 0, 16);
-            break;
         }
+    } catch (const Exception &e) {
+        // read() reports it, if nothing before it in the file went
+        // wrong first.
+        parsedTrack.error = e.getMessage();
+        return;
     }
 
-    // If the MIDI file track has a padding byte, read and discard it
-    // to make sure that the stream is positioned at the beginning of
-    // the following MIDI file track (if there is one.)
-    if (m_trackByteCount == 1)
-        midiFile->ignore();
-
     if (instrumentName != "")
-        trackName += " (" + instrumentName + ")";
-
-    // Fill out the Track Names
-    for (TrackId i = metaTrack; i <= lastTrackNum; ++i)
-        m_trackNames.push_back(trackName);
+        parsedTrack.name += " (" + instrumentName + ")";
 }
 
 bool
@@ -670,6 +758,38 @@ MidiFile::convertToRosegarden(const QString &filename, RosegardenDocument *doc)
         }
     }
 
+    std::vector<MidiTrack *> midiTracks;
+    for (TrackId trackId = 0;
+         trackId < m_midiComposition.size();
+         ++trackId) {
+        midiTracks.push_back(&m_midiComposition[trackId]);
+    }
+
+    // Convert the event times from delta to absolute, then consolidate
+    // NOTE ON and NOTE OFF events into NOTE ON events with a duration,
+    // the tracks in parallel.
+    auto convertTrack = [&midiTracks](int track) {
+        MidiTrack &midiTrack = *midiTracks[track];
+
+        timeT absTime = 0;
+
+        for (MidiTrack::iterator eventIter = midiTrack.begin();
+             eventIter != midiTrack.end();
+             ++eventIter) {
+            absTime += (*eventIter)->getTime();
+            (*eventIter)->setTime(absTime);
+        }
+
+        consolidateNoteEvents(midiTrack);
+    };
+
+    // 20% to 50% for this, and the rest for the conversion below.
+    if (!forEachTrack(static_cast<int>(midiTracks.size()), convertTrack,
+                      m_progressDialog, 20, 50)) {
+        m_error = qstrtostr(tr("Cancelled by user"));
+        return false;
+    }
+
     const int rosegardenPPQ = Note(Note::Crotchet).getDuration();
     const int midiFilePPQ = m_timingDivision ? m_timingDivision : 96;
     // Conversion factor.
@@ -701,10 +821,11 @@ MidiFile::convertToRosegarden(const QString &filename, RosegardenDocument *doc)
                 return false;
             }
 
-            // 20% total in file import itself (see read()) and then 80%
-            // split over the tracks.
-            int progressValue = 20 + static_cast<int>(
-                    80.0 * trackId / m_midiComposition.size());
+            // 20% total in file import itself (see read()), 30% for
+            // the consolidation above, and then 50% split over the
+            // tracks.
+            int progressValue = 50 + static_cast<int>(
+                    50.0 * trackId / m_midiComposition.size());
 
             //RG_DEBUG << "convertToRosegarden() progressValue: " << progressValue;
 
@@ -714,21 +835,6 @@ MidiFile::convertToRosegarden(const QString &filename, RosegardenDocument *doc)
         // Kick the event loop.
         qApp->processEvents();
 
-        timeT absTime = 0;
-
-        // Convert the event times from delta to absolute for
-        // consolidateNoteEvents().
-        for (MidiTrack::iterator eventIter = m_midiComposition[trackId].begin();
-             eventIter != m_midiComposition[trackId].end();
-             ++eventIter) {
-            absTime += (*eventIter)->getTime();
-            (*eventIter)->setTime(absTime);
-        }
-
-        // Consolidate NOTE ON and NOTE OFF events into NOTE ON events with
-        // a duration.
-        consolidateNoteEvents(trackId);
-
         InstrumentId instrumentId = MidiInstrumentBase;
 
         // If this track has a channel, use that channel's instrument.
@@ -1361,83 +1467,81 @@ MidiFile::convertToMidi(RosegardenDocument *doc, const QString &filename)
 }
 
 void
-MidiFile::writeInt(std::ofstream *midiFile, int number)
+MidiFile::writeInt(std::string &buffer, int number)
 {
-    *midiFile << static_cast<MidiByte>((number & 0xFF00) >> 8);
-    *midiFile << static_cast<MidiByte>(number & 0x00FF);
+    buffer += static_cast<char>((number & 0xFF00) >> 8);
+    buffer += static_cast<char>(number & 0x00FF);
 }
 
 void
-MidiFile::writeLong(std::ofstream *midiFile, unsigned long number)
+MidiFile::writeLong(std::string &buffer, unsigned long number)
 {
-    *midiFile << static_cast<MidiByte>((number & 0xFF000000) >> 24);
-    *midiFile << static_cast<MidiByte>((number & 0x00FF0000) >> 16);
-    *midiFile << static_cast<MidiByte>((number & 0x0000FF00) >> 8);
-    *midiFile << static_cast<MidiByte>(number & 0x000000FF);
+    buffer += static_cast<char>((number & 0xFF000000) >> 24);
+    buffer += static_cast<char>((number & 0x00FF0000) >> 16);
+    buffer += static_cast<char>((number & 0x0000FF00) >> 8);
+    buffer += static_cast<char>(number & 0x000000FF);
 }
 
-std::string
-MidiFile::longToVarBuffer(unsigned long value)
+void
+MidiFile::writeNumber(std::string &buffer, unsigned long value)
 {
     // See WriteVarLen() in the MIDI Spec section 4, page 11.
 
-    // Convert value into a "variable-length quantity" in buffer.
+    // Convert value into a "variable-length quantity" in varBuffer.
 
     // Start with the lowest 7 bits of the number
-    long buffer = value & 0x7f;
+    long varBuffer = value & 0x7f;
 
     while ((value >>= 7 ) > 0) {
-        buffer <<= 8;
-        buffer |= 0x80;
-        buffer += (value & 0x7f);
+        varBuffer <<= 8;
+        varBuffer |= 0x80;
+        varBuffer += (value & 0x7f);
     }
 
-    // Copy buffer to returnString and return it.
-
-    std::string returnString;
+    // Append varBuffer to buffer.
 
     while (true) {
-        returnString += (MidiByte)(buffer & 0xff);
-        if (buffer & 0x80)
-            buffer >>= 8;
+        buffer += static_cast<char>(varBuffer & 0xff);
+        if (varBuffer & 0x80)
+            varBuffer >>= 8;
         else
             break;
     }
-
-    return returnString;
 }
 
 void
-MidiFile::writeHeader(std::ofstream *midiFile)
+MidiFile::writeHeader(std::string &buffer)
 {
     // Our identifying Header string
-    *midiFile << MIDI_FILE_HEADER;
+    buffer += MIDI_FILE_HEADER;
 
     // Write number of Bytes to follow
-    *midiFile << static_cast<MidiByte>(0x00);
-    *midiFile << static_cast<MidiByte>(0x00);
-    *midiFile << static_cast<MidiByte>(0x00);
-    *midiFile << static_cast<MidiByte>(0x06);
-
-    writeInt(midiFile, static_cast<int>(m_format));
-    writeInt(midiFile, m_numberOfTracks);
-    writeInt(midiFile, m_timingDivision);
+    writeLong(buffer, 6);
+
+    writeInt(buffer, static_cast<int>(m_format));
+    writeInt(buffer, m_numberOfTracks);
+    writeInt(buffer, m_timingDivision);
 }
 
 void
-MidiFile::writeTrack(std::ofstream *midiFile, TrackId trackNumber)
+MidiFile::writeTrack(std::string &buffer, TrackId trackNumber)
 {
     // For running status.
     MidiByte previousEventCode = 0;
 
-    // First we write into trackBuffer, then we write trackBuffer
-    // out to the file with its accompanying length.
+    // The track goes straight on the end of buffer, and its length
+    // is filled in once we know it.
 
-    std::string trackBuffer;
+    buffer += MIDI_TRACK_HEADER;
+    const size_t lengthPosition = buffer.length();
+    writeLong(buffer, 0);
 
     // Used to accumulate time deltas for skipped events.
     timeT skippedTime = 0;
 
+    // Counter for kicking the event loop.
+    int eventCount = 0;
+
     // For each event in the Track
     for (MidiTrack::iterator i = m_midiComposition[trackNumber].begin();
          i != m_midiComposition[trackNumber].end();
@@ -1466,7 +1570,7 @@ MidiFile::writeTrack(std::ofstream *midiFile, TrackId trackNumber)
         }
 
         // Add the time to the buffer in MIDI format
-        trackBuffer += longToVarBuffer(midiEvent.getTime() + skippedTime);
+        writeNumber(buffer, midiEvent.getTime() + skippedTime);
 
         skippedTime = 0;
 
@@ -1477,12 +1581,11 @@ MidiFile::writeTrack(std::ofstream *midiFile, TrackId trackNumber)
         RG_DEBUG << midiEvent;
 
         if (midiEvent.isMeta()) {
-            trackBuffer += MIDI_FILE_META_EVENT;
-            trackBuffer += midiEvent.getMetaEventCode();
+            buffer += MIDI_FILE_META_EVENT;
+            buffer += midiEvent.getMetaEventCode();
 
-            trackBuffer += longToVarBuffer(midiEvent.
-                                           getMetaMessage().length());
-            trackBuffer += midiEvent.getMetaMessage();
+            writeNumber(buffer, midiEvent.getMetaMessage().length());
+            buffer += midiEvent.getMetaMessage();
 
             // Meta events cannot use running status.
             previousEventCode = 0;
@@ -1497,7 +1600,7 @@ MidiFile::writeTrack(std::ofstream *midiFile, TrackId trackNumber)
                 (midiEvent.getEventCode() == MIDI_SYSTEM_EXCLUSIVE)) {
 
                 // Send the normal event code (with encoded channel information)
-                trackBuffer += midiEvent.getEventCode();
+                buffer += midiEvent.getEventCode();
 
                 previousEventCode = midiEvent.getEventCode();
             }
@@ -1508,19 +1611,18 @@ MidiFile::writeTrack(std::ofstream *midiFile, TrackId trackNumber)
             case MIDI_PITCH_BEND:
             case MIDI_CTRL_CHANGE:
             case MIDI_POLY_AFTERTOUCH:
-                trackBuffer += midiEvent.getData1();
-                trackBuffer += midiEvent.getData2();
+                buffer += midiEvent.getData1();
+                buffer += midiEvent.getData2();
                 break;
 
             case MIDI_PROG_CHANGE:  // These have one data byte.
             case MIDI_CHNL_AFTERTOUCH:
-                trackBuffer += midiEvent.getData1();
+                buffer += midiEvent.getData1();
                 break;
 
             case MIDI_SYSTEM_EXCLUSIVE:
-                trackBuffer +=
-                        longToVarBuffer(midiEvent.getMetaMessage().length());
-                trackBuffer += midiEvent.getMetaMessage();
+                writeNumber(buffer, midiEvent.getMetaMessage().length());
+                buffer += midiEvent.getMetaMessage();
                 break;
 
             default:
@@ -1529,15 +1631,15 @@ MidiFile::writeTrack(std::ofstream *midiFile, TrackId trackNumber)
             }
         }
 
-        // Kick the event loop to keep the UI responsive.
-        qApp->processEvents();
+        // Kick the event loop now and then to keep the UI responsive.
+        if (++eventCount % 1000 == 0)
+            qApp->processEvents();
     }
 
-    // Now we write the track to the file.
-
-    *midiFile << MIDI_TRACK_HEADER;
-    writeLong(midiFile, trackBuffer.length());
-    *midiFile << trackBuffer;
+    // Now that we know it, fill in the track's length.
+    std::string length;
+    writeLong(length, buffer.length() - lengthPosition - 4);
+    buffer.replace(lengthPosition, 4, length);
 }
 
 bool
@@ -1552,11 +1654,14 @@ MidiFile::write(const QString &filename)
         return false;
     }
 
-    writeHeader(&midiFile);
+    // Put the whole file together, then write it out in one go.
+    std::string buffer;
 
-    // For each track, write it out.
+    writeHeader(buffer);
+
+    // For each track, add it.
     for (TrackId i = 0; i < m_numberOfTracks; ++i) {
-        writeTrack(&midiFile, i);
+        writeTrack(buffer, i);
 
         if (m_progressDialog  &&  m_progressDialog->wasCanceled())
             return false;
@@ -1565,21 +1670,37 @@ MidiFile::write(const QString &filename)
             m_progressDialog->setValue(i * 100 / m_numberOfTracks);
     }
 
+    midiFile.write(buffer.data(), buffer.length());
     midiFile.close();
 
+    if (!midiFile) {
+        RG_WARNING << "write() - failed writing file";
+        return false;
+    }
+
     return true;
 }
 
 void
-MidiFile::consolidateNoteEvents(TrackId trackId)
+MidiFile::consolidateNoteEvents(MidiTrack &track)
 {
-    MidiTrack &track = m_midiComposition[trackId];
+    if (track.empty())
+        return;
+
+    // Matched note-offs are deleted and left as null pointers, then
+    // cleared out of the track in one go at the end, rather than erased
+    // from the middle of it one at a time.
+
+    // The last event that's still on the track.
+    size_t lastEvent = track.size() - 1;
 
     // For each MIDI event on the track.
-    for (MidiTrack::iterator firstEventIter = track.begin();
-         firstEventIter != track.end();
-         ++firstEventIter) {
-        MidiEvent &firstEvent = **firstEventIter;
+    for (size_t first = 0; first < track.size(); ++first) {
+        // Already removed?  Try the next event.
+        if (!track[first])
+            continue;
+
+        MidiEvent &firstEvent = *track[first];
 
         // Not a note-on?  Try the next event.
         if (firstEvent.getMessageType() != MIDI_NOTE_ON)
@@ -1594,13 +1715,13 @@ MidiFile::consolidateNoteEvents(TrackId trackId)
 
         bool noteOffFound = false;
 
-        MidiTrack::iterator secondEventIter;
-
         // For each following MIDI event
-        for (secondEventIter = firstEventIter + 1;
-             secondEventIter != track.end();
-             ++secondEventIter) {
-            const MidiEvent &secondEvent = **secondEventIter;
+        for (size_t second = first + 1; second < track.size(); ++second) {
+            // Already removed?  Try the next event.
+            if (!track[second])
+                continue;
+
+            const MidiEvent &secondEvent = *track[second];
 
             bool noteOff = (secondEvent.getMessageType() == MIDI_NOTE_OFF  ||
                     (secondEvent.getMessageType() == MIDI_NOTE_ON  &&
@@ -1634,21 +1755,27 @@ MidiFile::consolidateNoteEvents(TrackId trackId)
             firstEvent.setDuration(noteDuration);
 
             // Remove the note-off.
-            delete *secondEventIter;
-            track.erase(secondEventIter);
+            delete track[second];
+            track[second] = nullptr;
+
+            // firstEvent is still there, so this stops at it at worst.
+            while (!track[lastEvent])
+                --lastEvent;
 
             noteOffFound = true;
             break;
         }
 
         if (!noteOffFound) {
-            // avoid crash due to secondEventIter == track.end()
-            --secondEventIter;
             // Set Event duration to length of Segment.
             firstEvent.setDuration(
-                    (*secondEventIter)->getTime() - firstEvent.getTime());
+                    track[lastEvent]->getTime() - firstEvent.getTime());
         }
     }
+
+    track.erase(std::remove(track.begin(), track.end(),
+                            static_cast<MidiEvent *>(nullptr)),
+                track.end());
 }
 
 void
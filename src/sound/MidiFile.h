@@ -123,68 +123,92 @@ private:
     // *** Standard MIDI File to Rosegarden
 
     /// Read a MIDI file into m_midiComposition.
+    /**
+     * The file is mapped into memory (or, failing that, read in all at
+     * once), and its track chunks are parsed in parallel.
+     */
     bool read(const QString &filename);
-    void parseHeader(std::ifstream *midiFile);
-    /// Convert a track to events in m_midiComposition.
-    void parseTrack(std::ifstream *midiFile);
+    /// Parse the header chunk, returning the offset of the chunk after it.
+    size_t parseHeader(const MidiByte *data, size_t size);
+
+    /// A MIDI file track, parsed apart from the others.
+    /**
+     * Its m_midiComposition tracks are numbered from 0 here: the first
+     * for meta events and the first channel found, and one more for
+     * each further channel.  read() renumbers them as it moves them
+     * into m_midiComposition.
+     */
+    struct ParsedTrack
+    {
+        ParsedTrack() : data(nullptr), size(0), available(0)  { }
+
+        /// The chunk, after its type and size.
+        const MidiByte *data;
+        /// The size the chunk says it is.
+        unsigned long size;
+        /// How much of that is actually in the file.
+        size_t available;
+
+        std::vector<MidiTrack> tracks;
+        /// MIDI channel for each track, -1 if none.
+        std::vector<int> channels;
+        std::string name;
+
+        /// Why parsing failed, empty if it didn't.
+        std::string error;
+    };
+    /// Find the next track chunk at or after position.
+    /**
+     * Skips alien chunks.  Returns the offset of the chunk after it.
+     */
+    size_t findNextTrack(const MidiByte *data, size_t size, size_t position,
+                         ParsedTrack &track);
+    /// Convert a track chunk to events.
+    /**
+     * Touches nothing but track, so tracks can be parsed on separate
+     * threads.
+     */
+    static void parseTrack(ParsedTrack &track);
+
     // m_midiComposition track to MIDI channel.
     std::map<TrackId, int /*channel*/> m_trackChannelMap;
     // Names for each track.
     std::vector<std::string> m_trackNames;
-    /// Find the next track chunk and set m_trackByteCount.
-    void findNextTrack(std::ifstream *midiFile);
     /// Combine each note-on/note-off pair into a single note event with a duration.
-    void consolidateNoteEvents(TrackId trackId);
+    /**
+     * Expects absolute times.  Touches nothing but track, so tracks
+     * can be consolidated on separate threads.
+     */
+    static void consolidateNoteEvents(MidiTrack &track);
     /// Configure the Instrument based on events in Segment at time 0.
     static void configureInstrument(
             Track *track, Segment *segment, Instrument *instrument);
 
-    // Read
-    /// Read a "variable-length quantity" from the MIDI byte stream.
-    /**
-     * In case the first byte has already been read, it can be sent
-     * in as firstByte.
-     */
-    long readNumber(std::ifstream *midiFile, int firstByte = -1);
-    MidiByte read(std::ifstream *midiFile);
-    std::string read(std::ifstream *midiFile,
-                     unsigned long numberOfBytes);
-
     // Conversion
-    int midiBytesToInt(const std::string &bytes);
-    long midiBytesToLong(const std::string &bytes);
+    static int midiBytesToInt(const MidiByte *bytes);
+    static long midiBytesToLong(const MidiByte *bytes);
 
     size_t m_fileSize;
-    /// Number of bytes left to read in the current track.
-    long m_trackByteCount;
-    /// Allow decrementing of m_trackByteCount while reading.
-    /**
-     * Set to true while processing a track.  false while processing other
-     * parts of the file.
-     */
-    bool m_decrementCount;
-
-    /// Counter for kicking the message loop.
-    int m_bytesRead;
 
     std::string m_error;
 
     // *** Rosegarden to Standard MIDI File
 
     /// Write m_midiComposition to a MIDI file.
+    /**
+     * The whole file is put together in memory and written in one go.
+     */
     bool write(const QString &filename);
-    void writeHeader(std::ofstream *midiFile);
-    void writeTrack(std::ofstream *midiFile, TrackId trackNumber);
+    void writeHeader(std::string &buffer);
+    void writeTrack(std::string &buffer, TrackId trackNumber);
 
     // Write
-    /// Write an int as 2 bytes.
-    void writeInt(std::ofstream *midiFile, int number);
-    /// Write a long as 4 bytes.
-    void writeLong(std::ofstream *midiFile, unsigned long number);
-
-    // Conversion
-    /// Convert a value to a "variable-length quantity" in a std::string.
-    std::string longToVarBuffer(unsigned long value);
+    /// Append an int as 2 bytes.
+    static void writeInt(std::string &buffer, int number);
+    /// Append a long as 4 bytes.
+    static void writeLong(std::string &buffer, unsigned long number);
+    /// Append a value as a "variable-length quantity".
+    static void writeNumber(std::string &buffer, unsigned long value);
 
     // *** Misc
 
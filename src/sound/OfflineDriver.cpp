@@ -0,0 +1,454 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[OfflineDriver]"
+
+#include "OfflineDriver.h"
+
+#include "AudioProcess.h"
+#include "MappedStudio.h"
+#include "PlayableAudioFile.h"
+#include "RingBuffer.h"
+#include "RunnablePluginInstance.h"
+#include "audiostream/AudioWriteStream.h"
+#include "audiostream/AudioWriteStreamFactory.h"
+#include "base/AudioLevel.h"
+#include "base/Instrument.h"
+
+#include "misc/Debug.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+
+//#define DEBUG_OFFLINE_DRIVER 1
+
+namespace Rosegarden
+{
+
+
+OfflineDriver::OfflineDriver(MappedStudio *studio, unsigned int sampleRate,
+                             size_t blockSize) :
+    DummyDriver(studio),
+    m_sampleRate(sampleRate),
+    m_blockSize(blockSize),
+    m_now(RealTime::zeroTime),
+    m_fileReader(nullptr),
+    m_instrumentMixer(nullptr),
+    m_bussMixer(nullptr),
+    m_masterLevel(0.0),
+    m_scratch(blockSize)
+{
+    m_name = "OfflineDriver - render to file";
+    m_driverStatus = AUDIO_OK;
+
+    // The sequencer's defaults.
+    setAudioBufferSizes(RealTime(0, 60000000), RealTime(2, 500000000),
+                        RealTime(4, 0), 256);
+
+    m_master[0].resize(blockSize);
+    m_master[1].resize(blockSize);
+    m_interleaved.resize(blockSize * 2);
+
+    // As JackDriver::initialise(), less the threads.  We do the
+    // threads' work in render() instead.
+    m_fileReader = new AudioFileReader(this, m_sampleRate);
+    m_instrumentMixer = new AudioInstrumentMixer
+        (this, m_fileReader, m_sampleRate, m_blockSize);
+    m_bussMixer = new AudioBussMixer
+        (this, m_instrumentMixer, m_sampleRate, m_blockSize);
+    m_instrumentMixer->setBussMixer(m_bussMixer);
+}
+
+OfflineDriver::~OfflineDriver()
+{
+    m_instrumentMixer->destroyAllPlugins();
+
+    delete m_bussMixer;
+    delete m_instrumentMixer;
+    delete m_fileReader;
+}
+
+QString
+OfflineDriver::getStatusLog()
+{
+    return QString("Rendering offline at %1Hz, %2 frames per block")
+        .arg(m_sampleRate).arg(m_blockSize);
+}
+
+void
+OfflineDriver::getAudioInstrumentNumbers(InstrumentId &base, int &count)
+{
+    base = AudioInstrumentBase;
+    count = AudioInstrumentCount;
+}
+
+void
+OfflineDriver::getSoftSynthInstrumentNumbers(InstrumentId &base, int &count)
+{
+    base = SoftSynthInstrumentBase;
+    count = SoftSynthInstrumentCount;
+}
+
+void
+OfflineDriver::setAudioBussLevels(int bussId, float dB, float pan)
+{
+    m_bussMixer->setBussLevels(bussId, dB, pan);
+}
+
+void
+OfflineDriver::setAudioInstrumentLevels(InstrumentId id, float dB, float pan)
+{
+    m_instrumentMixer->setInstrumentLevels(id, dB, pan);
+}
+
+void
+OfflineDriver::setPluginInstance(InstrumentId id, QString identifier,
+                                 int position)
+{
+    m_instrumentMixer->setPlugin(id, position, identifier);
+}
+
+void
+OfflineDriver::removePluginInstance(InstrumentId id, int position)
+{
+    m_instrumentMixer->removePlugin(id, position);
+}
+
+void
+OfflineDriver::setPluginInstancePortValue(InstrumentId id, int position,
+                                          unsigned long portNumber,
+                                          float value)
+{
+    m_instrumentMixer->setPluginPortValue(id, position, portNumber, value);
+}
+
+float
+OfflineDriver::getPluginInstancePortValue(InstrumentId id, int position,
+                                          unsigned long portNumber)
+{
+    return m_instrumentMixer->getPluginPortValue(id, position, portNumber);
+}
+
+void
+OfflineDriver::setPluginInstanceBypass(InstrumentId id, int position,
+                                       bool value)
+{
+    m_instrumentMixer->setPluginBypass(id, position, value);
+}
+
+void
+OfflineDriver::setPluginInstanceProgram(InstrumentId id, int position,
+                                        QString program)
+{
+    m_instrumentMixer->setPluginProgram(id, position, program);
+}
+
+QString
+OfflineDriver::configurePlugin(InstrumentId id, int position,
+                               QString key, QString value)
+{
+    return m_instrumentMixer->configurePlugin(id, position, key, value);
+}
+
+void
+OfflineDriver::claimUnwantedPlugin(void *plugin)
+{
+    m_pluginScavenger.claim((RunnablePluginInstance *)plugin);
+}
+
+void
+OfflineDriver::scavengePlugins()
+{
+    m_pluginScavenger.scavenge();
+}
+
+RunnablePluginInstance *
+OfflineDriver::getSynthPlugin(InstrumentId id)
+{
+    return m_instrumentMixer->getSynthPlugin(id);
+}
+
+void
+OfflineDriver::setThreadCount(int threads)
+{
+    m_instrumentMixer->setThreadCount(threads);
+}
+
+void
+OfflineDriver::updateAudioData()
+{
+    m_masterLevel = 0.0;
+
+    MappedAudioBuss *mbuss = getMappedStudio()->getAudioBuss(0);
+    if (mbuss) {
+        float level = 0.0;
+        (void)mbuss->getProperty(MappedAudioBuss::Level, level);
+        m_masterLevel = level;
+    }
+
+    InstrumentId audioInstrumentBase;
+    int audioInstruments;
+    getAudioInstrumentNumbers(audioInstrumentBase, audioInstruments);
+
+    InstrumentId synthInstrumentBase;
+    int synthInstruments;
+    getSoftSynthInstrumentNumbers(synthInstrumentBase, synthInstruments);
+
+    m_directToMaster.assign(audioInstruments + synthInstruments, false);
+
+    for (int i = 0; i < audioInstruments + synthInstruments; ++i) {
+
+        InstrumentId id;
+        if (i < audioInstruments)
+            id = audioInstrumentBase + i;
+        else
+            id = synthInstrumentBase + (i - audioInstruments);
+
+        MappedAudioFader *fader = getMappedStudio()->getAudioFader(id);
+        if (!fader)
+            continue;
+
+        // Connected to no output, or to the master.
+        MappedObjectValueList connections =
+            fader->getConnections(MappedConnectableObject::Out);
+        m_directToMaster[i] = (connections.empty() ||
+                               (mbuss && *connections.begin() == mbuss->getId()));
+    }
+
+    // Unlike JackDriver, leave the instruments' mute states alone.
+    // They come from the ControlBlock's tracks, and rendering without
+    // a document there are none, which would mute everything.
+    m_bussMixer->updateInstrumentConnections();
+}
+
+bool
+OfflineDriver::render(const RealTime &start, const RealTime &end,
+                      const QString &fileName)
+{
+    AudioWriteStream *stream =
+        AudioWriteStreamFactory::createWriteStream(fileName, 2, m_sampleRate);
+    if (!stream) {
+        RG_WARNING << "render(): Can't write" << fileName;
+        return false;
+    }
+
+    const bool ok = render(start, end, stream);
+    delete stream;
+    return ok;
+}
+
+bool
+OfflineDriver::render(const RealTime &start, const RealTime &end,
+                      AudioWriteStream *stream)
+{
+    m_statistics = Statistics();
+
+    if (!stream || stream->getChannelCount() != 2 ||
+        stream->getSampleRate() != m_sampleRate) {
+        RG_WARNING << "render(): Need a stereo stream at" << m_sampleRate << "Hz";
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // As JackDriver::prebufferAudio(), from the start.
+    updateAudioData();
+    m_instrumentMixer->resetAllPlugins(false);
+
+    const RealTime blockDuration =
+        RealTime::frame2RealTime(m_blockSize, m_sampleRate);
+
+    m_now = start;
+    m_playStartPosition = start;
+    m_playing = true;
+
+    // Prebuffering mixes the first block.
+    prepareBlock(start, start + blockDuration);
+
+    m_fileReader->fillBuffers(start);
+    if (m_bussMixer->getBussCount() > 0) {
+        m_bussMixer->fillBuffers(start); // also calls on m_instrumentMixer
+    } else {
+        m_instrumentMixer->fillBuffers(start);
+    }
+
+    // The file reader tops up every file's ring buffer when it's
+    // kicked, so it only needs to be kicked a few times per buffer.
+    const RealTime readInterval = getAudioReadBufferLength() / 4;
+    RealTime nextRead = start + readInterval;
+
+    const float gain = AudioLevel::dB_to_multiplier(m_masterLevel);
+
+    const size_t totalFrames =
+        (end > start) ? RealTime::realTime2Frame(end - start, m_sampleRate) : 0;
+
+    bool ok = true;
+
+    while (m_statistics.frames < totalFrames) {
+
+        // The mixers keep a block ahead of the one we read, so this
+        // block's kick mixes the next one.
+        prepareBlock(m_now, m_now + blockDuration + blockDuration);
+
+        if (m_now >= nextRead) {
+            m_fileReader->kick(false);
+            nextRead = m_now + readInterval;
+        }
+
+        m_instrumentMixer->kick(false);
+        if (m_bussMixer->getBussCount() > 0)
+            m_bussMixer->kick(false, false);
+
+        processBlock();
+
+        const size_t frames =
+            std::min(m_blockSize, totalFrames - m_statistics.frames);
+
+        for (size_t i = 0; i < frames; ++i) {
+            for (int ch = 0; ch < 2; ++ch) {
+                const float sample = m_master[ch][i] * gain;
+                m_statistics.peak = std::max(m_statistics.peak,
+                                             std::fabs(sample));
+                m_interleaved[i * 2 + ch] = sample;
+            }
+        }
+
+        if (!stream->putInterleavedFrames(frames, &m_interleaved[0])) {
+            RG_WARNING << "render(): Write failed:" << stream->getError();
+            ok = false;
+            break;
+        }
+
+        m_statistics.frames += frames;
+        m_now = m_now + blockDuration;
+    }
+
+    m_playing = false;
+
+    // Not playing any more, so return the ring buffers and defunct
+    // plugins now rather than leaving them for the next render.
+    const AudioPlayQueue::FileSet &files = getAudioQueue()->getAllScheduledFiles();
+    for (AudioPlayQueue::FileSet::const_iterator fi = files.begin();
+         fi != files.end(); ++fi) {
+        (*fi)->clearBuffers();
+    }
+    scavengePlugins();
+
+    m_statistics.seconds = timer.nsecsElapsed() / 1000000000.0;
+    if (m_statistics.seconds > 0) {
+        m_statistics.realtimeFactor =
+            (double(m_statistics.frames) / m_sampleRate) / m_statistics.seconds;
+    }
+
+    RG_DEBUG << "render(): rendered" << m_statistics.frames << "frames in"
+             << m_statistics.seconds << "s, realtime factor"
+             << m_statistics.realtimeFactor << ", peak" << m_statistics.peak
+             << "," << m_statistics.underruns << "underruns";
+
+    return ok;
+}
+
+void
+OfflineDriver::processBlock()
+{
+    std::fill(m_master[0].begin(), m_master[0].end(), 0.0f);
+    std::fill(m_master[1].begin(), m_master[1].end(), 0.0f);
+
+    bool underrun = false;
+
+    // Mix the busses, which have already mixed the instruments on
+    // them, and then the instruments that go straight to the master.
+
+    const int bussCount = m_bussMixer->getBussCount();
+
+    for (int buss = 0; buss < bussCount; ++buss) {
+        for (int ch = 0; ch < 2; ++ch) {
+
+            RingBuffer<AudioBussMixer::sample_t> *rb =
+                m_bussMixer->getRingBuffer(buss, ch);
+
+            if (!rb || m_bussMixer->isBussDormant(buss)) {
+                if (rb)
+                    rb->skip(m_blockSize);
+                continue;
+            }
+
+            if (rb->read(&m_scratch[0], m_blockSize) < m_blockSize)
+                underrun = true;
+
+            for (size_t i = 0; i < m_blockSize; ++i)
+                m_master[ch][i] += m_scratch[i];
+        }
+    }
+
+    InstrumentId audioInstrumentBase;
+    int audioInstruments;
+    getAudioInstrumentNumbers(audioInstrumentBase, audioInstruments);
+
+    InstrumentId synthInstrumentBase;
+    int synthInstruments;
+    getSoftSynthInstrumentNumbers(synthInstrumentBase, synthInstruments);
+
+    for (int i = 0; i < audioInstruments + synthInstruments; ++i) {
+
+        InstrumentId id;
+        if (i < audioInstruments)
+            id = audioInstrumentBase + i;
+        else
+            id = synthInstrumentBase + (i - audioInstruments);
+
+        if (m_instrumentMixer->isInstrumentEmpty(id))
+            continue;
+
+        const bool directToMaster =
+            (i < int(m_directToMaster.size()) && m_directToMaster[i]);
+
+        for (int ch = 0; ch < 2; ++ch) {
+
+            RingBuffer<AudioInstrumentMixer::sample_t, 2> *rb =
+                m_instrumentMixer->getRingBuffer(id, ch);
+            if (!rb)
+                continue;
+
+            if (m_instrumentMixer->isInstrumentDormant(id)) {
+                rb->skip(m_blockSize);
+            } else {
+                if (rb->read(&m_scratch[0], m_blockSize) < m_blockSize)
+                    underrun = true;
+                if (directToMaster) {
+                    for (size_t f = 0; f < m_blockSize; ++f)
+                        m_master[ch][f] += m_scratch[f];
+                }
+            }
+
+            // The buss mixer's reader, which it doesn't use for
+            // instruments that aren't on a buss.
+            if (directToMaster)
+                rb->skip(m_blockSize, 1);
+        }
+    }
+
+    if (underrun) {
+#ifdef DEBUG_OFFLINE_DRIVER
+        RG_DEBUG << "processBlock(): underrun at" << m_now;
+#endif
+        ++m_statistics.underruns;
+    }
+}
+
+
+}
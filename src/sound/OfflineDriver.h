@@ -0,0 +1,169 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_OFFLINEDRIVER_H
+#define RG_OFFLINEDRIVER_H
+
+#include <rosegardenprivate_export.h>
+
+#include "DummyDriver.h"
+#include "Scavenger.h"
+#include "base/RealTime.h"
+
+#include <QString>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+class AudioFileReader;
+class AudioInstrumentMixer;
+class AudioBussMixer;
+class AudioWriteStream;
+class RunnablePluginInstance;
+
+/// Render the studio's master out to a file, as fast as the CPU allows.
+/**
+ * Plays the audio queue and the soft synths through the same file
+ * reader, instrument mixer and buss mixer that JackDriver uses, and
+ * mixes the master as JackDriver's process callback does.  But there
+ * is no JACK and there are no audio threads: render() moves the clock
+ * on a block at a time as soon as the last block is mixed.
+ *
+ * Set it up as the sequencer would set up any driver -- add the audio
+ * files, initialiseAudioQueue(), and create the studio's busses and
+ * faders and plugins -- then render().  Plugin and level changes made
+ * through the MappedStudio reach the mixers through the SoundDriver
+ * calls below, as they do with JackDriver.
+ *
+ * Soft synths are played from the events sent to them with
+ * getSynthPlugin()->sendEvent(), timed in song time.  A subclass can
+ * send them a block ahead at a time in prepareBlock().
+ */
+class ROSEGARDENPRIVATE_EXPORT OfflineDriver : public DummyDriver
+{
+public:
+    OfflineDriver(MappedStudio *studio, unsigned int sampleRate,
+                  size_t blockSize = 1024);
+    ~OfflineDriver() override;
+
+    QString getStatusLog() override;
+
+    unsigned int getSampleRate() const override  { return m_sampleRate; }
+    size_t getBlockSize() const  { return m_blockSize; }
+
+    /// The start of the block being mixed, while rendering.
+    RealTime getSequencerTime() override  { return m_now; }
+
+    void getAudioInstrumentNumbers(InstrumentId &base, int &count) override;
+    void getSoftSynthInstrumentNumbers(InstrumentId &base, int &count) override;
+
+    void setAudioBussLevels(int bussId, float dB, float pan) override;
+    void setAudioInstrumentLevels(InstrumentId id, float dB, float pan) override;
+
+    void setPluginInstance(InstrumentId id, QString identifier,
+                           int position) override;
+    void removePluginInstance(InstrumentId id, int position) override;
+    void setPluginInstancePortValue(InstrumentId id, int position,
+                                    unsigned long portNumber,
+                                    float value) override;
+    float getPluginInstancePortValue(InstrumentId id, int position,
+                                     unsigned long portNumber) override;
+    void setPluginInstanceBypass(InstrumentId id, int position,
+                                 bool value) override;
+    void setPluginInstanceProgram(InstrumentId id, int position,
+                                  QString program) override;
+    QString configurePlugin(InstrumentId id, int position,
+                            QString key, QString value) override;
+
+    void claimUnwantedPlugin(void *plugin) override;
+    void scavengePlugins() override;
+
+    /// The synth on a soft synth instrument, to send events to.
+    RunnablePluginInstance *getSynthPlugin(InstrumentId id);
+
+    /// Threads for processing instruments.  See AudioInstrumentMixer.
+    void setThreadCount(int threads);
+
+    /// Render from start to end into the stream, which must be stereo
+    /// at our sample rate.  Returns false if the stream fails.
+    bool render(const RealTime &start, const RealTime &end,
+                AudioWriteStream *stream);
+
+    /// Render from start to end into a new file of a type
+    /// AudioWriteStreamFactory knows from its extension.
+    bool render(const RealTime &start, const RealTime &end,
+                const QString &fileName);
+
+    struct Statistics
+    {
+        Statistics() :
+            frames(0), seconds(0), realtimeFactor(0), peak(0), underruns(0)
+        { }
+
+        /// Frames rendered.
+        size_t frames;
+        /// Wall clock time taken.
+        double seconds;
+        /// Seconds of audio rendered per second taken.
+        double realtimeFactor;
+        /// The largest sample on either master channel.
+        float peak;
+        /// Blocks an instrument or buss had too few frames for.
+        int underruns;
+    };
+
+    /// How the last render() went.
+    const Statistics &getStatistics() const  { return m_statistics; }
+
+protected:
+    /// Called before each block is mixed, with the song time the mixers
+    /// may have reached by the end of it.  Send soft synths the events
+    /// up to then here.  Default does nothing.
+    virtual void prepareBlock(const RealTime & /*blockStart*/,
+                              const RealTime & /*mixedTo*/)  { }
+
+private:
+    /// What JackDriver::updateAudioData() works out before playing:
+    /// the master level and which instruments skip the busses.
+    void updateAudioData();
+
+    /// Mix one block into m_master, as JackDriver::jackProcess() does.
+    void processBlock();
+
+    unsigned int m_sampleRate;
+    size_t m_blockSize;
+    RealTime m_now;
+
+    AudioFileReader *m_fileReader;
+    AudioInstrumentMixer *m_instrumentMixer;
+    AudioBussMixer *m_bussMixer;
+
+    float m_masterLevel;
+    std::vector<bool> m_directToMaster;
+
+    std::vector<float> m_scratch;
+    std::vector<float> m_master[2];
+    std::vector<float> m_interleaved;
+
+    Scavenger<RunnablePluginInstance> m_pluginScavenger;
+
+    Statistics m_statistics;
+};
+
+
+}
+
+#endif
@@ -15,7 +15,9 @@
 #define RG_MODULE_STRING "[PeakFile]"
 
 #include <algorithm>  // std::max()
+#include <climits>  // INT_MAX
 #include <cmath>  // std::fabs()
+#include <cstring>  // memcpy()
 #include <unistd.h>  // usleep()
 #include <iostream>
 #include <string>
@@ -28,9 +30,11 @@
 
 #include "PeakFile.h"
 #include "AudioFile.h"
+#include "MemoryMappedFile.h"
 #include "base/Profiler.h"
 #include "misc/Debug.h"
 #include "misc/Strings.h"
+#include "misc/WorkerPool.h"
 
 //#define DEBUG_PEAKFILE 1
 //#define DEBUG_PEAKFILE_BRIEF 1
@@ -50,10 +54,264 @@ static const float SAMPLE_MAX_8BIT  = (float)(0xff);
 static const float SAMPLE_MAX_16BIT = (float)(0xffff/2);
 static const float SAMPLE_MAX_24BIT = (float)(0xffffff/2);
 static const char AUDIO_BWF_PEAK_ID[] = "levl";  // BWF peak chunk id
+static const char PEAK_LEVELS_ID[] = "mipl";  // our levels, in reserved space
+static const int PEAK_LEVEL_FACTOR = 8;
+static const int PEAK_MAX_LEVELS = 8;
+static const int PEAK_CHUNK_BLOCKS = 1024;  // blocks per writePeaks() job
 
 namespace Rosegarden
 {
 
+
+namespace
+{
+
+
+/// A peak value as getPreview() has always read it.
+inline int
+decodePeakValue(const unsigned char *data, int format)
+{
+    int value = 0;
+    for (int b = 0; b < format; ++b)
+        value += int(data[b]) << (8 * b);
+
+    const int divisor = (format == 1) ? int(SAMPLE_MAX_8BIT) : int(SAMPLE_MAX_16BIT);
+    while (value > divisor)
+        value -= (1 << (format * 8));
+
+    return value;
+}
+
+inline void
+encodePeakValue(int value, int format, unsigned char *data)
+{
+    for (int b = 0; b < format; ++b)
+        data[b] = (unsigned char)((unsigned(value) >> (8 * b)) & 0xff);
+}
+
+
+/// Peaks for the next level up: for every factor peaks, their
+/// highest high and lowest low.  Highs count towards the low too, so
+/// that every high in the block is known to lie between the two even
+/// where a clipped float sample has wrapped round.
+std::string
+decimatePeaks(const std::string &peaks, int channels, int format, int factor)
+{
+    const int peakBytes = channels * format * 2;
+    const int sourcePeaks = int(peaks.length() / peakBytes);
+    const int levelPeaks = (sourcePeaks + factor - 1) / factor;
+
+    const unsigned char *source = (const unsigned char *)peaks.data();
+    std::string level(size_t(levelPeaks) * peakBytes, '\0');
+    unsigned char *target = (unsigned char *)&level[0];
+
+    for (int peak = 0; peak < levelPeaks; ++peak) {
+
+        const int first = peak * factor;
+        const int last = std::min(first + factor, sourcePeaks);
+
+        for (int ch = 0; ch < channels; ++ch) {
+
+            const unsigned char *value =
+                source + size_t(first) * peakBytes + ch * format * 2;
+            int high = decodePeakValue(value, format);
+            int low = std::min(high, decodePeakValue(value + format, format));
+
+            for (int p = first + 1; p < last; ++p) {
+                value += peakBytes;
+                const int h = decodePeakValue(value, format);
+                high = std::max(high, h);
+                low = std::min(low, std::min(h, decodePeakValue(value + format, format)));
+            }
+
+            encodePeakValue(high, format, target);
+            target += format;
+            encodePeakValue(low, format, target);
+            target += format;
+        }
+    }
+
+    return level;
+}
+
+/// Turns whole blocks of samples into level 0 peak data.
+class PeakCalculator
+{
+public:
+    PeakCalculator(int channels, int bytes, int blockSize, int format) :
+        m_channels(channels),
+        m_bytes(bytes),
+        m_blockSize(blockSize),
+        m_format(format)
+    { }
+
+    int getBlockSize() const  { return m_blockSize; }
+    int getBlockBytes() const  { return m_blockSize * m_channels * m_bytes; }
+    int getPeakBytes() const  { return m_channels * m_format * 2; }
+
+    /// Write the peaks of each block to peaks.
+    /**
+     * Also finds the loudest sample, and its frame counting from the
+     * start of data.  Ties go to the earlier one.
+     */
+    void calculate(const unsigned char *samplePtr, int blocks,
+                   unsigned char *peaks,
+                   int &peakOfPeaks, int &positionPeakOfPeaks) const;
+
+private:
+    int m_channels;
+    int m_bytes;
+    int m_blockSize;
+    int m_format;
+};
+
+void
+PeakCalculator::calculate(const unsigned char *samplePtr, int blocks,
+                          unsigned char *peaks,
+                          int &peakOfPeaks, int &positionPeakOfPeaks) const
+{
+    std::vector<int> highs(m_channels), lows(m_channels);
+
+    int sampleValue;
+    int sampleFrameCount = 0;
+
+    peakOfPeaks = 0;
+    positionPeakOfPeaks = 0;
+
+    for (int block = 0; block < blocks; ++block) {
+
+        for (int i = 0; i < m_blockSize; i++) {
+            for (int ch = 0; ch < m_channels; ch++) {
+                // Single byte format values range from 0-255 and then
+                // shifted down about the x-axis.  Double byte and above
+                // are already centred about x-axis.
+                //
+                if (m_bytes == 1) {
+                    sampleValue = int(*samplePtr) - 128;
+                } else if (m_bytes == 2) {
+                    unsigned int bits = (samplePtr[1] << 8) + samplePtr[0];
+                    sampleValue = (short)bits;
+                } else if (m_bytes == 3) {
+                    unsigned int bits = (samplePtr[2] << 24) +
+                                        (samplePtr[1] << 16) +
+                                        (samplePtr[0] << 8);
+                    // write out as 16-bit (m_format == 2)
+                    sampleValue = int(bits) / 65536;
+                } else {
+                    // IEEE float (enforced by RIFFAudioFile), written
+                    // out as 16-bit (m_format == 2)
+                    float val;
+                    memcpy(&val, samplePtr, sizeof(float));
+                    sampleValue = (int)(32767.0 * val);
+                }
+                samplePtr += m_bytes;
+
+                if (i == 0) {
+                    highs[ch] = sampleValue;
+                    lows[ch] = sampleValue;
+                } else {
+                    if (sampleValue > highs[ch])
+                        highs[ch] = sampleValue;
+                    if (sampleValue < lows[ch])
+                        lows[ch] = sampleValue;
+                }
+
+                if (std::abs(sampleValue) > peakOfPeaks) {
+                    peakOfPeaks = std::abs(sampleValue);
+                    positionPeakOfPeaks = sampleFrameCount;
+                }
+            }
+
+            sampleFrameCount++;
+        }
+
+        // Absolute peak data in channel order, little endian
+        //
+        for (int ch = 0; ch < m_channels; ++ch) {
+            encodePeakValue(highs[ch], m_format, peaks);
+            peaks += m_format;
+            encodePeakValue(lows[ch], m_format, peaks);
+            peaks += m_format;
+        }
+    }
+}
+
+/// Level 0 peaks for a memory-mapped audio file, shared out in chunks
+/// on a WorkerPool.
+class PeakJob
+{
+public:
+    PeakJob(const PeakCalculator &calculator, const unsigned char *samples,
+            int blocks, unsigned char *peaks) :
+        m_calculator(calculator),
+        m_samples(samples),
+        m_blocks(blocks),
+        m_peaks(peaks),
+        m_chunks((blocks + PEAK_CHUNK_BLOCKS - 1) / PEAK_CHUNK_BLOCKS),
+        m_peakOfPeaks(m_chunks, 0),
+        m_positionPeakOfPeaks(m_chunks, 0)
+    { }
+
+    int getChunks() const  { return m_chunks; }
+
+    /// WorkerPool::Job to calculate one chunk.
+    static void run(void *job, size_t chunk, int worker);
+
+    /// Loudest sample and its frame, once all chunks are done.
+    void getPeakOfPeaks(int &peakOfPeaks, int &position) const;
+
+private:
+    const PeakCalculator &m_calculator;
+    const unsigned char *m_samples;
+    int m_blocks;
+    unsigned char *m_peaks;
+    int m_chunks;
+
+    // Per chunk, so each thread writes only its own.
+    std::vector<int> m_peakOfPeaks;
+    std::vector<int> m_positionPeakOfPeaks;
+};
+
+void
+PeakJob::run(void *job, size_t chunk, int /* worker */)
+{
+    PeakJob *peakJob = static_cast<PeakJob *>(job);
+
+    const int first = int(chunk) * PEAK_CHUNK_BLOCKS;
+    const int blocks = std::min(PEAK_CHUNK_BLOCKS, peakJob->m_blocks - first);
+    const PeakCalculator &calculator = peakJob->m_calculator;
+
+    calculator.calculate(
+            peakJob->m_samples + size_t(first) * calculator.getBlockBytes(),
+            blocks,
+            peakJob->m_peaks + size_t(first) * calculator.getPeakBytes(),
+            peakJob->m_peakOfPeaks[chunk],
+            peakJob->m_positionPeakOfPeaks[chunk]);
+
+#if TEST_PROGRESS_DIALOG
+    // Slow things down so we can test the progress dialog.
+    usleep(100000);
+#endif
+}
+
+void
+PeakJob::getPeakOfPeaks(int &peakOfPeaks, int &position) const
+{
+    peakOfPeaks = 0;
+    position = 0;
+
+    for (int chunk = 0; chunk < m_chunks; ++chunk) {
+        if (m_peakOfPeaks[chunk] > peakOfPeaks) {
+            peakOfPeaks = m_peakOfPeaks[chunk];
+            position = m_positionPeakOfPeaks[chunk] +
+                    chunk * PEAK_CHUNK_BLOCKS * m_calculator.getBlockSize();
+        }
+    }
+}
+
+}
+
+
 PeakFile::PeakFile(AudioFile *audioFile) :
         SoundFile(audioFile->getPeakFilename()),
         m_audioFile(audioFile),
@@ -66,6 +324,7 @@ PeakFile::PeakFile(AudioFile *audioFile) :
         m_positionPeakOfPeaks(0),
         m_offsetToPeaks(0),
         m_bodyBytes(0),
+        m_levelFactor(PEAK_LEVEL_FACTOR),
         m_modificationTime(QDate(1970, 1, 1), QTime(0, 0, 0)),
         m_chunkStartPosition(0),
         m_lastPreviewStartTime(0, 0),
@@ -148,6 +407,24 @@ PeakFile::parseHeader()
     m_numberOfPeaks = getIntegerFromLittleEndian(header.substr(28, 4));
     m_positionPeakOfPeaks = getIntegerFromLittleEndian(header.substr(32, 4));
 
+    // Our levels, if this is one of our files and it has any
+    //
+    m_levelPeaks.assign(1, m_numberOfPeaks);
+    m_levelFactor = PEAK_LEVEL_FACTOR;
+
+    if (header.compare(68, 4, PEAK_LEVELS_ID) == 0) {
+        int levels = getIntegerFromLittleEndian(header.substr(72, 4));
+        int factor = getIntegerFromLittleEndian(header.substr(76, 4));
+
+        if (levels > 1 && levels <= PEAK_MAX_LEVELS && factor > 1) {
+            m_levelFactor = factor;
+            for (int level = 1; level < levels; ++level) {
+                m_levelPeaks.push_back(getIntegerFromLittleEndian(
+                        header.substr(80 + (level - 1) * 4, 4)));
+            }
+        }
+    }
+
     // Read in date string and convert it up to QDateTime
     //
     QString dateString = QString(header.substr(40, 28).c_str());
@@ -296,6 +573,17 @@ PeakFile::close()
     dateString += "     ";
     putBytes(m_outFile, dateString);
 
+    // Our levels, in the reserved space after the date
+    //
+    m_outFile->seekp(m_chunkStartPosition + std::streamoff(68), std::ios::beg);
+
+    std::string levels = PEAK_LEVELS_ID;
+    levels += getLittleEndianFromInteger(getLevels(), 4);
+    levels += getLittleEndianFromInteger(m_levelFactor, 4);
+    for (int level = 1; level < getLevels(); ++level)
+        levels += getLittleEndianFromInteger(m_levelPeaks[level], 4);
+    putBytes(m_outFile, levels);
+
     // Ok, now close and tidy up
     //
     m_outFile->close();
@@ -309,6 +597,10 @@ PeakFile::isValid()
     if (m_audioFile->getModificationDateTime() > m_modificationTime)
         return false;
 
+    // Written before we had levels, and long enough to want them
+    if (getLevels() == 1 && m_numberOfPeaks >= m_levelFactor)
+        return false;
+
     return true;
 }
 
@@ -399,8 +691,26 @@ PeakFile::writeHeader(std::ofstream *file)
     putBytes(file, header);
 }
 
+int
+PeakFile::getLevelSpan(int level) const
+{
+    int span = 1;
+    for (int i = 0; i < level; ++i)
+        span *= m_levelFactor;
+    return span;
+}
+
+int
+PeakFile::getLevelOffset(int level) const
+{
+    int offset = 0;
+    for (int i = 0; i < level && i < int(m_levelPeaks.size()); ++i)
+        offset += m_levelPeaks[i];
+    return offset;
+}
+
 bool
-PeakFile::scanToPeak(int peak)
+PeakFile::scanToPeak(int peak, int level)
 {
     if (!m_inFile)
         return false;
@@ -411,7 +721,8 @@ PeakFile::scanToPeak(int peak)
     // Scan to start of chunk and then seek to peak number
     //
     ssize_t pos = (ssize_t)m_chunkStartPosition + 128 +
-                  peak * m_format * m_channels * m_pointsPerValue;
+                  ssize_t(getLevelOffset(level) + peak) *
+                      m_format * m_channels * m_pointsPerValue;
 
     ssize_t off = pos - m_inFile->tellg();
 
@@ -474,172 +785,162 @@ PeakFile::writePeaks(std::ofstream *file)
     RG_DEBUG << "writePeaks() - calculating peaks";
 #endif
 
-    // Scan to beginning of audio data
-    m_audioFile->scanTo(RealTime(0, 0));
-
-    // Store our samples
-    //
-    std::vector<std::pair<int, int> > channelPeaks;
-    std::string samples;
-    unsigned char *samplePtr;
-
-    int sampleValue;
-    int sampleMax = 0 ;
-    int sampleFrameCount = 0;
-
     int channels = m_audioFile->getChannels();
     int bytes = m_audioFile->getBitsPerSample() / 8;
 
+    if (bytes < 1 || bytes > 4)
+        throw(BadSoundFileException(m_fileName, "PeakFile::writePeaks - unsupported bit depth"));
+
     m_format = bytes;
     if (bytes == 3 || bytes == 4) // 24-bit PCM or 32-bit float
         m_format = 2; // write 16-bit PCM instead
 
-    // for the progress dialog
-    size_t apprxTotalBytes = m_audioFile->getSize();
-    size_t byteCount = 0;
-
-    for (int i = 0; i < channels; i++)
-        channelPeaks.push_back(std::pair<int, int>());
-
     // clear down info
     m_numberOfPeaks = 0;
     m_bodyBytes = 0;
     m_positionPeakOfPeaks = 0;
+    m_levelPeaks.clear();
+    m_levelFactor = PEAK_LEVEL_FACTOR;
 
-    // ??? Block count?  How does this differ from m_numberOfPeaks?
-    int ct = 0;
+    // and anything cached from the old data
+    m_peakCache.clear();
+    m_lastPreviewCache.clear();
+    m_lastPreviewWidth = -1;
+
+    std::string peaks;
+    if (!calculatePeaks(peaks))
+        return;
+
+    const int peakBytes = channels * m_format * 2;
+
+    m_numberOfPeaks = int(peaks.length() / peakBytes);
+    m_levelPeaks.push_back(m_numberOfPeaks);
 
-    // ??? for each block...?
+    // Write level 0, then each level from the one before it for as
+    // long as they keep getting smaller.
+    //
     while (true) {
-        try {
-            // Read a block
-            samples = m_audioFile->
-                      getBytes(m_blockSize * channels * bytes);
-        } catch (const BadSoundFileException &e) {
-            RG_WARNING << "writePeaks():" << e.getMessage();
-            break;
-        }
+        putBytes(file, peaks);
+        m_bodyBytes += int(peaks.length());
 
-        // If no bytes or less than the total number of bytes are returned
-        // then break out
-        //
-        if (samples.length() == 0 ||
-            samples.length() < (m_blockSize * m_audioFile->getChannels()
-                                * bytes))
+        if (getLevels() == PEAK_MAX_LEVELS ||
+            m_levelPeaks.back() < m_levelFactor)
             break;
 
-        byteCount += samples.length();
-
-#if !TEST_PROGRESS_DIALOG
-        // ??? Every 2000 blocks?  That's around 2Mbytes?
-        if (ct % 2000 == 0) {
-#else
-// Testing the progress dialogs.
-        // Slow things down so we can test the progress dialog.
-        usleep(10000);
+        peaks = decimatePeaks(peaks, channels, m_format, m_levelFactor);
+        m_levelPeaks.push_back(int(peaks.length() / peakBytes));
+    }
 
-        // ??? Every 10 blocks?  That's around 10kbytes!
-        if (ct % 10 == 0) {
+#ifdef DEBUG_PEAKFILE
+    RG_DEBUG << "writePeaks() - completed peaks";
 #endif
-            int progress = static_cast<int>(double(byteCount) /
-                    double(apprxTotalBytes) * 100.0);
 
-            //RG_DEBUG << "writePeaks(): progress" << progress;
+}
 
-            if (m_progressDialog) {
-                if (m_progressDialog->wasCanceled())
-                    break;
+bool
+PeakFile::calculatePeaks(std::string &peaks)
+{
+    const int channels = m_audioFile->getChannels();
+    const int bytes = m_audioFile->getBitsPerSample() / 8;
 
-                m_progressDialog->setValue(progress);
-            }
+    const PeakCalculator calculator(channels, bytes, m_blockSize, m_format);
+    const size_t blockBytes = calculator.getBlockBytes();
+    const size_t peakBytes = calculator.getPeakBytes();
 
-            qApp->processEvents(QEventLoop::AllEvents);
-        }
-        ++ct;
+    int peakOfPeaks = 0;
 
-        samplePtr = (unsigned char *)samples.c_str();
+    // If we can map the audio file, share it out between threads.
+    //
+    const std::streamoff dataOffset = m_audioFile->getDataOffset();
+    if (dataOffset >= 0) {
 
-        for (int i = 0; i < m_blockSize; i++) {
-            for (unsigned int ch = 0; ch < m_audioFile->getChannels(); ch++) {
-                // Single byte format values range from 0-255 and then
-                // shifted down about the x-axis.  Double byte and above
-                // are already centred about x-axis.
-                //
-                if (bytes == 1) {
-                    // get value
-                    sampleValue = int(*samplePtr) - 128;
-                    samplePtr++;
-                } else if (bytes == 2) {
-                    unsigned char b2 = samplePtr[0];
-                    unsigned char b1 = samplePtr[1];
-                    unsigned int bits = (b1 << 8) + b2;
-                    sampleValue = (short)bits;
-                    samplePtr += 2;
-                } else if (bytes == 3) {
-                    unsigned char b3 = samplePtr[0];
-                    unsigned char b2 = samplePtr[1];
-                    unsigned char b1 = samplePtr[2];
-                    unsigned int bits = (b1 << 24) + (b2 << 16) + (b3 << 8);
+        MemoryMappedFile mapped(m_audioFile->getFilename());
 
-                    // write out as 16-bit (m_format == 2)
-                    sampleValue = int(bits) / 65536;
+        if (mapped.isValid() && size_t(dataOffset) <= mapped.getSize()) {
 
-                    samplePtr += 3;
-                } else if (bytes == 4)  // IEEE float (enforced by RIFFAudioFile)
-                {
-                    // write out as 16-bit (m_format == 2)
-                    float val = *(float *)samplePtr;
-                    sampleValue = (int)(32767.0 * val);
-                    samplePtr += 4;
-                } else {
-                    throw(BadSoundFileException(m_fileName, "PeakFile::writePeaks - unsupported bit depth"));
-                }
+            const int blocks =
+                int((mapped.getSize() - size_t(dataOffset)) / blockBytes);
 
-                // First time for each channel
-                //
-                if (i == 0) {
-                    channelPeaks[ch].first = sampleValue;
-                    channelPeaks[ch].second = sampleValue;
-                } else {
-                    // Compare and store
-                    //
-                    if (sampleValue > channelPeaks[ch].first)
-                        channelPeaks[ch].first = sampleValue;
+            peaks.assign(size_t(blocks) * peakBytes, '\0');
 
-                    if (sampleValue < channelPeaks[ch].second)
-                        channelPeaks[ch].second = sampleValue;
-                }
+            PeakJob job(calculator, mapped.getData() + dataOffset, blocks,
+                        (unsigned char *)&peaks[0]);
 
-                // Store peak of peaks if it fits
-                //
-                if (std::abs(sampleValue) > sampleMax) {
-                    sampleMax = std::abs(sampleValue);
-                    m_positionPeakOfPeaks = sampleFrameCount;
-                }
-            }
+            WorkerPool pool(std::min(WorkerPool::getIdealThreadCount(),
+                                     job.getChunks()));
+            pool.start(PeakJob::run, &job, size_t(job.getChunks()));
 
-            // for peak of peaks as well as frame count
-            sampleFrameCount++;
+            // Keep the progress dialog going while they work.
+            const bool finished = pool.wait(m_progressDialog);
+
+            job.getPeakOfPeaks(peakOfPeaks, m_positionPeakOfPeaks);
+
+            return finished;
         }
+    }
 
-        // Write absolute peak data in channel order
-        //
-        for (unsigned int i = 0; i < m_audioFile->getChannels(); i++) {
-            putBytes(file, getLittleEndianFromInteger(channelPeaks[i].first,
-                     m_format));
-            putBytes(file, getLittleEndianFromInteger(channelPeaks[i].second,
-                     m_format));
-            m_bodyBytes += m_format * 2;
+    // Otherwise read through the audio file a chunk at a time.
+    //
+    m_audioFile->scanTo(RealTime(0, 0));
+
+    peaks.clear();
+
+    std::string samples;
+    std::string chunkPeaks(PEAK_CHUNK_BLOCKS * peakBytes, '\0');
+    int blocksDone = 0;
+
+    // for the progress dialog
+    size_t apprxTotalBytes = m_audioFile->getSize();
+    size_t byteCount = 0;
+
+    while (true) {
+        try {
+            samples = m_audioFile->getBytes(PEAK_CHUNK_BLOCKS * blockBytes);
+        } catch (const BadSoundFileException &e) {
+            RG_WARNING << "calculatePeaks():" << e.getMessage();
+            break;
         }
 
-        // increment number of peak frames
-        m_numberOfPeaks++;
-    }
+        const int blocks = int(samples.length() / blockBytes);
 
-#ifdef DEBUG_PEAKFILE
-    RG_DEBUG << "writePeaks() - completed peaks";
+        int chunkPeakOfPeaks;
+        int chunkPosition;
+        calculator.calculate((const unsigned char *)samples.data(), blocks,
+                             (unsigned char *)&chunkPeaks[0],
+                             chunkPeakOfPeaks, chunkPosition);
+
+        peaks.append(chunkPeaks, 0, blocks * peakBytes);
+
+        if (chunkPeakOfPeaks > peakOfPeaks) {
+            peakOfPeaks = chunkPeakOfPeaks;
+            m_positionPeakOfPeaks = blocksDone * m_blockSize + chunkPosition;
+        }
+
+        blocksDone += blocks;
+        byteCount += samples.length();
+
+        if (blocks < PEAK_CHUNK_BLOCKS)
+            break;
+
+#if TEST_PROGRESS_DIALOG
+        // Slow things down so we can test the progress dialog.
+        usleep(100000);
 #endif
 
+        int progress = static_cast<int>(double(byteCount) /
+                double(apprxTotalBytes) * 100.0);
+
+        if (m_progressDialog) {
+            if (m_progressDialog->wasCanceled())
+                return false;
+
+            m_progressDialog->setValue(progress);
+        }
+
+        qApp->processEvents(QEventLoop::AllEvents);
+    }
+
+    return true;
 }
 
 std::vector<float>
@@ -719,6 +1020,24 @@ PeakFile::getPreview(const RealTime &startTime,
     if (startPeak > endPeak)
         return m_lastPreviewCache;
 
+    // Use the coarsest level that still has a peak or more per pixel.
+    //
+    int level = 0;
+    if (width > 0) {
+        double peaksPerPixel = double(endPeak - startPeak) / double(width);
+        while (level + 1 < getLevels() && peaksPerPixel >= m_levelFactor) {
+            ++level;
+            peaksPerPixel /= m_levelFactor;
+        }
+    }
+    if (level > 0) {
+        startPeak = getPeak(startTime, level);
+        endPeak = getPeak(endTime, level);
+    }
+    const int levelPeaks =
+        (level < int(m_levelPeaks.size())) ? m_levelPeaks[level] : INT_MAX;
+    const int levelOffset = getLevelOffset(level);
+
     // Actual possible sample length in RealTime
     //
     double step = double(endPeak - startPeak) / double(width);
@@ -761,7 +1080,7 @@ PeakFile::getPreview(const RealTime &startTime,
         //
         if (!m_peakCache.length()) {
 
-            if (scanToPeak(peakNumber) == false) {
+            if (scanToPeak(peakNumber, level) == false) {
 #ifdef DEBUG_PEAKFILE
                 RG_DEBUG << "getPreview(): scanToPeak(" << peakNumber << ") failed";
 #endif
@@ -783,6 +1102,10 @@ PeakFile::getPreview(const RealTime &startTime,
         //
         for (int k = 0; peakNumber < nextPeakNumber; ++k) {
 
+            // The next level follows this one in the file.
+            if (peakNumber >= levelPeaks)
+                goto done;
+
             for (int ch = 0; ch < m_channels; ch++) {
 
                 if (!m_peakCache.length()) {
@@ -805,7 +1128,7 @@ PeakFile::getPreview(const RealTime &startTime,
 
                 } else {
 
-                    int valueNum = peakNumber * m_channels + ch;
+                    int valueNum = (levelOffset + peakNumber) * m_channels + ch;
                     int charNum = valueNum * m_format * m_pointsPerValue;
                     int charLength = m_format * m_pointsPerValue;
 
@@ -910,11 +1233,11 @@ done:
 }
 
 int
-PeakFile::getPeak(const RealTime &time)
+PeakFile::getPeak(const RealTime &time, int level)
 {
     double frames = ((time.sec * 1000000.0) + time.usec()) *
                     m_audioFile->getSampleRate() / 1000000.0;
-    return int(frames / double(m_blockSize));
+    return int(frames / (double(m_blockSize) * double(getLevelSpan(level))));
 }
 
 RealTime
@@ -925,6 +1248,51 @@ PeakFile::getTime(int peak)
     return RealTime(usecs / 1000000, (usecs % 1000000) * 1000);
 }
 
+bool
+PeakFile::readPeak(int level, int peak,
+                   std::vector<int> &highs, std::vector<int> &lows)
+{
+    if (level >= getLevels() || peak < 0 || peak >= m_levelPeaks[level])
+        return false;
+
+    const int valueBytes = m_format * m_pointsPerValue;
+    const size_t peakBytes = size_t(valueBytes) * m_channels;
+
+    std::string peakData;
+
+    if (m_peakCache.length()) {
+        size_t pos = size_t(getLevelOffset(level) + peak) * peakBytes;
+        if (pos + peakBytes > m_peakCache.length())
+            return false;
+        peakData = m_peakCache.substr(pos, peakBytes);
+    } else {
+        if (!scanToPeak(peak, level))
+            return false;
+        try {
+            peakData = getBytes(m_inFile, peakBytes);
+        } catch (const BadSoundFileException &e) {
+            RG_WARNING << "readPeak(): " << e.getMessage();
+            return false;
+        }
+        if (peakData.length() != peakBytes)
+            return false;
+    }
+
+    const unsigned char *data = (const unsigned char *)peakData.data();
+
+    highs.resize(m_channels);
+    lows.resize(m_channels);
+
+    for (int ch = 0; ch < m_channels; ++ch) {
+        highs[ch] = decodePeakValue(data + ch * valueBytes, m_format);
+        lows[ch] = (m_pointsPerValue == 2) ?
+                decodePeakValue(data + ch * valueBytes + m_format, m_format) :
+                highs[ch];
+    }
+
+    return true;
+}
+
 std::vector<SplitPointPair>
 PeakFile::getSplitPoints(const RealTime &startTime,
                          const RealTime &endTime,
@@ -962,7 +1330,51 @@ PeakFile::getSplitPoints(const RealTime &startTime,
     RealTime startSplit = RealTime::zeroTime;
     bool inSplit = false;
 
-    for (int i = startPeak; i < endPeak; i++) {
+    std::vector<int> highs, lows;
+    bool seek = false;
+
+    for (int i = startPeak; i < endPeak; ) {
+
+        // While waiting for the level to rise above the threshold, skip
+        // any whole block of a higher level that can't reach it: no
+        // level 0 high in there is further from zero than the block's
+        // own high or low.
+        //
+        if (belowThreshold) {
+            int skip = 0;
+
+            for (int level = getLevels() - 1; level > 0 && !skip; --level) {
+                const int span = getLevelSpan(level);
+                if (i % span != 0 || i + span > endPeak)
+                    continue;
+
+                seek = true;
+                if (!readPeak(level, i / span, highs, lows))
+                    continue;
+
+                float bound = 0.0;
+                for (int ch = 0; ch < m_channels; ch++) {
+                    int peakValue = std::max(std::abs(highs[ch]),
+                                             std::abs(lows[ch]));
+                    bound += std::fabs(float(peakValue) / divisor);
+                }
+                bound /= float(m_channels);
+
+                if (bound <= fThreshold)
+                    skip = span;
+            }
+
+            if (skip) {
+                i += skip;
+                continue;
+            }
+        }
+
+        if (seek) {
+            scanToPeak(i);
+            seek = false;
+        }
+
         value = 0.0;
 
         for (int ch = 0; ch < m_channels; ch++) {
@@ -975,8 +1387,8 @@ PeakFile::getSplitPoints(const RealTime &startTime,
 
             if (peakData.length() == (unsigned int)(m_format *
                                                     m_pointsPerValue)) {
-                int peakValue =
-                    getIntegerFromLittleEndian(peakData.substr(0, m_format));
+                int peakValue = decodePeakValue(
+                        (const unsigned char *)peakData.data(), m_format);
 
                 value += std::fabs(float(peakValue) / divisor);
             }
@@ -1000,6 +1412,8 @@ PeakFile::getSplitPoints(const RealTime &startTime,
                 belowThreshold = true;
             }
         }
+
+        ++i;
     }
 
     // if we've got a split point open the close it
@@ -1013,5 +1427,3 @@ PeakFile::getSplitPoints(const RealTime &startTime,
 
 
 }
-
-
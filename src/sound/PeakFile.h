@@ -26,6 +26,8 @@ class QProgressDialog;
 #ifndef RG_PEAKFILE_H
 #define RG_PEAKFILE_H
 
+#include <rosegardenprivate_export.h>
+
 
 namespace Rosegarden
 {
@@ -45,8 +47,14 @@ typedef std::pair<RealTime, RealTime> SplitPointPair;
  * the sample file itself (writeToHandle()) or used to generate an
  * external peak file (write()).  At the moment the only type of file
  * with an embedded peak chunk is the BWF file itself.
+ *
+ * After the BWF peaks (level 0) we write further levels, each with one
+ * peak for every eight of the level before.  These are listed in the
+ * header's reserved space, so other readers just see the BWF peaks.
+ * getPreview() reads whichever level is closest to one peak per pixel,
+ * and getSplitPoints() uses them to skip over quiet stretches.
  */
-class PeakFile : public QObject, public SoundFile
+class ROSEGARDENPRIVATE_EXPORT PeakFile : public QObject, public SoundFile
 {
     Q_OBJECT
 
@@ -62,13 +70,18 @@ public:
             { m_progressDialog = progressDialog; }
 
     /// Write to standard peak file
+    /**
+     * The audio is scanned in chunks on a thread per core, with the
+     * progress dialog kept up to date meanwhile.
+     */
     bool write() override;
 
     /// Is the peak file valid and up to date?
     /**
      * If the audio file is more recently modified than the modification time
      * on this peak file then we're invalid.  The action to rectify this is
-     * usually to regenerate the peak data.
+     * usually to regenerate the peak data.  So is a peak file from before
+     * we wrote levels, if it is long enough to need them.
      */
     bool isValid();
 
@@ -115,17 +128,33 @@ protected:
     void writeHeader(std::ofstream *file);
     void writePeaks(std::ofstream *file);
 
-    /// Convert time to block.
+    /// Calculate the level 0 peaks.  Returns false if cancelled.
+    bool calculatePeaks(std::string &peaks);
+
+    /// Convert time to block at the given level.
     /**
      * rename: getBlock()
      */
-    int getPeak(const RealTime &time);
+    int getPeak(const RealTime &time, int level = 0);
 
     /// Convert block to time.
     RealTime getTime(int block);
 
     void parseHeader();
 
+    int getLevels() const
+            { return m_levelPeaks.empty() ? 1 : int(m_levelPeaks.size()); }
+
+    /// Number of level 0 blocks in each block of the given level.
+    int getLevelSpan(int level) const;
+
+    /// Number of peaks in the file before those of the given level.
+    int getLevelOffset(int level) const;
+
+    /// Read the highs and lows of one peak at the given level.
+    bool readPeak(int level, int peak,
+                  std::vector<int> &highs, std::vector<int> &lows);
+
     /// The AudioFile that this peak file is based on.
     AudioFile *m_audioFile;
 
@@ -140,6 +169,11 @@ protected:
     int m_offsetToPeaks;
     int m_bodyBytes;
 
+    /// Number of peaks in each level, from level 0 (m_numberOfPeaks).
+    std::vector<int> m_levelPeaks;
+    /// Peaks of each level per peak of the next.
+    int m_levelFactor;
+
     /// Used to determine whether the peak file is out of sync with the audio file.
     QDateTime m_modificationTime;
 
@@ -161,7 +195,7 @@ protected:
     /// Cached in-memory copy of the peak file for getPreview().
     std::string        m_peakCache;
     
-    bool scanToPeak(int peak);
+    bool scanToPeak(int peak, int level = 0);
     //bool scanForward(int numberOfPeaks);
 };
 
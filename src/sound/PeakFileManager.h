@@ -86,6 +86,9 @@ public:
      * if the peak file already exists _and_ it's up to date then we don't
      * do anything.  For BWF files we generate an internal peak chunk.
      *
+     * The work is shared between threads (see PeakFile::write()), and
+     * this waits for them, keeping the progress dialog going.
+     *
      * throw BadSoundFileException, BadPeakFileException
      */
     void generatePeaks(AudioFile *audioFile);
@@ -14,6 +14,17 @@
 */
 
 #include "PlayableAudioFile.h"
+#include "MemoryMappedFile.h"
+#include "AudioKernels.h"
+#include "WAVAudioFile.h"
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <deque>
 
 namespace Rosegarden
 {
@@ -21,6 +32,7 @@ namespace Rosegarden
 //#define DEBUG_RING_BUFFER_POOL 1
 //#define DEBUG_PLAYABLE 1
 //#define DEBUG_PLAYABLE_READ 1
+//#define DEBUG_SMALL_FILE_PRELOADER 1
 
 class RingBufferPool
 {
@@ -286,7 +298,163 @@ RingBufferPool::returnBuffer(RingBuffer<sample_t> *buffer)
 }
 
 
+
+/**
+ * Decodes small files into the small file cache, one at a time, in
+ * the order asked for.  Each is read through an AudioFile of its own,
+ * so that the one it is cached for can carry on being used elsewhere.
+ */
+class SmallFilePreloader : public QThread
+{
+public:
+    SmallFilePreloader(AudioCache &cache);
+    ~SmallFilePreloader() override;
+
+    void add(AudioFile *audioFile, int targetSampleRate);
+
+    /// Drop anything queued or being decoded for the given file.
+    void forget(AudioFile *audioFile);
+
+    /// Drop everything queued or being decoded.
+    void forgetAll();
+
+protected:
+    void run() override;
+
+    struct Request {
+        AudioFile *audioFile;
+        QString fileName;
+        int targetSampleRate;
+    };
+
+    AudioCache &m_cache;
+
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    std::deque<Request> m_queue;
+    AudioFile *m_current;
+    bool m_exiting;
+};
+
+SmallFilePreloader::SmallFilePreloader(AudioCache &cache) :
+    m_cache(cache),
+    m_current(nullptr),
+    m_exiting(false)
+{
+}
+
+SmallFilePreloader::~SmallFilePreloader()
+{
+    m_mutex.lock();
+    m_exiting = true;
+    m_condition.wakeAll();
+    m_mutex.unlock();
+
+    wait();
+}
+
+void
+SmallFilePreloader::add(AudioFile *audioFile, int targetSampleRate)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Request request;
+    request.audioFile = audioFile;
+    request.fileName = audioFile->getFilename();
+    request.targetSampleRate = targetSampleRate;
+    m_queue.push_back(request);
+
+    m_condition.wakeAll();
+}
+
+void
+SmallFilePreloader::forget(AudioFile *audioFile)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (std::deque<Request>::iterator i = m_queue.begin();
+         i != m_queue.end(); ) {
+        if (i->audioFile == audioFile)
+            i = m_queue.erase(i);
+        else
+            ++i;
+    }
+
+    if (m_current == audioFile)
+        m_current = nullptr;
+}
+
+void
+SmallFilePreloader::forgetAll()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_queue.clear();
+    m_current = nullptr;
+}
+
+void
+SmallFilePreloader::run()
+{
+    while (true) {
+
+        Request request;
+
+        m_mutex.lock();
+        while (m_queue.empty() && !m_exiting)
+            m_condition.wait(&m_mutex);
+        if (m_exiting) {
+            m_mutex.unlock();
+            return;
+        }
+        request = m_queue.front();
+        m_queue.pop_front();
+        m_current = request.audioFile;
+        m_mutex.unlock();
+
+        size_t frames = 0;
+        size_t channels = 0;
+        PlayableAudioFile::sample_t **data = nullptr;
+
+        if (!m_cache.has(request.audioFile)) {
+            try {
+                WAVAudioFile file(0, "", request.fileName);
+                if (file.open()) {
+                    channels = file.getChannels();
+                    data = PlayableAudioFile::decodeSmallFile
+                        (&file, request.targetSampleRate, frames);
+                }
+            } catch (...) {
+            }
+        }
+
+        QMutexLocker locker(&m_mutex);
+
+        // Only cache it if nobody has forgotten the file in the
+        // meantime: the AudioFile may be gone, and another in its
+        // place.
+        bool cached = false;
+        if (data && m_current == request.audioFile) {
+            cached = m_cache.addUnreferencedData
+                (request.audioFile, channels, frames, data);
+        }
+        if (data && !cached) {
+            for (size_t ch = 0; ch < channels; ++ch)
+                delete[] data[ch];
+            delete[] data;
+        }
+        m_current = nullptr;
+
+#ifdef DEBUG_SMALL_FILE_PRELOADER
+        std::cerr << "SmallFilePreloader::run: " << request.fileName << (cached ? " cached" : " not cached") << std::endl;
+#endif
+    }
+}
+
+
 AudioCache PlayableAudioFile::m_smallFileCache;
+int PlayableAudioFile::m_smallFileCacheSampleRate = 0;
+SmallFilePreloader *PlayableAudioFile::m_smallFilePreloader = nullptr;
 
 std::vector<PlayableAudioFile::sample_t *> PlayableAudioFile::m_workBuffers;
 size_t PlayableAudioFile::m_workBufferSize = 0;
@@ -298,6 +466,8 @@ RingBufferPool *PlayableAudioFile::m_ringBufferPool = nullptr;
 
 size_t PlayableAudioFile::m_xfadeFrames = 30;
 
+bool PlayableAudioFile::m_memoryMapping = true;
+
 PlayableAudioFile::PlayableAudioFile(InstrumentId instrumentId,
                                      AudioFile *audioFile,
                                      const RealTime &startTime,
@@ -311,6 +481,10 @@ PlayableAudioFile::PlayableAudioFile(InstrumentId instrumentId,
     m_startIndex(startIndex),
     m_duration(duration),
     m_file(nullptr),
+    m_mappedFile(nullptr),
+    m_mappedDataOffset(0),
+    m_mappedFrames(0),
+    m_mappedFrame(0),
     m_audioFile(audioFile),
     m_instrumentId(instrumentId),
     m_targetChannels(targetChannels),
@@ -319,6 +493,9 @@ PlayableAudioFile::PlayableAudioFile(InstrumentId instrumentId,
     m_firstRead(true),
     m_runtimeSegmentId( -1),
     m_isSmallFile(false),
+    m_smallFileData(nullptr),
+    m_smallFileChannels(0),
+    m_smallFileFrames(0),
     m_currentScanPoint(RealTime::zeroTime),
     m_smallFileScanFrame(0),
     m_autoFade(false),
@@ -355,6 +532,66 @@ PlayableAudioFile::setRingBufferPoolSizes(size_t n, size_t nframes)
     m_ringBufferPool->setPoolSize(n);
 }
 
+void
+PlayableAudioFile::setSmallFileCacheLimit(size_t bytes)
+{
+    m_smallFileCache.setMemoryLimit(bytes);
+}
+
+size_t
+PlayableAudioFile::getSmallFileCacheLimit()
+{
+    return m_smallFileCache.getMemoryLimit();
+}
+
+AudioCache::Statistics
+PlayableAudioFile::getSmallFileCacheStatistics()
+{
+    return m_smallFileCache.getStatistics();
+}
+
+void
+PlayableAudioFile::preloadSmallFile(AudioFile *audioFile,
+                                    size_t smallFileSize,
+                                    int targetSampleRate)
+{
+    if (!audioFile || targetSampleRate <= 0 ||
+        audioFile->getSize() > smallFileSize)
+        return;
+
+    if (!m_smallFilePreloader) {
+        m_smallFilePreloader = new SmallFilePreloader(m_smallFileCache);
+        m_smallFilePreloader->start(QThread::LowPriority);
+    }
+
+    // Files are cached at a single rate, so anything cached at
+    // another has to go.  Anything still being played at the old rate
+    // goes once it has finished.
+    if (targetSampleRate != m_smallFileCacheSampleRate) {
+        m_smallFilePreloader->forgetAll();
+        m_smallFileCache.removeAll();
+        m_smallFileCacheSampleRate = targetSampleRate;
+    }
+
+    m_smallFilePreloader->add(audioFile, targetSampleRate);
+}
+
+void
+PlayableAudioFile::forgetSmallFile(AudioFile *audioFile)
+{
+    if (m_smallFilePreloader)
+        m_smallFilePreloader->forget(audioFile);
+    m_smallFileCache.remove(audioFile);
+}
+
+void
+PlayableAudioFile::stopSmallFilePreloader()
+{
+    // Waits for the thread to finish.
+    delete m_smallFilePreloader;
+    m_smallFilePreloader = nullptr;
+}
+
 
 void
 PlayableAudioFile::initialise(size_t bufferSize, size_t smallFileSize)
@@ -363,18 +600,15 @@ PlayableAudioFile::initialise(size_t bufferSize, size_t smallFileSize)
     std::cerr << "PlayableAudioFile::initialise() " << this << std::endl;
 #endif
 
+    if (m_targetChannels <= 0)
+        m_targetChannels = m_audioFile->getChannels();
+    if (m_targetSampleRate <= 0)
+        m_targetSampleRate = m_audioFile->getSampleRate();
+
     checkSmallFileCache(smallFileSize);
 
     if (!m_isSmallFile) {
-
-        m_file = new std::ifstream(m_audioFile->getFilename().toLocal8Bit(),
-                                   std::ios::in | std::ios::binary);
-
-        if (!*m_file) {
-            std::cerr << "ERROR: PlayableAudioFile::initialise: Failed to open audio file " << m_audioFile->getFilename() << std::endl;
-            delete m_file;
-            m_file = nullptr;
-        }
+        openFile();
     }
 
     // Scan to the beginning of the data chunk we need
@@ -383,7 +617,7 @@ PlayableAudioFile::initialise(size_t bufferSize, size_t smallFileSize)
     std::cerr << "PlayableAudioFile::initialise - scanning to " << m_startIndex << std::endl;
 #endif
 
-    if (m_file) {
+    if (m_file || m_mappedFile) {
         scanTo(m_startIndex);
     } else {
         m_fileEnded = false;
@@ -398,11 +632,6 @@ PlayableAudioFile::initialise(size_t bufferSize, size_t smallFileSize)
     (void)bufferSize;
 #endif
 
-    if (m_targetChannels <= 0)
-        m_targetChannels = m_audioFile->getChannels();
-    if (m_targetSampleRate <= 0)
-        m_targetSampleRate = m_audioFile->getSampleRate();
-
     m_ringBuffers = new RingBuffer<sample_t> *[m_targetChannels];
     for (int ch = 0; ch < m_targetChannels; ++ch) {
         m_ringBuffers[ch] = nullptr;
@@ -416,11 +645,13 @@ PlayableAudioFile::~PlayableAudioFile()
         delete m_file;
     }
 
+    delete m_mappedFile;
+
     returnRingBuffers();
     delete[] m_ringBuffers;
     m_ringBuffers = nullptr;
 
-    if (m_isSmallFile) {
+    if (m_smallFileData) {
         m_smallFileCache.decrementReference(m_audioFile);
     }
 
@@ -429,6 +660,54 @@ PlayableAudioFile::~PlayableAudioFile()
 #endif
 }
 
+bool
+PlayableAudioFile::openFile()
+{
+    if (m_file) {
+        m_file->close();
+        delete m_file;
+        m_file = nullptr;
+    }
+
+    if (m_memoryMapping) {
+
+        const std::streamoff dataOffset = m_audioFile->getDataOffset();
+        const size_t bytesPerFrame = getBytesPerFrame();
+
+        if (dataOffset >= 0 && bytesPerFrame > 0) {
+
+            MemoryMappedFile *mapped =
+                new MemoryMappedFile(m_audioFile->getFilename());
+
+            if (mapped->isValid() && size_t(dataOffset) <= mapped->getSize()) {
+                m_mappedFile = mapped;
+                m_mappedDataOffset = size_t(dataOffset);
+                m_mappedFrames =
+                    (mapped->getSize() - m_mappedDataOffset) / bytesPerFrame;
+                m_mappedFrame = 0;
+                return true;
+            }
+
+#ifdef DEBUG_PLAYABLE
+            std::cerr << "PlayableAudioFile::openFile: Failed to map audio file " << m_audioFile->getFilename() << ", reading it instead" << std::endl;
+#endif
+            delete mapped;
+        }
+    }
+
+    m_file = new std::ifstream(m_audioFile->getFilename().toLocal8Bit(),
+                               std::ios::in | std::ios::binary);
+
+    if (!*m_file) {
+        std::cerr << "ERROR: PlayableAudioFile::openFile: Failed to open audio file " << m_audioFile->getFilename() << std::endl;
+        delete m_file;
+        m_file = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
 void
 PlayableAudioFile::returnRingBuffers()
 {
@@ -462,6 +741,18 @@ PlayableAudioFile::scanTo(const RealTime &time)
 #endif
         ok = true;
 
+    } else if (m_mappedFile) {
+
+        // As RIFFAudioFile::scanTo(), we can go as far as the end
+        // of the data but no further.
+        size_t frame = (size_t)RealTime::realTime2Frame
+            (time, m_audioFile->getSampleRate());
+        if (frame <= m_mappedFrames) {
+            m_mappedFrame = frame;
+            m_currentScanPoint = time;
+            ok = true;
+        }
+
     } else {
 
         ok = m_audioFile->scanTo(m_file, time);
@@ -486,11 +777,8 @@ PlayableAudioFile::getSampleFramesAvailable()
     size_t actual = 0;
 
     if (m_isSmallFile) {
-        size_t cchannels;
-        size_t cframes;
-        (void)m_smallFileCache.getData(m_audioFile, cchannels, cframes);
-        if (cframes > m_smallFileScanFrame)
-            return cframes - m_smallFileScanFrame;
+        if (m_smallFileFrames > m_smallFileScanFrame)
+            return m_smallFileFrames - m_smallFileScanFrame;
         else
             return 0;
     }
@@ -521,7 +809,6 @@ PlayableAudioFile::addSamples(std::vector<sample_t *> &destination,
     if (!m_isSmallFile) {
 
         size_t qty = 0;
-        bool done = m_fileEnded;
 
         for (int ch = 0; ch < int(channels) && ch < m_targetChannels; ++ch) {
             if (!m_ringBuffers[ch])
@@ -529,21 +816,15 @@ PlayableAudioFile::addSamples(std::vector<sample_t *> &destination,
             size_t here = m_ringBuffers[ch]->readAdding(destination[ch] + offset, nframes);
             if (ch == 0 || here < qty)
                 qty = here;
-            if (done && (m_ringBuffers[ch]->getReadSpace() > 0))
-                done = false;
         }
 
         for (int ch = channels; ch < m_targetChannels; ++ch) {
             m_ringBuffers[ch]->skip(nframes);
         }
 
-        if (done) {
-#ifdef DEBUG_PLAYABLE_READ
-            std::cerr << "PlayableAudioFile::addSamples(" << nframes << "): reached end, returning buffers" << std::endl;
-#endif
-
-            returnRingBuffers();
-        }
+        // Once the file has ended and been read out, its buffers stay
+        // here, empty, until the AudioFileReader returns them to the
+        // pool.  That locks the pool, which we can't do on this thread.
 
 #ifdef DEBUG_PLAYABLE_READ
         std::cerr << "PlayableAudioFile::addSamples(" << nframes << "): returning " << qty << " frames (at least " << (m_ringBuffers[0] ? m_ringBuffers[0]->getReadSpace() : 0) << " remaining)" << std::endl;
@@ -553,9 +834,9 @@ PlayableAudioFile::addSamples(std::vector<sample_t *> &destination,
 
     } else {
 
-        size_t cchannels;
-        size_t cframes;
-        float **cached = m_smallFileCache.getData(m_audioFile, cchannels, cframes);
+        size_t cchannels = m_smallFileChannels;
+        size_t cframes = m_smallFileFrames;
+        float **cached = m_smallFileData;
 
         if (!cached) {
             std::cerr << "WARNING: PlayableAudioFile::addSamples: Failed to find small file in cache" << std::endl;
@@ -631,76 +912,56 @@ PlayableAudioFile::addSamples(std::vector<sample_t *> &destination,
 void
 PlayableAudioFile::checkSmallFileCache(size_t smallFileSize)
 {
-    if (m_smallFileCache.has(m_audioFile)) {
+    // Files are cached at a single rate, so anything cached at
+    // another has to go.  Anything still being played at the old rate
+    // goes once it has finished.
+    if (m_targetSampleRate != m_smallFileCacheSampleRate) {
+        if (m_smallFilePreloader)
+            m_smallFilePreloader->forgetAll();
+        m_smallFileCache.removeAll();
+        m_smallFileCacheSampleRate = m_targetSampleRate;
+    }
+
+    m_smallFileData = m_smallFileCache.acquire
+        (m_audioFile, m_smallFileChannels, m_smallFileFrames);
+
+    if (m_smallFileData) {
 
 #ifdef DEBUG_PLAYABLE
         std::cerr << "PlayableAudioFile::checkSmallFileCache: Found file in small file cache" << std::endl;
 #endif
 
-        m_smallFileCache.incrementReference(m_audioFile);
         m_isSmallFile = true;
 
     } else if (m_audioFile->getSize() <= smallFileSize) {
 
-        std::ifstream file(m_audioFile->getFilename().toLocal8Bit(),
-                           std::ios::in | std::ios::binary);
-
-        if (!file) {
-            std::cerr << "ERROR: PlayableAudioFile::checkSmallFileCache: Failed to open audio file " << m_audioFile->getFilename() << std::endl;
-            return ;
-        }
-
 #ifdef DEBUG_PLAYABLE
         std::cerr << "PlayableAudioFile::checkSmallFileCache: Adding file to small file cache" << std::endl;
 #endif
 
-        // We always encache files with their original number of
-        // channels (because they might be called for in any channel
-        // configuration subsequently) but with the current sample
-        // rate, not their original one.
-
-        m_audioFile->scanTo(&file, RealTime::zeroTime);
-
-        size_t reqd = m_audioFile->getSize() / m_audioFile->getBytesPerFrame();
-        unsigned char *buffer = new unsigned char[m_audioFile->getSize()];
-        size_t obtained = m_audioFile->getSampleFrames(&file, (char *)buffer, reqd);
-
-//        std::cerr <<"obtained=" << obtained << std::endl;
-
         size_t nch = getSourceChannels();
-        size_t nframes = obtained;
-        if (int(getSourceSampleRate()) != m_targetSampleRate) {
-#ifdef DEBUG_PLAYABLE
-            std::cerr << "PlayableAudioFile::checkSmallFileCache: Resampling badly from " << getSourceSampleRate() << " to " << m_targetSampleRate << std::endl;
-#endif
-            nframes = size_t(float(nframes) * float(m_targetSampleRate) /
-                             float(getSourceSampleRate()));
-        }
-
-        std::vector<sample_t *> samples;
-        for (size_t ch = 0; ch < nch; ++ch) {
-            samples.push_back(new sample_t[nframes]);
-        }
-
-        if (!m_audioFile->decode(buffer,
-                                 obtained * m_audioFile->getBytesPerFrame(),
-                                 m_targetSampleRate,
-                                 nch,
-                                 nframes,
-                                 samples)) {
-            std::cerr << "PlayableAudioFile::checkSmallFileCache: failed to decode file" << std::endl;
-        } else {
-            sample_t **toCache = new sample_t * [nch];
-            for (size_t ch = 0; ch < nch; ++ch) {
-                toCache[ch] = samples[ch];
+        size_t nframes = 0;
+        sample_t **toCache = decodeSmallFile
+            (m_audioFile, m_targetSampleRate, nframes);
+
+        if (toCache) {
+            if (m_smallFileCache.addData(m_audioFile, nch, nframes, toCache)) {
+                m_smallFileData = toCache;
+                m_smallFileChannels = nch;
+                m_smallFileFrames = nframes;
+            } else {
+                for (size_t ch = 0; ch < nch; ++ch)
+                    delete[] toCache[ch];
+                delete[] toCache;
+                // The preloader may have just got there first.
+                // Otherwise there's no room, and we stream it.
+                if (m_smallFileCache.has(m_audioFile)) {
+                    m_smallFileData = m_smallFileCache.acquire
+                        (m_audioFile, m_smallFileChannels, m_smallFileFrames);
+                }
             }
-            m_smallFileCache.addData(m_audioFile, nch, nframes, toCache);
-            m_isSmallFile = true;
+            m_isSmallFile = (m_smallFileData != nullptr);
         }
-
-        delete[] buffer;
-
-        file.close();
     }
 
     if (m_isSmallFile) {
@@ -712,6 +973,69 @@ PlayableAudioFile::checkSmallFileCache(size_t smallFileSize)
     }
 }
 
+PlayableAudioFile::sample_t **
+PlayableAudioFile::decodeSmallFile(AudioFile *audioFile,
+                                   int targetSampleRate, size_t &frames)
+{
+    std::ifstream file(audioFile->getFilename().toLocal8Bit(),
+                       std::ios::in | std::ios::binary);
+
+    if (!file) {
+        std::cerr << "ERROR: PlayableAudioFile::decodeSmallFile: Failed to open audio file " << audioFile->getFilename() << std::endl;
+        return nullptr;
+    }
+
+    // We always encache files with their original number of
+    // channels (because they might be called for in any channel
+    // configuration subsequently) but with the current sample
+    // rate, not their original one.
+
+    audioFile->scanTo(&file, RealTime::zeroTime);
+
+    size_t reqd = audioFile->getSize() / audioFile->getBytesPerFrame();
+    unsigned char *buffer = new unsigned char[audioFile->getSize()];
+    size_t obtained = audioFile->getSampleFrames(&file, (char *)buffer, reqd);
+
+    size_t nch = audioFile->getChannels();
+    size_t nframes = obtained;
+    if (int(audioFile->getSampleRate()) != targetSampleRate) {
+#ifdef DEBUG_PLAYABLE
+        std::cerr << "PlayableAudioFile::decodeSmallFile: Resampling badly from " << audioFile->getSampleRate() << " to " << targetSampleRate << std::endl;
+#endif
+        nframes = size_t(float(nframes) * float(targetSampleRate) /
+                         float(audioFile->getSampleRate()));
+    }
+
+    std::vector<sample_t *> samples;
+    for (size_t ch = 0; ch < nch; ++ch) {
+        samples.push_back(new sample_t[nframes]);
+    }
+
+    sample_t **decoded = nullptr;
+
+    if (!audioFile->decode(buffer,
+                           obtained * audioFile->getBytesPerFrame(),
+                           targetSampleRate,
+                           nch,
+                           nframes,
+                           samples)) {
+        std::cerr << "PlayableAudioFile::decodeSmallFile: failed to decode file" << std::endl;
+        for (size_t ch = 0; ch < nch; ++ch)
+            delete[] samples[ch];
+    } else {
+        decoded = new sample_t * [nch];
+        for (size_t ch = 0; ch < nch; ++ch) {
+            decoded[ch] = samples[ch];
+        }
+        frames = nframes;
+    }
+
+    delete[] buffer;
+
+    file.close();
+
+    return decoded;
+}
 
 void
 PlayableAudioFile::fillBuffers()
@@ -724,13 +1048,8 @@ PlayableAudioFile::fillBuffers()
     }
 #endif
 
-    if (!m_isSmallFile && (!m_file || !*m_file)) {
-        m_file = new std::ifstream(m_audioFile->getFilename().toLocal8Bit(),
-                                   std::ios::in | std::ios::binary);
-        if (!*m_file) {
-            std::cerr << "ERROR: PlayableAudioFile::fillBuffers: Failed to open audio file " << m_audioFile->getFilename() << std::endl;
-            delete m_file;
-            m_file = nullptr;
+    if (!m_isSmallFile && !m_mappedFile && (!m_file || !*m_file)) {
+        if (!openFile()) {
             return ;
         }
     }
@@ -768,13 +1087,8 @@ PlayableAudioFile::fillBuffers(const RealTime &currentTime)
         return true;
     }
 
-    if (!m_isSmallFile && (!m_file || !*m_file)) {
-        m_file = new std::ifstream(m_audioFile->getFilename().toLocal8Bit(),
-                                   std::ios::in | std::ios::binary);
-        if (!*m_file) {
-            std::cerr << "ERROR: PlayableAudioFile::fillBuffers: Failed to open audio file " << m_audioFile->getFilename() << std::endl;
-            delete m_file;
-            m_file = nullptr;
+    if (!m_isSmallFile && !m_mappedFile && (!m_file || !*m_file)) {
+        if (!openFile()) {
             return false;
         }
         scanTo(m_startIndex);
@@ -805,12 +1119,43 @@ PlayableAudioFile::fillBuffers(const RealTime &currentTime)
     return true;
 }
 
+void
+PlayableAudioFile::prefetch(const RealTime &currentTime, const RealTime &length)
+{
+    if (!m_mappedFile)
+        return;
+
+    if (currentTime > getEndTime() || currentTime + length < m_startTime)
+        return;
+
+    RealTime from = m_startIndex;
+    RealTime to = m_startIndex + currentTime + length - m_startTime;
+
+    if (currentTime > m_startTime) {
+        from = m_startIndex + currentTime - m_startTime;
+    }
+
+    if (to > m_startIndex + m_duration)
+        to = m_startIndex + m_duration;
+
+    const size_t fromFrame = (size_t)RealTime::realTime2Frame
+        (from, m_audioFile->getSampleRate());
+    const size_t toFrame = (size_t)RealTime::realTime2Frame
+        (to, m_audioFile->getSampleRate());
+
+    if (toFrame <= fromFrame)
+        return;
+
+    m_mappedFile->willNeed(m_mappedDataOffset + fromFrame * getBytesPerFrame(),
+                           (toFrame - fromFrame) * getBytesPerFrame());
+}
+
 bool
 PlayableAudioFile::updateBuffers()
 {
     if (m_isSmallFile)
         return false;
-    if (!m_file)
+    if (!m_file && !m_mappedFile)
         return false;
 
     if (m_fileEnded) {
@@ -878,23 +1223,49 @@ PlayableAudioFile::updateBuffers()
     std::cerr << "Want " << fileFrames << " (" << block << ") from file (" << (m_duration + m_startIndex - m_currentScanPoint - block) << " to go)" << std::endl;
 #endif
 
-    //!!! need to be doing this in initialise, want to avoid allocations here
-    if ((getBytesPerFrame() * fileFrames) > m_rawFileBufferSize) {
-        delete[] m_rawFileBuffer;
-        m_rawFileBufferSize = getBytesPerFrame() * fileFrames;
+    const unsigned char *sourceData = nullptr;
+    size_t obtained = 0;
+
+    if (m_mappedFile) {
+
+        // Decode straight out of the mapping: no read, no copy.
+        obtained = std::min(fileFrames, m_mappedFrames - m_mappedFrame);
+        sourceData = m_mappedFile->getData() + m_mappedDataOffset +
+            m_mappedFrame * getBytesPerFrame();
+        m_mappedFrame += obtained;
+
+        if (obtained < fileFrames) {
+            m_fileEnded = true;
+        } else {
+            // Have the kernel read the next block in while we
+            // decode this one, so the next call doesn't block on it.
+            m_mappedFile->willNeed
+                (m_mappedDataOffset + m_mappedFrame * getBytesPerFrame(),
+                 fileFrames * getBytesPerFrame());
+        }
+
+    } else {
+
+        //!!! need to be doing this in initialise, want to avoid allocations here
+        if ((getBytesPerFrame() * fileFrames) > m_rawFileBufferSize) {
+            delete[] m_rawFileBuffer;
+            m_rawFileBufferSize = getBytesPerFrame() * fileFrames;
 #ifdef DEBUG_PLAYABLE_READ
 
-        std::cerr << "Expanding raw file buffer to " << m_rawFileBufferSize << " chars" << std::endl;
+            std::cerr << "Expanding raw file buffer to " << m_rawFileBufferSize << " chars" << std::endl;
 #endif
 
-        m_rawFileBuffer = new char[m_rawFileBufferSize];
-    }
+            m_rawFileBuffer = new char[m_rawFileBufferSize];
+        }
 
-    size_t obtained =
-        m_audioFile->getSampleFrames(m_file, m_rawFileBuffer, fileFrames);
+        obtained =
+            m_audioFile->getSampleFrames(m_file, m_rawFileBuffer, fileFrames);
 
-    if (obtained < fileFrames || m_file->eof()) {
-        m_fileEnded = true;
+        if (obtained < fileFrames || m_file->eof()) {
+            m_fileEnded = true;
+        }
+
+        sourceData = (const unsigned char *)m_rawFileBuffer;
     }
 
 #ifdef DEBUG_PLAYABLE
@@ -925,7 +1296,7 @@ PlayableAudioFile::updateBuffers()
         }
     }
 
-    if (m_audioFile->decode((const unsigned char *)m_rawFileBuffer,
+    if (m_audioFile->decode(sourceData,
                             obtained * getBytesPerFrame(),
                             m_targetSampleRate,
                             m_targetChannels,
@@ -989,17 +1360,13 @@ PlayableAudioFile::updateBuffers()
         for (int ch = 0; ch < m_targetChannels; ++ch) {
 
             if (m_firstRead || m_fileEnded) {
-                float xfade = std::min(m_xfadeFrames, nframes);
+                size_t xfade = std::min(m_xfadeFrames, nframes);
                 if (m_firstRead) {
-                    for (size_t i = 0; i < xfade; ++i) {
-                        m_workBuffers[ch][i] *= float(i + 1) / xfade;
-                    }
+                    AudioKernels::fadeIn(m_workBuffers[ch], xfade, float(xfade));
                 }
                 if (m_fileEnded) {
-                    for (size_t i = 0; i < xfade; ++i) {
-                        m_workBuffers[ch][nframes - i - 1] *=
-                            float(i + 1) / xfade;
-                    }
+                    AudioKernels::fadeOut(m_workBuffers[ch] + nframes - xfade,
+                                          xfade, float(xfade));
                 }
             }
 
@@ -16,6 +16,8 @@
 #ifndef RG_PLAYABLE_AUDIO_FILE_H
 #define RG_PLAYABLE_AUDIO_FILE_H
 
+#include <rosegardenprivate_export.h>
+
 #include "base/Instrument.h"
 #include "RingBuffer.h"
 #include "AudioFile.h"
@@ -28,9 +30,11 @@ namespace Rosegarden
 {
 
 class RingBufferPool;
+class MemoryMappedFile;
+class SmallFilePreloader;
 
 
-class PlayableAudioFile
+class ROSEGARDENPRIVATE_EXPORT PlayableAudioFile
 {
 public:
     typedef float sample_t;
@@ -48,6 +52,38 @@ public:
 
     static void setRingBufferPoolSizes(size_t n, size_t nframes);
 
+    // Whether to read files that are too big for the small file
+    // cache through a memory mapping (the default) or an ifstream.
+    // Files that can't be mapped are always read through an ifstream.
+    // Affects files opened after the call.
+    //
+    static void setMemoryMapping(bool map) { m_memoryMapping = map; }
+    static bool getMemoryMapping() { return m_memoryMapping; }
+
+    // The small file cache, shared by all PlayableAudioFiles, holds
+    // each file decoded at the target sample rate.  It keeps files
+    // nobody is playing for as long as its memory limit allows, and
+    // files that would take it over the limit are streamed instead.
+    //
+    static void setSmallFileCacheLimit(size_t bytes);
+    static size_t getSmallFileCacheLimit();
+    static AudioCache::Statistics getSmallFileCacheStatistics();
+
+    // Decode a file into the small file cache on a background thread,
+    // if it is no bigger than smallFileSize, so that it is there
+    // before anything plays it.  Call forgetSmallFile() before
+    // deleting the AudioFile.
+    //
+    static void preloadSmallFile(AudioFile *audioFile, size_t smallFileSize,
+                                 int targetSampleRate);
+    static void forgetSmallFile(AudioFile *audioFile);
+
+    // Stop the background thread preloadSmallFile() starts, waiting
+    // for it to finish.  For driver shutdown.  A later
+    // preloadSmallFile() starts it again.
+    //
+    static void stopSmallFilePreloader();
+
     void setStartTime(const RealTime &time) { m_startTime = time; }
     RealTime getStartTime() const { return m_startTime; }
 
@@ -111,6 +147,10 @@ public:
     //
     bool fillBuffers(const RealTime &currentTime);
 
+    // Return the ring buffers to the pool.  Not realtime safe: addSamples
+    // leaves them in place when the file ends, for the AudioFileReader to
+    // clear once the mixer has passed getEndTime().
+    //
     void clearBuffers();
 
     // Update the buffer during playback.
@@ -121,6 +161,12 @@ public:
     //
     bool updateBuffers();
 
+    // Ask for the data this file will need over the given length of
+    // time from the proposed play time to be read in from disk, without
+    // waiting for it.  Only does anything for memory mapped files.
+    //
+    void prefetch(const RealTime &currentTime, const RealTime &length);
+
     // Has fillBuffers been called and completed yet?
     //
     bool isBuffered() const { return m_currentScanPoint > m_startIndex; }
@@ -156,6 +202,9 @@ public:
 protected: 
     void initialise(size_t bufferSize, size_t smallFileSize);
     void checkSmallFileCache(size_t smallFileSize);
+    static sample_t **decodeSmallFile(AudioFile *audioFile,
+                                      int targetSampleRate, size_t &frames);
+    bool openFile();
     bool scanTo(const RealTime &time);
     void returnRingBuffers();
 
@@ -169,6 +218,16 @@ protected:
     //
     std::ifstream        *m_file;
 
+    // Or the whole file mapped into memory, in which case we decode
+    // straight from the mapping, and the scan point is a frame index
+    // into the data chunk.
+    //
+    MemoryMappedFile     *m_mappedFile;
+    size_t                m_mappedDataOffset;
+    size_t                m_mappedFrames;
+    size_t                m_mappedFrame;
+    static bool           m_memoryMapping;
+
     // AudioFile handle
     //
     AudioFile            *m_audioFile;
@@ -186,8 +245,17 @@ protected:
     int                   m_runtimeSegmentId;
 
     static AudioCache     m_smallFileCache;
+    static int            m_smallFileCacheSampleRate;
+    static SmallFilePreloader *m_smallFilePreloader;
     bool                  m_isSmallFile;
 
+    // Our reference to the cached data, so that reading it takes no
+    // lock.
+    //
+    sample_t            **m_smallFileData;
+    size_t                m_smallFileChannels;
+    size_t                m_smallFileFrames;
+
     static std::vector<sample_t *> m_workBuffers;
     static size_t         m_workBufferSize;
     
@@ -205,6 +273,8 @@ protected:
     RealTime  m_fadeOutTime;
 
 private:
+    friend class SmallFilePreloader;
+
     PlayableAudioFile(const PlayableAudioFile &pAF); // not provided
 };
 
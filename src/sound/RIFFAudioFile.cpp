@@ -336,6 +336,28 @@ RIFFAudioFile::getLength()
     return RealTime(secs, nsecs);
 }
 
+std::streampos
+RIFFAudioFile::getDataOffset() const
+{
+    return std::streampos(m_dataChunkIndex);
+}
+
+void
+RIFFAudioFile::findDataChunk()
+{
+    m_dataChunkIndex = -1;
+
+    if (m_inFile == nullptr)
+        return ;
+
+    // Let scanTo() find the data chunk for us.  This runs from open(),
+    // before the file is handed to any other thread, so that
+    // getDataOffset() is just a read.
+    //
+    if (scanTo(m_inFile, RealTime::zeroTime))
+        m_dataChunkIndex = m_inFile->tellg();
+}
+
 
 // The RIFF file format chunk defines our internal meta data.
 //
@@ -24,6 +24,8 @@
 #ifndef RG_RIFFAUDIOFILE_H
 #define RG_RIFFAUDIOFILE_H
 
+#include <rosegardenprivate_export.h>
+
 #include <string>
 #include <vector>
 
@@ -35,7 +37,7 @@
 namespace Rosegarden
 {
 
-class RIFFAudioFile : public AudioFile
+class ROSEGARDENPRIVATE_EXPORT RIFFAudioFile : public AudioFile
 {
     Q_DECLARE_TR_FUNCTIONS(Rosegarden::RIFFAudioFile)
 public:
@@ -115,6 +117,11 @@ public:
     //
     RealTime getLength() override;
 
+    // Offset to start of sample data, or -1 if there isn't a data
+    // chunk.  Found by findDataChunk() when the file is opened.
+    //
+    std::streampos getDataOffset() const override;
+
     // Accessors
     //
     unsigned int getBytesPerFrame() override { return m_bytesPerFrame; }
@@ -150,6 +157,10 @@ protected:
     //
     void readFormatChunk();
 
+    // Find the data chunk and remember its offset for getDataOffset().
+    //
+    void findDataChunk();
+
     // Write out the Format chunk from the internal data we have
     //
     void writeFormatChunk();
@@ -0,0 +1,485 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "RealtimeAudit.h"
+
+#ifdef RG_RT_AUDIT
+
+#include <QAtomicInt>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#endif
+
+namespace Rosegarden
+{
+
+
+const char *
+RealtimeAudit::getKindName(Kind kind)
+{
+    switch (kind) {
+    case Allocation: return "allocation";
+    case Deallocation: return "deallocation";
+    case MutexLock: return "mutex lock";
+    case FileIO: return "file I/O";
+    }
+    return "unknown";
+}
+
+
+}
+
+#ifndef RG_RT_AUDIT
+
+namespace Rosegarden
+{
+
+
+bool RealtimeAudit::isEnabled()  { return false; }
+void RealtimeAudit::initialise()  { }
+bool RealtimeAudit::isRealtime()  { return false; }
+int RealtimeAudit::getViolationCount()  { return 0; }
+void RealtimeAudit::reset()  { }
+QString RealtimeAudit::getReport()  { return QString(); }
+
+
+}
+
+#else
+
+using Rosegarden::RealtimeAudit;
+
+namespace
+{
+
+/// Scope nesting on this thread.
+thread_local int t_depth = 0;
+
+/// Set while this thread is recording a violation, so that whatever
+/// the unwinder calls isn't taken for another one.
+thread_local int t_recording = 0;
+
+struct Violation
+{
+    /// Set once the rest has been written.
+    QAtomicInt ready;
+    RealtimeAudit::Kind kind;
+    int frameCount;
+    void *frames[RealtimeAudit::MaxFrames];
+};
+
+Violation g_violations[RealtimeAudit::MaxViolations];
+
+/// Violations so far.  May exceed MaxViolations.
+QAtomicInt g_violationCount;
+
+// noinline so that the frames to skip when reporting are always the
+// same: this and the interceptor that called it.
+__attribute__((noinline)) void
+record(RealtimeAudit::Kind kind)
+{
+    if (t_depth == 0  ||  t_recording)
+        return;
+
+    ++t_recording;
+
+    const int index = g_violationCount.fetchAndAddOrdered(1);
+    if (index < RealtimeAudit::MaxViolations) {
+        Violation &violation = g_violations[index];
+        violation.kind = kind;
+        violation.frameCount =
+                backtrace(violation.frames, RealtimeAudit::MaxFrames);
+        violation.ready.storeRelease(1);
+    }
+
+    --t_recording;
+}
+
+const int SkippedFrames = 2;
+
+/// The next definition of a function we intercept, usually libc's.
+/**
+ * Looked up on first use, as libraries may call these before our
+ * static initialisers have run.  RealtimeAudit::initialise() looks
+ * them all up, so that the realtime threads never have to.
+ */
+template <typename Function>
+Function
+next(Function &cached, const char *name)
+{
+    if (!cached)
+        cached = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+    return cached;
+}
+
+typedef int (*MutexLockFunction)(pthread_mutex_t *);
+typedef int (*OpenFunction)(const char *, int, ...);
+typedef ssize_t (*ReadFunction)(int, void *, size_t);
+typedef ssize_t (*WriteFunction)(int, const void *, size_t);
+typedef FILE *(*FopenFunction)(const char *, const char *);
+typedef size_t (*FreadFunction)(void *, size_t, size_t, FILE *);
+typedef size_t (*FwriteFunction)(const void *, size_t, size_t, FILE *);
+
+MutexLockFunction g_mutexLock = nullptr;
+OpenFunction g_open = nullptr;
+OpenFunction g_open64 = nullptr;
+ReadFunction g_read = nullptr;
+WriteFunction g_write = nullptr;
+FopenFunction g_fopen = nullptr;
+FopenFunction g_fopen64 = nullptr;
+FreadFunction g_fread = nullptr;
+FwriteFunction g_fwrite = nullptr;
+
+void
+lookUpAll()
+{
+    next(g_mutexLock, "pthread_mutex_lock");
+    next(g_open, "open");
+    next(g_open64, "open64");
+    next(g_read, "read");
+    next(g_write, "write");
+    next(g_fopen, "fopen");
+    next(g_fopen64, "fopen64");
+    next(g_fread, "fread");
+    next(g_fwrite, "fwrite");
+}
+
+/// "libfoo.so(_ZN3Foo3barEv+0x12) [0x...]" with the name demangled.
+QString
+demangle(const char *symbol)
+{
+    const char *open = strchr(symbol, '(');
+    const char *plus = open ? strchr(open, '+') : nullptr;
+    if (!open || !plus || plus == open + 1)
+        return symbol;
+
+    const std::string mangled(open + 1, plus);
+    int status = 0;
+    char *name = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr,
+                                     &status);
+    if (status != 0 || !name)
+        return symbol;
+
+    const QString result =
+            QString::fromLatin1(symbol, int(open + 1 - symbol)) +
+            QString::fromLatin1(name) + QString::fromLatin1(plus);
+    free(name);
+    return result;
+}
+
+}
+
+// The interceptors.  They are given their libc names with asm labels,
+// rather than declared by those names, so that whatever the headers
+// make of open() and fopen() (large file redirects, exception
+// specifications) doesn't come into it.  Default visibility puts them
+// ahead of libc's in the dynamic symbol lookup.
+
+#define RG_INTERCEPT(name) \
+    __asm__(#name) __attribute__((visibility("default")))
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *pointer);
+
+void *rgAuditMalloc(size_t size) RG_INTERCEPT(malloc);
+void *rgAuditCalloc(size_t count, size_t size) RG_INTERCEPT(calloc);
+void *rgAuditRealloc(void *pointer, size_t size) RG_INTERCEPT(realloc);
+void *rgAuditMemalign(size_t alignment, size_t size) RG_INTERCEPT(memalign);
+void *rgAuditAlignedAlloc(size_t alignment, size_t size)
+        RG_INTERCEPT(aligned_alloc);
+int rgAuditPosixMemalign(void **pointer, size_t alignment, size_t size)
+        RG_INTERCEPT(posix_memalign);
+void rgAuditFree(void *pointer) RG_INTERCEPT(free);
+
+int rgAuditMutexLock(pthread_mutex_t *mutex)
+        RG_INTERCEPT(pthread_mutex_lock);
+
+int rgAuditOpen(const char *path, int flags, ...) RG_INTERCEPT(open);
+int rgAuditOpen64(const char *path, int flags, ...) RG_INTERCEPT(open64);
+ssize_t rgAuditRead(int fd, void *buffer, size_t count) RG_INTERCEPT(read);
+ssize_t rgAuditWrite(int fd, const void *buffer, size_t count)
+        RG_INTERCEPT(write);
+FILE *rgAuditFopen(const char *path, const char *mode) RG_INTERCEPT(fopen);
+FILE *rgAuditFopen64(const char *path, const char *mode)
+        RG_INTERCEPT(fopen64);
+size_t rgAuditFread(void *buffer, size_t size, size_t count, FILE *file)
+        RG_INTERCEPT(fread);
+size_t rgAuditFwrite(const void *buffer, size_t size, size_t count,
+                     FILE *file) RG_INTERCEPT(fwrite);
+
+}
+
+#undef RG_INTERCEPT
+
+void *
+rgAuditMalloc(size_t size)
+{
+    record(RealtimeAudit::Allocation);
+    return __libc_malloc(size);
+}
+
+void *
+rgAuditCalloc(size_t count, size_t size)
+{
+    record(RealtimeAudit::Allocation);
+    return __libc_calloc(count, size);
+}
+
+void *
+rgAuditRealloc(void *pointer, size_t size)
+{
+    record(RealtimeAudit::Allocation);
+    return __libc_realloc(pointer, size);
+}
+
+void *
+rgAuditMemalign(size_t alignment, size_t size)
+{
+    record(RealtimeAudit::Allocation);
+    return __libc_memalign(alignment, size);
+}
+
+void *
+rgAuditAlignedAlloc(size_t alignment, size_t size)
+{
+    record(RealtimeAudit::Allocation);
+    return __libc_memalign(alignment, size);
+}
+
+int
+rgAuditPosixMemalign(void **pointer, size_t alignment, size_t size)
+{
+    record(RealtimeAudit::Allocation);
+
+    if (alignment % sizeof(void *) != 0  ||
+        (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    void *allocated = __libc_memalign(alignment, size);
+    if (!allocated)
+        return ENOMEM;
+    *pointer = allocated;
+    return 0;
+}
+
+void
+rgAuditFree(void *pointer)
+{
+    if (pointer)
+        record(RealtimeAudit::Deallocation);
+    __libc_free(pointer);
+}
+
+int
+rgAuditMutexLock(pthread_mutex_t *mutex)
+{
+    record(RealtimeAudit::MutexLock);
+    return next(g_mutexLock, "pthread_mutex_lock")(mutex);
+}
+
+int
+rgAuditOpen(const char *path, int flags, ...)
+{
+    record(RealtimeAudit::FileIO);
+
+    // The mode is only there if the flags call for one, but reading
+    // it regardless is harmless on the platforms we build for.
+    va_list args;
+    va_start(args, flags);
+    const mode_t mode = va_arg(args, mode_t);
+    va_end(args);
+
+    return next(g_open, "open")(path, flags, mode);
+}
+
+int
+rgAuditOpen64(const char *path, int flags, ...)
+{
+    record(RealtimeAudit::FileIO);
+
+    va_list args;
+    va_start(args, flags);
+    const mode_t mode = va_arg(args, mode_t);
+    va_end(args);
+
+    return next(g_open64, "open64")(path, flags, mode);
+}
+
+ssize_t
+rgAuditRead(int fd, void *buffer, size_t count)
+{
+    record(RealtimeAudit::FileIO);
+    return next(g_read, "read")(fd, buffer, count);
+}
+
+ssize_t
+rgAuditWrite(int fd, const void *buffer, size_t count)
+{
+    record(RealtimeAudit::FileIO);
+    return next(g_write, "write")(fd, buffer, count);
+}
+
+FILE *
+rgAuditFopen(const char *path, const char *mode)
+{
+    record(RealtimeAudit::FileIO);
+    return next(g_fopen, "fopen")(path, mode);
+}
+
+FILE *
+rgAuditFopen64(const char *path, const char *mode)
+{
+    record(RealtimeAudit::FileIO);
+    return next(g_fopen64, "fopen64")(path, mode);
+}
+
+size_t
+rgAuditFread(void *buffer, size_t size, size_t count, FILE *file)
+{
+    record(RealtimeAudit::FileIO);
+    return next(g_fread, "fread")(buffer, size, count, file);
+}
+
+size_t
+rgAuditFwrite(const void *buffer, size_t size, size_t count, FILE *file)
+{
+    record(RealtimeAudit::FileIO);
+    return next(g_fwrite, "fwrite")(buffer, size, count, file);
+}
+
+namespace Rosegarden
+{
+
+
+bool
+RealtimeAudit::isEnabled()
+{
+    return true;
+}
+
+void
+RealtimeAudit::initialise()
+{
+    lookUpAll();
+
+    // The first backtrace() loads the unwinder.
+    void *frames[2];
+    backtrace(frames, 2);
+}
+
+void
+RealtimeAudit::enter()
+{
+    ++t_depth;
+}
+
+void
+RealtimeAudit::leave()
+{
+    --t_depth;
+}
+
+bool
+RealtimeAudit::isRealtime()
+{
+    return t_depth > 0;
+}
+
+int
+RealtimeAudit::getViolationCount()
+{
+    return g_violationCount.loadAcquire();
+}
+
+void
+RealtimeAudit::reset()
+{
+    for (int i = 0; i < MaxViolations; ++i)
+        g_violations[i].ready.storeRelease(0);
+    g_violationCount.storeRelease(0);
+}
+
+QString
+RealtimeAudit::getReport()
+{
+    const int count = getViolationCount();
+    const int recorded = std::min(count, int(MaxViolations));
+
+    // The same site usually offends once per block, so report each
+    // distinct stack once, with how often it was seen.
+    typedef std::pair<int, std::vector<void *> > Site;
+    std::map<Site, int> sites;
+    std::vector<Site> order;
+
+    for (int i = 0; i < recorded; ++i) {
+        const Violation &violation = g_violations[i];
+        if (!violation.ready.loadAcquire())
+            continue;
+        const Site site(int(violation.kind),
+                        std::vector<void *>(violation.frames,
+                                            violation.frames +
+                                            violation.frameCount));
+        if (sites[site]++ == 0)
+            order.push_back(site);
+    }
+
+    QString report;
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        const Site &site = order[i];
+        report += QString("%1 on a realtime thread (%2 times):\n")
+                .arg(getKindName(Kind(site.first)))
+                .arg(sites[site]);
+
+        const int frameCount = int(site.second.size());
+        char **symbols = backtrace_symbols(&site.second[0], frameCount);
+        for (int f = SkippedFrames; f < frameCount; ++f) {
+            report += "    ";
+            report += (symbols ? demangle(symbols[f]) : QString("?"));
+            report += "\n";
+        }
+        free(symbols);
+    }
+
+    if (count > recorded) {
+        report += QString("%1 more not recorded\n").arg(count - recorded);
+    }
+
+    return report;
+}
+
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2021 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_REALTIME_AUDIT_H
+#define RG_REALTIME_AUDIT_H
+
+#include <rosegardenprivate_export.h>
+
+#include <QString>
+
+namespace Rosegarden
+{
+
+
+/// Catches the realtime audio threads doing what they mustn't.
+/**
+ * In a build configured with USE_RT_AUDIT (which defines RG_RT_AUDIT),
+ * malloc() and friends, pthread_mutex_lock() and file I/O (open(),
+ * read(), write(), fopen(), fread() and fwrite()) are intercepted for
+ * the whole process.  When one of them is called on a thread that is
+ * inside a Scope, which is to say in the JACK process callback or in
+ * one of the mixer's worker threads processing a block, a violation is
+ * recorded: what was called, and the stack it was called from.
+ *
+ * Locks that are only tried, with pthread_mutex_trylock(), are allowed,
+ * as are semaphores and condition signalling.
+ *
+ * Recording a violation is itself realtime safe: the first MaxViolations
+ * go into a fixed table, and the rest are only counted.  The stacks are
+ * turned into function names by getReport(), which isn't.
+ *
+ * Calls that glibc makes to itself are not intercepted, nor are those
+ * made directly by the kernel interface.  So this finds what our code,
+ * Qt and the standard C++ library do on the realtime threads, not
+ * everything that could block.
+ *
+ * In a normal build, Scope compiles away and there is never anything
+ * to report.
+ */
+class ROSEGARDENPRIVATE_EXPORT RealtimeAudit
+{
+public:
+    /// Violations beyond this many are counted but not recorded.
+    static const int MaxViolations = 256;
+    /// Stack frames recorded for each violation.
+    static const int MaxFrames = 24;
+
+    enum Kind {
+        Allocation,
+        Deallocation,
+        MutexLock,
+        FileIO
+    };
+
+    /// Whether this build audits anything.
+    static bool isEnabled();
+
+    /// Get ready to record.  Not realtime safe.
+    /**
+     * Call before the realtime threads start, so that the first
+     * violation doesn't have to load the unwinder.  Safe to call more
+     * than once.
+     */
+    static void initialise();
+
+    /// The calling thread is realtime from construction to destruction.
+    /**
+     * Scopes nest, so it doesn't matter if a function that has one is
+     * called from another that does.
+     */
+    class Scope
+    {
+    public:
+        Scope()  { enter(); }
+        ~Scope()  { leave(); }
+
+    private:
+        Scope(const Scope &);
+        Scope &operator=(const Scope &);
+    };
+
+    /// Whether the calling thread is inside a Scope.
+    static bool isRealtime();
+
+    /// Violations since the last reset(), recorded or not.
+    static int getViolationCount();
+
+    /// Forget all violations.  Not while the realtime threads run.
+    static void reset();
+
+    /// The recorded violations, each with its stack.  Not realtime safe.
+    static QString getReport();
+
+    static const char *getKindName(Kind kind);
+
+private:
+#ifdef RG_RT_AUDIT
+    static void enter();
+    static void leave();
+#else
+    static void enter()  { }
+    static void leave()  { }
+#endif
+};
+
+
+}
+
+#endif
@@ -14,8 +14,10 @@
 */
 
 #include "RecordableAudioFile.h"
+#include "AudioKernels.h"
 
 #include <cstdlib>
+#include <alloca.h>
 
 //#define DEBUG_RECORDABLE 1
 
@@ -137,14 +139,12 @@ RecordableAudioFile::write()
 	    }
 	}
     } else {
-	char *encodePointer = encodeBuffer;
-	for (size_t i = 0; i < s; ++i) {
-	    for (unsigned int ch = 0; ch < channels; ++ch) {
-		float sample = buffer[i + ch * s];
-		*(float *)encodePointer = sample;
-		encodePointer += sizeof(float);
-	    }
+	const float **sources =
+	    (const float **)alloca(channels * sizeof(const float *));
+	for (unsigned int ch = 0; ch < channels; ++ch) {
+	    sources[ch] = buffer + ch * s;
 	}
+	AudioKernels::interleave(sources, channels, s, (float *)encodeBuffer);
     }
 
 #ifdef DEBUG_RECORDABLE
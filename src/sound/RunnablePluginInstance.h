@@ -87,6 +87,14 @@ public:
 
     virtual void silence() = 0;
     virtual void discardEvents() { }
+
+    /**
+     * Whether this instance is run together with other instances of the
+     * same plugin (DSSI run_multiple_synths), sharing state with them.
+     * Such instances must all be run from the same thread.
+     */
+    virtual bool isInGroup() const { return false; }
+
     virtual void setIdealChannelCount(size_t channels) = 0; // must also silence(); may also re-instantiate
 
     void setFactory(PluginFactory *f) { m_factory = f; } // ew
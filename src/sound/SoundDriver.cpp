@@ -24,7 +24,8 @@
 #include "AudioPlayQueue.h"
 #include "PlayableAudioFile.h"
 
-#include <unistd.h>  // for usleep()
+#include <QElapsedTimer>
+
 #include <sys/time.h>
 #include <pthread.h> // for mutex
 
@@ -41,18 +42,20 @@ SoundDriver::SoundDriver(MappedStudio *studio, const QString &name) :
         m_playing(false),
         m_recordStatus(RECORD_OFF),
         m_midiClockInterval(0, 0),
+        m_wakeRequested(false),
         m_audioQueue(nullptr),
         m_smallFileSize(0),
+        m_preloadSmallFiles(false),
         m_audioRecFileFormat(RIFFAudioFile::FLOAT),
         m_studio(studio)
 {
-    m_audioQueue = new AudioPlayQueue();
+    m_audioQueue.storeRelease(new AudioPlayQueue());
 }
 
 SoundDriver::~SoundDriver()
 {
     RG_DEBUG << "SoundDriver::~SoundDriver (exiting)";
-    delete m_audioQueue;
+    delete m_audioQueue.loadAcquire();
 }
 
 void
@@ -146,15 +149,31 @@ SoundDriver::initialiseAudioQueue(const std::vector<MappedEvent> &events)
     RG_DEBUG << "SoundDriver::initialiseAudioQueue -- new queue has "
     << newQueue->size() << " files";
 
+    const AudioCache::Statistics cacheStatistics =
+        PlayableAudioFile::getSmallFileCacheStatistics();
+    RG_DEBUG << "SoundDriver::initialiseAudioQueue -- small file cache has "
+    << cacheStatistics.entries << " files in " << cacheStatistics.bytes
+    << " bytes (" << cacheStatistics.unreferencedBytes << " unused), "
+    << cacheStatistics.hits << " hits, " << cacheStatistics.misses
+    << " misses, " << cacheStatistics.evictions << " evictions, "
+    << cacheStatistics.refusals << " refused";
+
     if (newQueue->empty()) {
-        if (m_audioQueue->empty()) {
+        if (m_audioQueue.loadAcquire()->empty()) {
             delete newQueue;
             return ;
         }
     }
 
-    AudioPlayQueue *oldQueue = m_audioQueue;
-    m_audioQueue = newQueue;
+    setAudioQueue(newQueue);
+}
+
+void
+SoundDriver::setAudioQueue(AudioPlayQueue *queue)
+{
+    queue->buildIndex();
+
+    AudioPlayQueue *oldQueue = m_audioQueue.fetchAndStoreOrdered(queue);
     if (oldQueue)
         m_audioQueueScavenger.claim(oldQueue);
 }
@@ -162,7 +181,7 @@ SoundDriver::initialiseAudioQueue(const std::vector<MappedEvent> &events)
 const AudioPlayQueue *
 SoundDriver::getAudioQueue() const
 {
-    return m_audioQueue;
+    return m_audioQueue.loadAcquire();
 }
 
 
@@ -226,6 +245,13 @@ SoundDriver::getMappedDevice(DeviceId id)
 */
 
 
+void
+SoundDriver::setSmallFileCache(int memoryLimit, bool preload)
+{
+    PlayableAudioFile::setSmallFileCacheLimit(size_t(memoryLimit) * 1024);
+    m_preloadSmallFiles = preload;
+}
+
 bool
 SoundDriver::addAudioFile(const QString &fileName, unsigned int id)
 {
@@ -236,6 +262,11 @@ SoundDriver::addAudioFile(const QString &fileName, unsigned int id)
         ins->open();
         m_audioFiles.push_back(ins);
 
+        if (m_preloadSmallFiles) {
+            PlayableAudioFile::preloadSmallFile
+                (ins, size_t(m_smallFileSize) * 1024, int(getSampleRate()));
+        }
+
         //RG_DEBUG << "Sequencer::addAudioFile() = \"" << fileName << "\"";
 
         return true;
@@ -256,6 +287,7 @@ SoundDriver::removeAudioFile(unsigned int id)
             RG_DEBUG << "Sequencer::removeAudioFile() = \"" <<
                 (*it)->getFilename() << "\"";
 
+            PlayableAudioFile::forgetSmallFile(*it);
             delete (*it);
             m_audioFiles.erase(it);
             return true;
@@ -283,8 +315,10 @@ SoundDriver::clearAudioFiles()
     //RG_DEBUG << "SoundDriver::clearAudioFiles() - clearing down audio files";
 
     std::vector<AudioFile*>::iterator it;
-    for (it = m_audioFiles.begin(); it != m_audioFiles.end(); ++it)
+    for (it = m_audioFiles.begin(); it != m_audioFiles.end(); ++it) {
+        PlayableAudioFile::forgetSmallFile(*it);
         delete(*it);
+    }
 
     m_audioFiles.erase(m_audioFiles.begin(), m_audioFiles.end());
 }
@@ -292,12 +326,31 @@ SoundDriver::clearAudioFiles()
 void
 SoundDriver::sleep(const RealTime &rt)
 {
-    // The usleep man page says it's deprecated and we should use
-    // nanosleep.  And that's what we did.  But it seems quite a few
-    // people don't have nanosleep, so we're reverting to usleep.
+    const qint64 msecs = rt.sec * 1000 + rt.msec();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&m_wakeMutex);
+
+    // Loop in case of spurious wakeups.
+    while (!m_wakeRequested) {
+        const qint64 remaining = msecs - timer.elapsed();
+        if (remaining <= 0)
+            break;
+        m_wakeCondition.wait(&m_wakeMutex, remaining);
+    }
+
+    m_wakeRequested = false;
+}
+
+void
+SoundDriver::wake()
+{
+    QMutexLocker locker(&m_wakeMutex);
 
-    unsigned long usec = rt.sec * 1000000 + rt.usec();
-    usleep(usec);
+    m_wakeRequested = true;
+    m_wakeCondition.wakeAll();
 }
 
 
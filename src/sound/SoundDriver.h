@@ -16,6 +16,8 @@
 #ifndef RG_SOUNDDRIVER_H
 #define RG_SOUNDDRIVER_H
 
+#include <rosegardenprivate_export.h>
+
 #include "base/Device.h"
 #include "base/Instrument.h"  // For InstrumentId...
 #include "base/MidiProgram.h"  // For MidiByte...
@@ -28,8 +30,11 @@
 
 #include "RIFFAudioFile.h"  // For SubFormat enum
 
+#include <QAtomicPointer>
+#include <QMutex>
 #include <QString>
 #include <QStringList>
+#include <QWaitCondition>
 
 #include <set>
 #include <vector>
@@ -72,7 +77,7 @@ class MappedStudio;
  * of a sub class of this class and directing it as required
  * by RosegardenSequencer itself.
  */
-class SoundDriver
+class ROSEGARDENPRIVATE_EXPORT SoundDriver
 {
 public:
     SoundDriver(MappedStudio *studio, const QString &name);
@@ -169,8 +174,29 @@ public:
     virtual void setLoop(const RealTime & /*start*/,
                          const RealTime & /*end*/)  { }
 
+    /// Shorten a sleep so that the driver's next pending task is on time.
+    /**
+     * E.g. a note-off that processPending() has to send.  Called with
+     * the sequencer locked, unlike sleep().
+     */
+    virtual RealTime limitSleepTime(const RealTime &rt)  { return rt; }
+
+    /// Sleep for up to the given time, or until wake() is called.
+    /**
+     * Called by the sequencer thread between iterations of its loop.
+     * A driver should return early if it has work to do (e.g. incoming
+     * MIDI or a note-off that is due) rather than wait out the full
+     * time.
+     */
     virtual void sleep(const RealTime &rt);
 
+    /// Cut short a sleep() in progress, or the next one if none is.
+    /**
+     * Safe to call from any thread.  Used to get the sequencer thread
+     * to react to transport changes and the like right away.
+     */
+    virtual void wake();
+
     // Set MIDI clock interval - allow redefinition above to ensure
     // we handle this reset correctly.
     virtual void setMIDIClockInterval(RealTime interval)
@@ -191,6 +217,12 @@ public:
         m_smallFileSize = smallFileSize;
     }
 
+    // Limit the memory (in kbytes) the small file cache shared by all
+    // PlayableAudioFiles may take, and choose whether to decode small
+    // files into it in the background as they are added, rather than
+    // when they are first played.
+    void setSmallFileCache(int memoryLimit, bool preload);
+
     // Get the driver's operating sample rate
     virtual unsigned int getSampleRate() const  { return 0; }
 
@@ -209,6 +241,14 @@ public:
     bool removeAudioFile(unsigned int id);
 
     void initialiseAudioQueue(const std::vector<MappedEvent> &audioEvents);
+
+    /// The queue the audio threads are to play from.  RT safe.
+    /**
+     * The queue returned is never changed, and stays valid for at
+     * least as long as the scavenger's delay (a couple of seconds)
+     * after another replaces it.  So look it up once per block, not
+     * once per playback.
+     */
     const AudioPlayQueue *getAudioQueue() const;
 
     RIFFAudioFile::SubFormat getAudioRecFileFormat() const
@@ -353,13 +393,26 @@ protected:
      */
     RealTime m_midiClockInterval;
 
+    /// For the default sleep() and wake().
+    QMutex m_wakeMutex;
+    QWaitCondition m_wakeCondition;
+    bool m_wakeRequested;
+
 
     // *** Audio ***
 
     // Subclass _MUST_ scavenge this regularly.
     Scavenger<AudioPlayQueue> m_audioQueueScavenger;
 
-    AudioPlayQueue *m_audioQueue;
+    /// Index and publish a new queue, and scavenge the old one.
+    /**
+     * Call from the sequencer thread only.  To add to the current
+     * queue, make a copy with AudioPlayQueue's taking-over constructor,
+     * add to that and publish it.
+     */
+    void setAudioQueue(AudioPlayQueue *queue);
+
+    QAtomicPointer<AudioPlayQueue> m_audioQueue;
 
     /// A list of AudioFile's that we can play.
     std::vector<AudioFile *> m_audioFiles;
@@ -370,6 +423,7 @@ protected:
     RealTime m_audioWriteBufferLength;
 
     int m_smallFileSize;
+    bool m_preloadSmallFiles;
 
     RIFFAudioFile::SubFormat m_audioRecFileFormat;
 
@@ -15,6 +15,8 @@
 #ifndef RG_SOUNDFILE_H
 #define RG_SOUNDFILE_H
 
+#include <rosegardenprivate_export.h>
+
 // SoundFile is an abstract base class defining behaviour for both
 // MidiFiles and AudioFiles.  The getBytes routine is buffered into
 // suitably sized chunks to prevent excessive file reads.
@@ -34,7 +36,7 @@ namespace Rosegarden
 
 typedef unsigned char FileByte;
 
-class SoundFile
+class ROSEGARDENPRIVATE_EXPORT SoundFile
 {
     Q_DECLARE_TR_FUNCTIONS(Rosegarden::SoundFile)
 
@@ -16,8 +16,10 @@
 #define RG_MODULE_STRING "[WAVAudioFile]"
 
 #include "WAVAudioFile.h"
+#include "AudioKernels.h"
 #include "base/RealTime.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include "misc/Debug.h"
@@ -141,12 +143,7 @@ WAVAudioFile::parseHeader()
     //
     readFormatChunk();
 
-}
-
-std::streampos
-WAVAudioFile::getDataOffset()
-{
-    return 0;
+    findDataChunk();
 }
 
 bool
@@ -196,17 +193,31 @@ WAVAudioFile::decode(const unsigned char *ubuf,
             tch = 0;
         }
 
-        float ratio = 1.0;
-        if (sourceSampleRate != targetSampleRate) {
-            ratio = float(sourceSampleRate) / float(targetSampleRate);
+        const unsigned char *source = &ubuf[(bitsPerSample / 8) * ch];
+
+        if (sourceSampleRate == targetSampleRate) {
+
+            size_t frames = std::min(nframes, fileFrames);
+            AudioKernels::addPCM(source, bitsPerSample, sourceChannels,
+                                 target[tch], frames);
+
+            // Past the end of the data, repeat the last frame.
+            if (frames > 0 && frames < nframes) {
+                float sample = convertBytesToSample
+                    (&source[(bitsPerSample / 8) * (frames - 1) * sourceChannels]);
+                for (size_t i = frames; i < nframes; ++i) {
+                    target[tch][i] += sample;
+                }
+            }
+
+            continue;
         }
 
+        float ratio = float(sourceSampleRate) / float(targetSampleRate);
+
         for (size_t i = 0; i < nframes; ++i) {
 
-            size_t j = i;
-            if (sourceSampleRate != targetSampleRate) {
-                j = size_t(i * ratio);
-            }
+            size_t j = size_t(i * ratio);
             if (j >= fileFrames)
                 j = fileFrames - 1;
 
@@ -225,9 +236,7 @@ WAVAudioFile::decode(const unsigned char *ubuf,
             if (!adding) {
                 memcpy(target[ch], target[ch - 1], nframes * sizeof(float));
             } else {
-                for (size_t i = 0; i < nframes; ++i) {
-                    target[ch][i] += target[ch - 1][i];
-                }
+                AudioKernels::add(target[ch], target[ch - 1], nframes);
             }
         } else {
             if (!adding) {
@@ -25,10 +25,12 @@
 #ifndef RG_WAVAUDIOFILE_H
 #define RG_WAVAUDIOFILE_H
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
-class WAVAudioFile : public RIFFAudioFile
+class ROSEGARDENPRIVATE_EXPORT WAVAudioFile : public RIFFAudioFile
 {
 public:
     WAVAudioFile(const unsigned int &id,
@@ -67,10 +69,6 @@ public:
     //
     void parseHeader();
 
-    // Offset to start of sample data
-    //
-    std::streampos getDataOffset() override;
-
     // Peak file name
     //
     QString getPeakFilename() override
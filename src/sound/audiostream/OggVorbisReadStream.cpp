@@ -21,6 +21,7 @@
 #include "OggVorbisReadStream.h"
 
 #include "sound/RingBuffer.h"
+#include "sound/AudioKernels.h"
 
 #include <oggz/oggz.h>
 #include <fishsound/fishsound.h>
@@ -122,11 +123,7 @@ public:
 #else
         float *interleaved = (float *)alloca(n * channels * sizeof(float));
 #endif
-	for (long i = 0; i < n; ++i) {
-	    for (int c = 0; c < channels; ++c) {
-                interleaved[i * channels + c] = frames[c][i];
-            }
-        }
+        AudioKernels::interleave(frames, channels, n, interleaved);
         m_buffer->write(interleaved, n * channels);
         return 0;
     }
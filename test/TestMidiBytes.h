@@ -0,0 +1,32 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+// Helpers for the tests that build MIDI files a byte at a time.
+
+#ifndef RG_TEST_MIDI_BYTES_H
+#define RG_TEST_MIDI_BYTES_H
+
+#include <string>
+
+namespace Rosegarden
+{
+
+inline void appendNumber(std::string &bytes, unsigned long value)
+{
+    // A "variable-length quantity", most significant 7 bits first.
+    std::string reversed(1, char(value & 0x7f));
+    while ((value >>= 7) > 0)
+        reversed += char(0x80 | (value & 0x7f));
+    bytes.append(reversed.rbegin(), reversed.rend());
+}
+
+inline void appendLong(std::string &bytes, unsigned long value)
+{
+    bytes += char((value >> 24) & 0xff);
+    bytes += char((value >> 16) & 0xff);
+    bytes += char((value >> 8) & 0xff);
+    bytes += char(value & 0xff);
+}
+
+}
+
+#endif
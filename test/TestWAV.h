@@ -0,0 +1,73 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+// WAV file fixtures for the audio tests.
+
+#ifndef RG_TEST_WAV_H
+#define RG_TEST_WAV_H
+
+#include "sound/WAVAudioFile.h"
+
+#include <QString>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+/// A repeatable ramp of 16-bit samples, different for each id.
+inline std::vector<short> makeTestSamples(unsigned int id, size_t frames,
+                                          unsigned int channels = 2)
+{
+    std::vector<short> samples(frames * channels);
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = short((i * 37 + id * 1001) % 65536 - 32768);
+    return samples;
+}
+
+/// Write interleaved 16-bit samples to a WAV file.
+inline bool writeTestWAV(const QString &fileName,
+                         const std::vector<short> &samples,
+                         unsigned int channels = 2,
+                         unsigned int sampleRate = 48000)
+{
+    WAVAudioFile out(fileName, channels, sampleRate,
+                     sampleRate * channels * 2, channels * 2, 16);
+    if (!out.write())
+        return false;
+
+    std::vector<char> data(samples.size() * 2);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        data[i * 2] = char(samples[i] & 0xff);
+        data[i * 2 + 1] = char((samples[i] >> 8) & 0xff);
+    }
+    out.appendSamples(data.empty() ? nullptr : &data[0],
+                      (unsigned int)(samples.size() / channels));
+    out.close();
+    return true;
+}
+
+/// Open a WAV file for reading, or return nullptr.
+inline WAVAudioFile *openTestWAV(const QString &fileName, unsigned int id)
+{
+    WAVAudioFile *file = new WAVAudioFile(id, "test", fileName);
+    if (!file->open()) {
+        delete file;
+        return nullptr;
+    }
+    return file;
+}
+
+/// Write makeTestSamples(id, frames) to a WAV file and open it.
+inline WAVAudioFile *makeTestWAV(const QString &fileName, unsigned int id,
+                                 size_t frames, unsigned int channels = 2,
+                                 unsigned int sampleRate = 48000)
+{
+    if (!writeTestWAV(fileName, makeTestSamples(id, frames, channels),
+                      channels, sampleRate))
+        return nullptr;
+    return openTestWAV(fileName, id);
+}
+
+}
+
+#endif
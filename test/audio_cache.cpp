@@ -0,0 +1,367 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/AudioCache.h"
+#include "sound/PlayableAudioFile.h"
+#include "sound/WAVAudioFile.h"
+#include "base/RealTime.h"
+#include "TestWAV.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const unsigned int SampleRate = 48000;
+const unsigned int Channels = 2;
+const size_t BlockFrames = 1024;
+const size_t SmallFileSize = 131072;
+
+/// Cache data of the given length, every sample set to value.
+float **makeData(size_t channels, size_t frames, float value)
+{
+    float **data = new float *[channels];
+    for (size_t ch = 0; ch < channels; ++ch) {
+        data[ch] = new float[frames];
+        std::fill(data[ch], data[ch] + frames, value);
+    }
+    return data;
+}
+
+void *key(int n)
+{
+    return reinterpret_cast<void *>(size_t(n + 1) * 16);
+}
+
+/// Everything a file plays, from the start.
+std::vector<float> play(PlayableAudioFile &file)
+{
+    std::vector<float> played;
+
+    std::vector<float> left(BlockFrames), right(BlockFrames);
+    std::vector<float *> block;
+    block.push_back(&left[0]);
+    block.push_back(&right[0]);
+
+    file.fillBuffers(RealTime::zeroTime);
+
+    for (int round = 0; round < 10000; ++round) {
+        file.updateBuffers();
+
+        std::fill(left.begin(), left.end(), 0.0f);
+        std::fill(right.begin(), right.end(), 0.0f);
+        const size_t n = std::min(file.getSampleFramesAvailable(), BlockFrames);
+        if (n == 0 && file.isFullyBuffered())
+            break;
+        file.addSamples(block, Channels, n);
+
+        for (size_t i = 0; i < n; ++i) {
+            played.push_back(left[i]);
+            played.push_back(right[i]);
+        }
+    }
+
+    return played;
+}
+
+/// Whether a small file played the same as it did streamed.  Only
+/// streaming fades the start in, and pads the last block out with
+/// silence.
+bool sameAsStreamed(const std::vector<float> &played,
+                    const std::vector<float> &streamed)
+{
+    const size_t fade = 30 * Channels;
+    return played.size() == SampleRate / 10 * Channels &&
+        streamed.size() >= played.size() &&
+        std::equal(played.begin() + fade, played.end(),
+                   streamed.begin() + fade);
+}
+
+}
+
+// AudioCache keeps what nobody is using, least recently used first
+// out, within its memory limit, and PlayableAudioFile plays the same
+// samples from it as it streams.
+class TestAudioCache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testLeastRecentlyUsed();
+    void testLimit();
+    void testRemove();
+    void testRemoveAll();
+    void testPlayable();
+    void testPreload();
+    void benchmarkDrumHits();
+
+private:
+    PlayableAudioFile *makePlayable(size_t n);
+
+    QTemporaryDir m_dir;
+    // A tenth of a second each: small enough for the small file cache.
+    std::vector<AudioFile *> m_files;
+};
+
+void TestAudioCache::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    for (unsigned int n = 0; n < 64; ++n) {
+        const QString fileName = m_dir.path() + QString("/%1.wav").arg(n);
+        WAVAudioFile *file = makeTestWAV(fileName, n, SampleRate / 10,
+                                         Channels, SampleRate);
+        QVERIFY(file);
+        m_files.push_back(file);
+    }
+
+    PlayableAudioFile::setRingBufferPoolSizes(16, 16384);
+}
+
+void TestAudioCache::cleanupTestCase()
+{
+    for (size_t n = 0; n < m_files.size(); ++n) {
+        PlayableAudioFile::forgetSmallFile(m_files[n]);
+        delete m_files[n];
+    }
+    m_files.clear();
+}
+
+PlayableAudioFile *TestAudioCache::makePlayable(size_t n)
+{
+    return new PlayableAudioFile(n, m_files[n], RealTime::zeroTime,
+                                 RealTime::zeroTime, RealTime(1, 0),
+                                 16384, SmallFileSize);
+}
+
+void TestAudioCache::testLeastRecentlyUsed()
+{
+    const size_t frames = 1000;
+    const size_t bytes = frames * sizeof(float);
+
+    AudioCache cache;
+    cache.setMemoryLimit(bytes * 3);
+
+    size_t channels = 0, nframes = 0;
+
+    // Three fit, the first least recently used.
+    for (int n = 0; n < 3; ++n) {
+        QVERIFY(cache.addData(key(n), 1, frames, makeData(1, frames, n)));
+        cache.decrementReference(key(n));
+    }
+    QCOMPARE(cache.getStatistics().unreferencedBytes, bytes * 3);
+
+    // Using the first makes the second least recently used.
+    QVERIFY(cache.acquire(key(0), channels, nframes));
+    QCOMPARE(nframes, frames);
+    cache.decrementReference(key(0));
+
+    QVERIFY(cache.addUnreferencedData(key(3), 1, frames,
+                                      makeData(1, frames, 3)));
+    QVERIFY(cache.has(key(0)));
+    QVERIFY(!cache.has(key(1)));
+    QVERIFY(cache.has(key(2)));
+    QVERIFY(cache.has(key(3)));
+
+    float **data = cache.acquire(key(2), channels, nframes);
+    QVERIFY(data);
+    QCOMPARE(data[0][frames - 1], 2.0f);
+    QVERIFY(!cache.acquire(key(1), channels, nframes));
+
+    const AudioCache::Statistics statistics = cache.getStatistics();
+    QCOMPARE(statistics.hits, size_t(2));
+    QCOMPARE(statistics.misses, size_t(1));
+    QCOMPARE(statistics.evictions, size_t(1));
+    QCOMPARE(statistics.entries, size_t(3));
+    QCOMPARE(statistics.bytes, bytes * 3);
+    QCOMPARE(statistics.unreferencedBytes, bytes * 2);
+
+    cache.decrementReference(key(2));
+}
+
+void TestAudioCache::testLimit()
+{
+    const size_t frames = 1000;
+    const size_t bytes = frames * sizeof(float);
+
+    AudioCache cache;
+    cache.setMemoryLimit(bytes * 2);
+
+    // Data in use is never thrown out, so what won't fit is refused.
+    float **first = makeData(1, frames, 0);
+    float **second = makeData(1, frames, 1);
+    float **third = makeData(1, frames, 2);
+    QVERIFY(cache.addData(key(0), 1, frames, first));
+    QVERIFY(cache.addData(key(1), 1, frames, second));
+    QVERIFY(!cache.addData(key(2), 1, frames, third));
+    QCOMPARE(cache.getStatistics().refusals, size_t(1));
+
+    // Once something is released there is room.
+    cache.decrementReference(key(0));
+    QVERIFY(cache.addData(key(2), 1, frames, third));
+    QVERIFY(!cache.has(key(0)));
+
+    // Lowering the limit throws out what it can straight away.
+    cache.decrementReference(key(1));
+    cache.setMemoryLimit(bytes);
+    QVERIFY(!cache.has(key(1)));
+    QVERIFY(cache.has(key(2)));
+    QCOMPARE(cache.getStatistics().bytes, bytes);
+
+    cache.decrementReference(key(2));
+}
+
+void TestAudioCache::testRemove()
+{
+    const size_t frames = 1000;
+
+    AudioCache cache;
+    size_t channels = 0, nframes = 0;
+
+    // Removing data in use keeps it until it is released.
+    QVERIFY(cache.addData(key(0), 1, frames, makeData(1, frames, 0)));
+    cache.remove(key(0));
+    QVERIFY(cache.getData(key(0), channels, nframes));
+    cache.decrementReference(key(0));
+    QVERIFY(!cache.has(key(0)));
+
+    QVERIFY(cache.addUnreferencedData(key(1), 1, frames,
+                                      makeData(1, frames, 1)));
+    cache.remove(key(1));
+    QVERIFY(!cache.has(key(1)));
+    QCOMPARE(cache.getStatistics().bytes, size_t(0));
+}
+
+void TestAudioCache::testRemoveAll()
+{
+    const size_t frames = 1000;
+
+    AudioCache cache;
+    size_t channels = 0, nframes = 0;
+
+    // As happens when the sample rate changes while something plays.
+    float **held = makeData(1, frames, 0);
+    QVERIFY(cache.addData(key(0), 1, frames, held));
+    QVERIFY(cache.addUnreferencedData(key(1), 1, frames,
+                                      makeData(1, frames, 1)));
+    cache.removeAll();
+
+    // The data in use stays put for its holder...
+    QCOMPARE(cache.getData(key(0), channels, nframes), held);
+    // ...but nobody else gets it, and nothing replaces it yet.
+    QVERIFY(!cache.has(key(0)));
+    QVERIFY(!cache.acquire(key(0), channels, nframes));
+    float **replacement = makeData(1, frames, 2);
+    QVERIFY(!cache.addData(key(0), 1, frames, replacement));
+    QVERIFY(!cache.has(key(1)));
+
+    // Once released, the old data goes and new data can go in.
+    cache.decrementReference(key(0));
+    QCOMPARE(cache.getStatistics().bytes, size_t(0));
+    QVERIFY(cache.addData(key(0), 1, frames, replacement));
+    QCOMPARE(cache.acquire(key(0), channels, nframes), replacement);
+}
+
+void TestAudioCache::testPlayable()
+{
+    PlayableAudioFile::setSmallFileCacheLimit(64 * 1024 * 1024);
+
+    PlayableAudioFile *streamed = new PlayableAudioFile(
+            0, m_files[0], RealTime::zeroTime, RealTime::zeroTime,
+            RealTime(1, 0), 16384, 0);
+    QVERIFY(!streamed->isSmallFile());
+    const std::vector<float> expected = play(*streamed);
+    delete streamed;
+
+    const AudioCache::Statistics before =
+        PlayableAudioFile::getSmallFileCacheStatistics();
+
+    // The first decodes the file, and it stays cached for the second
+    // after the first has gone.
+    PlayableAudioFile *first = makePlayable(0);
+    QVERIFY(first->isSmallFile());
+    QVERIFY(sameAsStreamed(play(*first), expected));
+    delete first;
+
+    PlayableAudioFile *second = makePlayable(0);
+    QVERIFY(second->isSmallFile());
+    QVERIFY(sameAsStreamed(play(*second), expected));
+    delete second;
+
+    AudioCache::Statistics after =
+        PlayableAudioFile::getSmallFileCacheStatistics();
+    QCOMPARE(after.misses - before.misses, size_t(1));
+    QCOMPARE(after.hits - before.hits, size_t(1));
+
+    // With no room, files are streamed instead.
+    PlayableAudioFile::setSmallFileCacheLimit(0);
+    PlayableAudioFile *third = makePlayable(0);
+    QVERIFY(!third->isSmallFile());
+    QVERIFY(play(*third) == expected);
+    delete third;
+    QCOMPARE(PlayableAudioFile::getSmallFileCacheStatistics().bytes, size_t(0));
+
+    PlayableAudioFile::setSmallFileCacheLimit(64 * 1024 * 1024);
+}
+
+void TestAudioCache::testPreload()
+{
+    PlayableAudioFile::setSmallFileCacheLimit(64 * 1024 * 1024);
+
+    for (size_t n = 1; n < m_files.size(); ++n)
+        PlayableAudioFile::preloadSmallFile(m_files[n], SmallFileSize,
+                                            SampleRate);
+
+    // All bar the first, which the last test left out.
+    for (int wait = 0; wait < 1000; ++wait) {
+        if (PlayableAudioFile::getSmallFileCacheStatistics().entries ==
+            m_files.size() - 1)
+            break;
+        QTest::qWait(10);
+    }
+    QCOMPARE(PlayableAudioFile::getSmallFileCacheStatistics().entries,
+             m_files.size() - 1);
+
+    const AudioCache::Statistics before =
+        PlayableAudioFile::getSmallFileCacheStatistics();
+
+    for (size_t n = 1; n < m_files.size(); ++n) {
+        PlayableAudioFile *file = makePlayable(n);
+        QVERIFY(file->isSmallFile());
+        QVERIFY(!play(*file).empty());
+        delete file;
+    }
+
+    const AudioCache::Statistics after =
+        PlayableAudioFile::getSmallFileCacheStatistics();
+    QCOMPARE(after.hits - before.hits, m_files.size() - 1);
+    QCOMPARE(after.misses, before.misses);
+}
+
+void TestAudioCache::benchmarkDrumHits()
+{
+    PlayableAudioFile::setSmallFileCacheLimit(64 * 1024 * 1024);
+
+    // Each file started eight times over, as a drum pattern would.
+    QBENCHMARK {
+        for (int repeat = 0; repeat < 8; ++repeat) {
+            for (size_t n = 0; n < m_files.size(); ++n) {
+                PlayableAudioFile *file = makePlayable(n);
+                play(*file);
+                delete file;
+            }
+        }
+    }
+}
+
+QTEST_MAIN(TestAudioCache)
+
+#include "audio_cache.moc"
@@ -0,0 +1,195 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/PlayableAudioFile.h"
+#include "sound/WAVAudioFile.h"
+#include "base/RealTime.h"
+#include "TestWAV.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const unsigned int SampleRate = 48000;
+const unsigned int Channels = 2;
+const size_t BlockFrames = 1024;
+
+/// Play files from the start, as AudioFileReader and the mixer would,
+/// until they have all finished.  Returns everything played for each.
+std::vector<std::vector<float> > play(std::vector<PlayableAudioFile *> &files)
+{
+    std::vector<std::vector<float> > played(files.size());
+
+    std::vector<float> left(BlockFrames), right(BlockFrames);
+    std::vector<float *> block;
+    block.push_back(&left[0]);
+    block.push_back(&right[0]);
+
+    for (size_t f = 0; f < files.size(); ++f)
+        files[f]->fillBuffers(RealTime::zeroTime);
+
+    std::vector<bool> finished(files.size(), false);
+    size_t remaining = files.size();
+
+    // A generous bound, in case a file never reports that it has ended.
+    for (int round = 0; remaining > 0 && round < 100000; ++round) {
+        for (size_t f = 0; f < files.size(); ++f) {
+            if (finished[f])
+                continue;
+
+            files[f]->updateBuffers();
+
+            std::fill(left.begin(), left.end(), 0.0f);
+            std::fill(right.begin(), right.end(), 0.0f);
+            const size_t n = files[f]->addSamples(block, Channels, BlockFrames);
+
+            for (size_t i = 0; i < n; ++i) {
+                played[f].push_back(left[i]);
+                played[f].push_back(right[i]);
+            }
+
+            if (n == 0 && files[f]->isFullyBuffered()) {
+                finished[f] = true;
+                --remaining;
+            }
+        }
+    }
+
+    return played;
+}
+
+}
+
+// PlayableAudioFile reading files through a memory mapping gives the
+// same samples as reading them through an ifstream, and how long
+// streaming 64 files at once takes either way.
+class TestAudioFileStreaming : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testSameAsStream();
+    void testStartIndex();
+    void benchmarkStreaming_data();
+    void benchmarkStreaming();
+
+private:
+    std::vector<PlayableAudioFile *> makePlayables(
+            size_t count, const RealTime &startIndex, const RealTime &duration);
+
+    QTemporaryDir m_dir;
+    std::vector<AudioFile *> m_files;
+};
+
+void TestAudioFileStreaming::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    // Two seconds each: too big for the small file cache.
+    for (unsigned int n = 0; n < 64; ++n) {
+        const QString fileName = m_dir.path() + QString("/%1.wav").arg(n);
+        WAVAudioFile *file = makeTestWAV(fileName, n, SampleRate * 2,
+                                         Channels, SampleRate);
+        QVERIFY(file);
+        m_files.push_back(file);
+    }
+
+    PlayableAudioFile::setRingBufferPoolSizes(64 * Channels + 4, 16384);
+}
+
+void TestAudioFileStreaming::cleanupTestCase()
+{
+    for (size_t n = 0; n < m_files.size(); ++n)
+        delete m_files[n];
+    m_files.clear();
+
+    PlayableAudioFile::setMemoryMapping(true);
+}
+
+std::vector<PlayableAudioFile *> TestAudioFileStreaming::makePlayables(
+        size_t count, const RealTime &startIndex, const RealTime &duration)
+{
+    std::vector<PlayableAudioFile *> playables;
+    for (size_t n = 0; n < count; ++n) {
+        playables.push_back(new PlayableAudioFile(
+                n, m_files[n], RealTime::zeroTime, startIndex, duration,
+                16384));
+    }
+    return playables;
+}
+
+void TestAudioFileStreaming::testSameAsStream()
+{
+    const RealTime length = RealTime(2, 0);
+
+    PlayableAudioFile::setMemoryMapping(true);
+    std::vector<PlayableAudioFile *> mapped = makePlayables(4, RealTime::zeroTime, length);
+    PlayableAudioFile::setMemoryMapping(false);
+    std::vector<PlayableAudioFile *> streamed = makePlayables(4, RealTime::zeroTime, length);
+
+    const std::vector<std::vector<float> > fromMapped = play(mapped);
+    const std::vector<std::vector<float> > fromStreamed = play(streamed);
+
+    for (size_t f = 0; f < fromMapped.size(); ++f) {
+        QCOMPARE(fromMapped[f].size(), size_t(SampleRate * 2 * Channels));
+        QVERIFY(fromMapped[f] == fromStreamed[f]);
+        delete mapped[f];
+        delete streamed[f];
+    }
+}
+
+void TestAudioFileStreaming::testStartIndex()
+{
+    // Starting part way in, and asking for more than there is.
+    const RealTime startIndex = RealTime(1, 250000000);
+    const RealTime duration = RealTime(5, 0);
+
+    PlayableAudioFile::setMemoryMapping(true);
+    std::vector<PlayableAudioFile *> mapped = makePlayables(2, startIndex, duration);
+    PlayableAudioFile::setMemoryMapping(false);
+    std::vector<PlayableAudioFile *> streamed = makePlayables(2, startIndex, duration);
+
+    const std::vector<std::vector<float> > fromMapped = play(mapped);
+    const std::vector<std::vector<float> > fromStreamed = play(streamed);
+
+    for (size_t f = 0; f < fromMapped.size(); ++f) {
+        QVERIFY(!fromMapped[f].empty());
+        QVERIFY(fromMapped[f] == fromStreamed[f]);
+        delete mapped[f];
+        delete streamed[f];
+    }
+}
+
+void TestAudioFileStreaming::benchmarkStreaming_data()
+{
+    QTest::addColumn<bool>("mapped");
+    QTest::newRow("ifstream") << false;
+    QTest::newRow("mmap") << true;
+}
+
+void TestAudioFileStreaming::benchmarkStreaming()
+{
+    QFETCH(bool, mapped);
+
+    PlayableAudioFile::setMemoryMapping(mapped);
+
+    QBENCHMARK {
+        std::vector<PlayableAudioFile *> playables =
+            makePlayables(m_files.size(), RealTime::zeroTime, RealTime(2, 0));
+        play(playables);
+        for (size_t f = 0; f < playables.size(); ++f)
+            delete playables[f];
+    }
+}
+
+QTEST_MAIN(TestAudioFileStreaming)
+
+#include "audio_file_streaming.moc"
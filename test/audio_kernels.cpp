@@ -0,0 +1,317 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/AudioKernels.h"
+
+#include <QTest>
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+using namespace Rosegarden;
+
+Q_DECLARE_METATYPE(Rosegarden::AudioKernels::InstructionSet)
+
+namespace
+{
+
+/// Deterministic noise, covering the whole range of each sample size.
+std::vector<unsigned char> makeBytes(size_t count)
+{
+    std::vector<unsigned char> bytes(count);
+    uint32_t x = 12345;
+    for (size_t i = 0; i < count; ++i) {
+        x = x * 1103515245 + 12345;
+        bytes[i] = (unsigned char)(x >> 16);
+    }
+    return bytes;
+}
+
+/// Floats in [-1, 1), with some exact zeros.
+std::vector<float> makeFloats(size_t count, uint32_t seed)
+{
+    std::vector<float> floats(count);
+    uint32_t x = seed;
+    for (size_t i = 0; i < count; ++i) {
+        x = x * 1103515245 + 12345;
+        floats[i] = (i % 7 == 0) ? 0.0f : float(int(x >> 8) - (1 << 23)) / float(1 << 23);
+    }
+    return floats;
+}
+
+/// Bitwise, so that -0 and 0 differ.
+bool same(const std::vector<float> &a, const std::vector<float> &b)
+{
+    return a.size() == b.size() &&
+        (a.empty() || memcmp(&a[0], &b[0], a.size() * sizeof(float)) == 0);
+}
+
+/// As RIFFAudioFile::convertBytesToSample() has always done it.
+float original(const unsigned char *ubuf, int bits)
+{
+    switch (bits) {
+    case 8:
+        return (float)(ubuf[0] - 128.0) / 128.0;
+    case 16: {
+        unsigned char b2 = ubuf[0];
+        unsigned char b1 = ubuf[1];
+        unsigned int bits = (b1 << 8) + b2;
+        return (float)(short(bits)) / 32768.0;
+    }
+    case 24: {
+        unsigned char b3 = ubuf[0];
+        unsigned char b2 = ubuf[1];
+        unsigned char b1 = ubuf[2];
+        unsigned int bits = (b1 << 24) + (b2 << 16) + (b3 << 8);
+        return (float)(int(bits)) / 2147483648.0;
+    }
+    case 32:
+        return *(float *)ubuf;
+    default:
+        return 0.0f;
+    }
+}
+
+const int Bits[] = { 8, 16, 24, 32 };
+const size_t Strides[] = { 1, 2, 3, 6 };
+// Odd lengths, to leave something over after whole vectors.
+const size_t Counts[] = { 0, 1, 3, 7, 9, 17, 1023 };
+
+}
+
+// The SSE2 and AVX2 kernels give exactly the same results as the plain
+// ones, which give exactly the same results as the code they replaced.
+class TestAudioKernels : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void cleanupTestCase();
+    void testScalarAsBefore();
+    void testSameAsScalar_data();
+    void testSameAsScalar();
+    void benchmarkDecode_data();
+    void benchmarkDecode();
+
+private:
+    void addInstructionSets();
+};
+
+void TestAudioKernels::addInstructionSets()
+{
+    QTest::addColumn<AudioKernels::InstructionSet>("set");
+    QTest::newRow("scalar") << AudioKernels::Scalar;
+    if (AudioKernels::isSupported(AudioKernels::SSE2))
+        QTest::newRow("sse2") << AudioKernels::SSE2;
+    if (AudioKernels::isSupported(AudioKernels::AVX2))
+        QTest::newRow("avx2") << AudioKernels::AVX2;
+}
+
+void TestAudioKernels::cleanupTestCase()
+{
+    if (AudioKernels::isSupported(AudioKernels::AVX2))
+        AudioKernels::setInstructionSet(AudioKernels::AVX2);
+    else if (AudioKernels::isSupported(AudioKernels::SSE2))
+        AudioKernels::setInstructionSet(AudioKernels::SSE2);
+}
+
+void TestAudioKernels::testScalarAsBefore()
+{
+    QVERIFY(AudioKernels::setInstructionSet(AudioKernels::Scalar));
+    QCOMPARE(AudioKernels::getInstructionSet(), AudioKernels::Scalar);
+
+    // Every 16-bit value, and plenty of the others.
+    const std::vector<unsigned char> bytes = makeBytes(65536 * 2);
+
+    for (size_t b = 0; b < sizeof(Bits) / sizeof(Bits[0]); ++b) {
+        const int bits = Bits[b];
+        const size_t count = bytes.size() / (bits / 8);
+
+        std::vector<float> expected(count), actual(count, 0.0f);
+        for (size_t i = 0; i < count; ++i)
+            expected[i] = 0.0f + original(&bytes[i * (bits / 8)], bits);
+
+        AudioKernels::addPCM(&bytes[0], bits, 1, &actual[0], count);
+
+        QVERIFY(same(expected, actual));
+    }
+
+    // The fades are as PlayableAudioFile has always done them.
+    const size_t xfade = 30;
+    std::vector<float> in = makeFloats(xfade, 1), out = in;
+    std::vector<float> expectedIn = in, expectedOut = out;
+    for (size_t i = 0; i < xfade; ++i) {
+        expectedIn[i] *= float(i + 1) / float(xfade);
+        expectedOut[xfade - i - 1] *= float(i + 1) / float(xfade);
+    }
+    AudioKernels::fadeIn(&in[0], xfade, float(xfade));
+    AudioKernels::fadeOut(&out[0], xfade, float(xfade));
+    QVERIFY(same(expectedIn, in));
+    QVERIFY(same(expectedOut, out));
+}
+
+void TestAudioKernels::testSameAsScalar_data()
+{
+    addInstructionSets();
+}
+
+void TestAudioKernels::testSameAsScalar()
+{
+    QFETCH(AudioKernels::InstructionSet, set);
+
+    // PCM, at each size, stride and length.  Each source buffer ends
+    // with its last sample, so that reading beyond it would show up
+    // under a memory checker.
+    for (size_t b = 0; b < sizeof(Bits) / sizeof(Bits[0]); ++b) {
+        const int bits = Bits[b];
+        const size_t bytesPerSample = bits / 8;
+
+        for (size_t s = 0; s < sizeof(Strides) / sizeof(Strides[0]); ++s) {
+            const size_t stride = Strides[s];
+
+            for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); ++c) {
+                const size_t count = Counts[c];
+                const size_t used = count ? ((count - 1) * stride + 1) * bytesPerSample : 0;
+
+                std::vector<unsigned char> bytes = makeBytes(used);
+                if (bits == 32) {
+                    // Proper floats, not random bits.
+                    const std::vector<float> floats = makeFloats(count * stride, 7);
+                    if (used) memcpy(&bytes[0], &floats[0], used);
+                }
+                // Offset into the buffer, to misalign it.
+                std::vector<unsigned char> source(used + 1);
+                if (used) memcpy(&source[1], &bytes[0], used);
+
+                std::vector<float> expected = makeFloats(count + 1, 3);
+                std::vector<float> actual = expected;
+
+                AudioKernels::setInstructionSet(AudioKernels::Scalar);
+                AudioKernels::addPCM(&source[1], bits, stride, &expected[0], count);
+                QVERIFY(AudioKernels::setInstructionSet(set));
+                AudioKernels::addPCM(&source[1], bits, stride, &actual[0], count);
+
+                QVERIFY(same(expected, actual));
+            }
+        }
+    }
+
+    // Mixing.
+    for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); ++c) {
+        const size_t count = Counts[c];
+        const std::vector<float> a = makeFloats(count + 1, 11);
+        const std::vector<float> b = makeFloats(count + 1, 13);
+        const float gain = 0.7071f;
+        const float length = float(count + 3);
+
+        std::vector<std::vector<float> > expected, actual;
+        for (int pass = 0; pass < 2; ++pass) {
+            AudioKernels::setInstructionSet(pass == 0 ? AudioKernels::Scalar : set);
+            std::vector<std::vector<float> > &results = (pass == 0 ? expected : actual);
+
+            std::vector<float> r = a;
+            AudioKernels::add(&r[0], &b[0], count);
+            results.push_back(r);
+
+            r = a;
+            AudioKernels::applyGain(&r[0], count, gain);
+            results.push_back(r);
+
+            r = a;
+            AudioKernels::copyWithGain(&r[0], &b[0], count, gain);
+            results.push_back(r);
+
+            r = a;
+            AudioKernels::fadeIn(&r[0], count, length);
+            results.push_back(r);
+
+            r = a;
+            AudioKernels::fadeOut(&r[0], count, length);
+            results.push_back(r);
+        }
+        for (size_t i = 0; i < expected.size(); ++i)
+            QVERIFY(same(expected[i], actual[i]));
+
+        // Silence, with the only non-zero sample at each place in turn.
+        std::vector<float> silent(count + 1, 0.0f);
+        QVERIFY(AudioKernels::isSilent(&silent[0], count));
+        for (size_t i = 0; i < count; ++i) {
+            silent[i] = -0.0001f;
+            QVERIFY(!AudioKernels::isSilent(&silent[0], count));
+            silent[i] = 0.0f;
+        }
+        silent[count] = 1.0f;
+        QVERIFY(AudioKernels::isSilent(&silent[0], count));
+    }
+
+    // Interleaving, at each channel count and length.
+    for (size_t channels = 1; channels <= 3; ++channels) {
+        for (size_t c = 0; c < sizeof(Counts) / sizeof(Counts[0]); ++c) {
+            const size_t frames = Counts[c];
+
+            std::vector<std::vector<float> > planar;
+            std::vector<const float *> sources;
+            for (size_t ch = 0; ch < channels; ++ch)
+                planar.push_back(makeFloats(frames + 1, 17 + ch));
+            for (size_t ch = 0; ch < channels; ++ch)
+                sources.push_back(&planar[ch][0]);
+
+            std::vector<float> expected(frames * channels + 1, 0.5f);
+            std::vector<float> actual = expected;
+            for (size_t i = 0; i < frames; ++i)
+                for (size_t ch = 0; ch < channels; ++ch)
+                    expected[i * channels + ch] = planar[ch][i];
+
+            AudioKernels::setInstructionSet(set);
+            AudioKernels::interleave(&sources[0], channels, frames, &actual[0]);
+            QVERIFY(same(expected, actual));
+
+            // And back again.
+            std::vector<std::vector<float> > split(channels,
+                    std::vector<float>(frames + 1, 0.5f));
+            std::vector<float *> targets;
+            for (size_t ch = 0; ch < channels; ++ch)
+                targets.push_back(&split[ch][0]);
+            AudioKernels::deinterleave(&actual[0], channels, frames, &targets[0]);
+            for (size_t ch = 0; ch < channels; ++ch) {
+                std::vector<float> expectedChannel = planar[ch];
+                expectedChannel[frames] = 0.5f;
+                QVERIFY(same(expectedChannel, split[ch]));
+            }
+        }
+    }
+}
+
+void TestAudioKernels::benchmarkDecode_data()
+{
+    addInstructionSets();
+}
+
+void TestAudioKernels::benchmarkDecode()
+{
+    QFETCH(AudioKernels::InstructionSet, set);
+    QVERIFY(AudioKernels::setInstructionSet(set));
+
+    // A second of 24-bit stereo at 48kHz, decoded a channel at a time
+    // and mixed, as WAVAudioFile::decode() and the mixer would.
+    const size_t frames = 48000;
+    const std::vector<unsigned char> bytes = makeBytes(frames * 2 * 3);
+    std::vector<float> left(frames), right(frames), mix(frames);
+
+    QBENCHMARK {
+        for (int n = 0; n < 16; ++n) {
+            memset(&left[0], 0, frames * sizeof(float));
+            memset(&right[0], 0, frames * sizeof(float));
+            AudioKernels::addPCM(&bytes[0], 24, 2, &left[0], frames);
+            AudioKernels::addPCM(&bytes[3], 24, 2, &right[0], frames);
+            AudioKernels::applyGain(&left[0], frames, 0.5f);
+            AudioKernels::copyWithGain(&mix[0], &right[0], frames, 0.5f);
+            AudioKernels::add(&mix[0], &left[0], frames);
+        }
+    }
+}
+
+QTEST_MAIN(TestAudioKernels)
+
+#include "audio_kernels.moc"
@@ -0,0 +1,160 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "misc/WorkerPool.h"
+
+#include <QAtomicInt>
+#include <QTest>
+
+#include <cmath>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+// Stands in for an instrument: a block of samples run through a
+// "plugin chain" that costs a bit of CPU.
+struct Instrument
+{
+    Instrument() : runs(0), worker(-1) { }
+
+    std::vector<float> samples;
+    QAtomicInt runs;
+    int worker;
+};
+
+struct Session
+{
+    std::vector<Instrument> instruments;
+    /// Per worker, as AudioInstrumentMixer's ProcessContext.
+    std::vector<std::vector<float> > scratch;
+    int passes;
+};
+
+void processInstrument(void *context, size_t index, int worker)
+{
+    Session *session = static_cast<Session *>(context);
+    Instrument &instrument = session->instruments[index];
+    std::vector<float> &scratch = session->scratch[worker];
+
+    instrument.runs.fetchAndAddOrdered(1);
+    instrument.worker = worker;
+
+    for (size_t i = 0; i < instrument.samples.size(); ++i)
+        scratch[i] = instrument.samples[i];
+
+    for (int pass = 0; pass < session->passes; ++pass) {
+        for (size_t i = 0; i < scratch.size(); ++i)
+            scratch[i] = std::sin(scratch[i] + float(index) * 0.001f);
+    }
+
+    for (size_t i = 0; i < instrument.samples.size(); ++i)
+        instrument.samples[i] = scratch[i];
+}
+
+void makeSession(Session &session, int instruments, int workers, int passes)
+{
+    session.instruments = std::vector<Instrument>(instruments);
+    for (int n = 0; n < instruments; ++n) {
+        session.instruments[n].samples.resize(256);
+        for (size_t i = 0; i < 256; ++i)
+            session.instruments[n].samples[i] = float(i + n) / 256.0f;
+    }
+    session.scratch = std::vector<std::vector<float> >(
+            workers, std::vector<float>(256));
+    session.passes = passes;
+}
+
+}
+
+// WorkerPool, which AudioInstrumentMixer uses to process
+// instruments on more than one thread: every job is run exactly once per
+// round, the output is the same as running them one after another, and
+// how long a 48 instrument session takes either way.
+class TestAudioMixPool : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testEveryJobOnce();
+    void testSameAsSerial();
+    void benchmarkMix_data();
+    void benchmarkMix();
+};
+
+void TestAudioMixPool::testEveryJobOnce()
+{
+    WorkerPool pool(3);
+    QCOMPARE(pool.getWorkerCount(), 4);
+
+    Session session;
+    makeSession(session, 48, pool.getWorkerCount(), 1);
+
+    const int rounds = 1000;
+    for (int round = 0; round < rounds; ++round) {
+        // Including rounds with fewer jobs than threads.
+        const size_t jobs = (round % 10 == 0) ? 2 : session.instruments.size();
+        pool.run(processInstrument, &session, jobs);
+
+        for (size_t n = 0; n < jobs; ++n) {
+            QVERIFY(session.instruments[n].worker >= 0);
+            QVERIFY(session.instruments[n].worker < pool.getWorkerCount());
+        }
+    }
+
+    for (size_t n = 0; n < session.instruments.size(); ++n) {
+        const int expected = (n < 2) ? rounds : rounds - rounds / 10;
+        QCOMPARE(int(session.instruments[n].runs.loadAcquire()), expected);
+    }
+
+    // No jobs at all is fine too.
+    pool.run(processInstrument, &session, 0);
+}
+
+void TestAudioMixPool::testSameAsSerial()
+{
+    WorkerPool pool(3);
+
+    Session parallel;
+    makeSession(parallel, 48, pool.getWorkerCount(), 4);
+    Session serial;
+    makeSession(serial, 48, 1, 4);
+
+    for (int round = 0; round < 50; ++round) {
+        pool.run(processInstrument, &parallel, parallel.instruments.size());
+        for (size_t n = 0; n < serial.instruments.size(); ++n)
+            processInstrument(&serial, n, 0);
+    }
+
+    for (size_t n = 0; n < serial.instruments.size(); ++n)
+        QVERIFY(parallel.instruments[n].samples == serial.instruments[n].samples);
+}
+
+void TestAudioMixPool::benchmarkMix_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("2 threads") << 2;
+    QTest::newRow("4 threads") << 4;
+}
+
+void TestAudioMixPool::benchmarkMix()
+{
+    QFETCH(int, threads);
+
+    // A 48 track session with some heavy plugin chains.
+    WorkerPool pool(threads - 1);
+    Session session;
+    makeSession(session, 48, pool.getWorkerCount(), 20);
+
+    QBENCHMARK {
+        for (int block = 0; block < 20; ++block)
+            pool.run(processInstrument, &session, session.instruments.size());
+    }
+}
+
+QTEST_MAIN(TestAudioMixPool)
+
+#include "audio_mix_pool.moc"
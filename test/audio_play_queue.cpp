@@ -0,0 +1,286 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/AudioPlayQueue.h"
+#include "sound/PlayableAudioFile.h"
+#include "sound/WAVAudioFile.h"
+#include "base/Instrument.h"
+#include "base/RealTime.h"
+#include "TestWAV.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const unsigned int SampleRate = 48000;
+const int Instruments = 16;
+const size_t MaxPlaying = 64;
+
+/// A tiny stereo WAV file, which every PlayableAudioFile in the tests
+/// plays from the small file cache, so that making thousands of them
+/// doesn't open thousands of files.
+WAVAudioFile *makeWAV(const QString &fileName)
+{
+    if (!writeTestWAV(fileName, std::vector<short>(1024 * 2, 0), 2,
+                      SampleRate))
+        return nullptr;
+    return openTestWAV(fileName, 1);
+}
+
+/// A repeatable sequence of pseudo-random numbers.
+class Random
+{
+public:
+    Random() : m_state(12345) { }
+    unsigned int next(unsigned int range) {
+        m_state = m_state * 1103515245 + 12345;
+        return (m_state >> 8) % range;
+    }
+private:
+    unsigned int m_state;
+};
+
+/// Fill a queue with a session an hour long: mostly clips of up to half
+/// a minute, and a few takes as long as the whole session.
+void fill(AudioPlayQueue &queue, AudioFile *audioFile, size_t count)
+{
+    Random random;
+
+    for (size_t n = 0; n < count; ++n) {
+        const InstrumentId instrument =
+                AudioInstrumentBase + random.next(Instruments);
+        RealTime start(random.next(3600), random.next(1000) * 1000000);
+        RealTime duration(random.next(30), random.next(1000) * 1000000);
+        if (n % 8 == 0 && n < Instruments * 8) {
+            start = RealTime::zeroTime;
+            duration = RealTime(3600, 0);
+        }
+        queue.addScheduled(new PlayableAudioFile(
+                instrument, audioFile, start, RealTime::zeroTime, duration));
+    }
+
+    queue.buildIndex();
+}
+
+/// What getPlayingFilesForInstrument() should find, by looking at
+/// every file.
+std::set<PlayableAudioFile *> scan(const AudioPlayQueue &queue,
+                                   const RealTime &sliceStart,
+                                   const RealTime &sliceDuration,
+                                   InstrumentId instrument)
+{
+    std::set<PlayableAudioFile *> found;
+    const RealTime sliceEnd = sliceStart + sliceDuration;
+    const AudioPlayQueue::FileSet &files = queue.getAllScheduledFiles();
+    for (AudioPlayQueue::FileSet::const_iterator i = files.begin();
+         i != files.end(); ++i) {
+        if ((*i)->getInstrument() == instrument &&
+            (*i)->getStartTime() <= sliceEnd &&
+            (*i)->getEndTime() > sliceStart)
+            found.insert(*i);
+    }
+    return found;
+}
+
+}
+
+// AudioPlayQueue's interval index: lookups find the same files as
+// looking at every one, a queue can be copied and published in place
+// of another without either losing files, and how long the mixer's
+// lookups take with up to 10000 files queued.
+class TestAudioPlayQueue : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testSameAsScan();
+    void testPlayingFiles();
+    void testArrayFull();
+    void testTakeOver();
+    void benchmarkLookup_data();
+    void benchmarkLookup();
+
+private:
+    QTemporaryDir m_dir;
+    AudioFile *m_audioFile;
+};
+
+void TestAudioPlayQueue::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    m_audioFile = makeWAV(m_dir.path() + "/clip.wav");
+    QVERIFY(m_audioFile);
+}
+
+void TestAudioPlayQueue::cleanupTestCase()
+{
+    delete m_audioFile;
+    m_audioFile = nullptr;
+}
+
+void TestAudioPlayQueue::testSameAsScan()
+{
+    AudioPlayQueue queue;
+    fill(queue, m_audioFile, 2000);
+
+    Random random;
+    std::vector<PlayableAudioFile *> playing(queue.size());
+
+    for (int slice = 0; slice < 1000; ++slice) {
+        const InstrumentId instrument =
+                AudioInstrumentBase + random.next(Instruments + 1);
+        const RealTime sliceStart(int(random.next(3700)) - 50,
+                                  random.next(1000) * 1000000);
+        // Mostly mixer blocks, some of them disc reader lookaheads.
+        const RealTime sliceDuration = (slice % 4 == 0) ?
+                RealTime(4, 0) : RealTime::frame2RealTime(1024, SampleRate);
+
+        size_t count = playing.size();
+        queue.getPlayingFilesForInstrument(sliceStart, sliceDuration,
+                                           instrument, &playing[0], count);
+
+        const std::set<PlayableAudioFile *> found(playing.begin(),
+                                                  playing.begin() + count);
+        QCOMPARE(found.size(), count);
+        QVERIFY(found == scan(queue, sliceStart, sliceDuration, instrument));
+
+        // In order of start time.
+        for (size_t i = 1; i < count; ++i)
+            QVERIFY(playing[i - 1]->getStartTime() <= playing[i]->getStartTime());
+    }
+
+    QVERIFY(queue.haveFilesForInstrument(AudioInstrumentBase));
+    QVERIFY(!queue.haveFilesForInstrument(AudioInstrumentBase + Instruments));
+}
+
+void TestAudioPlayQueue::testPlayingFiles()
+{
+    AudioPlayQueue queue;
+    fill(queue, m_audioFile, 2000);
+
+    const RealTime sliceStart(1800, 0);
+    const RealTime sliceDuration(4, 0);
+
+    AudioPlayQueue::FileSet playing;
+    queue.getPlayingFiles(sliceStart, sliceDuration, playing);
+
+    std::set<PlayableAudioFile *> expected;
+    for (int i = 0; i < Instruments; ++i) {
+        const std::set<PlayableAudioFile *> found =
+                scan(queue, sliceStart, sliceDuration, AudioInstrumentBase + i);
+        expected.insert(found.begin(), found.end());
+    }
+
+    QVERIFY(!expected.empty());
+    QCOMPARE(playing.size(), expected.size());
+    for (AudioPlayQueue::FileSet::const_iterator i = playing.begin();
+         i != playing.end(); ++i)
+        QVERIFY(expected.find(*i) != expected.end());
+}
+
+void TestAudioPlayQueue::testArrayFull()
+{
+    AudioPlayQueue queue;
+    for (int n = 0; n < 10; ++n) {
+        queue.addScheduled(new PlayableAudioFile(
+                AudioInstrumentBase, m_audioFile, RealTime(n, 0),
+                RealTime::zeroTime, RealTime(20, 0)));
+    }
+    queue.buildIndex();
+
+    PlayableAudioFile *playing[4];
+    size_t count = 4;
+    queue.getPlayingFilesForInstrument(RealTime(15, 0), RealTime(1, 0),
+                                       AudioInstrumentBase, playing, count);
+    QCOMPARE(count, size_t(4));
+    QCOMPARE(playing[0]->getStartTime(), RealTime(0, 0));
+    QCOMPARE(playing[3]->getStartTime(), RealTime(3, 0));
+}
+
+void TestAudioPlayQueue::testTakeOver()
+{
+    AudioPlayQueue *published = new AudioPlayQueue;
+    fill(*published, m_audioFile, 100);
+
+    // As AlsaDriver does for an asynchronous (preview) file.
+    AudioPlayQueue *next = new AudioPlayQueue(*published);
+    next->addUnscheduled(new PlayableAudioFile(
+            AudioInstrumentBase + Instruments, m_audioFile, RealTime(10, 0),
+            RealTime::zeroTime, RealTime(1, 0)));
+    next->buildIndex();
+
+    QCOMPARE(next->size(), published->size() + 1);
+    QVERIFY(!published->haveFilesForInstrument(AudioInstrumentBase + Instruments));
+    QVERIFY(next->haveFilesForInstrument(AudioInstrumentBase + Instruments));
+
+    // The old queue is scavenged without deleting the files...
+    delete published;
+
+    // ...so the new one can still play them.
+    PlayableAudioFile *playing[MaxPlaying];
+    for (int i = 0; i <= Instruments; ++i) {
+        size_t count = MaxPlaying;
+        next->getPlayingFilesForInstrument(RealTime(10, 0), RealTime(1, 0),
+                                           AudioInstrumentBase + i,
+                                           playing, count);
+        for (size_t f = 0; f < count; ++f)
+            QCOMPARE(playing[f]->getInstrument(), AudioInstrumentBase + i);
+        if (i == Instruments)
+            QCOMPARE(count, size_t(1));
+    }
+
+    delete next;
+}
+
+void TestAudioPlayQueue::benchmarkLookup_data()
+{
+    QTest::addColumn<int>("files");
+    QTest::newRow("100 files") << 100;
+    QTest::newRow("1000 files") << 1000;
+    QTest::newRow("10000 files") << 10000;
+}
+
+void TestAudioPlayQueue::benchmarkLookup()
+{
+    QFETCH(int, files);
+
+    AudioPlayQueue queue;
+    fill(queue, m_audioFile, files);
+
+    const RealTime blockDuration = RealTime::frame2RealTime(1024, SampleRate);
+    PlayableAudioFile *playing[MaxPlaying];
+    size_t found = 0;
+
+    // A minute of mixer blocks, every instrument every block, from the
+    // middle of the session.
+    QBENCHMARK {
+        RealTime t(1800, 0);
+        const RealTime end(1860, 0);
+        while (t < end) {
+            for (int i = 0; i < Instruments; ++i) {
+                size_t count = MaxPlaying;
+                queue.getPlayingFilesForInstrument(t, blockDuration,
+                                                   AudioInstrumentBase + i,
+                                                   playing, count);
+                found += count;
+            }
+            t = t + blockDuration;
+        }
+    }
+
+    QVERIFY(found > 0);
+}
+
+QTEST_MAIN(TestAudioPlayQueue)
+
+#include "audio_play_queue.moc"
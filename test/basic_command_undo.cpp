@@ -0,0 +1,293 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/BaseProperties.h"
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "commands/edit/EventInsertionCommand.h"
+#include "document/BasicCommand.h"
+#include "document/CommandHistory.h"
+
+#include <QStringList>
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const timeT NoteSpacing = 240;
+
+/// Notes one after another, rising and falling in pitch.
+void fill(Segment &segment, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        Event *e = new Event(Note::EventType, i * NoteSpacing, NoteSpacing);
+        e->set<Int>(BaseProperties::PITCH, 48 + i % 24);
+        segment.insert(e);
+    }
+}
+
+/// Everything about the segment's events that the commands change.
+QStringList describe(Segment &segment)
+{
+    QStringList events;
+    for (Segment::iterator i = segment.begin(); i != segment.end(); ++i) {
+        long pitch = -1;
+        (*i)->get<Int>(BaseProperties::PITCH, pitch);
+        events << QString("%1 %2 %3 %4")
+                .arg((*i)->getAbsoluteTime())
+                .arg((*i)->getDuration())
+                .arg((*i)->getType().c_str())
+                .arg(pitch);
+    }
+    return events;
+}
+
+/// What it would cost to copy every event in the segment.
+size_t wholeSegmentSize(Segment &segment)
+{
+    size_t size = 0;
+    for (Segment::iterator i = segment.begin(); i != segment.end(); ++i)
+        size += (*i)->getStorageSize();
+    return size;
+}
+
+Event *note(timeT time, long pitch)
+{
+    Event *e = new Event(Note::EventType, time, NoteSpacing);
+    e->set<Int>(BaseProperties::PITCH, pitch);
+    return e;
+}
+
+/// Works on event pointers, so needs brute force redo: raises the
+/// first note in its range, erases the second and adds one in its
+/// place at the same time as the third.
+class PointerCommand : public BasicCommand
+{
+public:
+    PointerCommand(Segment &segment, timeT start, timeT end) :
+        BasicCommand("Pointer", segment, start, end, true),
+        modifyCount(0)
+    {
+    }
+
+    int modifyCount;
+
+protected:
+    void modifySegment() override
+    {
+        ++modifyCount;
+
+        Segment &segment = getSegment();
+        Segment::iterator i = segment.findTime(getStartTime());
+        Event *first = *i;
+        first->set<Int>(BaseProperties::PITCH, 100);
+        ++i;
+        const timeT third = (*i)->getAbsoluteTime() + NoteSpacing;
+        segment.erase(i);
+        segment.insert(note(third, 101));
+    }
+};
+
+/// Changes nothing.
+class NothingCommand : public BasicCommand
+{
+public:
+    NothingCommand(Segment &segment) :
+        BasicCommand("Nothing", segment, 0, NoteSpacing)
+    {
+    }
+
+protected:
+    void modifySegment() override { }
+};
+
+}
+
+// BasicCommand's undo and redo: that they put back exactly what was
+// there, that a command keeps only the events it changed, and that
+// CommandHistory keeps within its memory limit.
+class TestBasicCommandUndo : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testUndoRedo();
+    void testBruteForceRedo();
+    void testAtSegmentEnds();
+    void testNoChange();
+    void testStorage();
+    void testMemoryLimit();
+    void benchmarkExecute();
+};
+
+void TestBasicCommandUndo::testUndoRedo()
+{
+    Segment segment;
+    fill(segment, 1000);
+    const QStringList before = describe(segment);
+
+    EventInsertionCommand command(segment, note(500 * NoteSpacing, 90));
+    command.execute();
+    const QStringList after = describe(segment);
+    QCOMPARE(after.size(), before.size() + 1);
+
+    command.unexecute();
+    QCOMPARE(describe(segment), before);
+
+    command.execute();
+    QCOMPARE(describe(segment), after);
+
+    command.unexecute();
+    QCOMPARE(describe(segment), before);
+}
+
+void TestBasicCommandUndo::testBruteForceRedo()
+{
+    Segment segment;
+    fill(segment, 1000);
+    const QStringList before = describe(segment);
+
+    PointerCommand command(segment, 300 * NoteSpacing, 310 * NoteSpacing);
+    command.execute();
+    const QStringList after = describe(segment);
+    QVERIFY(after != before);
+
+    for (int i = 0; i < 3; ++i) {
+        command.unexecute();
+        QCOMPARE(describe(segment), before);
+        command.execute();
+        QCOMPARE(describe(segment), after);
+    }
+
+    // Redo didn't call modifySegment() again.
+    QCOMPARE(command.modifyCount, 1);
+}
+
+void TestBasicCommandUndo::testAtSegmentEnds()
+{
+    Segment segment;
+    fill(segment, 100);
+    const QStringList before = describe(segment);
+
+    PointerCommand first(segment, 0, 3 * NoteSpacing);
+    first.execute();
+    EventInsertionCommand last(segment, note(100 * NoteSpacing, 60));
+    last.execute();
+    const QStringList after = describe(segment);
+
+    last.unexecute();
+    first.unexecute();
+    QCOMPARE(describe(segment), before);
+
+    first.execute();
+    last.execute();
+    QCOMPARE(describe(segment), after);
+}
+
+void TestBasicCommandUndo::testNoChange()
+{
+    Segment segment;
+    fill(segment, 100);
+    const QStringList before = describe(segment);
+
+    NothingCommand command(segment);
+    command.execute();
+    QCOMPARE(describe(segment), before);
+    QVERIFY(command.getStorageSize() < 1024);
+
+    command.unexecute();
+    QCOMPARE(describe(segment), before);
+}
+
+void TestBasicCommandUndo::testStorage()
+{
+    Segment segment;
+    fill(segment, 10000);
+    const size_t whole = wholeSegmentSize(segment);
+
+    EventInsertionCommand insert(segment, note(5000 * NoteSpacing, 90));
+    insert.execute();
+    QVERIFY(insert.getStorageSize() > 0);
+    QVERIFY(insert.getStorageSize() < whole / 100);
+
+    // Redo calls modifySegment() again, so nothing is kept for it.
+    insert.unexecute();
+    QVERIFY(insert.getStorageSize() < whole / 100);
+
+    PointerCommand pointer(segment, 2000 * NoteSpacing, 2010 * NoteSpacing);
+    pointer.execute();
+    QVERIFY(pointer.getStorageSize() < whole / 100);
+    pointer.unexecute();
+    QVERIFY(pointer.getStorageSize() < whole / 100);
+}
+
+void TestBasicCommandUndo::testMemoryLimit()
+{
+    CommandHistory *history = CommandHistory::getInstance();
+    history->clear();
+    const size_t defaultLimit = history->getMemoryLimit();
+    history->setMemoryLimit(0);
+
+    Segment segment;
+    fill(segment, 1000);
+    const QStringList before = describe(segment);
+
+    const int steps = 20;
+    for (int i = 0; i < steps; ++i) {
+        history->addCommand(new EventInsertionCommand(
+                segment, note((i * 40 + 5) * NoteSpacing, 90)));
+    }
+
+    std::vector<size_t> sizes = history->getUndoStorageSizes();
+    QCOMPARE(sizes.size(), size_t(steps));
+    size_t total = 0;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        QVERIFY(sizes[i] > 0);
+        total += sizes[i];
+    }
+    QCOMPARE(history->getStorageSize(), total);
+
+    // The oldest steps go.
+    history->setMemoryLimit(total / 2);
+    sizes = history->getUndoStorageSizes();
+    QVERIFY(sizes.size() < size_t(steps));
+    QVERIFY(sizes.size() >= size_t(steps / 2) - 1);
+    QVERIFY(history->getStorageSize() <= total / 2);
+
+    // The rest still undo.
+    for (size_t i = 0; i < sizes.size(); ++i)
+        history->undo();
+    QCOMPARE(describe(segment).size(), before.size() + steps - int(sizes.size()));
+
+    // The latest is kept however low the limit.
+    history->setMemoryLimit(1);
+    QVERIFY(history->getUndoStorageSizes().empty());
+    history->redo();
+    QCOMPARE(history->getUndoStorageSizes().size(), size_t(1));
+
+    history->clear();
+    history->setMemoryLimit(defaultLimit);
+    QCOMPARE(history->getStorageSize(), size_t(0));
+}
+
+void TestBasicCommandUndo::benchmarkExecute()
+{
+    Segment segment;
+    fill(segment, 10000);
+
+    EventInsertionCommand command(segment, note(5000 * NoteSpacing, 90));
+
+    QBENCHMARK {
+        command.execute();
+        command.unexecute();
+    }
+}
+
+QTEST_MAIN(TestBasicCommandUndo)
+
+#include "basic_command_undo.moc"
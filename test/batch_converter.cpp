@@ -0,0 +1,298 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "document/RosegardenDocument.h"
+#include "document/io/BatchConverter.h"
+#include "sound/Midi.h"
+#include "sound/MidiFile.h"
+#include "TestMidiBytes.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+void appendChunk(std::string &bytes, const std::string &data)
+{
+    bytes += "MTrk";
+    appendLong(bytes, data.size());
+    bytes += data;
+}
+
+/// A format 1 file: a conductor track, then tracks of notes, one
+/// after another, on a channel each.
+std::string makeMidiFile(unsigned int seed, int tracks, int notes)
+{
+    std::string bytes = "MThd";
+    appendLong(bytes, 6);
+    bytes += '\0'; bytes += '\1';
+    bytes += '\0'; bytes += char(tracks + 1);
+    bytes += char(480 >> 8); bytes += char(480 & 0xff);
+
+    std::string conductor;
+    appendNumber(conductor, 0);
+    conductor += std::string("\xff\x51\x03\x07\xa1\x20", 6);
+    appendNumber(conductor, 0);
+    conductor += std::string("\xff\x2f\x00", 3);
+    appendChunk(bytes, conductor);
+
+    unsigned int x = seed;
+
+    for (int t = 0; t < tracks; ++t) {
+        std::string data;
+        for (int i = 0; i < notes; ++i) {
+            x = x * 1103515245 + 12345;
+            const int pitch = 48 + int((x >> 16) % 24);
+            const int length = 120 * (1 + int((x >> 8) % 4));
+
+            appendNumber(data, 0);
+            data += char(MIDI_NOTE_ON | t);
+            data += char(pitch);
+            data += char(100);
+            appendNumber(data, length);
+            data += char(MIDI_NOTE_OFF | t);
+            data += char(pitch);
+            data += char(0);
+        }
+        appendNumber(data, 0);
+        data += std::string("\xff\x2f\x00", 3);
+        appendChunk(bytes, data);
+    }
+
+    return bytes;
+}
+
+bool writeFile(const QString &fileName, const std::string &bytes)
+{
+    std::ofstream file(fileName.toLocal8Bit(),
+                       std::ios::out | std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+    return file.good();
+}
+
+QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+long countNotes(const QString &fileName)
+{
+    RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+    MidiFile midiFile;
+    if (!midiFile.convertToRosegarden(fileName, &doc))
+        return -1;
+
+    long notes = 0;
+    Composition &comp = doc.getComposition();
+    for (Composition::iterator i = comp.begin(); i != comp.end(); ++i) {
+        for (Segment::iterator j = (*i)->begin(); j != (*i)->end(); ++j) {
+            if ((*j)->isa(Note::EventType))
+                ++notes;
+        }
+    }
+    return notes;
+}
+
+const int Files = 12;
+const int Tracks = 4;
+const int Notes = 100;
+
+}
+
+// BatchConverter converts a directory of files on several threads, the
+// same as on one, and carries on past those it can't read.
+class TestBatchConverter : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testConvert();
+    void testSameOnOneThread();
+    void testGUIThread();
+    void testAudio();
+
+private:
+    QString makeDirectory(const QString &name);
+
+    QTemporaryDir m_dir;
+    QString m_inputDirectory;
+    QStringList m_formats;
+};
+
+void TestBatchConverter::initTestCase()
+{
+    // Don't touch the user's settings.
+    QCoreApplication::setApplicationName("test_batch_converter");
+
+    QVERIFY(m_dir.isValid());
+    m_inputDirectory = makeDirectory("in");
+
+    for (int n = 0; n < Files; ++n) {
+        const QString name = (n == 3 ? "name with spaces" :
+                              QString("%1").arg(n, 2, 10, QChar('0')));
+        QVERIFY(writeFile(QDir(m_inputDirectory).filePath(name + ".mid"),
+                          makeMidiFile(n + 1, Tracks, Notes)));
+    }
+
+    // Cut short in the middle of a track.
+    const std::string bytes = makeMidiFile(99, Tracks, Notes);
+    QVERIFY(writeFile(QDir(m_inputDirectory).filePath("truncated.mid"),
+                      bytes.substr(0, bytes.size() / 2)));
+
+    // Not for us.
+    QVERIFY(writeFile(QDir(m_inputDirectory).filePath("notes.txt"), "notes"));
+
+    m_formats << "rg" << "ly" << "xml" << "csd" << "mup";
+}
+
+QString TestBatchConverter::makeDirectory(const QString &name)
+{
+    QDir(m_dir.path()).mkdir(name);
+    return m_dir.filePath(name);
+}
+
+void TestBatchConverter::testConvert()
+{
+    const QStringList inputFiles =
+            BatchConverter::findInputFiles(m_inputDirectory);
+    QCOMPARE(inputFiles.size(), Files + 1);
+
+    BatchConverter converter;
+    converter.setFormats(m_formats);
+    converter.setOutputDirectory(makeDirectory("threads"));
+    converter.setThreads(4);
+
+    const std::vector<BatchConverter::Result> results =
+            converter.convert(inputFiles);
+    QCOMPARE(int(results.size()), inputFiles.size());
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BatchConverter::Result &result = results[i];
+        QCOMPARE(result.inputFile, inputFiles[int(i)]);
+
+        if (result.inputFile.endsWith("truncated.mid")) {
+            QVERIFY(!result.ok);
+            QVERIFY(!result.error.isEmpty());
+            QVERIFY(result.outputFiles.isEmpty());
+            continue;
+        }
+
+        QVERIFY2(result.ok, qPrintable(result.error));
+        QCOMPARE(result.outputFiles.size(), m_formats.size());
+        QVERIFY(result.loadSeconds > 0);
+        for (int f = 0; f < result.outputFiles.size(); ++f) {
+            QVERIFY(result.outputFiles[f].endsWith("." + m_formats[f]));
+            QVERIFY(QFileInfo(result.outputFiles[f]).size() > 0);
+        }
+    }
+
+    // LilyPond can't have spaces in file names, and the rest can.
+    QVERIFY(QFileInfo(m_dir.filePath("threads/namewithspaces.ly")).exists());
+    QVERIFY(QFileInfo(m_dir.filePath("threads/name with spaces.rg")).exists());
+}
+
+void TestBatchConverter::testSameOnOneThread()
+{
+    const QStringList inputFiles =
+            BatchConverter::findInputFiles(m_inputDirectory);
+
+    BatchConverter converter;
+    converter.setFormats(m_formats);
+    converter.setOutputDirectory(makeDirectory("one"));
+    converter.setThreads(1);
+    converter.convert(inputFiles);
+
+    const QStringList compared = QStringList() << "ly" << "csd" << "mup";
+
+    const QStringList outputFiles = QDir(m_dir.filePath("one")).entryList(
+            QDir::Files, QDir::Name);
+    QCOMPARE(outputFiles.size(), Files * m_formats.size());
+
+    for (int i = 0; i < outputFiles.size(); ++i) {
+        if (!compared.contains(QFileInfo(outputFiles[i]).suffix()))
+            continue;
+        const QByteArray one =
+                readFile(m_dir.filePath("one/" + outputFiles[i]));
+        QVERIFY(!one.isEmpty());
+        QCOMPARE(readFile(m_dir.filePath("threads/" + outputFiles[i])), one);
+    }
+}
+
+void TestBatchConverter::testGUIThread()
+{
+    // Reading .rg and writing MIDI are done on this thread.
+    const QStringList inputFiles = QStringList()
+            << m_dir.filePath("threads/00.rg")
+            << m_dir.filePath("threads/01.rg");
+
+    BatchConverter converter;
+    converter.setFormats(QStringList() << "mid");
+    QVERIFY(converter.needsGUIThread(inputFiles[0]));
+
+    const std::vector<BatchConverter::Result> results =
+            converter.convert(inputFiles);
+    QCOMPARE(int(results.size()), 2);
+
+    for (int n = 0; n < 2; ++n) {
+        QVERIFY2(results[n].ok, qPrintable(results[n].error));
+        QCOMPARE(results[n].outputFiles,
+                 QStringList() << m_dir.filePath(QString("threads/0%1.mid").arg(n)));
+        QCOMPARE(countNotes(results[n].outputFiles[0]), long(Tracks * Notes));
+    }
+
+    // And the input is never overwritten.
+    converter.setFormats(QStringList() << "rg");
+    const std::vector<BatchConverter::Result> again =
+            converter.convert(inputFiles);
+    QVERIFY(!again[0].ok);
+    QVERIFY(!again[0].error.isEmpty());
+}
+
+void TestBatchConverter::testAudio()
+{
+    const QString inputFile = m_dir.filePath("threads/02.rg");
+
+    BatchConverter converter;
+    converter.setFormats(QStringList() << "wav");
+    converter.setOutputDirectory(makeDirectory("audio"));
+    QVERIFY(converter.needsGUIThread(m_dir.filePath("threads/02.mid")));
+
+    const std::vector<BatchConverter::Result> results =
+            converter.convert(QStringList() << inputFile);
+    QCOMPARE(int(results.size()), 1);
+
+    const BatchConverter::Result &result = results[0];
+    QVERIFY2(result.ok, qPrintable(result.error));
+    QVERIFY(result.rendered);
+    QVERIFY(QFileInfo(result.outputFiles[0]).size() > 44);
+
+    // The whole composition, at 48kHz, on time.
+    const OfflineDriver::Statistics &stats = result.renderStatistics;
+    QVERIFY(stats.frames > 48000);
+    QVERIFY(stats.realtimeFactor > 0);
+    QCOMPARE(stats.underruns, 0);
+
+    // Nothing plays MIDI tracks, so it's silent.
+    QCOMPARE(stats.peak, 0.0f);
+}
+
+QTEST_MAIN(TestBatchConverter)
+
+#include "batch_converter.moc"
@@ -0,0 +1,242 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/RealTime.h"
+#include <QTest>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Rosegarden;
+
+// Bar numbers and tempo timestamps are now recalculated only from the
+// point of an edit onwards.  Checks that this gives the same answers as
+// calculating from scratch, and that the batch timeT to RealTime
+// conversion agrees with getElapsedRealTime().
+class TestCompositionTiming : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testIncrementalTempo();
+    void testIncrementalBars();
+    void testBatchRealTime();
+    void benchmarkEditTempoAndQuery();
+    void benchmarkRealTime_data();
+    void benchmarkRealTime();
+
+private:
+    /// A Composition with the same tempo and time signature changes as c.
+    static void copyTiming(const Composition &c, Composition &copy);
+    static void randomTiming(Composition &c, std::mt19937 &random, int changes);
+    static std::vector<timeT> sampleTimes(timeT start, timeT end, int count);
+};
+
+void TestCompositionTiming::copyTiming(const Composition &c, Composition &copy)
+{
+    copy.setStartMarker(c.getStartMarker());
+    copy.setEndMarker(c.getEndMarker());
+    copy.setCompositionDefaultTempo(c.getCompositionDefaultTempo());
+
+    for (int n = 0; n < c.getTempoChangeCount(); ++n) {
+        std::pair<timeT, tempoT> change = c.getTempoChange(n);
+        std::pair<bool, tempoT> ramp = c.getTempoRamping(n, false);
+        copy.addTempoAtTime(change.first, change.second,
+                            ramp.first ? ramp.second : -1);
+    }
+
+    for (int n = 0; n < c.getTimeSignatureCount(); ++n) {
+        std::pair<timeT, TimeSignature> change = c.getTimeSignatureChange(n);
+        copy.addTimeSignature(change.first, change.second);
+    }
+}
+
+void TestCompositionTiming::randomTiming(Composition &c,
+                                        std::mt19937 &random, int changes)
+{
+    const timeT bar = TimeSignature().getBarDuration();
+
+    for (int n = 0; n < changes; ++n) {
+        const timeT time = timeT(random() % 400) * bar / 4 - 4 * bar;
+        const tempoT tempo = Composition::getTempoForQpm(40 + random() % 160);
+        // Some steady, some ramped to a given tempo, some ramped to the
+        // next tempo change.
+        const int kind = random() % 3;
+        const tempoT target = (kind == 0 ? -1 : kind == 1 ? tempo / 2 : 0);
+        c.addTempoAtTime(time, tempo, target);
+
+        c.addTimeSignature(timeT(random() % 100) * bar,
+                           TimeSignature(2 + random() % 6, 4));
+    }
+}
+
+std::vector<timeT> TestCompositionTiming::sampleTimes(timeT start, timeT end,
+                                                      int count)
+{
+    std::vector<timeT> times;
+    for (int n = 0; n < count; ++n)
+        times.push_back(start + (end - start) * n / count);
+    return times;
+}
+
+void TestCompositionTiming::testIncrementalTempo()
+{
+    std::mt19937 random(1);
+    Composition c;
+    c.setEndMarker(TimeSignature().getBarDuration() * 120);
+    randomTiming(c, random, 50);
+
+    const std::vector<timeT> times =
+        sampleTimes(-4 * TimeSignature().getBarDuration(), c.getEndMarker(), 2000);
+
+    for (int edit = 0; edit < 200; ++edit) {
+        // Query first, so that the timestamps are up to date before
+        // the edit and only part of them are recalculated after it.
+        c.getElapsedRealTime(c.getEndMarker());
+
+        if (random() % 3 == 0  &&  c.getTempoChangeCount() > 0) {
+            c.removeTempoChange(random() % c.getTempoChangeCount());
+        } else {
+            randomTiming(c, random, 1);
+        }
+        if (edit % 50 == 0)
+            c.setCompositionDefaultTempo(
+                    Composition::getTempoForQpm(60 + edit % 100));
+
+        Composition fresh;
+        copyTiming(c, fresh);
+
+        for (size_t n = 0; n < times.size(); ++n) {
+            QCOMPARE(c.getElapsedRealTime(times[n]),
+                     fresh.getElapsedRealTime(times[n]));
+        }
+        QCOMPARE(c.getElapsedTimeForRealTime(RealTime(30, 0)),
+                 fresh.getElapsedTimeForRealTime(RealTime(30, 0)));
+    }
+}
+
+void TestCompositionTiming::testIncrementalBars()
+{
+    std::mt19937 random(2);
+    const timeT bar = TimeSignature().getBarDuration();
+
+    Composition c;
+    c.setEndMarker(bar * 120);
+    randomTiming(c, random, 30);
+
+    const std::vector<timeT> times = sampleTimes(-4 * bar, c.getEndMarker(), 2000);
+
+    for (int edit = 0; edit < 200; ++edit) {
+        c.getBarNumber(c.getEndMarker());
+
+        if (random() % 3 == 0  &&  c.getTimeSignatureCount() > 0) {
+            c.removeTimeSignature(random() % c.getTimeSignatureCount());
+        } else {
+            c.addTimeSignature(timeT(random() % 100) * bar,
+                               TimeSignature(2 + random() % 6, 4));
+        }
+        if (edit % 40 == 0)
+            c.setStartMarker(edit % 80 == 0 ? -2 * bar : 0);
+
+        Composition fresh;
+        copyTiming(c, fresh);
+
+        for (size_t n = 0; n < times.size(); ++n) {
+            const int barNo = c.getBarNumber(times[n]);
+            QCOMPARE(barNo, fresh.getBarNumber(times[n]));
+            QVERIFY(c.getBarRange(barNo) == fresh.getBarRange(barNo));
+        }
+    }
+}
+
+void TestCompositionTiming::testBatchRealTime()
+{
+    std::mt19937 random(3);
+    Composition c;
+    c.setEndMarker(TimeSignature().getBarDuration() * 120);
+    randomTiming(c, random, 100);
+
+    std::vector<timeT> times = sampleTimes(
+            -8 * TimeSignature().getBarDuration(), c.getEndMarker() * 2, 20000);
+    // Exactly on tempo changes too.
+    for (int n = 0; n < c.getTempoChangeCount(); ++n)
+        times.push_back(c.getTempoChange(n).first);
+    std::sort(times.begin(), times.end());
+
+    std::vector<RealTime> realTimes;
+    c.getElapsedRealTimes(times, realTimes);
+    QCOMPARE(realTimes.size(), times.size());
+    for (size_t n = 0; n < times.size(); ++n)
+        QCOMPARE(realTimes[n], c.getElapsedRealTime(times[n]));
+
+    // Out of order still gives the right answers.
+    std::shuffle(times.begin(), times.end(), random);
+    c.getElapsedRealTimes(times, realTimes);
+    for (size_t n = 0; n < times.size(); ++n)
+        QCOMPARE(realTimes[n], c.getElapsedRealTime(times[n]));
+
+    // No tempo changes at all.
+    Composition empty;
+    empty.getElapsedRealTimes(times, realTimes);
+    for (size_t n = 0; n < times.size(); ++n)
+        QCOMPARE(realTimes[n], empty.getElapsedRealTime(times[n]));
+}
+
+void TestCompositionTiming::benchmarkEditTempoAndQuery()
+{
+    // Editing the tempo near the end of a piece with lots of tempo
+    // changes, as when drawing a tempo curve, then redrawing.
+    std::mt19937 random(4);
+    const timeT bar = TimeSignature().getBarDuration();
+
+    Composition c;
+    c.setEndMarker(bar * 2000);
+    for (int n = 0; n < 5000; ++n)
+        c.addTempoAtTime(n * bar / 4, Composition::getTempoForQpm(60 + n % 100));
+
+    QBENCHMARK {
+        c.addTempoAtTime(bar * 1990, Composition::getTempoForQpm(60 + random() % 100));
+        c.getElapsedRealTime(c.getEndMarker());
+    }
+}
+
+void TestCompositionTiming::benchmarkRealTime_data()
+{
+    QTest::addColumn<bool>("batch");
+    QTest::newRow("getElapsedRealTime") << false;
+    QTest::newRow("getElapsedRealTimes") << true;
+}
+
+void TestCompositionTiming::benchmarkRealTime()
+{
+    QFETCH(bool, batch);
+
+    const timeT bar = TimeSignature().getBarDuration();
+
+    Composition c;
+    c.setEndMarker(bar * 500);
+    for (int n = 0; n < 1000; ++n)
+        c.addTempoAtTime(n * bar / 2, Composition::getTempoForQpm(60 + n % 100));
+
+    // A metronome's worth of ticks.
+    const std::vector<timeT> times = sampleTimes(0, c.getEndMarker(), 100000);
+    std::vector<RealTime> realTimes(times.size());
+
+    if (batch) {
+        QBENCHMARK {
+            c.getElapsedRealTimes(times, realTimes);
+        }
+    } else {
+        QBENCHMARK {
+            for (size_t n = 0; n < times.size(); ++n)
+                realTimes[n] = c.getElapsedRealTime(times[n]);
+        }
+    }
+}
+
+QTEST_MAIN(TestCompositionTiming)
+
+#include "composition_timing.moc"
@@ -0,0 +1,241 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "document/GzipFile.h"
+#include "document/GzipStreamReader.h"
+#include "document/RosegardenDocument.h"
+#include "document/XmlStreamParser.h"
+#include "misc/Strings.h"
+#include <QTemporaryDir>
+#include <QTest>
+#include <QXmlDefaultHandler>
+#include <QXmlInputSource>
+#include <QXmlSimpleReader>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+// Counts what it is handed.
+class CountingHandler : public QXmlDefaultHandler
+{
+public:
+    CountingHandler() :
+        started(false), ended(false), elements(0), attributeCount(0),
+        text(0), fatal(0)  { }
+
+    bool startDocument() override  { started = true; return true; }
+    bool endDocument() override  { ended = true; return true; }
+    bool startElement(const QString &, const QString &, const QString &,
+                      const QXmlAttributes &attributes) override
+    {
+        ++elements;
+        attributeCount += attributes.count();
+        return true;
+    }
+    bool characters(const QString &ch) override
+    {
+        text += ch.length();
+        return true;
+    }
+    bool fatalError(const QXmlParseException &) override
+    {
+        ++fatal;
+        return false;
+    }
+
+    bool started;
+    bool ended;
+    long elements;
+    long attributeCount;
+    long text;
+    int fatal;
+};
+
+}
+
+// Load time for a large (500,000 event) document, now that the file is
+// unzipped and parsed on worker threads as it arrives rather than
+// unzipped in full and then parsed.
+class TestDocumentLoad : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testStreamMatchesWholeFile();
+    void testParserMatchesWholeFile();
+    void testTruncatedFile();
+    void benchmarkLoad();
+
+private:
+    static long countEvents(RosegardenDocument &doc);
+
+    QTemporaryDir m_dir;
+    QString m_fileName;
+    long m_expectedEvents;
+};
+
+long TestDocumentLoad::countEvents(RosegardenDocument &doc)
+{
+    long events = 0;
+    Composition &comp = doc.getComposition();
+    for (Composition::iterator i = comp.begin(); i != comp.end(); ++i)
+        events += static_cast<long>((*i)->size());
+    return events;
+}
+
+void TestDocumentLoad::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    const QString input = QFINDTESTDATA("../data/examples/test_selection.rg");
+    QVERIFY(!input.isEmpty()); // file not found
+
+    RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+    doc.openDocument(input, false /*not permanent*/, true /*no progress dlg*/);
+
+    Composition &comp = doc.getComposition();
+    QVERIFY(!comp.getSegments().empty());
+    const TrackId track = (*comp.getSegments().begin())->getTrack();
+
+    const timeT quarter = Note(Note::Crotchet).getDuration();
+
+    // Ten Segments of 50,000 notes each.
+    for (int s = 0; s < 10; ++s) {
+        Segment *segment = new Segment;
+        segment->setTrack(track);
+        // Something that isn't plain ASCII, so that the UTF-8 decoding
+        // has multi-byte characters to deal with.
+        segment->setLabel(qstrtostr(QString::fromUtf8("S\xc3\xa9quence %1 \xe2\x99\xab").arg(s)));
+        for (int n = 0; n < 50000; ++n) {
+            segment->insert(Note(Note::Crotchet).getAsNoteEvent(
+                    n * quarter, 36 + (n + s) % 48));
+        }
+        comp.addSegment(segment);
+    }
+
+    m_expectedEvents = countEvents(doc);
+    QVERIFY(m_expectedEvents >= 500000);
+
+    m_fileName = m_dir.filePath("large.rg");
+    QString errMsg;
+    QVERIFY2(doc.saveDocument(m_fileName, errMsg, true /*autosave*/),
+             qPrintable(errMsg));
+}
+
+void TestDocumentLoad::testStreamMatchesWholeFile()
+{
+    QString whole;
+    QVERIFY(GzipFile::readFromFile(m_fileName, whole));
+
+    // Small, odd-sized chunks so that plenty of UTF-8 sequences are
+    // split between chunks.
+    GzipStreamReader reader(m_fileName, 4099, 2);
+    QVERIFY(reader.open());
+
+    QString streamed;
+    QString chunk;
+    int chunks = 0;
+    while (reader.readChunk(chunk)) {
+        streamed += chunk;
+        ++chunks;
+    }
+
+    QVERIFY(reader.isOK());
+    QVERIFY(chunks > 1);
+    QCOMPARE(reader.getProgress(), 100);
+    QCOMPARE(streamed.length(), whole.length());
+    QVERIFY(streamed == whole);
+
+    // Giving up part way through doesn't hang.
+    GzipStreamReader cancelled(m_fileName, 4099, 2);
+    QVERIFY(cancelled.open());
+    QVERIFY(cancelled.readChunk(chunk));
+    cancelled.cancel();
+    QVERIFY(!cancelled.readChunk(chunk));
+}
+
+void TestDocumentLoad::testParserMatchesWholeFile()
+{
+    QString whole;
+    QVERIFY(GzipFile::readFromFile(m_fileName, whole));
+
+    // Everything on this thread in one go.
+    CountingHandler expected;
+    QXmlInputSource source;
+    source.setData(whole);
+    QXmlSimpleReader reader;
+    reader.setContentHandler(&expected);
+    reader.setErrorHandler(&expected);
+    QVERIFY(reader.parse(&source));
+
+    // Parsed on a worker thread in small batches.
+    CountingHandler handler;
+    XmlStreamParser parser(m_fileName, 100, 2);
+    QVERIFY(parser.open());
+    int batches = 0;
+    while (parser.parseSome(handler))
+        ++batches;
+
+    QVERIFY(parser.isOK());
+    QVERIFY(parser.isReadOK());
+    QVERIFY(batches > 1);
+    QVERIFY(handler.started);
+    QVERIFY(handler.ended);
+    QCOMPARE(handler.fatal, 0);
+    QCOMPARE(handler.elements, expected.elements);
+    QCOMPARE(handler.attributeCount, expected.attributeCount);
+    QCOMPARE(handler.text, expected.text);
+
+    // Giving up part way through doesn't hang.
+    CountingHandler cancelledHandler;
+    XmlStreamParser cancelled(m_fileName, 100, 2);
+    QVERIFY(cancelled.open());
+    QVERIFY(cancelled.parseSome(cancelledHandler));
+    cancelled.cancel();
+    QVERIFY(!cancelled.parseSome(cancelledHandler));
+    QVERIFY(!cancelled.isOK());
+    QVERIFY(!cancelledHandler.ended);
+}
+
+void TestDocumentLoad::testTruncatedFile()
+{
+    QString whole;
+    QVERIFY(GzipFile::readFromFile(m_fileName, whole));
+
+    const QString truncatedName = m_dir.filePath("truncated.rg");
+    QVERIFY(GzipFile::writeToFile(truncatedName,
+                                  whole.left(whole.length() / 2)));
+
+    CountingHandler handler;
+    XmlStreamParser parser(truncatedName, 100, 2);
+    QVERIFY(parser.open());
+    while (parser.parseSome(handler)) { }
+
+    // The file reads fine, but the document is incomplete.
+    QVERIFY(!parser.isOK());
+    QVERIFY(parser.isReadOK());
+    QCOMPARE(handler.fatal, 1);
+    QVERIFY(!handler.ended);
+}
+
+void TestDocumentLoad::benchmarkLoad()
+{
+    long events = 0;
+    QBENCHMARK {
+        RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+        QVERIFY(doc.openDocument(m_fileName, false /*not permanent*/,
+                                 true /*no progress dlg*/));
+        events = countEvents(doc);
+    }
+    QCOMPARE(events, m_expectedEvents);
+}
+
+QTEST_MAIN(TestDocumentLoad)
+
+#include "document_load.moc"
@@ -0,0 +1,184 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "document/DocumentSnapshot.h"
+#include "document/RosegardenDocument.h"
+#include <QScopedPointer>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTextStream>
+
+using namespace Rosegarden;
+
+// Saving from a DocumentSnapshot: the snapshot is unaffected by later
+// edits, even while it is being written on another thread.  Also
+// compares the time taken on the GUI thread to take a snapshot with the
+// time it takes to write one out.
+class TestDocumentSnapshot : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestDocumentSnapshot()
+        : m_doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/),
+          m_segment(nullptr) {}
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void testSnapshotUnaffectedByEdits();
+    void testWithoutCopies();
+    void testSaveWhileEditing();
+    void benchmarkTakeSnapshot();
+    void benchmarkWriteSnapshot();
+
+private:
+    static QString toXml(const DocumentSnapshot &snapshot);
+    static long countEvents(RosegardenDocument &doc);
+    void edit();
+
+    RosegardenDocument m_doc;
+    Segment *m_segment;
+    QTemporaryDir m_dir;
+};
+
+QString TestDocumentSnapshot::toXml(const DocumentSnapshot &snapshot)
+{
+    QString text;
+    QTextStream stream(&text, QIODevice::WriteOnly);
+    snapshot.write(stream);
+    stream.flush();
+    return text;
+}
+
+long TestDocumentSnapshot::countEvents(RosegardenDocument &doc)
+{
+    long events = 0;
+    Composition &comp = doc.getComposition();
+    for (Composition::iterator i = comp.begin(); i != comp.end(); ++i)
+        events += static_cast<long>((*i)->size());
+    return events;
+}
+
+void TestDocumentSnapshot::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    const QString input = QFINDTESTDATA("../data/examples/test_selection.rg");
+    QVERIFY(!input.isEmpty()); // file not found
+    m_doc.openDocument(input, false /*not permanent*/, true /*no progress dlg*/);
+    QVERIFY(!m_doc.getComposition().getSegments().empty());
+}
+
+void TestDocumentSnapshot::init()
+{
+    Composition &comp = m_doc.getComposition();
+
+    const timeT quarter = Note(Note::Crotchet).getDuration();
+
+    m_segment = new Segment;
+    m_segment->setTrack((*comp.getSegments().begin())->getTrack());
+    for (int n = 0; n < 200000; ++n) {
+        Event *note = Note(Note::Crotchet).getAsNoteEvent(
+                n * quarter, 36 + n % 48);
+        // A non-persistent property, which is saved too.
+        note->set<Int>(BaseProperties::VELOCITY, 100, false);
+        m_segment->insert(note);
+    }
+    comp.addSegment(m_segment);
+}
+
+void TestDocumentSnapshot::cleanup()
+{
+    m_doc.getComposition().deleteSegment(m_segment);
+    m_segment = nullptr;
+}
+
+void TestDocumentSnapshot::edit()
+{
+    // Change some Events in place, which unshares them from the
+    // snapshot's copies, and delete others.
+    int n = 0;
+    for (Segment::iterator i = m_segment->begin();
+         i != m_segment->end(); ++n) {
+        Segment::iterator next = i;
+        ++next;
+        if (n % 3 == 0)
+            (*i)->set<Int>(BaseProperties::PITCH, 20);
+        else if (n % 3 == 1)
+            m_segment->erase(i);
+        i = next;
+    }
+}
+
+void TestDocumentSnapshot::testSnapshotUnaffectedByEdits()
+{
+    QScopedPointer<DocumentSnapshot> before(m_doc.takeSnapshot());
+    const QString xml = toXml(*before);
+    QVERIFY(xml.contains("<nproperty name=\"velocity\""));
+
+    edit();
+
+    QScopedPointer<DocumentSnapshot> after(m_doc.takeSnapshot());
+    QVERIFY(toXml(*after) != xml);
+    QCOMPARE(toXml(*before), xml);
+}
+
+void TestDocumentSnapshot::testWithoutCopies()
+{
+    // What saveDocument() writes.
+    QScopedPointer<DocumentSnapshot> live(
+            m_doc.takeSnapshot(false /*copyEvents*/));
+    QScopedPointer<DocumentSnapshot> copied(m_doc.takeSnapshot());
+
+    QCOMPARE(live->getEventCount(), 0L);
+    QVERIFY(copied->getEventCount() > 0);
+    QCOMPARE(toXml(*live), toXml(*copied));
+}
+
+void TestDocumentSnapshot::testSaveWhileEditing()
+{
+    const long expectedEvents = countEvents(m_doc);
+    const QString fileName = m_dir.filePath("snapshot.rg");
+
+    DocumentSaveThread thread(m_doc.takeSnapshot(), fileName);
+    thread.start();
+    edit();
+    thread.wait();
+
+    QVERIFY2(thread.isOK(), qPrintable(thread.getErrorMessage()));
+
+    RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+    QVERIFY(doc.openDocument(fileName, false /*not permanent*/,
+                             true /*no progress dlg*/));
+    QCOMPARE(countEvents(doc), expectedEvents);
+}
+
+void TestDocumentSnapshot::benchmarkTakeSnapshot()
+{
+    // What autosave costs the GUI thread now.
+    QBENCHMARK {
+        QScopedPointer<DocumentSnapshot> snapshot(m_doc.takeSnapshot());
+    }
+}
+
+void TestDocumentSnapshot::benchmarkWriteSnapshot()
+{
+    // What it used to cost the GUI thread, and now costs the save
+    // thread.
+    QScopedPointer<DocumentSnapshot> snapshot(m_doc.takeSnapshot());
+    const QString fileName = m_dir.filePath("benchmark.rg");
+    QBENCHMARK {
+        QString errMsg;
+        QVERIFY(RosegardenDocument::saveSnapshot(*snapshot, fileName, errMsg));
+    }
+}
+
+QTEST_MAIN(TestDocumentSnapshot)
+
+#include "document_snapshot.moc"
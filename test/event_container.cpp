@@ -0,0 +1,349 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/ChunkedEventSet.h"
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include <QTest>
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace Rosegarden;
+
+typedef std::multiset<Event *, Event::EventCmp> EventMultiset;
+
+// ChunkedEventSet against std::multiset: the same results for the same
+// operations, and timings for the operations Segment relies on most
+// (findTime(), insert() and iterating) with each container.
+class TestEventContainer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testRandomOperations();
+    void testIteratorStability();
+    void testIteratorEquality();
+    void benchmarkFindTime_data();
+    void benchmarkFindTime();
+    void benchmarkInsert_data();
+    void benchmarkInsert();
+    void benchmarkIterate_data();
+    void benchmarkIterate();
+
+private:
+    template <class Container>
+    static bool sameOrder(const Container &c, const EventMultiset &expected);
+    static void addChunkedColumn();
+
+    /// A Segment's worth of notes, chords and controllers, in random order.
+    std::vector<Event *> m_events;
+};
+
+template <class Container>
+bool TestEventContainer::sameOrder(const Container &c,
+                                   const EventMultiset &expected)
+{
+    if (c.size() != expected.size())
+        return false;
+    if (!std::equal(expected.begin(), expected.end(), c.begin()))
+        return false;
+    // And backwards.
+    return std::equal(expected.rbegin(), expected.rend(), c.rbegin());
+}
+
+void TestEventContainer::addChunkedColumn()
+{
+    QTest::addColumn<bool>("chunked");
+    QTest::newRow("std::multiset") << false;
+    QTest::newRow("ChunkedEventSet") << true;
+}
+
+void TestEventContainer::initTestCase()
+{
+    std::mt19937 random(1);
+
+    // Four notes per beat, with the odd chord and controller.
+    for (int i = 0; i < 200000; ++i) {
+        const timeT time = (i / 4) * 240;
+        const short subOrdering = (i % 7 == 0) ? -1 : 0;
+        m_events.push_back(new Event(Note::EventType, time, 240, subOrdering));
+    }
+    std::shuffle(m_events.begin(), m_events.end(), random);
+}
+
+void TestEventContainer::cleanupTestCase()
+{
+    for (size_t i = 0; i < m_events.size(); ++i)
+        delete m_events[i];
+}
+
+void TestEventContainer::testRandomOperations()
+{
+    std::mt19937 random(2);
+    std::vector<Event *> events;
+
+    ChunkedEventSet chunked;
+    EventMultiset expected;
+
+    for (int op = 0; op < 50000; ++op) {
+        const unsigned action = random() % 10;
+
+        if (action < 5  ||  expected.empty()) {
+            // Lots of equal times and sub-orderings, so that the order
+            // of equivalent Events is tested.
+            Event *e = new Event(Note::EventType, random() % 400, 0,
+                                 short(random() % 5) - 2);
+            events.push_back(e);
+
+            if (action < 3) {
+                chunked.insert(e);
+                expected.insert(e);
+            } else {
+                // A hint that is sometimes right and sometimes not.
+                const size_t n = expected.empty() ? 0 : random() % (expected.size() + 1);
+                ChunkedEventSet::iterator ci = chunked.begin();
+                EventMultiset::iterator ei = expected.begin();
+                std::advance(ci, n);
+                std::advance(ei, n);
+                QCOMPARE(*chunked.insert(ci, e), *expected.insert(ei, e));
+            }
+        } else if (action < 8) {
+            const size_t n = random() % expected.size();
+            ChunkedEventSet::iterator ci = chunked.begin();
+            EventMultiset::iterator ei = expected.begin();
+            std::advance(ci, n);
+            std::advance(ei, n);
+            QCOMPARE(*ci, *ei);
+            ci = chunked.erase(ci);
+            ei = expected.erase(ei);
+            QVERIFY((ci == chunked.end()) == (ei == expected.end()));
+            if (ei != expected.end())
+                QCOMPARE(*ci, *ei);
+        } else if (action < 9) {
+            Event key(Note::EventType, random() % 400, 0,
+                      short(random() % 5) - 2);
+            QCOMPARE(chunked.count(&key), expected.count(&key));
+            QCOMPARE(chunked.erase(&key), expected.erase(&key));
+        } else {
+            Event key(Note::EventType, random() % 400, 0, MIN_SUBORDERING);
+            ChunkedEventSet::iterator ci = chunked.lower_bound(&key);
+            EventMultiset::iterator ei = expected.lower_bound(&key);
+            QVERIFY((ci == chunked.end()) == (ei == expected.end()));
+            if (ei != expected.end())
+                QCOMPARE(*ci, *ei);
+            QCOMPARE(std::distance(chunked.begin(), ci),
+                     std::distance(expected.begin(), ei));
+        }
+
+        if (op % 500 == 0)
+            QVERIFY(sameOrder(chunked, expected));
+    }
+
+    QVERIFY(sameOrder(chunked, expected));
+
+    ChunkedEventSet copy(chunked);
+    QVERIFY(sameOrder(copy, expected));
+    chunked.clear();
+    QVERIFY(chunked.empty());
+    QVERIFY(chunked.begin() == chunked.end());
+
+    for (size_t i = 0; i < events.size(); ++i)
+        delete events[i];
+}
+
+void TestEventContainer::testIteratorStability()
+{
+    std::vector<Event *> events(m_events.begin(), m_events.begin() + 20000);
+
+    ChunkedEventSet chunked;
+    for (size_t i = 0; i < events.size(); ++i)
+        chunked.insert(events[i]);
+
+    // Hold iterators to some of the Events...
+    std::vector<ChunkedEventSet::iterator> held;
+    std::vector<Event *> heldEvents;
+    int n = 0;
+    for (ChunkedEventSet::iterator i = chunked.begin();
+         i != chunked.end(); ++i, ++n) {
+        if (n % 97 == 0) {
+            held.push_back(i);
+            heldEvents.push_back(*i);
+        }
+    }
+
+    // ...erase a lot of others, so that chunks merge...
+    std::set<Event *> keep(heldEvents.begin(), heldEvents.end());
+    for (ChunkedEventSet::iterator i = chunked.begin(); i != chunked.end(); ) {
+        if (keep.find(*i) == keep.end()  &&  (n++ % 3) != 0)
+            i = chunked.erase(i);
+        else
+            ++i;
+    }
+
+    // ...and insert plenty more, so that chunks split.
+    for (size_t i = 20000; i < 60000; ++i)
+        chunked.insert(m_events[i]);
+
+    EventMultiset expected(chunked.begin(), chunked.end());
+    QVERIFY(sameOrder(chunked, expected));
+
+    for (size_t i = 0; i < held.size(); ++i) {
+        QCOMPARE(*held[i], heldEvents[i]);
+
+        // Moving on from a held iterator gives the same as it would
+        // for std::multiset.
+        EventMultiset::iterator ei = expected.find(heldEvents[i]);
+        while (*ei != heldEvents[i])
+            ++ei;
+        ChunkedEventSet::iterator next = held[i];
+        ++next;
+        ++ei;
+        QVERIFY((next == chunked.end()) == (ei == expected.end()));
+        if (ei != expected.end())
+            QCOMPARE(*next, *ei);
+    }
+}
+
+void TestEventContainer::testIteratorEquality()
+{
+    Event e1(Note::EventType, 0, 240);
+    Event *e2 = new Event(Note::EventType, 240, 240);
+    Event e3(Note::EventType, 480, 240);
+    // Not on the heap, so that they can't reuse e2's address.
+    Event e4(Note::EventType, 120, 240);
+    Event e5(Note::EventType, 360, 240);
+
+    ChunkedEventSet a;
+    ChunkedEventSet b;
+    a.insert(&e1);
+    b.insert(&e1);
+
+    // Iterators into different containers are never equal, even at
+    // the same Event or both at end().
+    QVERIFY(a.begin() != b.begin());
+    QVERIFY(a.end() != b.end());
+    QVERIFY(ChunkedEventSet::iterator() == ChunkedEventSet::iterator());
+
+    // An iterator left at an Event that has since been erased and
+    // deleted is found again by the key it kept, without touching the
+    // Event.
+    a.insert(e2);
+    a.insert(&e3);
+    ChunkedEventSet::iterator stale = a.find(e2);
+    a.erase(stale);
+    delete e2;
+    a.insert(&e4);
+    QVERIFY(stale == a.end());
+
+    // Iterators that have been moved to the same place are equal.
+    ChunkedEventSet::iterator i = a.begin();
+    ChunkedEventSet::iterator j = a.find(&e3);
+    ++i;
+    ++i;
+    QVERIFY(i == j);
+    a.insert(&e5);
+    QVERIFY(i == j);
+    QCOMPARE(*i, &e3);
+}
+
+void TestEventContainer::benchmarkFindTime_data()
+{
+    addChunkedColumn();
+}
+
+void TestEventContainer::benchmarkFindTime()
+{
+    QFETCH(bool, chunked);
+
+    ChunkedEventSet chunkedSet(m_events.begin(), m_events.end());
+    EventMultiset multiset(m_events.begin(), m_events.end());
+
+    // What Segment::findTime() does.
+    std::vector<Event *> dummies;
+    std::mt19937 random(3);
+    const timeT endTime = (*multiset.rbegin())->getAbsoluteTime();
+    for (int i = 0; i < 100000; ++i)
+        dummies.push_back(new Event("dummy", random() % endTime, 0,
+                                    MIN_SUBORDERING));
+
+    long total = 0;
+    if (chunked) {
+        QBENCHMARK {
+            for (size_t i = 0; i < dummies.size(); ++i)
+                total += (*chunkedSet.lower_bound(dummies[i]))->getDuration();
+        }
+    } else {
+        QBENCHMARK {
+            for (size_t i = 0; i < dummies.size(); ++i)
+                total += (*multiset.lower_bound(dummies[i]))->getDuration();
+        }
+    }
+    QVERIFY(total > 0);
+
+    for (size_t i = 0; i < dummies.size(); ++i)
+        delete dummies[i];
+}
+
+void TestEventContainer::benchmarkInsert_data()
+{
+    addChunkedColumn();
+}
+
+void TestEventContainer::benchmarkInsert()
+{
+    QFETCH(bool, chunked);
+
+    // Events arrive in random order, as when pasting or recording
+    // over existing material.
+    if (chunked) {
+        QBENCHMARK {
+            ChunkedEventSet set;
+            for (size_t i = 0; i < m_events.size(); ++i)
+                set.insert(m_events[i]);
+        }
+    } else {
+        QBENCHMARK {
+            EventMultiset set;
+            for (size_t i = 0; i < m_events.size(); ++i)
+                set.insert(m_events[i]);
+        }
+    }
+}
+
+void TestEventContainer::benchmarkIterate_data()
+{
+    addChunkedColumn();
+}
+
+void TestEventContainer::benchmarkIterate()
+{
+    QFETCH(bool, chunked);
+
+    ChunkedEventSet chunkedSet(m_events.begin(), m_events.end());
+    EventMultiset multiset(m_events.begin(), m_events.end());
+
+    timeT total = 0;
+    if (chunked) {
+        QBENCHMARK {
+            for (ChunkedEventSet::const_iterator i = chunkedSet.begin();
+                 i != chunkedSet.end(); ++i)
+                total += (*i)->getAbsoluteTime();
+        }
+    } else {
+        QBENCHMARK {
+            for (EventMultiset::const_iterator i = multiset.begin();
+                 i != multiset.end(); ++i)
+                total += (*i)->getAbsoluteTime();
+        }
+    }
+    QVERIFY(total > 0);
+}
+
+QTEST_MAIN(TestEventContainer)
+
+#include "event_container.moc"
@@ -0,0 +1,118 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/NotationTypes.h"
+#include "base/MidiTypes.h"
+#include "base/Segment.h"
+#include <QTest>
+
+using namespace Rosegarden;
+
+// Micro-benchmark for Event::isa() over a large Segment.  Compares the
+// interned EventTypeName comparison against the std::string comparison
+// isa() used to do.
+class TestEventIsa : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testTypeNames();
+    void benchmarkIsa();
+    void benchmarkStringCompare();
+
+private:
+    Segment *m_segment;
+    long m_expectedNotes;
+};
+
+void TestEventIsa::initTestCase()
+{
+    m_segment = new Segment();
+    m_expectedNotes = 0;
+
+    // A mix of types in roughly the proportions found in real
+    // compositions: mostly notes, some rests and controllers.
+    for (int i = 0; i < 200000; ++i) {
+        const timeT time = i * 120;
+        Event *e;
+        switch (i % 8) {
+        case 0:
+            e = new Event(Note::EventRestType, time, 120);
+            break;
+        case 1:
+            e = new Event(Controller::EventType, time);
+            break;
+        default:
+            e = new Event(Note::EventType, time, 120);
+            ++m_expectedNotes;
+            break;
+        }
+        m_segment->insert(e);
+    }
+}
+
+void TestEventIsa::cleanupTestCase()
+{
+    delete m_segment;
+}
+
+void TestEventIsa::testTypeNames()
+{
+    Event note(Note::EventType, 0);
+    QVERIFY(note.isa(Note::EventType));
+    QVERIFY(!note.isa(Note::EventRestType));
+    QCOMPARE(note.getType(), std::string("note"));
+
+    // Strings and EventTypeNames interoperate.
+    Event rest("rest", 0);
+    QVERIFY(rest.isa(Note::EventRestType));
+    QVERIFY(rest.getType() == Note::EventRestType);
+    QVERIFY(EventTypeName("rest") == Note::EventRestType);
+
+    // Ordered by string, not by the order they were interned in.
+    const EventTypeName interned1st("zzz-first");
+    const EventTypeName interned2nd("aaa-second");
+    QVERIFY(interned2nd < interned1st);
+    QVERIFY(!(interned1st < interned2nd));
+    QVERIFY(!(interned1st < interned1st));
+
+    const PropertyName name("event-isa-test");
+    QCOMPARE(name.getName(), std::string("event-isa-test"));
+    QCOMPARE(PropertyName(name.getName()).getValue(), name.getValue());
+}
+
+void TestEventIsa::benchmarkIsa()
+{
+    long notes = 0;
+    QBENCHMARK {
+        notes = 0;
+        for (Segment::const_iterator i = m_segment->begin();
+             i != m_segment->end(); ++i) {
+            if ((*i)->isa(Note::EventType))
+                ++notes;
+        }
+    }
+    QCOMPARE(notes, m_expectedNotes);
+}
+
+void TestEventIsa::benchmarkStringCompare()
+{
+    // What isa() did before types were interned.
+    const std::string noteType = Note::EventType;
+    long notes = 0;
+    QBENCHMARK {
+        notes = 0;
+        for (Segment::const_iterator i = m_segment->begin();
+             i != m_segment->end(); ++i) {
+            if ((*i)->getTypeName().getName() == noteType)
+                ++notes;
+        }
+    }
+    QCOMPARE(notes, m_expectedNotes);
+}
+
+QTEST_MAIN(TestEventIsa)
+
+#include "event_isa.moc"
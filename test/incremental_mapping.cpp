@@ -0,0 +1,245 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/MidiTypes.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "base/SegmentLinker.h"
+#include "commands/edit/EventInsertionCommand.h"
+#include "document/CommandHistory.h"
+#include "document/RosegardenDocument.h"
+#include "gui/seqmanager/SegmentMapper.h"
+#include "sound/MappedEvent.h"
+#include <QTest>
+
+using namespace Rosegarden;
+
+// Checks that re-mapping just the edited part of a Segment
+// (MappedEventBuffer::refresh(from, to)) leaves the buffer exactly as a
+// full fillBuffer() would.
+class TestIncrementalMapping : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestIncrementalMapping()
+        : m_doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/),
+          m_segment(nullptr),
+          m_statusId(0) {}
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testInsertNote();
+    void testEraseNote();
+    void testTies();
+    void testController();
+    void testRepeating();
+    void testLinkedCopy();
+
+private:
+    void checkRefresh(Segment *segment, unsigned int statusId,
+                      QSharedPointer<SegmentMapper> mapper);
+    Segment::iterator findNote(timeT time);
+
+    RosegardenDocument m_doc;
+    Segment *m_segment;
+    unsigned int m_statusId;
+    QSharedPointer<SegmentMapper> m_mapper;
+    timeT m_quarter;
+};
+
+void TestIncrementalMapping::initTestCase()
+{
+    const QString input = QFINDTESTDATA("../data/examples/test_selection.rg");
+    QVERIFY(!input.isEmpty()); // file not found
+    m_doc.openDocument(input, false /*not permanent*/, true /*no progress dlg*/);
+
+    Composition &comp = m_doc.getComposition();
+    QVERIFY(!comp.getSegments().empty());
+
+    m_quarter = Note(Note::Crotchet).getDuration();
+
+    m_segment = new Segment;
+    m_segment->setTrack((*comp.getSegments().begin())->getTrack());
+
+    // 64 beats of crotchets in pairs of the same pitch, with a chord
+    // on every bar, a tie across every third pair and a controller
+    // every other bar.
+    for (int beat = 0; beat < 64; ++beat) {
+        const timeT time = beat * m_quarter;
+        Event *note = Note(Note::Crotchet).getAsNoteEvent(
+                time, 60 + (beat / 2) % 12);
+        if (beat % 6 == 0)
+            note->set<Bool>(BaseProperties::TIED_FORWARD, true);
+        if (beat % 6 == 1)
+            note->set<Bool>(BaseProperties::TIED_BACKWARD, true);
+        m_segment->insert(note);
+
+        if (beat % 4 == 0) {
+            m_segment->insert(Note(Note::Crotchet).getAsNoteEvent(time, 48));
+            m_segment->insert(Note(Note::Crotchet).getAsNoteEvent(time, 52));
+        }
+        if (beat % 8 == 0)
+            m_segment->insert(Controller::makeEvent(time, 7, 64 + beat));
+    }
+
+    comp.addSegment(m_segment);
+
+    m_statusId = m_segment->getNewRefreshStatusId();
+    m_mapper = SegmentMapper::makeMapperForSegment(&m_doc, m_segment);
+    QVERIFY(m_mapper);
+    QVERIFY(m_mapper->size() > 0);
+}
+
+void TestIncrementalMapping::cleanupTestCase()
+{
+    CommandHistory::getInstance()->clear();
+    m_mapper.clear();
+}
+
+void TestIncrementalMapping::checkRefresh(Segment *segment,
+                                          unsigned int statusId,
+                                          QSharedPointer<SegmentMapper> mapper)
+{
+    SegmentRefreshStatus &status = segment->getRefreshStatus(statusId);
+    QVERIFY(status.needsRefresh());
+    mapper->refresh(status.from(), status.to());
+    status.setNeedsRefresh(false);
+
+    QSharedPointer<SegmentMapper> full =
+            SegmentMapper::makeMapperForSegment(&m_doc, segment);
+
+    QCOMPARE(mapper->size(), full->size());
+
+    for (int i = 0; i < full->size(); ++i) {
+        const MappedEvent &updated = mapper->at(i);
+        const MappedEvent &filled = full->at(i);
+        QCOMPARE(updated.getType(), filled.getType());
+        QCOMPARE(updated.getEventTime(), filled.getEventTime());
+        QCOMPARE(updated.getDuration(), filled.getDuration());
+        QCOMPARE(updated.getData1(), filled.getData1());
+        QCOMPARE(updated.getData2(), filled.getData2());
+        QCOMPARE(updated.getTrackId(), filled.getTrackId());
+    }
+
+    RealTime updatedStart, updatedEnd, filledStart, filledEnd;
+    mapper->getStartEnd(updatedStart, updatedEnd);
+    full->getStartEnd(filledStart, filledEnd);
+    QCOMPARE(updatedStart, filledStart);
+    QCOMPARE(updatedEnd, filledEnd);
+}
+
+Segment::iterator TestIncrementalMapping::findNote(timeT time)
+{
+    Segment::iterator i = m_segment->findTime(time);
+    while (m_segment->isBeforeEndMarker(i) && !(*i)->isa(Note::EventType))
+        ++i;
+    return i;
+}
+
+void TestIncrementalMapping::testInsertNote()
+{
+    // An extra chord note in the middle and a long note crossing
+    // several others.
+    m_segment->insert(Note(Note::Crotchet).getAsNoteEvent(20 * m_quarter, 55));
+    m_segment->insert(Note(Note::Semibreve).getAsNoteEvent(
+            30 * m_quarter + m_quarter / 2, 72));
+
+    checkRefresh(m_segment, m_statusId, m_mapper);
+}
+
+void TestIncrementalMapping::testEraseNote()
+{
+    m_segment->erase(findNote(41 * m_quarter));
+    checkRefresh(m_segment, m_statusId, m_mapper);
+
+    // The second half of a tie.  The first half now sounds on its own.
+    m_segment->erase(findNote(13 * m_quarter));
+    checkRefresh(m_segment, m_statusId, m_mapper);
+}
+
+void TestIncrementalMapping::testTies()
+{
+    // Tie the second note of a pair to the first of the next pair,
+    // which has a different pitch, so the tie is bogus...
+    Segment::iterator i = findNote(15 * m_quarter);
+    Event *tied = new Event(**i);
+    tied->set<Bool>(BaseProperties::TIED_FORWARD, true);
+    m_segment->erase(i);
+    m_segment->insert(tied);
+    checkRefresh(m_segment, m_statusId, m_mapper);
+
+    // ...then make it a real one by tying the pair together, which
+    // changes how long the first note of the pair sounds.
+    i = findNote(27 * m_quarter);
+    tied = new Event(**i);
+    tied->set<Bool>(BaseProperties::TIED_BACKWARD, true);
+    m_segment->erase(i);
+    m_segment->insert(tied);
+    i = findNote(26 * m_quarter);
+    tied = new Event(**i);
+    tied->set<Bool>(BaseProperties::TIED_FORWARD, true);
+    m_segment->erase(i);
+    m_segment->insert(tied);
+    checkRefresh(m_segment, m_statusId, m_mapper);
+}
+
+void TestIncrementalMapping::testController()
+{
+    m_segment->insert(Controller::makeEvent(33 * m_quarter, 10, 20));
+    m_segment->insert(Controller::makeEvent(60 * m_quarter, 7, 100));
+    checkRefresh(m_segment, m_statusId, m_mapper);
+}
+
+void TestIncrementalMapping::testRepeating()
+{
+    m_segment->setRepeating(true);
+    m_mapper->refresh();
+    m_segment->getRefreshStatus(m_statusId).setNeedsRefresh(false);
+
+    m_segment->insert(Note(Note::Minim).getAsNoteEvent(10 * m_quarter, 67));
+    m_segment->erase(findNote(50 * m_quarter));
+    checkRefresh(m_segment, m_statusId, m_mapper);
+
+    // A note that hangs over the end of the Segment into the repeats.
+    m_segment->insert(Note(Note::Semibreve).getAsNoteEvent(62 * m_quarter, 79));
+    checkRefresh(m_segment, m_statusId, m_mapper);
+
+    m_segment->setRepeating(false);
+    m_mapper->refresh();
+    m_segment->getRefreshStatus(m_statusId).setNeedsRefresh(false);
+}
+
+void TestIncrementalMapping::testLinkedCopy()
+{
+    Composition &comp = m_doc.getComposition();
+
+    Segment *linked = SegmentLinker::createLinkedSegment(m_segment);
+    comp.addSegment(linked);
+    linked->setStartTime(m_segment->getEndMarkerTime());
+    linked->setTranspose(-12);
+
+    const unsigned int linkedStatusId = linked->getNewRefreshStatusId();
+    QSharedPointer<SegmentMapper> linkedMapper =
+            SegmentMapper::makeMapperForSegment(&m_doc, linked);
+
+    // createLinkedSegment() may have added a key at the start.
+    if (m_segment->getRefreshStatus(m_statusId).needsRefresh())
+        checkRefresh(m_segment, m_statusId, m_mapper);
+
+    // Editing one linked Segment updates the time range that changed
+    // in the other.
+    CommandHistory::getInstance()->addCommand(new EventInsertionCommand(
+            *m_segment,
+            Note(Note::Crotchet).getAsNoteEvent(45 * m_quarter, 50)));
+
+    checkRefresh(m_segment, m_statusId, m_mapper);
+    checkRefresh(linked, linkedStatusId, linkedMapper);
+}
+
+QTEST_MAIN(TestIncrementalMapping)
+
+#include "incremental_mapping.moc"
@@ -0,0 +1,242 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/RealTime.h"
+#include "base/Segment.h"
+#include "document/RosegardenDocument.h"
+#include "gui/seqmanager/MEBIterator.h"
+#include "gui/seqmanager/SegmentMapper.h"
+#include "sound/MappedBufMetaIterator.h"
+#include "sound/MappedEvent.h"
+#include "sound/MappedEventInserter.h"
+#include "sound/MappedEventList.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QTest>
+#include <QThread>
+
+#include <cstdlib>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+// Plays the buffer over and over like the sequencer thread does, in
+// slices, checking what comes out.
+class FetchThread : public QThread
+{
+public:
+    FetchThread(QSharedPointer<MappedEventBuffer> buffer, RealTime end) :
+        m_end(end),
+        m_fetched(0),
+        m_bad(0)
+    {
+        m_metaIterator.addBuffer(buffer);
+    }
+
+    void stop()  { m_stop.storeRelease(1); }
+
+    long getFetched() const  { return m_fetched; }
+    long getBad() const  { return m_bad; }
+
+protected:
+    void run() override
+    {
+        const RealTime slice = RealTime::fromMilliseconds(160);
+        RealTime start = RealTime::zeroTime;
+
+        while (!m_stop.loadAcquire()) {
+            MappedEventList list;
+            MappedEventInserter inserter(list);
+            m_metaIterator.fetchEvents(inserter, start, start + slice);
+
+            for (MappedEventList::const_iterator i = list.begin();
+                 i != list.end(); ++i) {
+                ++m_fetched;
+                // Every event we get must be a whole one from this
+                // slice, not something half-written.
+                if (!(*i)->isValid()  ||
+                    (*i)->getEventTime() >= start + slice)
+                    ++m_bad;
+            }
+
+            start = start + slice;
+            if (start > m_end) {
+                start = RealTime::zeroTime;
+                m_metaIterator.jumpToTime(start);
+            }
+        }
+    }
+
+private:
+    MappedBufMetaIterator m_metaIterator;
+    RealTime m_end;
+    QAtomicInt m_stop;
+    long m_fetched;
+    long m_bad;
+};
+
+}
+
+// Refills a MappedEventBuffer as fast as possible on one thread while
+// MappedBufMetaIterator::fetchEvents() reads it on another.  Best run
+// under a memory checker.
+class TestMappedBufferStress : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestMappedBufferStress()
+        : m_doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/)
+    { }
+
+private Q_SLOTS:
+    void initTestCase();
+    void testRefillWhileFetching();
+    void testPinnedEvent();
+
+private:
+    RosegardenDocument m_doc;
+};
+
+void TestMappedBufferStress::initTestCase()
+{
+    const QString input = QFINDTESTDATA("../data/examples/test_selection.rg");
+    QVERIFY(!input.isEmpty()); // file not found
+    m_doc.openDocument(input, false /*not permanent*/, true /*no progress dlg*/);
+}
+
+void TestMappedBufferStress::testRefillWhileFetching()
+{
+    Composition &comp = m_doc.getComposition();
+    QVERIFY(!comp.getSegments().empty());
+
+    const timeT quarter = Note(Note::Crotchet).getDuration();
+    const int beats = 2000;
+
+    Segment *segment = new Segment;
+    segment->setTrack((*comp.getSegments().begin())->getTrack());
+    for (int beat = 0; beat < beats; ++beat) {
+        segment->insert(Note(Note::Crotchet).getAsNoteEvent(
+                beat * quarter, 48 + beat % 24));
+    }
+    comp.addSegment(segment);
+
+    const unsigned int statusId = segment->getNewRefreshStatusId();
+
+    QSharedPointer<SegmentMapper> mapper =
+            SegmentMapper::makeMapperForSegment(&m_doc, segment);
+    QVERIFY(mapper);
+
+    FetchThread reader(mapper, comp.getElapsedRealTime(beats * quarter));
+    reader.start();
+
+    srand(1);
+
+    QElapsedTimer timer;
+    timer.start();
+    int refreshes = 0;
+
+    while (timer.elapsed() < 2000) {
+        if (refreshes % 20 == 0) {
+            // A big change so that the buffer has to grow, then shrink
+            // back.
+            for (int i = 0; i < 500; ++i) {
+                segment->insert(Note(Note::Quaver).getAsNoteEvent(
+                        (rand() % beats) * quarter, 72));
+            }
+            mapper->refresh();
+            segment->getRefreshStatus(statusId).setNeedsRefresh(false);
+            while (segment->size() > size_t(beats))
+                segment->erase(--segment->end());
+            mapper->refresh();
+        } else {
+            // A small edit, updated incrementally.
+            Segment::iterator i = segment->findTime((rand() % beats) * quarter);
+            if (segment->isBeforeEndMarker(i)  &&  (*i)->isa(Note::EventType)) {
+                Event *moved = new Event(**i, (*i)->getAbsoluteTime() + quarter / 2);
+                segment->erase(i);
+                segment->insert(moved);
+            }
+            SegmentRefreshStatus &status = segment->getRefreshStatus(statusId);
+            mapper->refresh(status.from(), status.to());
+        }
+        segment->getRefreshStatus(statusId).setNeedsRefresh(false);
+        ++refreshes;
+    }
+
+    reader.stop();
+    reader.wait();
+
+    qDebug("  %d refreshes, %ld events fetched", refreshes, reader.getFetched());
+
+    QVERIFY(refreshes > 0);
+    QVERIFY(reader.getFetched() > 0);
+    QCOMPARE(reader.getBad(), 0L);
+}
+
+// An event a reader is looking at stays put however many times the
+// buffer is refreshed.
+void TestMappedBufferStress::testPinnedEvent()
+{
+    Composition &comp = m_doc.getComposition();
+    QVERIFY(!comp.getSegments().empty());
+
+    const timeT quarter = Note(Note::Crotchet).getDuration();
+
+    Segment *segment = new Segment;
+    segment->setTrack((*comp.getSegments().begin())->getTrack());
+    for (int beat = 0; beat < 2000; ++beat) {
+        segment->insert(Note(Note::Crotchet).getAsNoteEvent(
+                beat * quarter, 60));
+    }
+    comp.addSegment(segment);
+
+    const unsigned int statusId = segment->getNewRefreshStatusId();
+
+    QSharedPointer<SegmentMapper> mapper =
+            SegmentMapper::makeMapperForSegment(&m_doc, segment);
+    QVERIFY(mapper);
+
+    MEBIterator iter(mapper);
+    const MappedEvent *event = iter.peek();
+    QVERIFY(event);
+    const RealTime time = event->getEventTime();
+    const int pitch = event->getPitch();
+
+    // Change every note, a bit at a time and all at once.
+    for (int i = 0; i < 200; ++i) {
+        for (Segment::iterator j = segment->begin();
+             j != segment->end(); ++j) {
+            (*j)->set<Int>(BaseProperties::PITCH, 61 + i % 10);
+        }
+        segment->updateRefreshStatuses(segment->getStartTime(),
+                                       segment->getEndTime());
+        SegmentRefreshStatus &status = segment->getRefreshStatus(statusId);
+        if (i % 2)
+            mapper->refresh(status.from(), status.to());
+        else
+            mapper->refresh();
+        status.setNeedsRefresh(false);
+    }
+
+    // Still the event from before the refreshes.
+    QCOMPARE(event->getEventTime(), time);
+    QCOMPARE(int(event->getPitch()), pitch);
+
+    // And the iterator moves on to the latest version when asked.
+    const MappedEvent *latest = iter.peek();
+    QVERIFY(latest);
+    QCOMPARE(int(latest->getPitch()), 61 + 199 % 10);
+
+    comp.deleteSegment(segment);
+}
+
+QTEST_MAIN(TestMappedBufferStress)
+
+#include "mapped_buffer_stress.moc"
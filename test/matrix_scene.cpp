@@ -0,0 +1,235 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/RulerScale.h"
+#include "base/Segment.h"
+#include "document/RosegardenDocument.h"
+#include "gui/editors/matrix/MatrixElement.h"
+#include "gui/editors/matrix/MatrixScene.h"
+
+#include <QImage>
+#include <QPainter>
+#include <QTest>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+/// A long, busy piano roll: a thousand bars of semiquavers in two voices.
+const int Bars = 1000;
+
+/// What a matrix editor window shows at the default zoom.
+const QSizeF ViewSize(1200, 600);
+
+/// The events of the notes with items in the given area.
+std::set<Event *> eventsIn(MatrixScene &scene, const QRectF &rect)
+{
+    std::set<Event *> events;
+    const QList<QGraphicsItem *> items = scene.items(rect);
+    for (int i = 0; i < items.size(); ++i) {
+        if (!items[i]->isVisible()) continue;
+        MatrixElement *element = MatrixElement::getMatrixElement(items[i]);
+        if (element) events.insert(element->event());
+    }
+    return events;
+}
+
+/// Items for notes anywhere in the scene.
+int noteItems(MatrixScene &scene)
+{
+    int count = 0;
+    const QList<QGraphicsItem *> items = scene.items();
+    for (int i = 0; i < items.size(); ++i) {
+        if (items[i]->isVisible() && MatrixElement::getMatrixElement(items[i]))
+            ++count;
+    }
+    return count;
+}
+
+}
+
+// The virtualised MatrixScene: that it has items for the notes in view,
+// the same ones as a scene with an item for every note, that it reuses
+// them as the view scrolls, and how long opening and scrolling a long
+// segment take with it and without.
+class TestMatrixScene : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestMatrixScene() :
+        m_doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/),
+        m_notes(0)
+    {
+    }
+
+private Q_SLOTS:
+    void initTestCase();
+    void testVisibleNotes();
+    void testScroll();
+    void benchmarkOpen_data();
+    void benchmarkOpen();
+    void benchmarkScroll_data();
+    void benchmarkScroll();
+
+private:
+    /// The view scrolled to the given bar, about middle C.
+    QRectF viewAt(MatrixScene &scene, int bar);
+
+    RosegardenDocument m_doc;
+    std::vector<Segment *> m_segments;
+    int m_notes;
+};
+
+void TestMatrixScene::initTestCase()
+{
+    const QString input = QFINDTESTDATA("../data/examples/test_selection.rg");
+    QVERIFY(!input.isEmpty()); // file not found
+    m_doc.openDocument(input, false /*not permanent*/, true /*no progress dlg*/);
+
+    Composition &comp = m_doc.getComposition();
+    QVERIFY(!comp.getSegments().empty());
+
+    Segment *segment = new Segment;
+    segment->setTrack((*comp.getSegments().begin())->getTrack());
+
+    const Note semiquaver(Note::Semiquaver);
+    const timeT bar = comp.getBarRange(0).second - comp.getBarRange(0).first;
+    const int perBar = int(bar / semiquaver.getDuration());
+
+    for (int n = 0; n < Bars * perBar; ++n) {
+        const timeT time = n * semiquaver.getDuration();
+        segment->insert(semiquaver.getAsNoteEvent(time, 48 + (n * 7) % 24));
+        segment->insert(semiquaver.getAsNoteEvent(time, 60 + (n * 5) % 24));
+        m_notes += 2;
+    }
+
+    comp.addSegment(segment);
+    m_segments.push_back(segment);
+}
+
+QRectF TestMatrixScene::viewAt(MatrixScene &scene, int bar)
+{
+    const Composition &comp = m_doc.getComposition();
+    const double x = scene.getRulerScale()->getXForTime(
+            comp.getBarRange(bar).first);
+    const double y = (127 - 72) * (scene.getYResolution() + 1);
+    return QRectF(QPointF(x, y), ViewSize);
+}
+
+void TestMatrixScene::testVisibleNotes()
+{
+    MatrixScene all;
+    all.setSegments(&m_doc, m_segments);
+    QCOMPARE(noteItems(all), m_notes);
+
+    MatrixScene virtualised;
+    virtualised.setVirtualised(true);
+    virtualised.setSegments(&m_doc, m_segments);
+
+    // Nothing until we know what's in view.
+    QCOMPARE(noteItems(virtualised), 0);
+
+    const QRectF view = viewAt(virtualised, Bars / 2);
+    virtualised.setVisibleRect(view);
+
+    const std::set<Event *> seen = eventsIn(virtualised, view);
+    QVERIFY(!seen.empty());
+    QVERIFY(seen == eventsIn(all, view));
+
+    // Only the notes around the view.
+    QVERIFY(noteItems(virtualised) < m_notes / 50);
+
+    // The grid is painted rather than made of items.
+    QVERIFY(virtualised.items().size() < all.items().size() / 50);
+}
+
+void TestMatrixScene::testScroll()
+{
+    MatrixScene all;
+    all.setSegments(&m_doc, m_segments);
+
+    MatrixScene virtualised;
+    virtualised.setVirtualised(true);
+    virtualised.setSegments(&m_doc, m_segments);
+
+    int mostItems = 0;
+
+    for (int bar = 0; bar < Bars; bar += 37) {
+        const QRectF view = viewAt(virtualised, bar);
+        virtualised.setVisibleRect(view);
+        QVERIFY2(eventsIn(virtualised, view) == eventsIn(all, view),
+                 qPrintable(QString("bar %1").arg(bar)));
+        mostItems = std::max(mostItems, virtualised.items().size());
+    }
+
+    // Back to the start: the items are reused rather than piling up.
+    virtualised.setVisibleRect(viewAt(virtualised, 0));
+    QVERIFY(virtualised.items().size() <= mostItems);
+    QVERIFY(noteItems(virtualised) < m_notes / 50);
+}
+
+void TestMatrixScene::benchmarkOpen_data()
+{
+    QTest::addColumn<bool>("virtualised");
+    QTest::newRow("item per note") << false;
+    QTest::newRow("virtualised") << true;
+}
+
+void TestMatrixScene::benchmarkOpen()
+{
+    QFETCH(bool, virtualised);
+
+    int items = 0;
+
+    QBENCHMARK {
+        MatrixScene scene;
+        scene.setVirtualised(virtualised);
+        scene.setSegments(&m_doc, m_segments);
+        scene.setVisibleRect(viewAt(scene, 0));
+        items = scene.items().size();
+    }
+
+    qDebug("%d notes, %d items", m_notes, items);
+}
+
+void TestMatrixScene::benchmarkScroll_data()
+{
+    QTest::addColumn<bool>("virtualised");
+    QTest::newRow("item per note") << false;
+    QTest::newRow("virtualised") << true;
+}
+
+void TestMatrixScene::benchmarkScroll()
+{
+    QFETCH(bool, virtualised);
+
+    MatrixScene scene;
+    scene.setVirtualised(virtualised);
+    scene.setSegments(&m_doc, m_segments);
+
+    QImage image(ViewSize.toSize(), QImage::Format_ARGB32_Premultiplied);
+
+    // Page through a hundred bars, drawing each screenful.
+    QBENCHMARK {
+        QRectF view = viewAt(scene, 0);
+        const QRectF end = viewAt(scene, 100);
+        while (view.left() < end.left()) {
+            scene.setVisibleRect(view);
+            QPainter painter(&image);
+            scene.render(&painter, QRectF(image.rect()), view);
+            view.translate(view.width() / 4, 0);
+        }
+    }
+}
+
+QTEST_MAIN(TestMatrixScene)
+
+#include "matrix_scene.moc"
@@ -0,0 +1,265 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "document/RosegardenDocument.h"
+#include "sound/Midi.h"
+#include "sound/MidiFile.h"
+#include "TestMidiBytes.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+void appendMeta(std::string &bytes, MidiByte code, const std::string &message)
+{
+    appendNumber(bytes, 0);
+    bytes += char(MIDI_FILE_META_EVENT);
+    bytes += char(code);
+    appendNumber(bytes, message.size());
+    bytes += message;
+}
+
+/// A track chunk of generated events on the given channels, using
+/// running status where it can.  Adds the notes it plays to notes.
+std::string makeTrack(unsigned int seed, int events, int channels,
+                      bool pad, long &notes)
+{
+    std::string data;
+    appendMeta(data, MIDI_TRACK_NAME, "Track " + std::to_string(seed));
+
+    unsigned int x = seed;
+    int lastStatus = -1;
+
+    for (int i = 0; i < events; ++i) {
+        x = x * 1103515245 + 12345;
+        const int channel = int((x >> 16) % channels);
+        const int kind = int((x >> 8) % 16);
+        const int pitch = 36 + int((x >> 20) % 48);
+
+        appendNumber(data, (x >> 4) % 200);
+
+        int status;
+        std::string body;
+        if (kind < 10) {
+            // A note on, and a note off as a zero velocity note on.
+            status = MIDI_NOTE_ON | channel;
+            body += char(pitch);
+            body += char(1 + (x >> 12) % 126);
+            ++notes;
+        } else if (kind == 10) {
+            status = MIDI_CTRL_CHANGE | channel;
+            body += char(7);
+            body += char((x >> 12) % 128);
+        } else if (kind == 11) {
+            status = MIDI_PROG_CHANGE | channel;
+            body += char((x >> 12) % 128);
+        } else if (kind == 12) {
+            status = MIDI_PITCH_BEND | channel;
+            body += char((x >> 12) % 128);
+            body += char((x >> 19) % 128);
+        } else if (kind == 13) {
+            status = MIDI_CHNL_AFTERTOUCH | channel;
+            body += char((x >> 12) % 128);
+        } else if (kind == 14) {
+            status = MIDI_SYSTEM_EXCLUSIVE;
+            std::string sysex = "\x41\x10\x42\x12";
+            sysex += char(MIDI_END_OF_EXCLUSIVE);
+            appendNumber(body, sysex.size());
+            body += sysex;
+        } else {
+            const std::string text(1 + x % 40, 'a');
+            data += char(MIDI_FILE_META_EVENT);
+            data += char(MIDI_TEXT_EVENT);
+            appendNumber(data, text.size());
+            data += text;
+            continue;
+        }
+
+        if (status != lastStatus || status == MIDI_SYSTEM_EXCLUSIVE)
+            data += char(status);
+        lastStatus = (status == MIDI_SYSTEM_EXCLUSIVE ? -1 : status);
+        data += body;
+
+        if (kind < 10) {
+            appendNumber(data, 1 + (x >> 6) % 480);
+            if (lastStatus != (MIDI_NOTE_ON | channel))
+                data += char(MIDI_NOTE_ON | channel);
+            lastStatus = MIDI_NOTE_ON | channel;
+            data += char(pitch);
+            data += char(0);
+        }
+    }
+
+    appendMeta(data, MIDI_END_OF_TRACK, "");
+
+    // An obscure, but real, padding byte at the end.
+    if (pad)
+        data += char(0);
+
+    std::string chunk = "MTrk";
+    appendLong(chunk, data.size());
+    return chunk + data;
+}
+
+/// A format 1 file: a conductor track with tempo, time and key, then
+/// tracks on one or more channels each, with an alien chunk among
+/// them.
+std::string makeMidiFile(unsigned int seed, int tracks, int events,
+                         long &notes)
+{
+    std::string bytes = "MThd";
+    appendLong(bytes, 6);
+    bytes += '\0'; bytes += '\1';
+    bytes += '\0'; bytes += char(tracks + 1);
+    bytes += char(480 >> 8); bytes += char(480 & 0xff);
+
+    std::string conductor;
+    appendMeta(conductor, MIDI_SET_TEMPO, std::string("\x07\xa1\x20", 3));
+    appendMeta(conductor, MIDI_TIME_SIGNATURE, std::string("\x03\x02\x18\x08", 4));
+    appendMeta(conductor, MIDI_KEY_SIGNATURE, std::string("\x02\x00", 2));
+    appendMeta(conductor, MIDI_END_OF_TRACK, "");
+    bytes += "MTrk";
+    appendLong(bytes, conductor.size());
+    bytes += conductor;
+
+    for (int t = 0; t < tracks; ++t) {
+        if (t == tracks / 2) {
+            bytes += "XFIH";
+            appendLong(bytes, 5);
+            bytes += "alien";
+        }
+        bytes += makeTrack(seed * 1000 + t, events, 1 + t % 3, t % 4 == 1,
+                           notes);
+    }
+
+    return bytes;
+}
+
+bool writeFile(const QString &fileName, const std::string &bytes)
+{
+    std::ofstream file(fileName.toLocal8Bit(),
+                       std::ios::out | std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+    return file.good();
+}
+
+long countNotes(RosegardenDocument &doc)
+{
+    long notes = 0;
+    Composition &comp = doc.getComposition();
+    for (Composition::iterator i = comp.begin(); i != comp.end(); ++i) {
+        for (Segment::iterator j = (*i)->begin(); j != (*i)->end(); ++j) {
+            if ((*j)->isa(Note::EventType))
+                ++notes;
+        }
+    }
+    return notes;
+}
+
+}
+
+// MidiFile reads generated files, odd corners and all, writes them
+// back out the same, and how long reading a corpus of them takes.
+class TestMidiFile : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testRead();
+    void testRoundTrip();
+    void testTruncated();
+    void benchmarkRead();
+
+private:
+    QTemporaryDir m_dir;
+    std::vector<QString> m_fileNames;
+    std::vector<long> m_notes;
+};
+
+void TestMidiFile::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    // 16 files of 24 tracks of 4000 events.
+    for (unsigned int n = 0; n < 16; ++n) {
+        long notes = 0;
+        const std::string bytes = makeMidiFile(n + 1, 24, 4000, notes);
+        m_fileNames.push_back(m_dir.filePath(QString("%1.mid").arg(n)));
+        QVERIFY(writeFile(m_fileNames.back(), bytes));
+        m_notes.push_back(notes);
+    }
+}
+
+void TestMidiFile::testRead()
+{
+    for (size_t n = 0; n < 2; ++n) {
+        RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+        MidiFile midiFile;
+        QVERIFY(midiFile.convertToRosegarden(m_fileNames[n], &doc));
+        QCOMPARE(countNotes(doc), m_notes[n]);
+
+        // A Segment for each channel of each track.
+        QCOMPARE(doc.getComposition().getNbSegments(),
+                 (1u + 2u + 3u) * 24u / 3u);
+    }
+}
+
+void TestMidiFile::testRoundTrip()
+{
+    RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+    MidiFile in;
+    QVERIFY(in.convertToRosegarden(m_fileNames[0], &doc));
+
+    const QString fileName = m_dir.filePath("out.mid");
+    MidiFile out;
+    QVERIFY(out.convertToMidi(&doc, fileName));
+
+    RosegardenDocument again(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+    MidiFile reread;
+    QVERIFY(reread.convertToRosegarden(fileName, &again));
+    QCOMPARE(countNotes(again), m_notes[0]);
+}
+
+void TestMidiFile::testTruncated()
+{
+    long notes = 0;
+    std::string bytes = makeMidiFile(99, 4, 100, notes);
+
+    // Anywhere past the header, cutting the file short is an error.
+    for (size_t length = 14; length < bytes.size(); length += 97) {
+        const QString fileName = m_dir.filePath("truncated.mid");
+        QVERIFY(writeFile(fileName, bytes.substr(0, length)));
+
+        RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+        MidiFile midiFile;
+        QVERIFY(!midiFile.convertToRosegarden(fileName, &doc));
+        QVERIFY(!midiFile.getError().empty());
+    }
+}
+
+void TestMidiFile::benchmarkRead()
+{
+    QBENCHMARK {
+        for (size_t n = 0; n < m_fileNames.size(); ++n) {
+            RosegardenDocument doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/);
+            MidiFile midiFile;
+            QVERIFY(midiFile.convertToRosegarden(m_fileNames[n], &doc));
+        }
+    }
+}
+
+QTEST_MAIN(TestMidiFile)
+
+#include "midi_file.moc"
@@ -0,0 +1,291 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "base/Track.h"
+#include "base/ViewElement.h"
+#include "commands/edit/EventInsertionCommand.h"
+#include "document/Command.h"
+#include "document/CommandHistory.h"
+#include "document/RosegardenDocument.h"
+#include "gui/editors/notation/NotationHLayout.h"
+#include "gui/editors/notation/NotationScene.h"
+#include "gui/editors/notation/NotationStaff.h"
+#include "gui/editors/notation/NotationWidget.h"
+#include "gui/editors/notation/StaffLayout.h"
+
+#include <QStringList>
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const int Staffs = 8;
+const int Bars = 64;
+
+/// Crotchets and pairs of quavers in C major, different on each staff.
+Segment *makeSegment(TrackId track, int staff, timeT barDuration)
+{
+    Segment *segment = new Segment;
+    segment->setTrack(track);
+
+    const Note crotchet(Note::Crotchet);
+    const Note quaver(Note::Quaver);
+    const int naturals[] = { 60, 62, 64, 65, 67, 69, 71, 72 };
+
+    for (int bar = 0; bar < Bars; ++bar) {
+        for (int beat = 0; beat < 4; ++beat) {
+            const timeT time = bar * barDuration +
+                    beat * crotchet.getDuration();
+            const int pitch = naturals[(bar * 3 + beat + staff) % 8];
+            if ((bar + beat + staff) % 3 == 0) {
+                segment->insert(quaver.getAsNoteEvent(time, pitch));
+                segment->insert(quaver.getAsNoteEvent
+                        (time + quaver.getDuration(), pitch + 2));
+            } else {
+                segment->insert(crotchet.getAsNoteEvent(time, pitch));
+            }
+        }
+    }
+
+    return segment;
+}
+
+/// Where the layout put the bar lines and every element.
+QStringList describe(NotationScene &scene)
+{
+    QStringList layout;
+
+    const NotationHLayout *hlayout = scene.getHLayout();
+    layout << QString("width %1").arg(hlayout->getTotalWidth());
+    for (int bar = hlayout->getFirstVisibleBar();
+         bar <= hlayout->getLastVisibleBar(); ++bar) {
+        layout << QString("bar %1 at %2")
+                .arg(bar).arg(hlayout->getBarPosition(bar));
+    }
+
+    std::vector<NotationStaff *> &staffs = *scene.getStaffs();
+    for (size_t i = 0; i < staffs.size(); ++i) {
+        ViewElementList *elements = staffs[i]->getViewElementList();
+        for (ViewElementList::iterator j = elements->begin();
+             j != elements->end(); ++j) {
+            layout << QString("staff %1: %2 %3 at %4, %5")
+                    .arg(i)
+                    .arg((*j)->getViewAbsoluteTime())
+                    .arg((*j)->event()->getType().c_str())
+                    .arg((*j)->getLayoutX())
+                    .arg((*j)->getLayoutY());
+        }
+    }
+
+    return layout;
+}
+
+}
+
+// Incremental notation layout: that after edits on one staff or several,
+// undone and redone, the layout is the same as laying the whole score
+// out afresh, that scanning the staffs on several threads gives the same
+// layout as one, and how long an edit takes to lay out compared with a
+// full layout, on one thread and several.
+class TestNotationLayout : public QObject
+{
+    Q_OBJECT
+
+public:
+    TestNotationLayout() :
+        m_doc(nullptr, {}, true /*skip autoload*/, true, false /*no sound*/),
+        m_barDuration(0)
+    {
+    }
+
+private Q_SLOTS:
+    void initTestCase();
+    void testEdits_data();
+    void testEdits();
+    void testThreads_data();
+    void testThreads();
+    void benchmarkEdit_data();
+    void benchmarkEdit();
+
+private:
+    /// A scene of the test segments, laid out from scratch.
+    QStringList fullLayout(StaffLayout::PageMode mode, int threads = 0);
+
+    /// A sharp, so wider than the notes already there.
+    Command *insertion(int staff, int bar);
+
+    RosegardenDocument m_doc;
+    std::vector<Segment *> m_segments;
+    timeT m_barDuration;
+};
+
+void TestNotationLayout::initTestCase()
+{
+    const QString input = QFINDTESTDATA("../data/examples/test_selection.rg");
+    QVERIFY(!input.isEmpty()); // file not found
+    m_doc.openDocument(input, false /*not permanent*/, true /*no progress dlg*/);
+
+    Composition &comp = m_doc.getComposition();
+    QVERIFY(!comp.getSegments().empty());
+    const Track *first =
+        comp.getTrackById((*comp.getSegments().begin())->getTrack());
+    QVERIFY(first);
+
+    m_barDuration = comp.getBarRange(0).second - comp.getBarRange(0).first;
+
+    for (int i = 0; i < Staffs; ++i) {
+        const TrackId id = comp.getNewTrackId();
+        comp.addTrack(new Track(id, first->getInstrument(),
+                                first->getPosition() + 1 + i));
+        Segment *segment = makeSegment(id, i, m_barDuration);
+        comp.addSegment(segment);
+        m_segments.push_back(segment);
+    }
+}
+
+QStringList TestNotationLayout::fullLayout(StaffLayout::PageMode mode,
+                                           int threads)
+{
+    NotationWidget widget;
+    widget.setSegments(&m_doc, m_segments);
+    NotationScene &scene = *widget.getScene();
+    scene.setLayoutThreadCount(threads);
+    scene.setPageMode(mode);
+    // Laid out again, with the threads asked for.
+    scene.resumeLayoutUpdates();
+    return describe(scene);
+}
+
+Command *TestNotationLayout::insertion(int staff, int bar)
+{
+    const Note crotchet(Note::Crotchet);
+    return new EventInsertionCommand
+        (*m_segments[staff],
+         crotchet.getAsNoteEvent(bar * m_barDuration + crotchet.getDuration(),
+                                 61));
+}
+
+void TestNotationLayout::testEdits_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::newRow("linear") << int(StaffLayout::LinearMode);
+    QTest::newRow("multi-page") << int(StaffLayout::MultiPageMode);
+}
+
+void TestNotationLayout::testEdits()
+{
+    QFETCH(int, mode);
+    const StaffLayout::PageMode pageMode = StaffLayout::PageMode(mode);
+
+    CommandHistory *history = CommandHistory::getInstance();
+    history->clear();
+
+    NotationWidget widget;
+    widget.setSegments(&m_doc, m_segments);
+    NotationScene &scene = *widget.getScene();
+    scene.setPageMode(pageMode);
+
+    const QStringList before = describe(scene);
+    QCOMPARE(before, fullLayout(pageMode));
+
+    // One staff: the bar gets wider and every later bar moves.
+    history->addCommand(insertion(2, 10));
+    QStringList after = describe(scene);
+    QVERIFY(after != before);
+    QCOMPARE(after, fullLayout(pageMode));
+
+    // Two staffs far apart, in one command.
+    MacroCommand *macro = new MacroCommand("Two staffs");
+    macro->addCommand(insertion(0, 3));
+    macro->addCommand(insertion(Staffs - 1, Bars - 5));
+    history->addCommand(macro);
+    QCOMPARE(describe(scene), fullLayout(pageMode));
+
+    // The first and last bars.
+    history->addCommand(insertion(Staffs / 2, 0));
+    history->addCommand(insertion(Staffs / 2, Bars - 1));
+    QCOMPARE(describe(scene), fullLayout(pageMode));
+
+    history->undo();
+    history->undo();
+    history->undo();
+    QCOMPARE(describe(scene), after);
+
+    history->redo();
+    QCOMPARE(describe(scene), fullLayout(pageMode));
+
+    history->undo();
+    history->undo();
+    QCOMPARE(describe(scene), before);
+
+    history->clear();
+}
+
+void TestNotationLayout::testThreads_data()
+{
+    testEdits_data();
+}
+
+void TestNotationLayout::testThreads()
+{
+    QFETCH(int, mode);
+    const StaffLayout::PageMode pageMode = StaffLayout::PageMode(mode);
+
+    // Fewer threads than staffs, so some scan more than one, and more,
+    // which leaves one staff to each.
+    const QStringList serial = fullLayout(pageMode, 1);
+    QCOMPARE(fullLayout(pageMode, 3), serial);
+    QCOMPARE(fullLayout(pageMode, Staffs * 2), serial);
+}
+
+void TestNotationLayout::benchmarkEdit_data()
+{
+    QTest::addColumn<bool>("full");
+    QTest::addColumn<int>("threads");
+    QTest::newRow("edit and undo") << false << 1;
+    QTest::newRow("two full layouts, 1 thread") << true << 1;
+    QTest::newRow("two full layouts, 4 threads") << true << 4;
+}
+
+void TestNotationLayout::benchmarkEdit()
+{
+    QFETCH(bool, full);
+    QFETCH(int, threads);
+
+    CommandHistory *history = CommandHistory::getInstance();
+    history->clear();
+
+    NotationWidget widget;
+    widget.setSegments(&m_doc, m_segments);
+    NotationScene &scene = *widget.getScene();
+    scene.setLayoutThreadCount(threads);
+
+    // An edit on two staffs, as a note entered in a pair of linked
+    // segments would be, and its undo: two layouts, against what
+    // laying out the whole score for each would cost.
+    QBENCHMARK {
+        if (full) {
+            scene.resumeLayoutUpdates();
+            scene.resumeLayoutUpdates();
+        } else {
+            MacroCommand *macro = new MacroCommand("Two staffs");
+            macro->addCommand(insertion(1, 20));
+            macro->addCommand(insertion(3, 40));
+            history->addCommand(macro);
+            history->undo();
+        }
+    }
+
+    history->clear();
+}
+
+QTEST_MAIN(TestNotationLayout)
+
+#include "notation_layout.moc"
@@ -0,0 +1,232 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/OfflineDriver.h"
+#include "sound/MappedEvent.h"
+#include "sound/MappedStudio.h"
+#include "sound/audiostream/AudioWriteStream.h"
+#include "base/Instrument.h"
+#include "base/RealTime.h"
+#include "TestWAV.h"
+
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const unsigned int SampleRate = 48000;
+const unsigned int Channels = 2;
+
+const int Instruments = 4;
+/// The first this many instruments go through a submaster, the rest
+/// straight to the master.
+const int SubmasterInstruments = 2;
+
+/// Each instrument plays a second, one after another, and then there
+/// is a second of nothing.
+const RealTime SessionLength(Instruments + 1, 0);
+
+/// Keeps what's rendered.
+class MemoryWriteStream : public AudioWriteStream
+{
+public:
+    MemoryWriteStream() :
+        AudioWriteStream(Target("", Channels, SampleRate))
+    {
+    }
+
+    bool putInterleavedFrames(size_t count, float *frames) override
+    {
+        samples.insert(samples.end(), frames, frames + count * Channels);
+        return true;
+    }
+
+    /// Whether every sample from start to end is zero.
+    bool isSilent(const RealTime &start, const RealTime &end) const
+    {
+        const size_t from = Channels *
+            (size_t)RealTime::realTime2Frame(start, SampleRate);
+        const size_t to = Channels *
+            (size_t)RealTime::realTime2Frame(end, SampleRate);
+        for (size_t i = from; i < to && i < samples.size(); ++i) {
+            if (samples[i] != 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    std::vector<float> samples;
+};
+
+/// A master, a submaster, a fader for each instrument and a file on
+/// each, as the sequencer would set them up for a document.
+bool setUp(MappedStudio &studio, OfflineDriver &driver, const QString &dir)
+{
+    MappedObject *masterBuss = studio.createObject(MappedObject::AudioBuss);
+    masterBuss->setProperty(MappedAudioBuss::BussId, 0);
+    MappedObject *submaster = studio.createObject(MappedObject::AudioBuss);
+    submaster->setProperty(MappedAudioBuss::BussId, 1);
+
+    std::vector<MappedEvent> events;
+
+    for (int i = 0; i < Instruments; ++i) {
+        MappedObject *fader = studio.createObject(MappedObject::AudioFader);
+        fader->setProperty(MappedObject::Instrument, AudioInstrumentBase + i);
+        studio.connectObjects(fader->getId(),
+                              i < SubmasterInstruments ?
+                                      submaster->getId() : masterBuss->getId());
+
+        const unsigned int audioId = i + 1;
+        const QString fileName = dir + QString("/render%1.wav").arg(audioId);
+        if (!writeTestWAV(fileName,
+                          makeTestSamples(audioId, SampleRate, Channels),
+                          Channels, SampleRate))
+            return false;
+        if (!driver.addAudioFile(fileName, audioId))
+            return false;
+        events.push_back(MappedEvent(AudioInstrumentBase + i, audioId,
+                                     RealTime(i, 0), RealTime(1, 0),
+                                     RealTime::zeroTime));
+    }
+
+    driver.initialiseAudioQueue(events);
+    return true;
+}
+
+}
+
+// OfflineDriver: that it renders a session through the submaster and
+// straight to the master, frame for frame the same each time and
+// whatever the number of mixing threads, and how much faster than
+// realtime it goes.
+class TestOfflineDriver : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRender();
+    void testRepeatable();
+    void testRenderToFile();
+    void benchmarkRender_data();
+    void benchmarkRender();
+};
+
+void TestOfflineDriver::testRender()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    MappedStudio studio;
+    OfflineDriver driver(&studio, SampleRate);
+    studio.setSoundDriver(&driver);
+    QVERIFY(setUp(studio, driver, dir.path()));
+
+    MemoryWriteStream stream;
+    QVERIFY(driver.render(RealTime::zeroTime, SessionLength, &stream));
+
+    const OfflineDriver::Statistics &statistics = driver.getStatistics();
+    const size_t frames =
+            (size_t)RealTime::realTime2Frame(SessionLength, SampleRate);
+    QCOMPARE(statistics.frames, frames);
+    QCOMPARE(stream.samples.size(), frames * Channels);
+    QCOMPARE(statistics.underruns, 0);
+    QVERIFY(statistics.peak > 0.0f);
+    QVERIFY(statistics.realtimeFactor > 0.0);
+
+    // Every instrument is heard, whether through the submaster or not,
+    // and nothing after the last file ends.
+    const RealTime margin(0, 100000000);
+    for (int i = 0; i < Instruments; ++i) {
+        QVERIFY2(!stream.isSilent(RealTime(i, 0) + margin,
+                                  RealTime(i + 1, 0) - margin),
+                 qPrintable(QString("instrument %1").arg(i)));
+    }
+    QVERIFY(stream.isSilent(RealTime(Instruments, 0) + margin,
+                            SessionLength));
+}
+
+void TestOfflineDriver::testRepeatable()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    MappedStudio studio;
+    OfflineDriver driver(&studio, SampleRate);
+    studio.setSoundDriver(&driver);
+    QVERIFY(setUp(studio, driver, dir.path()));
+
+    MemoryWriteStream first;
+    QVERIFY(driver.render(RealTime::zeroTime, SessionLength, &first));
+
+    MemoryWriteStream second;
+    QVERIFY(driver.render(RealTime::zeroTime, SessionLength, &second));
+    QVERIFY(first.samples == second.samples);
+
+    driver.setThreadCount(3);
+    MemoryWriteStream threaded;
+    QVERIFY(driver.render(RealTime::zeroTime, SessionLength, &threaded));
+    QVERIFY(first.samples == threaded.samples);
+}
+
+void TestOfflineDriver::testRenderToFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    MappedStudio studio;
+    OfflineDriver driver(&studio, SampleRate);
+    studio.setSoundDriver(&driver);
+    QVERIFY(setUp(studio, driver, dir.path()));
+
+    const QString fileName = dir.path() + "/mix.wav";
+    QVERIFY(driver.render(RealTime::zeroTime, SessionLength, fileName));
+
+    // At least 16 bits a sample, after the header.
+    QFileInfo info(fileName);
+    QVERIFY(info.exists());
+    QVERIFY(info.size() > qint64(driver.getStatistics().frames * Channels * 2));
+
+    // Not a stream we can write.
+    MemoryWriteStream stream;
+    OfflineDriver other(&studio, SampleRate / 2);
+    QVERIFY(!other.render(RealTime::zeroTime, SessionLength, &stream));
+}
+
+void TestOfflineDriver::benchmarkRender_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("3 threads") << 3;
+}
+
+void TestOfflineDriver::benchmarkRender()
+{
+    QFETCH(int, threads);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    MappedStudio studio;
+    OfflineDriver driver(&studio, SampleRate);
+    studio.setSoundDriver(&driver);
+    driver.setThreadCount(threads);
+    QVERIFY(setUp(studio, driver, dir.path()));
+
+    QBENCHMARK {
+        MemoryWriteStream stream;
+        QVERIFY(driver.render(RealTime::zeroTime, SessionLength, &stream));
+    }
+
+    qDebug("Realtime factor %.1f", driver.getStatistics().realtimeFactor);
+    QVERIFY(driver.getStatistics().realtimeFactor > 1.0);
+}
+
+QTEST_MAIN(TestOfflineDriver)
+
+#include "offline_driver.moc"
@@ -0,0 +1,279 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/PeakFile.h"
+#include "sound/WAVAudioFile.h"
+#include "base/RealTime.h"
+#include "TestWAV.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const unsigned int SampleRate = 48000;
+const int Channels = 2;
+const int BlockSize = 256;
+const int LevelFactor = 8;
+const float Divisor = 32767.0f;
+
+/// Half-second sections, one in seven loud and the rest near silent,
+/// with a little negative DC so that some quiet highs are below zero.
+std::vector<short> makeSamples(size_t frames)
+{
+    std::vector<short> samples(frames * Channels);
+    unsigned int x = 1;
+    for (size_t i = 0; i < frames; ++i) {
+        const bool loud = ((i / (SampleRate / 2)) % 7 == 3);
+        for (int ch = 0; ch < Channels; ++ch) {
+            x = x * 1103515245 + 12345;
+            const int noise = int((x >> 16) % 2001) - 1000;
+            samples[i * Channels + ch] =
+                short(loud ? noise * 30 : noise / 20 - 60);
+        }
+    }
+    return samples;
+}
+
+WAVAudioFile *makeWAV(const QString &fileName, const std::vector<short> &samples)
+{
+    if (!writeTestWAV(fileName, samples, Channels, SampleRate))
+        return nullptr;
+    return openTestWAV(fileName, 0);
+}
+
+/// Highest and lowest sample of a channel over [from, to).
+void range(const std::vector<short> &samples, size_t from, size_t to, int ch,
+           int &high, int &low)
+{
+    high = low = samples[from * Channels + ch];
+    for (size_t i = from; i < to; ++i) {
+        high = std::max(high, int(samples[i * Channels + ch]));
+        low = std::min(low, int(samples[i * Channels + ch]));
+    }
+}
+
+/// The preview of the whole file, worked out straight from the
+/// samples at the level getPreview() should pick: the coarsest with a
+/// peak or more per pixel.
+std::vector<float> expectedPreview(const std::vector<short> &samples,
+                                   int width)
+{
+    const size_t frames = samples.size() / Channels;
+    const int blocks = int(frames / BlockSize);
+
+    std::vector<int> levelPeaks(1, blocks);
+    while (levelPeaks.back() >= LevelFactor)
+        levelPeaks.push_back((levelPeaks.back() + LevelFactor - 1) / LevelFactor);
+
+    int level = 0;
+    int span = 1;
+    double peaksPerPixel = double(blocks) / double(width);
+    while (level + 1 < int(levelPeaks.size()) && peaksPerPixel >= LevelFactor) {
+        ++level;
+        span *= LevelFactor;
+        peaksPerPixel /= LevelFactor;
+    }
+
+    const int endPeak = int(frames / (BlockSize * span));
+    const double step = double(endPeak) / double(width);
+
+    std::vector<float> preview;
+
+    for (int i = 0; i < width; ++i) {
+        const int first = int(double(i) * step);
+        const int last = std::min(int(double(i + 1) * step), levelPeaks[level]);
+
+        for (int ch = 0; ch < Channels; ++ch) {
+            int high = 0, low = 0;
+            if (first < last) {
+                range(samples,
+                      size_t(first) * span * BlockSize,
+                      std::min(size_t(last) * span * BlockSize,
+                               size_t(blocks) * BlockSize),
+                      ch, high, low);
+            }
+            preview.push_back(std::max(std::fabs(float(high) / Divisor),
+                                       std::fabs(float(low) / Divisor)));
+        }
+    }
+
+    return preview;
+}
+
+RealTime frameToTime(size_t frame)
+{
+    return RealTime::frame2RealTime(frame, SampleRate);
+}
+
+}
+
+// PeakFile's levels give the same previews as working them out from
+// the samples, and skipping through them for split points gives the
+// same points as going a block at a time.
+class TestPeakFile : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void testPreview_data();
+    void testPreview();
+    void testSplitPoints_data();
+    void testSplitPoints();
+    void benchmarkWrite();
+
+private:
+    void addFiles();
+
+    QTemporaryDir m_dir;
+    // Short enough for PeakFile to keep in memory, and not.
+    std::vector<short> m_samples[2];
+    WAVAudioFile *m_files[2];
+    PeakFile *m_peakFiles[2];
+};
+
+void TestPeakFile::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    const int seconds[2] = { 10, 180 };
+
+    for (int n = 0; n < 2; ++n) {
+        m_samples[n] = makeSamples(SampleRate * seconds[n]);
+        m_files[n] = makeWAV(m_dir.path() + QString("/%1.wav").arg(n),
+                             m_samples[n]);
+        QVERIFY(m_files[n]);
+
+        m_peakFiles[n] = new PeakFile(m_files[n]);
+        QVERIFY(m_peakFiles[n]->write());
+        m_peakFiles[n]->close();
+        QVERIFY(m_peakFiles[n]->open());
+    }
+}
+
+void TestPeakFile::cleanupTestCase()
+{
+    for (int n = 0; n < 2; ++n) {
+        delete m_peakFiles[n];
+        delete m_files[n];
+    }
+}
+
+void TestPeakFile::addFiles()
+{
+    QTest::addColumn<int>("file");
+    QTest::newRow("cached") << 0;
+    QTest::newRow("uncached") << 1;
+}
+
+void TestPeakFile::testPreview_data()
+{
+    addFiles();
+}
+
+void TestPeakFile::testPreview()
+{
+    QFETCH(int, file);
+
+    const std::vector<short> &samples = m_samples[file];
+    const RealTime end = frameToTime(samples.size() / Channels);
+    const int blocks = int(samples.size() / Channels / BlockSize);
+
+    // From a pixel per block, through each level, to a handful of
+    // pixels for the whole file.
+    const int widths[] = { blocks, blocks / 3, blocks / 8, blocks / 50,
+                           blocks / 64, 700, 100, 7 };
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+        const std::vector<float> preview =
+            m_peakFiles[file]->getPreview(RealTime::zeroTime, end,
+                                          widths[w], false);
+        QVERIFY(preview == expectedPreview(samples, widths[w]));
+    }
+}
+
+void TestPeakFile::testSplitPoints_data()
+{
+    addFiles();
+}
+
+void TestPeakFile::testSplitPoints()
+{
+    QFETCH(int, file);
+
+    const std::vector<short> &samples = m_samples[file];
+    const int blocks = int(samples.size() / Channels / BlockSize);
+    const RealTime minLength(0, 200000000);
+    const int threshold = 10;
+
+    // A block at a time, as getSplitPoints() used to.
+    std::vector<SplitPointPair> expected;
+    bool belowThreshold = true;
+    bool inSplit = false;
+    RealTime startSplit;
+    for (int i = 0; i < blocks; ++i) {
+        float value = 0.0;
+        for (int ch = 0; ch < Channels; ++ch) {
+            int high, low;
+            range(samples, size_t(i) * BlockSize, size_t(i + 1) * BlockSize,
+                  ch, high, low);
+            value += std::fabs(float(high) / Divisor);
+        }
+        value /= float(Channels);
+
+        const RealTime time = frameToTime(size_t(i) * BlockSize);
+        if (belowThreshold) {
+            if (value > float(threshold) / 100.0) {
+                startSplit = time;
+                inSplit = true;
+                belowThreshold = false;
+            }
+        } else if (value < float(threshold) / 100.0 &&
+                   time - startSplit > minLength) {
+            expected.push_back(SplitPointPair(startSplit, time));
+            inSplit = false;
+            belowThreshold = true;
+        }
+    }
+    if (inSplit)
+        expected.push_back(SplitPointPair(startSplit,
+                                          frameToTime(size_t(blocks) * BlockSize)));
+
+    const std::vector<SplitPointPair> points =
+        m_peakFiles[file]->getSplitPoints(
+                RealTime::zeroTime,
+                frameToTime(size_t(blocks) * BlockSize),
+                threshold, minLength);
+
+    QVERIFY(!points.empty());
+    QCOMPARE(points.size(), expected.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        // PeakFile rounds block times to the microsecond.
+        QVERIFY(std::fabs((points[i].first - expected[i].first).toSeconds()) < 2e-6);
+        QVERIFY(std::fabs((points[i].second - expected[i].second).toSeconds()) < 2e-6);
+    }
+}
+
+void TestPeakFile::benchmarkWrite()
+{
+    PeakFile peakFile(m_files[1]);
+
+    QBENCHMARK {
+        QVERIFY(peakFile.write());
+        peakFile.close();
+    }
+}
+
+QTEST_MAIN(TestPeakFile)
+
+#include "peak_file.moc"
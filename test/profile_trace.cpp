@@ -0,0 +1,205 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Profiler.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QThread>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+// Records nested scopes as fast as it can, as a busy audio thread might.
+class RecordingThread : public QThread
+{
+public:
+    explicit RecordingThread(int scopes) : m_scopes(scopes) { }
+
+protected:
+    void run() override
+    {
+        for (int i = 0; i < m_scopes; ++i) {
+            ProfileTrace::Scope outer("outer");
+            ProfileTrace::Scope inner("inner \"quoted\"");
+        }
+    }
+
+private:
+    int m_scopes;
+};
+
+}
+
+// ProfileTrace: records from several threads at once end up in the
+// exported Chrome trace, with each thread's most recent records kept,
+// and buffers are reused once their threads have exited.
+class TestProfileTrace : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testNotRecording();
+    void testThreads();
+    void testRingBuffer();
+    void testThreadBuffersReused();
+    void benchmarkScope_data();
+    void benchmarkScope();
+
+private:
+    /// The events of the given phase in the exported trace.  "X" are
+    /// complete events, "M" are metadata such as thread names.
+    QJsonArray exportEvents(const QString &phase = "X");
+
+    QTemporaryDir m_dir;
+};
+
+QJsonArray TestProfileTrace::exportEvents(const QString &phase)
+{
+    const QString fileName = m_dir.path() + "/trace.json";
+    if (!ProfileTrace::exportChromeTrace(fileName))
+        return QJsonArray();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QJsonArray();
+
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll());
+    const QJsonArray all = document.object().value("traceEvents").toArray();
+
+    QJsonArray events;
+    for (int i = 0; i < all.size(); ++i) {
+        if (all[i].toObject().value("ph").toString() == phase)
+            events.append(all[i]);
+    }
+    return events;
+}
+
+void TestProfileTrace::testNotRecording()
+{
+    ProfileTrace::start();
+    ProfileTrace::stop();
+
+    {
+        ProfileTrace::Scope scope("not recorded");
+        Profiler profiler("not recorded either");
+    }
+
+    QVERIFY(exportEvents().isEmpty());
+}
+
+void TestProfileTrace::testThreads()
+{
+    const int threadCount = 4;
+    const int scopes = 1000;
+
+    ProfileTrace::start();
+
+    RecordingThread *threads[threadCount];
+    for (int t = 0; t < threadCount; ++t) {
+        threads[t] = new RecordingThread(scopes);
+        threads[t]->start();
+    }
+    for (int t = 0; t < threadCount; ++t) {
+        threads[t]->wait();
+        delete threads[t];
+    }
+
+    {
+        Profiler profiler("main thread");
+    }
+
+    ProfileTrace::stop();
+
+    const QJsonArray events = exportEvents();
+    QCOMPARE(events.size(), threadCount * scopes * 2 + 1);
+
+    QSet<int> tids;
+    int inner = 0;
+    for (int i = 0; i < events.size(); ++i) {
+        const QJsonObject event = events[i].toObject();
+        tids.insert(event.value("tid").toInt());
+        QVERIFY(event.value("dur").toDouble() >= 0);
+        if (event.value("name").toString() == "inner \"quoted\"")
+            ++inner;
+    }
+    QCOMPARE(tids.size(), threadCount + 1);
+    QCOMPARE(inner, threadCount * scopes);
+}
+
+void TestProfileTrace::testRingBuffer()
+{
+    ProfileTrace::start();
+
+    RecordingThread thread(ProfileTrace::RecordsPerThread * 2);
+    thread.start();
+    thread.wait();
+
+    ProfileTrace::stop();
+
+    // Only the most recent records are kept.
+    QCOMPARE(exportEvents().size(), int(ProfileTrace::RecordsPerThread));
+}
+
+void TestProfileTrace::testThreadBuffersReused()
+{
+    ProfileTrace::start();
+
+    // Many more threads than there are buffers, one after another.
+    // Each one's buffer goes back to the pool when it exits.
+    const int threadCount = ProfileTrace::MaxThreads * 3;
+    for (int t = 0; t < threadCount; ++t) {
+        RecordingThread thread(10);
+        if (t == threadCount - 1)
+            thread.setObjectName("last recorder");
+        thread.start();
+        thread.wait();
+    }
+
+    ProfileTrace::stop();
+
+    // The last thread still got a buffer.
+    const QJsonArray threads = exportEvents("M");
+    bool found = false;
+    for (int i = 0; i < threads.size(); ++i) {
+        const QJsonObject args =
+                threads[i].toObject().value("args").toObject();
+        if (args.value("name").toString() == "last recorder")
+            found = true;
+    }
+    QVERIFY(found);
+    QVERIFY(threads.size() <= ProfileTrace::MaxThreads);
+}
+
+void TestProfileTrace::benchmarkScope_data()
+{
+    QTest::addColumn<bool>("recording");
+    QTest::newRow("not recording") << false;
+    QTest::newRow("recording") << true;
+}
+
+void TestProfileTrace::benchmarkScope()
+{
+    QFETCH(bool, recording);
+
+    if (recording)
+        ProfileTrace::start();
+
+    QBENCHMARK {
+        for (int i = 0; i < 100000; ++i)
+            ProfileTrace::Scope scope("benchmark");
+    }
+
+    ProfileTrace::stop();
+}
+
+QTEST_MAIN(TestProfileTrace)
+
+#include "profile_trace.moc"
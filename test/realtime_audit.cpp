@@ -0,0 +1,346 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "sound/RealtimeAudit.h"
+#include "sound/AudioProcess.h"
+#include "sound/DummyDriver.h"
+#include "sound/MappedEvent.h"
+#include "sound/MappedStudio.h"
+#include "sound/RingBuffer.h"
+#include "base/Instrument.h"
+#include "base/RealTime.h"
+#include "TestWAV.h"
+
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <vector>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+const unsigned int SampleRate = 48000;
+const unsigned int Channels = 2;
+const size_t BlockFrames = 256;
+
+const int Instruments = 4;
+/// The first this many instruments go through a submaster, the rest
+/// straight to the master.
+const int SubmasterInstruments = 2;
+
+/// A driver whose clock only moves when the test says so.
+class SoakDriver : public DummyDriver
+{
+public:
+    SoakDriver(MappedStudio *studio) :
+        DummyDriver(studio),
+        m_now(RealTime::zeroTime)
+    {
+    }
+
+    unsigned int getSampleRate() const override  { return SampleRate; }
+
+    RealTime getSequencerTime() override  { return m_now; }
+    void setSequencerTime(const RealTime &t)  { m_now = t; }
+
+    void getAudioInstrumentNumbers(InstrumentId &base, int &count) override
+        { base = AudioInstrumentBase; count = Instruments; }
+    void getSoftSynthInstrumentNumbers(InstrumentId &base, int &count) override
+        { base = SoftSynthInstrumentBase; count = 0; }
+
+private:
+    RealTime m_now;
+};
+
+/// What the JACK process callback does with the mixers' output, less
+/// the JACK ports: kick the mixers, then read every buss and instrument
+/// and add up the master.
+struct ProcessCallback
+{
+    ProcessCallback(AudioInstrumentMixer &instrumentMixer,
+                    AudioBussMixer &bussMixer) :
+        instrumentMixer(instrumentMixer),
+        bussMixer(bussMixer),
+        scratch(BlockFrames),
+        master(BlockFrames),
+        peak(0.0f)
+    {
+    }
+
+    void operator()()
+    {
+        if (instrumentMixer.tryLock() == 0) {
+            instrumentMixer.kick(false);
+            instrumentMixer.releaseLock();
+        }
+        if (bussMixer.tryLock() == 0) {
+            bussMixer.kick(false, false);
+            bussMixer.releaseLock();
+        }
+
+        std::fill(master.begin(), master.end(), 0.0f);
+
+        for (int buss = 0; buss < bussMixer.getBussCount(); ++buss) {
+            for (unsigned int ch = 0; ch < 2; ++ch) {
+                RingBuffer<AudioBussMixer::sample_t> *rb =
+                        bussMixer.getRingBuffer(buss, ch);
+                if (!rb)
+                    continue;
+                if (bussMixer.isBussDormant(buss)) {
+                    rb->skip(BlockFrames);
+                } else {
+                    rb->read(&scratch[0], BlockFrames);
+                    add();
+                }
+            }
+        }
+
+        for (int i = 0; i < Instruments; ++i) {
+            const InstrumentId id = AudioInstrumentBase + i;
+            if (instrumentMixer.isInstrumentEmpty(id))
+                continue;
+
+            const bool directToMaster = (i >= SubmasterInstruments);
+
+            for (unsigned int ch = 0; ch < 2; ++ch) {
+                RingBuffer<AudioInstrumentMixer::sample_t, 2> *rb =
+                        instrumentMixer.getRingBuffer(id, ch);
+                if (!rb)
+                    continue;
+                if (instrumentMixer.isInstrumentDormant(id)) {
+                    rb->skip(BlockFrames);
+                } else {
+                    rb->read(&scratch[0], BlockFrames);
+                    if (directToMaster)
+                        add();
+                }
+                // The buss mixer's reader, which it doesn't use for
+                // instruments that aren't on a buss.
+                if (directToMaster)
+                    rb->skip(BlockFrames, 1);
+            }
+        }
+
+        for (size_t f = 0; f < BlockFrames; ++f) {
+            if (master[f] > peak)
+                peak = master[f];
+        }
+    }
+
+    void add()
+    {
+        for (size_t f = 0; f < BlockFrames; ++f)
+            master[f] += scratch[f];
+    }
+
+    AudioInstrumentMixer &instrumentMixer;
+    AudioBussMixer &bussMixer;
+    std::vector<float> scratch;
+    std::vector<float> master;
+    float peak;
+};
+
+// Defeat the optimiser, which may otherwise drop a malloc() and free()
+// pair that does nothing.
+void *volatile g_pointer = nullptr;
+
+}
+
+// RealtimeAudit: that it catches allocation, locking and file I/O on a
+// realtime thread and nothing outside one, and a soak test that plays a
+// session through the instrument and buss mixers, as the JACK process
+// callback would but off a fake clock, and fails on any violation.
+class TestRealtimeAudit : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testCatchesViolations();
+    void soakMixer_data();
+    void soakMixer();
+};
+
+void TestRealtimeAudit::initTestCase()
+{
+    RealtimeAudit::initialise();
+}
+
+void TestRealtimeAudit::testCatchesViolations()
+{
+    if (!RealtimeAudit::isEnabled())
+        QSKIP("Not built with USE_RT_AUDIT");
+
+    RealtimeAudit::reset();
+
+    // Not on a realtime thread, so none of this counts.
+    g_pointer = malloc(64);
+    free(g_pointer);
+    QVERIFY(!RealtimeAudit::isRealtime());
+    QCOMPARE(RealtimeAudit::getViolationCount(), 0);
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    bool realtime = false;
+    int afterTryLock = -1;
+
+    // No QVERIFY or QCOMPARE in here, as they may allocate.
+    {
+        RealtimeAudit::Scope scope;
+        realtime = RealtimeAudit::isRealtime();
+
+        // Trying a lock is fine.
+        if (pthread_mutex_trylock(&mutex) == 0)
+            pthread_mutex_unlock(&mutex);
+        afterTryLock = RealtimeAudit::getViolationCount();
+
+        g_pointer = malloc(64);
+        free(g_pointer);
+        pthread_mutex_lock(&mutex);
+        pthread_mutex_unlock(&mutex);
+        FILE *file = fopen("/dev/null", "r");
+        if (file)
+            fclose(file);
+    }
+
+    QVERIFY(realtime);
+    QCOMPARE(afterTryLock, 0);
+    QVERIFY(!RealtimeAudit::isRealtime());
+    QVERIFY(RealtimeAudit::getViolationCount() >= 4);
+
+    const QString report = RealtimeAudit::getReport();
+    QVERIFY(report.contains("allocation on a realtime thread"));
+    QVERIFY(report.contains("deallocation on a realtime thread"));
+    QVERIFY(report.contains("mutex lock on a realtime thread"));
+    QVERIFY(report.contains("file I/O on a realtime thread"));
+
+    RealtimeAudit::reset();
+    QCOMPARE(RealtimeAudit::getViolationCount(), 0);
+    QVERIFY(RealtimeAudit::getReport().isEmpty());
+}
+
+void TestRealtimeAudit::soakMixer_data()
+{
+    QTest::addColumn<int>("threads");
+    QTest::newRow("1 thread") << 1;
+    QTest::newRow("3 threads") << 3;
+}
+
+void TestRealtimeAudit::soakMixer()
+{
+    QFETCH(int, threads);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    MappedStudio studio;
+    SoakDriver driver(&studio);
+    studio.setSoundDriver(&driver);
+
+    // Read a second ahead, and count files under 64k as small, so that
+    // both the ring buffer and the small file cache paths are played.
+    driver.setAudioBufferSizes(RealTime(0, 100000000), RealTime(1, 0),
+                               RealTime(1, 0), 64);
+
+    // A master and one submaster.
+    MappedObject *masterBuss = studio.createObject(MappedObject::AudioBuss);
+    masterBuss->setProperty(MappedAudioBuss::BussId, 0);
+    MappedObject *submaster = studio.createObject(MappedObject::AudioBuss);
+    submaster->setProperty(MappedAudioBuss::BussId, 1);
+
+    for (int i = 0; i < Instruments; ++i) {
+        MappedObject *fader = studio.createObject(MappedObject::AudioFader);
+        fader->setProperty(MappedObject::Instrument, AudioInstrumentBase + i);
+        studio.connectObjects(fader->getId(),
+                              i < SubmasterInstruments ?
+                                      submaster->getId() : masterBuss->getId());
+    }
+
+    // On each instrument, a file every two seconds, alternately long
+    // (1.5s, played from ring buffers) and short (0.25s, played from
+    // the small file cache).
+    const RealTime passLength(12, 0);
+    std::vector<MappedEvent> events;
+    unsigned int audioId = 1;
+
+    for (int i = 0; i < Instruments; ++i) {
+        for (int start = i % 2; start < passLength.sec - 1; start += 2) {
+            const bool small = ((start / 2) % 2 == 1);
+            const RealTime duration = small ? RealTime(0, 250000000) :
+                                              RealTime(1, 500000000);
+            const QString fileName =
+                    dir.filePath(QString("soak%1.wav").arg(audioId));
+            const size_t frames =
+                    (size_t)RealTime::realTime2Frame(duration, SampleRate);
+            QVERIFY(writeTestWAV(fileName,
+                                 makeTestSamples(audioId, frames, Channels),
+                                 Channels, SampleRate));
+            QVERIFY(driver.addAudioFile(fileName, audioId));
+            events.push_back(MappedEvent(AudioInstrumentBase + i, audioId,
+                                         RealTime(start, 0), duration,
+                                         RealTime::zeroTime));
+            ++audioId;
+        }
+    }
+
+    driver.initialiseAudioQueue(events);
+
+    AudioFileReader reader(&driver, SampleRate);
+    AudioInstrumentMixer instrumentMixer(&driver, &reader,
+                                         SampleRate, BlockFrames);
+    AudioBussMixer bussMixer(&driver, &instrumentMixer,
+                             SampleRate, BlockFrames);
+    instrumentMixer.setBussMixer(&bussMixer);
+    instrumentMixer.setThreadCount(threads);
+    bussMixer.updateInstrumentConnections();
+    QCOMPARE(bussMixer.getBussCount(), 1);
+
+    ProcessCallback process(instrumentMixer, bussMixer);
+
+    const RealTime blockDuration =
+            RealTime::frame2RealTime(BlockFrames, SampleRate);
+
+    RealtimeAudit::reset();
+
+    // Play the session through three times, prebuffering from the
+    // start each time as the driver does when playback starts.
+    for (int pass = 0; pass < 3; ++pass) {
+
+        driver.setSequencerTime(RealTime::zeroTime);
+        reader.fillBuffers(RealTime::zeroTime);
+        bussMixer.fillBuffers(RealTime::zeroTime);
+
+        for (size_t block = 0;
+             driver.getSequencerTime() < passLength; ++block) {
+
+            // The file reader thread, a few times per block's worth
+            // of the read buffer.
+            if (block % 4 == 0)
+                reader.kick(false);
+
+            {
+                RealtimeAudit::Scope realtime;
+                process();
+            }
+
+            driver.setSequencerTime(driver.getSequencerTime() +
+                                    blockDuration);
+        }
+    }
+
+    QVERIFY2(RealtimeAudit::getViolationCount() == 0,
+             qPrintable(RealtimeAudit::getReport()));
+
+    // And it did play something.
+    QVERIFY(process.peak > 0.0f);
+}
+
+QTEST_MAIN(TestRealtimeAudit)
+
+#include "realtime_audit.moc"
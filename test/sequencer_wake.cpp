@@ -0,0 +1,132 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/RealTime.h"
+#include "sound/DummyDriver.h"
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QTest>
+#include <QThread>
+
+#include <algorithm>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+// Stands in for SequencerThread: sleeps in the driver until it sees a
+// transport change, then notes how long that took to be noticed.
+class TransportThread : public QThread
+{
+public:
+    TransportThread(SoundDriver &driver, const RealTime &sleepTime) :
+        m_driver(driver),
+        m_sleepTime(sleepTime),
+        m_latencyNsec(0)
+    {
+    }
+
+    /// Like RosegardenSequencer::play().
+    void play(bool wake)
+    {
+        m_timer.start();
+        m_playing.storeRelease(1);
+        if (wake)
+            m_driver.wake();
+    }
+
+    qint64 getLatencyNsec() const  { return m_latencyNsec; }
+
+protected:
+    void run() override
+    {
+        while (!m_playing.loadAcquire())
+            m_driver.sleep(m_sleepTime);
+        m_latencyNsec = m_timer.nsecsElapsed();
+    }
+
+private:
+    SoundDriver &m_driver;
+    RealTime m_sleepTime;
+    QAtomicInt m_playing;
+    QElapsedTimer m_timer;
+    qint64 m_latencyNsec;
+};
+
+}
+
+// Transport-start latency with the DummyDriver: how long the sequencer
+// thread takes to notice play() with wake-on-demand, compared with the
+// 10msec poll it used to do.
+class TestSequencerWake : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testWakeBeforeSleep();
+    void testStartLatency();
+
+private:
+    /// Maximum latency in msecs over a number of transport starts.
+    double measureLatency(const RealTime &sleepTime, bool wake);
+};
+
+double TestSequencerWake::measureLatency(const RealTime &sleepTime, bool wake)
+{
+    DummyDriver driver(nullptr);
+
+    qint64 total = 0;
+    qint64 worst = 0;
+    const int runs = 20;
+
+    for (int i = 0; i < runs; ++i) {
+        TransportThread thread(driver, sleepTime);
+        thread.start();
+        // Press play at some random point in the thread's sleep.
+        QThread::usleep(3000 + (i * 7919) % 10000);
+        thread.play(wake);
+        thread.wait();
+        total += thread.getLatencyNsec();
+        worst = std::max(worst, thread.getLatencyNsec());
+    }
+
+    qDebug("  %s: mean %.3f msecs, worst %.3f msecs",
+           wake ? "wake-on-demand, 1sec sleep" : "10msec poll",
+           total / runs / 1000000.0, worst / 1000000.0);
+
+    return worst / 1000000.0;
+}
+
+void TestSequencerWake::testWakeBeforeSleep()
+{
+    // A wake() that arrives while the thread is busy must cut short
+    // the next sleep() rather than be lost.
+    DummyDriver driver(nullptr);
+    driver.wake();
+
+    QElapsedTimer timer;
+    timer.start();
+    driver.sleep(RealTime(5, 0));
+    QVERIFY(timer.elapsed() < 1000);
+
+    // ...but only that one.
+    timer.start();
+    driver.sleep(RealTime::fromMilliseconds(50));
+    QVERIFY(timer.elapsed() >= 40);
+}
+
+void TestSequencerWake::testStartLatency()
+{
+    measureLatency(RealTime::fromMilliseconds(10), false);
+
+    // Even though the thread would otherwise sleep for a whole second,
+    // play() gets through straight away.
+    const double worst = measureLatency(RealTime(1, 0), true);
+    QVERIFY(worst < 100);
+}
+
+QTEST_MAIN(TestSequencerWake)
+
+#include "sequencer_wake.moc"
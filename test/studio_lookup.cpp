@@ -0,0 +1,223 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+//
+
+#include "base/Studio.h"
+#include "base/Device.h"
+#include "base/Instrument.h"
+
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+/// A big MIDI rig: 64 ports of 16 channels each.
+const int MidiDevices = 64;
+
+void addMidiDevices(Studio &studio, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        InstrumentId base;
+        const DeviceId id = studio.getSpareDeviceId(base);
+        studio.addDevice(QString("port %1").arg(i).toStdString(),
+                         id, base, Device::Midi);
+    }
+}
+
+/// What getInstrumentById() used to do.
+Instrument *scanForInstrument(Studio &studio, InstrumentId id)
+{
+    DeviceList *devices = studio.getDevices();
+    for (DeviceList::iterator it = devices->begin();
+         it != devices->end(); ++it) {
+        InstrumentList list = (*it)->getAllInstruments();
+        for (InstrumentList::iterator iit = list.begin();
+             iit != list.end(); ++iit) {
+            if ((*iit)->getId() == id)
+                return *iit;
+        }
+    }
+    return nullptr;
+}
+
+/// Every instrument ID in the studio.
+std::vector<InstrumentId> instrumentIds(Studio &studio)
+{
+    std::vector<InstrumentId> ids;
+    const InstrumentList list = studio.getAllInstruments();
+    for (InstrumentList::const_iterator it = list.begin();
+         it != list.end(); ++it) {
+        ids.push_back((*it)->getId());
+    }
+    return ids;
+}
+
+}
+
+// Studio's indices: that lookups by ID find what a search of every
+// device does as devices come and go, and how long looking up every
+// instrument in a 64-port studio takes with the index and without.
+class TestStudioLookup : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testInstruments();
+    void testDevices();
+    void testRemoveAndClear();
+    void testBusses();
+    void benchmarkInstrumentById();
+    void benchmarkInstrumentScan();
+};
+
+void TestStudioLookup::testInstruments()
+{
+    Studio studio;
+    addMidiDevices(studio, MidiDevices);
+
+    const std::vector<InstrumentId> ids = instrumentIds(studio);
+    QVERIFY(ids.size() >= size_t(MidiDevices * 16));
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        Instrument *instrument = studio.getInstrumentById(ids[i]);
+        QVERIFY(instrument);
+        QCOMPARE(instrument->getId(), ids[i]);
+        QCOMPARE(instrument, scanForInstrument(studio, ids[i]));
+    }
+
+    // Below the first device, and between the first and second.
+    QVERIFY(!studio.getInstrumentById(MidiInstrumentBase - 1));
+    QVERIFY(!studio.getInstrumentById(MidiInstrumentBase + 20));
+
+    // The audio and synth devices the studio always has.
+    QVERIFY(studio.getInstrumentById(AudioInstrumentBase));
+    QVERIFY(studio.getInstrumentById(SoftSynthInstrumentBase));
+    QVERIFY(studio.getContainerById(AudioInstrumentBase));
+}
+
+void TestStudioLookup::testDevices()
+{
+    Studio studio;
+    addMidiDevices(studio, MidiDevices);
+
+    DeviceList *devices = studio.getDevices();
+    for (DeviceList::iterator it = devices->begin();
+         it != devices->end(); ++it) {
+        QCOMPARE(studio.getDevice((*it)->getId()), *it);
+
+        // Each device's instruments are found on it.
+        InstrumentList list = (*it)->getAllInstruments();
+        for (InstrumentList::iterator iit = list.begin();
+             iit != list.end(); ++iit) {
+            QCOMPARE(studio.getInstrumentById((*iit)->getId())->getDevice(),
+                     *it);
+        }
+    }
+
+    QVERIFY(!studio.getDevice(DeviceId(MidiDevices)));
+    QVERIFY(studio.getDevice(AudioInstrumentBase));
+    QVERIFY(studio.getDevice(SoftSynthInstrumentBase));
+}
+
+void TestStudioLookup::testRemoveAndClear()
+{
+    Studio studio;
+    addMidiDevices(studio, 4);
+
+    DeviceList *devices = studio.getDevices();
+    Device *gone = nullptr;
+    for (DeviceList::iterator it = devices->begin();
+         it != devices->end(); ++it) {
+        if ((*it)->getType() == Device::Midi) {
+            gone = *it;
+            break;
+        }
+    }
+    QVERIFY(gone);
+
+    const DeviceId goneId = gone->getId();
+    const InstrumentList goneInstruments = gone->getAllInstruments();
+    std::vector<InstrumentId> goneIds;
+    for (size_t i = 0; i < goneInstruments.size(); ++i)
+        goneIds.push_back(goneInstruments[i]->getId());
+
+    studio.removeDevice(goneId);
+
+    QVERIFY(!studio.getDevice(goneId));
+    for (size_t i = 0; i < goneIds.size(); ++i)
+        QVERIFY(!studio.getInstrumentById(goneIds[i]));
+
+    // Everything else is still there.
+    const std::vector<InstrumentId> ids = instrumentIds(studio);
+    for (size_t i = 0; i < ids.size(); ++i)
+        QCOMPARE(studio.getInstrumentById(ids[i]),
+                 scanForInstrument(studio, ids[i]));
+
+    // The spare ID is reused, and the new device's instruments found.
+    addMidiDevices(studio, 1);
+    Device *added = studio.getDevice(goneId);
+    QVERIFY(added);
+    const InstrumentId addedId = added->getAllInstruments()[0]->getId();
+    QCOMPARE(studio.getInstrumentById(addedId)->getDevice(), added);
+
+    studio.clear();
+    QVERIFY(!studio.getDevice(goneId));
+    QVERIFY(!studio.getInstrumentById(addedId));
+    QVERIFY(!studio.getInstrumentById(AudioInstrumentBase));
+}
+
+void TestStudioLookup::testBusses()
+{
+    Studio studio;
+    studio.setBussCount(8);
+
+    for (BussId id = 0; id < 8; ++id) {
+        Buss *buss = studio.getBussById(id);
+        QVERIFY(buss);
+        QCOMPARE(buss->getId(), id);
+    }
+    QVERIFY(!studio.getBussById(8));
+
+    studio.setBussCount(2);
+    QVERIFY(studio.getBussById(1));
+    QVERIFY(!studio.getBussById(2));
+}
+
+void TestStudioLookup::benchmarkInstrumentById()
+{
+    Studio studio;
+    addMidiDevices(studio, MidiDevices);
+    const std::vector<InstrumentId> ids = instrumentIds(studio);
+
+    size_t found = 0;
+    QBENCHMARK {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (studio.getInstrumentById(ids[i]))
+                ++found;
+        }
+    }
+    QVERIFY(found > 0);
+}
+
+void TestStudioLookup::benchmarkInstrumentScan()
+{
+    Studio studio;
+    addMidiDevices(studio, MidiDevices);
+    const std::vector<InstrumentId> ids = instrumentIds(studio);
+
+    size_t found = 0;
+    QBENCHMARK {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (scanForInstrument(studio, ids[i]))
+                ++found;
+        }
+    }
+    QVERIFY(found > 0);
+}
+
+QTEST_MAIN(TestStudioLookup)
+
+#include "studio_lookup.moc"